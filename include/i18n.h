@@ -2,6 +2,15 @@
 
 #define GETTEXT_PACKAGE "darkradiant"
 
+#if defined(DR_NO_TRANSLATION)
+
+// Tools built without wxWidgets (like the standalone dmap) use the untranslated strings
+#include <string>
+
+#define _(s)	(std::string(s))
+
+#else
+
 // Redefine the _() macro to return a std::string for convenience
 #ifndef WXINTL_NO_GETTEXT_MACRO
 	#define WXINTL_NO_GETTEXT_MACRO
@@ -11,6 +20,9 @@
 
 // Custom translation macros
 #define _(s)	(wxGetTranslation((s)).ToStdString())
+
+#endif
+
 #define N_(str)	str
 
 #ifndef C_
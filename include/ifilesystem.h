@@ -128,6 +128,11 @@ public:
 	/// \brief Returns the absolute filename for a relative \p name, or "" if not found.
 	virtual std::string findFile(const std::string& name) = 0;
 
+	/// \brief Returns the absolute path of the physical file the relative \p name
+	/// is read from, or "" if not found. This is the archive containing the file,
+	/// or the file itself if it is located in a directory.
+	virtual std::string findPhysicalFile(const std::string& name) = 0;
+
 	/// \brief Returns the filesystem root for an absolute \p name, or "" if not found.
 	/// This can be used to convert an absolute name to a relative name.
 	virtual std::string findRoot(const std::string& name) = 0;
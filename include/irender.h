@@ -184,6 +184,16 @@ public:
     /// Return true if this light intersects the given AABB
 	virtual bool intersectsAABB(const AABB& aabb) const = 0;
 
+    /**
+     * \brief
+     * Return a world-space AABB enclosing the whole light volume.
+     *
+     * The renderer uses these bounds to find the objects which might be lit by
+     * this light, every AABB overlapping the light volume must intersect
+     * these bounds as well.
+     */
+    virtual AABB getLightVolumeBounds() const = 0;
+
     /**
      * \brief
      * Return the light origin in world space.
@@ -230,6 +240,9 @@ public:
     /// Test if the given light intersects the LitObject
     virtual bool intersectsLight(const RendererLight& light) const = 0;
 
+    /// Return the world-space bounds used to find the lights which might intersect the object
+    virtual const AABB& getLitObjectBounds() const = 0;
+
     /// Add a light to the set of lights which do intersect this object
     virtual void insertLight(const RendererLight& light) {}
 
@@ -376,6 +389,33 @@ public:
     }
 };
 
+class OpenGLRenderable;
+
+/**
+ * \brief
+ * Draws several OpenGLRenderables of the same kind at once.
+ *
+ * Renderables sharing their vertex storage (e.g. a common vertex buffer) can
+ * return the same RenderBatch, which is then used by the backend to draw
+ * subsequent renderables of a shader pass with the same transform and light
+ * in one go, e.g. using a single glMultiDrawArrays() call.
+ */
+class RenderBatch
+{
+public:
+    virtual ~RenderBatch() {}
+
+    /**
+     * \brief
+     * Submit the OpenGL render calls for the given renderables, which all
+     * returned this batch from OpenGLRenderable::getRenderBatch(). The result
+     * must be the same as calling render() on each of them.
+     */
+    virtual void render(const RenderInfo& info,
+                        const OpenGLRenderable* const* renderables,
+                        std::size_t count) = 0;
+};
+
 /**
  * \brief
  * Interface for objects which can render themselves in OpenGL.
@@ -398,6 +438,16 @@ public:
      * Submit OpenGL render calls.
      */
     virtual void render(const RenderInfo& info) const = 0;
+
+    /**
+     * \brief
+     * Returns the batch this renderable can be drawn with, or NULL if it
+     * needs to be rendered on its own (the default).
+     */
+    virtual RenderBatch* getRenderBatch() const
+    {
+        return NULL;
+    }
 };
 
 class Matrix4;
@@ -161,6 +161,18 @@ public:
 	virtual void viewChanged() const
 	{ }
 
+	/**
+	 * Called on the main thread before a parallel collection pass. Evaluates
+	 * any pending changes that would notify other objects (like changed bounds)
+	 * and returns true if renderSolid() and renderWireframe() can then be
+	 * invoked from a worker thread, concurrently to other renderables.
+	 * Renderables returning false (the default) are collected on the main thread.
+	 */
+	virtual bool prepareParallelCollection() const
+	{
+		return false;
+	}
+
 	/**
 	 * Method to determine whether this node should be rendered as highlighted.
 	 * This is usually true for selected nodes.
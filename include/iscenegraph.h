@@ -114,6 +114,11 @@ public:
 
 	// Returns the associated spacepartition
 	virtual ISpacePartitionSystemPtr getSpacePartition() = 0;
+
+	// The number of space partition nodes visited and culled by the most
+	// recent foreach*NodeInVolume() traversal
+	virtual std::size_t getLastVisitedSPNodeCount() const = 0;
+	virtual std::size_t getLastCulledSPNodeCount() const = 0;
 };
 typedef std::shared_ptr<Graph> GraphPtr;
 typedef std::weak_ptr<Graph> GraphWeakPtr;
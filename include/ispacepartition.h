@@ -1,7 +1,6 @@
 #ifndef _ISPACE_PARTITION_H_
 #define _ISPACE_PARTITION_H_
 
-#include <list>
 #include <vector>
 #include "imodule.h"
 
@@ -43,8 +42,8 @@ public:
 	// The child nodes
 	typedef std::vector<ISPNodePtr> NodeList;
 
-	// The members
-	typedef std::list<INodePtr> MemberList;
+	// The members, stored contiguously for fast traversal
+	typedef std::vector<INodePtr> MemberList;
 
 	// Get the parent node (can be NULL for the root node)
 	virtual ISPNodePtr getParent() const = 0;
@@ -88,11 +87,49 @@ public:
 	// (node had been linked before)
 	virtual bool unlink(const scene::INodePtr& sceneNode) = 0;
 
+	// Moves a node whose bounds have changed to the ISPNode it fits best now.
+	// Returns false if the node is not linked. In batch mode the node is just
+	// marked, it will be moved by the next flush().
+	virtual bool relink(const scene::INodePtr& sceneNode) = 0;
+
+	// Enters batch mode, calls can be nested. Use this during operations changing
+	// the bounds of many nodes, to move them all at once instead of one by one.
+	virtual void beginBatch() = 0;
+
+	// Leaves batch mode, the outermost call flushes the pending changes
+	virtual void endBatch() = 0;
+
+	// Moves all nodes marked by relink() during batch mode. This needs to
+	// be called before traversing the tree, to get it up to date.
+	virtual void flush() = 0;
+
 	// Returns the root node of this SP tree (the largest one, encompassing everything)
 	virtual ISPNodePtr getRoot() const = 0;
 };
 typedef std::shared_ptr<ISpacePartitionSystem> ISpacePartitionSystemPtr;
 
+/**
+ * Keeps the given space partition system in batch mode during its lifetime.
+ */
+class SpacePartitionBatch
+{
+private:
+	ISpacePartitionSystemPtr _spacePartition;
+
+public:
+	SpacePartitionBatch(const ISpacePartitionSystemPtr& spacePartition) :
+		_spacePartition(spacePartition)
+	{
+		_spacePartition->beginBatch();
+	}
+
+	~SpacePartitionBatch()
+	{
+		_spacePartition->endBatch();
+	}
+};
+typedef std::shared_ptr<SpacePartitionBatch> SpacePartitionBatchPtr;
+
 } // namespace scene
 
 #endif /* _ISPACE_PARTITION_H_ */
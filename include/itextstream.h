@@ -98,6 +98,41 @@ public:
 	{}
 };
 
+#if defined(_MSC_VER) && _MSC_VER < 1900
+	#define ITEXTSTREAM_THREAD_LOCAL __declspec(thread)
+#else
+	#define ITEXTSTREAM_THREAD_LOCAL thread_local
+#endif
+
+/**
+ * The text written by a thread to the application streams, buffered
+ * separately for each stream.
+ */
+class ThreadLogBuffer
+{
+public:
+	std::ostringstream message;
+	std::ostringstream warning;
+	std::ostringstream error;
+	std::ostringstream debug;
+
+	// Writes the buffered text to the matching application streams and clears
+	// the buffers. Call this from the main thread, defined below.
+	void flush();
+};
+
+/**
+ * The log devices behind the application streams are not thread-safe.
+ * Worker threads can redirect all their output into a private buffer
+ * by using a ScopedThreadStreamRedirect (see below). This returns the
+ * redirection target of the calling thread, which is NULL by default.
+ */
+inline ThreadLogBuffer*& ThreadOutputStreamRedirect()
+{
+	static ITEXTSTREAM_THREAD_LOCAL ThreadLogBuffer* _redirect = NULL;
+	return _redirect;
+}
+
 /**
  * greebo: This is a simple container holding a single output stream.
  * Use the getStream() method to acquire a reference to the stream.
@@ -107,9 +142,13 @@ class OutputStreamHolder
 	NullOutputStream _nullOutputStream;
 	std::ostream* _outputStream;
 
+	// The buffer receiving the output of redirected threads
+	std::ostringstream ThreadLogBuffer::* _threadBuffer;
+
 public:
-	OutputStreamHolder() :
-		_outputStream(&_nullOutputStream)
+	OutputStreamHolder(std::ostringstream ThreadLogBuffer::* threadBuffer) :
+		_outputStream(&_nullOutputStream),
+		_threadBuffer(threadBuffer)
 	{}
 
 	void setStream(std::ostream& outputStream) {
@@ -117,7 +156,34 @@ public:
 	}
 
 	std::ostream& getStream() {
-		return *_outputStream;
+		ThreadLogBuffer* redirect = ThreadOutputStreamRedirect();
+		return redirect != NULL ? redirect->*_threadBuffer : *_outputStream;
+	}
+};
+
+/**
+ * Redirects all application streams of the calling thread into the given
+ * buffer for the lifetime of this object. It's up to the owner of the buffer
+ * to flush the captured text on the main thread.
+ * Passing a NULL target leaves the current redirection unchanged.
+ */
+class ScopedThreadStreamRedirect
+{
+	ThreadLogBuffer* _previous;
+
+public:
+	ScopedThreadStreamRedirect(ThreadLogBuffer* target) :
+		_previous(ThreadOutputStreamRedirect())
+	{
+		if (target != NULL)
+		{
+			ThreadOutputStreamRedirect() = target;
+		}
+	}
+
+	~ScopedThreadStreamRedirect()
+	{
+		ThreadOutputStreamRedirect() = _previous;
 	}
 };
 
@@ -125,25 +191,25 @@ public:
 // module (DLL/so) at the time of the first call.
 inline OutputStreamHolder& GlobalOutputStream()
 {
-	static OutputStreamHolder _holder;
+	static OutputStreamHolder _holder(&ThreadLogBuffer::message);
 	return _holder;
 }
 
 inline OutputStreamHolder& GlobalErrorStream()
 {
-	static OutputStreamHolder _holder;
+	static OutputStreamHolder _holder(&ThreadLogBuffer::error);
 	return _holder;
 }
 
 inline OutputStreamHolder& GlobalWarningStream()
 {
-	static OutputStreamHolder _holder;
+	static OutputStreamHolder _holder(&ThreadLogBuffer::warning);
 	return _holder;
 }
 
 inline OutputStreamHolder& GlobalDebugStream()
 {
-	static OutputStreamHolder _holder;
+	static OutputStreamHolder _holder(&ThreadLogBuffer::debug);
 	return _holder;
 }
 
@@ -175,6 +241,26 @@ inline std::ostream& rDebug()
     return GlobalDebugStream().getStream();
 }
 
+inline void ThreadLogBuffer::flush()
+{
+	std::string text = message.str();
+	if (!text.empty()) rMessage() << text;
+
+	text = warning.str();
+	if (!text.empty()) rWarning() << text;
+
+	text = error.str();
+	if (!text.empty()) rError() << text;
+
+	text = debug.str();
+	if (!text.empty()) rDebug() << text;
+
+	message.str(std::string());
+	warning.str(std::string());
+	error.str(std::string());
+	debug.str(std::string());
+}
+
 namespace module {
 
 // greebo: This is called once by each module at load time to initialise
@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #if !defined(INCLUDED_CULLABLE_H)
 #define INCLUDED_CULLABLE_H
 
+#include <cstddef>
 #include "VolumeIntersectionValue.h"
 
 template<typename Element> class BasicVector3;
@@ -49,6 +50,9 @@ public:
   virtual VolumeIntersectionValue TestAABB(const AABB& aabb) const = 0;
   /// \brief Returns the intersection of \p aabb transformed by \p localToWorld and volume.
   virtual VolumeIntersectionValue TestAABB(const AABB& aabb, const Matrix4& localToWorld) const = 0;
+  /// \brief Tests the \p count contiguous \p aabbs at once, writing the intersections to \p results.
+  /// Prefer this over TestAABB() when testing many boxes, it is vectorised where possible.
+  virtual void TestAABBs(const AABB* aabbs, std::size_t count, VolumeIntersectionValue* results) const = 0;
 
   virtual bool fill() const = 0;
 
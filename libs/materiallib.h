@@ -0,0 +1,302 @@
+#pragma once
+
+#include "ishaders.h"
+#include "parser/DefTokeniser.h"
+#include "string/convert.h"
+
+#include <utility>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+/**
+ * Evaluation of the material keywords determining the flags, sort, deform
+ * and coverage of a material. This is shared by the shaders module and the
+ * standalone dmap compiler, which needs the same results without loading
+ * any images or expressions. All keyword tokens are expected in lowercase.
+ */
+namespace shaders
+{
+
+// Adds the flag of the given surface parameter, like "solid" or "areaportal".
+// Returns false if the token isn't a surface parameter.
+inline bool parseSurfaceFlag(const std::string& token, int& surfaceFlags)
+{
+	static const std::pair<const char*, int> SURFACE_FLAGS[] =
+	{
+		std::make_pair("solid", Material::SURF_SOLID),
+		std::make_pair("water", Material::SURF_WATER),
+		std::make_pair("playerclip", Material::SURF_PLAYERCLIP),
+		std::make_pair("monsterclip", Material::SURF_MONSTERCLIP),
+		std::make_pair("moveableclip", Material::SURF_MOVEABLECLIP),
+		std::make_pair("ikclip", Material::SURF_IKCLIP),
+		std::make_pair("blood", Material::SURF_BLOOD),
+		std::make_pair("trigger", Material::SURF_TRIGGER),
+		std::make_pair("aassolid", Material::SURF_AASSOLID),
+		std::make_pair("aasobstacle", Material::SURF_AASOBSTACLE),
+		std::make_pair("flashlight_trigger", Material::SURF_FLASHLIGHT_TRIGGER),
+		std::make_pair("nonsolid", Material::SURF_NONSOLID),
+		std::make_pair("nullnormal", Material::SURF_NULLNORMAL),
+		std::make_pair("areaportal", Material::SURF_AREAPORTAL),
+		std::make_pair("qer_nocarve", Material::SURF_NOCARVE),
+		std::make_pair("discrete", Material::SURF_DISCRETE),
+		std::make_pair("nofragment", Material::SURF_NOFRAGMENT),
+		std::make_pair("slick", Material::SURF_SLICK),
+		std::make_pair("collision", Material::SURF_COLLISION),
+		std::make_pair("noimpact", Material::SURF_NOIMPACT),
+		std::make_pair("nodamage", Material::SURF_NODAMAGE),
+		std::make_pair("ladder", Material::SURF_LADDER),
+		std::make_pair("nosteps", Material::SURF_NOSTEPS),
+	};
+
+	for (std::size_t i = 0; i < sizeof(SURFACE_FLAGS) / sizeof(SURFACE_FLAGS[0]); ++i)
+	{
+		if (token == SURFACE_FLAGS[i].first)
+		{
+			surfaceFlags |= SURFACE_FLAGS[i].second;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Adds the flag of the given global material keyword, like "noshadows" or
+// "forceopaque", some of which also determine the coverage.
+// Returns false if the token isn't one of these keywords.
+inline bool parseMaterialFlag(const std::string& token, int& materialFlags, Material::Coverage& coverage)
+{
+	if (token == "translucent")
+	{
+		materialFlags |= Material::FLAG_TRANSLUCENT | Material::FLAG_NOSHADOWS;
+		coverage = Material::MC_TRANSLUCENT;
+	}
+	else if (token == "noshadows")
+	{
+		materialFlags |= Material::FLAG_NOSHADOWS;
+	}
+	else if (token == "noselfshadow")
+	{
+		materialFlags |= Material::FLAG_NOSELFSHADOW;
+	}
+	else if (token == "forceshadows")
+	{
+		materialFlags |= Material::FLAG_FORCESHADOWS;
+	}
+	else if (token == "nooverlays")
+	{
+		materialFlags |= Material::FLAG_NOOVERLAYS;
+	}
+	else if (token == "forceoverlays")
+	{
+		materialFlags |= Material::FLAG_FORCEOVERLAYS;
+	}
+	else if (token == "forceopaque")
+	{
+		materialFlags |= Material::FLAG_FORCEOPAQUE;
+		coverage = Material::MC_OPAQUE;
+	}
+	else if (token == "nofog")
+	{
+		materialFlags |= Material::FLAG_NOFOG;
+	}
+	else if (token == "noportalfog")
+	{
+		materialFlags |= Material::FLAG_NOPORTALFOG;
+	}
+	else if (token == "unsmoothedtangents")
+	{
+		materialFlags |= Material::FLAG_UNSMOOTHEDTANGENTS;
+	}
+	else if (token == "mirror")
+	{
+		materialFlags |= Material::FLAG_MIRROR;
+		coverage = Material::MC_OPAQUE;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+// Converts the value of the "sort" keyword, which is either a sort
+// keyword or a number. Returns the given fallback value if it's neither.
+inline int parseSortRequest(const std::string& value, int fallback)
+{
+	std::string sortVal = boost::algorithm::to_lower_copy(value);
+
+	if (sortVal == "opaque") return Material::SORT_OPAQUE;
+	if (sortVal == "decal") return Material::SORT_DECAL;
+	if (sortVal == "portalsky") return Material::SORT_PORTAL_SKY;
+	if (sortVal == "subview") return Material::SORT_SUBVIEW;
+	if (sortVal == "far") return Material::SORT_FAR;
+	if (sortVal == "medium") return Material::SORT_MEDIUM;
+	if (sortVal == "close") return Material::SORT_CLOSE;
+	if (sortVal == "almostnearest") return Material::SORT_ALMOST_NEAREST;
+	if (sortVal == "nearest") return Material::SORT_NEAREST;
+	if (sortVal == "postprocess") return Material::SORT_POST_PROCESS;
+
+	// Strip any quotes
+	boost::algorithm::trim_if(sortVal, boost::algorithm::is_any_of("\""));
+
+	return string::convert<int>(sortVal, fallback);
+}
+
+// greebo: It appears that D3 is applying default sort values for material without
+// an explicitly defined sort value, depending on a couple of things I didn't really investigate
+// Some blend materials get SORT_MEDIUM applied by default, diffuses get OPAQUE assigned, but lights do not, etc.
+inline int getDefaultSortRequest(int materialFlags)
+{
+	// Translucent materials need to be drawn after opaque ones, if not explicitly specified otherwise
+	return (materialFlags & Material::FLAG_TRANSLUCENT) ? Material::SORT_MEDIUM : Material::SORT_OPAQUE;
+}
+
+// Skips a single expression term, which is either a single token or a parenthesised expression
+inline void skipExpressionTerm(parser::DefTokeniser& tokeniser)
+{
+	if (tokeniser.nextToken() != "(")
+	{
+		return;
+	}
+
+	for (std::size_t level = 1; level > 0;)
+	{
+		std::string token = tokeniser.nextToken();
+
+		if (token == ")")
+		{
+			--level;
+		}
+		else if (token == "(")
+		{
+			++level;
+		}
+	}
+}
+
+// Parses the arguments of the "deform" keyword. The deform type is set if
+// it is known, its parameters are skipped.
+inline void parseDeform(parser::DefTokeniser& tokeniser, Material::DeformType& deformType)
+{
+	std::string type = boost::algorithm::to_lower_copy(tokeniser.nextToken());
+
+	if (type == "sprite")
+	{
+		deformType = Material::DEFORM_SPRITE;
+	}
+	else if (type == "tube")
+	{
+		deformType = Material::DEFORM_TUBE;
+	}
+	else if (type == "flare")
+	{
+		deformType = Material::DEFORM_FLARE;
+
+		skipExpressionTerm(tokeniser); // skip size info
+	}
+	else if (type == "expand")
+	{
+		deformType = Material::DEFORM_EXPAND;
+
+		skipExpressionTerm(tokeniser); // skip amount
+	}
+	else if (type == "move")
+	{
+		deformType = Material::DEFORM_MOVE;
+
+		skipExpressionTerm(tokeniser); // skip amount
+	}
+	else if (type == "turbulent")
+	{
+		deformType = Material::DEFORM_TURBULENT;
+
+		tokeniser.skipTokens(1); // skip table name
+
+		skipExpressionTerm(tokeniser); // range
+		skipExpressionTerm(tokeniser); // timeoffset
+		skipExpressionTerm(tokeniser); // domain
+	}
+	else if (type == "eyeball")
+	{
+		deformType = Material::DEFORM_EYEBALL;
+	}
+	else if (type == "particle")
+	{
+		deformType = Material::DEFORM_PARTICLE;
+
+		tokeniser.skipTokens(1); // skip particle name
+	}
+	else if (type == "particle2")
+	{
+		deformType = Material::DEFORM_PARTICLE2;
+
+		tokeniser.skipTokens(1); // skip particle name
+	}
+}
+
+// Returns true if a stage with the given blend function strings, like ("add", "")
+// or ("gl_one", "gl_zero"), is blending with the destination colour.
+// Unknown GL blend modes are treated as gl_zero.
+inline bool blendsWithDestination(const std::pair<std::string, std::string>& blendFunc)
+{
+	std::string src = boost::algorithm::to_lower_copy(blendFunc.first);
+	std::string dest = boost::algorithm::to_lower_copy(blendFunc.second);
+
+	// The predefined blend modes are all reading the destination
+	if (src == "add" || src == "modulate" || src == "filter" || src == "blend" || src == "none")
+	{
+		return true;
+	}
+
+	if (src == "gl_dst_color" || src == "gl_one_minus_dst_color" ||
+		src == "gl_dst_alpha" || src == "gl_one_minus_dst_alpha")
+	{
+		return true;
+	}
+
+	return dest == "gl_one" || dest == "gl_src_color" || dest == "gl_one_minus_src_color" ||
+		dest == "gl_src_alpha" || dest == "gl_one_minus_src_alpha" || dest == "gl_dst_color" ||
+		dest == "gl_one_minus_dst_color" || dest == "gl_dst_alpha" || dest == "gl_one_minus_dst_alpha" ||
+		dest == "gl_src_alpha_saturate";
+}
+
+// Determines the coverage of a material which didn't specify it by a keyword, given the number of
+// stages with an image, how many of them are interaction stages and the blend function of the first one
+inline Material::Coverage determineCoverage(std::size_t numStages, std::size_t numInteractionStages,
+	const std::pair<std::string, std::string>& firstStageBlendFunc)
+{
+	// automatically set MC_TRANSLUCENT if we don't have any interaction stages and
+	// the first stage is blended and not an alpha test mask or a subview
+	if (numStages == 0)
+	{
+		// non-visible
+		return Material::MC_TRANSLUCENT;
+	}
+
+	if (numInteractionStages > 0)
+	{
+		// we have an interaction draw
+		return Material::MC_OPAQUE;
+	}
+
+	// If the layers are blended with the destination, we consider it translucent
+	return blendsWithDestination(firstStageBlendFunc) ? Material::MC_TRANSLUCENT : Material::MC_OPAQUE;
+}
+
+// Sets the flags implied by the final coverage of a material
+inline void applyCoverageFlags(Material::Coverage coverage, int& materialFlags, int& surfaceFlags)
+{
+	// translucent automatically implies noshadows
+	if (coverage == Material::MC_TRANSLUCENT)
+	{
+		materialFlags |= Material::FLAG_NOSHADOWS;
+	}
+	else
+	{
+		// mark the contents as opaque
+		surfaceFlags |= Material::SURF_OPAQUE;
+	}
+}
+
+} // namespace
@@ -2,6 +2,14 @@
 
 #include "AABB.h"
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_USE_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_USE_SSE2
+#endif
+
 // Normalise all planes in frustum
 void Frustum::normalisePlanes()
 {
@@ -128,6 +136,170 @@ VolumeIntersectionValue Frustum::testIntersection(const AABB& aabb) const
     return result;
 }
 
+namespace
+{
+
+// The frustum planes, broadcast to all lanes of a SIMD register.
+// The computation is the same as in AABB::classifyPlane(), in the same
+// order of operations, such that the results are identical.
+#if defined(FRUSTUM_USE_AVX)
+
+struct PackedPlane
+{
+	__m256d nx, ny, nz;
+	__m256d absX, absY, absZ;
+	__m256d dist;
+};
+
+inline void packPlane(const Plane3& plane, PackedPlane& packed)
+{
+	packed.nx = _mm256_set1_pd(plane.normal().x());
+	packed.ny = _mm256_set1_pd(plane.normal().y());
+	packed.nz = _mm256_set1_pd(plane.normal().z());
+	packed.absX = _mm256_set1_pd(fabs(plane.normal().x()));
+	packed.absY = _mm256_set1_pd(fabs(plane.normal().y()));
+	packed.absZ = _mm256_set1_pd(fabs(plane.normal().z()));
+	packed.dist = _mm256_set1_pd(plane.dist());
+}
+
+// Tests four AABBs, returns the bit masks of the ones being outside and inside
+inline void testPacked(const PackedPlane planes[6], const AABB* aabbs, int& outsideMask, int& insideMask)
+{
+	const AABB& a = aabbs[0];
+	const AABB& b = aabbs[1];
+	const AABB& c = aabbs[2];
+	const AABB& d = aabbs[3];
+
+	__m256d ox = _mm256_set_pd(d.origin.x(), c.origin.x(), b.origin.x(), a.origin.x());
+	__m256d oy = _mm256_set_pd(d.origin.y(), c.origin.y(), b.origin.y(), a.origin.y());
+	__m256d oz = _mm256_set_pd(d.origin.z(), c.origin.z(), b.origin.z(), a.origin.z());
+	__m256d ex = _mm256_set_pd(d.extents.x(), c.extents.x(), b.extents.x(), a.extents.x());
+	__m256d ey = _mm256_set_pd(d.extents.y(), c.extents.y(), b.extents.y(), a.extents.y());
+	__m256d ez = _mm256_set_pd(d.extents.z(), c.extents.z(), b.extents.z(), a.extents.z());
+
+	__m256d zero = _mm256_setzero_pd();
+	__m256d outside = zero;
+	__m256d inside = _mm256_cmp_pd(zero, zero, _CMP_EQ_OQ); // all bits set
+
+	for (std::size_t p = 0; p < 6; ++p)
+	{
+		const PackedPlane& plane = planes[p];
+
+		__m256d originDot = _mm256_add_pd(_mm256_add_pd(
+			_mm256_mul_pd(plane.nx, ox), _mm256_mul_pd(plane.ny, oy)), _mm256_mul_pd(plane.nz, oz));
+		__m256d extentsDot = _mm256_add_pd(_mm256_add_pd(
+			_mm256_mul_pd(plane.absX, ex), _mm256_mul_pd(plane.absY, ey)), _mm256_mul_pd(plane.absZ, ez));
+
+		__m256d maxDist = _mm256_sub_pd(_mm256_add_pd(originDot, extentsDot), plane.dist);
+		__m256d minDist = _mm256_sub_pd(_mm256_sub_pd(originDot, extentsDot), plane.dist);
+
+		outside = _mm256_or_pd(outside, _mm256_cmp_pd(maxDist, zero, _CMP_LT_OQ));
+		inside = _mm256_and_pd(inside, _mm256_cmp_pd(minDist, zero, _CMP_GE_OQ));
+	}
+
+	outsideMask = _mm256_movemask_pd(outside);
+	insideMask = _mm256_movemask_pd(inside);
+}
+
+const std::size_t PACKET_SIZE = 4;
+
+#elif defined(FRUSTUM_USE_SSE2)
+
+struct PackedPlane
+{
+	__m128d nx, ny, nz;
+	__m128d absX, absY, absZ;
+	__m128d dist;
+};
+
+inline void packPlane(const Plane3& plane, PackedPlane& packed)
+{
+	packed.nx = _mm_set1_pd(plane.normal().x());
+	packed.ny = _mm_set1_pd(plane.normal().y());
+	packed.nz = _mm_set1_pd(plane.normal().z());
+	packed.absX = _mm_set1_pd(fabs(plane.normal().x()));
+	packed.absY = _mm_set1_pd(fabs(plane.normal().y()));
+	packed.absZ = _mm_set1_pd(fabs(plane.normal().z()));
+	packed.dist = _mm_set1_pd(plane.dist());
+}
+
+// Tests two AABBs, returns the bit masks of the ones being outside and inside
+inline void testPacked(const PackedPlane planes[6], const AABB* aabbs, int& outsideMask, int& insideMask)
+{
+	const AABB& a = aabbs[0];
+	const AABB& b = aabbs[1];
+
+	__m128d ox = _mm_set_pd(b.origin.x(), a.origin.x());
+	__m128d oy = _mm_set_pd(b.origin.y(), a.origin.y());
+	__m128d oz = _mm_set_pd(b.origin.z(), a.origin.z());
+	__m128d ex = _mm_set_pd(b.extents.x(), a.extents.x());
+	__m128d ey = _mm_set_pd(b.extents.y(), a.extents.y());
+	__m128d ez = _mm_set_pd(b.extents.z(), a.extents.z());
+
+	__m128d zero = _mm_setzero_pd();
+	__m128d outside = zero;
+	__m128d inside = _mm_cmpeq_pd(zero, zero); // all bits set
+
+	for (std::size_t p = 0; p < 6; ++p)
+	{
+		const PackedPlane& plane = planes[p];
+
+		__m128d originDot = _mm_add_pd(_mm_add_pd(
+			_mm_mul_pd(plane.nx, ox), _mm_mul_pd(plane.ny, oy)), _mm_mul_pd(plane.nz, oz));
+		__m128d extentsDot = _mm_add_pd(_mm_add_pd(
+			_mm_mul_pd(plane.absX, ex), _mm_mul_pd(plane.absY, ey)), _mm_mul_pd(plane.absZ, ez));
+
+		__m128d maxDist = _mm_sub_pd(_mm_add_pd(originDot, extentsDot), plane.dist);
+		__m128d minDist = _mm_sub_pd(_mm_sub_pd(originDot, extentsDot), plane.dist);
+
+		outside = _mm_or_pd(outside, _mm_cmplt_pd(maxDist, zero));
+		inside = _mm_and_pd(inside, _mm_cmpge_pd(minDist, zero));
+	}
+
+	outsideMask = _mm_movemask_pd(outside);
+	insideMask = _mm_movemask_pd(inside);
+}
+
+const std::size_t PACKET_SIZE = 2;
+
+#endif
+
+}
+
+void Frustum::testIntersection(const AABB* aabbs, std::size_t count, VolumeIntersectionValue* results) const
+{
+	std::size_t i = 0;
+
+#if defined(FRUSTUM_USE_AVX) || defined(FRUSTUM_USE_SSE2)
+	PackedPlane planes[6];
+
+	packPlane(right, planes[0]);
+	packPlane(left, planes[1]);
+	packPlane(bottom, planes[2]);
+	packPlane(top, planes[3]);
+	packPlane(back, planes[4]);
+	packPlane(front, planes[5]);
+
+	for (; i + PACKET_SIZE <= count; i += PACKET_SIZE)
+	{
+		int outsideMask, insideMask;
+		testPacked(planes, aabbs + i, outsideMask, insideMask);
+
+		for (std::size_t j = 0; j < PACKET_SIZE; ++j)
+		{
+			results[i + j] = (outsideMask & (1 << j)) ? VOLUME_OUTSIDE :
+				(insideMask & (1 << j)) ? VOLUME_INSIDE : VOLUME_PARTIAL;
+		}
+	}
+#endif
+
+	// The remaining ones (or all of them without SIMD support)
+	for (; i < count; ++i)
+	{
+		results[i] = testIntersection(aabbs[i]);
+	}
+}
+
 VolumeIntersectionValue Frustum::testIntersection(const AABB& aabb, const Matrix4& localToWorld) const
 {
 	AABB aabb_world(aabb);
@@ -63,6 +63,14 @@ public:
      */
     VolumeIntersectionValue testIntersection(const AABB& aabb) const;
 
+	/**
+	 * Test the intersection of this frustum with the given number of
+	 * contiguous AABBs, storing one result per AABB. The results are the
+	 * same as the ones of the single-AABB variant, but the boxes are
+	 * tested in parallel using SSE2 or AVX instructions where available.
+	 */
+	void testIntersection(const AABB* aabbs, std::size_t count, VolumeIntersectionValue* results) const;
+
 	/**
 	 * Test the intersection of this frustum with a transformed AABB.
 	 */
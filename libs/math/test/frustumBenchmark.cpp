@@ -0,0 +1,121 @@
+/**
+ * Microbenchmark comparing the single-AABB frustum test against the
+ * batched one. Not run as part of the tests, build and run it with
+ * "make frustumBenchmark && ./frustumBenchmark [numBoxes] [numRuns]".
+ */
+#include <math/Frustum.h>
+#include <math/AABB.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    Frustum createFrustum()
+    {
+        // A 90 degree field of view, as in the camera view
+        Matrix4 projection = Matrix4::byColumns(
+            1, 0, 0, 0,
+            0, 1, 0, 0,
+            0, 0, -1.0001, -1,
+            0, 0, -2, 0
+        );
+
+        Matrix4 modelview = Matrix4::getRotationForEulerXYZDegrees(Vector3(-80, 0, 35));
+        modelview.translateBy(Vector3(-512, 300, -128));
+
+        return Frustum::createFromViewproj(projection.getMultipliedBy(modelview));
+    }
+
+    // Returns the best time of the given number of runs, in nanoseconds per box
+    template<typename Func>
+    double measure(std::size_t numBoxes, std::size_t numRuns, const Func& func)
+    {
+        double best = 0;
+
+        for (std::size_t run = 0; run < numRuns; ++run)
+        {
+            Clock::time_point start = Clock::now();
+            func();
+            double nanoseconds = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+            if (run == 0 || nanoseconds < best)
+            {
+                best = nanoseconds;
+            }
+        }
+
+        return best / numBoxes;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::size_t numBoxes = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 100000;
+    std::size_t numRuns = argc > 2 ? std::strtoul(argv[2], NULL, 10) : 50;
+
+    if (numBoxes == 0 || numRuns == 0)
+    {
+        std::cerr << "Usage: frustumBenchmark [numBoxes] [numRuns]" << std::endl;
+        return 1;
+    }
+
+    Frustum frustum = createFrustum();
+
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<double> position(-8192, 8192);
+    std::uniform_real_distribution<double> size(4, 256);
+
+    std::vector<AABB> boxes;
+
+    for (std::size_t i = 0; i < numBoxes; ++i)
+    {
+        boxes.push_back(AABB(Vector3(position(generator), position(generator), position(generator)),
+                             Vector3(size(generator), size(generator), size(generator))));
+    }
+
+    std::vector<VolumeIntersectionValue> results(numBoxes);
+
+    double single = measure(numBoxes, numRuns, [&]()
+    {
+        for (std::size_t i = 0; i < numBoxes; ++i)
+        {
+            results[i] = frustum.testIntersection(boxes[i]);
+        }
+    });
+
+    std::size_t numVisible = 0;
+
+    for (std::size_t i = 0; i < numBoxes; ++i)
+    {
+        if (results[i] != VOLUME_OUTSIDE) ++numVisible;
+    }
+
+    double batched = measure(numBoxes, numRuns, [&]()
+    {
+        frustum.testIntersection(&boxes.front(), numBoxes, &results.front());
+    });
+
+    // Batches of the size used by the scenegraph traversal
+    const std::size_t BATCH_SIZE = 32;
+
+    double smallBatches = measure(numBoxes, numRuns, [&]()
+    {
+        for (std::size_t start = 0; start < numBoxes; start += BATCH_SIZE)
+        {
+            frustum.testIntersection(&boxes[start], std::min(BATCH_SIZE, numBoxes - start), &results[start]);
+        }
+    });
+
+    std::cout << numBoxes << " boxes, " << numVisible << " visible, best of " << numRuns << " runs" << std::endl;
+    std::cout << "single:            " << single << " ns/box" << std::endl;
+    std::cout << "batched:           " << batched << " ns/box" << std::endl;
+    std::cout << "batches of " << BATCH_SIZE << ":     " << smallBatches << " ns/box" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE frustumTest
+#include <boost/test/unit_test.hpp>
+
+#include <math/Frustum.h>
+#include <math/AABB.h>
+
+#include <vector>
+#include <random>
+
+namespace
+{
+    // A pyramid looking down the x axis with a 90 degree field of view,
+    // rotated and moved away from the origin
+    Frustum createFrustum()
+    {
+        const double HALF_SQRT2 = sqrt(2.0) / 2;
+
+        Frustum frustum(
+            Plane3(HALF_SQRT2, -HALF_SQRT2, 0, 0), // right
+            Plane3(HALF_SQRT2, HALF_SQRT2, 0, 0),  // left
+            Plane3(HALF_SQRT2, 0, HALF_SQRT2, 0),  // bottom
+            Plane3(HALF_SQRT2, 0, -HALF_SQRT2, 0), // top
+            Plane3(-1, 0, 0, -8192),               // back
+            Plane3(1, 0, 0, 4)                     // front
+        );
+
+        Matrix4 transform = Matrix4::getTranslation(Vector3(300, -1200, 64));
+        transform.multiplyBy(Matrix4::getRotationForEulerXYZDegrees(Vector3(10, 25, 130)));
+
+        return frustum.getTransformedBy(transform);
+    }
+
+    std::vector<AABB> createRandomBoxes(std::size_t count)
+    {
+        std::mt19937 generator(1234);
+        std::uniform_real_distribution<double> position(-10000, 10000);
+        std::uniform_real_distribution<double> size(0, 1024);
+
+        std::vector<AABB> boxes;
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            boxes.push_back(AABB(Vector3(position(generator), position(generator), position(generator)),
+                                 Vector3(size(generator), size(generator), size(generator))));
+        }
+
+        return boxes;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(batchedIntersectionMatchesSingleTests)
+{
+    Frustum frustum = createFrustum();
+
+    // An odd number of boxes, to exercise the remainder handling
+    std::vector<AABB> boxes = createRandomBoxes(10007);
+    boxes.push_back(AABB()); // invalid bounds
+
+    std::vector<VolumeIntersectionValue> results(boxes.size());
+    frustum.testIntersection(&boxes.front(), boxes.size(), &results.front());
+
+    std::size_t counts[3] = { 0, 0, 0 };
+
+    for (std::size_t i = 0; i < boxes.size(); ++i)
+    {
+        BOOST_REQUIRE_EQUAL(results[i], frustum.testIntersection(boxes[i]));
+        ++counts[results[i]];
+    }
+
+    // Make sure all cases are covered
+    BOOST_CHECK(counts[VOLUME_OUTSIDE] > 0);
+    BOOST_CHECK(counts[VOLUME_INSIDE] > 0);
+    BOOST_CHECK(counts[VOLUME_PARTIAL] > 0);
+}
+
+BOOST_AUTO_TEST_CASE(batchedIntersectionOfFewBoxes)
+{
+    Frustum frustum = createFrustum();
+    std::vector<AABB> boxes = createRandomBoxes(3);
+
+    for (std::size_t count = 0; count <= boxes.size(); ++count)
+    {
+        VolumeIntersectionValue results[3] = { VOLUME_PARTIAL, VOLUME_PARTIAL, VOLUME_PARTIAL };
+        frustum.testIntersection(&boxes.front(), count, results);
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            BOOST_CHECK_EQUAL(results[i], frustum.testIntersection(boxes[i]));
+        }
+    }
+}
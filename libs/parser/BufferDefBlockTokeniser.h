@@ -0,0 +1,349 @@
+#ifndef BUFFER_DEF_BLOCK_TOKENISER_H_
+#define BUFFER_DEF_BLOCK_TOKENISER_H_
+
+#include "DefBlockTokeniser.h"
+#include "BufferDefTokeniser.h"
+
+namespace parser {
+
+/**
+ * BlockTokeniser working on a contiguous character buffer, with the same
+ * semantics as DefBlockTokeniserFunc.
+ *
+ * The block contents are returned by nextBlockView() as a reference into the
+ * buffer, only the (short) block names are copied. The buffer ownership
+ * rules are the same as BufferDefTokeniser's.
+ */
+class BufferDefBlockTokeniser :
+    public BlockTokeniser
+{
+public:
+    struct BlockView
+    {
+        // The name of this block
+        std::string name;
+
+        // The block contents (excluding braces), referencing the buffer
+        StringView contents;
+    };
+
+private:
+    enum State
+    {
+        SEARCHING_NAME,
+        TOKEN_STARTED,
+        SEARCHING_BLOCK,
+        BLOCK_CONTENT,
+        FORWARDSLASH,
+        COMMENT_EOL,
+        COMMENT_DELIM,
+        STAR
+    };
+
+    // Only used by the stream constructor
+    std::string _ownedBuffer;
+
+    const char* _pos;
+    const char* _end;
+
+    bool _delims[256];
+
+    const char _blockStartChar;
+    const char _blockEndChar;
+
+    // The block returned by the next call to nextBlock()
+    BlockView _next;
+    bool _hasNext;
+
+    // The block returned last by nextBlockView()
+    BlockView _current;
+
+public:
+    // Construct a tokeniser for the given characters, which are not copied
+    BufferDefBlockTokeniser(const char* data, std::size_t size,
+                            const char* delims = " \t\n\v\r",
+                            const char blockStartChar = '{',
+                            const char blockEndChar = '}') :
+        _pos(data),
+        _end(data + size),
+        _blockStartChar(blockStartChar),
+        _blockEndChar(blockEndChar)
+    {
+        init(delims);
+    }
+
+    // Construct a tokeniser referencing the given string, which is not copied
+    BufferDefBlockTokeniser(const std::string& str,
+                            const char* delims = " \t\n\v\r",
+                            const char blockStartChar = '{',
+                            const char blockEndChar = '}') :
+        _pos(str.data()),
+        _end(str.data() + str.size()),
+        _blockStartChar(blockStartChar),
+        _blockEndChar(blockEndChar)
+    {
+        init(delims);
+    }
+
+    // A temporary string would be destroyed before the blocks are read
+    BufferDefBlockTokeniser(std::string&& str,
+                            const char* delims = " \t\n\v\r",
+                            const char blockStartChar = '{',
+                            const char blockEndChar = '}') = delete;
+
+    // Construct a tokeniser for the remaining contents of the given stream,
+    // which is read completely into an internal buffer
+    BufferDefBlockTokeniser(std::istream& str,
+                            const char* delims = " \t\n\v\r",
+                            const char blockStartChar = '{',
+                            const char blockEndChar = '}') :
+        _blockStartChar(blockStartChar),
+        _blockEndChar(blockEndChar)
+    {
+        readStream(str, _ownedBuffer);
+
+        _pos = _ownedBuffer.data();
+        _end = _ownedBuffer.data() + _ownedBuffer.size();
+
+        init(delims);
+    }
+
+    BufferDefBlockTokeniser(const BufferDefBlockTokeniser& other) = delete;
+    BufferDefBlockTokeniser& operator=(const BufferDefBlockTokeniser& other) = delete;
+
+    bool hasMoreBlocks()
+    {
+        return _hasNext;
+    }
+
+    Block nextBlock()
+    {
+        const BlockView& view = nextBlockView();
+
+        Block block;
+        block.name = view.name;
+        block.contents = view.contents.str();
+
+        return block;
+    }
+
+    /**
+     * Return the next block without copying its contents. The returned
+     * reference is valid until the next call to nextBlock() or nextBlockView().
+     *
+     * @pre
+     * hasMoreBlocks() must be true, otherwise an exception will be thrown.
+     */
+    const BlockView& nextBlockView()
+    {
+        if (!_hasNext)
+        {
+            throw ParseException("BlockTokeniser: no more blocks");
+        }
+
+        _current.name.swap(_next.name);
+        _current.contents = _next.contents;
+
+        _hasNext = readBlock(_next);
+
+        return _current;
+    }
+
+private:
+    void init(const char* delims)
+    {
+        for (std::size_t i = 0; i < 256; ++i)
+        {
+            _delims[i] = false;
+        }
+
+        for (const char* c = delims; *c != 0; ++c)
+        {
+            _delims[static_cast<unsigned char>(*c)] = true;
+        }
+
+        _hasNext = readBlock(_next);
+    }
+
+    bool isDelim(char c) const
+    {
+        return _delims[static_cast<unsigned char>(c)];
+    }
+
+    // Reads the block following _pos, see DefBlockTokeniserFunc for the states
+    bool readBlock(BlockView& block)
+    {
+        State state = SEARCHING_NAME;
+
+        block.name.clear();
+        block.contents = StringView();
+
+        const char* next = _pos;
+        const char* end = _end;
+        const char* contentStart = NULL;
+        std::size_t blockLevel = 0;
+
+        while (next != end)
+        {
+            char ch = *next;
+
+            switch (state)
+            {
+            case SEARCHING_NAME:
+
+                if (isDelim(ch))
+                {
+                    ++next;
+                    continue;
+                }
+
+                state = TOKEN_STARTED;
+                // fall through
+
+            case TOKEN_STARTED:
+
+                if (isDelim(ch))
+                {
+                    state = SEARCHING_BLOCK;
+                    continue;
+                }
+
+                if (ch == '/')
+                {
+                    // Possible comment, the slash is added later if it isn't
+                    state = FORWARDSLASH;
+                    ++next;
+                    continue;
+                }
+
+                block.name += ch;
+                ++next;
+                continue;
+
+            case SEARCHING_BLOCK:
+
+                if (isDelim(ch))
+                {
+                    ++next;
+                }
+                else if (ch == _blockStartChar)
+                {
+                    state = BLOCK_CONTENT;
+                    blockLevel++;
+                    contentStart = ++next;
+                }
+                else if (ch == '/')
+                {
+                    state = FORWARDSLASH;
+                    ++next;
+                }
+                else
+                {
+                    // Another word of the name
+                    block.name += ' ';
+                    block.name += ch;
+
+                    state = TOKEN_STARTED;
+                    ++next;
+                }
+                continue;
+
+            case BLOCK_CONTENT:
+
+                // Skip to the matching closing brace, the contents are
+                // referenced directly
+                for (; next != end; ++next)
+                {
+                    if (*next == _blockEndChar)
+                    {
+                        if (--blockLevel == 0)
+                        {
+                            block.contents = StringView(contentStart,
+                                static_cast<std::size_t>(next - contentStart));
+
+                            _pos = next + 1;
+                            return true;
+                        }
+                    }
+                    else if (*next == _blockStartChar)
+                    {
+                        blockLevel++;
+                    }
+                }
+                continue;
+
+            case FORWARDSLASH:
+
+                switch (ch)
+                {
+                case '*':
+                    state = COMMENT_DELIM;
+                    ++next;
+                    continue;
+
+                case '/':
+                    state = COMMENT_EOL;
+                    ++next;
+                    continue;
+
+                default:
+                    // Not a comment, add the slash and carry on
+                    state = TOKEN_STARTED;
+                    block.name += '/';
+                    continue;
+                }
+
+            case COMMENT_DELIM:
+
+                if (ch == '*')
+                {
+                    state = STAR;
+                }
+
+                ++next;
+                continue;
+
+            case COMMENT_EOL:
+
+                if (ch == '\r' || ch == '\n')
+                {
+                    // An EOL comment with non-empty name means searching for block
+                    state = block.name.empty() ? SEARCHING_NAME : SEARCHING_BLOCK;
+                }
+
+                ++next;
+                continue;
+
+            case STAR:
+
+                if (ch == '/')
+                {
+                    // End of comment
+                    state = block.name.empty() ? SEARCHING_NAME : SEARCHING_BLOCK;
+                }
+                else if (ch != '*')
+                {
+                    // Remain in the STAR state for "**/"
+                    state = COMMENT_DELIM;
+                }
+
+                ++next;
+                continue;
+            }
+        }
+
+        _pos = next;
+
+        if (state == BLOCK_CONTENT)
+        {
+            // Unterminated block, return everything up to the end
+            block.contents = StringView(contentStart, static_cast<std::size_t>(end - contentStart));
+        }
+
+        return !block.name.empty();
+    }
+};
+
+} // namespace parser
+
+#endif /* BUFFER_DEF_BLOCK_TOKENISER_H_ */
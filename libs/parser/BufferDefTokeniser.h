@@ -0,0 +1,628 @@
+#ifndef BUFFER_DEF_TOKENISER_H_
+#define BUFFER_DEF_TOKENISER_H_
+
+#include "DefTokeniser.h"
+
+#include <string>
+#include <cstring>
+#include <istream>
+#include <ostream>
+
+namespace parser {
+
+/**
+ * A non-owning reference to a range of characters, similar to C++17's
+ * std::string_view. The referenced characters are not null-terminated.
+ */
+class StringView
+{
+    const char* _data;
+    std::size_t _size;
+
+public:
+    StringView() :
+        _data(""),
+        _size(0)
+    {}
+
+    StringView(const char* data, std::size_t size) :
+        _data(data),
+        _size(size)
+    {}
+
+    StringView(const std::string& str) :
+        _data(str.data()),
+        _size(str.size())
+    {}
+
+    const char* data() const
+    {
+        return _data;
+    }
+
+    std::size_t size() const
+    {
+        return _size;
+    }
+
+    bool empty() const
+    {
+        return _size == 0;
+    }
+
+    const char* begin() const
+    {
+        return _data;
+    }
+
+    const char* end() const
+    {
+        return _data + _size;
+    }
+
+    char operator[](std::size_t index) const
+    {
+        return _data[index];
+    }
+
+    // Returns a copy of the referenced characters
+    std::string str() const
+    {
+        return std::string(_data, _size);
+    }
+
+    bool operator==(const StringView& other) const
+    {
+        return _size == other._size && std::memcmp(_data, other._data, _size) == 0;
+    }
+
+    bool operator!=(const StringView& other) const
+    {
+        return !operator==(other);
+    }
+
+    bool operator==(const char* str) const
+    {
+        return operator==(StringView(str, std::strlen(str)));
+    }
+
+    bool operator!=(const char* str) const
+    {
+        return !operator==(str);
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const StringView& view)
+{
+    return os.write(view.data(), view.size());
+}
+
+/**
+ * Appends the remaining contents of the given stream to the string, reading
+ * it in large chunks instead of character by character.
+ */
+inline void readStream(std::istream& stream, std::string& buffer)
+{
+    char chunk[16384];
+
+    while (stream.read(chunk, sizeof(chunk)) || stream.gcount() > 0)
+    {
+        buffer.append(chunk, static_cast<std::size_t>(stream.gcount()));
+    }
+}
+
+/**
+ * DefTokeniser working on a contiguous character buffer, e.g. a preloaded
+ * file or a memory-mapped archive entry.
+ *
+ * The comment and quote handling is the same as DefTokeniserFunc's, but
+ * no string is constructed unless requested: nextTokenView() and peekView()
+ * return references into the buffer. Only quoted tokens containing escape
+ * sequences or continuations ("abc" \ "def") are assembled in an internal
+ * scratch buffer.
+ *
+ * A view returned by nextTokenView() stays valid until the next call to
+ * nextTokenView(), nextToken() or skipTokens(), as long as the buffer exists.
+ * The std::string and character buffer constructors don't copy the input,
+ * it must outlive the tokeniser. The stream constructor reads the whole
+ * stream into a buffer owned by the tokeniser.
+ */
+class BufferDefTokeniser :
+    public DefTokeniser
+{
+    enum State
+    {
+        SEARCHING,
+        TOKEN_STARTED,
+        QUOTED,
+        AFTER_CLOSING_QUOTE,
+        SEARCHING_FOR_QUOTE,
+        FORWARDSLASH,
+        COMMENT_EOL,
+        COMMENT_DELIM,
+        STAR
+    };
+
+    // Assembles a token, referencing the buffer for as long as possible
+    class TokenBuilder
+    {
+        const char* _begin;
+        const char* _end;
+        std::string& _scratch;
+        bool _usingScratch;
+
+    public:
+        TokenBuilder(std::string& scratch) :
+            _begin(NULL),
+            _end(NULL),
+            _scratch(scratch),
+            _usingScratch(false)
+        {}
+
+        // Appends the buffer character at the given position
+        void add(const char* c)
+        {
+            if (_usingScratch)
+            {
+                _scratch += *c;
+            }
+            else if (_begin == _end)
+            {
+                _begin = c;
+                _end = c + 1;
+            }
+            else if (_end == c)
+            {
+                ++_end;
+            }
+            else
+            {
+                switchToScratch();
+                _scratch += *c;
+            }
+        }
+
+        // Appends a character not present in the buffer (e.g. an unescaped one)
+        void addTransformed(char c)
+        {
+            if (!_usingScratch)
+            {
+                switchToScratch();
+            }
+
+            _scratch += c;
+        }
+
+        bool empty() const
+        {
+            return _usingScratch ? _scratch.empty() : _begin == _end;
+        }
+
+        bool usesScratch() const
+        {
+            return _usingScratch;
+        }
+
+        StringView get() const
+        {
+            return _usingScratch ? StringView(_scratch) :
+                StringView(_begin, static_cast<std::size_t>(_end - _begin));
+        }
+
+    private:
+        void switchToScratch()
+        {
+            _scratch.assign(_begin, _end);
+            _usingScratch = true;
+        }
+    };
+
+    // Only used by the stream constructor
+    std::string _ownedBuffer;
+
+    const char* _pos;
+    const char* _end;
+
+    bool _delims[256];
+    bool _keptDelims[256];
+
+    // The token returned by the next call to nextToken()
+    StringView _next;
+    bool _hasNext;
+
+    // Tokens which can't reference the buffer are assembled here. The two
+    // strings are used alternately, such that the token returned last
+    // stays valid while the following one is read.
+    std::string _scratch[2];
+    std::size_t _scratchIndex;
+
+public:
+    /**
+     * Construct a tokeniser for the given characters, which are not copied.
+     *
+     * @param delims
+     * The list of characters to use as delimiters.
+     *
+     * @param keptDelims
+     * String of characters to treat as delimiters but return as tokens in their
+     * own right.
+     */
+    BufferDefTokeniser(const char* data, std::size_t size,
+                       const char* delims = WHITESPACE,
+                       const char* keptDelims = "{}()") :
+        _pos(data),
+        _end(data + size)
+    {
+        init(delims, keptDelims);
+    }
+
+    // Construct a tokeniser referencing the given string, which is not copied
+    BufferDefTokeniser(const std::string& str,
+                       const char* delims = WHITESPACE,
+                       const char* keptDelims = "{}()") :
+        _pos(str.data()),
+        _end(str.data() + str.size())
+    {
+        init(delims, keptDelims);
+    }
+
+    // A temporary string would be destroyed before the tokens are read
+    BufferDefTokeniser(std::string&& str,
+                       const char* delims = WHITESPACE,
+                       const char* keptDelims = "{}()") = delete;
+
+    // Construct a tokeniser for the remaining contents of the given stream,
+    // which is read completely into an internal buffer
+    BufferDefTokeniser(std::istream& str,
+                       const char* delims = WHITESPACE,
+                       const char* keptDelims = "{}()")
+    {
+        readStream(str, _ownedBuffer);
+
+        _pos = _ownedBuffer.data();
+        _end = _ownedBuffer.data() + _ownedBuffer.size();
+
+        init(delims, keptDelims);
+    }
+
+    // The views reference the buffer and the scratch strings of this instance
+    BufferDefTokeniser(const BufferDefTokeniser& other) = delete;
+    BufferDefTokeniser& operator=(const BufferDefTokeniser& other) = delete;
+
+    bool hasMoreTokens() const
+    {
+        return _hasNext;
+    }
+
+    std::string nextToken()
+    {
+        return nextTokenView().str();
+    }
+
+    /**
+     * Return the next token without copying it, see the class description
+     * for the lifetime of the returned view.
+     *
+     * @pre
+     * hasMoreTokens() must be true, otherwise an exception will be thrown.
+     */
+    StringView nextTokenView()
+    {
+        if (!_hasNext)
+        {
+            throw ParseException("DefTokeniser: no more tokens");
+        }
+
+        StringView token = _next;
+        _hasNext = readToken(_next);
+
+        return token;
+    }
+
+    std::string peek() const
+    {
+        return peekView().str();
+    }
+
+    // Returns the next token without consuming it
+    StringView peekView() const
+    {
+        if (!_hasNext)
+        {
+            throw ParseException("DefTokeniser: no more tokens");
+        }
+
+        return _next;
+    }
+
+    void assertNextToken(const std::string& val)
+    {
+        StringView tok = nextTokenView();
+
+        if (tok != StringView(val))
+        {
+            throw ParseException("DefTokeniser: Assertion failed: Required \""
+                                 + val + "\", found \"" + tok.str() + "\"");
+        }
+    }
+
+    void skipTokens(unsigned int n)
+    {
+        for (unsigned int i = 0; i < n; i++)
+        {
+            nextTokenView();
+        }
+    }
+
+private:
+    void init(const char* delims, const char* keptDelims)
+    {
+        for (std::size_t i = 0; i < 256; ++i)
+        {
+            _delims[i] = false;
+            _keptDelims[i] = false;
+        }
+
+        for (const char* c = delims; *c != 0; ++c)
+        {
+            _delims[static_cast<unsigned char>(*c)] = true;
+        }
+
+        for (const char* c = keptDelims; *c != 0; ++c)
+        {
+            _keptDelims[static_cast<unsigned char>(*c)] = true;
+        }
+
+        _scratchIndex = 0;
+        _hasNext = readToken(_next);
+    }
+
+    bool isDelim(char c) const
+    {
+        return _delims[static_cast<unsigned char>(c)];
+    }
+
+    bool isKeptDelim(char c) const
+    {
+        return _keptDelims[static_cast<unsigned char>(c)];
+    }
+
+    bool acceptToken(const char* next, const TokenBuilder& tok, StringView& token)
+    {
+        _pos = next;
+        token = tok.get();
+
+        if (tok.usesScratch())
+        {
+            // Keep this token's string intact while reading the next one
+            _scratchIndex ^= 1;
+        }
+
+        return true;
+    }
+
+    // Reads the token following _pos, see DefTokeniserFunc for the states
+    bool readToken(StringView& token)
+    {
+        State state = SEARCHING;
+        TokenBuilder tok(_scratch[_scratchIndex]);
+
+        const char* next = _pos;
+        const char* end = _end;
+
+        while (next != end)
+        {
+            switch (state)
+            {
+            case SEARCHING:
+
+                if (isDelim(*next))
+                {
+                    ++next;
+                    continue;
+                }
+
+                // A kept delimiter is a token on its own
+                if (isKeptDelim(*next))
+                {
+                    tok.add(next++);
+                    return acceptToken(next, tok, token);
+                }
+
+                state = TOKEN_STARTED;
+                // fall through
+
+            case TOKEN_STARTED:
+
+                if (isDelim(*next) || isKeptDelim(*next))
+                {
+                    return acceptToken(next, tok, token);
+                }
+
+                switch (*next)
+                {
+                case '\"':
+                    if (!tok.empty())
+                    {
+                        return acceptToken(next, tok, token);
+                    }
+
+                    state = QUOTED;
+                    ++next;
+                    continue;
+
+                case '/':
+                    // Possible comment, the slash is added later if it isn't
+                    state = FORWARDSLASH;
+                    ++next;
+                    continue;
+
+                default:
+                    tok.add(next++);
+                    continue;
+                }
+
+            case QUOTED:
+
+                if (*next == '\"')
+                {
+                    // The string might be continued by a backslash
+                    ++next;
+                    state = AFTER_CLOSING_QUOTE;
+                    continue;
+                }
+                else if (*next == '\\')
+                {
+                    ++next;
+
+                    if (next != end)
+                    {
+                        if (*next == 'n')
+                        {
+                            tok.addTransformed('\n');
+                        }
+                        else if (*next == 't')
+                        {
+                            tok.addTransformed('\t');
+                        }
+                        else if (*next == '"')
+                        {
+                            tok.addTransformed('"');
+                        }
+                        else
+                        {
+                            // No special escape sequence, keep the backslash
+                            tok.add(next - 1);
+                            tok.add(next);
+                        }
+
+                        ++next;
+                    }
+
+                    continue;
+                }
+
+                tok.add(next++);
+                continue;
+
+            case AFTER_CLOSING_QUOTE:
+
+                if (*next == '\\')
+                {
+                    ++next;
+                    state = SEARCHING_FOR_QUOTE;
+                    continue;
+                }
+
+                if (isDelim(*next))
+                {
+                    ++next;
+                    continue;
+                }
+
+                // Not continued, this might be an empty string
+                return acceptToken(next, tok, token);
+
+            case SEARCHING_FOR_QUOTE:
+
+                if (isDelim(*next))
+                {
+                    ++next;
+                    continue;
+                }
+
+                if (*next == '\"')
+                {
+                    ++next;
+                    state = QUOTED;
+                    continue;
+                }
+
+                throw ParseException("Could not find opening double quote after backslash.");
+
+            case FORWARDSLASH:
+
+                switch (*next)
+                {
+                case '*':
+                    state = COMMENT_DELIM;
+                    ++next;
+                    continue;
+
+                case '/':
+                    state = COMMENT_EOL;
+                    ++next;
+                    continue;
+
+                default:
+                    // Not a comment, add the slash preceding this character
+                    state = TOKEN_STARTED;
+                    tok.add(next - 1);
+                    continue;
+                }
+
+            case COMMENT_DELIM:
+
+                if (*next == '*')
+                {
+                    state = STAR;
+                }
+
+                ++next;
+                continue;
+
+            case COMMENT_EOL:
+
+                if (*next == '\r' || *next == '\n')
+                {
+                    ++next;
+
+                    if (!tok.empty())
+                    {
+                        return acceptToken(next, tok, token);
+                    }
+
+                    state = SEARCHING;
+                    continue;
+                }
+
+                ++next;
+                continue;
+
+            case STAR:
+
+                if (*next == '/')
+                {
+                    // End of comment
+                    ++next;
+
+                    if (!tok.empty())
+                    {
+                        return acceptToken(next, tok, token);
+                    }
+
+                    state = SEARCHING;
+                    continue;
+                }
+
+                // Remain in the STAR state for "**/"
+                state = *next == '*' ? STAR : COMMENT_DELIM;
+                ++next;
+                continue;
+            }
+        }
+
+        _pos = next;
+
+        if (tok.empty())
+        {
+            return false;
+        }
+
+        return acceptToken(next, tok, token);
+    }
+};
+
+} // namespace parser
+
+#endif /* BUFFER_DEF_TOKENISER_H_ */
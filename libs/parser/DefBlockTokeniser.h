@@ -4,6 +4,8 @@
 #include "ParseException.h"
 
 #include <string>
+#include <istream>
+#include <iterator>
 #include <ctype.h>
 #include <boost/tokenizer.hpp>
 
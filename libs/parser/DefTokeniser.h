@@ -4,6 +4,8 @@
 #include "ParseException.h"
 
 #include <string>
+#include <istream>
+#include <iterator>
 #include <boost/tokenizer.hpp>
 
 namespace parser {
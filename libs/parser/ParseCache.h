@@ -0,0 +1,454 @@
+#ifndef PARSE_CACHE_H_
+#define PARSE_CACHE_H_
+
+#include "ParseException.h"
+
+#include <map>
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <cstdint>
+#include <sys/stat.h>
+
+namespace parser
+{
+
+/**
+ * Appends little-endian binary values to a string, used to serialise the
+ * data stored in a ParseCache.
+ */
+class CacheWriter
+{
+private:
+    std::string& _buffer;
+
+public:
+    CacheWriter(std::string& buffer) :
+        _buffer(buffer)
+    {}
+
+    void writeByte(unsigned char value)
+    {
+        _buffer.push_back(static_cast<char>(value));
+    }
+
+    void writeInt(std::uint32_t value)
+    {
+        _buffer.push_back(static_cast<char>(value & 0xff));
+        _buffer.push_back(static_cast<char>((value >> 8) & 0xff));
+        _buffer.push_back(static_cast<char>((value >> 16) & 0xff));
+        _buffer.push_back(static_cast<char>((value >> 24) & 0xff));
+    }
+
+    void writeInt64(std::uint64_t value)
+    {
+        writeInt(static_cast<std::uint32_t>(value & 0xffffffff));
+        writeInt(static_cast<std::uint32_t>(value >> 32));
+    }
+
+    void writeString(const std::string& str)
+    {
+        writeInt(static_cast<std::uint32_t>(str.size()));
+        _buffer.append(str);
+    }
+};
+
+/**
+ * Reads the values written by a CacheWriter. Throws a ParseException when
+ * running past the end of the data.
+ */
+class CacheReader
+{
+private:
+    const std::string& _data;
+    std::size_t _pos;
+
+public:
+    CacheReader(const std::string& data) :
+        _data(data),
+        _pos(0)
+    {}
+
+    bool atEnd() const
+    {
+        return _pos == _data.size();
+    }
+
+    unsigned char readByte()
+    {
+        require(1);
+        return static_cast<unsigned char>(_data[_pos++]);
+    }
+
+    std::uint32_t readInt()
+    {
+        require(4);
+
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(_data.data() + _pos);
+        _pos += 4;
+
+        return static_cast<std::uint32_t>(bytes[0]) | (static_cast<std::uint32_t>(bytes[1]) << 8) |
+            (static_cast<std::uint32_t>(bytes[2]) << 16) | (static_cast<std::uint32_t>(bytes[3]) << 24);
+    }
+
+    std::uint64_t readInt64()
+    {
+        std::uint64_t low = readInt();
+        std::uint64_t high = readInt();
+
+        return low | (high << 32);
+    }
+
+    std::string readString()
+    {
+        std::size_t length = readInt();
+        require(length);
+
+        std::string str(_data, _pos, length);
+        _pos += length;
+
+        return str;
+    }
+
+private:
+    void require(std::size_t numBytes)
+    {
+        if (_data.size() - _pos < numBytes)
+        {
+            throw ParseException("ParseCache: unexpected end of data");
+        }
+    }
+};
+
+/**
+ * Persistent cache of the parse results of declaration files like materials,
+ * entityDefs or skins, such that unchanged files don't need to be parsed again
+ * on the next startup.
+ *
+ * Entries are keyed by VFS path. Each entry stores the stamp of the physical
+ * file the VFS file has been read from (the PK4 archive, or the loose file
+ * itself), the hash of the file contents and the parse results as opaque data,
+ * which is written and read by the owning module using CacheWriter and
+ * CacheReader.
+ *
+ * If the stamp is unchanged, the cached data can be used without opening the
+ * file. Otherwise, the file is read and its content hash is compared, such
+ * that rebuilding an archive doesn't invalidate the files which didn't change.
+ *
+ * Lookups and stores may be called from several threads, as long as each VFS
+ * path is handled by a single thread.
+ */
+class ParseCache
+{
+public:
+    // Identifies the state of a physical file without reading it
+    struct FileStamp
+    {
+        std::string physicalPath;
+        std::int64_t modified;
+        std::int64_t size;
+
+        FileStamp() :
+            modified(-1),
+            size(-1)
+        {}
+
+        bool isValid() const
+        {
+            return modified != -1;
+        }
+
+        bool operator==(const FileStamp& other) const
+        {
+            return modified == other.modified && size == other.size &&
+                physicalPath == other.physicalPath;
+        }
+    };
+
+private:
+    struct Entry
+    {
+        FileStamp stamp;
+        std::uint64_t contentHash;
+        std::string data;
+
+        // Entries which haven't been used since loading are not saved again
+        bool used;
+    };
+
+    typedef std::map<std::string, Entry> Entries;
+    Entries _entries;
+
+    typedef std::map<std::string, FileStamp> Stamps;
+    Stamps _stamps;
+
+    std::string _filename;
+    std::string _formatId;
+
+    bool _changed;
+
+    std::size_t _numHits;
+    std::size_t _numMisses;
+
+    std::mutex _lock;
+
+public:
+    /**
+     * Construct an empty cache, to be loaded from and saved to the given file.
+     * The format identifier is saved along with the entries. Caches with a
+     * different identifier are ignored when loading, so it needs to change
+     * whenever the layout of the data written by the owning module changes.
+     */
+    ParseCache(const std::string& filename, const std::string& formatId) :
+        _filename(filename),
+        _formatId(formatId),
+        _changed(false),
+        _numHits(0),
+        _numMisses(0)
+    {}
+
+    static const char* FileId()
+    {
+        return "DarkRadiantParseCache001";
+    }
+
+    // The 64 bit FNV-1a hash of the given file contents
+    static std::uint64_t GetContentHash(const std::string& contents)
+    {
+        std::uint64_t hash = 14695981039346656037ULL;
+
+        for (std::string::const_iterator c = contents.begin(); c != contents.end(); ++c)
+        {
+            hash ^= static_cast<unsigned char>(*c);
+            hash *= 1099511628211ULL;
+        }
+
+        return hash;
+    }
+
+    std::size_t getNumHits() const
+    {
+        return _numHits;
+    }
+
+    std::size_t getNumMisses() const
+    {
+        return _numMisses;
+    }
+
+    /**
+     * Load the entries from the cache file. Returns false if the file doesn't
+     * exist, is damaged or has a different format, the cache is empty then.
+     */
+    bool load()
+    {
+        _entries.clear();
+
+        std::ifstream stream(_filename.c_str(), std::ios::in | std::ios::binary);
+
+        if (!stream)
+        {
+            return false;
+        }
+
+        std::string contents((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+        try
+        {
+            CacheReader reader(contents);
+
+            if (reader.readString() != FileId() || reader.readString() != _formatId)
+            {
+                return false;
+            }
+
+            std::size_t numEntries = reader.readInt();
+
+            for (std::size_t i = 0; i < numEntries; ++i)
+            {
+                std::string vfsPath = reader.readString();
+                Entry& entry = _entries[vfsPath];
+
+                entry.stamp.physicalPath = reader.readString();
+                entry.stamp.modified = static_cast<std::int64_t>(reader.readInt64());
+                entry.stamp.size = static_cast<std::int64_t>(reader.readInt64());
+                entry.contentHash = reader.readInt64();
+                entry.data = reader.readString();
+                entry.used = false;
+            }
+
+            if (!reader.atEnd())
+            {
+                throw ParseException("ParseCache: trailing data");
+            }
+        }
+        catch (ParseException&)
+        {
+            _entries.clear();
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+     * Write the entries which have been looked up or stored since loading to
+     * the cache file. Does nothing if the cache file is up to date.
+     */
+    bool save()
+    {
+        std::size_t numUsed = 0;
+
+        for (Entries::const_iterator i = _entries.begin(); i != _entries.end(); ++i)
+        {
+            if (i->second.used) ++numUsed;
+        }
+
+        // Unused entries belong to files which don't exist anymore
+        if (!_changed && numUsed == _entries.size())
+        {
+            return true;
+        }
+
+        std::string buffer;
+        CacheWriter writer(buffer);
+
+        writer.writeString(FileId());
+        writer.writeString(_formatId);
+        writer.writeInt(static_cast<std::uint32_t>(numUsed));
+
+        for (Entries::const_iterator i = _entries.begin(); i != _entries.end(); ++i)
+        {
+            if (!i->second.used) continue;
+
+            writer.writeString(i->first);
+            writer.writeString(i->second.stamp.physicalPath);
+            writer.writeInt64(static_cast<std::uint64_t>(i->second.stamp.modified));
+            writer.writeInt64(static_cast<std::uint64_t>(i->second.stamp.size));
+            writer.writeInt64(i->second.contentHash);
+            writer.writeString(i->second.data);
+        }
+
+        std::ofstream stream(_filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+        if (!stream)
+        {
+            return false;
+        }
+
+        stream.write(buffer.data(), buffer.size());
+        stream.flush();
+
+        if (!stream.good())
+        {
+            return false;
+        }
+
+        _changed = false;
+
+        return true;
+    }
+
+    /**
+     * Returns the stamp of the given physical file, which is invalid if the
+     * file doesn't exist. Archives contain many files, so the stamps are
+     * remembered for the lifetime of this cache.
+     */
+    FileStamp getStamp(const std::string& physicalPath)
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+
+        Stamps::iterator found = _stamps.find(physicalPath);
+
+        if (found != _stamps.end())
+        {
+            return found->second;
+        }
+
+        FileStamp stamp;
+        stamp.physicalPath = physicalPath;
+
+        struct stat st;
+
+        if (!physicalPath.empty() && stat(physicalPath.c_str(), &st) == 0)
+        {
+            stamp.modified = static_cast<std::int64_t>(st.st_mtime);
+            stamp.size = static_cast<std::int64_t>(st.st_size);
+        }
+
+        _stamps.insert(Stamps::value_type(physicalPath, stamp));
+
+        return stamp;
+    }
+
+    /**
+     * Returns the cached data of the given file if it has been stored with
+     * the same stamp, or NULL otherwise. The returned data stays valid until
+     * the next store() call for the same file.
+     */
+    const std::string* findByStamp(const std::string& vfsPath, const FileStamp& stamp)
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+
+        Entries::iterator found = _entries.find(vfsPath);
+
+        if (!stamp.isValid() || found == _entries.end() || !(found->second.stamp == stamp))
+        {
+            return NULL;
+        }
+
+        found->second.used = true;
+        ++_numHits;
+
+        return &found->second.data;
+    }
+
+    /**
+     * Returns the cached data of the given file if it has been stored with
+     * the same content hash, or NULL otherwise. On success, the stamp of the
+     * entry is updated. Each unsuccessful call counts as a cache miss.
+     */
+    const std::string* findByContent(const std::string& vfsPath, const FileStamp& stamp,
+                                     std::uint64_t contentHash)
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+
+        Entries::iterator found = _entries.find(vfsPath);
+
+        if (!stamp.isValid() || found == _entries.end() || found->second.contentHash != contentHash)
+        {
+            ++_numMisses;
+            return NULL;
+        }
+
+        found->second.stamp = stamp;
+        found->second.used = true;
+        _changed = true;
+        ++_numHits;
+
+        return &found->second.data;
+    }
+
+    // Stores the parse results of the given file, invalid stamps are ignored
+    void store(const std::string& vfsPath, const FileStamp& stamp,
+               std::uint64_t contentHash, const std::string& data)
+    {
+        if (!stamp.isValid()) return;
+
+        std::lock_guard<std::mutex> lock(_lock);
+
+        Entry& entry = _entries[vfsPath];
+
+        entry.stamp = stamp;
+        entry.contentHash = contentHash;
+        entry.data = data;
+        entry.used = true;
+
+        _changed = true;
+    }
+};
+
+} // namespace parser
+
+#endif /* PARSE_CACHE_H_ */
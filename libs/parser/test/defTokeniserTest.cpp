@@ -0,0 +1,219 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE defTokeniserTest
+#include <boost/test/unit_test.hpp>
+
+#include <parser/DefTokeniser.h>
+#include <parser/DefBlockTokeniser.h>
+#include <parser/BufferDefTokeniser.h>
+#include <parser/BufferDefBlockTokeniser.h>
+
+#include <vector>
+#include <random>
+#include <sstream>
+
+namespace
+{
+    // Returns the tokens of the given tokeniser, or the message of the
+    // exception thrown while tokenising (with a marker)
+    std::vector<std::string> getTokens(parser::DefTokeniser& tok)
+    {
+        std::vector<std::string> tokens;
+
+        try
+        {
+            while (tok.hasMoreTokens())
+            {
+                tokens.push_back(tok.nextToken());
+            }
+        }
+        catch (parser::ParseException& ex)
+        {
+            tokens.push_back(std::string("exception: ") + ex.what());
+        }
+
+        return tokens;
+    }
+
+    std::vector<std::string> tokeniseStream(const std::string& input)
+    {
+        try
+        {
+            std::istringstream stream(input);
+            parser::BasicDefTokeniser<std::istream> tok(stream);
+            return getTokens(tok);
+        }
+        catch (parser::ParseException& ex)
+        {
+            return std::vector<std::string>(1, std::string("exception: ") + ex.what());
+        }
+    }
+
+    std::vector<std::string> tokeniseBuffer(const std::string& input)
+    {
+        try
+        {
+            parser::BufferDefTokeniser tok(input);
+            return getTokens(tok);
+        }
+        catch (parser::ParseException& ex)
+        {
+            return std::vector<std::string>(1, std::string("exception: ") + ex.what());
+        }
+    }
+
+    typedef std::vector<std::pair<std::string, std::string> > Blocks;
+
+    Blocks getBlocks(parser::BlockTokeniser& tok)
+    {
+        Blocks blocks;
+
+        while (tok.hasMoreBlocks())
+        {
+            parser::BlockTokeniser::Block block = tok.nextBlock();
+            blocks.push_back(std::make_pair(block.name, block.contents));
+        }
+
+        return blocks;
+    }
+
+    void checkSameTokens(const std::string& input)
+    {
+        std::vector<std::string> expected = tokeniseStream(input);
+        std::vector<std::string> tokens = tokeniseBuffer(input);
+
+        BOOST_CHECK_MESSAGE(tokens == expected, "Token mismatch for input: " << input);
+    }
+
+    void checkSameBlocks(const std::string& input)
+    {
+        std::istringstream stream(input);
+        parser::BasicDefBlockTokeniser<std::istream> expectedTok(stream);
+        parser::BufferDefBlockTokeniser tok(input);
+
+        BOOST_CHECK_MESSAGE(getBlocks(tok) == getBlocks(expectedTok), "Block mismatch for input: " << input);
+    }
+
+    // Random input made of the characters with a special meaning
+    std::string createRandomInput(std::mt19937& generator, std::size_t length)
+    {
+        const char CHARS[] = "ab /*\"\\nt{}()\n\r\t ";
+
+        std::uniform_int_distribution<std::size_t> index(0, sizeof(CHARS) - 2);
+
+        std::string input;
+
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            input += CHARS[index(generator)];
+        }
+
+        return input;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(tokenViews)
+{
+    std::string input = "textures/common/caulk { \"quoted string\" } // comment\n value";
+
+    parser::BufferDefTokeniser tok(input);
+
+    BOOST_CHECK(tok.nextTokenView() == "textures/common/caulk");
+    BOOST_CHECK(tok.peekView() == "{");
+    tok.assertNextToken("{");
+
+    // Plain tokens reference the input
+    parser::StringView quoted = tok.nextTokenView();
+    BOOST_CHECK(quoted == "quoted string");
+    BOOST_CHECK(quoted.data() > input.data() && quoted.data() < input.data() + input.size());
+
+    tok.skipTokens(1);
+    BOOST_CHECK_EQUAL(tok.nextToken(), "value");
+    BOOST_CHECK(!tok.hasMoreTokens());
+    BOOST_CHECK_THROW(tok.nextToken(), parser::ParseException);
+}
+
+BOOST_AUTO_TEST_CASE(assembledTokensStayValid)
+{
+    std::string input = "\"a\\\"b\" \"c\" \\ \"d\" \"e\\tf\"";
+
+    parser::BufferDefTokeniser tok(input);
+
+    parser::StringView first = tok.nextTokenView();
+    BOOST_CHECK(first == "a\"b");
+
+    // The following token has already been assembled, without touching the first one
+    BOOST_CHECK(tok.peekView() == "cd");
+    BOOST_CHECK(first == "a\"b");
+
+    BOOST_CHECK(tok.nextTokenView() == "cd");
+
+    BOOST_CHECK(tok.nextTokenView() == "e\tf");
+    BOOST_CHECK(!tok.hasMoreTokens());
+}
+
+BOOST_AUTO_TEST_CASE(sameTokensAsStreamTokeniser)
+{
+    const char* const INPUTS[] =
+    {
+        "",
+        "   ",
+        "a b c",
+        "a{b}c(d)",
+        "// comment only",
+        "a // comment\nb",
+        "a/* comment */b",
+        "a /* unterminated",
+        "a/b/c",
+        "a /",
+        "/{",
+        "a**/b",
+        "/***/x",
+        "\"\"",
+        "\"\" a",
+        "a\"b\"",
+        "\"a\\nb\\tc\\\"d\\xe\"",
+        "\"a\" \\ \"b\" \\\n \"c\"",
+        "\"a\" \\ b",
+        "\"unterminated",
+        "x\r\ny\r\n// c\r\nz",
+    };
+
+    for (std::size_t i = 0; i < sizeof(INPUTS) / sizeof(INPUTS[0]); ++i)
+    {
+        checkSameTokens(INPUTS[i]);
+    }
+
+    std::mt19937 generator(1234);
+
+    for (std::size_t i = 0; i < 5000; ++i)
+    {
+        checkSameTokens(createRandomInput(generator, 1 + i % 64));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sameBlocksAsStreamTokeniser)
+{
+    const char* const INPUTS[] =
+    {
+        "",
+        "name { contents }",
+        "table foo { { 0, 1 } }",
+        "a/b { x } // comment\n c { y { z } }",
+        "/* comment */ name\n// another\n{ contents }",
+        "name { unterminated",
+        "name",
+        "a/ { x }",
+    };
+
+    for (std::size_t i = 0; i < sizeof(INPUTS) / sizeof(INPUTS[0]); ++i)
+    {
+        checkSameBlocks(INPUTS[i]);
+    }
+
+    std::mt19937 generator(5678);
+
+    for (std::size_t i = 0; i < 5000; ++i)
+    {
+        checkSameBlocks(createRandomInput(generator, 1 + i % 64));
+    }
+}
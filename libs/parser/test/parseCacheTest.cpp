@@ -0,0 +1,173 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE parseCacheTest
+#include <boost/test/unit_test.hpp>
+
+#include <parser/ParseCache.h>
+
+#include <cstdio>
+
+namespace
+{
+    const char* const CACHE_FILE = "parseCacheTest.cache";
+
+    parser::ParseCache::FileStamp createStamp(const std::string& path, std::int64_t modified)
+    {
+        parser::ParseCache::FileStamp stamp;
+
+        stamp.physicalPath = path;
+        stamp.modified = modified;
+        stamp.size = 1000;
+
+        return stamp;
+    }
+
+    struct CacheFileFixture
+    {
+        CacheFileFixture() { std::remove(CACHE_FILE); }
+        ~CacheFileFixture() { std::remove(CACHE_FILE); }
+    };
+}
+
+BOOST_AUTO_TEST_CASE(writerAndReader)
+{
+    std::string data;
+    parser::CacheWriter writer(data);
+
+    writer.writeByte(200);
+    writer.writeInt(0xdeadbeef);
+    writer.writeInt64(0x0123456789abcdefULL);
+    writer.writeString("textures/common/caulk");
+    writer.writeString("");
+
+    parser::CacheReader reader(data);
+
+    BOOST_CHECK_EQUAL(reader.readByte(), 200);
+    BOOST_CHECK_EQUAL(reader.readInt(), 0xdeadbeef);
+    BOOST_CHECK_EQUAL(reader.readInt64(), 0x0123456789abcdefULL);
+    BOOST_CHECK_EQUAL(reader.readString(), "textures/common/caulk");
+    BOOST_CHECK_EQUAL(reader.readString(), "");
+    BOOST_CHECK(reader.atEnd());
+    BOOST_CHECK_THROW(reader.readInt(), parser::ParseException);
+
+    // A string length pointing past the end
+    std::string truncated = data.substr(0, data.size() - 10);
+    parser::CacheReader truncatedReader(truncated);
+
+    truncatedReader.readByte();
+    truncatedReader.readInt();
+    truncatedReader.readInt64();
+    BOOST_CHECK_THROW(truncatedReader.readString(), parser::ParseException);
+}
+
+BOOST_FIXTURE_TEST_CASE(lookupByStampAndContent, CacheFileFixture)
+{
+    parser::ParseCache cache(CACHE_FILE, "test1");
+
+    BOOST_CHECK(!cache.load());
+
+    parser::ParseCache::FileStamp stamp = createStamp("/base/pak000.pk4", 100);
+
+    BOOST_CHECK(cache.findByStamp("materials/a.mtr", stamp) == NULL);
+
+    cache.store("materials/a.mtr", stamp, 42, "parsed a");
+
+    const std::string* data = cache.findByStamp("materials/a.mtr", stamp);
+    BOOST_REQUIRE(data != NULL);
+    BOOST_CHECK_EQUAL(*data, "parsed a");
+
+    // A rebuilt archive, the file contents didn't change
+    parser::ParseCache::FileStamp newStamp = createStamp("/base/pak000.pk4", 200);
+
+    BOOST_CHECK(cache.findByStamp("materials/a.mtr", newStamp) == NULL);
+    BOOST_CHECK(cache.findByContent("materials/a.mtr", newStamp, 43) == NULL);
+
+    data = cache.findByContent("materials/a.mtr", newStamp, 42);
+    BOOST_REQUIRE(data != NULL);
+    BOOST_CHECK_EQUAL(*data, "parsed a");
+
+    // The stamp has been updated
+    BOOST_CHECK(cache.findByStamp("materials/a.mtr", newStamp) != NULL);
+
+    // The same file moved into another archive
+    BOOST_CHECK(cache.findByStamp("materials/a.mtr", createStamp("/base/pak001.pk4", 200)) == NULL);
+
+    // Files which don't exist are never found nor stored
+    parser::ParseCache::FileStamp invalid;
+    cache.store("materials/b.mtr", invalid, 42, "parsed b");
+    BOOST_CHECK(cache.findByContent("materials/b.mtr", invalid, 42) == NULL);
+}
+
+BOOST_FIXTURE_TEST_CASE(saveAndLoad, CacheFileFixture)
+{
+    parser::ParseCache::FileStamp stamp = createStamp("/base/pak000.pk4", 100);
+
+    {
+        parser::ParseCache cache(CACHE_FILE, "test1");
+
+        cache.store("materials/a.mtr", stamp, 1, "parsed a");
+        cache.store("materials/b.mtr", stamp, 2, std::string("binary\0data", 11));
+
+        BOOST_CHECK(cache.save());
+    }
+
+    {
+        parser::ParseCache cache(CACHE_FILE, "test1");
+        BOOST_REQUIRE(cache.load());
+
+        const std::string* data = cache.findByStamp("materials/b.mtr", stamp);
+        BOOST_REQUIRE(data != NULL);
+        BOOST_CHECK(*data == std::string("binary\0data", 11));
+
+        // a.mtr is not used in this session, it is dropped when saving
+        BOOST_CHECK(cache.save());
+    }
+
+    {
+        parser::ParseCache cache(CACHE_FILE, "test1");
+        BOOST_REQUIRE(cache.load());
+
+        BOOST_CHECK(cache.findByStamp("materials/a.mtr", stamp) == NULL);
+        BOOST_CHECK(cache.findByStamp("materials/b.mtr", stamp) != NULL);
+    }
+
+    // Caches written in a different format are ignored
+    parser::ParseCache otherFormat(CACHE_FILE, "test2");
+    BOOST_CHECK(!otherFormat.load());
+    BOOST_CHECK(otherFormat.findByStamp("materials/b.mtr", stamp) == NULL);
+}
+
+BOOST_FIXTURE_TEST_CASE(damagedFile, CacheFileFixture)
+{
+    parser::ParseCache::FileStamp stamp = createStamp("/base/pak000.pk4", 100);
+
+    {
+        parser::ParseCache cache(CACHE_FILE, "test1");
+        cache.store("materials/a.mtr", stamp, 1, "parsed a");
+        BOOST_CHECK(cache.save());
+    }
+
+    // Cut off the last few bytes
+    std::string contents;
+
+    {
+        std::ifstream stream(CACHE_FILE, std::ios::in | std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    }
+
+    {
+        std::ofstream stream(CACHE_FILE, std::ios::out | std::ios::binary | std::ios::trunc);
+        stream.write(contents.data(), contents.size() - 3);
+    }
+
+    parser::ParseCache cache(CACHE_FILE, "test1");
+    BOOST_CHECK(!cache.load());
+    BOOST_CHECK(cache.findByStamp("materials/a.mtr", stamp) == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(stampOfMissingFile)
+{
+    parser::ParseCache cache(CACHE_FILE, "test1");
+
+    BOOST_CHECK(!cache.getStamp("").isValid());
+    BOOST_CHECK(!cache.getStamp("/does/not/exist.pk4").isValid());
+}
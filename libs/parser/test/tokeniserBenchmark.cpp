@@ -0,0 +1,190 @@
+/**
+ * Throughput benchmark comparing the stream-based DefTokenisers with the
+ * buffer-based ones. Not run as part of the tests, build and run it with
+ * "make tokeniserBenchmark && ./tokeniserBenchmark [file] [numRuns]".
+ * Without a file, a generated material file of about 8 MB is used.
+ */
+#include <parser/DefTokeniser.h>
+#include <parser/DefBlockTokeniser.h>
+#include <parser/BufferDefTokeniser.h>
+#include <parser/BufferDefBlockTokeniser.h>
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    std::string createMaterials(std::size_t numMaterials)
+    {
+        std::ostringstream str;
+
+        for (std::size_t i = 0; i < numMaterials; ++i)
+        {
+            str << "// Material number " << i << "\n";
+            str << "textures/benchmark/material_" << i << "\n";
+            str << "{\n";
+            str << "\tqer_editorimage textures/benchmark/material_" << i << "_ed\n";
+            str << "\tdescription \"A generated \\\"benchmark\\\" material\"\n";
+            str << "\t/* Diffuse and bump stages */\n";
+            str << "\tdiffusemap textures/benchmark/material_" << i << "_d\n";
+            str << "\tbumpmap addnormals(textures/benchmark/material_" << i << "_local, heightmap(textures/benchmark/h, 4))\n";
+            str << "\t{\n";
+            str << "\t\tblend add\n";
+            str << "\t\tmap textures/benchmark/glow\n";
+            str << "\t\trgb 0.5 * sintable[time * 0.1]\n";
+            str << "\t}\n";
+            str << "}\n\n";
+        }
+
+        return str.str();
+    }
+
+    // Runs the function the given number of times, returns the best throughput in MB/s
+    template<typename Func>
+    double measure(std::size_t numBytes, std::size_t numRuns, std::size_t& result, const Func& func)
+    {
+        double best = 0;
+
+        for (std::size_t run = 0; run < numRuns; ++run)
+        {
+            Clock::time_point start = Clock::now();
+            result = func();
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            if (run == 0 || seconds < best)
+            {
+                best = seconds;
+            }
+        }
+
+        return numBytes / (1024.0 * 1024.0) / best;
+    }
+
+    void printResult(const char* name, double throughput, std::size_t count)
+    {
+        std::cout << name << throughput << " MB/s (" << count << ")" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string input;
+
+    if (argc > 1)
+    {
+        std::ifstream file(argv[1], std::ios::binary);
+
+        if (!file)
+        {
+            std::cerr << "Usage: tokeniserBenchmark [file] [numRuns]" << std::endl;
+            return 1;
+        }
+
+        parser::readStream(file, input);
+    }
+    else
+    {
+        input = createMaterials(20000);
+    }
+
+    std::size_t numRuns = argc > 2 ? std::strtoul(argv[2], NULL, 10) : 5;
+
+    if (numRuns == 0)
+    {
+        std::cerr << "Usage: tokeniserBenchmark [file] [numRuns]" << std::endl;
+        return 1;
+    }
+
+    std::size_t count = 0;
+
+    double streamTokens = measure(input.size(), numRuns, count, [&]()
+    {
+        std::istringstream stream(input);
+        parser::BasicDefTokeniser<std::istream> tok(stream);
+
+        std::size_t numTokens = 0;
+
+        for (; tok.hasMoreTokens(); ++numTokens)
+        {
+            tok.nextToken();
+        }
+
+        return numTokens;
+    });
+
+    printResult("stream tokens:       ", streamTokens, count);
+
+    double bufferTokens = measure(input.size(), numRuns, count, [&]()
+    {
+        std::istringstream stream(input);
+        parser::BufferDefTokeniser tok(stream);
+
+        std::size_t numTokens = 0;
+
+        for (; tok.hasMoreTokens(); ++numTokens)
+        {
+            tok.nextToken();
+        }
+
+        return numTokens;
+    });
+
+    printResult("buffer tokens:       ", bufferTokens, count);
+
+    double viewTokens = measure(input.size(), numRuns, count, [&]()
+    {
+        parser::BufferDefTokeniser tok(input);
+
+        std::size_t numTokens = 0;
+
+        for (; tok.hasMoreTokens(); ++numTokens)
+        {
+            tok.nextTokenView();
+        }
+
+        return numTokens;
+    });
+
+    printResult("buffer token views:  ", viewTokens, count);
+
+    double streamBlocks = measure(input.size(), numRuns, count, [&]()
+    {
+        std::istringstream stream(input);
+        parser::BasicDefBlockTokeniser<std::istream> tok(stream);
+
+        std::size_t numBlocks = 0;
+
+        for (; tok.hasMoreBlocks(); ++numBlocks)
+        {
+            tok.nextBlock();
+        }
+
+        return numBlocks;
+    });
+
+    printResult("stream blocks:       ", streamBlocks, count);
+
+    double bufferBlocks = measure(input.size(), numRuns, count, [&]()
+    {
+        std::istringstream stream(input);
+        parser::BufferDefBlockTokeniser tok(stream);
+
+        std::size_t numBlocks = 0;
+
+        for (; tok.hasMoreBlocks(); ++numBlocks)
+        {
+            tok.nextBlock();
+        }
+
+        return numBlocks;
+    });
+
+    printResult("buffer blocks:       ", bufferBlocks, count);
+
+    return 0;
+}
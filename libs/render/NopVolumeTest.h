@@ -2,6 +2,7 @@
 
 #include "ivolumetest.h"
 #include "math/Matrix4.h"
+#include <algorithm>
 
 namespace render
 {
@@ -56,6 +57,11 @@ public:
 		return VOLUME_INSIDE;
 	}
 
+	void TestAABBs(const AABB* aabbs, std::size_t count, VolumeIntersectionValue* results) const
+	{
+		std::fill(results, results + count, VOLUME_INSIDE);
+	}
+
 	virtual bool fill() const
 	{ 
 		return true;
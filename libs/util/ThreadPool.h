@@ -0,0 +1,366 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+
+namespace util
+{
+
+/**
+ * A fixed-size pool of worker threads executing void() tasks.
+ *
+ * Every worker owns a task deque. Tasks submitted from within a worker
+ * are pushed to that worker's own deque and popped in LIFO order, which keeps
+ * recursive algorithms (like BSP building) cache-friendly. Idle workers steal
+ * the oldest tasks from the other deques.
+ *
+ * Tasks are usually submitted through a TaskGroup, whose wait() method keeps
+ * executing pending tasks while waiting, so it is safe to wait for nested
+ * task groups from within a worker thread.
+ *
+ * A pool constructed with numThreads <= 1 doesn't spawn any threads,
+ * all TaskGroups will then execute their tasks inline in the calling thread.
+ */
+class ThreadPool
+{
+public:
+	typedef std::function<void()> Task;
+
+private:
+	struct TaskQueue
+	{
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+	typedef std::shared_ptr<TaskQueue> TaskQueuePtr;
+
+	// One queue per worker, plus one for submissions from non-pool threads
+	std::vector<TaskQueuePtr> _queues;
+	std::vector<std::thread> _threads;
+
+	std::mutex _sleepLock;
+	std::condition_variable _wakeup;
+
+	std::atomic<std::size_t> _numPendingTasks;
+	std::atomic<bool> _shutdown;
+
+public:
+	// Pass 0 to use as many threads as there are hardware threads available
+	ThreadPool(std::size_t numThreads) :
+		_numPendingTasks(0),
+		_shutdown(false)
+	{
+		if (numThreads == 0)
+		{
+			numThreads = GetHardwareConcurrency();
+		}
+
+		if (numThreads <= 1)
+		{
+			return; // serial pool
+		}
+
+		for (std::size_t i = 0; i <= numThreads; ++i)
+		{
+			_queues.push_back(TaskQueuePtr(new TaskQueue));
+		}
+
+		for (std::size_t i = 0; i < numThreads; ++i)
+		{
+			_threads.push_back(std::thread(std::bind(&ThreadPool::workerLoop, this, i)));
+		}
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_sleepLock);
+			_shutdown = true;
+		}
+
+		_wakeup.notify_all();
+
+		std::for_each(_threads.begin(), _threads.end(), [](std::thread& thread)
+		{
+			thread.join();
+		});
+	}
+
+	// The number of worker threads, returns 1 for a serial pool
+	std::size_t getNumThreads() const
+	{
+		return _threads.empty() ? 1 : _threads.size();
+	}
+
+	bool isSerial() const
+	{
+		return _threads.empty();
+	}
+
+	static std::size_t GetHardwareConcurrency()
+	{
+		std::size_t count = std::thread::hardware_concurrency();
+		return count > 0 ? count : 1;
+	}
+
+	// Queues the given task for execution. Must not be called on a serial pool.
+	void push(const Task& task)
+	{
+		// Count the task before it becomes visible in the queue,
+		// such that the counter never drops below zero
+		{
+			std::lock_guard<std::mutex> lock(_sleepLock);
+			++_numPendingTasks;
+		}
+
+		TaskQueue& queue = *_queues[getQueueIndexForCurrentThread()];
+
+		{
+			std::lock_guard<std::mutex> lock(queue.lock);
+			queue.tasks.push_back(task);
+		}
+
+		_wakeup.notify_one();
+	}
+
+	// Executes a single pending task in the calling thread, if there is one.
+	// Returns false if no task has been found.
+	bool runPendingTask()
+	{
+		if (_threads.empty()) return false;
+
+		Task task;
+
+		if (!popTask(getQueueIndexForCurrentThread(), task))
+		{
+			return false;
+		}
+
+		task();
+		return true;
+	}
+
+private:
+	// Returns the queue index of the calling worker, or the index of the shared
+	// queue if called from a thread not belonging to this pool
+	std::size_t getQueueIndexForCurrentThread() const
+	{
+		std::thread::id id = std::this_thread::get_id();
+
+		for (std::size_t i = 0; i < _threads.size(); ++i)
+		{
+			if (_threads[i].get_id() == id)
+			{
+				return i;
+			}
+		}
+
+		return _threads.size();
+	}
+
+	// Try to pop a task from the own queue (newest first),
+	// then try to steal from the other ones (oldest first)
+	bool popTask(std::size_t ownIndex, Task& task)
+	{
+		if (_numPendingTasks == 0) return false;
+
+		{
+			TaskQueue& own = *_queues[ownIndex];
+			std::lock_guard<std::mutex> lock(own.lock);
+
+			if (!own.tasks.empty())
+			{
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				--_numPendingTasks;
+				return true;
+			}
+		}
+
+		for (std::size_t offset = 1; offset < _queues.size(); ++offset)
+		{
+			TaskQueue& victim = *_queues[(ownIndex + offset) % _queues.size()];
+			std::lock_guard<std::mutex> lock(victim.lock);
+
+			if (!victim.tasks.empty())
+			{
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				--_numPendingTasks;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void workerLoop(std::size_t index)
+	{
+		while (true)
+		{
+			Task task;
+
+			if (popTask(index, task))
+			{
+				task();
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(_sleepLock);
+
+			_wakeup.wait(lock, [this]() { return _shutdown || _numPendingTasks > 0; });
+
+			if (_shutdown) break;
+		}
+	}
+};
+typedef std::shared_ptr<ThreadPool> ThreadPoolPtr;
+
+/**
+ * A set of tasks which are run on a ThreadPool, and can be waited for.
+ * The first exception thrown by any of the tasks is re-thrown by wait().
+ * All tasks need to be finished before the group is destroyed.
+ */
+class TaskGroup
+{
+private:
+	ThreadPool& _pool;
+
+	std::atomic<std::size_t> _numOutstanding;
+
+	std::mutex _lock;
+	std::condition_variable _finished;
+	std::exception_ptr _exception;
+
+public:
+	TaskGroup(ThreadPool& pool) :
+		_pool(pool),
+		_numOutstanding(0)
+	{}
+
+	~TaskGroup()
+	{
+		// Don't leave any task behind which is still referencing this group
+		waitForOutstandingTasks();
+	}
+
+	// Submits the task, in a serial pool it is executed right away
+	void run(const ThreadPool::Task& task)
+	{
+		if (_pool.isSerial())
+		{
+			task();
+			return;
+		}
+
+		++_numOutstanding;
+
+		_pool.push([this, task]()
+		{
+			try
+			{
+				task();
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(_lock);
+
+				if (!_exception)
+				{
+					_exception = std::current_exception();
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(_lock);
+
+			if (--_numOutstanding == 0)
+			{
+				_finished.notify_all();
+			}
+		});
+	}
+
+	// Blocks until all submitted tasks are done, executing pending tasks meanwhile
+	void wait()
+	{
+		waitForOutstandingTasks();
+
+		std::exception_ptr exception;
+
+		{
+			std::lock_guard<std::mutex> lock(_lock);
+			std::swap(exception, _exception);
+		}
+
+		if (exception)
+		{
+			std::rethrow_exception(exception);
+		}
+	}
+
+private:
+	void waitForOutstandingTasks()
+	{
+		while (_numOutstanding > 0)
+		{
+			if (_pool.runPendingTask())
+			{
+				continue;
+			}
+
+			// Nothing to help with, sleep until the group is done, but check back
+			// regularly since running tasks might spawn more work for us
+			std::unique_lock<std::mutex> lock(_lock);
+			_finished.wait_for(lock, std::chrono::milliseconds(1), [this]() { return _numOutstanding == 0; });
+		}
+
+		// Synchronise with the last finishing task, which might still hold the lock
+		std::lock_guard<std::mutex> lock(_lock);
+	}
+};
+
+/**
+ * Invokes func(i) for each i in [0..count) on the given pool, returns when all
+ * invocations are done. Indices are handed out in chunks of the given size.
+ */
+template<typename Func>
+void parallelFor(ThreadPool& pool, std::size_t count, const Func& func, std::size_t chunkSize = 1)
+{
+	if (pool.isSerial() || count <= chunkSize)
+	{
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			func(i);
+		}
+
+		return;
+	}
+
+	TaskGroup group(pool);
+
+	for (std::size_t start = 0; start < count; start += chunkSize)
+	{
+		std::size_t end = std::min(start + chunkSize, count);
+
+		group.run([start, end, &func]()
+		{
+			for (std::size_t i = start; i < end; ++i)
+			{
+				func(i);
+			}
+		});
+	}
+
+	group.wait();
+}
+
+} // namespace
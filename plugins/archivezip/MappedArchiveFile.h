@@ -0,0 +1,120 @@
+#pragma once
+
+#include "iarchive.h"
+#include "archivelib.h"
+#include "gamelib.h"
+
+#include "MappedFile.h"
+#include "zlibstream.h"
+
+namespace detail
+{
+
+// Returns a stream for the given file data, which is read straight from the
+// mapping if it is stored, or inflated from it if it is deflated
+inline std::unique_ptr<InputStream> createMappedStream(const InputStream::byte_type* data,
+	std::size_t streamSize, bool deflated)
+{
+	if (deflated)
+	{
+		return std::unique_ptr<InputStream>(new DeflatedMemoryInputStream(data, streamSize));
+	}
+
+	return std::unique_ptr<InputStream>(new MemoryInputStream(data, streamSize));
+}
+
+}
+
+/**
+ * ArchiveFile of a memory-mapped ZIP, reading the data from the mapping
+ * instead of opening the archive file again.
+ */
+class MappedArchiveFile :
+	public ArchiveFile
+{
+	std::string m_name;
+
+	// Keeps the mapping alive as long as this file exists
+	MappedFilePtr _mapping;
+
+	std::unique_ptr<InputStream> _stream;
+	std::size_t m_size;
+
+public:
+	MappedArchiveFile(const std::string& name,
+					  const MappedFilePtr& mapping,
+					  const InputStream::byte_type* data,
+					  std::size_t stream_size,
+					  std::size_t file_size,
+					  bool deflated) :
+		m_name(name),
+		_mapping(mapping),
+		_stream(detail::createMappedStream(data, stream_size, deflated)),
+		m_size(file_size)
+	{}
+
+	std::size_t size() const {
+		return m_size;
+	}
+
+	const std::string& getName() const {
+		return m_name;
+	}
+
+	InputStream& getInputStream() {
+		return *_stream;
+	}
+};
+
+/**
+ * ArchiveTextFile of a memory-mapped ZIP, see MappedArchiveFile.
+ */
+class MappedArchiveTextFile :
+	public ArchiveTextFile
+{
+	std::string m_name;
+
+	// Keeps the mapping alive as long as this file exists
+	MappedFilePtr _mapping;
+
+	std::unique_ptr<InputStream> _stream;
+	BinaryToTextInputStream<InputStream> m_textStream;
+
+	// Mod directory containing this file
+	const std::string _modDir;
+
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param modDir
+	 * The name of the mod directory this file's archive is located in.
+	 */
+	MappedArchiveTextFile(const std::string& name,
+						  const std::string& modDir,
+						  const MappedFilePtr& mapping,
+						  const InputStream::byte_type* data,
+						  std::size_t stream_size,
+						  bool deflated) :
+		m_name(name),
+		_mapping(mapping),
+		_stream(detail::createMappedStream(data, stream_size, deflated)),
+		m_textStream(*_stream),
+		_modDir(game::current::getModPath(modDir))
+	{}
+
+	TextInputStream& getInputStream() {
+		return m_textStream;
+	}
+
+	const std::string& getName() const {
+		return m_name;
+	}
+
+	/**
+	 * Return mod directory of this file.
+	 */
+	std::string getModName() const {
+		return _modDir;
+	}
+};
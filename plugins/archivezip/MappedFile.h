@@ -0,0 +1,194 @@
+#pragma once
+
+#include "idatastream.h"
+
+#include <string>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+
+#if defined(WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+class MappedFile;
+typedef std::shared_ptr<MappedFile> MappedFilePtr;
+
+/**
+ * A file mapped read-only into memory. The mapping stays valid as long as
+ * this object exists, files opened from a mapped archive keep a reference
+ * to it.
+ */
+class MappedFile
+{
+private:
+	const unsigned char* _data;
+	std::size_t _size;
+
+#if defined(WIN32)
+	HANDLE _mapping;
+#endif
+
+	MappedFile() :
+		_data(NULL),
+		_size(0)
+#if defined(WIN32)
+		, _mapping(NULL)
+#endif
+	{}
+
+	MappedFile(const MappedFile& other);
+	MappedFile& operator=(const MappedFile& other);
+
+public:
+	~MappedFile()
+	{
+#if defined(WIN32)
+		if (_data != NULL) UnmapViewOfFile(_data);
+		if (_mapping != NULL) CloseHandle(_mapping);
+#else
+		if (_data != NULL) munmap(const_cast<unsigned char*>(_data), _size);
+#endif
+	}
+
+	const unsigned char* data() const
+	{
+		return _data;
+	}
+
+	std::size_t size() const
+	{
+		return _size;
+	}
+
+	/**
+	 * Map the given file, returns an empty pointer if the file can't be
+	 * opened or mapped (e.g. if it is empty or the address space is exhausted).
+	 */
+	static MappedFilePtr Open(const std::string& filename)
+	{
+		MappedFilePtr mapped(new MappedFile);
+
+#if defined(WIN32)
+		HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+		if (file == INVALID_HANDLE_VALUE) return MappedFilePtr();
+
+		LARGE_INTEGER size;
+
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0 &&
+			static_cast<unsigned long long>(size.QuadPart) <= static_cast<std::size_t>(-1))
+		{
+			mapped->_mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+			if (mapped->_mapping != NULL)
+			{
+				mapped->_data = static_cast<const unsigned char*>(
+					MapViewOfFile(mapped->_mapping, FILE_MAP_READ, 0, 0, 0));
+				mapped->_size = static_cast<std::size_t>(size.QuadPart);
+			}
+		}
+
+		// The mapping keeps its own reference to the file
+		CloseHandle(file);
+#else
+		int fd = open(filename.c_str(), O_RDONLY);
+
+		if (fd == -1) return MappedFilePtr();
+
+		struct stat st;
+
+		if (fstat(fd, &st) == 0 && st.st_size > 0 &&
+			static_cast<unsigned long long>(st.st_size) <= static_cast<std::size_t>(-1))
+		{
+			void* data = mmap(NULL, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+			if (data != MAP_FAILED)
+			{
+				mapped->_data = static_cast<const unsigned char*>(data);
+				mapped->_size = static_cast<std::size_t>(st.st_size);
+			}
+		}
+
+		// The mapping stays valid after closing the descriptor
+		close(fd);
+#endif
+
+		return mapped->_data != NULL ? mapped : MappedFilePtr();
+	}
+};
+
+/**
+ * A seekable input stream reading from a range of memory, like a part of a
+ * MappedFile. Reads are bounded by the range, seeking beyond its end is
+ * clamped to the end.
+ */
+class MemoryInputStream :
+	public SeekableInputStream
+{
+private:
+	const byte_type* _begin;
+	const byte_type* _cur;
+	const byte_type* _end;
+
+public:
+	MemoryInputStream(const byte_type* data, size_type size) :
+		_begin(data),
+		_cur(data),
+		_end(data + size)
+	{}
+
+	size_type read(byte_type* buffer, size_type length)
+	{
+		size_type count = (std::min)(length, static_cast<size_type>(_end - _cur));
+
+		std::memcpy(buffer, _cur, count);
+		_cur += count;
+
+		return count;
+	}
+
+	position_type seek(position_type position)
+	{
+		_cur = _begin + (std::min)(position, static_cast<position_type>(_end - _begin));
+		return 0;
+	}
+
+	position_type seek(offset_type offset, seekdir direction)
+	{
+		const byte_type* base = direction == beg ? _begin : direction == cur ? _cur : _end;
+
+		if (offset < 0 && static_cast<position_type>(-offset) > static_cast<position_type>(base - _begin))
+		{
+			_cur = _begin;
+		}
+		else
+		{
+			_cur = base + (std::min)(static_cast<std::ptrdiff_t>(offset), _end - base);
+		}
+
+		return 0;
+	}
+
+	position_type tell() const
+	{
+		return static_cast<position_type>(_cur - _begin);
+	}
+
+	// The remaining bytes, which can be used without copying them
+	const byte_type* current() const
+	{
+		return _cur;
+	}
+
+	size_type remaining() const
+	{
+		return static_cast<size_type>(_end - _cur);
+	}
+};
@@ -8,15 +8,54 @@
 
 #include "DeflatedArchiveFile.h"
 #include "DeflatedArchiveTextFile.h"
+#include "MappedArchiveFile.h"
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <algorithm>
+
+namespace
+{
+	// The size of the local file header up to the file name
+	const std::size_t LOCAL_HEADER_SIZE = 30;
+
+	inline unsigned int readUInt16(const unsigned char* bytes)
+	{
+		return bytes[0] | (bytes[1] << 8);
+	}
+
+	// Paths are compared case-insensitively, like in the ZipFileSystem
+	inline std::string normalisePath(const std::string& path)
+	{
+		std::string normalised = boost::algorithm::to_lower_copy(path);
+		std::replace(normalised.begin(), normalised.end(), '\\', '/');
+
+		return normalised;
+	}
+}
 
 ZipArchive::ZipArchive(const std::string& name) :
 	m_name(name),
-	m_istream(name)
+	_mapping(MappedFile::Open(name))
 {
-	if (!m_istream.failed()) {
-		if (!read_pkzip()) {
-			rError() << "ERROR: invalid zip-file " << name.c_str() << '\n';
-		}
+	bool valid = false;
+
+	if (_mapping)
+	{
+		// Read the central directory from the mapping as well
+		MemoryInputStream stream(_mapping->data(), _mapping->size());
+		valid = read_pkzip(stream);
+	}
+	else
+	{
+		m_istream.reset(new FileInputStream(name));
+
+		if (m_istream->failed()) return;
+
+		valid = read_pkzip(*m_istream);
+	}
+
+	if (!valid) {
+		rError() << "ERROR: invalid zip-file " << name.c_str() << '\n';
 	}
 }
 
@@ -29,59 +68,109 @@ ZipArchive::~ZipArchive() {
 }
 
 bool ZipArchive::failed() {
-	return m_istream.failed();
+	return !_mapping && m_istream->failed();
+}
+
+ZipRecord* ZipArchive::findRecord(const std::string& name) const
+{
+	RecordIndex::const_iterator found = _index.find(normalisePath(name));
+	return found != _index.end() ? found->second : NULL;
+}
+
+std::size_t ZipArchive::getDataOffset(const ZipRecord& record)
+{
+	if (_mapping)
+	{
+		// Read the local header in place, checking it lies within the mapping
+		const std::size_t size = _mapping->size();
+
+		if (record.m_position > size || size - record.m_position < LOCAL_HEADER_SIZE)
+		{
+			return 0;
+		}
+
+		const unsigned char* header = _mapping->data() + record.m_position;
+
+		MemoryInputStream stream(header, LOCAL_HEADER_SIZE);
+		zip_magic magic;
+		istream_read_zip_magic(stream, magic);
+
+		if (magic != zip_file_header_magic)
+		{
+			return 0;
+		}
+
+		std::size_t offset = record.m_position + LOCAL_HEADER_SIZE +
+			readUInt16(header + 26) + readUInt16(header + 28);
+
+		return offset <= size && size - offset >= record.m_stream_size ? offset : 0;
+	}
+
+	m_istream->seek(record.m_position);
+	zip_file_header file_header;
+	istream_read_zip_file_header(*m_istream, file_header);
+
+	if (file_header.z_magic != zip_file_header_magic) {
+		return 0;
+	}
+
+	return m_istream->tell();
 }
 
 ArchiveFilePtr ZipArchive::openFile(const std::string& name) {
-	ZipFileSystem::iterator i = m_filesystem.find(name);
-	if (i != m_filesystem.end() && !i->second.is_directory()) {
-		ZipRecord* file = i->second.file();
+	ZipRecord* file = findRecord(name);
 
-		m_istream.seek(file->m_position);
-		zip_file_header file_header;
-		istream_read_zip_file_header(m_istream, file_header);
+	if (file != NULL) {
+		std::size_t offset = getDataOffset(*file);
 
-		if (file_header.z_magic != zip_file_header_magic) {
+		if (offset == 0) {
 			rError() << "error reading zip file " << m_name.c_str();
 			return ArchiveFilePtr();
 		}
 
+		if (_mapping) {
+			return ArchiveFilePtr(new MappedArchiveFile(name, _mapping, _mapping->data() + offset,
+				file->m_stream_size, file->m_file_size, file->m_mode == ZipRecord::eDeflated));
+		}
+
 		switch (file->m_mode) {
 			case ZipRecord::eStored:
-				return ArchiveFilePtr(new StoredArchiveFile(name, m_name, m_istream.tell(), file->m_stream_size, file->m_file_size));
+				return ArchiveFilePtr(new StoredArchiveFile(name, m_name, offset, file->m_stream_size, file->m_file_size));
 			case ZipRecord::eDeflated:
-				return ArchiveFilePtr(new DeflatedArchiveFile(name, m_name, m_istream.tell(), file->m_stream_size, file->m_file_size));
+				return ArchiveFilePtr(new DeflatedArchiveFile(name, m_name, offset, file->m_stream_size, file->m_file_size));
 		}
 	}
 	return ArchiveFilePtr();
 }
 
 ArchiveTextFilePtr ZipArchive::openTextFile(const std::string& name) {
-	ZipFileSystem::iterator i = m_filesystem.find(name);
-	if (i != m_filesystem.end() && !i->second.is_directory()) {
-		ZipRecord* file = i->second.file();
+	ZipRecord* file = findRecord(name);
 
-		m_istream.seek(file->m_position);
-		zip_file_header file_header;
-		istream_read_zip_file_header(m_istream, file_header);
+	if (file != NULL) {
+		std::size_t offset = getDataOffset(*file);
 
-		if (file_header.z_magic != zip_file_header_magic) {
+		if (offset == 0) {
 			rError() << "error reading zip file " << m_name.c_str();
 			return ArchiveTextFilePtr();
 		}
 
+		if (_mapping) {
+			return ArchiveTextFilePtr(new MappedArchiveTextFile(name, m_name, _mapping,
+				_mapping->data() + offset, file->m_stream_size, file->m_mode == ZipRecord::eDeflated));
+		}
+
 		switch (file->m_mode) {
 			case ZipRecord::eStored:
 				return ArchiveTextFilePtr(new StoredArchiveTextFile(name,
 					m_name,
 					m_name,
-					m_istream.tell(),
+					offset,
 					file->m_stream_size));
 			case ZipRecord::eDeflated:
 				return ArchiveTextFilePtr(new DeflatedArchiveTextFile(name,
 					m_name,
 					m_name,
-					m_istream.tell(),
+					offset,
 					file->m_stream_size));
 		}
 	}
@@ -89,53 +178,52 @@ ArchiveTextFilePtr ZipArchive::openTextFile(const std::string& name) {
 }
 
 bool ZipArchive::containsFile(const std::string& name) {
-	ZipFileSystem::iterator i = m_filesystem.find(name);
-	return i != m_filesystem.end() && !i->second.is_directory();
+	return findRecord(name) != NULL;
 }
 
 void ZipArchive::forEachFile(VisitorFunc visitor, const std::string& root) {
 	m_filesystem.traverse(visitor, root);
 }
 
-bool ZipArchive::read_record() {
+bool ZipArchive::read_record(SeekableInputStream& stream) {
 	zip_magic magic;
-	istream_read_zip_magic(m_istream, magic);
+	istream_read_zip_magic(stream, magic);
 
 	if (!(magic == zip_root_dirent_magic)) {
 		return false;
 	}
 	zip_version version_encoder;
-	istream_read_zip_version(m_istream, version_encoder);
+	istream_read_zip_version(stream, version_encoder);
 	zip_version version_extract;
-	istream_read_zip_version(m_istream, version_extract);
+	istream_read_zip_version(stream, version_extract);
 	//unsigned short flags =
-	istream_read_int16_le(m_istream);
-	unsigned short compression_mode = istream_read_int16_le(m_istream);
+	istream_read_int16_le(stream);
+	unsigned short compression_mode = istream_read_int16_le(stream);
 
 	if (compression_mode != Z_DEFLATED && compression_mode != 0) {
 		return false;
 	}
 
 	zip_dostime dostime;
-	istream_read_zip_dostime(m_istream, dostime);
+	istream_read_zip_dostime(stream, dostime);
 
 	//unsigned int crc32 =
-	istream_read_int32_le(m_istream);
+	istream_read_int32_le(stream);
 
-	unsigned int compressed_size = istream_read_uint32_le(m_istream);
-	unsigned int uncompressed_size = istream_read_uint32_le(m_istream);
-	unsigned int namelength = istream_read_uint16_le(m_istream);
-	unsigned short extras = istream_read_uint16_le(m_istream);
-	unsigned short comment = istream_read_uint16_le(m_istream);
+	unsigned int compressed_size = istream_read_uint32_le(stream);
+	unsigned int uncompressed_size = istream_read_uint32_le(stream);
+	unsigned int namelength = istream_read_uint16_le(stream);
+	unsigned short extras = istream_read_uint16_le(stream);
+	unsigned short comment = istream_read_uint16_le(stream);
 
 	//unsigned short diskstart =
-	istream_read_int16_le(m_istream);
+	istream_read_int16_le(stream);
 	//unsigned short filetype =
-	istream_read_int16_le(m_istream);
+	istream_read_int16_le(stream);
 	//unsigned int filemode =
-	istream_read_int32_le(m_istream);
+	istream_read_int32_le(stream);
 
-	unsigned int position = istream_read_int32_le(m_istream);
+	unsigned int position = istream_read_int32_le(stream);
 
 	// greebo: Read the filename directly into a newly constructed std::string.
 
@@ -146,11 +234,11 @@ bool ZipArchive::read_record() {
 
 	std::string path(namelength, '\0');
 
-	m_istream.read(
-		reinterpret_cast<FileInputStream::byte_type*>(const_cast<char*>(path.data())),
+	stream.read(
+		reinterpret_cast<SeekableInputStream::byte_type*>(const_cast<char*>(path.data())),
 		namelength);
 
-	m_istream.seek(extras + comment, FileInputStream::cur);
+	stream.seek(extras + comment, SeekableInputStream::cur);
 
 	if (path_is_directory(path.c_str())) {
 		m_filesystem[path] = 0;
@@ -167,28 +255,30 @@ bool ZipArchive::read_record() {
 								 compressed_size,
 								 uncompressed_size,
 								 (compression_mode == Z_DEFLATED) ? ZipRecord::eDeflated : ZipRecord::eStored);
+
+			_index[normalisePath(path)] = file.file();
 		}
 	}
 
 	return true;
 }
 
-bool ZipArchive::read_pkzip() {
-	SeekableStream::position_type pos = pkzip_find_disk_trailer(m_istream);
+bool ZipArchive::read_pkzip(SeekableInputStream& stream) {
+	SeekableStream::position_type pos = pkzip_find_disk_trailer(stream);
 	if (pos != 0) {
 		zip_disk_trailer disk_trailer;
 
-		m_istream.seek(pos);
-		istream_read_zip_disk_trailer(m_istream, disk_trailer);
+		stream.seek(pos);
+		istream_read_zip_disk_trailer(stream, disk_trailer);
 
 		if (!(disk_trailer.z_magic == zip_disk_trailer_magic)) {
 			return false;
 		}
 
-		m_istream.seek(disk_trailer.z_rootseek);
+		stream.seek(disk_trailer.z_rootseek);
 
 		for (unsigned int i = 0; i < disk_trailer.z_entries; ++i) {
-			if (!read_record()) {
+			if (!read_record(stream)) {
 				return false;
 			}
 		}
@@ -4,6 +4,10 @@
 #include "iarchive.h"
 #include "fs_filesystem.h"
 #include "stream/filestream.h"
+#include "MappedFile.h"
+
+#include <memory>
+#include <unordered_map>
 
 class ZipRecord {
 public:
@@ -30,12 +34,29 @@ public:
 };
 typedef GenericFileSystem<ZipRecord> ZipFileSystem;
 
+/**
+ * Archive implementation for ZIP files (PK4).
+ *
+ * The archive is mapped into memory if possible. Files are then read or
+ * inflated straight from the mapping, without opening the archive again.
+ * Otherwise, each opened file uses its own file stream.
+ */
 class ZipArchive :
 	public Archive
 {
 	ZipFileSystem m_filesystem;
 	std::string m_name;
-	FileInputStream m_istream;
+
+	// The mapped archive, or an empty pointer if mapping failed
+	MappedFilePtr _mapping;
+
+	// Only used if the archive couldn't be mapped
+	std::unique_ptr<FileInputStream> m_istream;
+
+	// The file records by normalised (lowercase) path, for lookups
+	// without walking the directory tree
+	typedef std::unordered_map<std::string, ZipRecord*> RecordIndex;
+	RecordIndex _index;
 
 public:
 	ZipArchive(const std::string& name);
@@ -50,8 +71,14 @@ public:
 	void forEachFile(VisitorFunc visitor, const std::string& root);
 
 private:
-	bool read_record();
-	bool read_pkzip();
+	ZipRecord* findRecord(const std::string& name) const;
+
+	// Returns the offset of the file data following the local header of the
+	// given record, or 0 if the header is invalid
+	std::size_t getDataOffset(const ZipRecord& record);
+
+	bool read_record(SeekableInputStream& stream);
+	bool read_pkzip(SeekableInputStream& stream);
 };
 typedef std::shared_ptr<ZipArchive> ZipArchivePtr;
 
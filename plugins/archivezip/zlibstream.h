@@ -70,6 +70,43 @@ public:
   }
 };
 
+/// \brief An InputStream of data compressed with the zlib deflate algorithm, which is entirely in memory.
+///
+/// - Inflates directly from the given bytes, without copying them to an intermediate buffer.
+/// - The bytes are not copied and need to stay valid for the lifetime of the stream.
+class DeflatedMemoryInputStream : public InputStream
+{
+  z_stream m_zipstream;
+
+public:
+  DeflatedMemoryInputStream(const byte_type* data, size_type size)
+  {
+    m_zipstream.zalloc = 0;
+    m_zipstream.zfree = 0;
+    m_zipstream.opaque = 0;
+    m_zipstream.next_in = const_cast<byte_type*>(data);
+    m_zipstream.avail_in = static_cast<uInt>(size);
+    inflateInit2(&m_zipstream, -MAX_WBITS);
+  }
+  ~DeflatedMemoryInputStream()
+  {
+    inflateEnd(&m_zipstream);
+  }
+  size_type read(byte_type* buffer, size_type length)
+  {
+    m_zipstream.next_out = buffer;
+    m_zipstream.avail_out = static_cast<uInt>(length);
+    while(m_zipstream.avail_out != 0)
+    {
+      if(inflate(&m_zipstream, Z_SYNC_FLUSH) != Z_OK)
+      {
+        break;
+      }
+    }
+    return length - m_zipstream.avail_out;
+  }
+};
+
 #endif
 
 
@@ -457,9 +457,10 @@ void Doom3EntityClass::resolveInheritance(EntityClasses& classmap)
     }
     else
     {
-        // If no colour is set, assign the default entity colour to this class
-        static Vector3 defaultColour = ColourSchemes().getColour("default_entity");
-        setColour(defaultColour);
+        // If no colour is set, assign the default entity colour to this class.
+        // This might be called from several threads, so don't cache the
+        // colour in a function-local static.
+        setColour(Vector3(-1, -1, -1));
     }
 }
 
@@ -554,7 +555,56 @@ void Doom3EntityClass::parseEditorSpawnarg(const std::string& key,
     }
 }
 
-void Doom3EntityClass::parseFromTokens(parser::DefTokeniser& tokeniser)
+void Doom3EntityClass::parseKeyValue(const std::string& key, const std::string& value)
+{
+    // Handle some keys specially
+    if (key == "model")
+    {
+        setModelPath(os::standardPath(value));
+    }
+    else if (key == "editor_color")
+    {
+        setColour(string::convert<Vector3>(value));
+    }
+    else if (key == "editor_light")
+    {
+        setIsLight(value == "1");
+    }
+    else if (key == "spawnclass")
+    {
+        setIsLight(value == "idLight");
+    }
+    else if (boost::algorithm::istarts_with(key, "editor_"))
+    {
+        parseEditorSpawnarg(key, value);
+    }
+
+    // Try parsing this key/value with the Attachments manager
+    _attachments->parseDefAttachKeys(key, value);
+
+    // Add the EntityClassAttribute for this key/val
+    if (getAttribute(key).getType().empty())
+    {
+        // Following key-specific processing, add the keyvalue to the eclass
+        EntityClassAttribute attribute("text", key, value, "");
+
+        // Type is empty, attribute does not exist, add it.
+        addAttribute(attribute);
+    }
+    else if (getAttribute(key).getValue().empty())
+    {
+        // Attribute type is set, but value is empty, set the value.
+        getAttribute(key).setValue(value);
+    }
+    else
+    {
+        // Both type and value are not empty, emit a warning
+        rWarning() << "[eclassmgr] attribute " << key
+            << " already set on entityclass " << _name << std::endl;
+    }
+}
+
+void Doom3EntityClass::parseFromTokens(parser::DefTokeniser& tokeniser, KeyValues* keyValues)
 {
     // Clear this structure first, we might be "refreshing" ourselves from tokens
     clear();
@@ -568,52 +618,28 @@ void Doom3EntityClass::parseFromTokens(parser::DefTokeniser& tokeniser)
     {
         const std::string value = tokeniser.nextToken();
 
-        // Handle some keys specially
-        if (key == "model")
-        {
-            setModelPath(os::standardPath(value));
-        }
-        else if (key == "editor_color")
-        {
-            setColour(string::convert<Vector3>(value));
-        }
-        else if (key == "editor_light")
-        {
-            setIsLight(value == "1");
-        }
-        else if (key == "spawnclass")
-        {
-            setIsLight(value == "idLight");
-        }
-        else if (boost::algorithm::istarts_with(key, "editor_"))
+        parseKeyValue(key, value);
+
+        if (keyValues != NULL)
         {
-            parseEditorSpawnarg(key, value);
+            keyValues->push_back(KeyValues::value_type(key, value));
         }
+    } // while true
 
-        // Try parsing this key/value with the Attachments manager
-        _attachments->parseDefAttachKeys(key, value);
+    _attachments->validateAttachments();
 
-        // Add the EntityClassAttribute for this key/val
-        if (getAttribute(key).getType().empty())
-        {
-            // Following key-specific processing, add the keyvalue to the eclass
-            EntityClassAttribute attribute("text", key, value, "");
+    // Notify the observers
+    _changedSignal.emit();
+}
 
-            // Type is empty, attribute does not exist, add it.
-            addAttribute(attribute);
-        }
-        else if (getAttribute(key).getValue().empty())
-        {
-            // Attribute type is set, but value is empty, set the value.
-            getAttribute(key).setValue(value);
-        }
-        else
-        {
-            // Both type and value are not empty, emit a warning
-            rWarning() << "[eclassmgr] attribute " << key
-                << " already set on entityclass " << _name << std::endl;
-        }
-    } // while true
+void Doom3EntityClass::parseFromKeyValues(const KeyValues& keyValues)
+{
+    clear();
+
+    for (KeyValues::const_iterator i = keyValues.begin(); i != keyValues.end(); ++i)
+    {
+        parseKeyValue(i->first, i->second);
+    }
 
     _attachments->validateAttachments();
 
@@ -621,4 +647,36 @@ void Doom3EntityClass::parseFromTokens(parser::DefTokeniser& tokeniser)
     _changedSignal.emit();
 }
 
+void Doom3EntityClass::takeParsedContents(Doom3EntityClass& other)
+{
+    // The parent pointer is kept, as it is when parsing from tokens
+    _isLight = other._isLight;
+
+    _colour = other._colour;
+    _colourSpecified = other._colourSpecified;
+    _colourTransparent = other._colourTransparent;
+
+    // The shaders have only been defined if there was an editor_color key
+    if (other._colourSpecified)
+    {
+        _fillShader.swap(other._fillShader);
+        _wireShader.swap(other._wireShader);
+    }
+
+    _fixedSize = other._fixedSize;
+
+    _attributes.swap(other._attributes);
+    _model.swap(other._model);
+    _skin.swap(other._skin);
+    _inheritanceResolved = other._inheritanceResolved;
+
+    _modName.swap(other._modName);
+
+    // Both classes have the same name, so the attachments can be swapped too
+    _attachments.swap(other._attachments);
+
+    // Notify the observers
+    _changedSignal.emit();
+}
+
 } // namespace eclass
@@ -107,6 +107,7 @@ private:
     // Clear all contents (done before parsing from tokens)
     void clear();
     void parseEditorSpawnarg(const std::string& key, const std::string& value);
+    void parseKeyValue(const std::string& key, const std::string& value);
     void setIsLight(bool val);
 
 public:
@@ -198,8 +199,22 @@ public:
         _modName = mn;
     }
 
-    // Initialises this class from the given tokens
-    void parseFromTokens(parser::DefTokeniser& tokeniser);
+    typedef std::vector<std::pair<std::string, std::string> > KeyValues;
+
+    // Initialises this class from the given tokens. If keyValues is not NULL,
+    // the parsed key/value pairs are appended to it.
+    void parseFromTokens(parser::DefTokeniser& tokeniser, KeyValues* keyValues = NULL);
+
+    // Initialises this class from the key/value pairs recorded by parseFromTokens
+    void parseFromKeyValues(const KeyValues& keyValues);
+
+    /**
+     * Replace the contents of this class with the ones of the given class,
+     * which has been parsed from tokens into a temporary object. Like a
+     * parseFromTokens() call, this clears the resolved inheritance and notifies
+     * the observers. The other class is left in an unspecified state.
+     */
+    void takeParsedContents(Doom3EntityClass& other);
 
     void setParseStamp(std::size_t parseStamp)
     {
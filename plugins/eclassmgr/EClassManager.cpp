@@ -10,18 +10,80 @@
 #include "iuimanager.h"
 #include "ifilesystem.h"
 #include "archivelib.h"
-#include "parser/DefTokeniser.h"
+#include "imodule.h"
+#include "parser/BufferDefTokeniser.h"
 
 #include "Doom3EntityClass.h"
 #include "Doom3ModelDef.h"
 
 #include <boost/algorithm/string/case_conv.hpp>
 #include <functional>
+#include <limits>
+#include <sstream>
 
 #include "debugging/ScopedDebugTimer.h"
+#include "util/ThreadPool.h"
 
 namespace eclass {
 
+namespace
+{
+	// The parse results of unchanged def files are stored here, in the settings folder
+	const char* const PARSE_CACHE_FILE = "entitydefs.cache";
+
+	// Identifies the layout of the cached data, change it along with
+	// WriteCacheData() and ReadCacheData()
+	const char* const PARSE_CACHE_FORMAT = "entitydefs1";
+
+	// The kinds of declarations in the cached data
+	enum CachedDeclType
+	{
+		CACHED_ENTITYDEF,
+		CACHED_MODEL
+	};
+
+	// The inheritance depth of classes which are part of (or inherit from)
+	// a circular inheritance chain
+	const std::size_t INHERITANCE_CYCLE = std::numeric_limits<std::size_t>::max();
+
+	typedef std::map<const Doom3EntityClass*, std::size_t> InheritanceDepths;
+
+	// Returns the number of ancestors of the given class which are present in the map
+	std::size_t getInheritanceDepth(const Doom3EntityClassPtr& eclass,
+		const Doom3EntityClass::EntityClasses& classes, InheritanceDepths& depths)
+	{
+		std::pair<InheritanceDepths::iterator, bool> result = depths.insert(
+			InheritanceDepths::value_type(eclass.get(), INHERITANCE_CYCLE)
+		);
+
+		if (!result.second)
+		{
+			// Either known already, or still being calculated further
+			// up the call stack, in which case we ran into a cycle
+			return result.first->second;
+		}
+
+		std::size_t depth = 0;
+
+		const std::string& parentName = eclass->getAttribute("inherit").getValue();
+
+		if (!parentName.empty() && parentName != eclass->getName())
+		{
+			Doom3EntityClass::EntityClasses::const_iterator parent = classes.find(parentName);
+
+			if (parent != classes.end())
+			{
+				std::size_t parentDepth = getInheritanceDepth(parent->second, classes, depths);
+				depth = parentDepth == INHERITANCE_CYCLE ? INHERITANCE_CYCLE : parentDepth + 1;
+			}
+		}
+
+		result.first->second = depth;
+
+		return depth;
+	}
+}
+
 // Constructor
 EClassManager::EClassManager() :
     _realised(false),
@@ -131,15 +193,74 @@ void EClassManager::parseDefFiles()
 	// Increase the parse stamp for this run
 	_curParseStamp++;
 
+	// The parser threads might look up the default entity colour, make sure
+	// the module reference is acquired in this thread
+	ColourSchemes();
+
 	{
 		ScopedDebugTimer timer("EntityDefs parsed: ");
+
+		std::vector<std::string> filenames;
+
         GlobalFileSystem().forEachFile("def/", "def", [&](const std::string& filename)
         {
-            parseFile(filename);
+            filenames.push_back(filename);
         });
+
+		// Parse each file into its own list of declarations, then insert
+		// them in the order the files have been visited. This way the outcome
+		// and the log output don't depend on the number of threads.
+		std::vector<ParsedFile> parsedFiles(filenames.size());
+
+		parser::ParseCache cache(
+			module::GlobalModuleRegistry().getApplicationContext().getSettingsPath() + PARSE_CACHE_FILE,
+			PARSE_CACHE_FORMAT
+		);
+		cache.load();
+
+		util::ThreadPool pool(0);
+
+		std::vector<ThreadLogBuffer> logs(filenames.size());
+
+		util::parallelFor(pool, filenames.size(), [&](std::size_t index)
+		{
+			ScopedThreadStreamRedirect redirect(&logs[index]);
+			parseFile(filenames[index], parsedFiles[index], cache);
+		});
+
+		for (std::size_t i = 0; i < parsedFiles.size(); ++i)
+		{
+			logs[i].flush();
+			insertDefinitions(parsedFiles[i]);
+		}
+
+		rMessage() << "[eclassmgr] " << cache.getNumHits() << " of " << filenames.size()
+			<< " def files loaded from the parse cache." << std::endl;
+
+		if (!cache.save())
+		{
+			rWarning() << "[eclassmgr] Could not write the parse cache." << std::endl;
+		}
 	}
 }
 
+void EClassManager::resolveEntityInheritance(Doom3EntityClass& eclass)
+{
+	// Tell the class to resolve its own inheritance using the given
+	// map as a source for parent lookup
+	eclass.resolveInheritance(_entityClasses);
+
+    // If the entity has a model path ("model" key), lookup the actual
+    // model and apply its mesh and skin to this entity.
+    if (eclass.getModelPath().size() > 0) {
+        Models::iterator j = _models.find(eclass.getModelPath());
+        if (j != _models.end()) {
+            eclass.setModelPath(j->second->mesh);
+            eclass.setSkin(j->second->skin);
+        }
+    }
+}
+
 void EClassManager::resolveInheritance()
 {
 	// Resolve inheritance on the model classes
@@ -149,24 +270,55 @@ void EClassManager::resolveInheritance()
 
     // Resolve inheritance for the entities. At this stage the classes
     // will have the name of their parent, but not an actual pointer to
-    // it
-    for (EntityClasses::iterator i = _entityClasses.begin();
-         i != _entityClasses.end(); ++i)
+    // it. The classes are grouped by the number of their ancestors, each
+    // group can be resolved in parallel once the previous one is done.
+	std::vector<Doom3EntityClass*> classes;
+	std::vector<std::vector<std::size_t> > levels;
+
 	{
-		// Tell the class to resolve its own inheritance using the given
-		// map as a source for parent lookup
-		i->second->resolveInheritance(_entityClasses);
-
-        // If the entity has a model path ("model" key), lookup the actual
-        // model and apply its mesh and skin to this entity.
-        if (i->second->getModelPath().size() > 0) {
-            Models::iterator j = _models.find(i->second->getModelPath());
-            if (j != _models.end()) {
-                i->second->setModelPath(j->second->mesh);
-                i->second->setSkin(j->second->skin);
-            }
-        }
-    }
+		InheritanceDepths depths;
+
+		for (EntityClasses::iterator i = _entityClasses.begin(); i != _entityClasses.end(); ++i)
+		{
+			std::size_t depth = getInheritanceDepth(i->second, _entityClasses, depths);
+
+			if (depth == INHERITANCE_CYCLE)
+			{
+				rWarning() << "[eclassmgr] Entity class " << i->first
+					<< " has a circular inheritance chain, not resolving it" << std::endl;
+				continue;
+			}
+
+			if (depth >= levels.size())
+			{
+				levels.resize(depth + 1);
+			}
+
+			levels[depth].push_back(classes.size());
+			classes.push_back(i->second.get());
+		}
+	}
+
+	// The log output of each class is written out in map order afterwards
+	std::vector<ThreadLogBuffer> logs(classes.size());
+
+	util::ThreadPool pool(0);
+
+	for (std::size_t l = 0; l < levels.size(); ++l)
+	{
+		const std::vector<std::size_t>& level = levels[l];
+
+		util::parallelFor(pool, level.size(), [&](std::size_t i)
+		{
+			ScopedThreadStreamRedirect redirect(&logs[level[i]]);
+			resolveEntityInheritance(*classes[level[i]]);
+		}, 16);
+	}
+
+	for (std::size_t i = 0; i < logs.size(); ++i)
+	{
+		logs[i].flush();
+	}
 
 	// greebo: Override the eclass colours of two special entityclasses
     Vector3 worlspawnColour = ColourSchemes().getColour("default_brush");
@@ -323,13 +475,12 @@ void EClassManager::onFileSystemShutdown()
 	unrealise();
 }
 
-// Parse the provided stream containing the contents of a single .def file.
+// Parse the contents of a single .def file.
 // Extract all entitydefs and create objects accordingly.
-void EClassManager::parse(TextInputStream& inStr, const std::string& modDir)
+void EClassManager::parse(const std::string& contents, ParsedFile& parsed)
 {
-	// Construct a tokeniser for the stream
-	std::istream is(&inStr);
-    parser::BasicDefTokeniser<std::istream> tokeniser(is);
+	// Construct a tokeniser for the file contents
+    parser::BufferDefTokeniser tokeniser(contents);
 
     while (tokeniser.hasMoreTokens())
 	{
@@ -342,62 +493,189 @@ void EClassManager::parse(TextInputStream& inStr, const std::string& modDir)
 			const std::string sName =
     			boost::algorithm::to_lower_copy(tokeniser.nextToken());
 
-			// Ensure that an Entity class with this name already exists
-			// When reloading entityDef declarations, most names will already be registered
-			EntityClasses::iterator i = _entityClasses.find(sName);
+			// Parse into a new class, existing classes of the same name take over
+			// its contents later on. The declaration is added first, to keep a
+			// partially parsed class in case of a parse error.
+			parsed.decls.push_back(ParsedDecl());
+			ParsedDecl& decl = parsed.decls.back();
 
-			if (i == _entityClasses.end())
+			decl.name = sName;
+			decl.entityClass.reset(new eclass::Doom3EntityClass(sName));
+
+        	// Parse the contents of the eclass (excluding name)
+			decl.entityClass->parseFromTokens(tokeniser, &decl.keyValues);
+
+			// Set the mod directory
+        	decl.entityClass->setModName(parsed.modName);
+        }
+        else if (blockType == "model")
+		{
+			// Read the name
+			std::string modelDefName = tokeniser.nextToken();
+
+			parsed.decls.push_back(ParsedDecl());
+			ParsedDecl& decl = parsed.decls.back();
+
+			// Allocate an empty ModelDef and invoke the parser routine
+			decl.name = modelDefName;
+			decl.model.reset(new Doom3ModelDef(modelDefName));
+
+        	decl.model->parseFromTokens(tokeniser);
+			decl.model->setModName(parsed.modName);
+        }
+    }
+}
+
+std::string EClassManager::WriteCacheData(const ParsedFile& parsed)
+{
+	std::string data;
+	parser::CacheWriter writer(data);
+
+	writer.writeString(parsed.modName);
+	writer.writeInt(static_cast<std::uint32_t>(parsed.decls.size()));
+
+	for (std::vector<ParsedDecl>::const_iterator decl = parsed.decls.begin();
+		 decl != parsed.decls.end(); ++decl)
+	{
+		if (decl->entityClass)
+		{
+			writer.writeByte(CACHED_ENTITYDEF);
+			writer.writeString(decl->name);
+			writer.writeInt(static_cast<std::uint32_t>(decl->keyValues.size()));
+
+			for (Doom3EntityClass::KeyValues::const_iterator i = decl->keyValues.begin();
+				 i != decl->keyValues.end(); ++i)
 			{
-				// Not existing yet, allocate a new class
-        		Doom3EntityClassPtr entityClass(new eclass::Doom3EntityClass(sName));
+				writer.writeString(i->first);
+				writer.writeString(i->second);
+			}
+		}
+		else
+		{
+			const Doom3ModelDef& model = *decl->model;
 
-				std::pair<EntityClasses::iterator, bool> result = _entityClasses.insert(
-					EntityClasses::value_type(sName, entityClass)
-				);
+			writer.writeByte(CACHED_MODEL);
+			writer.writeString(decl->name);
+			writer.writeString(model.parent);
+			writer.writeString(model.mesh);
+			writer.writeString(model.skin);
+			writer.writeInt(static_cast<std::uint32_t>(model.anims.size()));
 
-				i = result.first;
+			for (IModelDef::Anims::const_iterator i = model.anims.begin(); i != model.anims.end(); ++i)
+			{
+				writer.writeString(i->first);
+				writer.writeString(i->second);
 			}
-			else
+		}
+	}
+
+	return data;
+}
+
+bool EClassManager::ReadCacheData(const std::string& data, ParsedFile& parsed)
+{
+	try
+	{
+		parser::CacheReader reader(data);
+
+		parsed.modName = reader.readString();
+
+		std::size_t numDecls = reader.readInt();
+
+		for (std::size_t d = 0; d < numDecls; ++d)
+		{
+			parsed.decls.push_back(ParsedDecl());
+			ParsedDecl& decl = parsed.decls.back();
+
+			unsigned char type = reader.readByte();
+			decl.name = reader.readString();
+
+			if (type == CACHED_ENTITYDEF)
 			{
-				// EntityDef already exists, compare the parse stamp
-				if (i->second->getParseStamp() == _curParseStamp)
+				std::size_t numKeyValues = reader.readInt();
+
+				Doom3EntityClass::KeyValues keyValues;
+
+				for (std::size_t i = 0; i < numKeyValues; ++i)
 				{
-					rWarning() << "[eclassmgr]: EntityDef "
-						<< sName << " redefined" << std::endl;
+					std::string key = reader.readString();
+					keyValues.push_back(Doom3EntityClass::KeyValues::value_type(key, reader.readString()));
 				}
+
+				decl.entityClass.reset(new eclass::Doom3EntityClass(decl.name));
+				decl.entityClass->parseFromKeyValues(keyValues);
+				decl.entityClass->setModName(parsed.modName);
 			}
+			else if (type == CACHED_MODEL)
+			{
+				decl.model.reset(new Doom3ModelDef(decl.name));
 
-			// At this point, i is pointing to a valid entityclass
+				decl.model->parent = reader.readString();
+				decl.model->mesh = reader.readString();
+				decl.model->skin = reader.readString();
 
-			i->second->setParseStamp(_curParseStamp);
+				std::size_t numAnims = reader.readInt();
 
-        	// Parse the contents of the eclass (excluding name)
-			i->second->parseFromTokens(tokeniser);
+				for (std::size_t i = 0; i < numAnims; ++i)
+				{
+					std::string name = reader.readString();
+					decl.model->anims.insert(IModelDef::Anims::value_type(name, reader.readString()));
+				}
 
-			// Set the mod directory
-        	i->second->setModName(modDir);
-        }
-        else if (blockType == "model")
-		{
-			// Read the name
-			std::string modelDefName = tokeniser.nextToken();
+				decl.model->setModName(parsed.modName);
+			}
+			else
+			{
+				throw parser::ParseException("EClassManager: invalid cached declaration type");
+			}
+		}
+	}
+	catch (parser::ParseException&)
+	{
+		parsed.decls.clear();
+		return false;
+	}
+
+	return true;
+}
 
-			// Ensure that an Entity class with this name already exists
+void EClassManager::insertDefinitions(const ParsedFile& parsed)
+{
+	for (std::vector<ParsedDecl>::const_iterator decl = parsed.decls.begin();
+		 decl != parsed.decls.end(); ++decl)
+	{
+		if (decl->entityClass)
+		{
 			// When reloading entityDef declarations, most names will already be registered
-			Models::iterator i = _models.find(modelDefName);
+			EntityClasses::iterator i = _entityClasses.find(decl->name);
 
-			if (i == _models.end())
+			if (i == _entityClasses.end())
 			{
-				// Does not exist yet, allocate a new one
+				// Not existing yet, take the parsed class
+				i = _entityClasses.insert(EntityClasses::value_type(decl->name, decl->entityClass)).first;
+			}
+			else
+			{
+				// EntityDef already exists, compare the parse stamp
+				if (i->second->getParseStamp() == _curParseStamp)
+				{
+					rWarning() << "[eclassmgr]: EntityDef "
+						<< decl->name << " redefined" << std::endl;
+				}
 
-				// Allocate an empty ModelDef
-        		Doom3ModelDefPtr model(new Doom3ModelDef(modelDefName));
+				// Keep the existing instance, IEntityClassPtrs must remain intact
+				i->second->takeParsedContents(*decl->entityClass);
+			}
 
-				std::pair<Models::iterator, bool> result = _models.insert(
-					Models::value_type(modelDefName, model)
-				);
+			i->second->setParseStamp(_curParseStamp);
+		}
+		else
+		{
+			Models::iterator i = _models.find(decl->name);
 
-				i = result.first;
+			if (i == _models.end())
+			{
+				i = _models.insert(Models::value_type(decl->name, decl->model)).first;
 			}
 			else
 			{
@@ -405,35 +683,85 @@ void EClassManager::parse(TextInputStream& inStr, const std::string& modDir)
 				if (i->second->getParseStamp() == _curParseStamp)
 				{
 					rWarning() << "[eclassmgr]: Model "
-						<< modelDefName << " redefined" << std::endl;
+						<< decl->name << " redefined" << std::endl;
 				}
+
+				// Keep the existing instance, only copy the parsed values
+				*i->second = *decl->model;
 			}
 
-			// Model structure is allocated and in the map,
-            // invoke the parser routine
 			i->second->setParseStamp(_curParseStamp);
-
-        	i->second->parseFromTokens(tokeniser);
-			i->second->setModName(modDir);
-        }
-    }
+		}
+	}
 }
 
-void EClassManager::parseFile(const std::string& filename)
+void EClassManager::parseFile(const std::string& filename, ParsedFile& parsed, parser::ParseCache& cache)
 {
 	const std::string fullname = "def/" + filename;
 
-	ArchiveTextFilePtr file = GlobalFileSystem().openTextFile(fullname);
+	parser::ParseCache::FileStamp stamp;
+
+	{
+		std::lock_guard<std::mutex> lock(_vfsLock);
+		stamp = cache.getStamp(GlobalFileSystem().findPhysicalFile(fullname));
+	}
+
+	const std::string* cached = cache.findByStamp(fullname, stamp);
+
+	if (cached != NULL && ReadCacheData(*cached, parsed))
+	{
+		return; // unchanged since the last run
+	}
+
+	ArchiveTextFilePtr file;
+
+	{
+		std::lock_guard<std::mutex> lock(_vfsLock);
+		file = GlobalFileSystem().openTextFile(fullname);
+	}
 
 	if (file == NULL) return;
 
+	parsed.modName = file->getModName();
+
+	std::string contents;
+
+	{
+		std::istream is(&(file->getInputStream()));
+		parser::readStream(is, contents);
+	}
+
+	// The archive might have changed, but not this file
+	std::uint64_t contentHash = parser::ParseCache::GetContentHash(contents);
+
+	cached = cache.findByContent(fullname, stamp, contentHash);
+
+	if (cached != NULL && ReadCacheData(*cached, parsed))
+	{
+		return;
+	}
+
+	// Damaged cache data might have overwritten the mod name
+	parsed.modName = file->getModName();
+
 	try {
 		// Parse entity defs from the file
-		parse(file->getInputStream(), file->getModName());
+		parse(contents, parsed);
 	}
 		catch (parser::ParseException& e) {
 			rError() << "[eclassmgr] failed to parse " << filename
 					  << " (" << e.what() << ")" << std::endl;
+
+		// Don't cache the results, to get the error again on the next run
+		return;
+	}
+
+	cache.store(fullname, stamp, contentHash, WriteCacheData(parsed));
+
+	// The key/values are only needed for the cache
+	for (std::vector<ParsedDecl>::iterator decl = parsed.decls.begin(); decl != parsed.decls.end(); ++decl)
+	{
+		Doom3EntityClass::KeyValues().swap(decl->keyValues);
 	}
 }
 
@@ -9,6 +9,10 @@
 
 #include "Doom3EntityClass.h"
 #include "Doom3ModelDef.h"
+#include "parser/ParseCache.h"
+
+#include <vector>
+#include <mutex>
 
 namespace eclass
 {
@@ -48,6 +52,31 @@ class EClassManager :
 	// definitions have been parsed
 	std::size_t _curParseStamp;
 
+    // An entityDef or model declaration, parsed into a new object
+    struct ParsedDecl
+    {
+        std::string name;
+
+        // One of these is set
+        Doom3EntityClassPtr entityClass;
+        Doom3ModelDefPtr model;
+
+        // The parsed key/values of the entity class, for the parse cache
+        Doom3EntityClass::KeyValues keyValues;
+    };
+
+    // The declarations found in a single .def file, in file order
+    struct ParsedFile
+    {
+        std::vector<ParsedDecl> decls;
+
+        // The mod the file belongs to
+        std::string modName;
+    };
+
+    // The VFS can't be used by several parser threads at once
+    std::mutex _vfsLock;
+
     sigc::signal<void> _defsReloadedSignal;
 
 public:
@@ -80,17 +109,27 @@ public:
 	virtual void initialiseModule(const ApplicationContext& ctx);
 	virtual void shutdownModule();
 
-	// Method loading the DEF files
-    void parseFile(const std::string& filename);
-
 private:
 	// Tries to insert the given eclass, not overwriting existing ones
 	// In either case, the eclass in the map is returned
 	Doom3EntityClassPtr insertUnique(const Doom3EntityClassPtr& eclass);
     Doom3EntityClassPtr findInternal(const std::string& name) const;
 
-	// Parses the given inputstream for DEFs.
-	void parse(TextInputStream& inStr, const std::string& modDir);
+	// Parses the given DEF file into the given object, or takes the result
+	// from the cache. Called by the parser threads.
+	void parseFile(const std::string& filename, ParsedFile& parsed, parser::ParseCache& cache);
+
+	// Parses the given file contents for DEFs.
+	void parse(const std::string& contents, ParsedFile& parsed);
+
+	// Conversion of the parse results from and to the cached representation.
+	// ReadCacheData returns false if the data is damaged.
+	static std::string WriteCacheData(const ParsedFile& parsed);
+	static bool ReadCacheData(const std::string& data, ParsedFile& parsed);
+
+	// Inserts the parsed declarations into the maps, existing entries take
+	// over the parsed contents
+	void insertDefinitions(const ParsedFile& parsed);
 
 	// Recursively resolves the inheritance of the model defs
 	void resolveModelInheritance(const std::string& name, const Doom3ModelDefPtr& model);
@@ -98,6 +137,9 @@ private:
 	void parseDefFiles();
 	void resolveInheritance();
 
+	// Resolves the inheritance and model of a single entity class
+	void resolveEntityInheritance(Doom3EntityClass& eclass);
+
 	void reloadDefsCmd(const cmd::ArgumentList& args);
 };
 typedef std::shared_ptr<EClassManager> EClassManagerPtr;
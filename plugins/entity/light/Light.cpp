@@ -294,6 +294,9 @@ void Light::rotationChanged()
     _owner.localToParent().translateBy(worldOrigin());
     _owner.localToParent().multiplyBy(m_rotation.getMatrix4());
 
+    // The light volume has been rotated
+    m_doom3Radius.m_changed();
+
     // Notify owner about this
     m_transformChanged();
 
@@ -782,28 +785,68 @@ bool Light::intersectsAABB(const AABB& other) const
     else
     {
         // test against an AABB which contains the rotated bounds of this light.
-        AABB bounds = localAABB();
-        bounds.origin += worldOrigin();
-
-        returnVal = other.intersects(AABB(
-            bounds.origin,
-            Vector3(
-                static_cast<float>(fabs(m_rotation[0] * bounds.extents[0])
-                                    + fabs(m_rotation[3] * bounds.extents[1])
-                                    + fabs(m_rotation[6] * bounds.extents[2])),
-                static_cast<float>(fabs(m_rotation[1] * bounds.extents[0])
-                                    + fabs(m_rotation[4] * bounds.extents[1])
-                                    + fabs(m_rotation[7] * bounds.extents[2])),
-                static_cast<float>(fabs(m_rotation[2] * bounds.extents[0])
-                                    + fabs(m_rotation[5] * bounds.extents[1])
-                                    + fabs(m_rotation[8] * bounds.extents[2]))
-            )
-        ));
+        returnVal = other.intersects(getLightVolumeBounds());
     }
 
     return returnVal;
 }
 
+AABB Light::getLightVolumeBounds() const
+{
+    if (isProjected())
+    {
+        updateProjection();
+
+        Matrix4 transRot = Matrix4::getIdentity();
+        transRot.translateBy(worldOrigin());
+        transRot.multiplyBy(rotation());
+
+        Frustum frustum = _frustum.getTransformedBy(transRot);
+
+        // The base area of the frustum
+        AABB bounds;
+        bounds.includePoint(Plane3::intersect(frustum.left, frustum.top, frustum.back));
+        bounds.includePoint(Plane3::intersect(frustum.left, frustum.bottom, frustum.back));
+        bounds.includePoint(Plane3::intersect(frustum.right, frustum.top, frustum.back));
+        bounds.includePoint(Plane3::intersect(frustum.right, frustum.bottom, frustum.back));
+
+        if (_lightStartTransformed != Vector3(0,0,0))
+        {
+            // The top area, the frustum is cut off at light_start
+            bounds.includePoint(Plane3::intersect(frustum.left, frustum.top, frustum.front));
+            bounds.includePoint(Plane3::intersect(frustum.left, frustum.bottom, frustum.front));
+            bounds.includePoint(Plane3::intersect(frustum.right, frustum.top, frustum.front));
+            bounds.includePoint(Plane3::intersect(frustum.right, frustum.bottom, frustum.front));
+        }
+        else
+        {
+            // The tip of the pyramid
+            bounds.includePoint(worldOrigin());
+        }
+
+        return bounds;
+    }
+
+    // An AABB which contains the rotated bounds of this light
+    AABB bounds = localAABB();
+    bounds.origin += worldOrigin();
+
+    return AABB(
+        bounds.origin,
+        Vector3(
+            static_cast<float>(fabs(m_rotation[0] * bounds.extents[0])
+                                + fabs(m_rotation[3] * bounds.extents[1])
+                                + fabs(m_rotation[6] * bounds.extents[2])),
+            static_cast<float>(fabs(m_rotation[1] * bounds.extents[0])
+                                + fabs(m_rotation[4] * bounds.extents[1])
+                                + fabs(m_rotation[7] * bounds.extents[2])),
+            static_cast<float>(fabs(m_rotation[2] * bounds.extents[0])
+                                + fabs(m_rotation[5] * bounds.extents[1])
+                                + fabs(m_rotation[8] * bounds.extents[2]))
+        )
+    );
+}
+
 const Matrix4& Light::rotation() const {
     m_doom3Rotation = m_rotation.getMatrix4();
     return m_doom3Rotation;
@@ -260,6 +260,7 @@ public:
 
     Matrix4 getLightTextureTransformation() const;
   	bool intersectsAABB(const AABB& other) const;
+	AABB getLightVolumeBounds() const;
 	const Matrix4& rotation() const;
 	Vector3 getLightOrigin() const;
 	const Vector3& colour() const;
@@ -5,6 +5,7 @@
 #include "igame.h"
 #include "ientity.h"
 #include "string/string.h"
+#include "parser/BufferDefTokeniser.h"
 
 #include "Doom3MapFormat.h"
 
@@ -31,7 +32,7 @@ void Doom3MapReader::readFromStream(std::istream& stream)
 	initPrimitiveParsers();
 
 	// The tokeniser used to split the stream into pieces
-	parser::BasicDefTokeniser<std::istream> tok(stream);
+	parser::BufferDefTokeniser tok(stream);
 
 	// Try to parse the map version (throws on failure)
 	parseMapVersion(tok);
@@ -5,6 +5,7 @@
 #include "igame.h"
 #include "ientity.h"
 #include "string/string.h"
+#include "parser/BufferDefTokeniser.h"
 
 #include "i18n.h"
 #include <boost/format.hpp>
@@ -29,7 +30,7 @@ void Quake3MapReader::readFromStream(std::istream& stream)
 	initPrimitiveParsers();
 
 	// The tokeniser used to split the stream into pieces
-	parser::BasicDefTokeniser<std::istream> tok(stream);
+	parser::BufferDefTokeniser tok(stream);
 
 	// Read each entity in the map, until EOF is reached
 	while (tok.hasMoreTokens())
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "math/AABB.h"
+#include <atomic>
 
 namespace map
 {
@@ -31,7 +32,7 @@ struct ProcPortal
 									// next[0] belongs to the linked list of the front node
 	ProcWinding		winding;
 
-	static std::size_t nextPortalId;
+	static std::atomic<std::size_t> nextPortalId;
 
 	ProcPortal() :
 		portalId(nextPortalId++),
@@ -79,7 +80,7 @@ struct BspTreeNode
 
 	ProcPortalPtr 		portals;	// also on nodes during constructions
 
-	static std::size_t	nextNodeId;
+	static std::atomic<std::size_t>	nextNodeId;
 
 	BspTreeNode() :
 		planenum(0),
@@ -99,7 +100,7 @@ struct BspTree
 	BspTreeNodePtr	outside;
 	AABB			bounds;
 
-	std::size_t		numFaceLeafs;
+	std::atomic<std::size_t> numFaceLeafs;
 
 	BspTree() :
 		outside(new BspTreeNode),
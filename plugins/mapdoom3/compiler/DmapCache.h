@@ -0,0 +1,142 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "ProcFile.h"
+
+namespace map
+{
+
+/**
+ * Incremental 64 bit FNV-1a hash of the data contributing to a compiler stage.
+ * Floating point values are hashed by their bit pattern, so only exactly
+ * matching input is considered unchanged.
+ */
+class ContentHash
+{
+private:
+	std::uint64_t _value;
+
+public:
+	ContentHash() :
+		_value(14695981039346656037ULL)
+	{}
+
+	std::uint64_t getValue() const
+	{
+		return _value;
+	}
+
+	void add(const void* data, std::size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			_value ^= bytes[i];
+			_value *= 1099511628211ULL;
+		}
+	}
+
+	void add(std::uint64_t value)
+	{
+		add(&value, sizeof(value));
+	}
+
+	void add(double value)
+	{
+		add(&value, sizeof(value));
+	}
+
+	void add(const std::string& str)
+	{
+		// include the length, such that "ab"+"c" differs from "a"+"bc"
+		add(static_cast<std::uint64_t>(str.size()));
+		add(str.data(), str.size());
+	}
+
+	template<typename Element>
+	void add(const BasicVector3<Element>& vec)
+	{
+		add(static_cast<double>(vec.x()));
+		add(static_cast<double>(vec.y()));
+		add(static_cast<double>(vec.z()));
+	}
+
+	void add(const ArbitraryMeshVertex& vertex)
+	{
+		add(vertex.vertex);
+		add(vertex.normal);
+		add(static_cast<double>(vertex.texcoord.x()));
+		add(static_cast<double>(vertex.texcoord.y()));
+	}
+};
+
+/**
+ * Results of the previous dmap run of a map, used by "dmap -incremental".
+ *
+ * If the geometry of the map didn't change, the BSP tree, the areas and the
+ * optimised area surfaces of the cached ProcFile are re-used and only the
+ * light shadows are built again.
+ *
+ * If only the structure of the world (its opaque and areaportal brushes) is
+ * unchanged, the BSP tree and the areas are re-used. The primitives and
+ * inlined models contributing to the world areas are matched by their hash,
+ * only the areas touched by changed contributions are filled and optimised
+ * again, the others are taken from the cache.
+ *
+ * Shadow volumes are cached separately, keyed by the hash of the light and
+ * the shadower triangles within its frustum, such that only the lights
+ * touching modified areas are re-processed.
+ */
+class DmapCache
+{
+public:
+	// The map file this cache belongs to
+	std::string mapFile;
+
+	// Hash of all primitives, inlined models and non-light entities of the cached compile
+	std::uint64_t geometryHash;
+
+	// Hash of everything the BSP tree and the areas of the world are built from
+	std::uint64_t structureHash;
+
+	// The result of the last successful full compile
+	ProcFilePtr procFile;
+
+	// A primitive or an inlined model of the world, with the areas it has been put into
+	struct AreaContribution
+	{
+		std::uint64_t hash;
+		std::vector<std::size_t> areas;
+
+		AreaContribution(std::uint64_t hash_) :
+			hash(hash_)
+		{}
+	};
+	typedef std::vector<AreaContribution> AreaContributions;
+
+	// The world primitives in their order, followed by the inlined models
+	AreaContributions worldContributions;
+
+	// The world areas before optimisation, as input to the shadow volume generation
+	ProcEntity::Areas preLightAreas;
+
+	// The world areas after optimisation, before fixing the t-junctions between them
+	ProcEntity::Areas optimizedAreas;
+
+	typedef std::map<std::uint64_t, Surface> ShadowVolumes;
+	ShadowVolumes shadowVolumes;
+
+	DmapCache(const std::string& mapFile_) :
+		mapFile(mapFile_),
+		geometryHash(0),
+		structureHash(0)
+	{}
+};
+typedef std::shared_ptr<DmapCache> DmapCachePtr;
+
+} // namespace
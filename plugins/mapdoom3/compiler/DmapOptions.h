@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <boost/algorithm/string/predicate.hpp>
+#include "string/convert.h"
+
+namespace map
+{
+
+// Settings controlling the dmap process, as passed to the dmap command
+struct DmapOptions
+{
+	// The number of worker threads used by the compiler.
+	// 1 = serial compilation, 0 = use all available hardware threads
+	std::size_t numThreads;
+
+	enum SplitHeuristic
+	{
+		SPLIT_CLASSIC,		// pick the face plane with the fewest splits (like the original dmap)
+		SPLIT_SURFACE_AREA,	// surface area heuristic with parallel evaluation
+	};
+
+	// The heuristic used to select the split planes of the face BSP
+	SplitHeuristic splitHeuristic;
+
+	// Re-use the results of the previous compile of the same map where possible
+	bool incremental;
+
+	// Write a binary .procb sidecar file next to the .proc, for our own tools
+	bool writeBinaryProc;
+
+	// Write the stage timings and statistics as JSON to this file, if not empty
+	std::string reportFile;
+
+	DmapOptions() :
+		numThreads(1),
+		splitHeuristic(SPLIT_CLASSIC),
+		incremental(false),
+		writeBinaryProc(false)
+	{}
+
+	// The options accepted by parseArguments(), for usage messages
+	static const char* ArgumentSyntax()
+	{
+		return "[-threads <numThreads>] [-split classic|sah] [-incremental] [-binary] [-report <jsonFile>] <mapFile>";
+	}
+
+	// Parses the given dmap arguments into this structure, the map file is
+	// written to the given string. Returns false if the arguments are invalid.
+	// This is shared by the dmap command and the standalone dmap executable.
+	bool parseArguments(const std::vector<std::string>& args, std::string& mapFile)
+	{
+		mapFile.clear();
+
+		for (std::size_t i = 0; i < args.size(); ++i)
+		{
+			const std::string& arg = args[i];
+
+			if (arg == "-threads")
+			{
+				// 0 means "use all available hardware threads"
+				if (i + 1 >= args.size() || string::convert<int>(args[i + 1], -1) < 0)
+				{
+					return false;
+				}
+
+				numThreads = static_cast<std::size_t>(string::convert<int>(args[++i]));
+			}
+			else if (arg == "-incremental")
+			{
+				incremental = true;
+			}
+			else if (arg == "-binary")
+			{
+				writeBinaryProc = true;
+			}
+			else if (arg == "-report")
+			{
+				if (i + 1 >= args.size())
+				{
+					return false;
+				}
+
+				reportFile = args[++i];
+			}
+			else if (arg == "-split")
+			{
+				if (i + 1 >= args.size())
+				{
+					return false;
+				}
+
+				const std::string& heuristic = args[++i];
+
+				if (heuristic == "classic")
+				{
+					splitHeuristic = SPLIT_CLASSIC;
+				}
+				else if (heuristic == "sah")
+				{
+					splitHeuristic = SPLIT_SURFACE_AREA;
+				}
+				else
+				{
+					return false;
+				}
+			}
+			else if (mapFile.empty() && !boost::algorithm::starts_with(arg, "-"))
+			{
+				mapFile = arg;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		return !mapFile.empty();
+	}
+};
+
+} // namespace
@@ -0,0 +1,209 @@
+#include "DmapProfiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <boost/format.hpp>
+
+#if defined(WIN32)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace map
+{
+
+namespace
+{
+
+std::string escapeJson(const std::string& str)
+{
+	std::string result;
+	result.reserve(str.size());
+
+	for (std::string::const_iterator c = str.begin(); c != str.end(); ++c)
+	{
+		switch (*c)
+		{
+		case '"': result += "\\\""; break;
+		case '\\': result += "\\\\"; break;
+		case '\n': result += "\\n"; break;
+		case '\r': result += "\\r"; break;
+		case '\t': result += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(*c) < 0x20)
+			{
+				result += (boost::format("\\u%04x") % static_cast<int>(*c)).str();
+			}
+			else
+			{
+				result += *c;
+			}
+		}
+	}
+
+	return result;
+}
+
+}
+
+DmapProfiler::ScopedStage::ScopedStage(const DmapProfilerPtr& profiler, const std::string& name) :
+	_profiler(profiler.get()),
+	_name(name),
+	_start(std::chrono::steady_clock::now()),
+	_startMemory(profiler ? DmapProfiler::getResidentMemory() : 0)
+{}
+
+DmapProfiler::ScopedStage::~ScopedStage()
+{
+	if (_profiler == NULL)
+	{
+		return;
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - _start;
+	std::size_t memory = DmapProfiler::getResidentMemory();
+
+	_profiler->recordStage(_name, elapsed.count(),
+		static_cast<std::int64_t>(memory) - static_cast<std::int64_t>(_startMemory), memory);
+}
+
+DmapProfiler::DmapProfiler() :
+	_start(std::chrono::steady_clock::now())
+{
+	// The stages of the dmap pipeline, in order
+	const char* const STAGES[] =
+	{
+		"faceBsp",
+		"makeTreePortals",
+		"filterBrushesIntoTree",
+		"floodEntities",
+		"floodAreas",
+		"putPrimitivesInAreas",
+		"shadows",
+		"optimize",
+		"tjunctions",
+		"write",
+	};
+
+	for (std::size_t i = 0; i < sizeof(STAGES) / sizeof(STAGES[0]); ++i)
+	{
+		_stages.push_back(Stage(STAGES[i]));
+	}
+}
+
+void DmapProfiler::recordStage(const std::string& stage, double seconds, std::int64_t memoryDelta, std::size_t memory)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+
+	Stage& s = getStage(stage);
+
+	s.calls++;
+	s.seconds += seconds;
+	s.memoryDelta += memoryDelta;
+	s.peakMemory = std::max(s.peakMemory, memory);
+}
+
+void DmapProfiler::addCounter(const std::string& stage, const std::string& counter, std::size_t value)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+
+	getStage(stage).counters[counter] += value;
+}
+
+void DmapProfiler::maxCounter(const std::string& stage, const std::string& counter, std::size_t value)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+
+	std::size_t& current = getStage(stage).counters[counter];
+	current = std::max(current, value);
+}
+
+void DmapProfiler::writeJson(std::ostream& str, const std::string& mapFile, std::size_t numThreads) const
+{
+	std::lock_guard<std::mutex> lock(_lock);
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - _start;
+
+	std::size_t peakMemory = 0;
+
+	for (Stages::const_iterator s = _stages.begin(); s != _stages.end(); ++s)
+	{
+		peakMemory = std::max(peakMemory, s->peakMemory);
+	}
+
+	str << "{" << std::endl;
+	str << "  \"map\": \"" << escapeJson(mapFile) << "\"," << std::endl;
+	str << "  \"threads\": " << numThreads << "," << std::endl;
+	str << "  \"totalSeconds\": " << (boost::format("%.6f") % elapsed.count()) << "," << std::endl;
+	str << "  \"peakMemory\": " << peakMemory << "," << std::endl;
+	str << "  \"stages\": [" << std::endl;
+
+	for (Stages::const_iterator s = _stages.begin(); s != _stages.end(); ++s)
+	{
+		str << "    { \"name\": \"" << escapeJson(s->name) << "\"";
+		str << ", \"calls\": " << s->calls;
+		str << ", \"seconds\": " << (boost::format("%.6f") % s->seconds);
+		str << ", \"memoryDelta\": " << s->memoryDelta;
+		str << ", \"peakMemory\": " << s->peakMemory;
+		str << ", \"counters\": {";
+
+		for (Stage::Counters::const_iterator c = s->counters.begin(); c != s->counters.end(); ++c)
+		{
+			str << (c == s->counters.begin() ? " " : ", ") << "\"" << escapeJson(c->first) << "\": " << c->second;
+		}
+
+		str << (s->counters.empty() ? "}" : " }") << " }";
+		str << (s + 1 != _stages.end() ? "," : "") << std::endl;
+	}
+
+	str << "  ]" << std::endl;
+	str << "}" << std::endl;
+}
+
+std::size_t DmapProfiler::getResidentMemory()
+{
+#if defined(WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return static_cast<std::size_t>(counters.WorkingSetSize);
+	}
+
+	return 0;
+#elif defined(__linux__)
+	// The second value of statm is the number of resident pages
+	std::ifstream statm("/proc/self/statm");
+
+	std::size_t size = 0;
+	std::size_t resident = 0;
+
+	if (statm >> size >> resident)
+	{
+		return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+	}
+
+	return 0;
+#else
+	return 0;
+#endif
+}
+
+DmapProfiler::Stage& DmapProfiler::getStage(const std::string& stage)
+{
+	for (Stages::iterator s = _stages.begin(); s != _stages.end(); ++s)
+	{
+		if (s->name == stage)
+		{
+			return *s;
+		}
+	}
+
+	_stages.push_back(Stage(stage));
+
+	return _stages.back();
+}
+
+} // namespace
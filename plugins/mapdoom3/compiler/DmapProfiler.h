@@ -0,0 +1,92 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <ostream>
+#include <cstdint>
+
+namespace map
+{
+
+/**
+ * Collects timings, memory usage and statistics of the dmap stages,
+ * which can be written as a JSON report by "dmap -report <file>".
+ *
+ * Stages can run several times (once per entity model) and on several
+ * threads at once, the times and memory deltas of all runs are summed up.
+ * All methods are thread-safe.
+ */
+class DmapProfiler
+{
+public:
+	struct Stage
+	{
+		std::string		name;
+		std::size_t		calls;
+		double			seconds;
+		std::int64_t	memoryDelta;	// change of the resident memory in bytes
+		std::size_t		peakMemory;		// highest resident memory at the end of a run
+
+		typedef std::map<std::string, std::size_t> Counters;
+		Counters		counters;
+
+		Stage(const std::string& name_) :
+			name(name_),
+			calls(0),
+			seconds(0),
+			memoryDelta(0),
+			peakMemory(0)
+		{}
+	};
+
+	// Measures the lifetime of this object as one run of the named stage.
+	// Does nothing if the profiler is NULL.
+	class ScopedStage
+	{
+	private:
+		DmapProfiler* _profiler;
+		std::string _name;
+		std::chrono::steady_clock::time_point _start;
+		std::size_t _startMemory;
+
+	public:
+		ScopedStage(const std::shared_ptr<DmapProfiler>& profiler, const std::string& name);
+		~ScopedStage();
+	};
+
+private:
+	mutable std::mutex _lock;
+
+	// Stages in pipeline order, such that the report is stable
+	typedef std::vector<Stage> Stages;
+	Stages _stages;
+
+	std::chrono::steady_clock::time_point _start;
+
+public:
+	DmapProfiler();
+
+	void recordStage(const std::string& stage, double seconds, std::int64_t memoryDelta, std::size_t memory);
+
+	// Adds the value to the counter of the given stage
+	void addCounter(const std::string& stage, const std::string& counter, std::size_t value);
+
+	// Sets the counter of the given stage to the value if it is larger than the current one
+	void maxCounter(const std::string& stage, const std::string& counter, std::size_t value);
+
+	void writeJson(std::ostream& str, const std::string& mapFile, std::size_t numThreads) const;
+
+	// Returns the resident memory of this process in bytes, 0 if unknown
+	static std::size_t getResidentMemory();
+
+private:
+	// Returns the named stage, adding it at the end if it is unknown. Lock must be held.
+	Stage& getStage(const std::string& stage);
+};
+typedef std::shared_ptr<DmapProfiler> DmapProfilerPtr;
+
+} // namespace
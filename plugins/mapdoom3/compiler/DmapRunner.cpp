@@ -0,0 +1,215 @@
+#include "DmapRunner.h"
+
+#include "itextstream.h"
+#include "ientity.h"
+
+#include <fstream>
+#include <boost/format.hpp>
+#include <boost/algorithm/string/replace.hpp>
+
+#include "os/path.h"
+#include "os/file.h"
+#include "stream/textfilestream.h"
+#include "scene/Node.h"
+#include "../Doom3MapReader.h"
+
+#include "ProcCompiler.h"
+
+namespace map
+{
+
+	namespace
+	{
+		class BasicNode :
+			public scene::Node
+		{
+		private:
+			AABB _emptyAABB;
+
+		public:
+			Type getNodeType() const
+			{
+				return Type::Unknown;
+			}
+
+			// Renderable implementation (empty)
+			void renderSolid(RenderableCollector& collector, const VolumeTest& volume) const
+			{}
+
+			void renderWireframe(RenderableCollector& collector, const VolumeTest& volume) const
+			{}
+
+			const AABB& localAABB() const
+			{
+				return _emptyAABB;
+			}
+
+			bool isHighlighted() const
+			{
+				return false; // never highlighted
+			}
+		};
+
+		class RawImporter :
+			public IMapImportFilter
+		{
+		private:
+			scene::INodePtr _root;
+
+		public:
+			RawImporter(const scene::INodePtr& root) :
+				_root(root)
+			{}
+
+			bool addEntity(const scene::INodePtr& entityNode)
+			{
+				_root->addChildNode(entityNode);
+				return true;
+			}
+
+			bool addPrimitiveToEntity(const scene::INodePtr& primitive, const scene::INodePtr& entity)
+			{
+				if (Node_getEntity(entity)->isContainer())
+				{
+					entity->addChildNode(primitive);
+					return true;
+				}
+				else
+				{
+					return false;
+				}
+			}
+		};
+	}
+
+const DmapOptions& DmapRunner::getOptions() const
+{
+	return _options;
+}
+
+void DmapRunner::setOptions(const DmapOptions& options)
+{
+	_options = options;
+}
+
+const ProcFilePtr& DmapRunner::getProcFile() const
+{
+	return _procFile;
+}
+
+void DmapRunner::compile(const scene::INodePtr& root)
+{
+	assert(root);
+
+	rMessage() << "=== DMAP: GenerateProc ===" << std::endl;
+
+	ProcCompiler compiler(root, _options, _options.incremental ? _dmapCache : DmapCachePtr(), _profiler);
+
+	_procFile = compiler.generateProcFile();
+}
+
+scene::INodePtr DmapRunner::loadMap(const std::string& mapFile)
+{
+	if (!os::fileOrDirExists(mapFile) || file_is_directory(mapFile.c_str()))
+	{
+		rError() << "Can't dmap, file doesn't exist: " << mapFile << std::endl;
+		return scene::INodePtr();
+	}
+
+	TextFileInputStream file(mapFile);
+	std::istream mapStream(&file);
+
+	std::shared_ptr<BasicNode> root(new BasicNode);
+
+	RawImporter importFilter(root);
+
+	try
+	{
+		// Parse our map file
+		Doom3MapReader reader(importFilter);
+		reader.readFromStream(mapStream);
+	}
+	catch (IMapReader::FailureException& e)
+	{
+		rError() <<
+			(boost::format("Failure reading map file:\n%s\n\n%s") % mapFile % e.what()).str() << std::endl;
+		return scene::INodePtr();
+	}
+
+	return root;
+}
+
+bool DmapRunner::run(const std::string& mapFile)
+{
+	scene::INodePtr root = loadMap(mapFile);
+
+	if (!root)
+	{
+		return false;
+	}
+
+	// The cache is only valid for the map it has been filled with
+	if (!_options.incremental)
+	{
+		_dmapCache.reset();
+	}
+	else if (!_dmapCache || _dmapCache->mapFile != mapFile)
+	{
+		_dmapCache.reset(new DmapCache(mapFile));
+	}
+
+	if (!_options.reportFile.empty())
+	{
+		_profiler.reset(new DmapProfiler);
+	}
+
+	// Start the sequence
+	compile(root);
+
+	if (!_procFile)
+	{
+		_profiler.reset();
+		return false;
+	}
+
+	if (_procFile->hasLeak())
+	{
+		std::string ext = "." + os::getExtension(mapFile);
+		std::string leakFileName = boost::algorithm::replace_last_copy(mapFile, ext, LeakFile::Extension());
+
+		_procFile->leakFile->writeToFile(leakFileName);
+	}
+	else
+	{
+		std::string ext = "." + os::getExtension(mapFile);
+		std::string procFileName = boost::algorithm::replace_last_copy(mapFile, ext, ProcFile::Extension());
+
+		DmapProfiler::ScopedStage stage(_profiler, "write");
+		_procFile->saveToFile(procFileName, _options.writeBinaryProc);
+	}
+
+	if (_profiler)
+	{
+		writeReport(mapFile);
+		_profiler.reset();
+	}
+
+	return !_procFile->hasLeak();
+}
+
+void DmapRunner::writeReport(const std::string& mapFile)
+{
+	rMessage() << "Writing dmap report to " << _options.reportFile << std::endl;
+
+	std::ofstream str(_options.reportFile.c_str());
+
+	if (!str.good())
+	{
+		rError() << "Cannot open " << _options.reportFile << " for writing" << std::endl;
+		return;
+	}
+
+	_profiler->writeJson(str, mapFile, _options.numThreads);
+}
+
+} // namespace
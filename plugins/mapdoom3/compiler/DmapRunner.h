@@ -0,0 +1,59 @@
+#pragma once
+
+#include "inode.h"
+
+#include "ProcFile.h"
+#include "DmapOptions.h"
+#include "DmapCache.h"
+#include "DmapProfiler.h"
+
+namespace map
+{
+
+/**
+ * Runs the dmap sequence on a map file: the map is parsed into a plain node
+ * tree, compiled to a ProcFile which is then written next to the map file
+ * (or the .lin file in case of a leak).
+ *
+ * This is the part of dmap which doesn't depend on the editor's UI or
+ * render system, it is shared by the dmap command of the Doom3MapCompiler
+ * module and the standalone dmap executable.
+ */
+class DmapRunner
+{
+private:
+	DmapOptions _options;
+
+	ProcFilePtr _procFile;
+
+	// Results of the last compile, for incremental dmap runs
+	DmapCachePtr _dmapCache;
+
+	// Stage timings of the running compile, only set if a report is requested
+	DmapProfilerPtr _profiler;
+
+public:
+	const DmapOptions& getOptions() const;
+	void setOptions(const DmapOptions& options);
+
+	// The result of the last compile, might be NULL
+	const ProcFilePtr& getProcFile() const;
+
+	// Compiles the given scene into a ProcFile, without writing it to disk
+	void compile(const scene::INodePtr& root);
+
+	// Loads the given map file, compiles it and writes the resulting files.
+	// Returns false if the map couldn't be loaded or if it is leaking.
+	bool run(const std::string& mapFile);
+
+	// Parses the given map file into a new node tree, holding the entities
+	// as children and their primitives as grandchildren of the returned root.
+	// Returns NULL on failure, the errors are written to the log.
+	static scene::INodePtr loadMap(const std::string& mapFile);
+
+private:
+	// Writes the collected stage timings and statistics to the report file
+	void writeReport(const std::string& mapFile);
+};
+
+} // namespace
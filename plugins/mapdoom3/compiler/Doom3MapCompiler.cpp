@@ -7,162 +7,52 @@
 #include "ifilesystem.h"
 
 #include <functional>
-#include <boost/format.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
 #include "os/path.h"
-#include "os/file.h"
-#include "stream/textfilestream.h"
-#include "scene/Node.h"
-#include "../Doom3MapReader.h"
-
-#include "ProcCompiler.h"
 
 namespace map
 {
 
 	namespace
 	{
-		class BasicNode :
-			public scene::Node
-		{
-		private:
-			AABB _emptyAABB;
-
-		public:
-			Type getNodeType() const
-			{
-				return Type::Unknown;
-			}
-
-			// Renderable implementation (empty)
-			void renderSolid(RenderableCollector& collector, const VolumeTest& volume) const
-			{}
-
-			void renderWireframe(RenderableCollector& collector, const VolumeTest& volume) const
-			{}
-
-			const AABB& localAABB() const
-			{
-				return _emptyAABB;
-			}
-
-			bool isHighlighted() const
-			{
-				return false; // never highlighted
-			}
-		};
-
-		class RawImporter :
-			public IMapImportFilter
-		{
-		private:
-			scene::INodePtr _root;
-
-		public:
-			RawImporter(const scene::INodePtr& root) :
-				_root(root)
-			{}
-
-			bool addEntity(const scene::INodePtr& entityNode)
-			{
-				_root->addChildNode(entityNode);
-				return true;
-			}
-
-			bool addPrimitiveToEntity(const scene::INodePtr& primitive, const scene::INodePtr& entity)
-			{
-				if (Node_getEntity(entity)->isContainer())
-				{
-					entity->addChildNode(primitive);
-					return true;
-				}
-				else
-				{
-					return false;
-				}
-			}
-		};
+		// Maximum number of arguments accepted by the dmap command (options plus map file)
+		const std::size_t MAX_DMAP_ARGUMENTS = 10;
 	}
 
 void Doom3MapCompiler::generateProc(const scene::INodePtr& root)
 {
-	rMessage() << "=== DMAP: GenerateProc ===" << std::endl;
+	_runner.compile(root);
 
-	ProcCompiler compiler(root);
-
-	_procFile = compiler.generateProcFile();
+	_procFile = _runner.getProcFile();
 }
 
-void Doom3MapCompiler::runDmap(const scene::INodePtr& root)
+void Doom3MapCompiler::runDmap(const std::string& mapFile)
 {
-	assert(root);
+	_runner.run(mapFile);
 
-	// First step: process map into .proc file
-	generateProc(root);
-
-	if (!_procFile || _procFile->hasLeak())
-	{
-		return;
-	}
+	_procFile = _runner.getProcFile();
 }
 
-void Doom3MapCompiler::runDmap(const std::string& mapFile)
+void Doom3MapCompiler::dmapCmd(const cmd::ArgumentList& args)
 {
-	if (!os::fileOrDirExists(mapFile) || file_is_directory(mapFile.c_str()))
-	{
-		rError() << "Can't dmap, file doesn't exist: " << mapFile << std::endl;
-		return;
-	}
-
-	TextFileInputStream file(mapFile);
-	std::istream mapStream(&file);
-
-	std::shared_ptr<BasicNode> root(new BasicNode);
-
-	RawImporter importFilter(root);
-
-	try
-	{
-		// Parse our map file
-		Doom3MapReader reader(importFilter);
-		reader.readFromStream(mapStream);
-	}
-	catch (IMapReader::FailureException& e)
-	{
-		rError() << 
-			(boost::format("Failure reading map file:\n%s\n\n%s") % mapFile % e.what()).str() << std::endl;
-		return;
-	}
+	std::vector<std::string> arguments;
 
-	// Start the sequence
-	runDmap(root);
-
-	if (_procFile->hasLeak())
+	for (std::size_t i = 0; i < args.size(); ++i)
 	{
-		std::string ext = "." + os::getExtension(mapFile);
-		std::string leakFileName = boost::algorithm::replace_last_copy(mapFile, ext, LeakFile::Extension());
-
-		_procFile->leakFile->writeToFile(leakFileName);
-
-		return;
+		arguments.push_back(args[i].getString());
 	}
 
-	std::string ext = "." + os::getExtension(mapFile);
-	std::string procFileName = boost::algorithm::replace_last_copy(mapFile, ext, ProcFile::Extension());
-
-	_procFile->saveToFile(procFileName);
-}
+	DmapOptions options;
+	std::string mapFile;
 
-void Doom3MapCompiler::dmapCmd(const cmd::ArgumentList& args)
-{
-	if (args.size() != 1)
+	if (!options.parseArguments(arguments, mapFile))
 	{
-		rWarning() << "Usage: dmap <mapFile>" << std::endl;
+		rWarning() << "Usage: dmap " << DmapOptions::ArgumentSyntax() << std::endl;
 		return;
 	}
 
-	std::string mapFile = args[0].getString();
+	_runner.setOptions(options);
 	
 	if (!boost::algorithm::iends_with(mapFile, ".map"))
 	{
@@ -234,7 +124,15 @@ void Doom3MapCompiler::initialiseModule(const ApplicationContext& ctx)
 {
 	rMessage() << getName() << ": initialiseModule called." << std::endl;
 
-	GlobalCommandSystem().addCommand("dmap", std::bind(&Doom3MapCompiler::dmapCmd, this, std::placeholders::_1), cmd::ARGTYPE_STRING);
+	// The map file name, optionally preceded by a number of options
+	cmd::Signature dmapSignature(cmd::ARGTYPE_STRING);
+
+	for (std::size_t i = 1; i < MAX_DMAP_ARGUMENTS; ++i)
+	{
+		dmapSignature.push_back(cmd::ARGTYPE_STRING|cmd::ARGTYPE_OPTIONAL);
+	}
+
+	GlobalCommandSystem().addCommand("dmap", std::bind(&Doom3MapCompiler::dmapCmd, this, std::placeholders::_1), dmapSignature);
 	GlobalCommandSystem().addCommand("setDmapRenderOption", std::bind(&Doom3MapCompiler::setDmapRenderOption, this, std::placeholders::_1), cmd::ARGTYPE_INT);
 }
 
@@ -6,6 +6,7 @@
 
 #include "ProcFile.h"
 #include "DebugRenderer.h"
+#include "DmapRunner.h"
 
 namespace map
 {
@@ -17,6 +18,9 @@ private:
 	DebugRendererPtr _debugRenderer;
 	ProcFilePtr _procFile;
 
+	// Loads and compiles the maps, keeps the cache between dmap commands
+	DmapRunner _runner;
+
 public:
 	virtual void generateProc(const scene::INodePtr& root);
 
@@ -32,7 +36,6 @@ private:
 	void setDmapRenderOption(const cmd::ArgumentList& args);
 
 	// Runs the actual dmap sequence on the given map file
-	void runDmap(const scene::INodePtr& root);
 	void runDmap(const std::string& mapFile);
 };
 typedef std::shared_ptr<Doom3MapCompiler> Doom3MapCompilerPtr;
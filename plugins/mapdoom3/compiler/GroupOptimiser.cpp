@@ -0,0 +1,552 @@
+#include "GroupOptimiser.h"
+
+#include "itextstream.h"
+#include <boost/format.hpp>
+#include "OptIsland.h"
+#include "OptUtils.h"
+
+namespace map
+{
+
+static std::size_t DEFAULT_OPT_EDGES = 0x40000;
+static std::size_t DEFAULT_OPT_VERTICES = 0x10000;
+
+GroupOptimiser::GroupOptimiser(const PlaneSet& planes) :
+    _planes(planes)
+{}
+
+std::size_t GroupOptimiser::countGroupListTris(const ProcArea::OptimizeGroups& groupList)
+{
+    std::size_t c = 0;
+
+    for (ProcArea::OptimizeGroups::const_iterator group = groupList.begin(); group != groupList.end(); ++group)
+    {
+        c += group->triList.size();
+    }
+
+    return c;
+}
+
+void GroupOptimiser::hashTriangles(ProcArea::OptimizeGroups& groups)
+{
+    // clear the hash tables
+    _triangleHash.reset(new TriangleHash);
+
+    // bound all the triangles to determine the bucket size
+    _triangleHash->_hashBounds = AABB();
+    _triangleHash->calculateBounds(groups);
+
+    _triangleHash->spreadHashBounds();
+    _triangleHash->hashTriangles(groups);
+}
+
+void GroupOptimiser::fixAreaGroupsTjunctions(ProcArea::OptimizeGroups& groups)
+{
+    if (false/*dmapGlobals.noTJunc*/) return; // FIXME
+
+    if (groups.empty()) return;
+
+    if (true/*dmapGlobals.verbose*/) // FIXME
+    {
+        std::size_t startCount = countGroupListTris(groups);
+        rMessage() << "----- FixAreaGroupsTjunctions -----" << std::endl;
+        rMessage() << (boost::format("%6i triangles in") % startCount) << std::endl;
+    }
+
+    hashTriangles(groups);
+
+    for (ProcArea::OptimizeGroups::iterator group = groups.begin();
+         group != groups.end(); ++group)
+    {
+        // don't touch discrete surfaces
+        if (group->material && group->material->isDiscrete())
+        {
+            continue;
+        }
+
+        ProcTris newList;
+        newList.reserve(group->triList.size());
+
+        for (ProcTris::const_iterator tri = group->triList.begin(); tri != group->triList.end(); ++tri)
+        {
+            _triangleHash->fixTriangleAgainstHash(*tri, newList);
+        }
+
+        group->triList.swap(newList);
+    }
+
+    if (true/*dmapGlobals.verbose*/) // FIXME
+    {
+        std::size_t endCount = countGroupListTris(groups);
+        rMessage() << (boost::format("%6i triangles out") % endCount) << std::endl;
+    }
+}
+
+inline void calcNormalVectors(const Vector3& self, Vector3& left, Vector3& down)
+{
+    float d = self.x() * self.x() + self.y() * self.y();
+
+    if (!d)
+    {
+        left[0] = 1;
+        left[1] = 0;
+        left[2] = 0;
+    } 
+    else 
+    {
+        d = 1 / sqrt(d);
+
+        left[0] = -self.y() * d;
+        left[1] = self.x() * d;
+        left[2] = 0;
+    }
+
+    down = left.crossProduct(self);
+}
+
+OptVertex* GroupOptimiser::findOptVertex(const ArbitraryMeshVertex& v, ProcOptimizeGroup& group)
+{
+    // deal with everything strictly as 2D
+    float x = v.vertex.dot(group.axis[0]);
+    float y = v.vertex.dot(group.axis[1]);
+
+    // should we match based on the t-junction fixing hash verts?
+    for (std::size_t i = 0; i < _optVerts.size(); ++i)
+    {
+        if (_optVerts[i].pv[0] == x && _optVerts[i].pv[1] == y)
+        {
+            return &_optVerts[i];
+        }
+    }
+
+    // not found, insert a new one
+    _optVerts.push_back(OptVertex());
+
+    OptVertex* vert = &_optVerts.back(); // TODO: greebo: instead of OptVertex* we might as well use array indices?
+    
+    vert->v = v;
+    vert->pv[0] = x;
+    vert->pv[1] = y;
+    vert->pv[2] = 0;
+
+    _optBounds.includePoint(vert->pv);
+
+    return vert;
+}
+
+namespace
+{
+
+bool vertexIsBetween(const OptVertex* p1, const OptVertex* v1, const OptVertex* v2)
+{
+    Vector3 d1 = p1->pv - v1->pv;
+    Vector3 d2 = p1->pv - v2->pv;
+    float d = d1.dot(d2);
+
+    return (d < 0);
+}
+
+} // namespace
+
+void GroupOptimiser::addOriginalTriangle(OptVertex* v[3])
+{
+    // if this triangle is backwards (possible with epsilon issues)
+    // ignore it completely
+    if (!OptUtils::IsTriangleValid(v[0], v[1], v[2]))
+    {
+        rWarning() << "WARNING: backwards triangle in input!" << std::endl;
+        return;
+    }
+
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        OptVertex* v1 = v[i];
+        OptVertex* v2 = v[(i+1) % 3];
+
+        if (v1 == v2)
+        {
+            // this probably shouldn't happen, because the
+            // tri would be degenerate
+            continue;
+        }
+
+        std::size_t j = 0;
+
+        // see if there is an existing one
+        for ( ; j < _originalEdges.size(); ++j)
+        {
+            if (_originalEdges[j].v1 == v1 && _originalEdges[j].v2 == v2)
+            {
+                break;
+            }
+
+            if (_originalEdges[j].v2 == v1 && _originalEdges[j].v1 == v2)
+            {
+                break;
+            }
+        }
+
+        if (j == _originalEdges.size())
+        {
+            // add it
+            _originalEdges.push_back(OriginalEdge(v1, v2));
+        }
+    }
+}
+
+void GroupOptimiser::addOriginalEdges(ProcOptimizeGroup& group)
+{
+    if (false/* dmapGlobals.verbose */) // FIXME
+    {
+        rMessage() <<  "----" << std::endl;
+        rMessage() << (boost::format("%6i original tris") % group.triList.size()) << std::endl;
+    }
+
+    _optBounds = AABB();
+
+    // allocate space for max possible edges
+    std::size_t numTris = group.triList.size();
+
+    _originalEdges.clear();
+    _originalEdges.reserve(numTris * 3);
+
+    // add all unique triangle edges
+    _optEdges.clear();
+    _optEdges.reserve(DEFAULT_OPT_EDGES);
+
+    _optVerts.clear();
+    _optVerts.reserve(DEFAULT_OPT_VERTICES);
+
+    OptVertex*  v[3];
+
+    for (ProcTris::iterator tri = group.triList.begin(); tri != group.triList.end(); ++tri)
+    {
+        v[0] = tri->optVert[0] = findOptVertex(tri->v[0], group);
+        v[1] = tri->optVert[1] = findOptVertex(tri->v[1], group);
+        v[2] = tri->optVert[2] = findOptVertex(tri->v[2], group);
+
+        addOriginalTriangle(v);
+    }
+}
+
+OptVertex* GroupOptimiser::getEdgeIntersection(const OptVertex* p1, const OptVertex* p2,
+                                const OptVertex* l1, const OptVertex* l2, ProcOptimizeGroup& group)
+{
+    Vector3 dir1 = p1->pv - l1->pv;
+    Vector3 dir2 = p1->pv - l2->pv;
+    Vector3 cross1 = dir1.crossProduct(dir2);
+
+    dir1 = p2->pv - l1->pv;
+    dir2 = p2->pv - l2->pv;
+    Vector3 cross2 = dir1.crossProduct(dir2);
+
+    if (cross1[2] - cross2[2] == 0)
+    {
+        return NULL;
+    }
+
+    float f = cross1[2] / (cross1[2] - cross2[2]);
+
+    ArbitraryMeshVertex v;
+
+    v.vertex = p1->v.vertex * (1.0f - f) + p2->v.vertex * f;
+    v.normal = p1->v.normal * (1.0f - f) + p2->v.normal * f;
+    v.normal.normalise();
+    v.texcoord[0] = p1->v.texcoord[0] * (1.0f - f) + p2->v.texcoord[0] * f;
+    v.texcoord[1] = p1->v.texcoord[1] * (1.0f - f) + p2->v.texcoord[1] * f;
+
+    return findOptVertex(v, group);
+}
+
+void GroupOptimiser::addEdgeIfNotAlready(OptVertex* v1, OptVertex* v2)
+{
+    // make sure that there isn't an identical edge already added
+    for (OptEdge* e = v1->edges; e ; )
+    {
+        if ((e->v1 == v1 && e->v2 == v2) || (e->v1 == v2 && e->v2 == v1))
+        {
+            return;     // already added
+        }
+
+        if (e->v1 == v1)
+        {
+            e = e->v1link;
+        } 
+        else if (e->v2 == v1)
+        {
+            e = e->v2link;
+        } 
+        else 
+        {
+            rError() << "addEdgeIfNotAlready: bad edge link" << std::endl;
+            return;
+        }
+    }
+
+    // this edge is a keeper
+    _optEdges.push_back(OptEdge());
+
+    OptEdge* newEdge = &_optEdges.back();
+    newEdge->v1 = v1;
+    newEdge->v2 = v2;
+
+    newEdge->islandLink = NULL;
+
+    // link the edge to its verts
+    newEdge->linkToVertices();
+}
+
+void GroupOptimiser::splitOriginalEdgesAtCrossings(ProcOptimizeGroup& group)
+{
+    std::size_t numOriginalVerts = _optVerts.size();
+
+    // now split any crossing edges and create optEdges
+    // linked to the vertexes
+
+#if 0
+    // debug drawing bounds
+    dmapGlobals.drawBounds = optBounds;
+
+    dmapGlobals.drawBounds[0][0] -= 2;
+    dmapGlobals.drawBounds[0][1] -= 2;
+    dmapGlobals.drawBounds[1][0] += 2;
+    dmapGlobals.drawBounds[1][1] += 2;
+#endif
+
+    // generate crossing points between all the original edges
+    EdgeCrossingsList crossings(_originalEdges.size());
+
+    for (std::size_t i = 0; i < _originalEdges.size(); ++i)
+    {
+#if 0
+        if ( dmapGlobals.drawflag ) {
+            DrawOriginalEdges( numOriginalEdges, originalEdges );
+            qglBegin( GL_LINES );
+            qglColor3f( 0, 1, 0 );
+            qglVertex3fv( originalEdges[i].v1->pv.ToFloatPtr() );
+            qglColor3f( 0, 0, 1 );
+            qglVertex3fv( originalEdges[i].v2->pv.ToFloatPtr() );
+            qglEnd();
+            qglFlush();
+        }
+#endif
+        for (std::size_t j = i + 1; j < _originalEdges.size(); ++j)
+        {
+            OptVertex* v1 = _originalEdges[i].v1;
+            OptVertex* v2 = _originalEdges[i].v2;
+            OptVertex* v3 = _originalEdges[j].v1;
+            OptVertex* v4 = _originalEdges[j].v2;
+
+            if (!OptUtils::EdgesCross(v1, v2, v3, v4))
+            {
+                continue;
+            }
+
+            // this is the only point in optimization where
+            // completely new points are created, and it only
+            // happens if there is overlapping coplanar
+            // geometry in the source triangles
+            OptVertex* newVert = getEdgeIntersection(v1, v2, v3, v4, group);
+
+            if (!newVert)
+            {
+                // colinear, so add both verts of each edge to opposite
+                if (vertexIsBetween(v3, v1, v2)) 
+                {
+                    crossings[i].push_back(EdgeCrossing(v3));
+                }
+
+                if (vertexIsBetween(v4, v1, v2)) 
+                {
+                    crossings[i].push_back(EdgeCrossing(v4));
+                }
+
+                if (vertexIsBetween(v1, v3, v4)) 
+                {
+                    crossings[j].push_back(EdgeCrossing(v1));
+                }
+
+                if (vertexIsBetween(v2, v3, v4)) 
+                {
+                    crossings[j].push_back(EdgeCrossing(v2));
+                }
+
+                continue;
+            }
+
+            if (newVert != v1 && newVert != v2)
+            {
+                crossings[i].push_back(EdgeCrossing(newVert));
+            }
+
+            if (newVert != v3 && newVert != v4)
+            {
+                crossings[j].push_back(EdgeCrossing(newVert));
+            }
+        }
+    }
+
+    // now split each edge by its crossing points
+    // colinear edges will have duplicated edges added, but it won't hurt anything
+    for (std::size_t i = 0; i < _originalEdges.size(); ++i)
+    {
+        std::size_t numCross = crossings[i].size();
+        numCross += 2;  // account for originals
+
+        std::vector<OptVertex*> sorted(numCross);
+        memset(&sorted[0], 0, sorted.size());
+
+        sorted[0] = _originalEdges[i].v1;
+        sorted[1] = _originalEdges[i].v2;
+
+        std::size_t j = 2;
+
+        for (EdgeCrossings::const_iterator cross = crossings[i].begin(); cross != crossings[i].end(); ++cross)
+        {
+            sorted[j] = cross->ov;
+            j++;
+        }
+
+        // add all possible fragment combinations that aren't divided by another point
+        for (std::size_t j = 0; j < numCross; ++j)
+        {
+            for (std::size_t k = j+1; k < numCross; ++k)
+            {
+                std::size_t l = 0;
+
+                for (; l < numCross; ++l)
+                {
+                    if (sorted[l] == sorted[j] || sorted[l] == sorted[k])
+                    {
+                        continue;
+                    }
+
+                    if (sorted[j] == sorted[k])
+                    {
+                        continue;
+                    }
+                    
+                    if (vertexIsBetween(sorted[l], sorted[j], sorted[k]))
+                    {
+                        break;
+                    }
+                }
+
+                if (l == numCross)
+                {
+                    //common->Printf( "line %i fragment from point %i to %i\n", i, sorted[j] - optVerts, sorted[k] - optVerts );
+                    addEdgeIfNotAlready(sorted[j], sorted[k]);
+                }
+            }
+        }
+    }
+
+
+    crossings.clear();
+    _originalEdges.clear();
+
+    // check for duplicated edges
+    for (std::size_t i = 0 ; i < _optEdges.size(); ++i)
+    {
+        for (std::size_t j = i + 1; j < _optEdges.size(); ++j)
+        {
+            if ((_optEdges[i].v1 == _optEdges[j].v1 && _optEdges[i].v2 == _optEdges[j].v2) ||
+                (_optEdges[i].v1 == _optEdges[j].v2 && _optEdges[i].v2 == _optEdges[j].v1))
+            {
+                rMessage() << "duplicated optEdge" << std::endl;
+            }
+        }
+    }
+
+    if (false/* dmapGlobals.verbose*/)
+    {
+        rMessage() << (boost::format("%6i original edges") % _originalEdges.size()) << std::endl;
+        rMessage() << (boost::format("%6i edges after splits") % _optEdges.size()) << std::endl;
+        rMessage() << (boost::format("%6i original vertexes") % numOriginalVerts) << std::endl;
+        rMessage() << (boost::format("%6i vertexes after splits") % _optVerts.size()) << std::endl;
+    }
+}
+
+void GroupOptimiser::dontSeparateIslands(ProcOptimizeGroup& group)
+{
+    OptIsland island(group, _optVerts, _optEdges, _planes);
+
+    island.optimise();
+}
+
+void GroupOptimiser::optimizeOptList(ProcOptimizeGroup& group)
+{
+    ProcArea::OptimizeGroups tempList;
+    tempList.push_back(std::move(group));
+
+    // fix the t junctions among this single list
+    // so we can match edges
+    // can we avoid doing this if colinear vertexes break edges?
+    fixAreaGroupsTjunctions(tempList);
+    group = std::move(tempList.front());
+    
+    // create the 2D vectors
+    calcNormalVectors(_planes.getPlane(group.planeNum).normal(), group.axis[0], group.axis[1]);
+
+    addOriginalEdges(group);
+    splitOriginalEdgesAtCrossings(group);
+
+#if 0
+    // seperate any discontinuous areas for individual optimization
+    // to reduce the scope of the problem
+    SeparateIslands( opt );
+#else
+    dontSeparateIslands(group);
+#endif
+
+    // now free the hash verts
+    _triangleHash.reset();
+
+    // free the original list and use the new one
+    group.triList.swap(group.regeneratedTris);
+    group.regeneratedTris.clear();
+}
+
+void GroupOptimiser::setGroupTriPlaneNums(ProcArea::OptimizeGroups& groupList)
+{
+    for (ProcArea::OptimizeGroups::iterator group = groupList.begin(); 
+         group != groupList.end(); ++group)
+    {
+        for (ProcTris::iterator tri = group->triList.begin(); tri != group->triList.end(); ++tri)
+        {
+            tri->planeNum = group->planeNum;
+        }
+    }
+}
+
+void GroupOptimiser::optimizeGroupList(ProcArea::OptimizeGroups& groupList)
+{
+    if (groupList.empty()) return;
+
+    std::size_t numIn = countGroupListTris(groupList);
+
+    // optimize and remove colinear edges, which will
+    // re-introduce some t junctions
+    for (ProcArea::OptimizeGroups::iterator group = groupList.begin(); 
+         group != groupList.end(); ++group)
+    {
+        optimizeOptList(*group);
+    }
+
+    std::size_t numEdge = countGroupListTris(groupList);
+
+    // fix t junctions again
+    fixAreaGroupsTjunctions(groupList);
+    _triangleHash.reset();
+
+    std::size_t numTjunc2 = countGroupListTris(groupList);
+
+    setGroupTriPlaneNums(groupList);
+
+    rMessage() << "----- OptimizeAreaGroups Results -----" << std::endl;
+    rMessage() << (boost::format("%6i tris in") % numIn) << std::endl;
+    rMessage() << (boost::format("%6i tris after edge removal optimization") % numEdge) << std::endl;
+    rMessage() << (boost::format("%6i tris after final t junction fixing") % numTjunc2) << std::endl;
+}
+
+} // namespace
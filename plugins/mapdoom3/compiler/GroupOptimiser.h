@@ -0,0 +1,71 @@
+#pragma once
+
+#include "ProcFile.h"
+#include "TriangleHash.h"
+
+namespace map
+{
+
+/**
+ * Optimises the triangles of optimize groups by removing colinear 
+ * edges and re-triangulating them, fixing t-junctions along the way.
+ *
+ * All the scratch data of the optimisation is held by this class, 
+ * so it is safe to run several optimisers concurrently, as long
+ * as they are working on distinct group lists.
+ */
+class GroupOptimiser
+{
+private:
+	// Plane lookups only, this set is not altered
+	const PlaneSet& _planes;
+
+	TriangleHashPtr _triangleHash;
+
+	AABB		_optBounds;
+
+	typedef std::vector<OriginalEdge> OriginalEdges;
+	OriginalEdges	_originalEdges;
+
+	typedef std::vector<OptEdge> OptEdges;
+	OptEdges		_optEdges;
+
+	typedef std::vector<OptVertex> OptVertices;
+	OptVertices		_optVerts;
+
+public:
+	GroupOptimiser(const PlaneSet& planes);
+
+	// This will also fix tjunctions
+	void optimizeGroupList(ProcArea::OptimizeGroups& groupList);
+
+	void fixAreaGroupsTjunctions(ProcArea::OptimizeGroups& groups);
+
+	static std::size_t countGroupListTris(const ProcArea::OptimizeGroups& groupList);
+
+private:
+	void optimizeOptList(ProcOptimizeGroup& group);
+
+	// removes triangles that are degenerated or flipped backwards
+	void hashTriangles(ProcArea::OptimizeGroups& groups);
+	void addOriginalEdges(ProcOptimizeGroup& group);
+
+	OptVertex* findOptVertex(const ArbitraryMeshVertex& vertex, ProcOptimizeGroup& group);
+	void addOriginalTriangle(OptVertex* v[3]);
+	void splitOriginalEdgesAtCrossings(ProcOptimizeGroup& group);
+
+	// Creates a new OptVertex where the line segments cross.
+	// this should only be called if PointsStraddleLine returned true
+	// will return NULL if the lines are colinear
+	OptVertex* getEdgeIntersection(const OptVertex* p1, const OptVertex* p2,
+						const OptVertex* l1, const OptVertex* l2, ProcOptimizeGroup& opt);
+
+	void addEdgeIfNotAlready(OptVertex* v1, OptVertex* v2);
+
+	void dontSeparateIslands(ProcOptimizeGroup& group);
+
+	// Copies the group planeNum to every triangle in each group
+	void setGroupTriPlaneNums(ProcArea::OptimizeGroups& groupList);
+};
+
+} // namespace
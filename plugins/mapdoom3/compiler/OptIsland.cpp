@@ -9,8 +9,8 @@ namespace map
 OptIsland::OptIsland(ProcOptimizeGroup& group, 
 					 std::vector<OptVertex>& vertices, 
 					 std::vector<OptEdge>& edges,
-					 const ProcFilePtr& procFile) :
-	_procFile(procFile),
+					 const PlaneSet& planes) :
+	_planes(planes),
 	_group(group),
 	_verts(NULL),
 	_edges(NULL),
@@ -836,6 +836,9 @@ void OptIsland::regenerateTriangles()
 {
 	std::size_t numOut = 0;
 
+	ProcTris regenerated;
+	regenerated.reserve(_tris.size());
+
 	for (std::size_t i = 0; i < _tris.size(); ++i)
 	{
 		const OptTriPtr& optTri = _tris[i];
@@ -854,7 +857,7 @@ void OptIsland::regenerateTriangles()
 
 		Plane3 plane(tri.v[1].vertex, tri.v[0].vertex, tri.v[2].vertex); // Plane(p1, p0, p2) call convention to match D3
 		
-		if (plane.normal().dot(_procFile->planes.getPlane(_group.planeNum).normal()) <= 0)
+		if (plane.normal().dot(_planes.getPlane(_group.planeNum).normal()) <= 0)
 		{
 			// this can happen reasonably when a triangle is nearly degenerate in
 			// optimization planar space, and winds up being degenerate in 3D space
@@ -863,11 +866,14 @@ void OptIsland::regenerateTriangles()
 			continue;
 		}
 
-		_group.regeneratedTris.push_front(tri);
+		regenerated.push_back(tri);
 
 		numOut++;
 	}
 
+	// The regenerated triangles are put in front of the existing ones, in reverse order
+	_group.regeneratedTris.insert(_group.regeneratedTris.begin(), regenerated.rbegin(), regenerated.rend());
+
 	_tris.clear();
 
 	if (false/* dmapGlobals.verbose */)
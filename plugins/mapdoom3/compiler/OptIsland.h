@@ -8,7 +8,7 @@ namespace map
 class OptIsland
 {
 private:
-	ProcFilePtr _procFile;
+	const PlaneSet& _planes;
 
 	ProcOptimizeGroup& _group;
 
@@ -32,7 +32,7 @@ public:
 	OptIsland(ProcOptimizeGroup& group, 
 			  std::vector<OptVertex>& vertices, 
 			  std::vector<OptEdge>& edges,
-			  const ProcFilePtr& procFile);
+			  const PlaneSet& planes);
 
 	// At this point, all needed vertexes are already in the list, 
 	// including any that were added at crossing points.
@@ -1,25 +1,89 @@
 #pragma once
 
-#include <map>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <limits>
+#include <cmath>
+#include <cstdint>
 #include "math/Plane3.h"
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace map
 {
 
-// A planeset adds all incoming Plane3 objects into a vector, using the 
-// plane's dist() value to look up the corresponding index in the vector.
+// A planeset adds all incoming Plane3 objects into a list, together with their
+// flipped counterpart. A plane and its flipped plane are always stored next to
+// each other, such that (planeNum ^ 1) refers to the opposite plane.
+//
+// Lookups are using an open-addressing hash table, keyed on the plane's normal
+// and distance, quantised into cells. Only the cells which are reachable
+// within the requested epsilons are probed, which is usually just one.
+//
+// A planeset can be used from several threads at once: stored planes are never
+// moved in memory and lookups don't take any locks. Insertions are serialised,
+// and re-check for an existing plane first, so no plane is ever added twice.
+//
+// A planeset can be layered on top of a base set, which must not be changed
+// during the lifetime of the layered set. All planes of the base set keep their
+// indices, new planes are appended after them without touching the base set.
 class PlaneSet
 {
 private:
-	// A mapping of (plane hash) => (vector index)
-	typedef std::multimap<int, std::size_t> IndexLookupMap;
-	typedef std::pair<typename IndexLookupMap::const_iterator, 
-					  typename IndexLookupMap::const_iterator> Range;
+	const PlaneSet* _base;
+	std::size_t _baseSize;
+
+	// Planes are stored in chunks of growing size, chunk n holds
+	// (1 << (FIRST_CHUNK_BITS + n)) planes. Chunks are never reallocated.
+	static const std::size_t FIRST_CHUNK_BITS = 8;
+	static const std::size_t MAX_CHUNKS = 40;
+
+	std::atomic<Plane3*> _chunks[MAX_CHUNKS];
 
-	IndexLookupMap _hashToIndex;
+	// The number of planes stored in this set (excluding the base set)
+	std::atomic<std::size_t> _size;
 
-	typedef std::vector<Plane3> PlaneList;
-	PlaneList _list;
+	// Cell resolution of the lookup hash, per unit of normal components and distance
+	static const int NORMAL_CELLS_PER_UNIT = 64;
+	static const int DIST_CELLS_PER_UNIT = 2;
+
+	// The upper 32 bits of a slot hold the upper bits of the cell hash, the lower bits
+	// hold the plane index + 1. A zero value denotes an empty slot.
+	struct HashTable
+	{
+		std::size_t mask;
+		std::size_t numEntries;
+		std::unique_ptr<std::atomic<std::uint64_t>[]> slots;
+
+		HashTable(std::size_t size) :
+			mask(size - 1),
+			numEntries(0),
+			slots(new std::atomic<std::uint64_t>[size])
+		{
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				slots[i].store(0, std::memory_order_relaxed);
+			}
+		}
+	};
+
+	static const std::size_t INITIAL_HASH_SIZE = 1024;
+
+	// The current table, replaced by a larger one when it's getting full
+	std::atomic<HashTable*> _table;
+
+	// All tables ever allocated, replaced tables might still be used by readers
+	std::vector<std::unique_ptr<HashTable> > _tables;
+
+	std::mutex _insertLock;
+
+	// non-copyable
+	PlaneSet(const PlaneSet& other);
+	PlaneSet& operator=(const PlaneSet& other);
 
 public:
 	enum PlaneType
@@ -38,69 +102,158 @@ public:
 		PLANETYPE_NONAXIAL			= 9,
 	};
 
+	static const std::size_t NOT_FOUND = std::numeric_limits<std::size_t>::max();
+
+	PlaneSet() :
+		_base(NULL),
+		_baseSize(0),
+		_size(0),
+		_table(NULL)
+	{
+		clearChunks();
+	}
+
+	// Construct a set layered on top of the given base set
+	explicit PlaneSet(const PlaneSet* base) :
+		_base(base),
+		_baseSize(base != NULL ? base->size() : 0),
+		_size(0),
+		_table(NULL)
+	{
+		clearChunks();
+	}
+
+	~PlaneSet()
+	{
+		for (std::size_t i = 0; i < MAX_CHUNKS; ++i)
+		{
+			delete[] _chunks[i].load(std::memory_order_relaxed);
+		}
+	}
+
 	const Plane3& getPlane(std::size_t planeNum) const
 	{
-		return _list[planeNum];
+		if (planeNum < _baseSize)
+		{
+			return _base->getPlane(planeNum);
+		}
+
+		std::size_t index = planeNum - _baseSize;
+		std::size_t chunk = getChunkForIndex(index);
+
+		return _chunks[chunk].load(std::memory_order_acquire)[index - getChunkStart(chunk)];
 	}
 
 	std::size_t size() const
 	{
-		return _list.size();
+		return _baseSize + _size.load(std::memory_order_acquire);
 	}
 
-	// Returns the index of the plane3, which can be the index of an existing plane
-	// if its normal and distance are equal respecting the given epsilon
-	std::size_t findOrInsertPlane(const Plane3& plane, double epsNormal, double epsDist)
+	// Returns the index of an existing plane whose normal and distance are equal
+	// to the given one (respecting the given epsilon), or NOT_FOUND.
+	// If several planes are matching, the lowest index is returned.
+	std::size_t findPlane(const Plane3& plane, double epsNormal, double epsDist) const
 	{
-		assert(epsDist <= 0.125f);
+		if (_base != NULL)
+		{
+			std::size_t index = _base->findPlane(plane, epsNormal, epsDist);
+
+			if (index != NOT_FOUND)
+			{
+				return index;
+			}
+		}
 
-		// Use the plane's distance/8 as hash key
-		int hashKey = static_cast<int>(fabs(plane.dist())*0.125);
+		const HashTable* table = _table.load(std::memory_order_acquire);
 
-		// The hash is not exact, so use up to three hashes to find an equivalent plane
-		for (int border = -1; border <= 1; border++ )
+		if (table == NULL)
 		{
-			Range range = _hashToIndex.equal_range(hashKey + border);
+			return NOT_FOUND;
+		}
 
-			for (IndexLookupMap::const_iterator i = range.first; i != range.second; ++i)
-			{
-				const Plane3& candidate = _list[i->second];
+		const Vector3& normal = plane.normal();
+
+		// Determine the range of cells an equal plane can be located in
+		int minCell[4];
+		int maxCell[4];
+
+		for (std::size_t i = 0; i < 3; ++i)
+		{
+			minCell[i] = getCell(normal[i] - epsNormal, NORMAL_CELLS_PER_UNIT);
+			maxCell[i] = getCell(normal[i] + epsNormal, NORMAL_CELLS_PER_UNIT);
+		}
+
+		minCell[3] = getCell(plane.dist() - epsDist, DIST_CELLS_PER_UNIT);
+		maxCell[3] = getCell(plane.dist() + epsDist, DIST_CELLS_PER_UNIT);
 
-				if (float_equal_epsilon(candidate.dist(), plane.dist(), epsDist) &&
-					candidate.normal().isEqual(plane.normal(), epsNormal))
+		std::size_t best = NOT_FOUND;
+
+		for (int x = minCell[0]; x <= maxCell[0]; ++x)
+		{
+			for (int y = minCell[1]; y <= maxCell[1]; ++y)
+			{
+				for (int z = minCell[2]; z <= maxCell[2]; ++z)
 				{
-					return i->second;
+					for (int d = minCell[3]; d <= maxCell[3]; ++d)
+					{
+						findPlaneInCell(*table, getCellHash(x, y, z, d), plane, epsNormal, epsDist, best);
+					}
 				}
 			}
 		}
 
+		if (best == NOT_FOUND)
+		{
+			return NOT_FOUND;
+		}
+
+		return _baseSize + best;
+	}
+
+	// Returns the index of the plane3, which can be the index of an existing plane
+	// if its normal and distance are equal respecting the given epsilon
+	std::size_t findOrInsertPlane(const Plane3& plane, double epsNormal, double epsDist)
+	{
+		std::size_t existing = findPlane(plane, epsNormal, epsDist);
+
+		if (existing != NOT_FOUND)
+		{
+			return existing;
+		}
+
+		std::lock_guard<std::mutex> lock(_insertLock);
+
+		// Another thread might have inserted an equal plane in the meantime
+		existing = findPlane(plane, epsNormal, epsDist);
+
+		if (existing != NOT_FOUND)
+		{
+			return existing;
+		}
+
 		// Plane not yet existing => classify it
 		PlaneType type = getPlaneType(plane);
 
+		std::size_t index = _size.load(std::memory_order_relaxed);
+
 		if (type >= PLANETYPE_NEGX && type < PLANETYPE_TRUEAXIAL)
 		{
 			// Insert flipped plane first
-			_list.push_back(-plane);
-			_hashToIndex.insert(IndexLookupMap::value_type(hashKey, _list.size() - 1));
+			appendPlane(index, -plane);
+			appendPlane(index + 1, plane);
 
-			_list.push_back(plane);
+			_size.store(index + 2, std::memory_order_release);
 
-			std::size_t index = _list.size() - 1; // will be returned
-			_hashToIndex.insert(IndexLookupMap::value_type(hashKey, index));
-			
-			return index;
+			return _baseSize + index + 1;
 		}
 		else
 		{
-			_list.push_back(plane);
+			appendPlane(index, plane);
+			appendPlane(index + 1, -plane);
 
-			std::size_t index = _list.size() - 1; // will be returned
-			_hashToIndex.insert(IndexLookupMap::value_type(hashKey, index));
+			_size.store(index + 2, std::memory_order_release);
 
-			_list.push_back(-plane);
-			_hashToIndex.insert(IndexLookupMap::value_type(hashKey, _list.size() - 1));
-
-			return index;
+			return _baseSize + index;
 		}
 	}
 
@@ -135,6 +288,173 @@ public:
 			return PLANETYPE_NONAXIAL;
 		}
 	}
+
+private:
+	void clearChunks()
+	{
+		for (std::size_t i = 0; i < MAX_CHUNKS; ++i)
+		{
+			_chunks[i].store(NULL, std::memory_order_relaxed);
+		}
+	}
+
+	static std::size_t getHighestBit(std::size_t value)
+	{
+#if defined(__GNUC__)
+		return sizeof(unsigned long long) * 8 - 1 - __builtin_clzll(value);
+#elif defined(_MSC_VER)
+		unsigned long index;
+		_BitScanReverse(&index, static_cast<unsigned long>(value));
+		return index;
+#else
+		std::size_t bit = 0;
+		while (value >>= 1) ++bit;
+		return bit;
+#endif
+	}
+
+	static std::size_t getChunkForIndex(std::size_t index)
+	{
+		return getHighestBit((index >> FIRST_CHUNK_BITS) + 1);
+	}
+
+	static std::size_t getChunkStart(std::size_t chunk)
+	{
+		return ((static_cast<std::size_t>(1) << chunk) - 1) << FIRST_CHUNK_BITS;
+	}
+
+	static int getCell(double value, int cellsPerUnit)
+	{
+		return static_cast<int>(floor(value * cellsPerUnit));
+	}
+
+	static std::uint64_t getCellHash(int x, int y, int z, int d)
+	{
+		std::uint64_t hash = static_cast<std::uint32_t>(x);
+
+		hash = hash * 0x9E3779B97F4A7C15ULL + static_cast<std::uint32_t>(y);
+		hash = hash * 0x9E3779B97F4A7C15ULL + static_cast<std::uint32_t>(z);
+		hash = hash * 0x9E3779B97F4A7C15ULL + static_cast<std::uint32_t>(d);
+
+		// Final avalanche, such that both the lower and upper bits are usable
+		hash ^= hash >> 31;
+		hash *= 0xBF58476D1CE4E5B9ULL;
+		hash ^= hash >> 27;
+		hash *= 0x94D049BB133111EBULL;
+		hash ^= hash >> 31;
+
+		return hash;
+	}
+
+	static std::uint64_t getCellHash(const Plane3& plane)
+	{
+		const Vector3& normal = plane.normal();
+
+		return getCellHash(getCell(normal[0], NORMAL_CELLS_PER_UNIT),
+						   getCell(normal[1], NORMAL_CELLS_PER_UNIT),
+						   getCell(normal[2], NORMAL_CELLS_PER_UNIT),
+						   getCell(plane.dist(), DIST_CELLS_PER_UNIT));
+	}
+
+	// Walks the probe sequence of the given cell, keeping the lowest matching index in best
+	void findPlaneInCell(const HashTable& table, std::uint64_t hash, const Plane3& plane,
+						 double epsNormal, double epsDist, std::size_t& best) const
+	{
+		const std::uint64_t HASH_MASK = 0xFFFFFFFF00000000ULL;
+
+		for (std::size_t slot = hash & table.mask; ; slot = (slot + 1) & table.mask)
+		{
+			std::uint64_t entry = table.slots[slot].load(std::memory_order_acquire);
+
+			if (entry == 0)
+			{
+				return;
+			}
+
+			if ((entry & HASH_MASK) != (hash & HASH_MASK))
+			{
+				continue;
+			}
+
+			std::size_t index = static_cast<std::size_t>(entry & ~HASH_MASK) - 1;
+
+			if (index >= best)
+			{
+				continue;
+			}
+
+			const Plane3& candidate = getPlane(_baseSize + index);
+
+			if (float_equal_epsilon(candidate.dist(), plane.dist(), epsDist) &&
+				candidate.normal().isEqual(plane.normal(), epsNormal))
+			{
+				best = index;
+			}
+		}
+	}
+
+	static void insertIntoTable(HashTable& table, std::uint64_t hash, std::size_t index)
+	{
+		std::size_t slot = hash & table.mask;
+
+		while (table.slots[slot].load(std::memory_order_relaxed) != 0)
+		{
+			slot = (slot + 1) & table.mask;
+		}
+
+		table.slots[slot].store((hash & 0xFFFFFFFF00000000ULL) | (index + 1), std::memory_order_release);
+		table.numEntries++;
+	}
+
+	// Stores the plane at the given local index and publishes it in the hash table,
+	// must be called with the insert lock held
+	void appendPlane(std::size_t index, const Plane3& plane)
+	{
+		std::size_t chunk = getChunkForIndex(index);
+		Plane3* planes = _chunks[chunk].load(std::memory_order_relaxed);
+
+		if (planes == NULL)
+		{
+			planes = new Plane3[static_cast<std::size_t>(1) << (chunk + FIRST_CHUNK_BITS)];
+			_chunks[chunk].store(planes, std::memory_order_release);
+		}
+
+		planes[index - getChunkStart(chunk)] = plane;
+
+		HashTable* table = _table.load(std::memory_order_relaxed);
+
+		// Keep the load factor below 50%
+		if (table == NULL || (table->numEntries + 1) * 2 > table->mask + 1)
+		{
+			table = createLargerTable(index);
+		}
+
+		insertIntoTable(*table, getCellHash(plane), index);
+	}
+
+	// Allocates a new table with all planes up to the given index, and publishes it
+	HashTable* createLargerTable(std::size_t numPlanes)
+	{
+		const HashTable* current = _table.load(std::memory_order_relaxed);
+		std::size_t size = INITIAL_HASH_SIZE;
+
+		if (current != NULL)
+		{
+			size = (current->mask + 1) * 2;
+		}
+
+		_tables.push_back(std::unique_ptr<HashTable>(new HashTable(size)));
+		HashTable* table = _tables.back().get();
+
+		for (std::size_t i = 0; i < numPlanes; ++i)
+		{
+			insertIntoTable(*table, getCellHash(getPlane(_baseSize + i)), i);
+		}
+
+		_table.store(table, std::memory_order_release);
+
+		return table;
+	}
 };
 
 } // namespace
@@ -7,42 +7,86 @@
 #include "imodelcache.h"
 #include "imodelsurface.h"
 #include <limits>
+#include <map>
+#include <algorithm>
 #include <boost/format.hpp>
 #include "OptIsland.h"
 #include "OptUtils.h"
 #include "ProcPatch.h"
+#include "ShadowVolumeBuilder.h"
 #include <stdexcept>
+#include <sstream>
 
 namespace map
 {
 
-std::size_t BspTreeNode::nextNodeId = 0;
-std::size_t ProcPortal::nextPortalId = 0;
+std::atomic<std::size_t> BspTreeNode::nextNodeId(0);
+std::atomic<std::size_t> ProcPortal::nextPortalId(0);
 
 const float CLIP_EPSILON = 0.1f;
 const float SPLIT_WINDING_EPSILON = 0.001f;
 
-static std::size_t DEFAULT_OPT_EDGES = 0x40000;
-static std::size_t DEFAULT_OPT_VERTICES = 0x10000;
-
 const std::size_t MULTIAREA_CROSS = std::numeric_limits<std::size_t>::max();
 const std::size_t AREANUM_DIFFERENT = std::numeric_limits<std::size_t>::max();
 
-static const float LIGHT_CLIP_EPSILON = 0.1f;
+namespace
+{
+
+// Invokes func(i) for each i in [0..count) on the given pool. The log output
+// of each invocation is buffered and written out in index order afterwards,
+// such that the log looks the same regardless of the number of threads.
+template<typename Func>
+void parallelForWithOrderedLog(util::ThreadPool& pool, std::size_t count, const Func& func)
+{
+    if (pool.isSerial())
+    {
+        util::parallelFor(pool, count, func);
+        return;
+    }
+
+    std::vector<ThreadLogBuffer> logs(count);
 
-#define MAX_SHADOW_INDEXES      0x18000
-#define MAX_SHADOW_VERTS        0x18000
+    util::parallelFor(pool, count, [&](std::size_t index)
+    {
+        ScopedThreadStreamRedirect redirect(&logs[index]);
+        func(index);
+    });
 
-// a point that is on the plane is NOT culled
-#define POINT_CULLED(p1) ( ( pointCull[p1] & 0xfc0 ) != 0xfc0 )
-#define TRIANGLE_CLIPPED(p1,p2,p3) ( ( ( pointCull[p1] & pointCull[p2] & pointCull[p3] ) & 0xfc0 ) != 0xfc0 )
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        logs[i].flush();
+    }
+}
 
-// an edge that is on the plane is NOT culled
-#define EDGE_CULLED(p1,p2) ( ( pointCull[p1] ^ 0xfc0 ) & ( pointCull[p2] ^ 0xfc0 ) & 0xfc0 )
-#define EDGE_CLIPPED(p1,p2) ( ( pointCull[p1] & pointCull[p2] & 0xfc0 ) != 0xfc0 )
+}
 
-ProcCompiler::ProcCompiler(const scene::INodePtr& root) :
+ProcCompiler::ProcCompiler(const scene::INodePtr& root, const DmapOptions& options, const DmapCachePtr& cache,
+                           const DmapProfilerPtr& profiler) :
     _root(root),
+    _options(options),
+    _cache(cache),
+    _profiler(profiler),
+    _planes(NULL),
+    _numActivePortals(0),
+    _numPeakPortals(0),
+    _numTinyPortals(0),
+    _numUniqueBrushes(0),
+    _numClusters(0),
+    _numFloodedLeafs(0),
+    _numOutsideLeafs(0),
+    _numInsideLeafs(0),
+    _numSolidLeafs(0),
+    _numAreas(0),
+    _numAreaFloods(0)
+{}
+
+ProcCompiler::ProcCompiler(const ProcCompiler& owner, PlaneSet& planes) :
+    _root(owner._root),
+    _procFile(owner._procFile),
+    _options(owner._options),
+    _threadPool(owner._threadPool),
+    _profiler(owner._profiler),
+    _planes(&planes),
     _numActivePortals(0),
     _numPeakPortals(0),
     _numTinyPortals(0),
@@ -53,20 +97,54 @@ ProcCompiler::ProcCompiler(const scene::INodePtr& root) :
     _numInsideLeafs(0),
     _numSolidLeafs(0),
     _numAreas(0),
-    _numAreaFloods(0),
-    _overflowed(false),
-    _shadowVerts(MAX_SHADOW_VERTS),
-    _shadowIndices(MAX_SHADOW_INDEXES)
+    _numAreaFloods(0)
 {}
 
 ProcFilePtr ProcCompiler::generateProcFile()
 {
     _procFile.reset(new ProcFile);
+    _planes = &_procFile->planes;
+
+    _threadPool.reset(new util::ThreadPool(_options.numThreads));
+
+    if (_cache && _cache->procFile)
+    {
+        insertCachedPlanes(_cache->procFile->planes);
+    }
 
     // Load all entities into proc entities
     generateBrushData();
 
-    processModels();
+    std::uint64_t geometryHash = 0;
+    std::uint64_t structureHash = 0;
+
+    if (_cache)
+    {
+        geometryHash = calculateGeometryHash();
+
+        if (reuseCachedWorld(geometryHash))
+        {
+            addCounter("shadows", "reusedWorld", 1);
+            return _procFile;
+        }
+
+        structureHash = calculateStructureHash();
+    }
+
+    if (_cache && reuseCachedStructure(structureHash))
+    {
+        addCounter("putPrimitivesInAreas", "reusedStructure", 1);
+        processEntityModels();
+    }
+    else
+    {
+        processModels();
+    }
+
+    if (_cache && !_procFile->hasLeak())
+    {
+        storeInCache(geometryHash, structureHash);
+    }
 
     return _procFile;
 }
@@ -168,10 +246,15 @@ public:
                 surface.subdivide(true);
             }
 
-            for (std::size_t i = 0; i < surface.getNumIndices(); i += 3)
+            tris.reserve(surface.getNumIndices() / 3);
+
+            // The triangles are added in reverse order
+            for (std::size_t i = surface.getNumIndices() / 3 * 3; i >= 3; )
             {
-                tris.push_front(ProcTri());
-                ProcTri& tri = tris.front();
+                i -= 3;
+
+                tris.push_back(ProcTri());
+                ProcTri& tri = tris.back();
 
                 tri.v[2] = surface.getVertex(surface.getIndex(i+0));
                 tri.v[1] = surface.getVertex(surface.getIndex(i+2));
@@ -518,6 +601,19 @@ private:
         // we can use the same renderLight generation
         //gameEdit->ParseSpawnArgsToRenderLight( &mapEnt->epairs, &light->def.parms );
         light.parseFromSpawnargs(entity);
+
+        // remember the spawnargs, to identify unchanged lights in incremental builds
+        ContentHash spawnargHash;
+        Entity::KeyValuePairs spawnargs = entity.getKeyValuePairs("");
+        std::sort(spawnargs.begin(), spawnargs.end());
+
+        for (Entity::KeyValuePairs::const_iterator i = spawnargs.begin(); i != spawnargs.end(); ++i)
+        {
+            spawnargHash.add(i->first);
+            spawnargHash.add(i->second);
+        }
+
+        light.spawnargHash = spawnargHash.getValue();
         
         // fills everything in based on light.parms
         light.deriveLightData();
@@ -558,4103 +654,3424 @@ void ProcCompiler::generateBrushData()
         minBounds[0] % minBounds[1] % minBounds[2] % maxBounds[0] % maxBounds[1] % maxBounds[2]).str() << std::endl;
 }
 
-bool ProcCompiler::processModels()
+namespace
+{
+
+// Adds the properties of the material the compiled geometry depends on
+void addMaterialToHash(ContentHash& hash, const MaterialPtr& material)
+{
+    hash.add(material->getName());
+    hash.add(static_cast<std::uint64_t>(material->getMaterialFlags()));
+    hash.add(static_cast<std::uint64_t>(material->getSurfaceFlags()));
+    hash.add(static_cast<std::uint64_t>(material->getCoverage()));
+    hash.add(static_cast<std::uint64_t>(material->getDeformType()));
+    hash.add(static_cast<std::uint64_t>(material->getSortRequest()));
+    hash.add(static_cast<std::uint64_t>(material->isDrawn()));
+}
+
+void addSpawnargsToHash(ContentHash& hash, const Entity& entity)
 {
-    for (std::size_t i = 0; i < _procFile->entities.size(); ++i)
+    Entity::KeyValuePairs spawnargs = entity.getKeyValuePairs("");
+    std::sort(spawnargs.begin(), spawnargs.end());
+
+    for (Entity::KeyValuePairs::const_iterator i = spawnargs.begin(); i != spawnargs.end(); ++i)
     {
-        ProcEntity& entity = *_procFile->entities[i];
+        hash.add(i->first);
+        hash.add(i->second);
+    }
+}
 
-        if (entity.primitives.empty())
-        {
-            continue;
-        }
+std::uint64_t calculatePrimitiveHash(const ProcPrimitive& prim, const PlaneSet& planes)
+{
+    ContentHash hash;
 
-        rMessage() << "############### entity " << i << " ###############" << std::endl;
+    if (prim.brush)
+    {
+        hash.add(std::string("brush"));
 
-        // if we leaked, stop without any more processing, only floodfill the first entity (world)
-        if (!processModel(entity, i == 0))
+        for (ProcBrush::ProcFaces::const_iterator side = prim.brush->sides.begin(); 
+             side != prim.brush->sides.end(); ++side)
         {
-            return false;
+            const Plane3& plane = planes.getPlane(side->planenum);
+
+            hash.add(plane.normal());
+            hash.add(plane.dist());
+            addMaterialToHash(hash, side->material);
+
+            for (std::size_t i = 0; i < 2; ++i)
+            {
+                hash.add(side->texVec[i].getVector3());
+                hash.add(side->texVec[i].w());
+            }
         }
     }
+    else
+    {
+        hash.add(std::string("patch"));
+    }
 
-    return true;
+    for (ProcTris::const_iterator tri = prim.patch.begin(); tri != prim.patch.end(); ++tri)
+    {
+        addMaterialToHash(hash, tri->material);
+        hash.add(tri->v[0]);
+        hash.add(tri->v[1]);
+        hash.add(tri->v[2]);
+    }
+
+    return hash.getValue();
 }
 
-void ProcCompiler::makeStructuralProcFaceList(const ProcEntity::Primitives& primitives)
+// Hash of the surfaces of the given model as loaded by the model cache,
+// models used by several entities are only hashed once
+std::uint64_t getModelHash(const std::string& modelName, std::map<std::string, std::uint64_t>& modelHashes)
 {
-    std::size_t brushCount = 0;
-    std::size_t nonOpaqueCount = 0;
+    std::map<std::string, std::uint64_t>::const_iterator found = modelHashes.find(modelName);
 
-    for (ProcEntity::Primitives::const_reverse_iterator i = primitives.rbegin();
-        i != primitives.rend(); ++i)
+    if (found != modelHashes.end())
     {
-        if (!i->brush) continue; // skip all patches
-
-        brushCount++;
+        return found->second;
+    }
 
-        ProcBrush& brush = *i->brush;
+    ContentHash hash;
+    model::IModelPtr model = GlobalModelCache().getModel(modelName);
 
-        if (!brush.opaque && !(brush.contents & Material::SURF_AREAPORTAL))
-        {
-            nonOpaqueCount++;
-            continue; // skip all non-opaque non-portals
-        }
+    if (model != NULL)
+    {
+        hash.add(static_cast<std::uint64_t>(model->getSurfaceCount()));
 
-        for (ProcBrush::ProcFaces::const_iterator s = brush.sides.begin(); s != brush.sides.end(); ++s)
+        for (int i = 0; i < model->getSurfaceCount(); ++i)
         {
-            const ProcFace& side = *s;
+            const model::IModelSurface& surface = model->getSurface(i);
 
-            if (side.winding.empty()) continue;
+            addMaterialToHash(hash, GlobalMaterialManager().getMaterialForName(surface.getDefaultMaterial()));
 
-            int sideFlags = side.material->getSurfaceFlags();
+            int numTris = surface.getNumTriangles();
+            hash.add(static_cast<std::uint64_t>(numTris));
 
-            // Skip all faces of a portal brush that are not textured with the "areaportal" face
-            if ((brush.contents & Material::SURF_AREAPORTAL) && !(sideFlags & Material::SURF_AREAPORTAL))
+            for (int j = 0; j < numTris; ++j)
             {
-                continue;
-            }
-
-            // Allocate a new BspFace
-            _bspFaces.push_back(BspFacePtr(new BspFace()));
-            BspFace& face = *_bspFaces.back();
+                model::ModelPolygon poly = surface.getPolygon(j);
 
-            // Check if this is a portal face
-            face.portal = (sideFlags & Material::SURF_AREAPORTAL) != 0;
-            face.w = side.winding;
-            face.planenum = side.planenum & ~1; // use the even plane number
+                hash.add(poly.a);
+                hash.add(poly.b);
+                hash.add(poly.c);
+            }
         }
     }
+
+    modelHashes.insert(std::make_pair(modelName, hash.getValue()));
+
+    return hash.getValue();
 }
 
-#define BLOCK_SIZE  1024
+}
 
-std::size_t ProcCompiler::selectSplitPlaneNum(const BspTreeNodePtr& node, BspFaces& faces)
+std::uint64_t ProcCompiler::calculateGeometryHash()
 {
-    // if it is crossing a 1k block boundary, force a split
-    // this prevents epsilon problems from extending an
-    // arbitrary distance across the map
+    ContentHash hash;
 
-    Vector3 halfSize = node->bounds.extents;
-    Vector3 nodeMin = node->bounds.origin - node->bounds.extents;
-    Vector3 nodeMax = node->bounds.origin + node->bounds.extents;
+    hash.add(static_cast<std::uint64_t>(_options.splitHeuristic));
 
-    for (int axis = 0; axis < 3; ++axis)
+    _worldContributions.clear();
+
+    std::map<std::string, std::uint64_t> modelHashes;
+
+    for (ProcFile::ProcEntities::const_iterator e = _procFile->entities.begin(); e != _procFile->entities.end(); ++e)
     {
-        float dist;
+        const ProcEntity& entity = **e;
+        const Entity& mapEntity = entity.mapEntity->getEntity();
 
-        if (halfSize[axis] > BLOCK_SIZE)
+        // Light spawnargs are only affecting the shadow volumes, which are checked separately
+        if (mapEntity.getKeyValue("classname") != "light")
         {
-            dist = BLOCK_SIZE * ( floor( (nodeMin[axis] + halfSize[axis]) / BLOCK_SIZE ) + 1.0f );
+            addSpawnargsToHash(hash, mapEntity);
         }
         else
         {
-            dist = BLOCK_SIZE * ( floor( nodeMin[axis] / BLOCK_SIZE ) + 1.0f );
+            hash.add(std::string("light"));
         }
 
-        if (dist > nodeMin[axis] + 1.0f && dist < nodeMax[axis] - 1.0f)
-        {
-            Plane3 plane(0, 0, 0, dist);
-            plane.normal()[axis] = 1.0f;
+        hash.add(static_cast<std::uint64_t>(entity.primitives.size()));
 
-            return _procFile->planes.findOrInsertPlane(plane, EPSILON_NORMAL, EPSILON_DIST);
-        }
-    }
+        for (ProcEntity::Primitives::const_iterator p = entity.primitives.begin(); p != entity.primitives.end(); ++p)
+        {
+            std::uint64_t primitiveHash = calculatePrimitiveHash(*p, _procFile->planes);
 
-    // pick one of the face planes
-    // if we have any portal faces at all, only
-    // select from them, otherwise select from
-    // all faces
-    int bestValue = -999999;
-    BspFaces::const_reverse_iterator bestSplit = faces.rbegin();
+            hash.add(primitiveHash);
 
-    bool havePortals = false;
+            if (e == _procFile->entities.begin())
+            {
+                _worldContributions.push_back(DmapCache::AreaContribution(primitiveHash));
+            }
+        }
 
-    for (BspFaces::const_reverse_iterator split = faces.rbegin(); split != faces.rend(); ++split)
-    {
-        (*split)->checked = false;
+        // func_static models are either inlined or used to fix the t-junctions of the world
+        std::string modelName = mapEntity.getKeyValue("model");
 
-        if ((*split)->portal)
+        if (mapEntity.getKeyValue("classname") == "func_static" && !modelName.empty())
         {
-            havePortals = true;
+            hash.add(getModelHash(modelName, modelHashes));
         }
     }
 
-    for (BspFaces::const_reverse_iterator split = faces.rbegin(); split != faces.rend(); ++split)
+    // The inlined models are put into the world areas after the primitives
+    std::vector<std::size_t> inlined = getInlinedModelEntities();
+
+    for (std::size_t i = 0; i < inlined.size(); ++i)
     {
-        if ((*split)->checked) continue;
+        const Entity& mapEntity = _procFile->entities[inlined[i]]->mapEntity->getEntity();
 
-        // greebo: prefer portals as split planes, if we have some
-        if (havePortals != (*split)->portal) continue;
+        ContentHash inlinedHash;
+        inlinedHash.add(std::string("inlined"));
+        addSpawnargsToHash(inlinedHash, mapEntity);
+        inlinedHash.add(getModelHash(mapEntity.getKeyValue("model"), modelHashes));
 
-        const Plane3& mapPlane = _procFile->planes.getPlane((*split)->planenum);
+        _worldContributions.push_back(DmapCache::AreaContribution(inlinedHash.getValue()));
+    }
 
-        int splits = 0;
-        int facing = 0;
-        int front = 0;
-        int back = 0;
+    return hash.getValue();
+}
 
-        for (BspFaces::const_reverse_iterator check = faces.rbegin(); check != faces.rend(); ++check)
-        {
-            if ((*check)->planenum == (*split)->planenum)
-            {
-                facing++;
-                (*check)->checked = true;   // won't need to test this plane again
-                continue;
-            }
+std::uint64_t ProcCompiler::calculateStructureHash()
+{
+    ContentHash hash;
 
-            int side = (*check)->w.planeSide(mapPlane);
+    hash.add(static_cast<std::uint64_t>(_options.splitHeuristic));
 
-            if (side == SIDE_CROSS)
-            {
-                splits++;
-            }
-            else if (side == SIDE_FRONT)
-            {
-                front++;
-            }
-            else if (side == SIDE_BACK)
-            {
-                back++;
-            }
-        }
+    if (_procFile->entities.empty())
+    {
+        return hash.getValue();
+    }
 
-        int value = 5*facing - 5*splits; // - abs(front-back);
+    const ProcEntity& world = *_procFile->entities.front();
 
-        if (PlaneSet::getPlaneType(mapPlane) < PlaneSet::PLANETYPE_TRUEAXIAL)
+    // The faces used by makeStructuralProcFaceList() and filterBrushesIntoTree(),
+    // in the order they are inserted into the tree
+    for (std::size_t i = 0; i < world.primitives.size(); ++i)
+    {
+        const ProcBrushPtr& brush = world.primitives[i].brush;
+
+        if (!brush || (!brush->opaque && !(brush->contents & Material::SURF_AREAPORTAL)))
         {
-            value += 5;     // axial is better
+            continue;
         }
 
-        if (value > bestValue)
+        // The portals refer to the sides of the areaportal brushes,
+        // which are only re-used if they didn't change at all
+        if (brush->contents & Material::SURF_AREAPORTAL)
         {
-            bestValue = value;
-            bestSplit = split;
+            hash.add(_worldContributions[i].hash);
         }
-    }
 
-    if (bestValue == -999999)
-    {
-        return std::numeric_limits<std::size_t>::max();
+        hash.add(static_cast<std::uint64_t>(brush->contents));
+        hash.add(static_cast<std::uint64_t>(brush->opaque));
+
+        for (ProcBrush::ProcFaces::const_iterator side = brush->sides.begin(); side != brush->sides.end(); ++side)
+        {
+            const Plane3& plane = _procFile->planes.getPlane(side->planenum);
+
+            hash.add(plane.normal());
+            hash.add(plane.dist());
+            hash.add(static_cast<std::uint64_t>(side->winding.empty()));
+            hash.add(static_cast<std::uint64_t>(side->material->getSurfaceFlags()));
+        }
     }
 
-    return (*bestSplit)->planenum;
+    return hash.getValue();
 }
 
-void ProcCompiler::buildFaceTreeRecursively(const BspTreeNodePtr& node, BspFaces& faces, BspTree& tree)
+void ProcCompiler::insertCachedPlanes(const PlaneSet& cachedPlanes)
 {
-    std::size_t splitPlaneNum = selectSplitPlaneNum(node, faces);
-
-    // if we don't have any more faces, this is a node
-    if (splitPlaneNum == std::numeric_limits<std::size_t>::max())
+    // Each pair of planes is re-created by inserting its first plane,
+    // which keeps the plane numbers of the cached tree valid
+    for (std::size_t i = 0; i < cachedPlanes.size(); i += 2)
     {
-        node->planenum = PLANENUM_LEAF;
-        tree.numFaceLeafs++;
-        return;
+        std::size_t planeNum = _planes->findOrInsertPlane(cachedPlanes.getPlane(i), 0, 0);
+        assert(planeNum == i);
     }
+}
 
-    // partition the list
-    node->planenum = splitPlaneNum;
-
-    const Plane3& plane = _procFile->planes.getPlane(splitPlaneNum);
+bool ProcCompiler::originsInsideCachedAreas(const ProcFile& cachedFile)
+{
+    const ProcEntity& world = *cachedFile.entities.front();
 
-    BspFaces childLists[2];
+    std::vector<Vector3> origins;
 
-    BspFaces::reverse_iterator next;
+    for (ProcFile::ProcLights::const_iterator light = _procFile->lights.begin(); 
+         light != _procFile->lights.end(); ++light)
+    {
+        origins.push_back(light->parms.origin);
+    }
 
-    // greebo: We use a reverse iterator since D3 is pushing planes to front of the list,
-    // this way we keep the same order
-    for (BspFaces::reverse_iterator split = faces.rbegin(); split != faces.rend(); split = next )
+    // The entities flood filling the world, see floodEntities()
+    for (std::size_t i = 1; i < _procFile->entities.size(); ++i)
     {
-        next = split + 1; // remember the pointer to next
+        const Entity& mapEnt = _procFile->entities[i]->mapEntity->getEntity();
 
-        if ((*split)->planenum == node->planenum)
+        std::string originStr = mapEnt.getKeyValue("origin");
+
+        if (!originStr.empty() && mapEnt.getKeyValue("noFlood").empty() && 
+            mapEnt.getKeyValue("classname") != "light")
         {
-            split->reset();
-            continue;
+            origins.push_back(string::convert<Vector3>(originStr));
         }
+    }
 
-        int side = (*split)->w.planeSide(plane);
+    for (std::size_t i = 0; i < origins.size(); ++i)
+    {
+        BspTreeNodePtr node = world.tree.head;
 
-        if (side == SIDE_CROSS)
+        while (node->planenum != PLANENUM_LEAF)
         {
-            // Split into front and back winding
-            ProcWinding front;
-            ProcWinding back;
+            const Plane3& plane = cachedFile.planes.getPlane(node->planenum);
 
-            (*split)->w.split(plane, CLIP_EPSILON * 2, front, back);
+            node = plane.distanceToPoint(origins[i]) >= 0.0f ? node->children[0] : node->children[1];
+        }
 
-            if (!front.empty())
-            {
-                childLists[0].push_back(BspFacePtr(new BspFace));
+        if (node->opaque || node->area >= world.numAreas)
+        {
+            rMessage() << "Entity origin " << origins[i] << " is outside the previously compiled areas, " <<
+                "running a full compile" << std::endl;
+            return false;
+        }
+    }
 
-                childLists[0].back()->w = front;
-                childLists[0].back()->planenum = (*split)->planenum;
-            }
+    return true;
+}
 
-            if (!back.empty())
-            {
-                childLists[1].push_back(BspFacePtr(new BspFace));
-
-                childLists[1].back()->w = back;
-                childLists[1].back()->planenum = (*split)->planenum;
-            }
-
-            split->reset();
-        }
-        else if (side == SIDE_FRONT)
-        {
-            childLists[0].push_back(*split);
-        }
-        else if ( side == SIDE_BACK )
-        {
-            childLists[1].push_back(*split);
-        }
+bool ProcCompiler::reuseCachedWorld(std::uint64_t geometryHash)
+{
+    if (!_cache->procFile || _cache->geometryHash != geometryHash || _cache->procFile->entities.empty())
+    {
+        return false;
     }
 
-    // recursively process children
-    for (std::size_t i = 0; i < 2; ++i)
+    const ProcFile& cachedFile = *_cache->procFile;
+    const ProcEntity& world = *cachedFile.entities.front();
+
+    // A light moved into the void would make the map leak, which the
+    // cached tree cannot tell, so every light must be inside an area
+    if (!world.tree.head || !originsInsideCachedAreas(cachedFile))
     {
-        node->children[i].reset(new BspTreeNode);
-        node->children[i]->parent = node.get();
-        node->children[i]->bounds = node->bounds;
+        return false;
     }
 
-    // split the bounds if we have a nice axial plane
-    for (std::size_t i = 0; i < 3; ++i)
-    {
-        if (fabs(plane.normal()[i] - 1.0f) < 0.001f)
-        {
-            // greebo: calculate the new origin and extents, if we set the children[0].min's and children[1].max's components to dist
-            float distHalf = plane.dist() * 0.5f;
-            float base = 0.5f * (node->children[0]->bounds.origin[i] + node->children[0]->bounds.extents[i]);
-            
-            node->children[0]->bounds.origin[i] = base + distHalf;
-            node->children[0]->bounds.extents[i] = base - distHalf;
+    rMessage() << "--- Geometry unchanged, re-using the BSP and area surfaces of the previous compile ---" << std::endl;
 
-            base = 0.5f * (node->children[1]->bounds.extents[i] - node->children[1]->bounds.origin[i]);
+    // Continue with the cached results, using the lights we just parsed
+    _cache->procFile->lights.swap(_procFile->lights);
 
-            node->children[1]->bounds.origin[i] = distHalf - base;
-            node->children[1]->bounds.extents[i] = distHalf + base;
-            break;
-        }
-    }
+    _procFile = _cache->procFile;
+    _planes = &_procFile->planes;
+
+    rMessage() << "----- BuildLightShadows -----" << std::endl;
 
-    for (std::size_t i = 0; i < 2; ++i)
     {
-        buildFaceTreeRecursively(node->children[i], childLists[i], tree);
+        DmapProfiler::ScopedStage stage(_profiler, "shadows");
+
+        parallelForWithOrderedLog(*_threadPool, _procFile->lights.size(), [&](std::size_t i)
+        {
+            buildLightShadows(_cache->preLightAreas, _procFile->lights[i]);
+        });
     }
 
-    // Cleanup
-    faces.clear();
+    addShadowCounters();
+
+    // Drop the shadow volumes of lights which don't exist anymore
+    _cache->shadowVolumes.swap(_shadowVolumes);
+
+    return true;
 }
 
-void ProcCompiler::faceBsp(ProcEntity& entity)
+bool ProcCompiler::reuseCachedStructure(std::uint64_t structureHash)
 {
-    rMessage() << "--- FaceBSP: " << _bspFaces.size() << " faces ---" << std::endl;
+    if (!_cache->procFile || _cache->structureHash != structureHash || _cache->procFile->entities.empty() ||
+        _procFile->entities.empty() || _procFile->entities.front()->primitives.empty())
+    {
+        return false;
+    }
 
-    entity.tree.bounds = AABB();
+    const ProcFile& cachedFile = *_cache->procFile;
+    const ProcEntity& cachedWorld = *cachedFile.entities.front();
 
-    // Accumulate bounds
-    for (BspFaces::const_iterator f = _bspFaces.begin(); f != _bspFaces.end(); ++f)
+    // Entities need to flood the same leafs as before, otherwise the outside
+    // leafs filled by the previous compile are not valid anymore
+    if (!cachedWorld.tree.head || _cache->preLightAreas.size() != cachedWorld.numAreas ||
+        _cache->optimizedAreas.size() != cachedWorld.numAreas || !originsInsideCachedAreas(cachedFile))
     {
-        for (std::size_t i = 0; i < (*f)->w.size(); ++i)
-        {
-            entity.tree.bounds.includePoint((*f)->w[i].vertex);
-        }
+        return false;
     }
 
-    // Allocate the head node and use the total bounds
-    entity.tree.head.reset(new BspTreeNode);
-    entity.tree.head->bounds = entity.tree.bounds;
+    rMessage() << "--- World structure unchanged, re-using the BSP tree and areas of the previous compile ---" << std::endl;
 
-    buildFaceTreeRecursively(entity.tree.head, _bspFaces, entity.tree);
+    ProcEntity& world = *_procFile->entities.front();
 
-    rMessage() << (boost::format("%5i leafs") % entity.tree.numFaceLeafs).str() << std::endl;
+    world.tree.head = cachedWorld.tree.head;
+    world.tree.outside = cachedWorld.tree.outside;
+    world.tree.bounds = cachedWorld.tree.bounds;
+    world.numAreas = cachedWorld.numAreas;
 
-    //common->Printf( "%5.1f seconds faceBsp\n", ( end - start ) / 1000.0 );
+    // The portals refer to the sides of the cached areaportal brushes, which
+    // are part of the structure hash and are therefore all matched below
+    _procFile->interAreaPortals = cachedFile.interAreaPortals;
 
-    /*rMessage() << ("After Face BSP\n");
+    const DmapCache::AreaContributions& cached = _cache->worldContributions;
+    std::size_t numPrimitives = world.primitives.size();
+    std::size_t numCachedPrimitives = cachedWorld.primitives.size();
 
-    std::size_t planes = _procFile->planes.size();
+    std::multimap<std::uint64_t, std::size_t> unmatched;
 
-    for (std::size_t i = 0; i < planes; ++i)
+    for (std::size_t j = 0; j < cached.size(); ++j)
     {
-        const Plane3& plane = _procFile->planes.getPlane(i);
-        rMessage() << (boost::format("Plane %d: (%f %f %f %f)\n") % i % plane.normal().x() % plane.normal().y() % plane.normal().z() % plane.dist());
-    }*/
-}
+        unmatched.insert(std::make_pair(cached[j].hash, j));
+    }
 
-void ProcCompiler::addPortalToNodes(const ProcPortalPtr& portal, const BspTreeNodePtr& front, const BspTreeNodePtr& back)
-{
-    if (portal->nodes[0] || portal->nodes[1])
+    std::vector<bool> dirtyAreas(world.numAreas, false);
+    std::vector<bool> changed(_worldContributions.size(), true);
+
+    for (std::size_t i = 0; i < _worldContributions.size(); ++i)
     {
-        rError() << "AddPortalToNode: already included" << std::endl;
-        return;
-    }
+        std::multimap<std::uint64_t, std::size_t>::iterator found = unmatched.find(_worldContributions[i].hash);
 
-    //rMessage() << (boost::format("Adding portal %d to node front = %d and back = %d") % portal->portalId % front->nodeId % back->nodeId) << std::endl;
+        // primitives never match inlined models, their hashes are tagged differently
+        if (found == unmatched.end() || (i < numPrimitives) != (found->second < numCachedPrimitives))
+        {
+            continue;
+        }
 
-    portal->nodes[0] = front;
-    portal->nodes[1] = back;
+        std::size_t j = found->second;
+        unmatched.erase(found);
 
-    // Add the given portal to the front and back node
-    portal->next[0] = front->portals;
-    front->portals = portal;
+        changed[i] = false;
+        _worldContributions[i].areas = cached[j].areas;
 
-    portal->next[1] = back->portals;
-    back->portals = portal;
-}
+        // Take the cached primitive, its visible hulls are still valid and
+        // the triangles of the cached areas are referring to its faces
+        if (i < numPrimitives)
+        {
+            world.primitives[i] = cachedWorld.primitives[j];
+        }
+    }
 
-void ProcCompiler::removePortalFromNode(const ProcPortalPtr& portal, const BspTreeNodePtr& node)
-{
-    ProcPortalPtr* portalRef = &node->portals;
+    // The areas of removed primitives and models need to be rebuilt without them
+    for (std::multimap<std::uint64_t, std::size_t>::const_iterator i = unmatched.begin(); i != unmatched.end(); ++i)
+    {
+        const std::vector<std::size_t>& areas = cached[i->second].areas;
+
+        for (std::size_t a = 0; a < areas.size(); ++a)
+        {
+            dirtyAreas[areas[a]] = true;
+        }
+    }
+
+    std::vector<std::size_t> inlined = getInlinedModelEntities();
+    std::vector<AreaTriLists> triLists(_worldContributions.size());
 
-    //rMessage() << (boost::format("Removing portal %d from node %d") % portal->portalId % node->nodeId) << std::endl;
-    
-    // remove reference to the current portal
-    while (true)
     {
-        ProcPortalPtr& test = *portalRef;
+        DmapProfiler::ScopedStage stage(_profiler, "putPrimitivesInAreas");
 
-        if (!test)
+        rMessage() << "----- PutPrimitivesInAreas -----" << std::endl;
+
+        std::vector<std::size_t> changedContributions;
+
+        for (std::size_t i = 0; i < _worldContributions.size(); ++i)
         {
-            rError() << "RemovePortalFromNode: portal not bounding leaf" << std::endl;
-            return;
+            if (!changed[i]) continue;
+
+            if (i < numPrimitives && world.primitives[i].brush)
+            {
+                clipBrushSidesByTree(*world.primitives[i].brush, world.tree.head);
+            }
+
+            changedContributions.push_back(i);
         }
 
-        if (test == portal)
+        clipWorldContributions(world, changedContributions, inlined, triLists);
+
+        for (std::size_t c = 0; c < changedContributions.size(); ++c)
         {
-            break; // found
+            DmapCache::AreaContribution& contribution = _worldContributions[changedContributions[c]];
+
+            setContributionAreas(contribution, triLists[changedContributions[c]]);
+
+            for (std::size_t a = 0; a < contribution.areas.size(); ++a)
+            {
+                dirtyAreas[contribution.areas[a]] = true;
+            }
         }
 
-        if (test->nodes[0] == node)
+        // Unchanged primitives and models touching a dirty area are clipped again,
+        // such that the dirty areas can be filled from scratch
+        std::vector<std::size_t> touchingContributions;
+
+        for (std::size_t i = 0; i < _worldContributions.size(); ++i)
         {
-            portalRef = &(test->next[0]);
+            if (changed[i]) continue;
+
+            const std::vector<std::size_t>& areas = _worldContributions[i].areas;
+
+            for (std::size_t a = 0; a < areas.size(); ++a)
+            {
+                if (dirtyAreas[areas[a]])
+                {
+                    touchingContributions.push_back(i);
+                    break;
+                }
+            }
         }
-        else if (test->nodes[1] == node)
+
+        clipWorldContributions(world, touchingContributions, inlined, triLists);
+
+        world.areas.clear();
+        world.areas.resize(world.numAreas);
+
+        // Add the lists in the order of a full compile, primitives back to front followed by the models.
+        // Lists outside the dirty areas are already contained in the cached areas.
+        for (std::size_t k = 0; k < triLists.size(); ++k)
         {
-            portalRef = &(test->next[1]);
+            AreaTriLists& lists = triLists[k < numPrimitives ? numPrimitives - 1 - k : k];
+
+            lists.erase(std::remove_if(lists.begin(), lists.end(), [&](const AreaTriList& list)
+            {
+                return !dirtyAreas[list.areaNum];
+            }), lists.end());
+
+            addAreaTriLists(world, lists);
         }
-        else
+
+        for (std::size_t a = 0; a < world.numAreas; ++a)
         {
-            rError() << "removePortalFromNode: portal not in leaf" << std::endl; 
-            return;
+            if (!dirtyAreas[a])
+            {
+                world.areas[a] = _cache->preLightAreas[a];
+            }
         }
     }
-    
-    if (portal->nodes[0] == node)
-    {
-        *portalRef = portal->next[0];
-        portal->nodes[0].reset();
-    } 
-    else if (portal->nodes[1] == node)
-    {
-        *portalRef = portal->next[1];   
-        portal->nodes[1].reset();
-    }
-    else
-    {
-        rError() << "removePortalFromNode: mislinked" << std::endl;
-    }   
-}
 
-void ProcCompiler::makeHeadNodePortals(BspTree& tree)
-{
-    tree.outside->planenum = PLANENUM_LEAF;
-    tree.outside->nodeId = 9999;
-    tree.outside->brushlist.clear();
-    tree.outside->portals.reset();
-    tree.outside->opaque = false;
+    std::size_t numDirtyAreas = std::count(dirtyAreas.begin(), dirtyAreas.end(), true);
 
-    BspTreeNodePtr& node = tree.head;
+    rMessage() << (boost::format("%5i of %i areas changed") % numDirtyAreas % world.numAreas) << std::endl;
+
+    addCounter("putPrimitivesInAreas", "dirtyAreas", numDirtyAreas);
+    addCounter("putPrimitivesInAreas", "triangles", countAreaTriangles(world));
 
-    // if no nodes, don't go any farther
-    if (node->planenum == PLANENUM_LEAF)
     {
-        return;
+        DmapProfiler::ScopedStage stage(_profiler, "shadows");
+        preLight(world);
     }
 
-    AABB bounds = tree.bounds;
-
-    // pad with some space so there will never be null volume leafs
-    static const float SIDESPACE = 8;
-    bounds.extendBy(Vector3(SIDESPACE, SIDESPACE, SIDESPACE));
+    {
+        DmapProfiler::ScopedStage stage(_profiler, "optimize");
+        optimizeDirtyAreas(world, dirtyAreas);
+    }
 
-    // greebo: Six planes/portals to separate the whole tree from the "outside"
-    // Each portal has the head node as front and the outside as back node
-    ProcPortalPtr portals[6];
-    Plane3 planes[6];
+    addCounter("optimize", "triangles", countAreaTriangles(world));
 
-    for (std::size_t i = 0; i < 3; ++i)
     {
-        for (std::size_t j = 0; j < 2 ; ++j)
-        {
-            std::size_t n = j*3 + i;
+        DmapProfiler::ScopedStage stage(_profiler, "tjunctions");
+        fixGlobalTjunctions(world);
+    }
 
-            portals[n].reset(new ProcPortal);
+    addCounter("tjunctions", "triangles", countAreaTriangles(world));
 
-            _numActivePortals++;
-            if (_numActivePortals > _numPeakPortals)
-            {
-                _numPeakPortals = _numActivePortals;
-            }
-    
-            Plane3& pl = planes[n];
-            pl = Plane3(0,0,0,0);
+    // the cached tree has been pruned already
+    return true;
+}
 
-            if (j) // j == 1
-            {
-                pl.normal()[i] = -1;
-                pl.dist() = -(bounds.origin + bounds.extents)[i];
-            }
-            else // j == 0
-            {
-                pl.normal()[i] = 1;
-                pl.dist() = (bounds.origin - bounds.extents)[i];
-            }
+void ProcCompiler::clipWorldContributions(const ProcEntity& world, const std::vector<std::size_t>& contributions,
+                                          const std::vector<std::size_t>& inlined, std::vector<AreaTriLists>& triLists)
+{
+    std::size_t numPrimitives = world.primitives.size();
 
-            portals[n]->plane = pl;
-            portals[n]->winding.setFromPlane(pl);
-            
-            addPortalToNodes(portals[n], node, tree.outside);
+    std::vector<std::size_t> primitives;
+
+    for (std::size_t c = 0; c < contributions.size(); ++c)
+    {
+        if (contributions[c] < numPrimitives)
+        {
+            primitives.push_back(contributions[c]);
         }
     }
 
-    // clip the (near-infinitely large) windings by all the other planes
-    for (std::size_t i = 0; i < 6; ++i)
+    parallelForWithOrderedLog(*_threadPool, primitives.size(), [&](std::size_t index)
     {
-        for (std::size_t j = 0; j < 6; ++j)
-        {
-            if (j == i) continue;
+        clipPrimitiveIntoAreas(world.primitives[primitives[index]], world, triLists[primitives[index]]);
+    });
 
-            portals[i]->winding.clip(planes[j], ON_EPSILON);
+    // The model cache is not thread-safe, inlined models are processed serially
+    for (std::size_t c = 0; c < contributions.size(); ++c)
+    {
+        if (contributions[c] >= numPrimitives)
+        {
+            const ProcEntity& entity = *_procFile->entities[inlined[contributions[c] - numPrimitives]];
+            clipInlinedModelIntoAreas(entity, world, triLists[contributions[c]]);
         }
     }
 }
 
-void ProcCompiler::calculateNodeBounds(const BspTreeNodePtr& node)
+void ProcCompiler::storeInCache(std::uint64_t geometryHash, std::uint64_t structureHash)
 {
-    // calc mins/maxs for both leafs and nodes
-    node->bounds = AABB();
-    std::size_t s = 0;
+    _cache->geometryHash = geometryHash;
+    _cache->structureHash = structureHash;
+    _cache->procFile = _procFile;
+    _cache->worldContributions.swap(_worldContributions);
+    _cache->preLightAreas.swap(_preLightAreas);
+    _cache->optimizedAreas.swap(_optimizedAreas);
+    _cache->shadowVolumes.swap(_shadowVolumes);
+}
 
-    // Use raw pointers to avoid constant shared_ptr assigments
-    for (ProcPortal* p = node->portals.get(); p != NULL; p = p->next[s].get())
+void ProcCompiler::addCounter(const char* stage, const char* counter, std::size_t value)
+{
+    if (_profiler)
     {
-        s = (p->nodes[1] == node) ? 1 : 0;
-
-        for (std::size_t i = 0; i < p->winding.size(); ++i)
-        {
-            node->bounds.includePoint(p->winding[i].vertex);
-        }
+        _profiler->addCounter(stage, counter, value);
     }
 }
 
-ProcWinding ProcCompiler::getBaseWindingForNode(const BspTreeNodePtr& node)
+void ProcCompiler::addShadowCounters()
 {
-    ProcWinding winding(_procFile->planes.getPlane(node->planenum));
-
-    // clip by all the parents
-    BspTreeNode* nodeRaw = node.get(); // FIXME
-    for (BspTreeNode* n = node->parent; n != NULL && !winding.empty(); )
+    if (!_profiler)
     {
-        const Plane3& plane = _procFile->planes.getPlane(n->planenum);
-        static const float BASE_WINDING_EPSILON = 0.001f;
+        return;
+    }
 
-        if (n->children[0].get() == nodeRaw)
-        {
-            // take front
-            winding.clip(plane, BASE_WINDING_EPSILON);
-        } 
-        else
-        {
-            // take back
-            winding.clip(-plane, BASE_WINDING_EPSILON);
-        }
+    std::size_t numShadowVerts = 0;
+    std::size_t numShadowIndices = 0;
 
-        nodeRaw = n;
-        n = n->parent;
+    for (ProcFile::ProcLights::const_iterator light = _procFile->lights.begin(); 
+         light != _procFile->lights.end(); ++light)
+    {
+        numShadowVerts += light->shadowTris.shadowVertices.size();
+        numShadowIndices += light->shadowTris.indices.size();
     }
 
-    return winding;
+    _profiler->addCounter("shadows", "lights", _procFile->lights.size());
+    _profiler->addCounter("shadows", "shadowVerts", numShadowVerts);
+    _profiler->addCounter("shadows", "shadowIndices", numShadowIndices);
 }
 
-void ProcCompiler::makeNodePortal(const BspTreeNodePtr& node)
+std::size_t ProcCompiler::countAreaTriangles(const ProcEntity& entity)
 {
-    ProcWinding w = getBaseWindingForNode(node);
-
-    std::size_t side;
+    std::size_t count = 0;
 
-    // clip the portal by all the other portals in the node
-    for (ProcPortal* p = node->portals.get(); p != NULL && !w.empty(); p = p->next[side].get())
+    for (ProcEntity::Areas::const_iterator area = entity.areas.begin(); area != entity.areas.end(); ++area)
     {
-        Plane3 plane;
-
-        if (p->nodes[0] == node)
-        {
-            side = 0;
-            plane = p->plane;
-        }
-        else if (p->nodes[1] == node)
-        {
-            side = 1;
-            plane = -p->plane;
-        }
-        else
+        for (ProcArea::OptimizeGroups::const_iterator group = area->groups.begin(); 
+             group != area->groups.end(); ++group)
         {
-            rError() << "makeNodePortal: mislinked portal" << std::endl;
-            side = 0;   // quiet a compiler warning
-            return;
+            count += group->triList.size();
         }
-
-        w.clip(plane, CLIP_EPSILON);
     }
 
-    if (w.empty())
+    return count;
+}
+
+bool ProcCompiler::processModels()
+{
+    BspTreeNode::nextNodeId = 0;
+    ProcPortal::nextPortalId = 0;
+
+    if (_procFile->entities.empty())
     {
-        return;
+        return true;
     }
 
-    if (w.isTiny())
+    ProcEntity& world = *_procFile->entities.front();
+
+    if (!world.primitives.empty())
     {
-        _numTinyPortals++;
-        w.clear();
-        return;
+        rMessage() << "############### entity " << 0 << " ###############" << std::endl;
+
+        // if we leaked, stop without any more processing, only floodfill the first entity (world)
+        if (!processModel(world, true))
+        {
+            return false;
+        }
     }
-    
-    ProcPortalPtr newPortal(new ProcPortal);
 
-    newPortal->plane = _procFile->planes.getPlane(node->planenum);
-    newPortal->onnode = node;
-    newPortal->winding = w;
+    processEntityModels();
 
-    addPortalToNodes(newPortal, node->children[0], node->children[1]);
+    return true;
 }
 
-void ProcCompiler::splitNodePortals(const BspTreeNodePtr& node)
+void ProcCompiler::processEntityModels()
 {
-    const Plane3& plane = _procFile->planes.getPlane(node->planenum);
-
-    const BspTreeNodePtr& front = node->children[0];
-    const BspTreeNodePtr& back = node->children[1];
-
-    //rMessage() << "-- Split node portals on node " << node->nodeId << std::endl;
+    // The remaining entity models are independent of each other. Planes created
+    // while processing them are kept in a set per entity, layered on top of the
+    // world's planes, which keeps the results independent of the processing order.
+    std::vector<std::size_t> entityNums;
 
-    ProcPortalPtr nextPortal;
-
-    for (ProcPortalPtr portal = node->portals; portal; portal = nextPortal)
+    for (std::size_t i = 1; i < _procFile->entities.size(); ++i)
     {
-        std::size_t side;
-
-        if (portal->nodes[0] == node)
-        {
-            side = 0;
-        }
-        else if (portal->nodes[1] == node)
-        {
-            side = 1;
-        }
-        else
+        if (!_procFile->entities[i]->primitives.empty())
         {
-            rError() << "splitNodePortals: mislinked portal" << std::endl;
-            side = 0;   // quiet a compiler warning
+            entityNums.push_back(i);
         }
+    }
 
-        nextPortal = portal->next[side];
+    parallelForWithOrderedLog(*_threadPool, entityNums.size(), [&](std::size_t index)
+    {
+        std::size_t entityNum = entityNums[index];
 
-        // Remember the other node before removing the portal from them
-        BspTreeNodePtr otherNode = portal->nodes[!side];
+        rMessage() << "############### entity " << entityNum << " ###############" << std::endl;
 
-        removePortalFromNode(portal, portal->nodes[0]);
-        removePortalFromNode(portal, portal->nodes[1]);
+        PlaneSet entityPlanes(&_procFile->planes);
+        ProcCompiler compiler(*this, entityPlanes);
 
-        // cut the portal into two portals, one on each side of the cut plane
-        ProcWinding frontwinding;
-        ProcWinding backwinding;
-        portal->winding.split(plane, SPLIT_WINDING_EPSILON, frontwinding, backwinding);
+        compiler.processModel(*_procFile->entities[entityNum], false);
+    });
+}
 
-        if (!frontwinding.empty() && frontwinding.isTiny())
-        {
-            //rMessage() << " Discarding tiny portal " << portal->portalId << std::endl;
+void ProcCompiler::makeStructuralProcFaceList(const ProcEntity::Primitives& primitives)
+{
+    std::size_t brushCount = 0;
+    std::size_t nonOpaqueCount = 0;
 
-            frontwinding.clear();
-            _numTinyPortals++;
-        }
+    for (ProcEntity::Primitives::const_reverse_iterator i = primitives.rbegin();
+        i != primitives.rend(); ++i)
+    {
+        if (!i->brush) continue; // skip all patches
 
-        if (!backwinding.empty() && backwinding.isTiny())
-        {
-            //rMessage() << " Discarding portal " << portal->portalId << std::endl;
+        brushCount++;
 
-            backwinding.clear();
-            _numTinyPortals++;
-        }
+        ProcBrush& brush = *i->brush;
 
-        if (frontwinding.empty() && backwinding.empty())
-        {   
-            continue; // tiny windings on both sides
+        if (!brush.opaque && !(brush.contents & Material::SURF_AREAPORTAL))
+        {
+            nonOpaqueCount++;
+            continue; // skip all non-opaque non-portals
         }
 
-        if (frontwinding.empty())
+        for (ProcBrush::ProcFaces::const_iterator s = brush.sides.begin(); s != brush.sides.end(); ++s)
         {
-            //rMessage() << " No front winding " << portal->portalId << std::endl;
+            const ProcFace& side = *s;
 
-            backwinding.clear();
+            if (side.winding.empty()) continue;
 
-            if (side == 0)
-            {
-                addPortalToNodes(portal, back, otherNode);
-            }
-            else
+            int sideFlags = side.material->getSurfaceFlags();
+
+            // Skip all faces of a portal brush that are not textured with the "areaportal" face
+            if ((brush.contents & Material::SURF_AREAPORTAL) && !(sideFlags & Material::SURF_AREAPORTAL))
             {
-                addPortalToNodes(portal, otherNode, back);
+                continue;
             }
 
-            continue;
-        }
+            // Allocate a new BspFace
+            _bspFaces.push_back(BspFacePtr(new BspFace()));
+            BspFace& face = *_bspFaces.back();
 
-        if (backwinding.empty())
-        {
-            //rMessage() << " No back winding " << portal->portalId << std::endl;
+            // Check if this is a portal face
+            face.portal = (sideFlags & Material::SURF_AREAPORTAL) != 0;
+            face.w = side.winding;
+            face.planenum = side.planenum & ~1; // use the even plane number
+        }
+    }
+}
 
-            frontwinding.clear();
+#define BLOCK_SIZE  1024
 
-            if (side == 0)
-            {
-                addPortalToNodes(portal, front, otherNode);
-            }
-            else
-            {
-                addPortalToNodes(portal, otherNode, front);
-            }
+std::size_t ProcCompiler::findBlockSplitPlaneNum(const BspTreeNodePtr& node)
+{
+    // if it is crossing a 1k block boundary, force a split
+    // this prevents epsilon problems from extending an
+    // arbitrary distance across the map
 
-            continue;
-        }
+    Vector3 halfSize = node->bounds.extents;
+    Vector3 nodeMin = node->bounds.origin - node->bounds.extents;
+    Vector3 nodeMax = node->bounds.origin + node->bounds.extents;
 
-        //rMessage() << " Splitting portal " << portal->portalId << std::endl;
-        
-        // the winding is split
-        ProcPortalPtr newPortal(new ProcPortal(*portal)); // copy-construct
-        newPortal->winding = backwinding;
-        
-        portal->winding = frontwinding;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float dist;
 
-        if (side == 0)
+        if (halfSize[axis] > BLOCK_SIZE)
         {
-            addPortalToNodes(portal, front, otherNode);
-            addPortalToNodes(newPortal, back, otherNode);
+            dist = BLOCK_SIZE * ( floor( (nodeMin[axis] + halfSize[axis]) / BLOCK_SIZE ) + 1.0f );
         }
         else
         {
-            addPortalToNodes(portal, otherNode, front);
-            addPortalToNodes(newPortal, otherNode, back);
+            dist = BLOCK_SIZE * ( floor( nodeMin[axis] / BLOCK_SIZE ) + 1.0f );
+        }
+
+        if (dist > nodeMin[axis] + 1.0f && dist < nodeMax[axis] - 1.0f)
+        {
+            Plane3 plane(0, 0, 0, dist);
+            plane.normal()[axis] = 1.0f;
+
+            return _planes->findOrInsertPlane(plane, EPSILON_NORMAL, EPSILON_DIST);
         }
     }
 
-    node->portals.reset();
+    return std::numeric_limits<std::size_t>::max();
 }
 
-void ProcCompiler::makeTreePortalsRecursively(const BspTreeNodePtr& node)
+void ProcCompiler::insertBlockSplitPlanes(const AABB& bounds)
 {
-    calculateNodeBounds(node);
+    Vector3 mins = bounds.origin - bounds.extents;
+    Vector3 maxs = bounds.origin + bounds.extents;
 
-    Vector3 minbounds = node->bounds.origin - node->bounds.extents;
-    Vector3 maxBounds = node->bounds.origin + node->bounds.extents;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (float dist = BLOCK_SIZE * floor(mins[axis] / BLOCK_SIZE); dist <= maxs[axis]; dist += BLOCK_SIZE)
+        {
+            Plane3 plane(0, 0, 0, dist);
+            plane.normal()[axis] = 1.0f;
 
-    if (node->bounds.extents.getLengthSquared() <= 0)
+            _planes->findOrInsertPlane(plane, EPSILON_NORMAL, EPSILON_DIST);
+        }
+    }
+}
+
+std::size_t ProcCompiler::selectSplitPlaneNum(const BspTreeNodePtr& node, BspFaces& faces)
+{
+    std::size_t blockPlaneNum = findBlockSplitPlaneNum(node);
+
+    if (blockPlaneNum != std::numeric_limits<std::size_t>::max())
     {
-        rWarning() << "node without a volume" << std::endl;
+        return blockPlaneNum;
     }
 
-    Vector3 boundsMin = node->bounds.origin - node->bounds.extents;
-    Vector3 boundsMax = node->bounds.origin + node->bounds.extents;
+    // pick one of the face planes
+    // if we have any portal faces at all, only
+    // select from them, otherwise select from
+    // all faces
+    int bestValue = -999999;
+    BspFaces::const_reverse_iterator bestSplit = faces.rbegin();
 
-    for (std::size_t i = 0; i < 3; ++i)
+    bool havePortals = false;
+
+    for (BspFaces::const_reverse_iterator split = faces.rbegin(); split != faces.rend(); ++split)
     {
-        if (boundsMin[i] < MIN_WORLD_COORD || boundsMax[i] > MAX_WORLD_COORD )
+        (*split)->checked = false;
+
+        if ((*split)->portal)
         {
-            rWarning() << "node with unbounded volume" << std::endl;
-            break;
+            havePortals = true;
         }
     }
 
-    if (node->planenum == PLANENUM_LEAF)
+    for (BspFaces::const_reverse_iterator split = faces.rbegin(); split != faces.rend(); ++split)
     {
-        return;
-    }
+        if ((*split)->checked) continue;
 
-    makeNodePortal(node);
-    splitNodePortals(node);
+        // greebo: prefer portals as split planes, if we have some
+        if (havePortals != (*split)->portal) continue;
 
-    makeTreePortalsRecursively(node->children[0]);
-    makeTreePortalsRecursively(node->children[1]);
-}
+        const Plane3& mapPlane = _planes->getPlane((*split)->planenum);
 
-void ProcCompiler::makeTreePortals(BspTree& tree)
-{
-    rMessage() << "----- MakeTreePortals -----" << std::endl;
+        int splits = 0;
+        int facing = 0;
+        int front = 0;
+        int back = 0;
 
-    makeHeadNodePortals(tree);
+        for (BspFaces::const_reverse_iterator check = faces.rbegin(); check != faces.rend(); ++check)
+        {
+            if ((*check)->planenum == (*split)->planenum)
+            {
+                facing++;
+                (*check)->checked = true;   // won't need to test this plane again
+                continue;
+            }
 
-    makeTreePortalsRecursively(tree.head);
-}
+            int side = (*check)->w.planeSide(mapPlane);
 
-float ProcCompiler::calculateBrushVolume(const ProcBrushPtr& brush) 
-{
-    if (!brush) return 0;
+            if (side == SIDE_CROSS)
+            {
+                splits++;
+            }
+            else if (side == SIDE_FRONT)
+            {
+                front++;
+            }
+            else if (side == SIDE_BACK)
+            {
+                back++;
+            }
+        }
 
-    ProcWinding* w = NULL;
-    std::size_t i = 0;
+        int value = 5*facing - 5*splits; // - abs(front-back);
 
-    // grab the first valid point as the corner
-    for (i = 0; i < brush->sides.size(); ++i)
-    {
-        w = &brush->sides[i].winding;
+        if (PlaneSet::getPlaneType(mapPlane) < PlaneSet::PLANETYPE_TRUEAXIAL)
+        {
+            value += 5;     // axial is better
+        }
 
-        if (!w->empty())
-            break;
+        if (value > bestValue)
+        {
+            bestValue = value;
+            bestSplit = split;
+        }
     }
 
-    if (w->empty())
+    if (bestValue == -999999)
     {
-        return 0;
+        return std::numeric_limits<std::size_t>::max();
     }
 
-    Vector3 corner = (*w)[0].vertex;
+    return (*bestSplit)->planenum;
+}
 
-    // make tetrahedrons to all other faces
-    float volume = 0;
+namespace
+{
+    // Weights of the surface area heuristic, in units of "one face in a child node"
+    const double SAH_SPLIT_COST = 2.0;      // crossing faces end up in both children
+    const double SAH_FACING_BONUS = 1.0;    // faces on the split plane are consumed by the node
+    const double SAH_NONAXIAL_COST = 1.0;   // axial is better
 
-    for (; i < brush->sides.size(); ++i)
-    {
-        const ProcWinding& winding = brush->sides[i].winding;
+    // Candidate planes are binned by plane type and position within the faces' bounds,
+    // only the candidate with the most faces per bin is scored
+    const std::size_t SAH_POSITION_BINS = 8;
 
-        if (winding.empty())
-        {
-            continue;
-        }
+    // Face lists smaller than this are scored and split without spawning tasks
+    const std::size_t SAH_PARALLEL_FACE_THRESHOLD = 256;
 
-        const Plane3& plane = _procFile->planes.getPlane(brush->sides[i].planenum);
+    inline double getSurfaceArea(const AABB& bounds)
+    {
+        if (!bounds.isValid()) return 0;
 
-        float d = -plane.distanceToPoint(corner);
-        float area = winding.getArea();
-        volume += d * area;
+        const Vector3& e = bounds.extents;
+        return 8 * (e.x() * e.y() + e.y() * e.z() + e.z() * e.x());
     }
-
-    return volume / 3;
 }
 
-void ProcCompiler::splitBrush(const ProcBrushPtr& brush, std::size_t planenum, ProcBrushPtr& front, ProcBrushPtr& back)
+std::size_t ProcCompiler::selectSplitPlaneNumSah(const BspTreeNodePtr& node, const BspFaces& faces)
 {
-    const Plane3& plane = _procFile->planes.getPlane(planenum);
+    std::size_t blockPlaneNum = findBlockSplitPlaneNum(node);
 
-    // check all points
-    float d_front = 0;
-    float d_back = 0;
-
-    for (std::size_t i = 0; i < brush->sides.size(); ++i)
+    if (blockPlaneNum != std::numeric_limits<std::size_t>::max())
     {
-        ProcWinding& w = brush->sides[i].winding;
+        return blockPlaneNum;
+    }
 
-        for (std::size_t j = 0; j < w.size(); ++j)
-        {
-            float d = plane.distanceToPoint(w[j].vertex);
+    // like the classic heuristic, only select from portal faces if we have any
+    bool havePortals = false;
+    AABB faceBounds;
 
-            if (d > 0 && d > d_front)
-            {
-                d_front = d;
-            }
+    for (BspFaces::const_iterator f = faces.begin(); f != faces.end(); ++f)
+    {
+        havePortals |= (*f)->portal;
 
-            if (d < 0 && d < d_back)
-            {
-                d_back = d;
-            }
+        for (std::size_t i = 0; i < (*f)->w.size(); ++i)
+        {
+            faceBounds.includePoint((*f)->w[i].vertex);
         }
     }
 
-    if (d_front < 0.1f) // PLANESIDE_EPSILON)
-    {   // only on back
-        back.reset(new ProcBrush(*brush)); // copy
-        return;
-    }
+    std::map<int, std::size_t> facesPerPlane;
 
-    if (d_back > -0.1) // PLANESIDE_EPSILON)
-    {   // only on front
-        front.reset(new ProcBrush(*brush)); // copy
-        return;
+    for (BspFaces::const_iterator f = faces.begin(); f != faces.end(); ++f)
+    {
+        if ((*f)->portal == havePortals)
+        {
+            facesPerPlane[(*f)->planenum]++;
+        }
     }
 
-    // create a new winding from the split plane
-    ProcWinding w(plane);
-
-    for (std::size_t i = 0; i < brush->sides.size() && !w.empty(); ++i)
+    if (facesPerPlane.empty())
     {
-        const Plane3& plane2 = _procFile->planes.getPlane(brush->sides[i].planenum ^ 1);
-        w.clip(plane2, 0);
+        return std::numeric_limits<std::size_t>::max();
     }
 
-    if (w.empty() || w.isTiny())
+    // Bin the candidates, keeping the plane with the most faces on it
+    std::vector<std::pair<int, std::size_t> > bins(
+        (PlaneSet::PLANETYPE_NONAXIAL + 1) * SAH_POSITION_BINS, std::make_pair(-1, 0));
+
+    for (std::map<int, std::size_t>::const_iterator i = facesPerPlane.begin(); i != facesPerPlane.end(); ++i)
     {
-        // the brush isn't really split
-        int side = brush->mostlyOnSide(plane);
+        const Plane3& plane = _planes->getPlane(i->first);
 
-        if (side == PSIDE_FRONT)
+        // Position of the plane within the projection of the face bounds onto its normal
+        double centre = plane.normal().dot(faceBounds.origin);
+        double radius = fabs(plane.normal().x() * faceBounds.extents.x()) + 
+            fabs(plane.normal().y() * faceBounds.extents.y()) + 
+            fabs(plane.normal().z() * faceBounds.extents.z());
+
+        double fraction = radius > 0 ? (plane.dist() - (centre - radius)) / (2 * radius) : 0;
+        int position = static_cast<int>(fraction * SAH_POSITION_BINS);
+
+        if (position < 0)
         {
-            front.reset(new ProcBrush(*brush));
+            position = 0;
         }
-
-        if (side == PSIDE_BACK)
+        else if (position >= static_cast<int>(SAH_POSITION_BINS))
         {
-            back.reset(new ProcBrush(*brush));
+            position = SAH_POSITION_BINS - 1;
         }
 
-        return;
+        std::pair<int, std::size_t>& bin = bins[PlaneSet::getPlaneType(plane) * SAH_POSITION_BINS + position];
+
+        if (i->second > bin.second)
+        {
+            bin = *i;
+        }
     }
 
-    if (w.isHuge())
+    std::vector<int> candidates;
+
+    for (std::size_t i = 0; i < bins.size(); ++i)
     {
-        rWarning() << "huge winding" << std::endl;
+        if (bins[i].first != -1)
+        {
+            candidates.push_back(bins[i].first);
+        }
     }
 
-    ProcWinding midwinding = w;
+    double totalArea = getSurfaceArea(faceBounds);
 
-    // split it for real
+    if (totalArea <= 0)
+    {
+        totalArea = 1;
+    }
 
-    ProcBrushPtr parts[2];
+    std::vector<double> costs(candidates.size());
 
-    for (std::size_t i = 0; i < 2; ++i)
+    auto scoreCandidate = [&](std::size_t c)
     {
-        parts[i].reset(new ProcBrush(*brush));
+        const Plane3& plane = _planes->getPlane(candidates[c]);
 
-        parts[i]->sides.clear(); // reserve(brush->sides.size() + 1);
-        parts[i]->original = brush->original;
-    }
+        AABB frontBounds;
+        AABB backBounds;
+        std::size_t front = 0;
+        std::size_t back = 0;
+        std::size_t splits = 0;
+        std::size_t facing = 0;
 
-    // split all the current windings
-    ProcWinding cw[2];
+        for (BspFaces::const_iterator f = faces.begin(); f != faces.end(); ++f)
+        {
+            const BspFace& face = **f;
 
-    for (std::size_t i = 0; i < brush->sides.size(); ++i)
-    {
-        ProcFace& side = brush->sides[i];
-        ProcWinding w = side.winding;
+            if (face.planenum == candidates[c])
+            {
+                facing++;
+                continue;
+            }
 
-        if (w.empty()) continue;
+            int side = face.w.planeSide(plane);
 
-        w.split(plane, 0 /*PLANESIDE_EPSILON*/, cw[0], cw[1]);
+            if (side == SIDE_CROSS)
+            {
+                splits++;
+            }
 
-        for (std::size_t j = 0; j < 2; ++j)
-        {
-            if (cw[j].empty()) continue;
+            if (side == SIDE_FRONT || side == SIDE_CROSS)
+            {
+                front++;
 
-            parts[j]->sides.push_back(side);
-            parts[j]->sides.back().winding.swap(cw[j]);
-        }
-    }
+                for (std::size_t i = 0; i < face.w.size(); ++i)
+                {
+                    frontBounds.includePoint(face.w[i].vertex);
+                }
+            }
 
-    // see if we have valid polygons on both sides
+            if (side == SIDE_BACK || side == SIDE_CROSS)
+            {
+                back++;
 
-    for (std::size_t i = 0 ; i < 2 ; ++i)
-    {
-        if (!parts[i]->bound())
-        {
-            break;
+                for (std::size_t i = 0; i < face.w.size(); ++i)
+                {
+                    backBounds.includePoint(face.w[i].vertex);
+                }
+            }
         }
 
-        if (parts[i]->sides.size() < 3)
-        {
-            parts[i].reset();
-        }
-    }
+        double cost = (getSurfaceArea(frontBounds) * front + getSurfaceArea(backBounds) * back) / totalArea;
 
-    if (!(parts[0] && parts[1]))
-    {
-        if (!parts[0] && !parts[1])
-        {
-            rMessage() << "split removed brush" << std::endl;
-        }
-        else
-        {
-            rMessage() << "split not on both sides" << std::endl;
-        }
+        cost += SAH_SPLIT_COST * splits;
+        cost -= SAH_FACING_BONUS * facing;
 
-        if (parts[0])
+        if (PlaneSet::getPlaneType(plane) >= PlaneSet::PLANETYPE_TRUEAXIAL)
         {
-            parts[0].reset();
-            front.reset(new ProcBrush(*brush)); // copy
+            cost += SAH_NONAXIAL_COST;
         }
 
-        if (parts[1])
-        {
-            parts[1].reset();
-            back.reset(new ProcBrush(*brush)); // copy
-        }
+        costs[c] = cost;
+    };
 
-        return;
+    if (faces.size() >= SAH_PARALLEL_FACE_THRESHOLD)
+    {
+        util::parallelFor(*_threadPool, candidates.size(), scoreCandidate);
     }
-
-    // add the midwinding to both sides
-    for (std::size_t i = 0; i < 2; ++i)
+    else
     {
-        parts[i]->sides.push_back(ProcFace());
-
-        parts[i]->sides.back().planenum = planenum^i^1;
-        
-        if (i==0)
+        for (std::size_t c = 0; c < candidates.size(); ++c)
         {
-            parts[i]->sides.back().winding = midwinding; // copy
-        }
-        else
-        {
-            parts[i]->sides.back().winding.swap(midwinding); // move
+            scoreCandidate(c);
         }
     }
 
+    // lowest cost wins, ties are resolved in candidate order to stay deterministic
+    std::size_t best = 0;
+
+    for (std::size_t c = 1; c < candidates.size(); ++c)
     {
-        for (std::size_t i = 0; i < 2; ++i)
+        if (costs[c] < costs[best])
         {
-            float v1 = calculateBrushVolume(parts[i]);
-
-            if (v1 < 1.0f)
-            {
-                parts[i].reset();
-            }
+            best = c;
         }
     }
 
-    front.swap(parts[0]); // assign return values
-    back.swap(parts[1]);
+    return candidates[best];
 }
 
-std::size_t ProcCompiler::filterBrushIntoTreeRecursively(const ProcBrushPtr& brush, const BspTreeNodePtr& node)
+void ProcCompiler::buildFaceTreeRecursively(const BspTreeNodePtr& node, BspFaces& faces, BspTree& tree)
 {
-    if (!brush)
+    std::size_t splitPlaneNum = _options.splitHeuristic == DmapOptions::SPLIT_SURFACE_AREA ?
+        selectSplitPlaneNumSah(node, faces) : selectSplitPlaneNum(node, faces);
+
+    // if we don't have any more faces, this is a node
+    if (splitPlaneNum == std::numeric_limits<std::size_t>::max())
     {
-        return 0;
+        node->planenum = PLANENUM_LEAF;
+        tree.numFaceLeafs++;
+        return;
     }
 
-    // add it to the leaf list
-    if (node->planenum == PLANENUM_LEAF)
-    {
-        node->brushlist.push_back(brush);
+    // partition the list
+    node->planenum = splitPlaneNum;
 
-        // classify the leaf by the structural brush
-        if (brush->opaque)
+    const Plane3& plane = _planes->getPlane(splitPlaneNum);
+
+    BspFaces childLists[2];
+
+    BspFaces::reverse_iterator next;
+
+    // greebo: We use a reverse iterator since D3 is pushing planes to front of the list,
+    // this way we keep the same order
+    for (BspFaces::reverse_iterator split = faces.rbegin(); split != faces.rend(); split = next )
+    {
+        next = split + 1; // remember the pointer to next
+
+        if ((*split)->planenum == node->planenum)
         {
-            node->opaque = true;
+            split->reset();
+            continue;
         }
 
-        return 1;
-    }
+        int side = (*split)->w.planeSide(plane);
 
-    // split it by the node plane
-    ProcBrushPtr front;
-    ProcBrushPtr back;
-    splitBrush(brush, node->planenum, front, back);
+        if (side == SIDE_CROSS)
+        {
+            // Split into front and back winding
+            ProcWinding front;
+            ProcWinding back;
 
-    std::size_t count = 0;
+            (*split)->w.split(plane, CLIP_EPSILON * 2, front, back);
 
-    count += filterBrushIntoTreeRecursively(front, node->children[0]);
-    count += filterBrushIntoTreeRecursively(back, node->children[1]);
+            if (!front.empty())
+            {
+                childLists[0].push_back(BspFacePtr(new BspFace));
 
-    return count;
-}
+                childLists[0].back()->w = front;
+                childLists[0].back()->planenum = (*split)->planenum;
+            }
 
-void ProcCompiler::filterBrushesIntoTree(ProcEntity& entity)
-{
-    rMessage() << "----- FilterBrushesIntoTree -----" << std::endl;
+            if (!back.empty())
+            {
+                childLists[1].push_back(BspFacePtr(new BspFace));
 
-    _numUniqueBrushes = 0;
-    _numClusters = 0;
+                childLists[1].back()->w = back;
+                childLists[1].back()->planenum = (*split)->planenum;
+            }
 
-    for (ProcEntity::Primitives::const_iterator prim = entity.primitives.begin(); prim != entity.primitives.end(); ++prim)
+            split->reset();
+        }
+        else if (side == SIDE_FRONT)
+        {
+            childLists[0].push_back(*split);
+        }
+        else if ( side == SIDE_BACK )
+        {
+            childLists[1].push_back(*split);
+        }
+    }
+
+    // recursively process children
+    for (std::size_t i = 0; i < 2; ++i)
     {
-        const ProcBrushPtr& brush = prim->brush;
+        node->children[i].reset(new BspTreeNode);
+        node->children[i]->parent = node.get();
+        node->children[i]->bounds = node->bounds;
+    }
 
-        if (!brush) continue;
-        
-        _numUniqueBrushes++;
+    // split the bounds if we have a nice axial plane
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        if (fabs(plane.normal()[i] - 1.0f) < 0.001f)
+        {
+            // greebo: calculate the new origin and extents, if we set the children[0].min's and children[1].max's components to dist
+            float distHalf = plane.dist() * 0.5f;
+            float base = 0.5f * (node->children[0]->bounds.origin[i] + node->children[0]->bounds.extents[i]);
+            
+            node->children[0]->bounds.origin[i] = base + distHalf;
+            node->children[0]->bounds.extents[i] = base - distHalf;
 
-        // Copy the brush
-        ProcBrushPtr newBrush(new ProcBrush(*brush));
+            base = 0.5f * (node->children[1]->bounds.extents[i] - node->children[1]->bounds.origin[i]);
 
-        _numClusters += filterBrushIntoTreeRecursively(newBrush, entity.tree.head);
+            node->children[1]->bounds.origin[i] = distHalf - base;
+            node->children[1]->bounds.extents[i] = distHalf + base;
+            break;
+        }
     }
 
-    rMessage() << (boost::format("%5i total brushes") % _numUniqueBrushes).str() << std::endl;
-    rMessage() << (boost::format("%5i cluster references") % _numClusters).str() << std::endl;
+    if (_options.splitHeuristic == DmapOptions::SPLIT_SURFACE_AREA &&
+        childLists[0].size() + childLists[1].size() >= SAH_PARALLEL_FACE_THRESHOLD)
+    {
+        // the subtrees are independent, build the front one as a separate task
+        util::TaskGroup group(*_threadPool);
+
+        group.run([&]() { buildFaceTreeRecursively(node->children[0], childLists[0], tree); });
+        buildFaceTreeRecursively(node->children[1], childLists[1], tree);
+
+        group.wait();
+    }
+    else
+    {
+        for (std::size_t i = 0; i < 2; ++i)
+        {
+            buildFaceTreeRecursively(node->children[i], childLists[i], tree);
+        }
+    }
+
+    // Cleanup
+    faces.clear();
 }
 
-#if 1 // Debug helpers
-inline std::string printPortals(const BspTreeNodePtr& node)
+void ProcCompiler::faceBsp(ProcEntity& entity)
 {
-    if (!node->portals) return "-";
+    rMessage() << "--- FaceBSP: " << _bspFaces.size() << " faces ---" << std::endl;
 
-    std::string rv;
-    std::size_t s;
-    std::size_t count = 0;
+    entity.tree.bounds = AABB();
 
-    for (ProcPortalPtr p = node->portals; p; p = p->next[s])
+    // Accumulate bounds
+    for (BspFaces::const_iterator f = _bspFaces.begin(); f != _bspFaces.end(); ++f)
     {
-        if (p->nodes[0] == node)
-        {
-            s = 0;
-        }
-        else
+        for (std::size_t i = 0; i < (*f)->w.size(); ++i)
         {
-            s = 1;
+            entity.tree.bounds.includePoint((*f)->w[i].vertex);
         }
+    }
 
-        count++;
-
-        rv += (!rv.empty()) ? ", " : "";
-        rv += string::to_string(p->portalId);
+    // Allocate the head node and use the total bounds
+    entity.tree.head.reset(new BspTreeNode);
+    entity.tree.head->bounds = entity.tree.bounds;
 
-        rv += (s == 0) ? " (f)" : " (b)";
+    if (_options.splitHeuristic == DmapOptions::SPLIT_SURFACE_AREA)
+    {
+        // No planes must be inserted while the subtrees are built in parallel,
+        // otherwise the plane numbering would depend on the task scheduling
+        insertBlockSplitPlanes(entity.tree.bounds);
     }
 
-    rv += " [count: " + string::to_string(count) + "]";
+    buildFaceTreeRecursively(entity.tree.head, _bspFaces, entity.tree);
 
-    return rv;
-}
+    rMessage() << (boost::format("%5i leafs") % entity.tree.numFaceLeafs.load()).str() << std::endl;
 
-inline void printBrushCount(const BspTreeNodePtr& node, std::size_t level)
-{
-    for (std::size_t i = 0; i < level; ++i) rMessage() << " ";
-    rMessage() << level << ": node " << node->nodeId << " has " << node->brushlist.size() << " brushes." << std::endl;
+    //common->Printf( "%5.1f seconds faceBsp\n", ( end - start ) / 1000.0 );
 
-    for (std::size_t i = 0; i < level; ++i) rMessage() << " ";
-    rMessage() << level << ": node " << node->nodeId << " has portals: " << printPortals(node) << std::endl;
+    /*rMessage() << ("After Face BSP\n");
 
-    if (node->children[0])
-    {
-        printBrushCount(node->children[0], level+1);
-    }
+    std::size_t planes = _planes->size();
 
-    if (node->children[1])
+    for (std::size_t i = 0; i < planes; ++i)
     {
-        printBrushCount(node->children[1], level+1);
-    }
+        const Plane3& plane = _planes->getPlane(i);
+        rMessage() << (boost::format("Plane %d: (%f %f %f %f)\n") % i % plane.normal().x() % plane.normal().y() % plane.normal().z() % plane.dist());
+    }*/
 }
-#endif
 
-void ProcCompiler::floodPortalsRecursively(const BspTreeNodePtr& node, int dist)
+void ProcCompiler::addPortalToNodes(const ProcPortalPtr& portal, const BspTreeNodePtr& front, const BspTreeNodePtr& back)
 {
-    if (node->occupied)
-    {
-        return;
-    }
-
-    if (node->opaque)
+    if (portal->nodes[0] || portal->nodes[1])
     {
+        rError() << "AddPortalToNode: already included" << std::endl;
         return;
     }
 
-    _numFloodedLeafs++;
-    node->occupied = dist;
+    //rMessage() << (boost::format("Adding portal %d to node front = %d and back = %d") % portal->portalId % front->nodeId % back->nodeId) << std::endl;
 
-    for (ProcPortal* p = node->portals.get(); p != NULL; )
-    {
-        std::size_t s = p->nodes[1] == node ? 0 : 1;
+    portal->nodes[0] = front;
+    portal->nodes[1] = back;
 
-        floodPortalsRecursively(p->nodes[s], dist + 1);
+    // Add the given portal to the front and back node
+    portal->next[0] = front->portals;
+    front->portals = portal;
 
-        p = p->next[1-s].get();
-    }
+    portal->next[1] = back->portals;
+    back->portals = portal;
 }
 
-bool ProcCompiler::placeOccupant(const BspTreeNodePtr& node, const Vector3& origin, const ProcEntityPtr& entity)
+void ProcCompiler::removePortalFromNode(const ProcPortalPtr& portal, const BspTreeNodePtr& node)
 {
-    assert(node);
-
-    // find the leaf to start in
-    BspTreeNodePtr nodeIter = node;
+    ProcPortalPtr* portalRef = &node->portals;
 
-    while (nodeIter->planenum != PLANENUM_LEAF)
+    //rMessage() << (boost::format("Removing portal %d from node %d") % portal->portalId % node->nodeId) << std::endl;
+    
+    // remove reference to the current portal
+    while (true)
     {
-        const Plane3& plane = _procFile->planes.getPlane(nodeIter->planenum);
+        ProcPortalPtr& test = *portalRef;
 
-        float d = plane.distanceToPoint(origin);
+        if (!test)
+        {
+            rError() << "RemovePortalFromNode: portal not bounding leaf" << std::endl;
+            return;
+        }
 
-        if (d >= 0.0f)
+        if (test == portal)
         {
-            nodeIter = nodeIter->children[0];
+            break; // found
+        }
+
+        if (test->nodes[0] == node)
+        {
+            portalRef = &(test->next[0]);
+        }
+        else if (test->nodes[1] == node)
+        {
+            portalRef = &(test->next[1]);
         }
         else
         {
-            nodeIter = nodeIter->children[1];
+            rError() << "removePortalFromNode: portal not in leaf" << std::endl; 
+            return;
         }
-
-        assert(nodeIter);
     }
-
-    if (nodeIter->opaque)
+    
+    if (portal->nodes[0] == node)
     {
-        return false;
+        *portalRef = portal->next[0];
+        portal->nodes[0].reset();
+    } 
+    else if (portal->nodes[1] == node)
+    {
+        *portalRef = portal->next[1];   
+        portal->nodes[1].reset();
     }
-
-    nodeIter->occupant = entity;
-
-    floodPortalsRecursively(nodeIter, 1);
-
-    return true;
+    else
+    {
+        rError() << "removePortalFromNode: mislinked" << std::endl;
+    }   
 }
 
-bool ProcCompiler::floodEntities(BspTree& tree)
+void ProcCompiler::makeHeadNodePortals(BspTree& tree)
 {
-    const BspTreeNodePtr& headnode = tree.head;
+    tree.outside->planenum = PLANENUM_LEAF;
+    tree.outside->nodeId = 9999;
+    tree.outside->brushlist.clear();
+    tree.outside->portals.reset();
+    tree.outside->opaque = false;
 
-    rMessage() << "--- FloodEntities ---" << std::endl;
+    BspTreeNodePtr& node = tree.head;
 
-    bool inside = false;
-    tree.outside->occupied = 0;
-
-    _numFloodedLeafs = 0;
-    bool errorShown = false;
-
-    for (std::size_t i = 1; i < _procFile->entities.size(); ++i)
+    // if no nodes, don't go any farther
+    if (node->planenum == PLANENUM_LEAF)
     {
-        Entity& mapEnt = _procFile->entities[i]->mapEntity->getEntity();
-        
-        std::string originStr = mapEnt.getKeyValue("origin");
+        return;
+    }
 
-        if (originStr.empty())
-        {
-            continue;
-        }
+    AABB bounds = tree.bounds;
 
-        Vector3 origin = string::convert<Vector3>(originStr);
+    // pad with some space so there will never be null volume leafs
+    static const float SIDESPACE = 8;
+    bounds.extendBy(Vector3(SIDESPACE, SIDESPACE, SIDESPACE));
 
-        // any entity can have "noFlood" set to skip it
-        if (!mapEnt.getKeyValue("noFlood").empty())
-        {
-            continue;
-        }
+    // greebo: Six planes/portals to separate the whole tree from the "outside"
+    // Each portal has the head node as front and the outside as back node
+    ProcPortalPtr portals[6];
+    Plane3 planes[6];
 
-        std::string className = mapEnt.getKeyValue("classname");
-        
-        if (className == "light")
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        for (std::size_t j = 0; j < 2 ; ++j)
         {
-            // don't place lights that have a light_start field, because they can still
-            // be valid if their origin is outside the world
-            if (!mapEnt.getKeyValue("light_start").empty())
-            {
-                continue;
-            }
+            std::size_t n = j*3 + i;
 
-            // don't place fog lights, because they often
-            // have origins outside the light
-            std::string texture = mapEnt.getKeyValue("texture");
+            portals[n].reset(new ProcPortal);
 
-            if (!texture.empty())
+            _numActivePortals++;
+            if (_numActivePortals > _numPeakPortals)
             {
-                MaterialPtr mat = GlobalMaterialManager().getMaterialForName(texture);
+                _numPeakPortals = _numActivePortals;
+            }
+    
+            Plane3& pl = planes[n];
+            pl = Plane3(0,0,0,0);
 
-                if (mat->isFogLight())
-                {
-                    continue;
-                }
+            if (j) // j == 1
+            {
+                pl.normal()[i] = -1;
+                pl.dist() = -(bounds.origin + bounds.extents)[i];
+            }
+            else // j == 0
+            {
+                pl.normal()[i] = 1;
+                pl.dist() = (bounds.origin - bounds.extents)[i];
             }
-        }
 
-        if (placeOccupant(headnode, origin, _procFile->entities[i]))
-        {
-            inside = true;
+            portals[n]->plane = pl;
+            portals[n]->winding.setFromPlane(pl);
+            
+            addPortalToNodes(portals[n], node, tree.outside);
         }
+    }
 
-        if (tree.outside->occupied && !errorShown)
+    // clip the (near-infinitely large) windings by all the other planes
+    for (std::size_t i = 0; i < 6; ++i)
+    {
+        for (std::size_t j = 0; j < 6; ++j)
         {
-            errorShown = true;
-            rError() << "Leak on entity #" << i << std::endl;
-            rError() << "Entity classname was " << mapEnt.getKeyValue("classname") << std::endl;
-            rError() << "Entity name was " << mapEnt.getKeyValue("name") << std::endl;
-            rError() << "Entity origin is " 
-                                << string::convert<Vector3>(mapEnt.getKeyValue("origin"))
-                                << std::endl;
+            if (j == i) continue;
+
+            portals[i]->winding.clip(planes[j], ON_EPSILON);
         }
     }
+}
 
-    rMessage() << (boost::format("%5i flooded leafs") % _numFloodedLeafs).str() << std::endl;
+void ProcCompiler::calculateNodeBounds(const BspTreeNodePtr& node)
+{
+    // calc mins/maxs for both leafs and nodes
+    node->bounds = AABB();
+    std::size_t s = 0;
 
-    if (!inside)
-    {
-        rMessage() << "no entities in open -- no filling" << std::endl;
-    }
-    else if (tree.outside->occupied > 0)
+    // Use raw pointers to avoid constant shared_ptr assigments
+    for (ProcPortal* p = node->portals.get(); p != NULL; p = p->next[s].get())
     {
-        rMessage() << "entity reached from outside -- no filling" << std::endl;
-    }
+        s = (p->nodes[1] == node) ? 1 : 0;
 
-    return inside && tree.outside->occupied == 0;
+        for (std::size_t i = 0; i < p->winding.size(); ++i)
+        {
+            node->bounds.includePoint(p->winding[i].vertex);
+        }
+    }
 }
 
-void ProcCompiler::fillOutsideRecursively(const BspTreeNodePtr& node)
+ProcWinding ProcCompiler::getBaseWindingForNode(const BspTreeNodePtr& node)
 {
-    if (node->planenum != PLANENUM_LEAF)
-    {
-        fillOutsideRecursively(node->children[0]);
-        fillOutsideRecursively(node->children[1]);
-        return;
-    }
+    ProcWinding winding(_planes->getPlane(node->planenum));
 
-    // anything not reachable by an entity
-    // can be filled away
-    if (!node->occupied)
+    // clip by all the parents
+    BspTreeNode* nodeRaw = node.get(); // FIXME
+    for (BspTreeNode* n = node->parent; n != NULL && !winding.empty(); )
     {
-        if (!node->opaque)
+        const Plane3& plane = _planes->getPlane(n->planenum);
+        static const float BASE_WINDING_EPSILON = 0.001f;
+
+        if (n->children[0].get() == nodeRaw)
         {
-            _numOutsideLeafs++;
-            node->opaque = true;
+            // take front
+            winding.clip(plane, BASE_WINDING_EPSILON);
         } 
         else
         {
-            _numSolidLeafs++;
+            // take back
+            winding.clip(-plane, BASE_WINDING_EPSILON);
         }
-    }
-    else
-    {
-        _numInsideLeafs++;
-    }
-}
-
-void ProcCompiler::fillOutside(const ProcEntity& entity)
-{
-    _numOutsideLeafs = 0;
-    _numInsideLeafs = 0;
-    _numSolidLeafs = 0;
-
-    rMessage() << "--- FillOutside ---" << std::endl;
 
-    fillOutsideRecursively(entity.tree.head);
+        nodeRaw = n;
+        n = n->parent;
+    }
 
-    rMessage() << (boost::format("%5i solid leafs") % _numSolidLeafs).str() << std::endl;
-    rMessage() << (boost::format("%5i leafs filled") % _numOutsideLeafs).str() << std::endl;
-    rMessage() << (boost::format("%5i inside leafs") % _numInsideLeafs).str() << std::endl;
+    return winding;
 }
 
-void ProcCompiler::clipSideByTreeRecursively(ProcWinding& winding, ProcFace& side, const BspTreeNodePtr& node)
+void ProcCompiler::makeNodePortal(const BspTreeNodePtr& node)
 {
-    if (winding.empty()) return;
+    ProcWinding w = getBaseWindingForNode(node);
 
-    if (node->planenum != PLANENUM_LEAF)
+    std::size_t side;
+
+    // clip the portal by all the other portals in the node
+    for (ProcPortal* p = node->portals.get(); p != NULL && !w.empty(); p = p->next[side].get())
     {
-        if (side.planenum == node->planenum)
-        {
-            clipSideByTreeRecursively(winding, side, node->children[0]);
-            return;
-        }
+        Plane3 plane;
 
-        if (side.planenum == (node->planenum ^ 1))
+        if (p->nodes[0] == node)
         {
-            clipSideByTreeRecursively(winding, side, node->children[1]);
-            return;
+            side = 0;
+            plane = p->plane;
         }
-
-        ProcWinding front;
-        ProcWinding back;
-        winding.split(_procFile->planes.getPlane(node->planenum), ON_EPSILON, front, back);
-        
-        clipSideByTreeRecursively(front, side, node->children[0]);
-        clipSideByTreeRecursively(back, side, node->children[1]);
-        return;
-    }
-
-    // if opaque leaf, don't add
-    if (!node->opaque)
-    {
-        if (side.visibleHull.empty())
+        else if (p->nodes[1] == node)
         {
-            side.visibleHull.swap(winding);
+            side = 1;
+            plane = -p->plane;
         }
         else
         {
-            side.visibleHull.addToConvexHull(winding, _procFile->planes.getPlane(side.planenum).normal());
+            rError() << "makeNodePortal: mislinked portal" << std::endl;
+            side = 0;   // quiet a compiler warning
+            return;
         }
-    }
-}
 
-void ProcCompiler::clipSidesByTree(ProcEntity& entity)
-{
-    rMessage() << "----- ClipSidesByTree -----" << std::endl;
+        w.clip(plane, CLIP_EPSILON);
+    }
 
-    for (ProcEntity::Primitives::const_iterator prim = entity.primitives.begin(); prim != entity.primitives.end(); ++prim)
+    if (w.empty())
     {
-        const ProcBrushPtr& brush = prim->brush;
-
-        if (!brush) continue;
-
-        for (std::size_t i = 0; i < brush->sides.size(); ++i)
-        {
-            ProcFace& side = brush->sides[i];
-
-            if (side.winding.empty()) continue;
-            
-            ProcWinding winding(side.winding); // copy
-            
-            side.visibleHull.clear();
-
-            clipSideByTreeRecursively(winding, side, entity.tree.head);
-
-            // FIXME: Implement noClipSide option?
-        }
+        return;
     }
-}
 
-void ProcCompiler::clearAreasRecursively(const BspTreeNodePtr& node)
-{
-    if (node->planenum != PLANENUM_LEAF)
+    if (w.isTiny())
     {
-        clearAreasRecursively(node->children[0]);
-        clearAreasRecursively(node->children[1]);
+        _numTinyPortals++;
+        w.clear();
         return;
     }
+    
+    ProcPortalPtr newPortal(new ProcPortal);
 
-    node->area = -1;
+    newPortal->plane = _planes->getPlane(node->planenum);
+    newPortal->onnode = node;
+    newPortal->winding = w;
+
+    addPortalToNodes(newPortal, node->children[0], node->children[1]);
 }
 
-bool ProcCompiler::portalIsPassable(const ProcPortal& portal)
+void ProcCompiler::splitNodePortals(const BspTreeNodePtr& node)
 {
-    if (!portal.onnode)
-    {
-        return false;   // to global outsideleaf
-    }
-
-    if (portal.nodes[0]->planenum != PLANENUM_LEAF || portal.nodes[1]->planenum != PLANENUM_LEAF)
-    {
-        rError() << "ProcCompiler::portalIsPassable: not a leaf" << std::endl;
-        return false;
-    }
+    const Plane3& plane = _planes->getPlane(node->planenum);
 
-    if (!portal.nodes[0]->opaque && !portal.nodes[1]->opaque )
-    {
-        return true;
-    }
+    const BspTreeNodePtr& front = node->children[0];
+    const BspTreeNodePtr& back = node->children[1];
 
-    return false;
-}
+    //rMessage() << "-- Split node portals on node " << node->nodeId << std::endl;
 
-ProcFace* ProcCompiler::findSideForPortal(const ProcPortalPtr& portal)
-{
-    // scan both bordering nodes brush lists for a portal brush
-    // that shares the plane
-    for (std::size_t i = 0; i < 2; ++i)
+    ProcPortalPtr nextPortal;
+
+    for (ProcPortalPtr portal = node->portals; portal; portal = nextPortal)
     {
-        BspTreeNodePtr node = portal->nodes[i];
+        std::size_t side;
 
-        for (BspTreeNode::Brushes::const_iterator b = node->brushlist.begin(); b != node->brushlist.end(); ++b)
+        if (portal->nodes[0] == node)
         {
-            ProcBrush& brush = **b;
-
-            if (!(brush.contents & Material::SURF_AREAPORTAL))
-            {
-                continue;
-            }
-
-            ProcBrushPtr orig = brush.original.lock();
-
-            assert(orig);
+            side = 0;
+        }
+        else if (portal->nodes[1] == node)
+        {
+            side = 1;
+        }
+        else
+        {
+            rError() << "splitNodePortals: mislinked portal" << std::endl;
+            side = 0;   // quiet a compiler warning
+        }
 
-            for (std::size_t j = 0 ; j < orig->sides.size(); ++j)
-            {
-                ProcFace& s = orig->sides[j];
+        nextPortal = portal->next[side];
 
-                if (s.visibleHull.empty())
-                {
-                    continue;
-                }
+        // Remember the other node before removing the portal from them
+        BspTreeNodePtr otherNode = portal->nodes[!side];
 
-                if (!(s.material->getSurfaceFlags() & Material::SURF_AREAPORTAL))
-                {
-                    continue;
-                }
+        removePortalFromNode(portal, portal->nodes[0]);
+        removePortalFromNode(portal, portal->nodes[1]);
 
-                if ((s.planenum & ~1) != (portal->onnode->planenum & ~1))
-                {
-                    continue;
-                }
+        // cut the portal into two portals, one on each side of the cut plane
+        ProcWinding frontwinding;
+        ProcWinding backwinding;
+        portal->winding.split(plane, SPLIT_WINDING_EPSILON, frontwinding, backwinding);
 
-                // remove the visible hull from any other portal sides of this portal brush
-                for (std::size_t k = 0; k < orig->sides.size(); ++k)
-                {
-                    if (k == j)
-                    {
-                        continue;
-                    }
+        if (!frontwinding.empty() && frontwinding.isTiny())
+        {
+            //rMessage() << " Discarding tiny portal " << portal->portalId << std::endl;
 
-                    ProcFace& s2 = orig->sides[k];
+            frontwinding.clear();
+            _numTinyPortals++;
+        }
 
-                    if (s2.visibleHull.empty())
-                    {
-                        continue;
-                    }
+        if (!backwinding.empty() && backwinding.isTiny())
+        {
+            //rMessage() << " Discarding portal " << portal->portalId << std::endl;
 
-                    if (!(s2.material->getSurfaceFlags() & Material::SURF_AREAPORTAL))
-                    {
-                        continue;
-                    }
+            backwinding.clear();
+            _numTinyPortals++;
+        }
 
-                    Vector3 center = s2.visibleHull.getCenter();
+        if (frontwinding.empty() && backwinding.empty())
+        {   
+            continue; // tiny windings on both sides
+        }
 
-                    rWarning() << "brush has multiple area portal sides at " << center << std::endl;
+        if (frontwinding.empty())
+        {
+            //rMessage() << " No front winding " << portal->portalId << std::endl;
 
-                    s2.visibleHull.clear();
-                }
+            backwinding.clear();
 
-                return &s;
+            if (side == 0)
+            {
+                addPortalToNodes(portal, back, otherNode);
+            }
+            else
+            {
+                addPortalToNodes(portal, otherNode, back);
             }
+
+            continue;
         }
-    }
 
-    return NULL;
-}
+        if (backwinding.empty())
+        {
+            //rMessage() << " No back winding " << portal->portalId << std::endl;
 
-void ProcCompiler::floodAreasRecursively(const BspTreeNodePtr& node)
-{
-    if (node->area != -1)
-    {
-        return;     // already got it
-    }
+            frontwinding.clear();
 
-    if (node->opaque)
-    {
-        return;
-    }
+            if (side == 0)
+            {
+                addPortalToNodes(portal, front, otherNode);
+            }
+            else
+            {
+                addPortalToNodes(portal, otherNode, front);
+            }
 
-    _numAreaFloods++;
-    node->area = _numAreas;
+            continue;
+        }
 
-    std::size_t s = 0;
-    for (ProcPortalPtr p = node->portals; p; p = p->next[s])
-    {
-        s = (p->nodes[1] == node);
-        const BspTreeNodePtr& other = p->nodes[1-s];
+        //rMessage() << " Splitting portal " << portal->portalId << std::endl;
+        
+        // the winding is split
+        ProcPortalPtr newPortal(new ProcPortal(*portal)); // copy-construct
+        newPortal->winding = backwinding;
+        
+        portal->winding = frontwinding;
 
-        if (!portalIsPassable(*p))
+        if (side == 0)
         {
-            continue;
+            addPortalToNodes(portal, front, otherNode);
+            addPortalToNodes(newPortal, back, otherNode);
         }
-
-        // can't flood through an area portal
-        if (findSideForPortal(p))
+        else
         {
-            continue;
+            addPortalToNodes(portal, otherNode, front);
+            addPortalToNodes(newPortal, otherNode, back);
         }
-
-        floodAreasRecursively(other);
     }
+
+    node->portals.reset();
 }
 
-void ProcCompiler::findAreasRecursively(const BspTreeNodePtr& node)
+void ProcCompiler::makeTreePortalsRecursively(const BspTreeNodePtr& node)
 {
-    if (node->planenum != PLANENUM_LEAF)
+    calculateNodeBounds(node);
+
+    Vector3 minbounds = node->bounds.origin - node->bounds.extents;
+    Vector3 maxBounds = node->bounds.origin + node->bounds.extents;
+
+    if (node->bounds.extents.getLengthSquared() <= 0)
     {
-        findAreasRecursively(node->children[0]);
-        findAreasRecursively(node->children[1]);
-        return;
+        rWarning() << "node without a volume" << std::endl;
     }
 
-    if (node->opaque)
+    Vector3 boundsMin = node->bounds.origin - node->bounds.extents;
+    Vector3 boundsMax = node->bounds.origin + node->bounds.extents;
+
+    for (std::size_t i = 0; i < 3; ++i)
     {
-        return;
+        if (boundsMin[i] < MIN_WORLD_COORD || boundsMax[i] > MAX_WORLD_COORD )
+        {
+            rWarning() << "node with unbounded volume" << std::endl;
+            break;
+        }
     }
 
-    if (node->area != -1)
+    if (node->planenum == PLANENUM_LEAF)
     {
-        return;     // already got it
+        return;
     }
 
-    _numAreaFloods = 0;
-    floodAreasRecursively(node);
-
-    rMessage() << (boost::format("Area %i has %i leafs") % _numAreas % _numAreaFloods) << std::endl;
+    makeNodePortal(node);
+    splitNodePortals(node);
 
-    _numAreas++;
+    makeTreePortalsRecursively(node->children[0]);
+    makeTreePortalsRecursively(node->children[1]);
 }
 
-void ProcCompiler::checkAreasRecursively(const BspTreeNodePtr& node)
+void ProcCompiler::makeTreePortals(BspTree& tree)
 {
-    if (node->planenum != PLANENUM_LEAF)
-    {
-        checkAreasRecursively(node->children[0]);
-        checkAreasRecursively(node->children[1]);
-        return;
-    }
+    rMessage() << "----- MakeTreePortals -----" << std::endl;
 
-    if (!node->opaque && node->area < 0)
-    {
-        rError() << "ProcCompiler::checkAreasRecursively: area = %i" << node->area << std::endl;
-    }
+    makeHeadNodePortals(tree);
+
+    makeTreePortalsRecursively(tree.head);
 }
 
-void ProcCompiler::findInterAreaPortalsRecursively(const BspTreeNodePtr& node)
+float ProcCompiler::calculateBrushVolume(const ProcBrushPtr& brush) 
 {
-    if (node->planenum != PLANENUM_LEAF)
+    if (!brush) return 0;
+
+    ProcWinding* w = NULL;
+    std::size_t i = 0;
+
+    // grab the first valid point as the corner
+    for (i = 0; i < brush->sides.size(); ++i)
     {
-        findInterAreaPortalsRecursively(node->children[0]);
-        findInterAreaPortalsRecursively(node->children[1]);
-        return;
+        w = &brush->sides[i].winding;
+
+        if (!w->empty())
+            break;
     }
 
-    if (node->opaque)
+    if (w->empty())
     {
-        return;
+        return 0;
     }
 
-    std::size_t s = 0;
-    for (ProcPortalPtr p = node->portals; p; p = p->next[s])
-    {
-        s = (p->nodes[1] == node) ? 1 : 0;
-        const BspTreeNodePtr& other = p->nodes[1-s];
+    Vector3 corner = (*w)[0].vertex;
 
-        if (other->opaque)
-        {
-            continue;
-        }
-
-        // only report areas going from lower number to higher number
-        // so we don't report the portal twice
-        if (other->area <= node->area)
-        {
-            continue;
-        }
-
-        ProcFace* side = findSideForPortal(p);
-
-        if (side == NULL)
-        {
-            rWarning() << "findSideForPortal failed at " << p->winding.getCenter() << std::endl;
-            continue;
-        }
+    // make tetrahedrons to all other faces
+    float volume = 0;
 
-        const ProcWinding& w = side->visibleHull;
+    for (; i < brush->sides.size(); ++i)
+    {
+        const ProcWinding& winding = brush->sides[i].winding;
 
-        if (w.empty())
+        if (winding.empty())
         {
             continue;
         }
 
-        // see if we have created this portal before
-        std::size_t i = 0;
-
-        for (i = 0; i < _procFile->interAreaPortals.size(); ++i)
-        {
-            ProcInterAreaPortal& iap = _procFile->interAreaPortals[i];
-
-            if (side == iap.side &&
-                ((p->nodes[0]->area == iap.area0 && p->nodes[1]->area == iap.area1) || 
-                 (p->nodes[1]->area == iap.area0 && p->nodes[0]->area == iap.area1))) 
-            {
-                break;
-            }
-        }
-
-        if (i != _procFile->interAreaPortals.size())
-        {
-            continue;   // already emitted
-        }
-
-        _procFile->interAreaPortals.push_back(ProcInterAreaPortal());
-        ProcInterAreaPortal& iap = _procFile->interAreaPortals.back();
-
-        if (side->planenum == p->onnode->planenum)
-        {
-            iap.area0 = p->nodes[0]->area;
-            iap.area1 = p->nodes[1]->area;
-        }
-        else
-        {
-            iap.area0 = p->nodes[1]->area;
-            iap.area1 = p->nodes[0]->area;
-        }
+        const Plane3& plane = _planes->getPlane(brush->sides[i].planenum);
 
-        iap.side = side;
+        float d = -plane.distanceToPoint(corner);
+        float area = winding.getArea();
+        volume += d * area;
     }
-}
-
-void ProcCompiler::floodAreas(ProcEntity& entity)
-{
-    rMessage() << "--- FloodAreas ---" << std::endl;
-
-    // set all areas to -1
-    clearAreasRecursively(entity.tree.head);
-
-    // flood fill from non-opaque areas
-    _numAreas = 0;
-
-    findAreasRecursively(entity.tree.head);
-
-    rMessage() << (boost::format("%5i areas") % _numAreas) << std::endl;
-    entity.numAreas = _numAreas;
-
-    // make sure we got all of them
-    checkAreasRecursively(entity.tree.head);
 
-    // identify all portals between areas if this is the world
-    if (&entity == _procFile->entities.begin()->get())
-    {
-        _procFile->interAreaPortals.clear();
-        findInterAreaPortalsRecursively(entity.tree.head);
-
-        rMessage() << (boost::format("%5i interarea portals") % _procFile->interAreaPortals.size()) << std::endl;
-    }
+    return volume / 3;
 }
 
-ProcTris ProcCompiler::triangleListForSide(const ProcFace& side, const ProcWinding& winding)
+void ProcCompiler::splitBrush(const ProcBrushPtr& brush, std::size_t planenum, ProcBrushPtr& front, ProcBrushPtr& back)
 {
-    const MaterialPtr& si = side.material;
-
-    // skip any generated faces
-    if (!si) return ProcTris();
-    
-    // don't create faces for non-visible sides
-    if (!si->surfaceCastsShadow() && !si->isDrawn())
-    {
-        return ProcTris();
-    }
+    const Plane3& plane = _planes->getPlane(planenum);
 
-#if 1
-    // triangle fan using only the outer verts
-    // this gives the minimum triangle count,
-    // but may have some very distended triangles
-    ProcTris triList;
+    // check all points
+    float d_front = 0;
+    float d_back = 0;
 
-    for (std::size_t i = 2; i < winding.size(); ++i)
+    for (std::size_t i = 0; i < brush->sides.size(); ++i)
     {
-        triList.push_front(ProcTri());
-        ProcTri& tri = triList.front();
+        ProcWinding& w = brush->sides[i].winding;
 
-        tri.material = si;  
-        
-        for (std::size_t j = 0; j < 3; ++j)
+        for (std::size_t j = 0; j < w.size(); ++j)
         {
-            const Vector3* vec;
-
-            if (j == 0)
-            {
-                vec = &(winding[0].vertex);
-            } 
-            else if ( j == 1 )
-            {
-                vec = &(winding[i-1].vertex);
-            } 
-            else
-            {
-                vec = &(winding[i].vertex);
-            }
+            float d = plane.distanceToPoint(w[j].vertex);
 
-            ArbitraryMeshVertex& dv = tri.v[j];
-#if 0
-            // round the xyz to a given precision
-            for ( k = 0 ; k < 3 ; k++ )
+            if (d > 0 && d > d_front)
             {
-                dv->xyz[k] = SNAP_INT_TO_FLOAT * floor( vec[k] * SNAP_FLOAT_TO_INT + 0.5 );
+                d_front = d;
             }
-#else
-            dv.vertex = *vec;
-#endif
-                
-            // calculate texture s/t from brush primitive texture matrix
-            dv.texcoord[0] = dv.vertex.dot(side.texVec[0].getVector3()) + side.texVec[0][3];
-            dv.texcoord[1] = dv.vertex.dot(side.texVec[1].getVector3()) + side.texVec[1][3];
-
-            // copy normal
-            dv.normal = _procFile->planes.getPlane(side.planenum).normal();
 
-            if (dv.normal.getLength() < 0.9f || dv.normal.getLength() > 1.1f)
+            if (d < 0 && d < d_back)
             {
-                rError() << "Bad normal in TriListForSide" << std::endl;
-                return triList;
+                d_back = d;
             }
         }
     }
-#else
-    // triangle fan from central point, more verts and tris, but less distended
-    // I use this when debugging some tjunction problems
-    triList = NULL;
-    for ( i = 0 ; i < w->GetNumPoints() ; i++ ) {
-        idVec3  midPoint;
 
-        tri = AllocTri();
-        tri->material = si; 
-        tri->next = triList;
-        triList = tri;
-
-        for ( j = 0 ; j < 3 ; j++ ) {
-            if ( j == 0 ) {
-                vec = &midPoint;
-                midPoint = w->GetCenter();
-            } else if ( j == 1 ) {
-                vec = &((*w)[i]).ToVec3();
-            } else {
-                vec = &((*w)[(i+1)%w->GetNumPoints()]).ToVec3();
-            }
-
-            dv = tri->v + j;
-
-            VectorCopy( *vec, dv->xyz );
-                
-            // calculate texture s/t from brush primitive texture matrix
-            dv->st[0] = DotProduct( dv->xyz, s->texVec.v[0] ) + s->texVec.v[0][3];
-            dv->st[1] = DotProduct( dv->xyz, s->texVec.v[1] ) + s->texVec.v[1][3];
-
-            // copy normal
-            dv->normal = dmapGlobals.mapPlanes[s->planenum].Normal();
-            if ( dv->normal.Length() < 0.9f || dv->normal.Length() > 1.1f ) {
-                common->Error( "Bad normal in TriListForSide" );
-            }
-        }
+    if (d_front < 0.1f) // PLANESIDE_EPSILON)
+    {   // only on back
+        back.reset(new ProcBrush(*brush)); // copy
+        return;
     }
-#endif
 
-    // set merge groups if needed, to prevent multiple sides from being
-    // merged into a single surface in the case of gui shaders, mirrors, and autosprites
-    if (side.material->isDiscrete())
-    {
-        for (ProcTris::iterator tri = triList.begin(); tri != triList.end(); ++tri)
-        {
-            tri->mergeGroup = &side;
-        }
+    if (d_back > -0.1) // PLANESIDE_EPSILON)
+    {   // only on front
+        front.reset(new ProcBrush(*brush)); // copy
+        return;
     }
 
-    return triList;
-}
-
-std::size_t ProcCompiler::checkWindingInAreasRecursively(const ProcWinding& winding, const BspTreeNodePtr& node)
-{
-    assert(!winding.empty());
+    // create a new winding from the split plane
+    ProcWinding w(plane);
 
-    if (node->planenum != PLANENUM_LEAF)
+    for (std::size_t i = 0; i < brush->sides.size() && !w.empty(); ++i)
     {
-        ProcWinding front;
-        ProcWinding back;
-        winding.split(_procFile->planes.getPlane(node->planenum), ON_EPSILON, front, back);
-
-        std::size_t a1 = front.empty() ? 0 : checkWindingInAreasRecursively(front, node->children[0]);
-        std::size_t a2 = back.empty() ? 0 : checkWindingInAreasRecursively(back, node->children[1]);
-        
-        if (a1 == MULTIAREA_CROSS || a2 == MULTIAREA_CROSS)
-        {
-            return MULTIAREA_CROSS; // different
-        }
+        const Plane3& plane2 = _planes->getPlane(brush->sides[i].planenum ^ 1);
+        w.clip(plane2, 0);
+    }
 
-        if (a1 == -1)
-        {
-            return a2;  // one solid
-        }
+    if (w.empty() || w.isTiny())
+    {
+        // the brush isn't really split
+        int side = brush->mostlyOnSide(plane);
 
-        if (a2 == -1)
+        if (side == PSIDE_FRONT)
         {
-            return a1;  // one solid
+            front.reset(new ProcBrush(*brush));
         }
 
-        if (a1 != a2)
+        if (side == PSIDE_BACK)
         {
-            return MULTIAREA_CROSS; // cross areas
+            back.reset(new ProcBrush(*brush));
         }
 
-        return a1;
-    }
-
-    return node->area;
-}
-
-#define  TEXTURE_OFFSET_EQUAL_EPSILON   0.005f
-#define  TEXTURE_VECTOR_EQUAL_EPSILON   0.001f
-
-void ProcCompiler::addTriListToArea(ProcEntity& entity, const ProcTris& triList, 
-                                    std::size_t planeNum, std::size_t areaNum, 
-                                    Vector4 texVec[2])
-{
-    if (triList.empty())
-    {
         return;
     }
 
-    ProcArea& area = entity.areas[areaNum];
-    ProcArea::OptimizeGroups::iterator group;
-
-    for (group = area.groups.begin(); group != area.groups.end(); ++group)
+    if (w.isHuge())
     {
-        if (group->material == triList.front().material && 
-            group->planeNum == planeNum && 
-            (group->mergeGroup == triList.front().mergeGroup || 
-             group->mergeSurf == triList.front().mergeSurf || 
-             group->mergePatch == triList.front().mergePatch))
-        {
-            // check the texture vectors
-            std::size_t i = 0;
+        rWarning() << "huge winding" << std::endl;
+    }
 
-            for (i = 0; i < 2; ++i)
-            {
-                std::size_t j = 0;
+    ProcWinding midwinding = w;
 
-                for (j = 0; j < 3; ++j)
-                {
-                    if (fabs(texVec[i][j] - group->texVec[i][j]) > TEXTURE_VECTOR_EQUAL_EPSILON)
-                    {
-                        break;
-                    }
-                }
+    // split it for real
 
-                if (j != 3)
-                {
-                    break;
-                }
+    ProcBrushPtr parts[2];
 
-                if (fabs(texVec[i][3] - group->texVec[i][3]) > TEXTURE_OFFSET_EQUAL_EPSILON)
-                {
-                    break;
-                }
-            }
+    for (std::size_t i = 0; i < 2; ++i)
+    {
+        parts[i].reset(new ProcBrush(*brush));
 
-            if (i == 2)
-            {
-                break;  // exact match
-            }
-            /*else
-            {
-                // different texture offsets
-                i = 1;  // just for debugger breakpoint
-            }*/
-        }
+        parts[i]->sides.clear(); // reserve(brush->sides.size() + 1);
+        parts[i]->original = brush->original;
     }
 
-    if (group == area.groups.end())
+    // split all the current windings
+    ProcWinding cw[2];
+
+    for (std::size_t i = 0; i < brush->sides.size(); ++i)
     {
-        //std::size_t oldSize = area.groups.size();
+        ProcFace& side = brush->sides[i];
+        ProcWinding w = side.winding;
 
-        area.groups.push_front(ProcOptimizeGroup());
-        group = area.groups.begin();
+        if (w.empty()) continue;
 
-        //rMessage() << (boost::format("Adding group from plane %d after %d\n") % planeNum % oldSize);
+        w.split(plane, 0 /*PLANESIDE_EPSILON*/, cw[0], cw[1]);
 
-        group->numGroupLights = 0;
-        group->smoothed = false;
-        group->surfaceEmitted = false;
+        for (std::size_t j = 0; j < 2; ++j)
+        {
+            if (cw[j].empty()) continue;
 
-        group->planeNum = planeNum;
-        group->mergeGroup = triList.front().mergeGroup;
-        group->mergeSurf = triList.front().mergeSurf;
-        group->mergePatch = triList.front().mergePatch;
-        group->material = triList.front().material;
-        group->texVec[0] = texVec[0];
-        group->texVec[1] = texVec[1];
+            parts[j]->sides.push_back(side);
+            parts[j]->sides.back().winding.swap(cw[j]);
+        }
     }
 
-    // Append the incoming triangles to the existing ones in the group
-    group->triList.insert(group->triList.end(), triList.begin(), triList.end());
-}
-
-void ProcCompiler::putWindingIntoAreasRecursively(ProcEntity& entity, const ProcWinding& winding, 
-    ProcFace& side, const BspTreeNodePtr& node)
-{
-    if (winding.empty()) return;
+    // see if we have valid polygons on both sides
 
-    if (node->planenum != PLANENUM_LEAF)
+    for (std::size_t i = 0 ; i < 2 ; ++i)
     {
-        if (side.planenum == node->planenum)
+        if (!parts[i]->bound())
         {
-            putWindingIntoAreasRecursively(entity, winding, side, node->children[0]);
-            return;
+            break;
         }
 
-        if (side.planenum == (node->planenum ^ 1))
+        if (parts[i]->sides.size() < 3)
         {
-            putWindingIntoAreasRecursively(entity, winding, side, node->children[1]);
-            return;
+            parts[i].reset();
         }
+    }
 
-        // see if we need to split it
-        // adding the "noFragment" flag to big surfaces like sky boxes
-        // will avoid potentially dicing them up into tons of triangles
-        // that take forever to optimize back together
-        if (/*FIXME !dmapGlobals.fullCarve || */side.material->getSurfaceFlags() & Material::SURF_NOFRAGMENT)
+    if (!(parts[0] && parts[1]))
+    {
+        if (!parts[0] && !parts[1])
         {
-            std::size_t area = checkWindingInAreasRecursively(winding, node);
+            rMessage() << "split removed brush" << std::endl;
+        }
+        else
+        {
+            rMessage() << "split not on both sides" << std::endl;
+        }
 
-            if (area != MULTIAREA_CROSS)
-            {
-                ProcTris tris = triangleListForSide(side, winding);
+        if (parts[0])
+        {
+            parts[0].reset();
+            front.reset(new ProcBrush(*brush)); // copy
+        }
 
-                addTriListToArea(entity, tris, side.planenum, area, side.texVec);
-                return;
-            }
+        if (parts[1])
+        {
+            parts[1].reset();
+            back.reset(new ProcBrush(*brush)); // copy
         }
 
-        ProcWinding front;
-        ProcWinding back;
-        winding.split(_procFile->planes.getPlane(node->planenum), ON_EPSILON, front, back);
+        return;
+    }
 
-        putWindingIntoAreasRecursively(entity, front, side, node->children[0]);
-        putWindingIntoAreasRecursively(entity, back, side, node->children[1]);
+    // add the midwinding to both sides
+    for (std::size_t i = 0; i < 2; ++i)
+    {
+        parts[i]->sides.push_back(ProcFace());
 
-        return;
+        parts[i]->sides.back().planenum = planenum^i^1;
+        
+        if (i==0)
+        {
+            parts[i]->sides.back().winding = midwinding; // copy
+        }
+        else
+        {
+            parts[i]->sides.back().winding.swap(midwinding); // move
+        }
     }
 
-    // if opaque leaf, don't add
-    if (node->area >= 0 && !node->opaque)
     {
-        ProcTris tris = triangleListForSide(side, winding);
-        addTriListToArea(entity, tris, side.planenum, node->area, side.texVec);
+        for (std::size_t i = 0; i < 2; ++i)
+        {
+            float v1 = calculateBrushVolume(parts[i]);
+
+            if (v1 < 1.0f)
+            {
+                parts[i].reset();
+            }
+        }
     }
+
+    front.swap(parts[0]); // assign return values
+    back.swap(parts[1]);
 }
 
-// TODO: Make this a member method of ProcTri
-inline void getTexVecForTri(Vector4 texVec[2], const ProcTri& tri)
+std::size_t ProcCompiler::filterBrushIntoTreeRecursively(const ProcBrushPtr& brush, const BspTreeNodePtr& node)
 {
-    float d0[5];
-    float d1[5];
+    if (!brush)
+    {
+        return 0;
+    }
 
-    const ArbitraryMeshVertex& a = tri.v[0];
-    const ArbitraryMeshVertex& b = tri.v[1];
-    const ArbitraryMeshVertex& c = tri.v[2];
+    // add it to the leaf list
+    if (node->planenum == PLANENUM_LEAF)
+    {
+        node->brushlist.push_back(brush);
 
-    d0[0] = b.vertex[0] - a.vertex[0];
-    d0[1] = b.vertex[1] - a.vertex[1];
-    d0[2] = b.vertex[2] - a.vertex[2];
-    d0[3] = b.texcoord[0] - a.texcoord[0];
-    d0[4] = b.texcoord[1] - a.texcoord[1];
+        // classify the leaf by the structural brush
+        if (brush->opaque)
+        {
+            node->opaque = true;
+        }
 
-    d1[0] = c.vertex[0] - a.vertex[0];
-    d1[1] = c.vertex[1] - a.vertex[1];
-    d1[2] = c.vertex[2] - a.vertex[2];
-    d1[3] = c.texcoord[0] - a.texcoord[0];
-    d1[4] = c.texcoord[1] - a.texcoord[1];
+        return 1;
+    }
 
-    float area = d0[3] * d1[4] - d0[4] * d1[3];
-    float inva = 1.0f / area;
+    // split it by the node plane
+    ProcBrushPtr front;
+    ProcBrushPtr back;
+    splitBrush(brush, node->planenum, front, back);
 
-    Vector3 temp(
-        (d0[0] * d1[4] - d0[4] * d1[0]) * inva,
-        (d0[1] * d1[4] - d0[4] * d1[1]) * inva,
-        (d0[2] * d1[4] - d0[4] * d1[2]) * inva
-    );
+    std::size_t count = 0;
 
-    temp.normalise();
+    count += filterBrushIntoTreeRecursively(front, node->children[0]);
+    count += filterBrushIntoTreeRecursively(back, node->children[1]);
 
-    texVec[0].x() = temp.x();
-    texVec[0].y() = temp.y();
-    texVec[0].z() = temp.z();
+    return count;
+}
 
-    texVec[0][3] = tri.v[0].vertex.dot(texVec[0].getVector3()) - tri.v[0].texcoord[0];
+void ProcCompiler::filterBrushesIntoTree(ProcEntity& entity)
+{
+    rMessage() << "----- FilterBrushesIntoTree -----" << std::endl;
 
-    temp[0] = (d0[3] * d1[0] - d0[0] * d1[3]) * inva;
-    temp[1] = (d0[3] * d1[1] - d0[1] * d1[3]) * inva;
-    temp[2] = (d0[3] * d1[2] - d0[2] * d1[3]) * inva;
+    _numUniqueBrushes = 0;
+    _numClusters = 0;
 
-    temp.normalise();
+    for (ProcEntity::Primitives::const_iterator prim = entity.primitives.begin(); prim != entity.primitives.end(); ++prim)
+    {
+        const ProcBrushPtr& brush = prim->brush;
 
-    texVec[1].x() = temp.x();
-    texVec[1].y() = temp.y();
-    texVec[1].z() = temp.z();
-    texVec[1][3] = tri.v[0].vertex.dot(texVec[0].getVector3()) - tri.v[0].texcoord[1];
-}
+        if (!brush) continue;
+        
+        _numUniqueBrushes++;
 
-// TODO: Make this a member method of ProcTri
-// Regenerate the texcoords and colors on a fragmented tri from the plane equations
-void triVertsFromOriginal(ProcTri& tri, const ProcTri& original)
-{
-    float denom = ProcWinding::getTriangleArea(original.v[0].vertex, original.v[1].vertex, original.v[2].vertex);
+        // Copy the brush
+        ProcBrushPtr newBrush(new ProcBrush(*brush));
 
-    if (denom == 0)
-    {
-        return;     // original was degenerate, so it doesn't matter
+        _numClusters += filterBrushIntoTreeRecursively(newBrush, entity.tree.head);
     }
-    
-    for (std::size_t i = 0; i < 3; ++i)
-    {
-        // find the barycentric coordinates
-        float a = ProcWinding::getTriangleArea(tri.v[i].vertex, original.v[1].vertex, original.v[2].vertex ) / denom;
-        float b = ProcWinding::getTriangleArea(tri.v[i].vertex, original.v[2].vertex, original.v[0].vertex ) / denom;
-        float c = ProcWinding::getTriangleArea(tri.v[i].vertex, original.v[0].vertex, original.v[1].vertex ) / denom;
 
-        // regenerate the interpolated values
-        tri.v[i].texcoord[0] = a * original.v[0].texcoord[0] + b * original.v[1].texcoord[0] + c * original.v[2].texcoord[0];
-        tri.v[i].texcoord[1] = a * original.v[0].texcoord[1] + b * original.v[1].texcoord[1] + c * original.v[2].texcoord[1];
+    rMessage() << (boost::format("%5i total brushes") % _numUniqueBrushes).str() << std::endl;
+    rMessage() << (boost::format("%5i cluster references") % _numClusters).str() << std::endl;
+}
 
-        for (std::size_t j = 0; j < 3; ++j)
+#if 1 // Debug helpers
+inline std::string printPortals(const BspTreeNodePtr& node)
+{
+    if (!node->portals) return "-";
+
+    std::string rv;
+    std::size_t s;
+    std::size_t count = 0;
+
+    for (ProcPortalPtr p = node->portals; p; p = p->next[s])
+    {
+        if (p->nodes[0] == node)
         {
-            tri.v[i].normal[j] = a * original.v[0].normal[j] + b * original.v[1].normal[j] + c * original.v[2].normal[j];
+            s = 0;
+        }
+        else
+        {
+            s = 1;
         }
 
-        tri.v[i].normal.normalise();
+        count++;
+
+        rv += (!rv.empty()) ? ", " : "";
+        rv += string::to_string(p->portalId);
+
+        rv += (s == 0) ? " (f)" : " (b)";
     }
+
+    rv += " [count: " + string::to_string(count) + "]";
+
+    return rv;
 }
 
-inline ProcTris windingToTriList(const ProcWinding& w, const ProcTri& originalTri)
+inline void printBrushCount(const BspTreeNodePtr& node, std::size_t level)
 {
-    assert(!w.empty());
+    for (std::size_t i = 0; i < level; ++i) rMessage() << " ";
+    rMessage() << level << ": node " << node->nodeId << " has " << node->brushlist.size() << " brushes." << std::endl;
 
-    ProcTris triList;
+    for (std::size_t i = 0; i < level; ++i) rMessage() << " ";
+    rMessage() << level << ": node " << node->nodeId << " has portals: " << printPortals(node) << std::endl;
 
-    for (std::size_t i = 2 ; i < w.size(); ++i)
+    if (node->children[0])
     {
-        triList.push_front(originalTri);
-
-        ProcTri& tri = triList.front();
-
-        for (std::size_t j = 0; j < 3; ++j)
-        {
-            if (j == 0)
-            {
-                tri.v[j].vertex = w[0].vertex;
-            }
-            else if (j == 1)
-            {
-                tri.v[j].vertex = w[i-1].vertex;
-            } 
-            else
-            {
-                tri.v[j].vertex = w[i].vertex;
-            }
-        }
+        printBrushCount(node->children[0], level+1);
+    }
 
-        triVertsFromOriginal(tri, originalTri);
+    if (node->children[1])
+    {
+        printBrushCount(node->children[1], level+1);
     }
-
-    return triList;
 }
+#endif
 
-void ProcCompiler::clipTriIntoTreeRecursively(const ProcWinding& winding, const ProcTri& originalTri, 
-                                              ProcEntity& entity, const BspTreeNodePtr& node)
+void ProcCompiler::floodPortalsRecursively(const BspTreeNodePtr& node, int dist)
 {
-    assert(!winding.empty());
-
-    if (node->planenum != PLANENUM_LEAF)
+    if (node->occupied)
     {
-        ProcWinding front;
-        ProcWinding back;
-
-        winding.split(_procFile->planes.getPlane(node->planenum), ON_EPSILON, front, back);
-
-        if (!front.empty())
-        {
-            clipTriIntoTreeRecursively(front, originalTri, entity, node->children[0]);
-        }
-
-        if (!back.empty())
-        {
-            clipTriIntoTreeRecursively(back, originalTri, entity, node->children[1]);
-        }
-
         return;
     }
 
-    // if opaque leaf, don't add
-    if (!node->opaque && node->area != MULTIAREA_CROSS)
+    if (node->opaque)
     {
-        ProcTris list = windingToTriList(winding, originalTri);
+        return;
+    }
 
-        Plane3 plane(originalTri.v[1].vertex, originalTri.v[0].vertex, originalTri.v[2].vertex); // Plane(p1, p0, p2) call convention to match D3
+    _numFloodedLeafs++;
+    node->occupied = dist;
 
-        std::size_t planeNum = _procFile->planes.findOrInsertPlane(plane, EPSILON_NORMAL, EPSILON_DIST);
+    for (ProcPortal* p = node->portals.get(); p != NULL; )
+    {
+        std::size_t s = p->nodes[1] == node ? 0 : 1;
 
-        Vector4 texVec[2];
-        getTexVecForTri(texVec, originalTri);
+        floodPortalsRecursively(p->nodes[s], dist + 1);
 
-        addTriListToArea(entity, list, planeNum, node->area, texVec);
+        p = p->next[1-s].get();
     }
 }
 
-void ProcCompiler::addMapTrisToAreas(const ProcTris& tris, ProcEntity& entity)
+bool ProcCompiler::placeOccupant(const BspTreeNodePtr& node, const Vector3& origin, const ProcEntityPtr& entity)
 {
-    for (ProcTris::const_iterator tri = tris.begin(); tri != tris.end(); ++tri)
+    assert(node);
+
+    // find the leaf to start in
+    BspTreeNodePtr nodeIter = node;
+
+    while (nodeIter->planenum != PLANENUM_LEAF)
     {
-        // skip degenerate triangles from pinched curves
-        if (ProcWinding::getTriangleArea(tri->v[0].vertex, tri->v[1].vertex, tri->v[2].vertex) <= 0)
+        const Plane3& plane = _planes->getPlane(nodeIter->planenum);
+
+        float d = plane.distanceToPoint(origin);
+
+        if (d >= 0.0f)
         {
-            continue;
+            nodeIter = nodeIter->children[0];
         }
-
-        // FIXME: fullCarve can be disabled, is enabled by default
-        if (true/* dmapGlobals.fullCarve*/)
+        else
         {
-            // always fragment into areas
-            ProcWinding w(tri->v[0].vertex, tri->v[1].vertex, tri->v[2].vertex);
-            clipTriIntoTreeRecursively(w, *tri, entity, entity.tree.head);
-            continue;
+            nodeIter = nodeIter->children[1];
         }
 
-        ProcWinding w(tri->v[0].vertex, tri->v[1].vertex, tri->v[2].vertex);
-
-        std::size_t area = checkWindingInAreasRecursively(w, entity.tree.head);
-
-        if (area != MULTIAREA_CROSS)
-        {
-            // put in single area
-            ProcTris newTri(1, *tri); // list with 1 triangle
+        assert(nodeIter);
+    }
 
-            Plane3 plane(tri->v[1].vertex, tri->v[0].vertex, tri->v[2].vertex); // Plane(p1, p0, p2) call convention to match D3
+    if (nodeIter->opaque)
+    {
+        return false;
+    }
 
-            std::size_t planeNum = _procFile->planes.findOrInsertPlane(plane, EPSILON_NORMAL, EPSILON_DIST);
+    nodeIter->occupant = entity;
 
-            Vector4 texVec[2];
-            getTexVecForTri(texVec, newTri.front());
+    floodPortalsRecursively(nodeIter, 1);
 
-            addTriListToArea(entity, newTri, planeNum, area, texVec);
-        } 
-        else
-        {
-            // fragment into areas
-            clipTriIntoTreeRecursively(w, *tri, entity, entity.tree.head);
-        }
-    }
+    return true;
 }
 
-void ProcCompiler::putPrimitivesInAreas(ProcEntity& entity)
+bool ProcCompiler::floodEntities(BspTree& tree)
 {
-    rMessage() << "----- PutPrimitivesInAreas -----" << std::endl;
-
-    // allocate space for surface chains for each area
-    entity.areas.resize(entity.numAreas);
+    const BspTreeNodePtr& headnode = tree.head;
 
-    // for each primitive, clip it to the non-solid leafs
-    // and divide it into different areas
-    std::size_t primCount = 0;
-    for (ProcEntity::Primitives::const_reverse_iterator prim = entity.primitives.rbegin();
-        prim != entity.primitives.rend(); ++prim, ++primCount)
-    {
-        const ProcBrushPtr& brush = prim->brush;
+    rMessage() << "--- FloodEntities ---" << std::endl;
 
-        if (!brush)
-        {
-            //rMessage() << "--- Primitive: " << primCount << " (patch) " << std::endl;
+    bool inside = false;
+    tree.outside->occupied = 0;
 
-            // add curve triangles
-            addMapTrisToAreas(prim->patch, entity);
+    _numFloodedLeafs = 0;
+    bool errorShown = false;
 
-            /*for (std::size_t i = 0; i < _procFile->planes.size(); ++i)
-            {
-                const Plane3& plane = _procFile->planes.getPlane(i);
-                rMessage() << (boost::format("Plane %d: %f %f %f %f") % i % plane.normal().x() % plane.normal().y() % plane.normal().z() % plane.dist()) << std::endl;
-            }*/
-            
-            /*// Print result
-            for (std::size_t a = 0; a < entity.areas.size(); ++a)
-            {
-                rMessage() << " Area " << a << ": ";
+    for (std::size_t i = 1; i < _procFile->entities.size(); ++i)
+    {
+        Entity& mapEnt = _procFile->entities[i]->mapEntity->getEntity();
         
-                rMessage() << entity.areas[a].groups.size() << " groups" << std::endl;
-
-                for (ProcArea::OptimizeGroups::const_iterator g = entity.areas[a].groups.begin(); 
-                    g != entity.areas[a].groups.end(); ++g)
-                {
-                    rMessage() << "  plane " << g->planeNum << ", " <<
-                        g->triList.size() << " tris" << std::endl;
-                }
-            }*/
+        std::string originStr = mapEnt.getKeyValue("origin");
 
+        if (originStr.empty())
+        {
             continue;
         }
 
-        //rMessage() << "--- Primitive: " << primCount << " (brush " << brush->brushnum << ") " << std::endl;
+        Vector3 origin = string::convert<Vector3>(originStr);
 
-        // clip in brush sides
-        for (std::size_t i = 0; i < brush->sides.size(); ++i)
+        // any entity can have "noFlood" set to skip it
+        if (!mapEnt.getKeyValue("noFlood").empty())
         {
-            ProcFace& side = brush->sides[i];
-
-            if (side.visibleHull.empty())
-            {
-                continue;
-            }
-
-            putWindingIntoAreasRecursively(entity, side.visibleHull, side, entity.tree.head);
+            continue;
         }
 
-        // Print result
-        /*for (std::size_t a = 0; a < entity.areas.size(); ++a)
-        {
-            rMessage() << " Area " << a << ": ";
+        std::string className = mapEnt.getKeyValue("classname");
         
-            rMessage() << entity.areas[a].groups.size() << " groups" << std::endl;
-
-            for (ProcArea::OptimizeGroups::const_iterator g = entity.areas[a].groups.begin(); 
-                g != entity.areas[a].groups.end(); ++g)
-            {
-                rMessage() << "  plane " << g->planeNum << ", " <<
-                    g->triList.size() << " tris" << std::endl;
-            }
-        }*/
-    }
-
-    // optionally inline some of the func_static models
-    if (&entity == _procFile->entities[0].get())
-    {
-        IEntityNodePtr worldspawn = _procFile->entities[0]->mapEntity;
-
-        bool inlineAll = worldspawn->getEntity().getKeyValue("inlineAllStatics") == "1";
-
-        for (std::size_t eNum = 1; eNum < _procFile->entities.size(); ++eNum)
+        if (className == "light")
         {
-            ProcEntity& entity = *_procFile->entities[eNum];
-            Entity& mapEnt = entity.mapEntity->getEntity();
-
-            if (mapEnt.getKeyValue("classname") != "func_static")
-            {
-                continue;
-            }
-
-            if (mapEnt.getKeyValue("inline") != "1" && !inlineAll)
-            {
-                continue;
-            }
-
-            std::string modelName = mapEnt.getKeyValue("model");
-
-            if (modelName.empty())
-            {
-                continue;
-            }
-
-            model::IModelPtr model = GlobalModelCache().getModel(modelName);
-            
-            if (model == NULL)
+            // don't place lights that have a light_start field, because they can still
+            // be valid if their origin is outside the world
+            if (!mapEnt.getKeyValue("light_start").empty())
             {
-                rWarning() << "Cannot inline entity " << mapEnt.getKeyValue("name") <<
-                    " since the model cannot be loaded: " << modelName << std::endl;
                 continue;
             }
 
-            rMessage() << "inlining " << mapEnt.getKeyValue("name") << std::endl;
-            
-            // get the rotation matrix in either full form, or single angle form
-            std::string rotation = mapEnt.getKeyValue("rotation");
-
-            Matrix4 axis;
+            // don't place fog lights, because they often
+            // have origins outside the light
+            std::string texture = mapEnt.getKeyValue("texture");
 
-            if (rotation.empty())
+            if (!texture.empty())
             {
-                float angle = string::convert<float>(mapEnt.getKeyValue("angle"));
+                MaterialPtr mat = GlobalMaterialManager().getMaterialForName(texture);
 
-                // idMath::AngleNormalize360
-                if (angle >= 360.0f || angle < 0.0f)
+                if (mat->isFogLight())
                 {
-                    angle -= floor(angle / 360.0f) * 360.0f;
+                    continue;
                 }
-
-                axis = Matrix4::getRotationAboutZDegrees(angle);
-            }
-            else
-            {
-                axis = Matrix4::getRotation(rotation);
             }
+        }
 
-            Vector3 origin = string::convert<Vector3>(mapEnt.getKeyValue("origin"));
-
-            for (int i = 0; i < model->getSurfaceCount(); ++i)
-            {
-                const model::IModelSurface& surface = model->getSurface(i);
+        if (placeOccupant(headnode, origin, _procFile->entities[i]))
+        {
+            inside = true;
+        }
 
-                MaterialPtr material = GlobalMaterialManager().getMaterialForName(surface.getDefaultMaterial());
+        if (tree.outside->occupied && !errorShown)
+        {
+            errorShown = true;
+            rError() << "Leak on entity #" << i << std::endl;
+            rError() << "Entity classname was " << mapEnt.getKeyValue("classname") << std::endl;
+            rError() << "Entity name was " << mapEnt.getKeyValue("name") << std::endl;
+            rError() << "Entity origin is " 
+                                << string::convert<Vector3>(mapEnt.getKeyValue("origin"))
+                                << std::endl;
+        }
+    }
 
-                ProcTris tris;
+    rMessage() << (boost::format("%5i flooded leafs") % _numFloodedLeafs).str() << std::endl;
 
-                int numTris = surface.getNumTriangles();
-                for (int j = 0; j < numTris; ++j)
-                {
-                    tris.push_back(ProcTri());
-                    ProcTri& tri = tris.back();
+    if (!inside)
+    {
+        rMessage() << "no entities in open -- no filling" << std::endl;
+    }
+    else if (tree.outside->occupied > 0)
+    {
+        rMessage() << "entity reached from outside -- no filling" << std::endl;
+    }
 
-                    tri.material = material;
-                    
-                    if (material->isDiscrete())
-                    {
-                        tri.mergeSurf = &surface;
-                    }
+    return inside && tree.outside->occupied == 0;
+}
 
-                    model::ModelPolygon poly = surface.getPolygon(j);
-                    
-                    tri.v[0].vertex = axis.transformPoint(poly.a.vertex) + origin;
-                    tri.v[0].normal = axis.transformDirection(poly.a.normal);
-                    tri.v[0].texcoord = poly.a.texcoord;
+void ProcCompiler::fillOutsideRecursively(const BspTreeNodePtr& node)
+{
+    if (node->planenum != PLANENUM_LEAF)
+    {
+        fillOutsideRecursively(node->children[0]);
+        fillOutsideRecursively(node->children[1]);
+        return;
+    }
 
-                    tri.v[1].vertex = axis.transformPoint(poly.b.vertex) + origin;
-                    tri.v[1].normal = axis.transformDirection(poly.b.normal);
-                    tri.v[1].texcoord = poly.b.texcoord;
+    // anything not reachable by an entity
+    // can be filled away
+    if (!node->occupied)
+    {
+        if (!node->opaque)
+        {
+            _numOutsideLeafs++;
+            node->opaque = true;
+        } 
+        else
+        {
+            _numSolidLeafs++;
+        }
+    }
+    else
+    {
+        _numInsideLeafs++;
+    }
+}
 
-                    tri.v[2].vertex = axis.transformPoint(poly.c.vertex) + origin;
-                    tri.v[2].normal = axis.transformDirection(poly.c.normal);
-                    tri.v[2].texcoord = poly.c.texcoord;
+void ProcCompiler::fillOutside(const ProcEntity& entity)
+{
+    _numOutsideLeafs = 0;
+    _numInsideLeafs = 0;
+    _numSolidLeafs = 0;
 
-                    // greebo: This is probably the point where the normals should be renormalised to
-                    // fix the weird lighting when applying "rotation hack scaling"
-                }
+    rMessage() << "--- FillOutside ---" << std::endl;
 
-                addMapTrisToAreas(tris, entity);
-            }
-        }
-    }
+    fillOutsideRecursively(entity.tree.head);
 
-    /*rMessage() << ("After Put Primitives in Areas\n");
+    rMessage() << (boost::format("%5i solid leafs") % _numSolidLeafs).str() << std::endl;
+    rMessage() << (boost::format("%5i leafs filled") % _numOutsideLeafs).str() << std::endl;
+    rMessage() << (boost::format("%5i inside leafs") % _numInsideLeafs).str() << std::endl;
+}
 
-    std::size_t planes = _procFile->planes.size();
+void ProcCompiler::clipSideByTreeRecursively(ProcWinding& winding, ProcFace& side, const BspTreeNodePtr& node)
+{
+    if (winding.empty()) return;
 
-    for (std::size_t i = 0; i < planes; ++i)
+    if (node->planenum != PLANENUM_LEAF)
     {
-        const Plane3& plane = _procFile->planes.getPlane(i);
-        rMessage() << (boost::format("Plane %d: (%f %f %f %f)\n") % i % plane.normal().x() % plane.normal().y() % plane.normal().z() % plane.dist());
-    }
+        if (side.planenum == node->planenum)
+        {
+            clipSideByTreeRecursively(winding, side, node->children[0]);
+            return;
+        }
 
-    rMessage() << (boost::format("PPIA: Entity %s\n") % entity.mapEntity->getEntity().getKeyValue("name"));
+        if (side.planenum == (node->planenum ^ 1))
+        {
+            clipSideByTreeRecursively(winding, side, node->children[1]);
+            return;
+        }
 
-    // Print result
-    for (std::size_t a = 0; a < entity.areas.size(); ++a)
-    {
-        rMessage() << " Area " << a << ": ";
+        ProcWinding front;
+        ProcWinding back;
+        winding.split(_planes->getPlane(node->planenum), ON_EPSILON, front, back);
         
-        rMessage() << entity.areas[a].groups.size() << " groups" << std::endl;
+        clipSideByTreeRecursively(front, side, node->children[0]);
+        clipSideByTreeRecursively(back, side, node->children[1]);
+        return;
+    }
 
-        std::size_t count = 0;
-        for (ProcArea::OptimizeGroups::const_iterator g = entity.areas[a].groups.begin(); g != entity.areas[a].groups.end(); ++g, ++count)
+    // if opaque leaf, don't add
+    if (!node->opaque)
+    {
+        if (side.visibleHull.empty())
         {
-            rMessage() << (boost::format("  Group %d, plane %d, %d tris\n") % count % g->planeNum % g->triList.size());
-
-            std::size_t triCount = 0;
-            for (ProcTris::const_iterator t = g->triList.begin(); t != g->triList.end(); ++t, ++triCount)
-            {
-                rMessage() << (boost::format("  Tri %d: (%f %f %f) (%f %f %f) (%f %f %f)\n") % triCount % 
-                    t->v[0].vertex.x() % t->v[0].vertex.y() % t->v[0].vertex.z() %
-                    t->v[1].vertex.x() % t->v[1].vertex.y() % t->v[1].vertex.z() %
-                    t->v[2].vertex.x() % t->v[2].vertex.y() % t->v[2].vertex.z());
-            }
+            side.visibleHull.swap(winding);
         }
-    }*/
+        else
+        {
+            side.visibleHull.addToConvexHull(winding, _planes->getPlane(side.planenum).normal());
+        }
+    }
 }
 
-void ProcCompiler::boundOptimizeGroup(ProcOptimizeGroup& group)
+void ProcCompiler::clipSidesByTree(ProcEntity& entity)
 {
-    group.bounds = AABB();
+    rMessage() << "----- ClipSidesByTree -----" << std::endl;
 
-    for (ProcTris::reverse_iterator tri = group.triList.rbegin(); tri != group.triList.rend(); ++tri)
+    for (ProcEntity::Primitives::const_iterator prim = entity.primitives.begin(); prim != entity.primitives.end(); ++prim)
     {
-        group.bounds.includePoint(tri->v[0].vertex);
-        group.bounds.includePoint(tri->v[1].vertex);
-        group.bounds.includePoint(tri->v[2].vertex);
+        if (!prim->brush) continue;
+
+        clipBrushSidesByTree(*prim->brush, entity.tree.head);
     }
 }
 
-void ProcCompiler::clipTriByLight(const ProcLight& light, const ProcTri& tri, ProcTris& in, ProcTris& out)
+void ProcCompiler::clipBrushSidesByTree(ProcBrush& brush, const BspTreeNodePtr& head)
 {
-    in.clear();
-    out.clear();
-
-    // clip this winding to the light
-    ProcWinding inside(tri.v[0].vertex, tri.v[1].vertex, tri.v[2].vertex);
-    ProcWinding outside[6];
-
-    bool hasOutside = false;
-    ProcWinding oldInside;
-
-    for (std::size_t i = 0; i < 6 ; ++i)
+    for (std::size_t i = 0; i < brush.sides.size(); ++i)
     {
-        oldInside = inside;
+        ProcFace& side = brush.sides[i];
 
-        if (!oldInside.empty())
-        {
-            oldInside.split(light.getFrustumPlane(i), 0, outside[i], inside);
-            oldInside.clear();
-        }
-        else
-        {
-            outside[i].clear();
-        }
+        if (side.winding.empty()) continue;
+        
+        ProcWinding winding(side.winding); // copy
+        
+        side.visibleHull.clear();
 
-        if (!outside[i].empty())
-        {
-            hasOutside = true;
-        }
-    }
+        clipSideByTreeRecursively(winding, side, head);
 
-    if (inside.empty())
-    {
-        // the entire winding is outside this light
-        out.push_back(tri);
-        return;
+        // FIXME: Implement noClipSide option?
     }
+}
 
-    if (!hasOutside)
+void ProcCompiler::clearAreasRecursively(const BspTreeNodePtr& node)
+{
+    if (node->planenum != PLANENUM_LEAF)
     {
-        // the entire winding is inside this light
-        in.push_back(tri);
+        clearAreasRecursively(node->children[0]);
+        clearAreasRecursively(node->children[1]);
         return;
     }
 
-    // the winding is split
-    in = windingToTriList(inside, tri);
-    inside.clear();
+    node->area = -1;
+}
 
-    // combine all the outside fragments
-    for (std::size_t i = 0; i < 6; ++i)
+bool ProcCompiler::portalIsPassable(const ProcPortal& portal)
+{
+    if (!portal.onnode)
     {
-        if (!outside[i].empty())
-        {
-            ProcTris temp = windingToTriList(outside[i], tri);
-            out.insert(out.end(), temp.begin(), temp.end());
-        }
+        return false;   // to global outsideleaf
     }
-}
 
-std::size_t ProcCompiler::countGroupListTris(ProcArea::OptimizeGroups& groupList)
-{
-    std::size_t c = 0;
+    if (portal.nodes[0]->planenum != PLANENUM_LEAF || portal.nodes[1]->planenum != PLANENUM_LEAF)
+    {
+        rError() << "ProcCompiler::portalIsPassable: not a leaf" << std::endl;
+        return false;
+    }
 
-    for (ProcArea::OptimizeGroups::const_iterator group = groupList.begin(); group != groupList.end(); ++group)
+    if (!portal.nodes[0]->opaque && !portal.nodes[1]->opaque )
     {
-        c += group->triList.size();
+        return true;
     }
 
-    return c;
+    return false;
 }
 
-void ProcCompiler::hashTriangles(ProcArea::OptimizeGroups& groups)
+ProcFace* ProcCompiler::findSideForPortal(const ProcPortalPtr& portal)
 {
-    // clear the hash tables
-    _triangleHash.reset(new TriangleHash);
+    // scan both bordering nodes brush lists for a portal brush
+    // that shares the plane
+    for (std::size_t i = 0; i < 2; ++i)
+    {
+        BspTreeNodePtr node = portal->nodes[i];
 
-    // bound all the triangles to determine the bucket size
-    _triangleHash->_hashBounds = AABB();
-    _triangleHash->calculateBounds(groups);
+        for (BspTreeNode::Brushes::const_iterator b = node->brushlist.begin(); b != node->brushlist.end(); ++b)
+        {
+            ProcBrush& brush = **b;
+
+            if (!(brush.contents & Material::SURF_AREAPORTAL))
+            {
+                continue;
+            }
+
+            ProcBrushPtr orig = brush.original.lock();
+
+            assert(orig);
+
+            for (std::size_t j = 0 ; j < orig->sides.size(); ++j)
+            {
+                ProcFace& s = orig->sides[j];
+
+                if (s.visibleHull.empty())
+                {
+                    continue;
+                }
+
+                if (!(s.material->getSurfaceFlags() & Material::SURF_AREAPORTAL))
+                {
+                    continue;
+                }
+
+                if ((s.planenum & ~1) != (portal->onnode->planenum & ~1))
+                {
+                    continue;
+                }
+
+                // remove the visible hull from any other portal sides of this portal brush
+                for (std::size_t k = 0; k < orig->sides.size(); ++k)
+                {
+                    if (k == j)
+                    {
+                        continue;
+                    }
+
+                    ProcFace& s2 = orig->sides[k];
+
+                    if (s2.visibleHull.empty())
+                    {
+                        continue;
+                    }
+
+                    if (!(s2.material->getSurfaceFlags() & Material::SURF_AREAPORTAL))
+                    {
+                        continue;
+                    }
+
+                    Vector3 center = s2.visibleHull.getCenter();
+
+                    rWarning() << "brush has multiple area portal sides at " << center << std::endl;
+
+                    s2.visibleHull.clear();
+                }
+
+                return &s;
+            }
+        }
+    }
 
-    _triangleHash->spreadHashBounds();
-    _triangleHash->hashTriangles(groups);
+    return NULL;
 }
 
-void ProcCompiler::fixAreaGroupsTjunctions(ProcArea::OptimizeGroups& groups)
+void ProcCompiler::floodAreasRecursively(const BspTreeNodePtr& node)
 {
-    if (false/*dmapGlobals.noTJunc*/) return; // FIXME
-
-    if (groups.empty()) return;
+    if (node->area != -1)
+    {
+        return;     // already got it
+    }
 
-    if (true/*dmapGlobals.verbose*/) // FIXME
+    if (node->opaque)
     {
-        std::size_t startCount = countGroupListTris(groups);
-        rMessage() << "----- FixAreaGroupsTjunctions -----" << std::endl;
-        rMessage() << (boost::format("%6i triangles in") % startCount) << std::endl;
+        return;
     }
 
-    hashTriangles(groups);
+    _numAreaFloods++;
+    node->area = _numAreas;
 
-    for (ProcArea::OptimizeGroups::iterator group = groups.begin();
-         group != groups.end(); ++group)
+    std::size_t s = 0;
+    for (ProcPortalPtr p = node->portals; p; p = p->next[s])
     {
-        // don't touch discrete surfaces
-        if (group->material && group->material->isDiscrete())
+        s = (p->nodes[1] == node);
+        const BspTreeNodePtr& other = p->nodes[1-s];
+
+        if (!portalIsPassable(*p))
         {
             continue;
         }
 
-        ProcTris newList;
-
-        for (ProcTris::const_iterator tri = group->triList.begin(); tri != group->triList.end(); ++tri)
+        // can't flood through an area portal
+        if (findSideForPortal(p))
         {
-            _triangleHash->fixTriangleAgainstHash(*tri, newList);
+            continue;
         }
 
-        group->triList.swap(newList);
-    }
-
-    if (true/*dmapGlobals.verbose*/) // FIXME
-    {
-        std::size_t endCount = countGroupListTris(groups);
-        rMessage() << (boost::format("%6i triangles out") % endCount) << std::endl;
+        floodAreasRecursively(other);
     }
 }
 
-inline void calcNormalVectors(const Vector3& self, Vector3& left, Vector3& down)
+void ProcCompiler::findAreasRecursively(const BspTreeNodePtr& node)
 {
-    float d = self.x() * self.x() + self.y() * self.y();
-
-    if (!d)
-    {
-        left[0] = 1;
-        left[1] = 0;
-        left[2] = 0;
-    } 
-    else 
+    if (node->planenum != PLANENUM_LEAF)
     {
-        d = 1 / sqrt(d);
-
-        left[0] = -self.y() * d;
-        left[1] = self.x() * d;
-        left[2] = 0;
+        findAreasRecursively(node->children[0]);
+        findAreasRecursively(node->children[1]);
+        return;
     }
 
-    down = left.crossProduct(self);
-}
-
-OptVertex* ProcCompiler::findOptVertex(const ArbitraryMeshVertex& v, ProcOptimizeGroup& group)
-{
-    // deal with everything strictly as 2D
-    float x = v.vertex.dot(group.axis[0]);
-    float y = v.vertex.dot(group.axis[1]);
-
-    // should we match based on the t-junction fixing hash verts?
-    for (std::size_t i = 0; i < _optVerts.size(); ++i)
+    if (node->opaque)
     {
-        if (_optVerts[i].pv[0] == x && _optVerts[i].pv[1] == y)
-        {
-            return &_optVerts[i];
-        }
+        return;
     }
 
-    // not found, insert a new one
-    _optVerts.push_back(OptVertex());
+    if (node->area != -1)
+    {
+        return;     // already got it
+    }
 
-    OptVertex* vert = &_optVerts.back(); // TODO: greebo: instead of OptVertex* we might as well use array indices?
-    
-    vert->v = v;
-    vert->pv[0] = x;
-    vert->pv[1] = y;
-    vert->pv[2] = 0;
+    _numAreaFloods = 0;
+    floodAreasRecursively(node);
 
-    _optBounds.includePoint(vert->pv);
+    rMessage() << (boost::format("Area %i has %i leafs") % _numAreas % _numAreaFloods) << std::endl;
 
-    return vert;
+    _numAreas++;
 }
 
-namespace
-{
-
-bool vertexIsBetween(const OptVertex* p1, const OptVertex* v1, const OptVertex* v2)
+void ProcCompiler::checkAreasRecursively(const BspTreeNodePtr& node)
 {
-    Vector3 d1 = p1->pv - v1->pv;
-    Vector3 d2 = p1->pv - v2->pv;
-    float d = d1.dot(d2);
+    if (node->planenum != PLANENUM_LEAF)
+    {
+        checkAreasRecursively(node->children[0]);
+        checkAreasRecursively(node->children[1]);
+        return;
+    }
 
-    return (d < 0);
+    if (!node->opaque && node->area < 0)
+    {
+        rError() << "ProcCompiler::checkAreasRecursively: area = %i" << node->area << std::endl;
+    }
 }
 
-} // namespace
-
-void ProcCompiler::addOriginalTriangle(OptVertex* v[3])
+void ProcCompiler::findInterAreaPortalsRecursively(const BspTreeNodePtr& node)
 {
-    // if this triangle is backwards (possible with epsilon issues)
-    // ignore it completely
-    if (!OptUtils::IsTriangleValid(v[0], v[1], v[2]))
+    if (node->planenum != PLANENUM_LEAF)
+    {
+        findInterAreaPortalsRecursively(node->children[0]);
+        findInterAreaPortalsRecursively(node->children[1]);
+        return;
+    }
+
+    if (node->opaque)
     {
-        rWarning() << "WARNING: backwards triangle in input!" << std::endl;
         return;
     }
 
-    for (std::size_t i = 0; i < 3; ++i)
+    std::size_t s = 0;
+    for (ProcPortalPtr p = node->portals; p; p = p->next[s])
     {
-        OptVertex* v1 = v[i];
-        OptVertex* v2 = v[(i+1) % 3];
+        s = (p->nodes[1] == node) ? 1 : 0;
+        const BspTreeNodePtr& other = p->nodes[1-s];
 
-        if (v1 == v2)
+        if (other->opaque)
         {
-            // this probably shouldn't happen, because the
-            // tri would be degenerate
             continue;
         }
 
-        std::size_t j = 0;
-
-        // see if there is an existing one
-        for ( ; j < _originalEdges.size(); ++j)
+        // only report areas going from lower number to higher number
+        // so we don't report the portal twice
+        if (other->area <= node->area)
         {
-            if (_originalEdges[j].v1 == v1 && _originalEdges[j].v2 == v2)
-            {
-                break;
-            }
-
-            if (_originalEdges[j].v2 == v1 && _originalEdges[j].v1 == v2)
-            {
-                break;
-            }
+            continue;
         }
 
-        if (j == _originalEdges.size())
+        ProcFace* side = findSideForPortal(p);
+
+        if (side == NULL)
         {
-            // add it
-            _originalEdges.push_back(OriginalEdge(v1, v2));
+            rWarning() << "findSideForPortal failed at " << p->winding.getCenter() << std::endl;
+            continue;
         }
-    }
-}
 
-void ProcCompiler::addOriginalEdges(ProcOptimizeGroup& group)
-{
-    if (false/* dmapGlobals.verbose */) // FIXME
-    {
-        rMessage() <<  "----" << std::endl;
-        rMessage() << (boost::format("%6i original tris") % group.triList.size()) << std::endl;
-    }
+        const ProcWinding& w = side->visibleHull;
 
-    _optBounds = AABB();
+        if (w.empty())
+        {
+            continue;
+        }
 
-    // allocate space for max possible edges
-    std::size_t numTris = group.triList.size();
+        // see if we have created this portal before
+        std::size_t i = 0;
 
-    _originalEdges.clear();
-    _originalEdges.reserve(numTris * 3);
+        for (i = 0; i < _procFile->interAreaPortals.size(); ++i)
+        {
+            ProcInterAreaPortal& iap = _procFile->interAreaPortals[i];
 
-    // add all unique triangle edges
-    _optEdges.clear();
-    _optEdges.reserve(DEFAULT_OPT_EDGES);
+            if (side == iap.side &&
+                ((p->nodes[0]->area == iap.area0 && p->nodes[1]->area == iap.area1) || 
+                 (p->nodes[1]->area == iap.area0 && p->nodes[0]->area == iap.area1))) 
+            {
+                break;
+            }
+        }
 
-    _optVerts.clear();
-    _optVerts.reserve(DEFAULT_OPT_VERTICES);
+        if (i != _procFile->interAreaPortals.size())
+        {
+            continue;   // already emitted
+        }
 
-    OptVertex*  v[3];
+        _procFile->interAreaPortals.push_back(ProcInterAreaPortal());
+        ProcInterAreaPortal& iap = _procFile->interAreaPortals.back();
 
-    for (ProcTris::iterator tri = group.triList.begin(); tri != group.triList.end(); ++tri)
-    {
-        v[0] = tri->optVert[0] = findOptVertex(tri->v[0], group);
-        v[1] = tri->optVert[1] = findOptVertex(tri->v[1], group);
-        v[2] = tri->optVert[2] = findOptVertex(tri->v[2], group);
+        if (side->planenum == p->onnode->planenum)
+        {
+            iap.area0 = p->nodes[0]->area;
+            iap.area1 = p->nodes[1]->area;
+        }
+        else
+        {
+            iap.area0 = p->nodes[1]->area;
+            iap.area1 = p->nodes[0]->area;
+        }
 
-        addOriginalTriangle(v);
+        iap.side = side;
     }
 }
 
-OptVertex* ProcCompiler::getEdgeIntersection(const OptVertex* p1, const OptVertex* p2,
-                                const OptVertex* l1, const OptVertex* l2, ProcOptimizeGroup& group)
+void ProcCompiler::floodAreas(ProcEntity& entity)
 {
-    Vector3 dir1 = p1->pv - l1->pv;
-    Vector3 dir2 = p1->pv - l2->pv;
-    Vector3 cross1 = dir1.crossProduct(dir2);
-
-    dir1 = p2->pv - l1->pv;
-    dir2 = p2->pv - l2->pv;
-    Vector3 cross2 = dir1.crossProduct(dir2);
+    rMessage() << "--- FloodAreas ---" << std::endl;
 
-    if (cross1[2] - cross2[2] == 0)
-    {
-        return NULL;
-    }
+    // set all areas to -1
+    clearAreasRecursively(entity.tree.head);
 
-    float f = cross1[2] / (cross1[2] - cross2[2]);
+    // flood fill from non-opaque areas
+    _numAreas = 0;
 
-    ArbitraryMeshVertex v;
+    findAreasRecursively(entity.tree.head);
 
-    v.vertex = p1->v.vertex * (1.0f - f) + p2->v.vertex * f;
-    v.normal = p1->v.normal * (1.0f - f) + p2->v.normal * f;
-    v.normal.normalise();
-    v.texcoord[0] = p1->v.texcoord[0] * (1.0f - f) + p2->v.texcoord[0] * f;
-    v.texcoord[1] = p1->v.texcoord[1] * (1.0f - f) + p2->v.texcoord[1] * f;
+    rMessage() << (boost::format("%5i areas") % _numAreas) << std::endl;
+    entity.numAreas = _numAreas;
 
-    return findOptVertex(v, group);
-}
+    // make sure we got all of them
+    checkAreasRecursively(entity.tree.head);
 
-void ProcCompiler::addEdgeIfNotAlready(OptVertex* v1, OptVertex* v2)
-{
-    // make sure that there isn't an identical edge already added
-    for (OptEdge* e = v1->edges; e ; )
+    // identify all portals between areas if this is the world
+    if (&entity == _procFile->entities.begin()->get())
     {
-        if ((e->v1 == v1 && e->v2 == v2) || (e->v1 == v2 && e->v2 == v1))
-        {
-            return;     // already added
-        }
+        _procFile->interAreaPortals.clear();
+        findInterAreaPortalsRecursively(entity.tree.head);
 
-        if (e->v1 == v1)
-        {
-            e = e->v1link;
-        } 
-        else if (e->v2 == v1)
-        {
-            e = e->v2link;
-        } 
-        else 
-        {
-            rError() << "addEdgeIfNotAlready: bad edge link" << std::endl;
-            return;
-        }
+        rMessage() << (boost::format("%5i interarea portals") % _procFile->interAreaPortals.size()) << std::endl;
     }
-
-    // this edge is a keeper
-    _optEdges.push_back(OptEdge());
-
-    OptEdge* newEdge = &_optEdges.back();
-    newEdge->v1 = v1;
-    newEdge->v2 = v2;
-
-    newEdge->islandLink = NULL;
-
-    // link the edge to its verts
-    newEdge->linkToVertices();
 }
 
-void ProcCompiler::splitOriginalEdgesAtCrossings(ProcOptimizeGroup& group)
+ProcTris ProcCompiler::triangleListForSide(const ProcFace& side, const ProcWinding& winding)
 {
-    std::size_t numOriginalVerts = _optVerts.size();
-
-    // now split any crossing edges and create optEdges
-    // linked to the vertexes
-
-#if 0
-    // debug drawing bounds
-    dmapGlobals.drawBounds = optBounds;
+    const MaterialPtr& si = side.material;
 
-    dmapGlobals.drawBounds[0][0] -= 2;
-    dmapGlobals.drawBounds[0][1] -= 2;
-    dmapGlobals.drawBounds[1][0] += 2;
-    dmapGlobals.drawBounds[1][1] += 2;
-#endif
+    // skip any generated faces
+    if (!si) return ProcTris();
+    
+    // don't create faces for non-visible sides
+    if (!si->surfaceCastsShadow() && !si->isDrawn())
+    {
+        return ProcTris();
+    }
 
-    // generate crossing points between all the original edges
-    EdgeCrossingsList crossings(_originalEdges.size());
+#if 1
+    // triangle fan using only the outer verts
+    // this gives the minimum triangle count,
+    // but may have some very distended triangles
+    ProcTris triList;
+    triList.reserve(winding.size());
 
-    for (std::size_t i = 0; i < _originalEdges.size(); ++i)
+    // The fan is emitted in reverse order
+    for (std::size_t i = winding.size(); i-- > 2; )
     {
-#if 0
-        if ( dmapGlobals.drawflag ) {
-            DrawOriginalEdges( numOriginalEdges, originalEdges );
-            qglBegin( GL_LINES );
-            qglColor3f( 0, 1, 0 );
-            qglVertex3fv( originalEdges[i].v1->pv.ToFloatPtr() );
-            qglColor3f( 0, 0, 1 );
-            qglVertex3fv( originalEdges[i].v2->pv.ToFloatPtr() );
-            qglEnd();
-            qglFlush();
-        }
-#endif
-        for (std::size_t j = i + 1; j < _originalEdges.size(); ++j)
+        triList.push_back(ProcTri());
+        ProcTri& tri = triList.back();
+
+        tri.material = si;  
+        
+        for (std::size_t j = 0; j < 3; ++j)
         {
-            OptVertex* v1 = _originalEdges[i].v1;
-            OptVertex* v2 = _originalEdges[i].v2;
-            OptVertex* v3 = _originalEdges[j].v1;
-            OptVertex* v4 = _originalEdges[j].v2;
+            const Vector3* vec;
 
-            if (!OptUtils::EdgesCross(v1, v2, v3, v4))
+            if (j == 0)
             {
-                continue;
-            }
-
-            // this is the only point in optimization where
-            // completely new points are created, and it only
-            // happens if there is overlapping coplanar
-            // geometry in the source triangles
-            OptVertex* newVert = getEdgeIntersection(v1, v2, v3, v4, group);
-
-            if (!newVert)
+                vec = &(winding[0].vertex);
+            } 
+            else if ( j == 1 )
             {
-                // colinear, so add both verts of each edge to opposite
-                if (vertexIsBetween(v3, v1, v2)) 
-                {
-                    crossings[i].push_back(EdgeCrossing(v3));
-                }
-
-                if (vertexIsBetween(v4, v1, v2)) 
-                {
-                    crossings[i].push_back(EdgeCrossing(v4));
-                }
-
-                if (vertexIsBetween(v1, v3, v4)) 
-                {
-                    crossings[j].push_back(EdgeCrossing(v1));
-                }
-
-                if (vertexIsBetween(v2, v3, v4)) 
-                {
-                    crossings[j].push_back(EdgeCrossing(v2));
-                }
-
-                continue;
+                vec = &(winding[i-1].vertex);
+            } 
+            else
+            {
+                vec = &(winding[i].vertex);
             }
 
-            if (newVert != v1 && newVert != v2)
+            ArbitraryMeshVertex& dv = tri.v[j];
+#if 0
+            // round the xyz to a given precision
+            for ( k = 0 ; k < 3 ; k++ )
             {
-                crossings[i].push_back(EdgeCrossing(newVert));
+                dv->xyz[k] = SNAP_INT_TO_FLOAT * floor( vec[k] * SNAP_FLOAT_TO_INT + 0.5 );
             }
+#else
+            dv.vertex = *vec;
+#endif
+                
+            // calculate texture s/t from brush primitive texture matrix
+            dv.texcoord[0] = dv.vertex.dot(side.texVec[0].getVector3()) + side.texVec[0][3];
+            dv.texcoord[1] = dv.vertex.dot(side.texVec[1].getVector3()) + side.texVec[1][3];
 
-            if (newVert != v3 && newVert != v4)
+            // copy normal
+            dv.normal = _planes->getPlane(side.planenum).normal();
+
+            if (dv.normal.getLength() < 0.9f || dv.normal.getLength() > 1.1f)
             {
-                crossings[j].push_back(EdgeCrossing(newVert));
+                rError() << "Bad normal in TriListForSide" << std::endl;
+                return triList;
             }
         }
     }
+#else
+    // triangle fan from central point, more verts and tris, but less distended
+    // I use this when debugging some tjunction problems
+    triList = NULL;
+    for ( i = 0 ; i < w->GetNumPoints() ; i++ ) {
+        idVec3  midPoint;
 
-    // now split each edge by its crossing points
-    // colinear edges will have duplicated edges added, but it won't hurt anything
-    for (std::size_t i = 0; i < _originalEdges.size(); ++i)
-    {
-        std::size_t numCross = crossings[i].size();
-        numCross += 2;  // account for originals
-
-        std::vector<OptVertex*> sorted(numCross);
-        memset(&sorted[0], 0, sorted.size());
-
-        sorted[0] = _originalEdges[i].v1;
-        sorted[1] = _originalEdges[i].v2;
-
-        std::size_t j = 2;
-
-        for (EdgeCrossings::const_iterator cross = crossings[i].begin(); cross != crossings[i].end(); ++cross)
-        {
-            sorted[j] = cross->ov;
-            j++;
-        }
-
-        // add all possible fragment combinations that aren't divided by another point
-        for (std::size_t j = 0; j < numCross; ++j)
-        {
-            for (std::size_t k = j+1; k < numCross; ++k)
-            {
-                std::size_t l = 0;
-
-                for (; l < numCross; ++l)
-                {
-                    if (sorted[l] == sorted[j] || sorted[l] == sorted[k])
-                    {
-                        continue;
-                    }
-
-                    if (sorted[j] == sorted[k])
-                    {
-                        continue;
-                    }
-                    
-                    if (vertexIsBetween(sorted[l], sorted[j], sorted[k]))
-                    {
-                        break;
-                    }
-                }
+        tri = AllocTri();
+        tri->material = si; 
+        tri->next = triList;
+        triList = tri;
 
-                if (l == numCross)
-                {
-                    //common->Printf( "line %i fragment from point %i to %i\n", i, sorted[j] - optVerts, sorted[k] - optVerts );
-                    addEdgeIfNotAlready(sorted[j], sorted[k]);
-                }
+        for ( j = 0 ; j < 3 ; j++ ) {
+            if ( j == 0 ) {
+                vec = &midPoint;
+                midPoint = w->GetCenter();
+            } else if ( j == 1 ) {
+                vec = &((*w)[i]).ToVec3();
+            } else {
+                vec = &((*w)[(i+1)%w->GetNumPoints()]).ToVec3();
             }
-        }
-    }
 
+            dv = tri->v + j;
 
-    crossings.clear();
-    _originalEdges.clear();
+            VectorCopy( *vec, dv->xyz );
+                
+            // calculate texture s/t from brush primitive texture matrix
+            dv->st[0] = DotProduct( dv->xyz, s->texVec.v[0] ) + s->texVec.v[0][3];
+            dv->st[1] = DotProduct( dv->xyz, s->texVec.v[1] ) + s->texVec.v[1][3];
 
-    // check for duplicated edges
-    for (std::size_t i = 0 ; i < _optEdges.size(); ++i)
-    {
-        for (std::size_t j = i + 1; j < _optEdges.size(); ++j)
-        {
-            if ((_optEdges[i].v1 == _optEdges[j].v1 && _optEdges[i].v2 == _optEdges[j].v2) ||
-                (_optEdges[i].v1 == _optEdges[j].v2 && _optEdges[i].v2 == _optEdges[j].v1))
-            {
-                rMessage() << "duplicated optEdge" << std::endl;
+            // copy normal
+            dv->normal = dmapGlobals.mapPlanes[s->planenum].Normal();
+            if ( dv->normal.Length() < 0.9f || dv->normal.Length() > 1.1f ) {
+                common->Error( "Bad normal in TriListForSide" );
             }
         }
     }
+#endif
 
-    if (false/* dmapGlobals.verbose*/)
+    // set merge groups if needed, to prevent multiple sides from being
+    // merged into a single surface in the case of gui shaders, mirrors, and autosprites
+    if (side.material->isDiscrete())
     {
-        rMessage() << (boost::format("%6i original edges") % _originalEdges.size()) << std::endl;
-        rMessage() << (boost::format("%6i edges after splits") % _optEdges.size()) << std::endl;
-        rMessage() << (boost::format("%6i original vertexes") % numOriginalVerts) << std::endl;
-        rMessage() << (boost::format("%6i vertexes after splits") % _optVerts.size()) << std::endl;
+        for (ProcTris::iterator tri = triList.begin(); tri != triList.end(); ++tri)
+        {
+            tri->mergeGroup = &side;
+        }
     }
-}
-
-void ProcCompiler::dontSeparateIslands(ProcOptimizeGroup& group)
-{
-    OptIsland island(group, _optVerts, _optEdges, _procFile);
 
-    island.optimise();
+    return triList;
 }
 
-void ProcCompiler::optimizeOptList(ProcOptimizeGroup& group)
+std::size_t ProcCompiler::checkWindingInAreasRecursively(const ProcWinding& winding, const BspTreeNodePtr& node)
 {
-    ProcArea::OptimizeGroups tempList(1, group);
-
-    // fix the t junctions among this single list
-    // so we can match edges
-    // can we avoid doing this if colinear vertexes break edges?
-    fixAreaGroupsTjunctions(tempList);
-    group = tempList.front();
-    
-    // create the 2D vectors
-    calcNormalVectors(_procFile->planes.getPlane(group.planeNum).normal(), group.axis[0], group.axis[1]);
-
-    addOriginalEdges(group);
-    splitOriginalEdgesAtCrossings(group);
-
-#if 0
-    // seperate any discontinuous areas for individual optimization
-    // to reduce the scope of the problem
-    SeparateIslands( opt );
-#else
-    dontSeparateIslands(group);
-#endif
+    assert(!winding.empty());
 
-    // now free the hash verts
-    _triangleHash.reset();
+    if (node->planenum != PLANENUM_LEAF)
+    {
+        ProcWinding front;
+        ProcWinding back;
+        winding.split(_planes->getPlane(node->planenum), ON_EPSILON, front, back);
 
-    // free the original list and use the new one
-    group.triList.swap(group.regeneratedTris);
-    group.regeneratedTris.clear();
-}
+        std::size_t a1 = front.empty() ? 0 : checkWindingInAreasRecursively(front, node->children[0]);
+        std::size_t a2 = back.empty() ? 0 : checkWindingInAreasRecursively(back, node->children[1]);
+        
+        if (a1 == MULTIAREA_CROSS || a2 == MULTIAREA_CROSS)
+        {
+            return MULTIAREA_CROSS; // different
+        }
 
-void ProcCompiler::setGroupTriPlaneNums(ProcArea::OptimizeGroups& groupList)
-{
-    for (ProcArea::OptimizeGroups::iterator group = groupList.begin(); 
-         group != groupList.end(); ++group)
-    {
-        for (ProcTris::iterator tri = group->triList.begin(); tri != group->triList.end(); ++tri)
+        if (a1 == -1)
         {
-            tri->planeNum = group->planeNum;
+            return a2;  // one solid
         }
-    }
-}
 
-void ProcCompiler::optimizeGroupList(ProcArea::OptimizeGroups& groupList)
-{
-    if (groupList.empty()) return;
+        if (a2 == -1)
+        {
+            return a1;  // one solid
+        }
 
-    std::size_t numIn = countGroupListTris(groupList);
+        if (a1 != a2)
+        {
+            return MULTIAREA_CROSS; // cross areas
+        }
 
-    // optimize and remove colinear edges, which will
-    // re-introduce some t junctions
-    for (ProcArea::OptimizeGroups::iterator group = groupList.begin(); 
-         group != groupList.end(); ++group)
-    {
-        optimizeOptList(*group);
+        return a1;
     }
 
-    std::size_t numEdge = countGroupListTris(groupList);
-
-    // fix t junctions again
-    fixAreaGroupsTjunctions(groupList);
-    _triangleHash.reset();
-
-    std::size_t numTjunc2 = countGroupListTris(groupList);
-
-    setGroupTriPlaneNums(groupList);
-
-    rMessage() << "----- OptimizeAreaGroups Results -----" << std::endl;
-    rMessage() << (boost::format("%6i tris in") % numIn) << std::endl;
-    rMessage() << (boost::format("%6i tris after edge removal optimization") % numEdge) << std::endl;
-    rMessage() << (boost::format("%6i tris after final t junction fixing") % numTjunc2) << std::endl;
+    return node->area;
 }
 
-Surface ProcCompiler::shareMapTriVerts(const ProcTris& tris)
-{
-    // unique the vertexes
-    std::size_t count = tris.size();
+#define  TEXTURE_OFFSET_EQUAL_EPSILON   0.005f
+#define  TEXTURE_VECTOR_EQUAL_EPSILON   0.001f
 
-    Surface uTri;
+void ProcCompiler::addTriListToArea(ProcEntity& entity, const ProcTris& triList, 
+                                    std::size_t planeNum, std::size_t areaNum, 
+                                    const Vector4 texVec[2])
+{
+    if (triList.empty())
+    {
+        return;
+    }
 
-    uTri.vertices.reserve(count * 3);
-    uTri.indices.reserve(count * 3);
+    ProcArea& area = entity.areas[areaNum];
+    ProcArea::OptimizeGroups::iterator group;
 
-    for (ProcTris::const_iterator step = tris.begin(); step != tris.end(); ++step)
+    for (group = area.groups.begin(); group != area.groups.end(); ++group)
     {
-        for (std::size_t i = 0; i < 3; ++i)
+        if (group->material == triList.front().material && 
+            group->planeNum == planeNum && 
+            (group->mergeGroup == triList.front().mergeGroup || 
+             group->mergeSurf == triList.front().mergeSurf || 
+             group->mergePatch == triList.front().mergePatch))
         {
-            const ArbitraryMeshVertex& dv = step->v[i];
-
-            // search for a match
-            std::size_t j = 0;
+            // check the texture vectors
+            std::size_t i = 0;
 
-            for (j = 0; j < uTri.vertices.size(); ++j)
+            for (i = 0; i < 2; ++i)
             {
-                if (OptUtils::MatchVert(uTri.vertices[j], dv))
+                std::size_t j = 0;
+
+                for (j = 0; j < 3; ++j)
+                {
+                    if (fabs(texVec[i][j] - group->texVec[i][j]) > TEXTURE_VECTOR_EQUAL_EPSILON)
+                    {
+                        break;
+                    }
+                }
+
+                if (j != 3)
+                {
+                    break;
+                }
+
+                if (fabs(texVec[i][3] - group->texVec[i][3]) > TEXTURE_OFFSET_EQUAL_EPSILON)
                 {
                     break;
                 }
             }
 
-            if (j == uTri.vertices.size())
+            if (i == 2)
             {
-                uTri.vertices.push_back(dv);
+                break;  // exact match
             }
-
-            uTri.indices.push_back(static_cast<int>(j));
+            /*else
+            {
+                // different texture offsets
+                i = 1;  // just for debugger breakpoint
+            }*/
         }
     }
 
-    return uTri;
-}
-
-Surface ProcCompiler::createVertexProgramTurboShadowVolume(const Matrix4& transform, const Surface& tri, 
-        const ProcLight& light, Surface::CullInfo& cullInfo)
-{
-    throw std::runtime_error("createVertexProgramTurboShadowVolume not implemented yet.");
-}
-
-Surface ProcCompiler::createTurboShadowVolume(const Matrix4& transform, const Surface& tri, 
-        const ProcLight& light, Surface::CullInfo& cullInfo)
-{
-    throw std::runtime_error("createTurboShadowVolume not implemented yet.");
-}
-
-namespace
-{
-
-inline Vector3 globalPointToLocal(const Matrix4& transform, const Vector3& in)
-{
-    Vector3 temp = in - transform.translation();
-    //VectorSubtract( in, &modelMatrix[12], temp );
-
-    Vector3 out(
-        temp.dot(transform.x().getVector3()),   //DotProduct( temp, &modelMatrix[0] );
-        temp.dot(transform.y().getVector3()),
-        temp.dot(transform.z().getVector3())
-    );
-
-    return temp;
-}
-
-inline float planeDistanceToBounds(const AABB& bounds, const Plane3& plane)
-{
-    Vector3 mins = bounds.origin - bounds.extents;
-    Vector3 maxs = bounds.origin + bounds.extents;
-
-    float d1 = plane.distanceToPoint(bounds.origin);
-    float d2 = fabs((maxs[0] - bounds.origin[0]) * plane.normal()[0]) +
-               fabs((maxs[1] - bounds.origin[1]) * plane.normal()[1]) +
-               fabs((maxs[2] - bounds.origin[2]) * plane.normal()[2]);
-
-    if (d1 - d2 > 0.0f)
-    {
-        return d1 - d2;
-    }
-
-    if (d1 + d2 < 0.0f)
-    {
-        return d1 + d2;
-    }
-
-    return 0.0f;
-}
-
-}
-
-void ProcCompiler::calcInteractionFacing(const Matrix4& transform, const Surface& tri, const ProcLight& light,
-                             Surface::CullInfo& cullInfo)
-{
-    if (!cullInfo.facing.empty())
+    if (group == area.groups.end())
     {
-        return;
-    }
-
-    Vector3 localLightOrigin = globalPointToLocal(transform, light.getGlobalLightOrigin());
+        //std::size_t oldSize = area.groups.size();
 
-    std::size_t numFaces = tri.indices.size() / 3;
+        area.groups.push_front(ProcOptimizeGroup());
+        group = area.groups.begin();
 
-    if (tri.facePlanes.empty() || !tri.facePlanesCalculated)
-    {
-        const_cast<Surface&>(tri).deriveFacePlanes();
-    }
+        //rMessage() << (boost::format("Adding group from plane %d after %d\n") % planeNum % oldSize);
 
-    cullInfo.facing.resize(numFaces + 1);
+        group->numGroupLights = 0;
+        group->smoothed = false;
+        group->surfaceEmitted = false;
 
-    // calculate back face culling
-    // exact geometric cull against face
-    for (std::size_t i = 0; i < numFaces; ++i) 
-    {
-        float planeSide = localLightOrigin.dot(tri.facePlanes[i].normal()) - tri.facePlanes[i].dist();
-        cullInfo.facing[i] = planeSide >= 0.0f;
+        group->planeNum = planeNum;
+        group->mergeGroup = triList.front().mergeGroup;
+        group->mergeSurf = triList.front().mergeSurf;
+        group->mergePatch = triList.front().mergePatch;
+        group->material = triList.front().material;
+        group->texVec[0] = texVec[0];
+        group->texVec[1] = texVec[1];
     }
 
-    cullInfo.facing[numFaces] = 1;  // for dangling edges to reference
+    // Append the incoming triangles to the existing ones in the group
+    group->triList.insert(group->triList.end(), triList.begin(), triList.end());
 }
 
-void ProcCompiler::calcPointCull(const Surface& tri, const Plane3 frustum[6], unsigned short* pointCull, int* remap)
+void ProcCompiler::addAreaTriLists(ProcEntity& entity, AreaTriLists& triLists)
 {
-    memset(remap, -1, tri.vertices.size() * sizeof(remap[0]));
-
-    int frontBits = 0;
-    std::size_t i = 0;
-
-    for (frontBits = 0, i = 0; i < 6; ++i)
-    {
-        // get front bits for the whole surface
-        if (planeDistanceToBounds(tri.bounds, frustum[i]) >= LIGHT_CLIP_EPSILON)
-        {
-            frontBits |= 1 << (i + 6);
-        }
-    }
-
-    // initialize point cull
-    for (i = 0; i < tri.vertices.size(); ++i)
-    {
-        pointCull[i] = frontBits;
-    }
-
-    // if the surface is not completely inside the light frustum
-    if (frontBits == ( ( ( 1 << 6 ) - 1 ) ) << 6)
-    {
-        return;
-    }
-
-    unsigned char* side1 = (unsigned char*)alloca(tri.vertices.size() * sizeof(unsigned char));
-    unsigned char* side2 = (unsigned char*)alloca(tri.vertices.size() * sizeof(unsigned char));
-
-    memset(side1, 0, tri.vertices.size() * sizeof(unsigned char));
-    memset(side2, 0, tri.vertices.size() * sizeof(unsigned char));
-
-    for (i = 0; i < 6; ++i)
+    for (AreaTriLists::iterator i = triLists.begin(); i != triLists.end(); ++i)
     {
-        if (frontBits & (1<<(i+6)))
+        if (i->planeNum == PLANENUM_UNRESOLVED)
         {
-            continue;
+            i->planeNum = _planes->findOrInsertPlane(i->plane, EPSILON_NORMAL, EPSILON_DIST);
         }
 
-        for (std::size_t c = 0; c < tri.vertices.size(); ++c)
-        {
-            float planeSide = frustum[i].normal().dot(tri.vertices[c].vertex) - frustum[i].dist();
-            side1[c] |= (planeSide < LIGHT_CLIP_EPSILON) << i;
-            side2[c] |= (planeSide > -LIGHT_CLIP_EPSILON) << i;
-        }
+        addTriListToArea(entity, i->tris, i->planeNum, i->areaNum, i->texVec);
     }
 
-    for (i = 0; i < tri.vertices.size(); ++i)
-    {
-        pointCull[i] |= side1[i] | (side2[i] << 6);
-    }
+    triLists.clear();
 }
 
-int ProcCompiler::chopWinding(ClipTri clipTris[2], int inNum, const Plane3& plane)
+void ProcCompiler::putWindingIntoAreasRecursively(const ProcWinding& winding, const ProcFace& side, 
+    const BspTreeNodePtr& node, AreaTriLists& output)
 {
-    float   dists[MAX_CLIPPED_POINTS];
-    int     sides[MAX_CLIPPED_POINTS];
-        
-    ClipTri& in = clipTris[inNum];
-    ClipTri& out = clipTris[inNum^1];
-
-    int counts[3] = { 0, 0, 0 };
-    
-    // determine sides for each point
-    int i = 0;
+    if (winding.empty()) return;
 
-    for (i = 0 ; i < in.numVerts; i++)
+    if (node->planenum != PLANENUM_LEAF)
     {
-        float dot = plane.distanceToPoint(in.verts[i]);
-        dists[i] = dot;
-        if (dot < -LIGHT_CLIP_EPSILON)
+        if (side.planenum == node->planenum)
         {
-            sides[i] = SIDE_BACK;
+            putWindingIntoAreasRecursively(winding, side, node->children[0], output);
+            return;
         }
-        else if (dot > LIGHT_CLIP_EPSILON)
+
+        if (side.planenum == (node->planenum ^ 1))
         {
-            sides[i] = SIDE_FRONT;
+            putWindingIntoAreasRecursively(winding, side, node->children[1], output);
+            return;
         }
-        else
+
+        // see if we need to split it
+        // adding the "noFragment" flag to big surfaces like sky boxes
+        // will avoid potentially dicing them up into tons of triangles
+        // that take forever to optimize back together
+        if (/*FIXME !dmapGlobals.fullCarve || */side.material->getSurfaceFlags() & Material::SURF_NOFRAGMENT)
         {
-            sides[i] = SIDE_ON;
+            std::size_t area = checkWindingInAreasRecursively(winding, node);
+
+            if (area != MULTIAREA_CROSS)
+            {
+                output.push_back(AreaTriList(side.planenum, area, side.texVec));
+                output.back().tris = triangleListForSide(side, winding);
+                return;
+            }
         }
 
-        counts[sides[i]]++;
-    }
+        ProcWinding front;
+        ProcWinding back;
+        winding.split(_planes->getPlane(node->planenum), ON_EPSILON, front, back);
 
-    // if none in front, it is completely clipped away
-    if (!counts[SIDE_FRONT])
-    {
-        in.numVerts = 0;
-        return inNum;
+        putWindingIntoAreasRecursively(front, side, node->children[0], output);
+        putWindingIntoAreasRecursively(back, side, node->children[1], output);
+
+        return;
     }
 
-    if (!counts[SIDE_BACK])
+    // if opaque leaf, don't add
+    if (node->area >= 0 && !node->opaque)
     {
-        return inNum;       // inout stays the same
+        output.push_back(AreaTriList(side.planenum, node->area, side.texVec));
+        output.back().tris = triangleListForSide(side, winding);
     }
+}
 
-    // avoid wrapping checks by duplicating first value to end
-    sides[i] = sides[0];
-    dists[i] = dists[0];
-
-    in.verts[in.numVerts] = in.verts[0];
-    in.edgeFlags[in.numVerts] = in.edgeFlags[0];
+// TODO: Make this a member method of ProcTri
+inline void getTexVecForTri(Vector4 texVec[2], const ProcTri& tri)
+{
+    float d0[5];
+    float d1[5];
 
-    out.numVerts = 0;
+    const ArbitraryMeshVertex& a = tri.v[0];
+    const ArbitraryMeshVertex& b = tri.v[1];
+    const ArbitraryMeshVertex& c = tri.v[2];
 
-    for (i = 0; i < in.numVerts; ++i)
-    {
-        Vector3& p1 = in.verts[i];
+    d0[0] = b.vertex[0] - a.vertex[0];
+    d0[1] = b.vertex[1] - a.vertex[1];
+    d0[2] = b.vertex[2] - a.vertex[2];
+    d0[3] = b.texcoord[0] - a.texcoord[0];
+    d0[4] = b.texcoord[1] - a.texcoord[1];
 
-        if (sides[i] != SIDE_BACK)
-        {
-            out.verts[out.numVerts] = p1;
+    d1[0] = c.vertex[0] - a.vertex[0];
+    d1[1] = c.vertex[1] - a.vertex[1];
+    d1[2] = c.vertex[2] - a.vertex[2];
+    d1[3] = c.texcoord[0] - a.texcoord[0];
+    d1[4] = c.texcoord[1] - a.texcoord[1];
 
-            if (sides[i] == SIDE_ON && sides[i+1] == SIDE_BACK)
-            {
-                out.edgeFlags[out.numVerts] = 1;
-            } 
-            else
-            {
-                out.edgeFlags[out.numVerts] = in.edgeFlags[i];
-            }
+    float area = d0[3] * d1[4] - d0[4] * d1[3];
+    float inva = 1.0f / area;
 
-            out.numVerts++;
-        }
+    Vector3 temp(
+        (d0[0] * d1[4] - d0[4] * d1[0]) * inva,
+        (d0[1] * d1[4] - d0[4] * d1[1]) * inva,
+        (d0[2] * d1[4] - d0[4] * d1[2]) * inva
+    );
 
-        if ((sides[i] == SIDE_FRONT && sides[i+1] == SIDE_BACK) || 
-            (sides[i] == SIDE_BACK && sides[i+1] == SIDE_FRONT))
-        {
-            // generate a split point
-            Vector3& p2 = in.verts[i+1];
-            
-            float dot = dists[i] / (dists[i]-dists[i+1]);
+    temp.normalise();
 
-            Vector3 mid;
+    texVec[0].x() = temp.x();
+    texVec[0].y() = temp.y();
+    texVec[0].z() = temp.z();
 
-            for (int j = 0; j < 3; ++j)
-            {
-                mid[j] = p1[j] + dot*(p2[j] - p1[j]);
-            }
-                
-            out.verts[out.numVerts] = mid;
+    texVec[0][3] = tri.v[0].vertex.dot(texVec[0].getVector3()) - tri.v[0].texcoord[0];
 
-            // set the edge flag
-            if (sides[i+1] != SIDE_FRONT)
-            {
-                out.edgeFlags[out.numVerts] = 1;
-            } 
-            else 
-            {
-                out.edgeFlags[out.numVerts] = in.edgeFlags[i];
-            }
+    temp[0] = (d0[3] * d1[0] - d0[0] * d1[3]) * inva;
+    temp[1] = (d0[3] * d1[1] - d0[1] * d1[3]) * inva;
+    temp[2] = (d0[3] * d1[2] - d0[2] * d1[3]) * inva;
 
-            out.numVerts++;
-        }
-    }
+    temp.normalise();
 
-    return inNum ^ 1;
+    texVec[1].x() = temp.x();
+    texVec[1].y() = temp.y();
+    texVec[1].z() = temp.z();
+    texVec[1][3] = tri.v[0].vertex.dot(texVec[0].getVector3()) - tri.v[0].texcoord[1];
 }
 
-bool ProcCompiler::clipTriangleToLight(const Vector3& a, const Vector3& b, const Vector3& c, int planeBits, const Plane3 frustum[6])
+// TODO: Make this a member method of ProcTri
+// Regenerate the texcoords and colors on a fragmented tri from the plane equations
+void triVertsFromOriginal(ProcTri& tri, const ProcTri& original)
 {
-    ClipTri pingPong[2];
+    float denom = ProcWinding::getTriangleArea(original.v[0].vertex, original.v[1].vertex, original.v[2].vertex);
 
-    pingPong[0].numVerts = 3;
-    pingPong[0].edgeFlags[0] = 0;
-    pingPong[0].edgeFlags[1] = 0;
-    pingPong[0].edgeFlags[2] = 0;
-    pingPong[0].verts[0] = a;
-    pingPong[0].verts[1] = b;
-    pingPong[0].verts[2] = c;
+    if (denom == 0)
+    {
+        return;     // original was degenerate, so it doesn't matter
+    }
+    
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        // find the barycentric coordinates
+        float a = ProcWinding::getTriangleArea(tri.v[i].vertex, original.v[1].vertex, original.v[2].vertex ) / denom;
+        float b = ProcWinding::getTriangleArea(tri.v[i].vertex, original.v[2].vertex, original.v[0].vertex ) / denom;
+        float c = ProcWinding::getTriangleArea(tri.v[i].vertex, original.v[0].vertex, original.v[1].vertex ) / denom;
 
-    int p = 0;
+        // regenerate the interpolated values
+        tri.v[i].texcoord[0] = a * original.v[0].texcoord[0] + b * original.v[1].texcoord[0] + c * original.v[2].texcoord[0];
+        tri.v[i].texcoord[1] = a * original.v[0].texcoord[1] + b * original.v[1].texcoord[1] + c * original.v[2].texcoord[1];
 
-    for (int i = 0 ; i < 6 ; ++i)
-    {
-        if (planeBits & ( 1 << i ))
+        for (std::size_t j = 0; j < 3; ++j)
         {
-            p = chopWinding(pingPong, p, frustum[i]);
-
-            if (pingPong[p].numVerts < 1)
-            {
-                return false;
-            }
+            tri.v[i].normal[j] = a * original.v[0].normal[j] + b * original.v[1].normal[j] + c * original.v[2].normal[j];
         }
-    }
 
-    ClipTri& ct = pingPong[p];
-
-    // copy the clipped points out to shadowVerts
-    if (_numShadowVerts + ct.numVerts * 2 > MAX_SHADOW_VERTS)
-    {
-        _overflowed = true;
-        return false;
+        tri.v[i].normal.normalise();
     }
+}
 
-    int base = static_cast<int>(_numShadowVerts);
+inline ProcTris windingToTriList(const ProcWinding& w, const ProcTri& originalTri)
+{
+    assert(!w.empty());
 
-    for (std::size_t i = 0; i < ct.numVerts; ++i)
-    {
-        _shadowVerts[base + i*2].getVector3() = ct.verts[i];
-    }
-    _numShadowVerts += ct.numVerts * 2;
+    ProcTris triList;
+    triList.reserve(w.size());
 
-    if (_numShadowIndices + 3 * (ct.numVerts - 2) > MAX_SHADOW_INDEXES) 
+    // The fan is emitted in reverse order
+    for (std::size_t i = w.size(); i-- > 2; )
     {
-        _overflowed = true;
-        return false;
-    }
+        triList.push_back(originalTri);
 
-    for (int i = 2; i < ct.numVerts; i++)
-    {
-        _shadowIndices[_numShadowIndices++] = base + i * 2;
-        _shadowIndices[_numShadowIndices++] = base + ( i - 1 ) * 2;
-        _shadowIndices[_numShadowIndices++] = base;
-    }
+        ProcTri& tri = triList.back();
 
-    // any edges that were created by the clipping process will
-    // have a silhouette quad created for it, because it is one
-    // of the exterior bounds of the shadow volume
-    for (int i = 0; i < ct.numVerts; i++)
-    {
-        if (ct.edgeFlags[i])
+        for (std::size_t j = 0; j < 3; ++j)
         {
-            if (_numClipSilEdges == MAX_CLIP_SIL_EDGES)
+            if (j == 0)
             {
-                break;
+                tri.v[j].vertex = w[0].vertex;
             }
-
-            _clipSilEdges[_numClipSilEdges][0] = base + i * 2;
-
-            if (i == ct.numVerts - 1)
+            else if (j == 1)
             {
-                _clipSilEdges[_numClipSilEdges][1] = base;
+                tri.v[j].vertex = w[i-1].vertex;
             } 
-            else 
+            else
             {
-                _clipSilEdges[_numClipSilEdges][1] = base + (i + 1) * 2;
+                tri.v[j].vertex = w[i].vertex;
             }
-
-            _numClipSilEdges++;
         }
-    }
-
-    return true;
-}
-
-namespace
-{
-
-/* 
-To make sure the triangulations of the sil edges is consistant,
-we need to be able to order two points.  We don't care about how
-they compare with any other points, just that when the same two
-points are passed in (in either order), they will always specify
-the same one as leading.
-
-Currently we need to have separate faces in different surfaces
-order the same way, so we must look at the actual coordinates.
-If surfaces are ever guaranteed to not have to edge match with
-other surfaces, we could just compare indexes.
-===============
-*/
-static bool pointsOrdered(const Vector3& a, const Vector3& b)
-{
-    // vectors that wind up getting an equal hash value will
-    // potentially cause a misorder, which can show as a couple
-    // crack pixels in a shadow
-
-    // scale by some odd numbers so -8, 8, 8 will not be equal
-    // to 8, -8, 8
-
-    // in the very rare case that these might be equal, all that would
-    // happen is an oportunity for a tiny rasterization shadow crack
-    float i = a[0] + a[1]*127 + a[2]*1023;
-    float j = b[0] + b[1]*127 + b[2]*1023;
-
-    return i < j;
-}
 
-}
-
-void ProcCompiler::addClipSilEdges()
-{
-    // don't allow it to overflow
-    if (_numShadowIndices + _numClipSilEdges * 6 > MAX_SHADOW_INDEXES)
-    {
-        _overflowed = true;
-        return;
+        triVertsFromOriginal(tri, originalTri);
     }
 
-    for (std::size_t i = 0; i < _numClipSilEdges; i++)
-    {
-        int v1 = _clipSilEdges[i][0];
-        int v2 = _clipSilEdges[i][1];
-        int v1_back = v1 + 1;
-        int v2_back = v2 + 1;
-
-        if (pointsOrdered(_shadowVerts[v1].getVector3(), _shadowVerts[v2].getVector3()))
-        {
-            _shadowIndices[_numShadowIndices++] = v1;
-            _shadowIndices[_numShadowIndices++] = v2;
-            _shadowIndices[_numShadowIndices++] = v1_back;
-            _shadowIndices[_numShadowIndices++] = v2;
-            _shadowIndices[_numShadowIndices++] = v2_back;
-            _shadowIndices[_numShadowIndices++] = v1_back;
-        } 
-        else
-        {
-            _shadowIndices[_numShadowIndices++] = v1;
-            _shadowIndices[_numShadowIndices++] = v2;
-            _shadowIndices[_numShadowIndices++] = v2_back;
-            _shadowIndices[_numShadowIndices++] = v1;
-            _shadowIndices[_numShadowIndices++] = v2_back;
-            _shadowIndices[_numShadowIndices++] = v1_back;
-        }
-    }
+    return triList;
 }
 
-bool ProcCompiler::clipLineToLight(const Vector3& a, const Vector3& b, const Plane3 frustum[4], Vector3& p1, Vector3& p2)
+void ProcCompiler::clipTriIntoTreeRecursively(const ProcWinding& winding, const ProcTri& originalTri, 
+                                              const BspTreeNodePtr& node, AreaTriLists& output)
 {
-    p1 = a;
-    p2 = b;
+    assert(!winding.empty());
 
-    // clip it
-    for (int j = 0; j < 6 ; ++j)
+    if (node->planenum != PLANENUM_LEAF)
     {
-        float d1 = frustum[j].distanceToPoint(p1);
-        float d2 = frustum[j].distanceToPoint(p2);
+        ProcWinding front;
+        ProcWinding back;
 
-        // if both on or in front, not clipped to this plane
-        if (d1 > -LIGHT_CLIP_EPSILON && d2 > -LIGHT_CLIP_EPSILON)
-        {
-            continue;
-        }
+        winding.split(_planes->getPlane(node->planenum), ON_EPSILON, front, back);
 
-        // if one is behind and the other isn't clearly in front, the edge is clipped off
-        if (d1 <= -LIGHT_CLIP_EPSILON && d2 < LIGHT_CLIP_EPSILON)
+        if (!front.empty())
         {
-            return false;
+            clipTriIntoTreeRecursively(front, originalTri, node->children[0], output);
         }
 
-        if (d2 <= -LIGHT_CLIP_EPSILON && d1 < LIGHT_CLIP_EPSILON) 
+        if (!back.empty())
         {
-            return false;
+            clipTriIntoTreeRecursively(back, originalTri, node->children[1], output);
         }
 
-        // clip it, keeping the negative side
-        Vector3& clip = (d1 < 0) ? p1 : p2;
+        return;
+    }
 
-#if 0
-        if ( idMath::Fabs(d1 - d2) < 0.001 ) {
-            d2 = d1 - 0.1;
-        }
-#endif
+    // if opaque leaf, don't add
+    if (!node->opaque && node->area != MULTIAREA_CROSS)
+    {
+        Plane3 plane(originalTri.v[1].vertex, originalTri.v[0].vertex, originalTri.v[2].vertex); // Plane(p1, p0, p2) call convention to match D3
 
-        float f = d1 / (d1 - d2);
+        Vector4 texVec[2];
+        getTexVecForTri(texVec, originalTri);
 
-        clip[0] = p1[0] + f * (p2[0] - p1[0]);
-        clip[1] = p1[1] + f * (p2[1] - p1[1]);
-        clip[2] = p1[2] + f * (p2[2] - p1[2]);
+        // The plane number is resolved when the list is added to the area
+        output.push_back(AreaTriList(plane, node->area, texVec));
+        output.back().tris = windingToTriList(winding, originalTri);
     }
-
-    return true;    // retain a fragment
 }
 
-void ProcCompiler::addSilEdges(const Surface& tri, unsigned short* pointCull, const Plane3 frustum[6], 
-    int* remap, unsigned char* faceCastsShadow)
+void ProcCompiler::addMapTrisToAreas(const ProcTris& tris, const ProcEntity& entity, AreaTriLists& output)
 {
-    std::size_t numPlanes = tri.indices.size() / 3;
-
-    // add sil edges for any true silhouette boundaries on the surface
-    for (std::size_t i = 0; i < tri.silEdges.size(); ++i)
+    for (ProcTris::const_iterator tri = tris.begin(); tri != tris.end(); ++tri)
     {
-        const Surface::SilEdge& sil = tri.silEdges[i];
-
-        if (sil.p1 < 0 || sil.p1 > numPlanes || sil.p2 < 0 || sil.p2 > numPlanes)
-        {
-            rError() << "Bad sil planes" << std::endl;
-            return;
-        }
-
-        // an edge will be a silhouette edge if the face on one side
-        // casts a shadow, but the face on the other side doesn't.
-        // "casts a shadow" means that it has some surface in the projection,
-        // not just that it has the correct facing direction
-        // This will cause edges that are exactly on the frustum plane
-        // to be considered sil edges if the face inside casts a shadow.
-        if (!(faceCastsShadow[sil.p1] ^ faceCastsShadow[sil.p2]))
+        // skip degenerate triangles from pinched curves
+        if (ProcWinding::getTriangleArea(tri->v[0].vertex, tri->v[1].vertex, tri->v[2].vertex) <= 0)
         {
             continue;
         }
 
-        // if the edge is completely off the negative side of
-        // a frustum plane, don't add it at all.  This can still
-        // happen even if the face is visible and casting a shadow
-        // if it is partially clipped
-        if (EDGE_CULLED(sil.v1, sil.v2))
+        // FIXME: fullCarve can be disabled, is enabled by default
+        if (true/* dmapGlobals.fullCarve*/)
         {
+            // always fragment into areas
+            ProcWinding w(tri->v[0].vertex, tri->v[1].vertex, tri->v[2].vertex);
+            clipTriIntoTreeRecursively(w, *tri, entity.tree.head, output);
             continue;
         }
 
-        std::size_t v1 = 0;
-        std::size_t v2 = 0;
-
-        // see if the edge needs to be clipped
-        if (EDGE_CLIPPED(sil.v1, sil.v2))
-        {
-            if (_numShadowVerts + 4 > MAX_SHADOW_VERTS)
-            {
-                _overflowed = true;
-                return;
-            }
-
-            v1 = _numShadowVerts;
-            v2 = v1 + 2;
+        ProcWinding w(tri->v[0].vertex, tri->v[1].vertex, tri->v[2].vertex);
 
-            if (!clipLineToLight(tri.vertices[sil.v1].vertex, tri.vertices[sil.v2].vertex, 
-                frustum, _shadowVerts[v1].getVector3(), _shadowVerts[v2].getVector3()))
-            {
-                continue;   // clipped away
-            }
+        std::size_t area = checkWindingInAreasRecursively(w, entity.tree.head);
 
-            _numShadowVerts += 4;
-        } 
-        else 
+        if (area != MULTIAREA_CROSS)
         {
-            // use the entire edge
-            v1 = remap[sil.v1];
-            v2 = remap[sil.v2];
-            if ( v1 < 0 || v2 < 0 )
-            {
-                rError() << "addSilEdges: bad remap[]" << std::endl;
-                return;
-            }
-        }
+            // put in single area
+            Plane3 plane(tri->v[1].vertex, tri->v[0].vertex, tri->v[2].vertex); // Plane(p1, p0, p2) call convention to match D3
 
-        // don't overflow
-        if (_numShadowIndices + 6 > MAX_SHADOW_INDEXES)
-        {
-            _overflowed = true;
-            return;
-        }
+            Vector4 texVec[2];
+            getTexVecForTri(texVec, *tri);
 
-        // we need to choose the correct way of triangulating the silhouette quad
-        // consistantly between any two points, no matter which order they are specified.
-        // If this wasn't done, slight rasterization cracks would show in the shadow
-        // volume when two sil edges were exactly coincident
-        if (faceCastsShadow[sil.p2])
-        {
-            if (pointsOrdered(_shadowVerts[v1].getVector3(), _shadowVerts[v2].getVector3()))
-            {
-                _shadowIndices[_numShadowIndices++] = v1;
-                _shadowIndices[_numShadowIndices++] = v1+1;
-                _shadowIndices[_numShadowIndices++] = v2;
-                _shadowIndices[_numShadowIndices++] = v2;
-                _shadowIndices[_numShadowIndices++] = v1+1;
-                _shadowIndices[_numShadowIndices++] = v2+1;
-            } 
-            else
-            {
-                _shadowIndices[_numShadowIndices++] = v1;
-                _shadowIndices[_numShadowIndices++] = v2+1;
-                _shadowIndices[_numShadowIndices++] = v2;
-                _shadowIndices[_numShadowIndices++] = v1;
-                _shadowIndices[_numShadowIndices++] = v1+1;
-                _shadowIndices[_numShadowIndices++] = v2+1;
-            }
-        }
+            output.push_back(AreaTriList(plane, area, texVec));
+            output.back().tris.push_back(*tri); // list with 1 triangle
+        } 
         else
-        { 
-            if (pointsOrdered(_shadowVerts[v1].getVector3(), _shadowVerts[v2].getVector3()))
-            {
-                _shadowIndices[_numShadowIndices++] = v1;
-                _shadowIndices[_numShadowIndices++] = v2;
-                _shadowIndices[_numShadowIndices++] = v1+1;
-                _shadowIndices[_numShadowIndices++] = v2;
-                _shadowIndices[_numShadowIndices++] = v2+1;
-                _shadowIndices[_numShadowIndices++] = v1+1;
-            } 
-            else
-            {
-                _shadowIndices[_numShadowIndices++] = v1;
-                _shadowIndices[_numShadowIndices++] = v2;
-                _shadowIndices[_numShadowIndices++] = v2+1;
-                _shadowIndices[_numShadowIndices++] = v1;
-                _shadowIndices[_numShadowIndices++] = v2+1;
-                _shadowIndices[_numShadowIndices++] = v1+1;
-            }
+        {
+            // fragment into areas
+            clipTriIntoTreeRecursively(w, *tri, entity.tree.head, output);
         }
     }
 }
 
-namespace
-{
-
-inline void getLightProjectionMatrix(const Vector3& origin, const Plane3& rearPlane, Vector4 mat[4])
-{
-    // calculate the homogeneous light vector
-    Vector4 lv(origin, 1);
-
-    float lg = Vector4(rearPlane.normal(), -rearPlane.dist()).dot(lv);
-
-    // outer product
-    mat[0][0] = lg - rearPlane.normal()[0] * lv[0];
-    mat[0][1] = -rearPlane.normal()[1] * lv[0];
-    mat[0][2] = -rearPlane.normal()[2] * lv[0];
-    mat[0][3] = rearPlane.dist() * lv[0];
-
-    mat[1][0] = -rearPlane.normal()[0] * lv[1];
-    mat[1][1] = lg - rearPlane.normal()[1] * lv[1];
-    mat[1][2] = -rearPlane.normal()[2] * lv[1];
-    mat[1][3] = rearPlane.dist() * lv[1];
-
-    mat[2][0] = -rearPlane.normal()[0] * lv[2];
-    mat[2][1] = -rearPlane.normal()[1] * lv[2];
-    mat[2][2] = lg - rearPlane.normal()[2] * lv[2];
-    mat[2][3] = rearPlane.dist() * lv[2];
-
-    mat[3][0] = -rearPlane.normal()[0] * lv[3];
-    mat[3][1] = -rearPlane.normal()[1] * lv[3];
-    mat[3][2] = -rearPlane.normal()[2] * lv[3];
-    mat[3][3] = lg - (-rearPlane.dist() * lv[3]);
-}
-
-}
-
-void ProcCompiler::projectPointsToFarPlane(const Matrix4& transform, const ProcLight& light, 
-    const Plane3& lightPlaneLocal, std::size_t firstShadowVert, std::size_t numShadowVerts)
+void ProcCompiler::clipPrimitiveIntoAreas(const ProcPrimitive& prim, const ProcEntity& entity, AreaTriLists& output)
 {
-    Vector3 lv = transform.transformPoint(light.getGlobalLightOrigin());
-
-    Vector4 mat[4];
-    getLightProjectionMatrix(lv, lightPlaneLocal, mat);
+    const ProcBrushPtr& brush = prim.brush;
 
-    // make a projected copy of the even verts into the odd spots
-    Vector4* in = &_shadowVerts[firstShadowVert];
+    if (!brush)
+    {
+        // add curve triangles
+        addMapTrisToAreas(prim.patch, entity, output);
+        return;
+    }
 
-    for (std::size_t i = firstShadowVert; i < numShadowVerts; i+= 2, in += 2)
+    // clip in brush sides
+    for (std::size_t i = 0; i < brush->sides.size(); ++i)
     {
-        in[0].w() = 1;
+        const ProcFace& side = brush->sides[i];
 
-        float w = in->getVector3().dot(mat[3].getVector3()) + mat[3][3];
-        
-        if (w == 0)
+        if (side.visibleHull.empty())
         {
-            in[1] = in[0];
             continue;
         }
 
-        float oow = 1.0f / w;
-
-        in[1].x() = (in->getVector3().dot(mat[0].getVector3()) + mat[0][3]) * oow;
-        in[1].y() = (in->getVector3().dot(mat[1].getVector3()) + mat[1][3]) * oow;
-        in[1].z() = (in->getVector3().dot(mat[2].getVector3()) + mat[2][3]) * oow;
-        in[1].w() = 1;
+        putWindingIntoAreasRecursively(side.visibleHull, side, entity.tree.head, output);
     }
 }
 
-void ProcCompiler::createShadowVolumeInFrustum(const Matrix4& transform, const Surface& tri,
-    const ProcLight& light, const Vector3& lightOrigin, const Plane3 frustum[6],
-    const Plane3 &farPlane, bool makeClippedPlanes, int* remap, unsigned char* faceCastsShadow,
-    std::vector<unsigned char>& globalFacing)
+std::vector<std::size_t> ProcCompiler::getInlinedModelEntities()
 {
-#if 0
-    int     cullBits;
-#endif
+    std::vector<std::size_t> entityNums;
 
-    unsigned short* pointCull = (unsigned short*)alloca(tri.vertices.size() * sizeof(unsigned short));
-
-    // test the vertexes for inside the light frustum, which will allow
-    // us to completely cull away some triangles from consideration.
-    calcPointCull(tri, frustum, pointCull, remap);
-
-    // this may not be the first frustum added to the volume
-    std::size_t firstShadowIndex = _numShadowIndices;
-    std::size_t firstShadowVert = _numShadowVerts;
+    if (_procFile->entities.empty())
+    {
+        return entityNums;
+    }
 
-    // decide which triangles front shadow volumes, clipping as needed
-    _numClipSilEdges = 0;
+    IEntityNodePtr worldspawn = _procFile->entities[0]->mapEntity;
 
-    std::size_t numTris = tri.indices.size() / 3;
+    bool inlineAll = worldspawn->getEntity().getKeyValue("inlineAllStatics") == "1";
 
-    for (std::size_t i = 0; i < numTris; ++i)
+    for (std::size_t eNum = 1; eNum < _procFile->entities.size(); ++eNum)
     {
-        faceCastsShadow[i] = 0; // until shown otherwise
+        Entity& mapEnt = _procFile->entities[eNum]->mapEntity->getEntity();
 
-        // if it isn't facing the right way, don't add it
-        // to the shadow volume
-        if (globalFacing[i])
+        if (mapEnt.getKeyValue("classname") != "func_static")
         {
             continue;
         }
 
-        int i1 = tri.silIndexes[i*3 + 0];
-        int i2 = tri.silIndexes[i*3 + 1];
-        int i3 = tri.silIndexes[i*3 + 2];
-
-        // if all the verts are off one side of the frustum,
-        // don't add any of them
-        if (pointCull[i1] & pointCull[i2] & pointCull[i3] & 0x3f)
+        if (mapEnt.getKeyValue("inline") != "1" && !inlineAll)
         {
             continue;
         }
 
-        // make sure the verts that are not on the negative sides
-        // of the frustum are copied over.
-        // we need to get the original verts even from clipped triangles
-        // so the edges reference correctly, because an edge may be unclipped
-        // even when a triangle is clipped.
-        if (_numShadowVerts + 6 > MAX_SHADOW_VERTS)
-        {
-            _overflowed = true;
-            return;
-        }
-
-        if (!POINT_CULLED(i1) && remap[i1] == -1)
-        {
-            remap[i1] = static_cast<int>(_numShadowVerts);
-            _shadowVerts[_numShadowVerts].getVector3() = tri.vertices[i1].vertex;
-            _numShadowVerts += 2;
-        }
-
-        if (!POINT_CULLED(i2) && remap[i2] == -1)
+        if (mapEnt.getKeyValue("model").empty())
         {
-            remap[i2] = static_cast<int>(_numShadowVerts);
-            _shadowVerts[_numShadowVerts].getVector3() = tri.vertices[i2].vertex;
-            _numShadowVerts += 2;
-        }
-
-        if (!POINT_CULLED(i3) && remap[i3] == -1)
-        {
-            remap[i3] = static_cast<int>(_numShadowVerts);
-            _shadowVerts[_numShadowVerts].getVector3() = tri.vertices[i3].vertex;
-            _numShadowVerts += 2;
+            continue;
         }
 
-        // clip the triangle if any points are on the negative sides
-        if ( TRIANGLE_CLIPPED( i1, i2, i3 ) )
-        {
-            int cullBits = ( ( pointCull[ i1 ] ^ 0xfc0 ) | ( pointCull[ i2 ] ^ 0xfc0 ) | ( pointCull[ i3 ] ^ 0xfc0 ) ) >> 6;
-
-            // this will also define clip edges that will become silhouette planes
-            if (clipTriangleToLight(tri.vertices[i1].vertex, tri.vertices[i2].vertex, tri.vertices[i3].vertex, cullBits, frustum))
-            {
-                faceCastsShadow[i] = 1;
-            }
-        } 
-        else
-        {
-            // instead of overflowing or drawing a streamer shadow, don't draw a shadow at all
-            if (_numShadowIndices + 3 > MAX_SHADOW_INDEXES)
-            {
-                _overflowed = true;
-                return;
-            }
+        entityNums.push_back(eNum);
+    }
 
-            if (remap[i1] == -1 || remap[i2] == -1 || remap[i3] == -1)
-            {
-                rError() << "createShadowVolumeInFrustum: bad remap[]" << std::endl;
-                return;
-            }
+    return entityNums;
+}
 
-            _shadowIndices[_numShadowIndices++] = remap[i3];
-            _shadowIndices[_numShadowIndices++] = remap[i2];
-            _shadowIndices[_numShadowIndices++] = remap[i1];
-            faceCastsShadow[i] = 1;
-        }
-    }
+void ProcCompiler::clipInlinedModelIntoAreas(const ProcEntity& inlinedEntity, const ProcEntity& entity, 
+                                             AreaTriLists& output)
+{
+    Entity& mapEnt = inlinedEntity.mapEntity->getEntity();
 
-    // add indexes for the back caps, which will just be reversals of the
-    // front caps using the back vertexes
-    std::size_t numCapIndexes = _numShadowIndices - firstShadowIndex;
+    std::string modelName = mapEnt.getKeyValue("model");
 
-    // if no faces have been defined for the shadow volume,
-    // there won't be anything at all
-    if (numCapIndexes == 0)
+    model::IModelPtr model = GlobalModelCache().getModel(modelName);
+    
+    if (model == NULL)
     {
+        rWarning() << "Cannot inline entity " << mapEnt.getKeyValue("name") <<
+            " since the model cannot be loaded: " << modelName << std::endl;
         return;
     }
 
-    //--------------- off-line processing ------------------
-
-    // if we are running from dmap, perform the (very) expensive shadow optimizations
-    // to remove internal sil edges and optimize the caps
-    if (false/*callOptimizer*/) // greebo: defaults to false for the moment being
-    {
-#if 0
-        optimizedShadow_t opt;
-        
-        // project all of the vertexes to the shadow plane, generating
-        // an equal number of back vertexes
-//      R_ProjectPointsToFarPlane( ent, light, farPlane, firstShadowVert, numShadowVerts );
-
-        opt = SuperOptimizeOccluders( shadowVerts, shadowIndexes + firstShadowIndex, numCapIndexes, farPlane, lightOrigin );
-
-        // pull off the non-optimized data
-        numShadowIndexes = firstShadowIndex;
-        numShadowVerts = firstShadowVert;
-
-        // add the optimized data
-        if ( numShadowIndexes + opt.totalIndexes > MAX_SHADOW_INDEXES 
-            || numShadowVerts + opt.numVerts > MAX_SHADOW_VERTS ) {
-            overflowed = true;
-            common->Printf( "WARNING: overflowed MAX_SHADOW tables, shadow discarded\n" );
-            Mem_Free( opt.verts );
-            Mem_Free( opt.indexes );
-            return;
-        }
-
-        for ( i = 0 ; i < opt.numVerts ; i++ ) {
-            shadowVerts[numShadowVerts+i][0] = opt.verts[i][0];
-            shadowVerts[numShadowVerts+i][1] = opt.verts[i][1];
-            shadowVerts[numShadowVerts+i][2] = opt.verts[i][2];
-            shadowVerts[numShadowVerts+i][3] = 1;
-        }
-        for ( i = 0 ; i < opt.totalIndexes ; i++ ) {
-            int index = opt.indexes[i];
-            if ( index < 0 || index > opt.numVerts ) {
-                common->Error( "optimized shadow index out of range" );
-            }
-            shadowIndexes[numShadowIndexes+i] = index + numShadowVerts;
-        }
-
-        numShadowVerts += opt.numVerts;
-        numShadowIndexes += opt.totalIndexes;
-
-        // note the index distribution so we can sort all the caps after all the sils
-        indexRef[indexFrustumNumber].frontCapStart = firstShadowIndex;
-        indexRef[indexFrustumNumber].rearCapStart = firstShadowIndex+opt.numFrontCapIndexes;
-        indexRef[indexFrustumNumber].silStart = firstShadowIndex+opt.numFrontCapIndexes+opt.numRearCapIndexes;
-        indexRef[indexFrustumNumber].end = numShadowIndexes;
-        indexFrustumNumber++;
+    rMessage() << "inlining " << mapEnt.getKeyValue("name") << std::endl;
+    
+    // get the rotation matrix in either full form, or single angle form
+    std::string rotation = mapEnt.getKeyValue("rotation");
 
-        Mem_Free( opt.verts );
-        Mem_Free( opt.indexes );
-#endif
-        return;
-    }
+    Matrix4 axis;
 
-    //--------------- real-time processing ------------------
+    if (rotation.empty())
+    {
+        float angle = string::convert<float>(mapEnt.getKeyValue("angle"));
 
-    // the dangling edge "face" is never considered to cast a shadow,
-    // so any face with dangling edges that casts a shadow will have
-    // it's dangling sil edge trigger a sil plane
-    faceCastsShadow[numTris] = 0;
+        // idMath::AngleNormalize360
+        if (angle >= 360.0f || angle < 0.0f)
+        {
+            angle -= floor(angle / 360.0f) * 360.0f;
+        }
 
-    // instead of overflowing or drawing a streamer shadow, don't draw a shadow at all
-    // if we ran out of space
-    if (_numShadowIndices + numCapIndexes > MAX_SHADOW_INDEXES)
+        axis = Matrix4::getRotationAboutZDegrees(angle);
+    }
+    else
     {
-        _overflowed = true;
-        return;
+        axis = Matrix4::getRotation(rotation);
     }
 
-    for (std::size_t i = 0; i < numCapIndexes; i += 3)
+    Vector3 origin = string::convert<Vector3>(mapEnt.getKeyValue("origin"));
+
+    for (int i = 0; i < model->getSurfaceCount(); ++i)
     {
-        _shadowIndices[_numShadowIndices + i + 0] = _shadowIndices[firstShadowIndex + i + 2] + 1;
-        _shadowIndices[_numShadowIndices + i + 1] = _shadowIndices[firstShadowIndex + i + 1] + 1;
-        _shadowIndices[_numShadowIndices + i + 2] = _shadowIndices[firstShadowIndex + i + 0] + 1;
-    }
+        const model::IModelSurface& surface = model->getSurface(i);
+
+        MaterialPtr material = GlobalMaterialManager().getMaterialForName(surface.getDefaultMaterial());
 
-    _numShadowIndices += numCapIndexes;
+        ProcTris tris;
 
-    // c_caps += numCapIndexes * 2;
+        int numTris = surface.getNumTriangles();
+        for (int j = 0; j < numTris; ++j)
+        {
+            tris.push_back(ProcTri());
+            ProcTri& tri = tris.back();
 
-    std::size_t preSilIndexes = _numShadowIndices;
+            tri.material = material;
+            
+            if (material->isDiscrete())
+            {
+                tri.mergeSurf = &surface;
+            }
 
-    // if any triangles were clipped, we will have a list of edges
-    // on the frustum which must now become sil edges
-    if (makeClippedPlanes)
-    {
-        addClipSilEdges();
-    }
+            model::ModelPolygon poly = surface.getPolygon(j);
+            
+            tri.v[0].vertex = axis.transformPoint(poly.a.vertex) + origin;
+            tri.v[0].normal = axis.transformDirection(poly.a.normal);
+            tri.v[0].texcoord = poly.a.texcoord;
 
-    // any edges that are a transition between a shadowing and
-    // non-shadowing triangle will cast a silhouette edge
-    addSilEdges(tri, pointCull, frustum, remap, faceCastsShadow);
+            tri.v[1].vertex = axis.transformPoint(poly.b.vertex) + origin;
+            tri.v[1].normal = axis.transformDirection(poly.b.normal);
+            tri.v[1].texcoord = poly.b.texcoord;
 
-    // c_sils += numShadowIndexes - preSilIndexes;
+            tri.v[2].vertex = axis.transformPoint(poly.c.vertex) + origin;
+            tri.v[2].normal = axis.transformDirection(poly.c.normal);
+            tri.v[2].texcoord = poly.c.texcoord;
 
-    // project all of the vertexes to the shadow plane, generating
-    // an equal number of back vertexes
-    projectPointsToFarPlane(transform, light, farPlane, firstShadowVert, _numShadowVerts);
+            // greebo: This is probably the point where the normals should be renormalised to
+            // fix the weird lighting when applying "rotation hack scaling"
+        }
 
-    // note the index distribution so we can sort all the caps after all the sils
-    _indexRef[_indexFrustumNumber].frontCapStart = firstShadowIndex;
-    _indexRef[_indexFrustumNumber].rearCapStart = firstShadowIndex+numCapIndexes;
-    _indexRef[_indexFrustumNumber].silStart = preSilIndexes;
-    _indexRef[_indexFrustumNumber].end = _numShadowIndices;
-    _indexFrustumNumber++;
+        addMapTrisToAreas(tris, entity, output);
+    }
 }
 
-Surface ProcCompiler::createShadowVolume(const Matrix4& transform, const Surface& tri, const ProcLight& light,
-                             ShadowGenType optimize, Surface::CullInfo& cullInfo)
+void ProcCompiler::setContributionAreas(DmapCache::AreaContribution& contribution, const AreaTriLists& triLists)
 {
-#if 0
-    if ( !r_shadows.GetBool() ) {
-        return NULL;
-    }
-#endif
+    contribution.areas.clear();
 
-    if (tri.silEdges.empty() || tri.indices.empty() || tri.vertices.empty())
+    for (AreaTriLists::const_iterator i = triLists.begin(); i != triLists.end(); ++i)
     {
-        return Surface();
+        contribution.areas.push_back(i->areaNum);
     }
 
-    //tr.pc.c_createShadowVolumes++;
+    std::sort(contribution.areas.begin(), contribution.areas.end());
+    contribution.areas.erase(std::unique(contribution.areas.begin(), contribution.areas.end()), 
+                             contribution.areas.end());
+}
 
-    // use the fast infinite projection in dynamic situations, which
-    // trades somewhat more overdraw and no cap optimizations for
-    // a very simple generation process
-    if (optimize == SG_DYNAMIC && true /*r_useTurboShadow.GetBool()*/)
-    {
-        // greebo: With the current settings this code won't be reached
+void ProcCompiler::putPrimitivesInAreas(ProcEntity& entity)
+{
+    rMessage() << "----- PutPrimitivesInAreas -----" << std::endl;
 
-        if (true /*tr.backEndRendererHasVertexPrograms*/ && true/*r_useShadowVertexProgram.GetBool()*/)
-        {
-             return createVertexProgramTurboShadowVolume(transform, tri, light, cullInfo);
-        } 
-        else
-        {
-            return createTurboShadowVolume(transform, tri, light, cullInfo);
-        }
-    }
+    // allocate space for surface chains for each area
+    entity.areas.resize(entity.numAreas);
+
+    // for each primitive, clip it to the non-solid leafs
+    // and divide it into different areas. The primitives are clipped in parallel,
+    // the resulting triangle lists are added to the areas in the original order.
+    std::size_t numPrimitives = entity.primitives.size();
+    std::vector<AreaTriLists> triLists(numPrimitives);
 
-    Surface newTri;
+    parallelForWithOrderedLog(*_threadPool, numPrimitives, [&](std::size_t index)
+    {
+        // Primitives are processed back to front
+        clipPrimitiveIntoAreas(entity.primitives[numPrimitives - 1 - index], entity, triLists[index]);
+    });
 
-    calcInteractionFacing(transform, tri, light, cullInfo);
+    bool isWorld = &entity == _procFile->entities[0].get();
 
-    std::size_t numFaces = tri.indices.size() / 3;
-    
-    unsigned char allFront = 1;
+    // Incremental compiles need to know which areas each world primitive and inlined model went into
+    bool recordAreas = _cache && isWorld;
 
-    for (std::size_t i = 0; i < numFaces && allFront; ++i)
+    for (std::size_t i = 0; i < triLists.size(); ++i)
     {
-        allFront &= cullInfo.facing[i];
+        if (recordAreas)
+        {
+            setContributionAreas(_worldContributions[numPrimitives - 1 - i], triLists[i]);
+        }
+
+        addAreaTriLists(entity, triLists[i]);
     }
 
-    if (allFront)
+    // optionally inline some of the func_static models
+    if (isWorld)
     {
-        // if no faces are the right direction, don't make a shadow at all
-        return Surface();
-    }
+        std::vector<std::size_t> inlined = getInlinedModelEntities();
+
+        for (std::size_t i = 0; i < inlined.size(); ++i)
+        {
+            // The model cache is not thread-safe, inlined models are processed serially
+            AreaTriLists inlinedTriLists;
+            clipInlinedModelIntoAreas(*_procFile->entities[inlined[i]], entity, inlinedTriLists);
+
+            if (recordAreas)
+            {
+                setContributionAreas(_worldContributions[numPrimitives + i], inlinedTriLists);
+            }
 
-    // clear the shadow volume
-    _numShadowIndices = 0;
-    _numShadowVerts = 0;
-    bool overflowed = false;
-    _indexFrustumNumber = 0;
-    int capPlaneBits = 0;
-    bool callOptimizer = (optimize == SG_OFFLINE);
+            addAreaTriLists(entity, inlinedTriLists);
+        }
+    }
 
-    // the facing information will be the same for all six projections
-    // from a point light, as well as for any directed lights
-    std::vector<unsigned char>& globalFacing = cullInfo.facing;
+    /*rMessage() << ("After Put Primitives in Areas\n");
 
-    unsigned char* faceCastsShadow = (unsigned char*)alloca(tri.indices.size() / 3 + 1);    // + 1 for fake dangling edge face
-    int* remap = (int*)alloca(tri.vertices.size() * sizeof(int));
+    std::size_t planes = _planes->size();
 
-    Vector3 lightOrigin = globalPointToLocal(transform, light.getGlobalLightOrigin());
-    
-    // run through all the shadow frustums, which is one for a projected light,
-    // and usually six for a point light, but point lights with centers outside
-    // the box may have less
-    for (std::size_t frustumNum = 0; frustumNum < light.numShadowFrustums; ++frustumNum)
+    for (std::size_t i = 0; i < planes; ++i)
     {
-        const ShadowFrustum& frust = light.shadowFrustums[frustumNum];
-        Plane3 frustum[6];
+        const Plane3& plane = _planes->getPlane(i);
+        rMessage() << (boost::format("Plane %d: (%f %f %f %f)\n") % i % plane.normal().x() % plane.normal().y() % plane.normal().z() % plane.dist());
+    }
 
-        // transform the planes into entity space
-        // we could share and reverse some of the planes between frustums for a minor
-        // speed increase
+    rMessage() << (boost::format("PPIA: Entity %s\n") % entity.mapEntity->getEntity().getKeyValue("name"));
 
-        // the cull test is redundant for a single shadow frustum projected light, because
-        // the surface has already been checked against the main light frustums
-        std::size_t j = 0;
+    // Print result
+    for (std::size_t a = 0; a < entity.areas.size(); ++a)
+    {
+        rMessage() << " Area " << a << ": ";
+        
+        rMessage() << entity.areas[a].groups.size() << " groups" << std::endl;
 
-        for (j = 0; j < frust.numPlanes; ++j)
+        std::size_t count = 0;
+        for (ProcArea::OptimizeGroups::const_iterator g = entity.areas[a].groups.begin(); g != entity.areas[a].groups.end(); ++g, ++count)
         {
-            frustum[j] = OptUtils::TransformPlane(frust.planes[j], transform);
-            //R_GlobalPlaneToLocal( ent->modelMatrix, frust->planes[j], frustum[j] );
-
-            // try to cull the entire surface against this frustum
-            float d = planeDistanceToBounds(tri.bounds, frustum[j]);
+            rMessage() << (boost::format("  Group %d, plane %d, %d tris\n") % count % g->planeNum % g->triList.size());
 
-            if (d < -LIGHT_CLIP_EPSILON)
+            std::size_t triCount = 0;
+            for (ProcTris::const_iterator t = g->triList.begin(); t != g->triList.end(); ++t, ++triCount)
             {
-                break;
+                rMessage() << (boost::format("  Tri %d: (%f %f %f) (%f %f %f) (%f %f %f)\n") % triCount % 
+                    t->v[0].vertex.x() % t->v[0].vertex.y() % t->v[0].vertex.z() %
+                    t->v[1].vertex.x() % t->v[1].vertex.y() % t->v[1].vertex.z() %
+                    t->v[2].vertex.x() % t->v[2].vertex.y() % t->v[2].vertex.z());
             }
         }
+    }*/
+}
 
-        if (j != frust.numPlanes)
-        {
-            continue;
-        }
+void ProcCompiler::boundOptimizeGroup(ProcOptimizeGroup& group)
+{
+    group.bounds = AABB();
+
+    for (ProcTris::reverse_iterator tri = group.triList.rbegin(); tri != group.triList.rend(); ++tri)
+    {
+        group.bounds.includePoint(tri->v[0].vertex);
+        group.bounds.includePoint(tri->v[1].vertex);
+        group.bounds.includePoint(tri->v[2].vertex);
+    }
+}
+
+void ProcCompiler::clipTriByLight(const ProcLight& light, const ProcTri& tri, ProcTris& in, ProcTris& out)
+{
+    in.clear();
+    out.clear();
+
+    // clip this winding to the light
+    ProcWinding inside(tri.v[0].vertex, tri.v[1].vertex, tri.v[2].vertex);
+    ProcWinding outside[6];
 
-        // we need to check all the triangles
-        std::size_t oldFrustumNumber = _indexFrustumNumber;
+    bool hasOutside = false;
+    ProcWinding oldInside;
 
-        createShadowVolumeInFrustum(transform, tri, light, lightOrigin, frustum, frustum[5], frust.makeClippedPlanes, remap, faceCastsShadow, globalFacing);
+    for (std::size_t i = 0; i < 6 ; ++i)
+    {
+        oldInside = inside;
 
-        // if we couldn't make a complete shadow volume, it is better to
-        // not draw one at all, avoiding streamer problems
-        if (overflowed)
+        if (!oldInside.empty())
         {
-            return Surface();
+            oldInside.split(light.getFrustumPlane(i), 0, outside[i], inside);
+            oldInside.clear();
+        }
+        else
+        {
+            outside[i].clear();
         }
 
-        if (_indexFrustumNumber != oldFrustumNumber)
+        if (!outside[i].empty())
         {
-            // note that we have caps projected against this frustum,
-            // which may allow us to skip drawing the caps if all projected
-            // planes face away from the viewer and the viewer is outside the light volume
-            capPlaneBits |= 1<<frustumNum;
+            hasOutside = true;
         }
     }
 
-    // if no faces have been defined for the shadow volume,
-    // there won't be anything at all
-    if (_numShadowIndices == 0) 
+    if (inside.empty())
     {
-        return Surface();
+        // the entire winding is outside this light
+        out.push_back(tri);
+        return;
     }
 
-    // this should have been prevented by the overflowed flag, so if it ever happens,
-    // it is a code error
-    if (_numShadowVerts > MAX_SHADOW_VERTS || _numShadowIndices > MAX_SHADOW_INDEXES)
+    if (!hasOutside)
     {
-        throw std::runtime_error("Shadow volume exceeded allocation");
+        // the entire winding is inside this light
+        in.push_back(tri);
+        return;
     }
 
-    // allocate a new surface for the shadow volume
-    // newTri = R_AllocStaticTriSurf();
-
-    // we might consider setting this, but it would only help for
-    // large lights that are partially off screen
-    //newTri.bounds = AABB();
-
-    // copy off the verts and indexes
-    newTri.shadowVertices.assign(_shadowVerts.begin(), _shadowVerts.begin() + _numShadowVerts);
-
-    newTri.indices.resize(_numShadowIndices);
-
-    // the shadow verts will go into a main memory buffer as well as a vertex
-    // cache buffer, so they can be copied back if they are purged
-    //R_AllocStaticTriSurfShadowVerts( newTri, newTri->numVerts );
-    //SIMDProcessor->Memcpy( newTri->shadowVertexes, shadowVerts, newTri->numVerts * sizeof( newTri->shadowVertexes[0] ) );
-
-    //R_AllocStaticTriSurfIndexes( newTri, newTri->numIndexes );
+    // the winding is split
+    in = windingToTriList(inside, tri);
+    inside.clear();
 
-    if ( 1 /* sortCapIndexes */ )
+    // combine all the outside fragments
+    for (std::size_t i = 0; i < 6; ++i)
     {
-        newTri.shadowCapPlaneBits = capPlaneBits;
-
-        // copy the sil indexes first
-        newTri.numShadowIndicesNoCaps = 0;
-
-        for (std::size_t i = 0; i < _indexFrustumNumber; ++i)
+        if (!outside[i].empty())
         {
-            std::size_t c = _indexRef[i].end - _indexRef[i].silStart;
-
-            memcpy(&newTri.indices[newTri.numShadowIndicesNoCaps], &_shadowIndices[_indexRef[i].silStart], c * sizeof(newTri.indices[0]));
-
-            newTri.numShadowIndicesNoCaps += c;
+            ProcTris temp = windingToTriList(outside[i], tri);
+            out.insert(out.end(), temp.begin(), temp.end());
         }
+    }
+}
 
-        // copy rear cap indexes next
-        newTri.numShadowIndicesNoFrontCaps = newTri.numShadowIndicesNoCaps;
+Surface ProcCompiler::shareMapTriVerts(const ProcTris& tris)
+{
+    // unique the vertexes
+    std::size_t count = tris.size();
 
-        for (std::size_t i = 0; i < _indexFrustumNumber; ++i)
-        {
-            std::size_t c = _indexRef[i].silStart - _indexRef[i].rearCapStart;
+    Surface uTri;
 
-            memcpy(&newTri.indices[newTri.numShadowIndicesNoFrontCaps], &_shadowIndices[_indexRef[i].rearCapStart], c * sizeof(newTri.indices[0]));
+    uTri.vertices.reserve(count * 3);
+    uTri.indices.reserve(count * 3);
 
-            newTri.numShadowIndicesNoFrontCaps += c;
-        }
+    for (ProcTris::const_iterator step = tris.begin(); step != tris.end(); ++step)
+    {
+        for (std::size_t i = 0; i < 3; ++i)
+        {
+            const ArbitraryMeshVertex& dv = step->v[i];
 
-        // copy front cap indexes last
-        std::size_t numIndices = newTri.numShadowIndicesNoFrontCaps;
+            // search for a match
+            std::size_t j = 0;
 
-        for (std::size_t i = 0; i < _indexFrustumNumber; ++i)
-        {
-            std::size_t c = _indexRef[i].rearCapStart - _indexRef[i].frontCapStart;
+            for (j = 0; j < uTri.vertices.size(); ++j)
+            {
+                if (OptUtils::MatchVert(uTri.vertices[j], dv))
+                {
+                    break;
+                }
+            }
 
-            memcpy(&newTri.indices[numIndices], &_shadowIndices[_indexRef[i].frontCapStart], c * sizeof(newTri.indices[0]));
+            if (j == uTri.vertices.size())
+            {
+                uTri.vertices.push_back(dv);
+            }
 
-            numIndices += c;
+            uTri.indices.push_back(static_cast<int>(j));
         }
     }
-//  else 
-//  {
-//      newTri->shadowCapPlaneBits = 63;    // we don't have optimized index lists
-//      SIMDProcessor->Memcpy( newTri->indexes, shadowIndexes, newTri->numIndexes * sizeof( newTri->indexes[0] ) );
-//  }
 
-    if (false /*optimize == SG_OFFLINE*/) // greebo: cannot be true at the moment
-    {
-        //CleanupOptimizedShadowTris( newTri );
-    }
-
-    return newTri;
+    return uTri;
 }
 
 Surface ProcCompiler::createLightShadow(ProcArea::OptimizeGroups& shadowerGroups, const ProcLight& light)
@@ -4662,7 +4079,7 @@ Surface ProcCompiler::createLightShadow(ProcArea::OptimizeGroups& shadowerGroups
     rMessage() << (boost::format("----- CreateLightShadow %s -----") % light.name) << std::endl;
 
     // optimize all the groups
-    optimizeGroupList(shadowerGroups);
+    GroupOptimiser(*_planes).optimizeGroupList(shadowerGroups);
 
     Surface shadowTris;
     
@@ -4715,16 +4132,17 @@ Surface ProcCompiler::createLightShadow(ProcArea::OptimizeGroups& shadowerGroups
 #endif
 
     Surface::CullInfo cullInfo;
+    ShadowVolumeBuilder builder;
 
     // call the normal shadow creation, but with the superOptimize flag set, which will
     // call back to SuperOptimizeOccluders after clipping the triangles to each frustum
     if (true /*dmapGlobals.shadowOptLevel == SO_MERGE_SURFACES*/) // default is merge_surfaces
     {
-        shadowTris = createShadowVolume(transform, occluders, light, SG_STATIC, cullInfo);
+        shadowTris = builder.createShadowVolume(transform, occluders, light, ShadowVolumeBuilder::SG_STATIC, cullInfo);
     }
     else
     {
-        shadowTris = createShadowVolume(transform, occluders, light, SG_OFFLINE, cullInfo);
+        shadowTris = builder.createShadowVolume(transform, occluders, light, ShadowVolumeBuilder::SG_OFFLINE, cullInfo);
     }
 
     /*R_FreeStaticTriSurf( occluders );
@@ -4742,7 +4160,7 @@ Surface ProcCompiler::createLightShadow(ProcArea::OptimizeGroups& shadowerGroups
     return shadowTris;
 }
 
-void ProcCompiler::buildLightShadows(ProcEntity& entity, ProcLight& light)
+void ProcCompiler::buildLightShadows(const ProcEntity::Areas& areas, ProcLight& light)
 {
     //
     // build a group list of all the triangles that will contribute to
@@ -4761,11 +4179,11 @@ void ProcCompiler::buildLightShadows(ProcEntity& entity, ProcLight& light)
     {
         rMessage() << (boost::format("--- Light %s is casting shadows") % light.name) << std::endl;
 
-        for (std::size_t i = 0; i < entity.numAreas; ++i)
+        for (std::size_t i = 0; i < areas.size(); ++i)
         {
             //rMessage() << (boost::format("Prelighting area %d") % i) << std::endl;
 
-            const ProcArea& area = entity.areas[i];
+            const ProcArea& area = areas[i];
 
             int groupNum = 0;
 
@@ -4783,7 +4201,7 @@ void ProcCompiler::buildLightShadows(ProcEntity& entity, ProcLight& light)
 
                 // if the group doesn't face away from the light, it
                 // won't contribute to the shadow volume
-                if (_procFile->planes.getPlane(group->planeNum).distanceToPoint(lightOrigin) > 0)
+                if (_planes->getPlane(group->planeNum).distanceToPoint(lightOrigin) > 0)
                 {
                     //rMessage() << " is not facing away\n";
                     continue;
@@ -4903,6 +4321,50 @@ void ProcCompiler::buildLightShadows(ProcEntity& entity, ProcLight& light)
         }
     }*/
 
+    // In incremental builds, the shadow volume is only re-created
+    // if the light or the geometry in its frustum changed
+    std::uint64_t shadowHash = 0;
+
+    if (_cache)
+    {
+        ContentHash hash;
+
+        hash.add(light.spawnargHash);
+        hash.add(static_cast<std::uint64_t>(hasPerforatedSurface));
+
+        for (ProcArea::OptimizeGroups::const_iterator group = shadowerGroups.begin(); 
+             group != shadowerGroups.end(); ++group)
+        {
+            const Plane3& plane = _planes->getPlane(group->planeNum);
+
+            hash.add(plane.normal());
+            hash.add(plane.dist());
+            hash.add(group->material->getName());
+
+            for (ProcTris::const_iterator tri = group->triList.begin(); tri != group->triList.end(); ++tri)
+            {
+                hash.add(tri->v[0]);
+                hash.add(tri->v[1]);
+                hash.add(tri->v[2]);
+            }
+        }
+
+        shadowHash = hash.getValue();
+
+        DmapCache::ShadowVolumes::const_iterator cached = _cache->shadowVolumes.find(shadowHash);
+
+        if (cached != _cache->shadowVolumes.end())
+        {
+            rMessage() << (boost::format("--- Light %s is unchanged, using the cached shadow volume") % light.name) << std::endl;
+
+            light.shadowTris = cached->second;
+
+            std::lock_guard<std::mutex> lock(_shadowVolumesLock);
+            _shadowVolumes.insert(*cached);
+            return;
+        }
+    }
+
     // take the shadower group list and create a beam tree and shadow volume
     light.shadowTris = createLightShadow(shadowerGroups, light);
 
@@ -4923,6 +4385,12 @@ void ProcCompiler::buildLightShadows(ProcEntity& entity, ProcLight& light)
         light.shadowTris.numShadowIndicesNoCaps = light.shadowTris.numShadowIndicesNoFrontCaps = light.shadowTris.indices.size();
     }
 
+    if (_cache)
+    {
+        std::lock_guard<std::mutex> lock(_shadowVolumesLock);
+        _shadowVolumes[shadowHash] = light.shadowTris;
+    }
+
     // we don't need the original shadower triangles for anything else
     //FreeOptimizeGroupList( shadowerGroups );
 }
@@ -4940,7 +4408,7 @@ void ProcCompiler::preLight(ProcEntity& entity)
         rMessage() << "----- BuildLightShadows -----" << std::endl;
         
         // calc bounds for all the groups to speed things up
-        for (std::size_t i = 0; i < entity.numAreas; ++i)
+        parallelForWithOrderedLog(*_threadPool, entity.numAreas, [&](std::size_t i)
         {
             ProcArea& area = entity.areas[i];
 
@@ -4954,14 +4422,21 @@ void ProcCompiler::preLight(ProcEntity& entity)
 
                 rMessage() << (boost::format("Bounds: %f %f %f - %f %f %f\n") % mins[0] % mins[1] % mins[2] % maxs[0] % maxs[1] % maxs[2]);*/
             }
+        });
+
+        // keep the unoptimised areas, future incremental builds need them to rebuild the shadows
+        if (_cache)
+        {
+            _preLightAreas = entity.areas;
         }
 
-        for (std::size_t i = 0; i < _procFile->lights.size(); ++i)
+        // lights are independent of each other, each task is using its own shadow volume builder
+        parallelForWithOrderedLog(*_threadPool, _procFile->lights.size(), [&](std::size_t i)
         {
-            ProcLight& light = _procFile->lights[i];
+            buildLightShadows(entity.areas, _procFile->lights[i]);
+        });
 
-            buildLightShadows(entity, light);
-        }
+        addShadowCounters();
     }
 
     if (false/* !dmapGlobals.noLightCarve */) // greebo: noLightCarve defaults to true
@@ -4984,32 +4459,67 @@ void ProcCompiler::optimizeEntity(ProcEntity& entity)
 {
     rMessage() << "----- OptimizeEntity -----" << std::endl;
 
-    for (std::size_t i = 0; i < entity.areas.size(); ++i)
+    // Areas are optimised independently, each task is using its own optimiser
+    parallelForWithOrderedLog(*_threadPool, entity.areas.size(), [&](std::size_t i)
+    {
+        GroupOptimiser optimiser(*_planes);
+        optimiser.optimizeGroupList(entity.areas[i].groups);
+    });
+
+    // keep the optimised areas, future incremental builds re-use the unchanged ones
+    if (_cache)
+    {
+        _optimizedAreas = entity.areas;
+    }
+}
+
+void ProcCompiler::optimizeDirtyAreas(ProcEntity& entity, const std::vector<bool>& dirtyAreas)
+{
+    rMessage() << "----- OptimizeEntity -----" << std::endl;
+
+    std::vector<std::size_t> areaNums;
+
+    for (std::size_t a = 0; a < entity.areas.size(); ++a)
     {
-        optimizeGroupList(entity.areas[i].groups);
+        if (dirtyAreas[a])
+        {
+            areaNums.push_back(a);
+        }
+        else
+        {
+            entity.areas[a] = _cache->optimizedAreas[a];
+        }
     }
+
+    parallelForWithOrderedLog(*_threadPool, areaNums.size(), [&](std::size_t i)
+    {
+        GroupOptimiser optimiser(*_planes);
+        optimiser.optimizeGroupList(entity.areas[areaNums[i]].groups);
+    });
+
+    _optimizedAreas = entity.areas;
 }
 
 void ProcCompiler::fixGlobalTjunctions(ProcEntity& entity)
 {
     rMessage() << "----- FixGlobalTjunctions -----" << std::endl;
 
-    _triangleHash.reset(new TriangleHash);
+    TriangleHashPtr triangleHash(new TriangleHash);
 
     // bound all the triangles to determine the bucket size
-    _triangleHash->_hashBounds = AABB();
+    triangleHash->_hashBounds = AABB();
 
     for (std::size_t a = 0; a < entity.areas.size(); ++a)
     {
-        _triangleHash->calculateBounds(entity.areas[a].groups);
+        triangleHash->calculateBounds(entity.areas[a].groups);
     }
 
     // spread the bounds so it will never have a zero size
-    _triangleHash->spreadHashBounds();
+    triangleHash->spreadHashBounds();
 
     for (std::size_t a = 0; a < entity.areas.size(); ++a)
     {
-        _triangleHash->hashTriangles(entity.areas[a].groups);
+        triangleHash->hashTriangles(entity.areas[a].groups);
     }
 
     // add all the func_static model vertexes to the hash buckets
@@ -5079,14 +4589,20 @@ void ProcCompiler::fixGlobalTjunctions(ProcEntity& entity)
                     const ArbitraryMeshVertex& vertex = surface.getVertex(v);
 
                     Vector3 transformed = axis.transformPoint(vertex.vertex) + origin;
-                    _triangleHash->getHashVert(transformed);
+                    triangleHash->getHashVert(transformed);
                 }
             }
         }
     }
 
-    // now fix each area
-    for (std::size_t a = 0; a < entity.areas.size(); ++a)
+    TriangleHash::OccupancyStats stats = triangleHash->getOccupancyStats();
+
+    rMessage() << (boost::format("%6i hash verts in %i of %i bins (%i max, %.2f avg per bin)") %
+        triangleHash->getNumHashVerts() % stats.numOccupiedBins % stats.numBins %
+        stats.maxVertsPerBin % stats.averageVertsPerOccupiedBin) << std::endl;
+
+    // now fix each area, the hash is not altered anymore at this point
+    parallelForWithOrderedLog(*_threadPool, entity.areas.size(), [&](std::size_t a)
     {
         for (ProcArea::OptimizeGroups::iterator group = entity.areas[a].groups.begin();
              group != entity.areas[a].groups.end(); ++group)
@@ -5098,18 +4614,16 @@ void ProcCompiler::fixGlobalTjunctions(ProcEntity& entity)
             }
 
             ProcTris newList;
+            newList.reserve(group->triList.size());
 
             for (ProcTris::const_iterator tri = group->triList.begin(); tri != group->triList.end(); ++tri)
             {
-                _triangleHash->fixTriangleAgainstHash(*tri, newList);
+                triangleHash->fixTriangleAgainstHash(*tri, newList);
             }
 
             group->triList.swap(newList);
         }
-    }
-    
-    // done
-    _triangleHash.reset();
+    });
 }
 
 void ProcCompiler::freeTreePortalsRecursively(const BspTreeNodePtr& node)
@@ -5167,22 +4681,41 @@ bool ProcCompiler::processModel(ProcEntity& entity, bool floodFill)
 {
     _bspFaces.clear();
 
-    BspTreeNode::nextNodeId = 0;
-    ProcPortal::nextPortalId = 0;
-
     // build a bsp tree using all of the sides
     // of all of the structural brushes
     makeStructuralProcFaceList(entity.primitives);
 
     // Sort all the faces into the tree
-    faceBsp(entity);
+    {
+        DmapProfiler::ScopedStage stage(_profiler, "faceBsp");
+        faceBsp(entity);
+    }
+
+    addCounter("faceBsp", "faceLeafs", entity.tree.numFaceLeafs.load());
 
     // create portals at every leaf intersection
     // to allow flood filling
-    makeTreePortals(entity.tree);
+    {
+        DmapProfiler::ScopedStage stage(_profiler, "makeTreePortals");
+        makeTreePortals(entity.tree);
+    }
+
+    addCounter("makeTreePortals", "activePortals", _numActivePortals);
+    addCounter("makeTreePortals", "tinyPortals", _numTinyPortals);
+
+    if (_profiler)
+    {
+        _profiler->maxCounter("makeTreePortals", "peakPortals", _numPeakPortals);
+    }
 
     // classify the leafs as opaque or areaportal
-    filterBrushesIntoTree(entity);
+    {
+        DmapProfiler::ScopedStage stage(_profiler, "filterBrushesIntoTree");
+        filterBrushesIntoTree(entity);
+    }
+
+    addCounter("filterBrushesIntoTree", "uniqueBrushes", _numUniqueBrushes);
+    addCounter("filterBrushesIntoTree", "clusters", _numClusters);
 
 #if 0
     printBrushCount(entity.tree.head, 0);
@@ -5191,10 +4724,17 @@ bool ProcCompiler::processModel(ProcEntity& entity, bool floodFill)
     // see if the bsp is completely enclosed
     if (floodFill/* && !dmapGlobals.noFlood*/)  // TODO: noflood option
     {
+        DmapProfiler::ScopedStage stage(_profiler, "floodEntities");
+
         if (floodEntities(entity.tree))
         {
             // set the outside leafs to opaque
             fillOutside(entity);
+
+            addCounter("floodEntities", "floodedLeafs", _numFloodedLeafs);
+            addCounter("floodEntities", "outsideLeafs", _numOutsideLeafs);
+            addCounter("floodEntities", "insideLeafs", _numInsideLeafs);
+            addCounter("floodEntities", "solidLeafs", _numSolidLeafs);
         }
         else
         {
@@ -5219,24 +4759,34 @@ bool ProcCompiler::processModel(ProcEntity& entity, bool floodFill)
 
     // determine areas before clipping tris into the
     // tree, so tris will never cross area boundaries
-    floodAreas(entity);
+    {
+        DmapProfiler::ScopedStage stage(_profiler, "floodAreas");
+        floodAreas(entity);
+    }
+
+    addCounter("floodAreas", "areas", _numAreas);
 
     /*rMessage() << "--- Planelist before PutPrimitivesInAreas --- " << std::endl;
 
-    for (std::size_t i = 0; i < _procFile->planes.size(); ++i)
+    for (std::size_t i = 0; i < _planes->size(); ++i)
     {
-        const Plane3& plane = _procFile->planes.getPlane(i);
+        const Plane3& plane = _planes->getPlane(i);
         rMessage() << (boost::format("Plane %d: %f %f %f %f") % i % plane.normal().x() % plane.normal().y() % plane.normal().z() % plane.dist()) << std::endl;
     }*/
 
     // we now have a BSP tree with solid and non-solid leafs marked with areas
     // all primitives will now be clipped into this, throwing away
     // fragments in the solid areas
-    putPrimitivesInAreas(entity);
+    {
+        DmapProfiler::ScopedStage stage(_profiler, "putPrimitivesInAreas");
+        putPrimitivesInAreas(entity);
+    }
+
+    addCounter("putPrimitivesInAreas", "triangles", countAreaTriangles(entity));
 
-    /*for (std::size_t i = 0; i < _procFile->planes.size(); ++i)
+    /*for (std::size_t i = 0; i < _planes->size(); ++i)
     {
-        const Plane3& plane = _procFile->planes.getPlane(i);
+        const Plane3& plane = _planes->getPlane(i);
         rMessage() << (boost::format("Plane %d: %f %f %f %f") % i % plane.normal().x() % plane.normal().y() % plane.normal().z() % plane.dist()) << std::endl;
     }*/
 
@@ -5244,12 +4794,20 @@ bool ProcCompiler::processModel(ProcEntity& entity, bool floodFill)
     // the optimize lists by the light beam trees
     // so there won't be unneeded overdraw in the static
     // case
-    preLight(entity);
+    {
+        DmapProfiler::ScopedStage stage(_profiler, "shadows");
+        preLight(entity);
+    }
 
     // optimizing is a superset of fixing tjunctions
     if (true/*!dmapGlobals.noOptimize*/) // greebo: noOptimize is false by default
     {
-        optimizeEntity(entity);
+        {
+            DmapProfiler::ScopedStage stage(_profiler, "optimize");
+            optimizeEntity(entity);
+        }
+
+        addCounter("optimize", "triangles", countAreaTriangles(entity));
     }
     else if (false/*!dmapGlobals.noTJunc*/)
     {
@@ -5257,7 +4815,12 @@ bool ProcCompiler::processModel(ProcEntity& entity, bool floodFill)
     }
 
     // now fix t junctions across areas
-    fixGlobalTjunctions(entity);
+    {
+        DmapProfiler::ScopedStage stage(_profiler, "tjunctions");
+        fixGlobalTjunctions(entity);
+    }
+
+    addCounter("tjunctions", "triangles", countAreaTriangles(entity));
 
     // greebo: This was done by the proc output writer before, but it makes sense to 
     // do that before returning
@@ -7,6 +7,11 @@
 #include "math/Vector3.h"
 #include "LeakFile.h"
 #include "TriangleHash.h"
+#include "GroupOptimiser.h"
+#include "DmapOptions.h"
+#include "DmapCache.h"
+#include "DmapProfiler.h"
+#include "util/ThreadPool.h"
 
 namespace map
 {
@@ -24,6 +29,28 @@ private:
 	// The working copy
 	ProcFilePtr _procFile;
 
+	DmapOptions _options;
+
+	// Worker threads, shared with the compilers processing the entity models
+	util::ThreadPoolPtr _threadPool;
+
+	// Results of the previous compile, NULL if not compiling incrementally
+	DmapCachePtr _cache;
+
+	// Data collected for the cache during this compile
+	DmapCache::AreaContributions _worldContributions;
+	ProcEntity::Areas _preLightAreas;
+	ProcEntity::Areas _optimizedAreas;
+	DmapCache::ShadowVolumes _shadowVolumes;
+	std::mutex _shadowVolumesLock;
+
+	// Collects the stage timings and statistics, NULL if not profiling
+	DmapProfilerPtr _profiler;
+
+	// The plane set new planes are inserted into. This is the ProcFile's set
+	// for the worldspawn, other entities are using a set layered on top of it.
+	PlaneSet* _planes;
+
 	struct BspFace
 	{
 		int					planenum;
@@ -59,67 +86,97 @@ private:
 	std::size_t _numAreas;
 	std::size_t _numAreaFloods;
 
-	TriangleHashPtr _triangleHash;
-
-	AABB		_optBounds;
+	// A triangle list waiting to be added to an area. Primitives are clipped
+	// into the tree in parallel, the lists are added in the original order,
+	// which is also when any new planes are inserted into the plane set.
+	struct AreaTriList
+	{
+		ProcTris		tris;
+		std::size_t		planeNum;	// PLANENUM_UNRESOLVED if the plane needs to be looked up
+		Plane3			plane;
+		std::size_t		areaNum;
+		Vector4			texVec[2];
+
+		AreaTriList(std::size_t planeNum_, std::size_t areaNum_, const Vector4 texVec_[2]) :
+			planeNum(planeNum_),
+			areaNum(areaNum_)
+		{
+			texVec[0] = texVec_[0];
+			texVec[1] = texVec_[1];
+		}
+
+		AreaTriList(const Plane3& plane_, std::size_t areaNum_, const Vector4 texVec_[2]) :
+			planeNum(PLANENUM_UNRESOLVED),
+			plane(plane_),
+			areaNum(areaNum_)
+		{
+			texVec[0] = texVec_[0];
+			texVec[1] = texVec_[1];
+		}
+	};
+	typedef std::vector<AreaTriList> AreaTriLists;
 
-	typedef std::vector<OriginalEdge> OriginalEdges;
-	OriginalEdges	_originalEdges;
+	static const std::size_t PLANENUM_UNRESOLVED = PLANENUM_LEAF;
 
-	typedef std::vector<OptEdge> OptEdges;
-	OptEdges		_optEdges;
+public:
+	ProcCompiler(const scene::INodePtr& root, const DmapOptions& options = DmapOptions(),
+		const DmapCachePtr& cache = DmapCachePtr(), const DmapProfilerPtr& profiler = DmapProfilerPtr());
 
-	typedef std::vector<OptVertex> OptVertices;
-	OptVertices		_optVerts;
+	// Generate the .proc file
+	ProcFilePtr generateProcFile();
 
-	enum ShadowGenType
-	{
-		SG_DYNAMIC,		// use infinite projections
-		SG_STATIC,		// clip to bounds
-		SG_OFFLINE		// perform very time consuming optimizations
-	};
+private:
+	// Constructs a compiler processing a single entity model on behalf of
+	// the given owner, new planes are inserted into the given set
+	ProcCompiler(const ProcCompiler& owner, PlaneSet& planes);
 
-	std::size_t _numShadowIndices;
-	std::size_t _numShadowVerts;
-	std::size_t _numClipSilEdges;
-	bool _overflowed;
-	std::vector<Vector4> _shadowVerts;
-	std::vector<std::size_t> _shadowIndices;
+	void generateBrushData();
 
-#define	MAX_CLIP_SIL_EDGES		2048
+	// Inserts the planes of the previous compile first, such that the plane
+	// numbers used by its tree and areas are valid in this compile too
+	void insertCachedPlanes(const PlaneSet& cachedPlanes);
 
-	int	_clipSilEdges[MAX_CLIP_SIL_EDGES][2];
+	// Hash of everything the BSP and the area surfaces are generated from,
+	// that is all primitives, all non-light entities, the models and the relevant options.
+	// Also collects the hashes of the world primitives and inlined models.
+	std::uint64_t calculateGeometryHash();
 
-#define	MAX_CLIPPED_POINTS	20
+	// Hash of everything the world BSP tree and its areas are generated from
+	std::uint64_t calculateStructureHash();
 
-	struct ClipTri
-	{
-		int		numVerts;
-		Vector3	verts[MAX_CLIPPED_POINTS];
-		int		edgeFlags[MAX_CLIPPED_POINTS];
-	};
+	// Returns true if all lights and flooding entities are within the areas of the cached tree
+	bool originsInsideCachedAreas(const ProcFile& cachedFile);
 
-	struct IndexRef 
-	{
-		std::size_t	frontCapStart;
-		std::size_t	rearCapStart;
-		std::size_t	silStart;
-		std::size_t	end;
-	};
-	
-	IndexRef _indexRef[6];
-	std::size_t _indexFrustumNumber;		// which shadow generating side of a light the indexRef is for
+	// Takes the BSP and areas from the cache and only rebuilds the light shadows,
+	// returns false if the cached results cannot be used for the given geometry
+	bool reuseCachedWorld(std::uint64_t geometryHash);
 
-public:
-	ProcCompiler(const scene::INodePtr& root);
+	// Takes the BSP tree and areas of the world from the cache and only rebuilds the
+	// areas touched by changed primitives or inlined models. Returns false if the
+	// cached tree cannot be used for the given world structure.
+	bool reuseCachedStructure(std::uint64_t structureHash);
 
-	// Generate the .proc file
-	ProcFilePtr generateProcFile();
+	// Clips the given world primitives and inlined models (indexed like _worldContributions)
+	// into the areas, the lists are stored at the same index in triLists
+	void clipWorldContributions(const ProcEntity& world, const std::vector<std::size_t>& contributions,
+		const std::vector<std::size_t>& inlined, std::vector<AreaTriLists>& triLists);
 
-private:
-	void generateBrushData();
+	// Stores the results of this compile in the cache
+	void storeInCache(std::uint64_t geometryHash, std::uint64_t structureHash);
 
 	bool processModels();
+
+	// Processes the models of all entities except the world
+	void processEntityModels();
+
+	// Adds to the counter of the given profiler stage, if profiling
+	void addCounter(const char* stage, const char* counter, std::size_t value);
+
+	// Adds the number of shadow verts and indices of all lights to the profiler
+	void addShadowCounters();
+
+	// The number of triangles in the optimize groups of all areas
+	static std::size_t countAreaTriangles(const ProcEntity& entity);
 	bool processModel(ProcEntity& entity, bool floodFill);
 
 	// Create a list of all faces that are relevant for faceBSP()
@@ -134,6 +191,16 @@ private:
 
 	std::size_t selectSplitPlaneNum(const BspTreeNodePtr& node, BspFaces& list);
 
+	// Surface area heuristic variant of selectSplitPlaneNum(), candidates are scored in parallel
+	std::size_t selectSplitPlaneNumSah(const BspTreeNodePtr& node, const BspFaces& faces);
+
+	// Returns the axial plane at a 1k block boundary crossing the node, or max() if there is none
+	std::size_t findBlockSplitPlaneNum(const BspTreeNodePtr& node);
+
+	// Makes sure all 1k block planes within the bounds are present in the plane set,
+	// such that findBlockSplitPlaneNum() doesn't insert planes while building the tree in parallel
+	void insertBlockSplitPlanes(const AABB& bounds);
+
 	void makeTreePortals(BspTree& tree);
 
 	void makeHeadNodePortals(BspTree& tree);
@@ -175,6 +242,8 @@ private:
 	 */
 	void clipSidesByTree(ProcEntity& entity);
 
+	void clipBrushSidesByTree(ProcBrush& brush, const BspTreeNodePtr& head);
+
 	// Adds non-opaque leaf fragments to the convex hull
 	void clipSideByTreeRecursively(ProcWinding& winding, ProcFace& side, const BspTreeNodePtr& node);
 
@@ -199,10 +268,20 @@ private:
 
 	void putPrimitivesInAreas(ProcEntity& entity);
 
+	void clipPrimitiveIntoAreas(const ProcPrimitive& prim, const ProcEntity& entity, AreaTriLists& output);
+
+	// The func_static entities whose models are inlined into the world areas
+	std::vector<std::size_t> getInlinedModelEntities();
+
+	void clipInlinedModelIntoAreas(const ProcEntity& inlinedEntity, const ProcEntity& entity, AreaTriLists& output);
+
+	// Stores the areas the given lists are going into
+	static void setContributionAreas(DmapCache::AreaContribution& contribution, const AreaTriLists& triLists);
+
 	// Clips a winding down into the bsp tree, then converts
-	// the fragments to triangles and adds them to the area lists
-	void putWindingIntoAreasRecursively(ProcEntity& entity, const ProcWinding& winding, 
-										ProcFace& side, const BspTreeNodePtr& node);
+	// the fragments to triangles and adds them to the output lists
+	void putWindingIntoAreasRecursively(const ProcWinding& winding, const ProcFace& side, 
+										const BspTreeNodePtr& node, AreaTriLists& output);
 
 	// Returns the area number that the winding is in, or MULTIAREA_CROSS if it crosses multiple areas.
 	// Empty windings are not allowed!
@@ -215,12 +294,16 @@ private:
 	// The entire list is assumed to come from the same planar primitive
 	void addTriListToArea(ProcEntity& entity, const ProcTris& triList, 
 						  std::size_t planeNum, std::size_t areaNum, 
-						  Vector4 texVec[2]);
+						  const Vector4 texVec[2]);
+
+	// Resolves the plane numbers of the given lists and adds them to the areas
+	// in the order they have been collected. The lists are cleared afterwards.
+	void addAreaTriLists(ProcEntity& entity, AreaTriLists& triLists);
 
-	void addMapTrisToAreas(const ProcTris& tris, ProcEntity& e);
+	void addMapTrisToAreas(const ProcTris& tris, const ProcEntity& entity, AreaTriLists& output);
 
 	void clipTriIntoTreeRecursively(const ProcWinding& winding, const ProcTri& originalTri, 
-								  ProcEntity& entity, const BspTreeNodePtr& node);
+								  const BspTreeNodePtr& node, AreaTriLists& output);
 
 	// Break optimize groups up into additional groups at light boundaries, so
 	// optimization won't cross light bounds
@@ -228,7 +311,7 @@ private:
 	void boundOptimizeGroup(ProcOptimizeGroup& group);
 
 	// Build the beam tree and shadow volume surface for a light
-	void buildLightShadows(ProcEntity& entity, ProcLight& light);
+	void buildLightShadows(const ProcEntity::Areas& areas, ProcLight& light);
 	void clipTriByLight(const ProcLight& light, const ProcTri& tri, ProcTris& in, ProcTris& out);
 
 	// shadowerGroups should be exactly clipped to the light frustum before calling.
@@ -236,122 +319,13 @@ private:
 	// lightShadow_t list is a further culling and optimization of the data.
 	Surface createLightShadow(ProcArea::OptimizeGroups& shadowerGroups, const ProcLight& light);
 
-	// This will also fix tjunctions
-	void optimizeGroupList(ProcArea::OptimizeGroups& groupList);
-	std::size_t countGroupListTris(ProcArea::OptimizeGroups& groupList);
-	void optimizeOptList(ProcOptimizeGroup& group);
-	void fixAreaGroupsTjunctions(ProcArea::OptimizeGroups& groups);
-
-	// removes triangles that are degenerated or flipped backwards
-	void hashTriangles(ProcArea::OptimizeGroups& groups);
-	void addOriginalEdges(ProcOptimizeGroup& group);
-
-	OptVertex* findOptVertex(const ArbitraryMeshVertex& vertex, ProcOptimizeGroup& group);
-	void addOriginalTriangle(OptVertex* v[3]);
-	void splitOriginalEdgesAtCrossings(ProcOptimizeGroup& group);
-
-	// Creates a new OptVertex where the line segments cross.
-	// this should only be called if PointsStraddleLine returned true
-	// will return NULL if the lines are colinear
-	OptVertex* getEdgeIntersection(const OptVertex* p1, const OptVertex* p2,
-						const OptVertex* l1, const OptVertex* l2, ProcOptimizeGroup& opt);
-
-	void addEdgeIfNotAlready(OptVertex* v1, OptVertex* v2);
-
-	void dontSeparateIslands(ProcOptimizeGroup& group);
-
-	// Copies the group planeNum to every triangle in each group
-	void setGroupTriPlaneNums(ProcArea::OptimizeGroups& groupList);
-
 	Surface shareMapTriVerts(const ProcTris& tris);
 
-	/*
-	 * The returned surface will have a valid bounds and radius for culling.
-	 * 
-	 * Triangles are clipped to the light frustum before projecting.
-	 * 
-	 * A single triangle can clip to as many as 7 vertexes, so
-	 * the worst case expansion is 2*(numindexes/3)*7 verts when counting both
-	 * the front and back caps, although it will usually only be a modest
-	 * increase in vertexes for closed modesl
-	 * 
-	 * The worst case index count is much larger, when the 7 vertex clipped triangle
-	 * needs 15 indexes for the front, 15 for the back, and 42 (a quad on seven sides)
-	 * for the sides, for a total of 72 indexes from the original 3.  Ouch.
-	 * 
-	 * NULL may be returned if the surface doesn't create a shadow volume at all,
-	 * as with a single face that the light is behind.
-	 * 
-	 * If an edge is within an epsilon of the border of the volume, it must be treated
-	 * as if it is clipped for triangles, generating a new sil edge, and act
-	 * as if it was culled for edges, because the sil edge will have been
-	 * generated by the triangle irregardless of if it actually was a sil edge.
-	*/
-	Surface createShadowVolume(const Matrix4& transform, const Surface& tri, const ProcLight& light,
-							 ShadowGenType optimize, Surface::CullInfo& cullInfo);
-
-	// Stubs, not implemented yet
-	Surface createVertexProgramTurboShadowVolume(const Matrix4& transform, const Surface& tri, 
-								const ProcLight& light, Surface::CullInfo& cullInfo);
-	Surface createTurboShadowVolume(const Matrix4& transform, const Surface& tri, 
-								const ProcLight& light, Surface::CullInfo& cullInfo);
-
-	// Determines which triangles of the surface are facing towards the light origin.
-	// The facing array should be allocated with one extra index than
-	// the number of surface triangles, which will be used to handle dangling
-	void calcInteractionFacing(const Matrix4& transform, const Surface& tri, const ProcLight& light,
-							 Surface::CullInfo& cullInfo);
-
-	// Adds new verts and indexes to the shadow volume.
-	// 
-	// If the frustum completely defines the projected light,
-	// makeClippedPlanes should be true, which will cause sil quads to
-	// be added along all clipped edges.
-	// 
-	// If the frustum is just part of a point light, clipped planes don't
-	// need to be added.
-	void createShadowVolumeInFrustum(const Matrix4& transform, const Surface& tri,
-									const ProcLight& light, const Vector3& lightOrigin, const Plane3 frustum[6],
-									const Plane3 &farPlane, bool makeClippedPlanes, int* remap, 
-									unsigned char* faceCastsShadow, std::vector<unsigned char>& globalFacing);
-
-	// Also inits the remap[] array to all -1
-	void calcPointCull(const Surface& tri, const Plane3 frustum[6], unsigned short* pointCull, int* remap);
-
-	bool clipTriangleToLight(const Vector3& a, const Vector3& b, const Vector3& c, int planeBits, const Plane3 frustum[6]);
-
-	// Clips a triangle from one buffer to another, setting edge flags
-	// The returned buffer may be the same as inNum if no clipping is done
-	// If entirely clipped away, clipTris[returned].numVerts == 0
-	// 
-	// I have some worries about edge flag cases when polygons are clipped
-	// multiple times near the epsilon.
-	int chopWinding(ClipTri clipTris[2], int inNum, const Plane3& plane);
-
-	// Add sil edges for each triangle clipped to the side of the frustum.
-	// Only done for simple projected lights, not point lights.
-	void addClipSilEdges();
-
-	// Add quads from the front points to the projected points
-	// for each silhouette edge in the light
-	void addSilEdges(const Surface& tri, unsigned short* pointCull, const Plane3 frustum[6], 
-					 int* remap, unsigned char* faceCastsShadow);
-
-	// If neither point is clearly behind the clipping
-	// plane, the edge will be passed unmodified.  A sil edge that
-	// is on a border plane must be drawn.
-	// 
-	// If one point is clearly clipped by the plane and the
-	// other point is on the plane, it will be completely removed.
-	bool clipLineToLight(const Vector3& a, const Vector3& b, const Plane3 frustum[4], Vector3& p1, Vector3& p2);
-
-	// make a projected copy of the even verts into the odd spots
-	// that is on the far light clip plane
-	void projectPointsToFarPlane(const Matrix4& transform, const ProcLight& light, 
-								const Plane3& lightPlaneLocal, std::size_t firstShadowVert, std::size_t numShadowVerts);
-
 	void optimizeEntity(ProcEntity& entity);
 
+	// Optimises the dirty areas only, the others are taken from the cache
+	void optimizeDirtyAreas(ProcEntity& entity, const std::vector<bool>& dirtyAreas);
+
 	void fixGlobalTjunctions(ProcEntity& entity);
 
 	// Any nodes that have all children with the same
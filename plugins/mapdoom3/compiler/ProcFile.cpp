@@ -1,7 +1,8 @@
 #include "ProcFile.h"
-#include <fstream>
 #include <boost/format.hpp>
+#include <boost/algorithm/string/replace.hpp>
 #include "OptUtils.h"
+#include "ProcFileWriter.h"
 
 namespace map
 {
@@ -133,77 +134,7 @@ Surface shareMapTriVerts(const ProcTris& tris)
 	return uTri;
 }
 
-inline void writeFloat(std::ostream& str, float v)
-{
-	if (fabs(v - floorf(v + 0.5f)) < 0.001)
-	{
-		str << (boost::format("%i ") % (int)floorf(v + 0.5f));
-	}
-	else 
-	{
-		str << (boost::format("%f ") % v);
-	}
-}
-
-// Writes text verts and indexes to procfile
-inline std::ostream& writeSurface(std::ostream& str, const Surface& surf)
-{
-	// emit this chain
-	str << (boost::format("/* numVerts = */ %i /* numIndexes = */ %i") % surf.vertices.size() % surf.indices.size()) << std::endl;
-
-	// verts
-	std::size_t col = 0;
-
-	for (std::size_t i = 0; i < surf.vertices.size(); ++i)
-	{
-		const ArbitraryMeshVertex& dv = surf.vertices[i];
-
-		str << "( ";
-		writeFloat(str, dv.vertex[0]);
-		writeFloat(str, dv.vertex[1]);
-		writeFloat(str, dv.vertex[2]);
-		writeFloat(str, dv.texcoord[0]);
-		writeFloat(str, dv.texcoord[1]);
-		writeFloat(str, dv.normal[0]);
-		writeFloat(str, dv.normal[1]);
-		writeFloat(str, dv.normal[2]);
-		str << " ) ";
-
-		if (++col == 3)
-		{
-			col = 0;
-			str << std::endl;
-		}
-	}
-
-	if (col != 0)
-	{
-		str << std::endl;
-	}
-
-	// indexes
-	col = 0;
-
-	for (std::size_t i = 0; i < surf.indices.size(); ++i)
-	{
-		str << (boost::format("%i ") % surf.indices[i]);
-
-		if (++col == 18)
-		{
-			col = 0;
-			str << std::endl;
-		}
-	}
-
-	if (col != 0)
-	{
-		str << std::endl;
-	}
-
-	return str;
-}
-
-void writeOutputSurfaces(std::ostream& str, ProcEntity& entity, std::size_t areaNum)
+void writeOutputSurfaces(ProcFileWriter& writer, ProcEntity& entity, std::size_t areaNum)
 {
 	ProcArea& area = entity.areas[areaNum];
 
@@ -213,8 +144,7 @@ void writeOutputSurfaces(std::ostream& str, ProcEntity& entity, std::size_t area
 
 	if (entity.entityNum == 0)
 	{
-		str << (boost::format("model { /* name = */ \"_area%i\" /* numSurfaces = */ %i") % areaNum % numSurfaces) 
-			<< std::endl << std::endl;
+		writer.beginModel((boost::format("_area%i") % areaNum).str(), numSurfaces);
 	}
 	else
 	{
@@ -226,8 +156,7 @@ void writeOutputSurfaces(std::ostream& str, ProcEntity& entity, std::size_t area
 			return;
 		}
 
-		str << (boost::format("model { /* name = */ \"%s\" /* numSurfaces = */ %i") % name % numSurfaces) 
-			<< std::endl << std::endl;
+		writer.beginModel(name, numSurfaces);
 	}
 
 	std::size_t surfaceNum = 0;
@@ -305,14 +234,12 @@ void writeOutputSurfaces(std::ostream& str, ProcEntity& entity, std::size_t area
 		if (surfaceNum >= numSurfaces)
 		{
 			rError() << "writeOutputSurfaces: surfaceNum >= numSurfaces" << std::endl;
-			return;
+			break;
 		}
 
-		str << (boost::format("/* surface %i */ { ") % surfaceNum);
-		
 		surfaceNum++;
-		
-		str << (boost::format("\"%s\" ") % ambient.front().material->getName());
+
+		std::string material = ambient.front().material->getName();
 
 		Surface uTri = shareMapTriVerts(ambient);
 		
@@ -320,12 +247,10 @@ void writeOutputSurfaces(std::ostream& str, ProcEntity& entity, std::size_t area
 
 		uTri.cleanupUTriangles();
 		
-		writeSurface(str, uTri);
-
-		str << "}" << std::endl << std::endl;
+		writer.writeModelSurface(material, uTri);
 	}
 
-	str << "}" << std::endl << std::endl;
+	writer.endModel();
 }
 
 int numberNodesRecursively(const BspTreeNodePtr& node, int nextNumber)
@@ -344,49 +269,105 @@ int numberNodesRecursively(const BspTreeNodePtr& node, int nextNumber)
 	return nextNumber;
 }
 
-} // namespace
-
-std::ostream& ProcFile::writeOutputPortals(std::ostream& str, ProcEntity& entity)
+// Passes the data on to several writers, such that the text file
+// and its binary sidecar are written in a single pass
+class ProcFileWriterList :
+	public ProcFileWriter
 {
-	str << (boost::format("interAreaPortals { /* numAreas = */ %i /* numIAP = */ %i") % entity.numAreas % interAreaPortals.size()) 
-		<< std::endl << std::endl;
+private:
+	std::vector<ProcFileWriter*> _writers;
 
-	str << "/* interAreaPortal format is: numPoints positiveSideArea negativeSideArea ( point) ... */" << std::endl;
+public:
+	void add(ProcFileWriter& writer)
+	{
+		_writers.push_back(&writer);
+	}
 
-	for (std::size_t i = 0; i < interAreaPortals.size(); ++i)
+	bool isOpen() const
 	{
-		const ProcInterAreaPortal& iap = interAreaPortals[i];
-		const ProcWinding& w = iap.side->winding;
+		return true;
+	}
 
-		str << (boost::format("/* iap %i */ %i %i %i ") % i % w.size() % iap.area0 % iap.area1);
+	void beginModel(const std::string& name, std::size_t numSurfaces)
+	{
+		for (std::size_t i = 0; i < _writers.size(); ++i) _writers[i]->beginModel(name, numSurfaces);
+	}
 
-		str << "( ";
+	void writeModelSurface(const std::string& material, const Surface& surface)
+	{
+		for (std::size_t i = 0; i < _writers.size(); ++i) _writers[i]->writeModelSurface(material, surface);
+	}
 
-		for (std::size_t j = 0; j < w.size(); ++j)
-		{
-			writeFloat(str, w[j].vertex[0]);
-			writeFloat(str, w[j].vertex[1]);
-			writeFloat(str, w[j].vertex[2]);
-		}
+	void endModel()
+	{
+		for (std::size_t i = 0; i < _writers.size(); ++i) _writers[i]->endModel();
+	}
+
+	void beginPortals(std::size_t numAreas, std::size_t numPortals)
+	{
+		for (std::size_t i = 0; i < _writers.size(); ++i) _writers[i]->beginPortals(numAreas, numPortals);
+	}
+
+	void writePortal(std::size_t area0, std::size_t area1, const ProcWinding& winding)
+	{
+		for (std::size_t i = 0; i < _writers.size(); ++i) _writers[i]->writePortal(area0, area1, winding);
+	}
+
+	void endPortals()
+	{
+		for (std::size_t i = 0; i < _writers.size(); ++i) _writers[i]->endPortals();
+	}
 
-		str << ") ";
+	void beginNodes(std::size_t numNodes)
+	{
+		for (std::size_t i = 0; i < _writers.size(); ++i) _writers[i]->beginNodes(numNodes);
+	}
+
+	void writeNode(const Plane3& plane, int positiveChild, int negativeChild)
+	{
+		for (std::size_t i = 0; i < _writers.size(); ++i) _writers[i]->writeNode(plane, positiveChild, negativeChild);
+	}
+
+	void endNodes()
+	{
+		for (std::size_t i = 0; i < _writers.size(); ++i) _writers[i]->endNodes();
+	}
 
-		str << std::endl;
+	void writeShadowModel(const std::string& name, const Surface& shadowTris)
+	{
+		for (std::size_t i = 0; i < _writers.size(); ++i) _writers[i]->writeShadowModel(name, shadowTris);
+	}
+
+	void finish()
+	{
+		for (std::size_t i = 0; i < _writers.size(); ++i) _writers[i]->finish();
 	}
+};
+
+} // namespace
 
-	str << "}" << std::endl<< std::endl;
+void ProcFile::writeOutputPortals(ProcFileWriter& writer, ProcEntity& entity)
+{
+	writer.beginPortals(entity.numAreas, interAreaPortals.size());
 
-	return str;
+	for (std::size_t i = 0; i < interAreaPortals.size(); ++i)
+	{
+		const ProcInterAreaPortal& iap = interAreaPortals[i];
+
+		writer.writePortal(iap.area0, iap.area1, iap.side->winding);
+	}
+
+	writer.endPortals();
 }
 
-std::ostream& ProcFile::writeOutputNodeRecursively(std::ostream& str, const BspTreeNodePtr& node)
+void ProcFile::writeOutputNodeRecursively(ProcFileWriter& writer, const BspTreeNodePtr& node)
 {
 	if (node->planenum == PLANENUM_LEAF)
 	{
 		// we shouldn't get here unless the entire world
 		// was a single leaf
-		str << "/* node 0 */ ( 0 0 0 0 ) -1 -1" << std::endl;
-		return str;
+		writer.writeNode(Plane3(0, 0, 0, 0), -1, -1);
+		return;
 	}
 
 	int child[2];
@@ -403,50 +384,31 @@ std::ostream& ProcFile::writeOutputNodeRecursively(std::ostream& str, const BspT
 		}
 	}
 
-	const Plane3& plane = planes.getPlane(node->planenum);
-
-	str << (boost::format("/* node %i */ ") % node->nodeNumber);
-
-	str << "( ";
-	writeFloat(str, plane.normal()[0]);
-	writeFloat(str, plane.normal()[1]);
-	writeFloat(str, plane.normal()[2]);
-	writeFloat(str, -plane.dist());
-	str << ") ";
-	str << (boost::format("%i %i") % child[0] % child[1]) << std::endl;
+	writer.writeNode(planes.getPlane(node->planenum), child[0], child[1]);
 
 	if (child[0] > 0)
 	{
-		writeOutputNodeRecursively(str, node->children[0]);
+		writeOutputNodeRecursively(writer, node->children[0]);
 	}
 
 	if (child[1] > 0)
 	{
-		writeOutputNodeRecursively(str, node->children[1]);
+		writeOutputNodeRecursively(writer, node->children[1]);
 	}
-
-	return str;
 }
 
-std::ostream& ProcFile::writeOutputNodes(std::ostream& str, const BspTreeNodePtr& node)
+void ProcFile::writeOutputNodes(ProcFileWriter& writer, const BspTreeNodePtr& node)
 {
 	std::size_t numNodes = numberNodesRecursively(node, 0 );
 
-	// output
-	str << (boost::format("nodes { /* numNodes = */ %i") % numNodes) << std::endl << std::endl;
-
-	str << "/* node format is: ( planeVector ) positiveChild negativeChild */" << std::endl;
-	str << "/* a child number of 0 is an opaque, solid area */" << std::endl;
-	str << "/* negative child numbers are areas: (-1-child) */" << std::endl;
-
-	writeOutputNodeRecursively(str, node);
+	writer.beginNodes(numNodes);
 
-	str << "}" << std::endl << std::endl;
+	writeOutputNodeRecursively(writer, node);
 
-	return str;
+	writer.endNodes();
 }
 
-std::ostream& ProcFile::writeProcEntity(std::ostream& str, ProcEntity& entity)
+void ProcFile::writeProcEntity(ProcFileWriter& writer, ProcEntity& entity)
 {
 	if (entity.entityNum != 0)
 	{
@@ -459,92 +421,59 @@ std::ostream& ProcFile::writeProcEntity(std::ostream& str, ProcEntity& entity)
 
 	for (std::size_t a = 0; a < entity.numAreas; ++a)
 	{
-		writeOutputSurfaces(str, entity, a);
+		writeOutputSurfaces(writer, entity, a);
 	}
 
 	// we will completely skip the portals and nodes if it is a single area
 	if (entity.entityNum == 0 && entity.numAreas > 1)
 	{
 		// output the area portals
-		writeOutputPortals(str, entity);
+		writeOutputPortals(writer, entity);
 
 		// output the nodes
-		writeOutputNodes(str, entity.tree.head);
+		writeOutputNodes(writer, entity.tree.head);
 	}
-
-	return str;
 }
 
-std::ostream& ProcFile::writeShadowTriangles(std::ostream& str, const Surface& tri)
+void ProcFile::saveToFile(const std::string& path, bool writeBinarySidecar)
 {
-	// emit this chain
-	str << (boost::format("/* numVerts = */ %i /* noCaps = */ %i /* noFrontCaps = */ %i /* numIndexes = */ %i /* planeBits = */ %i")
-		% tri.vertices.size() % tri.numShadowIndicesNoCaps % tri.numShadowIndicesNoFrontCaps % tri.indices.size() % tri.shadowCapPlaneBits);
+	// write the file
+	rMessage() << "----- WriteOutputFile -----" << std::endl;
 
-	str << std::endl;
+	rMessage() << "writing " << path << std::endl;
 
-	// verts
-	std::size_t col = 0;
+	ProcFileWriterList writers;
 
-	for (std::size_t i = 0 ; i < tri.vertices.size(); ++i)
-	{
-		str << "( ";
-		writeFloat(str, tri.shadowVertices[i][0]);
-		writeFloat(str, tri.shadowVertices[i][1]);
-		writeFloat(str, tri.shadowVertices[i][2]);
-		str << " )";
-		
-		if (++col == 5)
-		{
-			col = 0;
-			str << std::endl;
-		}
-	}
+	ProcTextWriter textWriter(path);
 
-	if (col != 0)
+	if (!textWriter.isOpen())
 	{
-		str << std::endl;
+		rMessage() << "error opening " << path << std::endl;
+		return;
 	}
 
-	// indexes
-	col = 0;
+	writers.add(textWriter);
 
-	for (std::size_t i = 0 ; i < tri.indices.size(); ++i)
-	{
-		str << (boost::format("%i ") % (str, tri.indices[i]));
-
-		if (++col == 18 )
-		{
-			col = 0;
-			str << std::endl;
-		}
-	}
+	std::shared_ptr<ProcBinaryWriter> binaryWriter;
 
-	if (col != 0)
+	if (writeBinarySidecar)
 	{
-		str << std::endl;
-	}
+		std::string binaryPath = boost::algorithm::replace_last_copy(path, Extension(), BinaryExtension());
 
-	return str;
-}
+		rMessage() << "writing " << binaryPath << std::endl;
 
-void ProcFile::saveToFile(const std::string& path)
-{
-	// write the file
-	rMessage() << "----- WriteOutputFile -----" << std::endl;
-
-	rMessage() << "writing " << path << std::endl;
+		binaryWriter.reset(new ProcBinaryWriter(binaryPath));
 
-	std::ofstream str(path.c_str());
-
-	if (!str.good())
-	{
-		rMessage() << "error opening " << path << std::endl;
-		return;
+		if (binaryWriter->isOpen())
+		{
+			writers.add(*binaryWriter);
+		}
+		else
+		{
+			rMessage() << "error opening " << binaryPath << std::endl;
+		}
 	}
 
-	str << FILE_ID << std::endl << std::endl;
-
 	// write the entity models and information, writing entities first
 	for (ProcEntities::reverse_iterator i = entities.rbegin(); i != entities.rend(); ++i)
 	{
@@ -555,7 +484,7 @@ void ProcFile::saveToFile(const std::string& path)
 			continue;
 		}
 
-		writeProcEntity(str, entity);
+		writeProcEntity(writers, entity);
 	}
 
 	// write the shadow volumes
@@ -563,20 +492,15 @@ void ProcFile::saveToFile(const std::string& path)
 	{
 		ProcLight& light = lights[i];
 
-		if (light.shadowTris.vertices.empty())
+		if (light.shadowTris.shadowVertices.empty())
 		{
 			continue;
 		}
 
-		str << (boost::format("shadowModel { /* name = */ \"_prelight_%s\"") % light.name) << std::endl << std::endl;
-
-		writeShadowTriangles(str, light.shadowTris);
-
-		str << "}" << std::endl << std::endl;
+		writers.writeShadowModel("_prelight_" + light.name, light.shadowTris);
 	}
 
-	str.flush();
-	str.close();
+	writers.finish();
 }
 
 } // namespace
@@ -2,7 +2,7 @@
 
 #include <memory>
 #include <vector>
-#include <list>
+#include <deque>
 #include "ibrush.h"
 #include "ipatch.h"
 #include "ishaders.h"
@@ -111,7 +111,7 @@ struct OptTri
 };
 typedef std::shared_ptr<OptTri> OptTriPtr;
 
-// chains of ProcTri are the general unit of processing
+// lists of ProcTri are the general unit of processing
 struct ProcTri
 {
 	MaterialPtr					material;
@@ -134,7 +134,8 @@ struct ProcTri
 		hashVert[0] = hashVert[1] = hashVert[2] = NULL;
 	}
 };
-typedef std::list<ProcTri> ProcTris;
+// Triangles are stored contiguously, to keep the clipping and optimisation passes cache-friendly
+typedef std::vector<ProcTri> ProcTris;
 
 #define MAX_GROUP_LIGHTS 16
 
@@ -163,7 +164,9 @@ struct ProcOptimizeGroup
 
 struct ProcArea
 {
-	typedef std::list<ProcOptimizeGroup> OptimizeGroups;
+	// New groups are added to the front, a deque keeps the groups (which are
+	// quite heavy due to their light array) in place while doing so
+	typedef std::deque<ProcOptimizeGroup> OptimizeGroups;
 	OptimizeGroups	groups;
 };
 
@@ -212,10 +215,12 @@ struct ProcInterAreaPortal
 class LeakFile;
 typedef std::shared_ptr<LeakFile> LeakFilePtr;
 
+class ProcFileWriter;
+
 /**
  * This class represents the processed data (entity models and shadow volumes)
  * as generated by the dmap compiler. Use the saveToFile() method to write the
- * data into the .proc file.
+ * data into the .proc file, ProcFileLoader reads it back.
  */
 class ProcFile
 {
@@ -250,7 +255,9 @@ public:
 		numWorldTriSurfs(0)
 	{}
 
-	void saveToFile(const std::string& path);
+	// Writes the .proc file to the given path. If writeBinarySidecar is true,
+	// the same data is written in binary form to a .procb file next to it.
+	void saveToFile(const std::string& path, bool writeBinarySidecar = false);
 
 	bool hasLeak() const
 	{
@@ -262,12 +269,16 @@ public:
 		return ".proc";
 	}
 
+	static const char* const BinaryExtension()
+	{
+		return ".procb";
+	}
+
 private:
-	std::ostream& writeProcEntity(std::ostream& str, ProcEntity& entity);
-	std::ostream& writeOutputPortals(std::ostream& str, ProcEntity& entity);
-	std::ostream& writeOutputNodes(std::ostream& str, const BspTreeNodePtr& node);
-	std::ostream& writeOutputNodeRecursively(std::ostream& str, const BspTreeNodePtr& node);
-	std::ostream& writeShadowTriangles(std::ostream& str, const Surface& shadowTris);
+	void writeProcEntity(ProcFileWriter& writer, ProcEntity& entity);
+	void writeOutputPortals(ProcFileWriter& writer, ProcEntity& entity);
+	void writeOutputNodes(ProcFileWriter& writer, const BspTreeNodePtr& node);
+	void writeOutputNodeRecursively(ProcFileWriter& writer, const BspTreeNodePtr& node);
 };
 typedef std::shared_ptr<ProcFile> ProcFilePtr;
 
@@ -0,0 +1,561 @@
+#include "ProcFileLoader.h"
+
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <boost/algorithm/string/predicate.hpp>
+#include "parser/BufferDefTokeniser.h"
+#include "ProcFile.h"
+
+namespace map
+{
+
+void ProcFileContents::writeTo(ProcFileWriter& writer) const
+{
+	for (Models::const_iterator model = models.begin(); model != models.end(); ++model)
+	{
+		writer.beginModel(model->name, model->surfaces.size());
+
+		for (std::size_t i = 0; i < model->surfaces.size(); ++i)
+		{
+			writer.writeModelSurface(model->surfaces[i].material, model->surfaces[i].surface);
+		}
+
+		writer.endModel();
+	}
+
+	// Single-area worlds don't have any portals or nodes
+	if (!nodes.empty())
+	{
+		writer.beginPortals(numAreas, portals.size());
+
+		for (Portals::const_iterator p = portals.begin(); p != portals.end(); ++p)
+		{
+			writer.writePortal(p->area0, p->area1, p->winding);
+		}
+
+		writer.endPortals();
+
+		writer.beginNodes(nodes.size());
+
+		for (Nodes::const_iterator n = nodes.begin(); n != nodes.end(); ++n)
+		{
+			writer.writeNode(n->plane, n->children[0], n->children[1]);
+		}
+
+		writer.endNodes();
+	}
+
+	for (ShadowModels::const_iterator s = shadowModels.begin(); s != shadowModels.end(); ++s)
+	{
+		writer.writeShadowModel(s->name, s->surface);
+	}
+
+	writer.finish();
+}
+
+namespace
+{
+
+// Text format
+
+float parseFloat(parser::DefTokeniser& tok)
+{
+	std::string token = tok.nextToken();
+
+	char* end = NULL;
+	double value = strtod(token.c_str(), &end);
+
+	if (token.empty() || *end != '\0')
+	{
+		throw parser::ParseException("ProcFileLoader: expected a number, found \"" + token + "\"");
+	}
+
+	return static_cast<float>(value);
+}
+
+int parseInt(parser::DefTokeniser& tok)
+{
+	std::string token = tok.nextToken();
+
+	char* end = NULL;
+	long value = strtol(token.c_str(), &end, 10);
+
+	if (token.empty() || *end != '\0')
+	{
+		throw parser::ParseException("ProcFileLoader: expected an integer, found \"" + token + "\"");
+	}
+
+	return static_cast<int>(value);
+}
+
+std::size_t parseCount(parser::DefTokeniser& tok)
+{
+	int value = parseInt(tok);
+
+	if (value < 0)
+	{
+		throw parser::ParseException("ProcFileLoader: negative count");
+	}
+
+	return static_cast<std::size_t>(value);
+}
+
+void parseIndices(parser::DefTokeniser& tok, Surface& surface, std::size_t numIndexes)
+{
+	surface.indices.resize(numIndexes);
+
+	for (std::size_t i = 0; i < numIndexes; ++i)
+	{
+		surface.indices[i] = parseInt(tok);
+	}
+}
+
+void parseModel(parser::DefTokeniser& tok, ProcFileContents& contents)
+{
+	contents.models.push_back(ProcFileContents::Model());
+	ProcFileContents::Model& model = contents.models.back();
+
+	tok.assertNextToken("{");
+
+	model.name = tok.nextToken();
+	model.surfaces.resize(parseCount(tok));
+
+	for (std::size_t s = 0; s < model.surfaces.size(); ++s)
+	{
+		ProcFileContents::ModelSurface& modelSurface = model.surfaces[s];
+
+		tok.assertNextToken("{");
+
+		modelSurface.material = tok.nextToken();
+
+		std::size_t numVerts = parseCount(tok);
+		std::size_t numIndexes = parseCount(tok);
+
+		modelSurface.surface.vertices.resize(numVerts);
+
+		for (std::size_t i = 0; i < numVerts; ++i)
+		{
+			ArbitraryMeshVertex& v = modelSurface.surface.vertices[i];
+
+			tok.assertNextToken("(");
+			v.vertex[0] = parseFloat(tok);
+			v.vertex[1] = parseFloat(tok);
+			v.vertex[2] = parseFloat(tok);
+			v.texcoord[0] = parseFloat(tok);
+			v.texcoord[1] = parseFloat(tok);
+			v.normal[0] = parseFloat(tok);
+			v.normal[1] = parseFloat(tok);
+			v.normal[2] = parseFloat(tok);
+			tok.assertNextToken(")");
+		}
+
+		parseIndices(tok, modelSurface.surface, numIndexes);
+
+		tok.assertNextToken("}");
+	}
+
+	tok.assertNextToken("}");
+}
+
+void parsePortals(parser::DefTokeniser& tok, ProcFileContents& contents)
+{
+	tok.assertNextToken("{");
+
+	contents.numAreas = parseCount(tok);
+	contents.portals.resize(parseCount(tok));
+
+	for (std::size_t p = 0; p < contents.portals.size(); ++p)
+	{
+		ProcFileContents::Portal& portal = contents.portals[p];
+
+		std::size_t numPoints = parseCount(tok);
+		portal.area0 = parseCount(tok);
+		portal.area1 = parseCount(tok);
+
+		portal.winding.resize(numPoints);
+
+		// Accept both a single parenthesis around all points (as written
+		// by ProcTextWriter) and one around each point
+		for (std::size_t i = 0; i < numPoints; ++i)
+		{
+			if (tok.peek() == "(")
+			{
+				tok.nextToken();
+			}
+
+			portal.winding[i].vertex[0] = parseFloat(tok);
+			portal.winding[i].vertex[1] = parseFloat(tok);
+			portal.winding[i].vertex[2] = parseFloat(tok);
+
+			if (tok.peek() == ")")
+			{
+				tok.nextToken();
+			}
+		}
+	}
+
+	tok.assertNextToken("}");
+}
+
+void parseNodes(parser::DefTokeniser& tok, ProcFileContents& contents)
+{
+	tok.assertNextToken("{");
+
+	contents.nodes.resize(parseCount(tok));
+
+	for (std::size_t n = 0; n < contents.nodes.size(); ++n)
+	{
+		ProcFileContents::Node& node = contents.nodes[n];
+
+		tok.assertNextToken("(");
+		float a = parseFloat(tok);
+		float b = parseFloat(tok);
+		float c = parseFloat(tok);
+		float d = parseFloat(tok);
+		tok.assertNextToken(")");
+
+		node.plane = Plane3(a, b, c, -d);
+
+		node.children[0] = parseInt(tok);
+		node.children[1] = parseInt(tok);
+	}
+
+	tok.assertNextToken("}");
+}
+
+void parseShadowModel(parser::DefTokeniser& tok, ProcFileContents& contents)
+{
+	contents.shadowModels.push_back(ProcFileContents::ShadowModel());
+	ProcFileContents::ShadowModel& model = contents.shadowModels.back();
+
+	tok.assertNextToken("{");
+
+	model.name = tok.nextToken();
+
+	std::size_t numVerts = parseCount(tok);
+	model.surface.numShadowIndicesNoCaps = parseCount(tok);
+	model.surface.numShadowIndicesNoFrontCaps = parseCount(tok);
+	std::size_t numIndexes = parseCount(tok);
+	model.surface.shadowCapPlaneBits = parseInt(tok);
+
+	model.surface.shadowVertices.resize(numVerts);
+
+	for (std::size_t i = 0; i < numVerts; ++i)
+	{
+		tok.assertNextToken("(");
+		float x = parseFloat(tok);
+		float y = parseFloat(tok);
+		float z = parseFloat(tok);
+		tok.assertNextToken(")");
+
+		model.surface.shadowVertices[i] = Vector4(x, y, z, 1);
+	}
+
+	parseIndices(tok, model.surface, numIndexes);
+
+	tok.assertNextToken("}");
+}
+
+// Binary format
+
+class BinaryReader
+{
+private:
+	std::istream& _stream;
+
+public:
+	BinaryReader(std::istream& stream) :
+		_stream(stream)
+	{}
+
+	// Returns false at the end of the stream
+	bool readTag(int& tag)
+	{
+		char c;
+
+		if (!_stream.get(c))
+		{
+			return false;
+		}
+
+		tag = static_cast<unsigned char>(c);
+		return true;
+	}
+
+	std::int32_t readInt()
+	{
+		unsigned char bytes[4];
+
+		if (!_stream.read(reinterpret_cast<char*>(bytes), 4))
+		{
+			throw parser::ParseException("ProcFileLoader: unexpected end of binary file");
+		}
+
+		return static_cast<std::int32_t>(bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) |
+			(static_cast<std::uint32_t>(bytes[3]) << 24));
+	}
+
+	std::size_t readCount()
+	{
+		std::int32_t value = readInt();
+
+		if (value < 0)
+		{
+			throw parser::ParseException("ProcFileLoader: negative count");
+		}
+
+		return static_cast<std::size_t>(value);
+	}
+
+	float readFloat()
+	{
+		std::int32_t bits = readInt();
+
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+
+		return value;
+	}
+
+	std::string readString()
+	{
+		std::size_t length = readCount();
+		std::string str(length, '\0');
+
+		if (length > 0 && !_stream.read(&str[0], length))
+		{
+			throw parser::ParseException("ProcFileLoader: unexpected end of binary file");
+		}
+
+		return str;
+	}
+
+	void readIndices(Surface& surface, std::size_t numIndexes)
+	{
+		surface.indices.resize(numIndexes);
+
+		for (std::size_t i = 0; i < numIndexes; ++i)
+		{
+			surface.indices[i] = readInt();
+		}
+	}
+
+	void expectTag(int expected)
+	{
+		int tag;
+
+		if (!readTag(tag) || tag != expected)
+		{
+			throw parser::ParseException("ProcFileLoader: unexpected record in binary file");
+		}
+	}
+};
+
+} // namespace
+
+ProcFileContentsPtr ProcFileLoader::loadText(std::istream& stream)
+{
+	ProcFileContentsPtr contents(new ProcFileContents);
+
+	parser::BufferDefTokeniser tok(stream);
+
+	tok.assertNextToken(ProcFile::FILE_ID);
+
+	while (tok.hasMoreTokens())
+	{
+		std::string token = tok.nextToken();
+
+		if (token == "model")
+		{
+			parseModel(tok, *contents);
+		}
+		else if (token == "interAreaPortals")
+		{
+			parsePortals(tok, *contents);
+		}
+		else if (token == "nodes")
+		{
+			parseNodes(tok, *contents);
+		}
+		else if (token == "shadowModel")
+		{
+			parseShadowModel(tok, *contents);
+		}
+		else
+		{
+			throw parser::ParseException("ProcFileLoader: unknown token \"" + token + "\"");
+		}
+	}
+
+	return contents;
+}
+
+ProcFileContentsPtr ProcFileLoader::loadBinary(std::istream& stream)
+{
+	ProcFileContentsPtr contents(new ProcFileContents);
+
+	BinaryReader reader(stream);
+
+	if (reader.readString() != ProcBinaryWriter::BINARY_FILE_ID)
+	{
+		throw parser::ParseException("ProcFileLoader: not a binary proc file");
+	}
+
+	int tag;
+
+	while (reader.readTag(tag))
+	{
+		switch (tag)
+		{
+		case ProcBinaryWriter::TAG_MODEL:
+		{
+			contents->models.push_back(ProcFileContents::Model());
+			ProcFileContents::Model& model = contents->models.back();
+
+			model.name = reader.readString();
+			model.surfaces.resize(reader.readCount());
+
+			for (std::size_t s = 0; s < model.surfaces.size(); ++s)
+			{
+				ProcFileContents::ModelSurface& modelSurface = model.surfaces[s];
+
+				reader.expectTag(ProcBinaryWriter::TAG_MODEL_SURFACE);
+
+				modelSurface.material = reader.readString();
+
+				std::size_t numVerts = reader.readCount();
+				std::size_t numIndexes = reader.readCount();
+
+				modelSurface.surface.vertices.resize(numVerts);
+
+				for (std::size_t i = 0; i < numVerts; ++i)
+				{
+					ArbitraryMeshVertex& v = modelSurface.surface.vertices[i];
+
+					v.vertex[0] = reader.readFloat();
+					v.vertex[1] = reader.readFloat();
+					v.vertex[2] = reader.readFloat();
+					v.texcoord[0] = reader.readFloat();
+					v.texcoord[1] = reader.readFloat();
+					v.normal[0] = reader.readFloat();
+					v.normal[1] = reader.readFloat();
+					v.normal[2] = reader.readFloat();
+				}
+
+				reader.readIndices(modelSurface.surface, numIndexes);
+			}
+
+			reader.expectTag(ProcBinaryWriter::TAG_END);
+			break;
+		}
+		case ProcBinaryWriter::TAG_PORTALS:
+		{
+			contents->numAreas = reader.readCount();
+			contents->portals.resize(reader.readCount());
+
+			for (std::size_t p = 0; p < contents->portals.size(); ++p)
+			{
+				ProcFileContents::Portal& portal = contents->portals[p];
+
+				reader.expectTag(ProcBinaryWriter::TAG_PORTAL);
+
+				portal.area0 = reader.readCount();
+				portal.area1 = reader.readCount();
+				portal.winding.resize(reader.readCount());
+
+				for (std::size_t i = 0; i < portal.winding.size(); ++i)
+				{
+					portal.winding[i].vertex[0] = reader.readFloat();
+					portal.winding[i].vertex[1] = reader.readFloat();
+					portal.winding[i].vertex[2] = reader.readFloat();
+				}
+			}
+
+			reader.expectTag(ProcBinaryWriter::TAG_END);
+			break;
+		}
+		case ProcBinaryWriter::TAG_NODES:
+		{
+			contents->nodes.resize(reader.readCount());
+
+			for (std::size_t n = 0; n < contents->nodes.size(); ++n)
+			{
+				ProcFileContents::Node& node = contents->nodes[n];
+
+				reader.expectTag(ProcBinaryWriter::TAG_NODE);
+
+				float a = reader.readFloat();
+				float b = reader.readFloat();
+				float c = reader.readFloat();
+				float d = reader.readFloat();
+
+				node.plane = Plane3(a, b, c, -d);
+
+				node.children[0] = reader.readInt();
+				node.children[1] = reader.readInt();
+			}
+
+			reader.expectTag(ProcBinaryWriter::TAG_END);
+			break;
+		}
+		case ProcBinaryWriter::TAG_SHADOW_MODEL:
+		{
+			contents->shadowModels.push_back(ProcFileContents::ShadowModel());
+			ProcFileContents::ShadowModel& model = contents->shadowModels.back();
+
+			model.name = reader.readString();
+
+			std::size_t numVerts = reader.readCount();
+			model.surface.numShadowIndicesNoCaps = reader.readCount();
+			model.surface.numShadowIndicesNoFrontCaps = reader.readCount();
+			std::size_t numIndexes = reader.readCount();
+			model.surface.shadowCapPlaneBits = reader.readInt();
+
+			model.surface.shadowVertices.resize(numVerts);
+
+			for (std::size_t i = 0; i < numVerts; ++i)
+			{
+				float x = reader.readFloat();
+				float y = reader.readFloat();
+				float z = reader.readFloat();
+
+				model.surface.shadowVertices[i] = Vector4(x, y, z, 1);
+			}
+
+			reader.readIndices(model.surface, numIndexes);
+			break;
+		}
+		default:
+			throw parser::ParseException("ProcFileLoader: unexpected record in binary file");
+		};
+	}
+
+	return contents;
+}
+
+ProcFileContentsPtr ProcFileLoader::loadFile(const std::string& path)
+{
+	if (boost::algorithm::iends_with(path, ProcFile::BinaryExtension()))
+	{
+		std::ifstream stream(path.c_str(), std::ios::in | std::ios::binary);
+
+		if (!stream.good())
+		{
+			throw parser::ParseException("ProcFileLoader: cannot open " + path);
+		}
+
+		return loadBinary(stream);
+	}
+
+	std::ifstream stream(path.c_str());
+
+	if (!stream.good())
+	{
+		throw parser::ParseException("ProcFileLoader: cannot open " + path);
+	}
+
+	return loadText(stream);
+}
+
+} // namespace
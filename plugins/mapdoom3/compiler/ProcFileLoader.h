@@ -0,0 +1,85 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <istream>
+#include "ProcFileWriter.h"
+
+namespace map
+{
+
+/**
+ * The contents of a .proc file, as read back by the ProcFileLoader.
+ * Passing them to a ProcFileWriter reproduces the file, such that
+ * a compiled .proc can be verified and compared without the game.
+ */
+class ProcFileContents
+{
+public:
+	struct ModelSurface
+	{
+		std::string material;
+		Surface		surface;		// vertices and indices
+	};
+
+	struct Model
+	{
+		std::string name;
+		std::vector<ModelSurface> surfaces;
+	};
+	typedef std::vector<Model> Models;
+	Models models;
+
+	struct Portal
+	{
+		std::size_t area0;
+		std::size_t area1;
+		ProcWinding winding;
+	};
+	typedef std::vector<Portal> Portals;
+	Portals portals;
+
+	std::size_t numAreas;
+
+	struct Node
+	{
+		Plane3	plane;
+		int		children[2];	// 0 = solid, negative = area (-1-child)
+	};
+	typedef std::vector<Node> Nodes;
+	Nodes nodes;
+
+	struct ShadowModel
+	{
+		std::string name;
+		Surface		surface;		// shadowVertices, indices and the shadow index counts
+	};
+	typedef std::vector<ShadowModel> ShadowModels;
+	ShadowModels shadowModels;
+
+	ProcFileContents() :
+		numAreas(0)
+	{}
+
+	void writeTo(ProcFileWriter& writer) const;
+};
+typedef std::shared_ptr<ProcFileContents> ProcFileContentsPtr;
+
+/**
+ * Reads .proc files in the text format written by ProcTextWriter
+ * (which is the format of the game) or in the binary sidecar format
+ * written by ProcBinaryWriter. Throws parser::ParseException on
+ * malformed input.
+ */
+class ProcFileLoader
+{
+public:
+	static ProcFileContentsPtr loadText(std::istream& stream);
+	static ProcFileContentsPtr loadBinary(std::istream& stream);
+
+	// Loads the given file, choosing the format by its extension
+	static ProcFileContentsPtr loadFile(const std::string& path);
+};
+
+} // namespace
@@ -0,0 +1,562 @@
+#include "ProcFileWriter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "ProcFile.h"
+
+namespace map
+{
+
+namespace
+{
+	// The buffers are passed to the stream once they exceed this size
+	const std::size_t WRITE_BUFFER_SIZE = 1 << 20;
+}
+
+ProcTextWriter::ProcTextWriter(const std::string& path) :
+	_stream(path.c_str()),
+	_surfaceNum(0),
+	_portalNum(0),
+	_nodeNum(0)
+{
+	_buffer.reserve(WRITE_BUFFER_SIZE + 1024);
+
+	write(ProcFile::FILE_ID);
+	write("\n\n");
+}
+
+bool ProcTextWriter::isOpen() const
+{
+	return _stream.good();
+}
+
+void ProcTextWriter::beginModel(const std::string& name, std::size_t numSurfaces)
+{
+	_surfaceNum = 0;
+
+	write("model { /* name = */ \"");
+	write(name);
+	write("\" /* numSurfaces = */ ");
+	writeInt(numSurfaces);
+	_buffer.resize(_buffer.size() - 1); // no trailing space
+	write("\n\n");
+}
+
+void ProcTextWriter::writeModelSurface(const std::string& material, const Surface& surface)
+{
+	write("/* surface ");
+	writeInt(_surfaceNum++);
+	write("*/ { \"");
+	write(material);
+	write("\" ");
+
+	write("/* numVerts = */ ");
+	writeInt(surface.vertices.size());
+	write("/* numIndexes = */ ");
+	writeInt(surface.indices.size());
+	_buffer.resize(_buffer.size() - 1);
+	write('\n');
+
+	// verts
+	std::size_t col = 0;
+
+	for (std::size_t i = 0; i < surface.vertices.size(); ++i)
+	{
+		const ArbitraryMeshVertex& dv = surface.vertices[i];
+
+		write("( ");
+		writeFloat(static_cast<float>(dv.vertex[0]));
+		writeFloat(static_cast<float>(dv.vertex[1]));
+		writeFloat(static_cast<float>(dv.vertex[2]));
+		writeFloat(static_cast<float>(dv.texcoord[0]));
+		writeFloat(static_cast<float>(dv.texcoord[1]));
+		writeFloat(static_cast<float>(dv.normal[0]));
+		writeFloat(static_cast<float>(dv.normal[1]));
+		writeFloat(static_cast<float>(dv.normal[2]));
+		write(" ) ");
+
+		if (++col == 3)
+		{
+			col = 0;
+			write('\n');
+		}
+
+		flushIfFull();
+	}
+
+	if (col != 0)
+	{
+		write('\n');
+	}
+
+	// indexes
+	col = 0;
+
+	for (std::size_t i = 0; i < surface.indices.size(); ++i)
+	{
+		writeInt(surface.indices[i]);
+
+		if (++col == 18)
+		{
+			col = 0;
+			write('\n');
+		}
+
+		flushIfFull();
+	}
+
+	if (col != 0)
+	{
+		write('\n');
+	}
+
+	write("}\n\n");
+}
+
+void ProcTextWriter::endModel()
+{
+	write("}\n\n");
+	flushIfFull();
+}
+
+void ProcTextWriter::beginPortals(std::size_t numAreas, std::size_t numPortals)
+{
+	_portalNum = 0;
+
+	write("interAreaPortals { /* numAreas = */ ");
+	writeInt(numAreas);
+	write("/* numIAP = */ ");
+	writeInt(numPortals);
+	_buffer.resize(_buffer.size() - 1);
+	write("\n\n");
+
+	write("/* interAreaPortal format is: numPoints positiveSideArea negativeSideArea ( point) ... */\n");
+}
+
+void ProcTextWriter::writePortal(std::size_t area0, std::size_t area1, const ProcWinding& winding)
+{
+	write("/* iap ");
+	writeInt(_portalNum++);
+	write("*/ ");
+	writeInt(winding.size());
+	writeInt(area0);
+	writeInt(area1);
+
+	write("( ");
+
+	for (std::size_t j = 0; j < winding.size(); ++j)
+	{
+		writeFloat(static_cast<float>(winding[j].vertex[0]));
+		writeFloat(static_cast<float>(winding[j].vertex[1]));
+		writeFloat(static_cast<float>(winding[j].vertex[2]));
+	}
+
+	write(") \n");
+
+	flushIfFull();
+}
+
+void ProcTextWriter::endPortals()
+{
+	write("}\n\n");
+}
+
+void ProcTextWriter::beginNodes(std::size_t numNodes)
+{
+	_nodeNum = 0;
+
+	write("nodes { /* numNodes = */ ");
+	writeInt(numNodes);
+	_buffer.resize(_buffer.size() - 1);
+	write("\n\n");
+
+	write("/* node format is: ( planeVector ) positiveChild negativeChild */\n");
+	write("/* a child number of 0 is an opaque, solid area */\n");
+	write("/* negative child numbers are areas: (-1-child) */\n");
+}
+
+void ProcTextWriter::writeNode(const Plane3& plane, int positiveChild, int negativeChild)
+{
+	write("/* node ");
+	writeInt(_nodeNum++);
+	write("*/ ( ");
+	writeFloat(static_cast<float>(plane.normal()[0]));
+	writeFloat(static_cast<float>(plane.normal()[1]));
+	writeFloat(static_cast<float>(plane.normal()[2]));
+	writeFloat(static_cast<float>(-plane.dist()));
+	write(") ");
+	writeInt(positiveChild);
+	writeInt(negativeChild);
+	_buffer.resize(_buffer.size() - 1);
+	write('\n');
+
+	flushIfFull();
+}
+
+void ProcTextWriter::endNodes()
+{
+	write("}\n\n");
+}
+
+void ProcTextWriter::writeShadowModel(const std::string& name, const Surface& tri)
+{
+	write("shadowModel { /* name = */ \"");
+	write(name);
+	write("\"\n\n");
+
+	write("/* numVerts = */ ");
+	writeInt(tri.shadowVertices.size());
+	write("/* noCaps = */ ");
+	writeInt(tri.numShadowIndicesNoCaps);
+	write("/* noFrontCaps = */ ");
+	writeInt(tri.numShadowIndicesNoFrontCaps);
+	write("/* numIndexes = */ ");
+	writeInt(tri.indices.size());
+	write("/* planeBits = */ ");
+	writeInt(tri.shadowCapPlaneBits);
+	_buffer.resize(_buffer.size() - 1);
+	write('\n');
+
+	// verts
+	std::size_t col = 0;
+
+	for (std::size_t i = 0; i < tri.shadowVertices.size(); ++i)
+	{
+		write("( ");
+		writeFloat(static_cast<float>(tri.shadowVertices[i][0]));
+		writeFloat(static_cast<float>(tri.shadowVertices[i][1]));
+		writeFloat(static_cast<float>(tri.shadowVertices[i][2]));
+		write(" )");
+
+		if (++col == 5)
+		{
+			col = 0;
+			write('\n');
+		}
+
+		flushIfFull();
+	}
+
+	if (col != 0)
+	{
+		write('\n');
+	}
+
+	// indexes
+	col = 0;
+
+	for (std::size_t i = 0; i < tri.indices.size(); ++i)
+	{
+		writeInt(tri.indices[i]);
+
+		if (++col == 18)
+		{
+			col = 0;
+			write('\n');
+		}
+
+		flushIfFull();
+	}
+
+	if (col != 0)
+	{
+		write('\n');
+	}
+
+	write("}\n\n");
+}
+
+void ProcTextWriter::finish()
+{
+	_stream.write(_buffer.data(), _buffer.size());
+	_buffer.clear();
+
+	_stream.flush();
+}
+
+void ProcTextWriter::write(const char* str)
+{
+	_buffer.append(str);
+}
+
+void ProcTextWriter::write(const std::string& str)
+{
+	_buffer.append(str);
+}
+
+void ProcTextWriter::write(char c)
+{
+	_buffer.push_back(c);
+}
+
+void ProcTextWriter::writeInt(long long value)
+{
+	char digits[24];
+	std::size_t numDigits = 0;
+
+	unsigned long long magnitude = value < 0 ?
+		static_cast<unsigned long long>(-(value + 1)) + 1 : static_cast<unsigned long long>(value);
+
+	do
+	{
+		digits[numDigits++] = static_cast<char>('0' + magnitude % 10);
+		magnitude /= 10;
+	}
+	while (magnitude > 0);
+
+	if (value < 0)
+	{
+		_buffer.push_back('-');
+	}
+
+	while (numDigits > 0)
+	{
+		_buffer.push_back(digits[--numDigits]);
+	}
+
+	_buffer.push_back(' ');
+}
+
+void ProcTextWriter::writeFloat(float v)
+{
+	double magnitude = fabs(static_cast<double>(v));
+
+	// Values this large don't occur in maps, leave them to the C library
+	if (!(magnitude < 1e12))
+	{
+		char str[64];
+		snprintf(str, sizeof(str), "%f ", v);
+		write(str);
+		return;
+	}
+
+	float rounded = floorf(v + 0.5f);
+
+	if (fabs(v - rounded) < 0.001)
+	{
+		writeInt(static_cast<long long>(rounded));
+		return;
+	}
+
+	// Equivalent to "%f": six decimals, rounded
+	unsigned long long scaled = static_cast<unsigned long long>(magnitude * 1e6 + 0.5);
+	unsigned long long fraction = scaled % 1000000;
+
+	if (v < 0)
+	{
+		_buffer.push_back('-');
+	}
+
+	// the integer part, written without the trailing space
+	writeInt(static_cast<long long>(scaled / 1000000));
+	_buffer[_buffer.size() - 1] = '.';
+
+	char decimals[6];
+
+	for (int i = 5; i >= 0; --i)
+	{
+		decimals[i] = static_cast<char>('0' + fraction % 10);
+		fraction /= 10;
+	}
+
+	_buffer.append(decimals, 6);
+	_buffer.push_back(' ');
+}
+
+void ProcTextWriter::flushIfFull()
+{
+	if (_buffer.size() >= WRITE_BUFFER_SIZE)
+	{
+		_stream.write(_buffer.data(), _buffer.size());
+		_buffer.clear();
+	}
+}
+
+// ------------------------------------------------------------------------
+
+const char* const ProcBinaryWriter::BINARY_FILE_ID = "binaryProcFile001";
+
+ProcBinaryWriter::ProcBinaryWriter(const std::string& path) :
+	_stream(path.c_str(), std::ios::out | std::ios::binary)
+{
+	_buffer.reserve(WRITE_BUFFER_SIZE + 1024);
+
+	writeString(BINARY_FILE_ID);
+}
+
+bool ProcBinaryWriter::isOpen() const
+{
+	return _stream.good();
+}
+
+void ProcBinaryWriter::beginModel(const std::string& name, std::size_t numSurfaces)
+{
+	writeTag(TAG_MODEL);
+	writeString(name);
+	writeInt(static_cast<std::int32_t>(numSurfaces));
+}
+
+void ProcBinaryWriter::writeModelSurface(const std::string& material, const Surface& surface)
+{
+	writeTag(TAG_MODEL_SURFACE);
+	writeString(material);
+	writeInt(static_cast<std::int32_t>(surface.vertices.size()));
+	writeInt(static_cast<std::int32_t>(surface.indices.size()));
+
+	for (std::size_t i = 0; i < surface.vertices.size(); ++i)
+	{
+		const ArbitraryMeshVertex& dv = surface.vertices[i];
+
+		writeFloat(static_cast<float>(dv.vertex[0]));
+		writeFloat(static_cast<float>(dv.vertex[1]));
+		writeFloat(static_cast<float>(dv.vertex[2]));
+		writeFloat(static_cast<float>(dv.texcoord[0]));
+		writeFloat(static_cast<float>(dv.texcoord[1]));
+		writeFloat(static_cast<float>(dv.normal[0]));
+		writeFloat(static_cast<float>(dv.normal[1]));
+		writeFloat(static_cast<float>(dv.normal[2]));
+
+		flushIfFull();
+	}
+
+	for (std::size_t i = 0; i < surface.indices.size(); ++i)
+	{
+		writeInt(surface.indices[i]);
+	}
+
+	flushIfFull();
+}
+
+void ProcBinaryWriter::endModel()
+{
+	writeTag(TAG_END);
+}
+
+void ProcBinaryWriter::beginPortals(std::size_t numAreas, std::size_t numPortals)
+{
+	writeTag(TAG_PORTALS);
+	writeInt(static_cast<std::int32_t>(numAreas));
+	writeInt(static_cast<std::int32_t>(numPortals));
+}
+
+void ProcBinaryWriter::writePortal(std::size_t area0, std::size_t area1, const ProcWinding& winding)
+{
+	writeTag(TAG_PORTAL);
+	writeInt(static_cast<std::int32_t>(area0));
+	writeInt(static_cast<std::int32_t>(area1));
+	writeInt(static_cast<std::int32_t>(winding.size()));
+
+	for (std::size_t j = 0; j < winding.size(); ++j)
+	{
+		writeFloat(static_cast<float>(winding[j].vertex[0]));
+		writeFloat(static_cast<float>(winding[j].vertex[1]));
+		writeFloat(static_cast<float>(winding[j].vertex[2]));
+	}
+
+	flushIfFull();
+}
+
+void ProcBinaryWriter::endPortals()
+{
+	writeTag(TAG_END);
+}
+
+void ProcBinaryWriter::beginNodes(std::size_t numNodes)
+{
+	writeTag(TAG_NODES);
+	writeInt(static_cast<std::int32_t>(numNodes));
+}
+
+void ProcBinaryWriter::writeNode(const Plane3& plane, int positiveChild, int negativeChild)
+{
+	writeTag(TAG_NODE);
+	writeFloat(static_cast<float>(plane.normal()[0]));
+	writeFloat(static_cast<float>(plane.normal()[1]));
+	writeFloat(static_cast<float>(plane.normal()[2]));
+	writeFloat(static_cast<float>(-plane.dist()));
+	writeInt(positiveChild);
+	writeInt(negativeChild);
+
+	flushIfFull();
+}
+
+void ProcBinaryWriter::endNodes()
+{
+	writeTag(TAG_END);
+}
+
+void ProcBinaryWriter::writeShadowModel(const std::string& name, const Surface& tri)
+{
+	writeTag(TAG_SHADOW_MODEL);
+	writeString(name);
+	writeInt(static_cast<std::int32_t>(tri.shadowVertices.size()));
+	writeInt(static_cast<std::int32_t>(tri.numShadowIndicesNoCaps));
+	writeInt(static_cast<std::int32_t>(tri.numShadowIndicesNoFrontCaps));
+	writeInt(static_cast<std::int32_t>(tri.indices.size()));
+	writeInt(tri.shadowCapPlaneBits);
+
+	for (std::size_t i = 0; i < tri.shadowVertices.size(); ++i)
+	{
+		writeFloat(static_cast<float>(tri.shadowVertices[i][0]));
+		writeFloat(static_cast<float>(tri.shadowVertices[i][1]));
+		writeFloat(static_cast<float>(tri.shadowVertices[i][2]));
+
+		flushIfFull();
+	}
+
+	for (std::size_t i = 0; i < tri.indices.size(); ++i)
+	{
+		writeInt(tri.indices[i]);
+	}
+
+	flushIfFull();
+}
+
+void ProcBinaryWriter::finish()
+{
+	_stream.write(_buffer.data(), _buffer.size());
+	_buffer.clear();
+
+	_stream.flush();
+}
+
+void ProcBinaryWriter::writeTag(Tag tag)
+{
+	_buffer.push_back(static_cast<char>(tag));
+}
+
+void ProcBinaryWriter::writeInt(std::int32_t value)
+{
+	std::uint32_t bits = static_cast<std::uint32_t>(value);
+
+	_buffer.push_back(static_cast<char>(bits & 0xff));
+	_buffer.push_back(static_cast<char>((bits >> 8) & 0xff));
+	_buffer.push_back(static_cast<char>((bits >> 16) & 0xff));
+	_buffer.push_back(static_cast<char>((bits >> 24) & 0xff));
+}
+
+void ProcBinaryWriter::writeFloat(float value)
+{
+	std::int32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	writeInt(bits);
+}
+
+void ProcBinaryWriter::writeString(const std::string& str)
+{
+	writeInt(static_cast<std::int32_t>(str.size()));
+	_buffer.append(str);
+}
+
+void ProcBinaryWriter::flushIfFull()
+{
+	if (_buffer.size() >= WRITE_BUFFER_SIZE)
+	{
+		_stream.write(_buffer.data(), _buffer.size());
+		_buffer.clear();
+	}
+}
+
+} // namespace
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include "math/Plane3.h"
+#include "ProcWinding.h"
+#include "Surface.h"
+
+namespace map
+{
+
+/**
+ * Receives the contents of a .proc file in file order: the entity models
+ * first, followed by the portals and the nodes of the world, followed by the
+ * shadow models. The implementations stream the data to disk as it arrives.
+ */
+class ProcFileWriter
+{
+public:
+	virtual ~ProcFileWriter() {}
+
+	// Returns false if the target file could not be opened
+	virtual bool isOpen() const = 0;
+
+	virtual void beginModel(const std::string& name, std::size_t numSurfaces) = 0;
+	virtual void writeModelSurface(const std::string& material, const Surface& surface) = 0;
+	virtual void endModel() = 0;
+
+	virtual void beginPortals(std::size_t numAreas, std::size_t numPortals) = 0;
+	virtual void writePortal(std::size_t area0, std::size_t area1, const ProcWinding& winding) = 0;
+	virtual void endPortals() = 0;
+
+	// Nodes are numbered in the order they are written, starting at 0
+	virtual void beginNodes(std::size_t numNodes) = 0;
+	virtual void writeNode(const Plane3& plane, int positiveChild, int negativeChild) = 0;
+	virtual void endNodes() = 0;
+
+	// Writes the shadowVertices and indices of the given surface
+	virtual void writeShadowModel(const std::string& name, const Surface& shadowTris) = 0;
+
+	// Writes any pending data to disk
+	virtual void finish() = 0;
+};
+
+/**
+ * Writes the .proc text format as read by the game. Numbers are formatted
+ * by hand into a large buffer which is passed to the stream in one go
+ * when full, which is a lot faster than streaming each value on its own.
+ */
+class ProcTextWriter :
+	public ProcFileWriter
+{
+private:
+	std::ofstream _stream;
+	std::string _buffer;
+
+	std::size_t _surfaceNum;
+	std::size_t _portalNum;
+	std::size_t _nodeNum;
+
+public:
+	ProcTextWriter(const std::string& path);
+
+	bool isOpen() const;
+
+	void beginModel(const std::string& name, std::size_t numSurfaces);
+	void writeModelSurface(const std::string& material, const Surface& surface);
+	void endModel();
+
+	void beginPortals(std::size_t numAreas, std::size_t numPortals);
+	void writePortal(std::size_t area0, std::size_t area1, const ProcWinding& winding);
+	void endPortals();
+
+	void beginNodes(std::size_t numNodes);
+	void writeNode(const Plane3& plane, int positiveChild, int negativeChild);
+	void endNodes();
+
+	void writeShadowModel(const std::string& name, const Surface& shadowTris);
+
+	void finish();
+
+private:
+	void write(const char* str);
+	void write(const std::string& str);
+	void write(char c);
+
+	// Writes the integer followed by a space
+	void writeInt(long long value);
+
+	// Integral values are written without decimals, all others
+	// with six fixed decimals, each followed by a space
+	void writeFloat(float value);
+
+	void flushIfFull();
+};
+
+/**
+ * Compact binary representation of the .proc contents, meant for our
+ * own tools and not understood by the game. All values are stored in
+ * little-endian byte order, vertices as 32 bit floats.
+ *
+ * The file starts with the BINARY_FILE_ID string, followed by a sequence
+ * of records, each starting with its one byte Tag.
+ */
+class ProcBinaryWriter :
+	public ProcFileWriter
+{
+public:
+	static const char* const BINARY_FILE_ID;
+
+	enum Tag
+	{
+		TAG_MODEL = 1,			// name, numSurfaces
+		TAG_MODEL_SURFACE,		// material, numVerts, numIndexes, vertices (8 floats), indices
+		TAG_PORTALS,			// numAreas, numPortals
+		TAG_PORTAL,				// area0, area1, numPoints, points (3 floats)
+		TAG_NODES,				// numNodes
+		TAG_NODE,				// plane (4 floats), positiveChild, negativeChild
+		TAG_SHADOW_MODEL,		// name, numVerts, noCaps, noFrontCaps, numIndexes, planeBits, vertices (3 floats), indices
+		TAG_END,				// closes a model, portals or nodes block
+	};
+
+private:
+	std::ofstream _stream;
+	std::string _buffer;
+
+public:
+	ProcBinaryWriter(const std::string& path);
+
+	bool isOpen() const;
+
+	void beginModel(const std::string& name, std::size_t numSurfaces);
+	void writeModelSurface(const std::string& material, const Surface& surface);
+	void endModel();
+
+	void beginPortals(std::size_t numAreas, std::size_t numPortals);
+	void writePortal(std::size_t area0, std::size_t area1, const ProcWinding& winding);
+	void endPortals();
+
+	void beginNodes(std::size_t numNodes);
+	void writeNode(const Plane3& plane, int positiveChild, int negativeChild);
+	void endNodes();
+
+	void writeShadowModel(const std::string& name, const Surface& shadowTris);
+
+	void finish();
+
+private:
+	void writeTag(Tag tag);
+	void writeInt(std::int32_t value);
+	void writeFloat(float value);
+	void writeString(const std::string& str);
+
+	void flushIfFull();
+};
+
+} // namespace
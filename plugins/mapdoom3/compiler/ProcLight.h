@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include "string/string.h"
 #include "itextstream.h"
 #include "ientity.h"
@@ -113,8 +114,12 @@ public:
 	std::size_t		numShadowFrustums;
 	ShadowFrustum	shadowFrustums[6];
 
+	// Hash of the spawnargs this light has been parsed from (for incremental dmap)
+	std::uint64_t	spawnargHash;
+
 	ProcLight() :
-		numShadowFrustums(0)
+		numShadowFrustums(0),
+		spawnargHash(0)
 	{
 		// Distance value in Plane3 is not initialised
 		lightProject[0].dist() = lightProject[1].dist() = 
@@ -0,0 +1,1081 @@
+#include "ShadowVolumeBuilder.h"
+
+#include "itextstream.h"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include "OptUtils.h"
+
+namespace map
+{
+
+static const float LIGHT_CLIP_EPSILON = 0.1f;
+
+// The buffers start out with this size and are doubled when running out of space
+static const std::size_t INITIAL_SHADOW_VERTS = 0x1000;
+static const std::size_t INITIAL_SHADOW_INDEXES = 0x1000;
+
+// a point that is on the plane is NOT culled
+#define POINT_CULLED(p1) ( ( pointCull[p1] & 0xfc0 ) != 0xfc0 )
+#define TRIANGLE_CLIPPED(p1,p2,p3) ( ( ( pointCull[p1] & pointCull[p2] & pointCull[p3] ) & 0xfc0 ) != 0xfc0 )
+
+// an edge that is on the plane is NOT culled
+#define EDGE_CULLED(p1,p2) ( ( pointCull[p1] ^ 0xfc0 ) & ( pointCull[p2] ^ 0xfc0 ) & 0xfc0 )
+#define EDGE_CLIPPED(p1,p2) ( ( pointCull[p1] & pointCull[p2] & 0xfc0 ) != 0xfc0 )
+
+ShadowVolumeBuilder::ShadowVolumeBuilder() :
+    _numShadowIndices(0),
+    _numShadowVerts(0),
+    _shadowVerts(INITIAL_SHADOW_VERTS),
+    _shadowIndices(INITIAL_SHADOW_INDEXES),
+    _indexFrustumNumber(0)
+{}
+
+void ShadowVolumeBuilder::reserveShadowVerts(std::size_t count)
+{
+    if (_numShadowVerts + count > _shadowVerts.size())
+    {
+        _shadowVerts.resize(std::max(_shadowVerts.size() * 2, _numShadowVerts + count));
+    }
+}
+
+void ShadowVolumeBuilder::reserveShadowIndices(std::size_t count)
+{
+    if (_numShadowIndices + count > _shadowIndices.size())
+    {
+        _shadowIndices.resize(std::max(_shadowIndices.size() * 2, _numShadowIndices + count));
+    }
+}
+
+Surface ShadowVolumeBuilder::createVertexProgramTurboShadowVolume(const Matrix4& transform, const Surface& tri, 
+        const ProcLight& light, Surface::CullInfo& cullInfo)
+{
+    throw std::runtime_error("createVertexProgramTurboShadowVolume not implemented yet.");
+}
+
+Surface ShadowVolumeBuilder::createTurboShadowVolume(const Matrix4& transform, const Surface& tri, 
+        const ProcLight& light, Surface::CullInfo& cullInfo)
+{
+    throw std::runtime_error("createTurboShadowVolume not implemented yet.");
+}
+
+namespace
+{
+
+inline Vector3 globalPointToLocal(const Matrix4& transform, const Vector3& in)
+{
+    Vector3 temp = in - transform.translation();
+    //VectorSubtract( in, &modelMatrix[12], temp );
+
+    Vector3 out(
+        temp.dot(transform.x().getVector3()),   //DotProduct( temp, &modelMatrix[0] );
+        temp.dot(transform.y().getVector3()),
+        temp.dot(transform.z().getVector3())
+    );
+
+    return temp;
+}
+
+inline float planeDistanceToBounds(const AABB& bounds, const Plane3& plane)
+{
+    Vector3 mins = bounds.origin - bounds.extents;
+    Vector3 maxs = bounds.origin + bounds.extents;
+
+    float d1 = plane.distanceToPoint(bounds.origin);
+    float d2 = fabs((maxs[0] - bounds.origin[0]) * plane.normal()[0]) +
+               fabs((maxs[1] - bounds.origin[1]) * plane.normal()[1]) +
+               fabs((maxs[2] - bounds.origin[2]) * plane.normal()[2]);
+
+    if (d1 - d2 > 0.0f)
+    {
+        return d1 - d2;
+    }
+
+    if (d1 + d2 < 0.0f)
+    {
+        return d1 + d2;
+    }
+
+    return 0.0f;
+}
+
+}
+
+void ShadowVolumeBuilder::calcInteractionFacing(const Matrix4& transform, const Surface& tri, const ProcLight& light,
+                             Surface::CullInfo& cullInfo)
+{
+    if (!cullInfo.facing.empty())
+    {
+        return;
+    }
+
+    Vector3 localLightOrigin = globalPointToLocal(transform, light.getGlobalLightOrigin());
+
+    std::size_t numFaces = tri.indices.size() / 3;
+
+    if (tri.facePlanes.empty() || !tri.facePlanesCalculated)
+    {
+        const_cast<Surface&>(tri).deriveFacePlanes();
+    }
+
+    cullInfo.facing.resize(numFaces + 1);
+
+    // calculate back face culling
+    // exact geometric cull against face
+    for (std::size_t i = 0; i < numFaces; ++i) 
+    {
+        float planeSide = localLightOrigin.dot(tri.facePlanes[i].normal()) - tri.facePlanes[i].dist();
+        cullInfo.facing[i] = planeSide >= 0.0f;
+    }
+
+    cullInfo.facing[numFaces] = 1;  // for dangling edges to reference
+}
+
+void ShadowVolumeBuilder::calcPointCull(const Surface& tri, const Plane3 frustum[6], unsigned short* pointCull, int* remap)
+{
+    memset(remap, -1, tri.vertices.size() * sizeof(remap[0]));
+
+    int frontBits = 0;
+    std::size_t i = 0;
+
+    for (frontBits = 0, i = 0; i < 6; ++i)
+    {
+        // get front bits for the whole surface
+        if (planeDistanceToBounds(tri.bounds, frustum[i]) >= LIGHT_CLIP_EPSILON)
+        {
+            frontBits |= 1 << (i + 6);
+        }
+    }
+
+    // initialize point cull
+    for (i = 0; i < tri.vertices.size(); ++i)
+    {
+        pointCull[i] = frontBits;
+    }
+
+    // if the surface is not completely inside the light frustum
+    if (frontBits == ( ( ( 1 << 6 ) - 1 ) ) << 6)
+    {
+        return;
+    }
+
+    unsigned char* side1 = (unsigned char*)alloca(tri.vertices.size() * sizeof(unsigned char));
+    unsigned char* side2 = (unsigned char*)alloca(tri.vertices.size() * sizeof(unsigned char));
+
+    memset(side1, 0, tri.vertices.size() * sizeof(unsigned char));
+    memset(side2, 0, tri.vertices.size() * sizeof(unsigned char));
+
+    for (i = 0; i < 6; ++i)
+    {
+        if (frontBits & (1<<(i+6)))
+        {
+            continue;
+        }
+
+        for (std::size_t c = 0; c < tri.vertices.size(); ++c)
+        {
+            float planeSide = frustum[i].normal().dot(tri.vertices[c].vertex) - frustum[i].dist();
+            side1[c] |= (planeSide < LIGHT_CLIP_EPSILON) << i;
+            side2[c] |= (planeSide > -LIGHT_CLIP_EPSILON) << i;
+        }
+    }
+
+    for (i = 0; i < tri.vertices.size(); ++i)
+    {
+        pointCull[i] |= side1[i] | (side2[i] << 6);
+    }
+}
+
+int ShadowVolumeBuilder::chopWinding(ClipTri clipTris[2], int inNum, const Plane3& plane)
+{
+    float   dists[MAX_CLIPPED_POINTS];
+    int     sides[MAX_CLIPPED_POINTS];
+        
+    ClipTri& in = clipTris[inNum];
+    ClipTri& out = clipTris[inNum^1];
+
+    int counts[3] = { 0, 0, 0 };
+    
+    // determine sides for each point
+    int i = 0;
+
+    for (i = 0 ; i < in.numVerts; i++)
+    {
+        float dot = plane.distanceToPoint(in.verts[i]);
+        dists[i] = dot;
+        if (dot < -LIGHT_CLIP_EPSILON)
+        {
+            sides[i] = SIDE_BACK;
+        }
+        else if (dot > LIGHT_CLIP_EPSILON)
+        {
+            sides[i] = SIDE_FRONT;
+        }
+        else
+        {
+            sides[i] = SIDE_ON;
+        }
+
+        counts[sides[i]]++;
+    }
+
+    // if none in front, it is completely clipped away
+    if (!counts[SIDE_FRONT])
+    {
+        in.numVerts = 0;
+        return inNum;
+    }
+
+    if (!counts[SIDE_BACK])
+    {
+        return inNum;       // inout stays the same
+    }
+
+    // avoid wrapping checks by duplicating first value to end
+    sides[i] = sides[0];
+    dists[i] = dists[0];
+
+    in.verts[in.numVerts] = in.verts[0];
+    in.edgeFlags[in.numVerts] = in.edgeFlags[0];
+
+    out.numVerts = 0;
+
+    for (i = 0; i < in.numVerts; ++i)
+    {
+        Vector3& p1 = in.verts[i];
+
+        if (sides[i] != SIDE_BACK)
+        {
+            out.verts[out.numVerts] = p1;
+
+            if (sides[i] == SIDE_ON && sides[i+1] == SIDE_BACK)
+            {
+                out.edgeFlags[out.numVerts] = 1;
+            } 
+            else
+            {
+                out.edgeFlags[out.numVerts] = in.edgeFlags[i];
+            }
+
+            out.numVerts++;
+        }
+
+        if ((sides[i] == SIDE_FRONT && sides[i+1] == SIDE_BACK) || 
+            (sides[i] == SIDE_BACK && sides[i+1] == SIDE_FRONT))
+        {
+            // generate a split point
+            Vector3& p2 = in.verts[i+1];
+            
+            float dot = dists[i] / (dists[i]-dists[i+1]);
+
+            Vector3 mid;
+
+            for (int j = 0; j < 3; ++j)
+            {
+                mid[j] = p1[j] + dot*(p2[j] - p1[j]);
+            }
+                
+            out.verts[out.numVerts] = mid;
+
+            // set the edge flag
+            if (sides[i+1] != SIDE_FRONT)
+            {
+                out.edgeFlags[out.numVerts] = 1;
+            } 
+            else 
+            {
+                out.edgeFlags[out.numVerts] = in.edgeFlags[i];
+            }
+
+            out.numVerts++;
+        }
+    }
+
+    return inNum ^ 1;
+}
+
+bool ShadowVolumeBuilder::clipTriangleToLight(const Vector3& a, const Vector3& b, const Vector3& c, int planeBits, const Plane3 frustum[6])
+{
+    ClipTri pingPong[2];
+
+    pingPong[0].numVerts = 3;
+    pingPong[0].edgeFlags[0] = 0;
+    pingPong[0].edgeFlags[1] = 0;
+    pingPong[0].edgeFlags[2] = 0;
+    pingPong[0].verts[0] = a;
+    pingPong[0].verts[1] = b;
+    pingPong[0].verts[2] = c;
+
+    int p = 0;
+
+    for (int i = 0 ; i < 6 ; ++i)
+    {
+        if (planeBits & ( 1 << i ))
+        {
+            p = chopWinding(pingPong, p, frustum[i]);
+
+            if (pingPong[p].numVerts < 1)
+            {
+                return false;
+            }
+        }
+    }
+
+    ClipTri& ct = pingPong[p];
+
+    // copy the clipped points out to shadowVerts
+    reserveShadowVerts(ct.numVerts * 2);
+
+    int base = static_cast<int>(_numShadowVerts);
+
+    for (std::size_t i = 0; i < ct.numVerts; ++i)
+    {
+        _shadowVerts[base + i*2].getVector3() = ct.verts[i];
+    }
+    _numShadowVerts += ct.numVerts * 2;
+
+    reserveShadowIndices(3 * (ct.numVerts - 2));
+
+    for (int i = 2; i < ct.numVerts; i++)
+    {
+        _shadowIndices[_numShadowIndices++] = base + i * 2;
+        _shadowIndices[_numShadowIndices++] = base + ( i - 1 ) * 2;
+        _shadowIndices[_numShadowIndices++] = base;
+    }
+
+    // any edges that were created by the clipping process will
+    // have a silhouette quad created for it, because it is one
+    // of the exterior bounds of the shadow volume
+    for (int i = 0; i < ct.numVerts; i++)
+    {
+        if (ct.edgeFlags[i])
+        {
+            if (i == ct.numVerts - 1)
+            {
+                _clipSilEdges.push_back(ClipSilEdge(base + i * 2, base));
+            } 
+            else 
+            {
+                _clipSilEdges.push_back(ClipSilEdge(base + i * 2, base + (i + 1) * 2));
+            }
+        }
+    }
+
+    return true;
+}
+
+namespace
+{
+
+/* 
+To make sure the triangulations of the sil edges is consistant,
+we need to be able to order two points.  We don't care about how
+they compare with any other points, just that when the same two
+points are passed in (in either order), they will always specify
+the same one as leading.
+
+Currently we need to have separate faces in different surfaces
+order the same way, so we must look at the actual coordinates.
+If surfaces are ever guaranteed to not have to edge match with
+other surfaces, we could just compare indexes.
+===============
+*/
+static bool pointsOrdered(const Vector3& a, const Vector3& b)
+{
+    // vectors that wind up getting an equal hash value will
+    // potentially cause a misorder, which can show as a couple
+    // crack pixels in a shadow
+
+    // scale by some odd numbers so -8, 8, 8 will not be equal
+    // to 8, -8, 8
+
+    // in the very rare case that these might be equal, all that would
+    // happen is an oportunity for a tiny rasterization shadow crack
+    float i = a[0] + a[1]*127 + a[2]*1023;
+    float j = b[0] + b[1]*127 + b[2]*1023;
+
+    return i < j;
+}
+
+}
+
+void ShadowVolumeBuilder::addClipSilEdges()
+{
+    reserveShadowIndices(_clipSilEdges.size() * 6);
+
+    for (std::size_t i = 0; i < _clipSilEdges.size(); i++)
+    {
+        int v1 = _clipSilEdges[i].v1;
+        int v2 = _clipSilEdges[i].v2;
+        int v1_back = v1 + 1;
+        int v2_back = v2 + 1;
+
+        if (pointsOrdered(_shadowVerts[v1].getVector3(), _shadowVerts[v2].getVector3()))
+        {
+            _shadowIndices[_numShadowIndices++] = v1;
+            _shadowIndices[_numShadowIndices++] = v2;
+            _shadowIndices[_numShadowIndices++] = v1_back;
+            _shadowIndices[_numShadowIndices++] = v2;
+            _shadowIndices[_numShadowIndices++] = v2_back;
+            _shadowIndices[_numShadowIndices++] = v1_back;
+        } 
+        else
+        {
+            _shadowIndices[_numShadowIndices++] = v1;
+            _shadowIndices[_numShadowIndices++] = v2;
+            _shadowIndices[_numShadowIndices++] = v2_back;
+            _shadowIndices[_numShadowIndices++] = v1;
+            _shadowIndices[_numShadowIndices++] = v2_back;
+            _shadowIndices[_numShadowIndices++] = v1_back;
+        }
+    }
+}
+
+bool ShadowVolumeBuilder::clipLineToLight(const Vector3& a, const Vector3& b, const Plane3 frustum[4], Vector3& p1, Vector3& p2)
+{
+    p1 = a;
+    p2 = b;
+
+    // clip it
+    for (int j = 0; j < 6 ; ++j)
+    {
+        float d1 = frustum[j].distanceToPoint(p1);
+        float d2 = frustum[j].distanceToPoint(p2);
+
+        // if both on or in front, not clipped to this plane
+        if (d1 > -LIGHT_CLIP_EPSILON && d2 > -LIGHT_CLIP_EPSILON)
+        {
+            continue;
+        }
+
+        // if one is behind and the other isn't clearly in front, the edge is clipped off
+        if (d1 <= -LIGHT_CLIP_EPSILON && d2 < LIGHT_CLIP_EPSILON)
+        {
+            return false;
+        }
+
+        if (d2 <= -LIGHT_CLIP_EPSILON && d1 < LIGHT_CLIP_EPSILON) 
+        {
+            return false;
+        }
+
+        // clip it, keeping the negative side
+        Vector3& clip = (d1 < 0) ? p1 : p2;
+
+#if 0
+        if ( idMath::Fabs(d1 - d2) < 0.001 ) {
+            d2 = d1 - 0.1;
+        }
+#endif
+
+        float f = d1 / (d1 - d2);
+
+        clip[0] = p1[0] + f * (p2[0] - p1[0]);
+        clip[1] = p1[1] + f * (p2[1] - p1[1]);
+        clip[2] = p1[2] + f * (p2[2] - p1[2]);
+    }
+
+    return true;    // retain a fragment
+}
+
+void ShadowVolumeBuilder::addSilEdges(const Surface& tri, unsigned short* pointCull, const Plane3 frustum[6], 
+    int* remap, unsigned char* faceCastsShadow)
+{
+    std::size_t numPlanes = tri.indices.size() / 3;
+
+    // add sil edges for any true silhouette boundaries on the surface
+    for (std::size_t i = 0; i < tri.silEdges.size(); ++i)
+    {
+        const Surface::SilEdge& sil = tri.silEdges[i];
+
+        if (sil.p1 < 0 || sil.p1 > numPlanes || sil.p2 < 0 || sil.p2 > numPlanes)
+        {
+            rError() << "Bad sil planes" << std::endl;
+            return;
+        }
+
+        // an edge will be a silhouette edge if the face on one side
+        // casts a shadow, but the face on the other side doesn't.
+        // "casts a shadow" means that it has some surface in the projection,
+        // not just that it has the correct facing direction
+        // This will cause edges that are exactly on the frustum plane
+        // to be considered sil edges if the face inside casts a shadow.
+        if (!(faceCastsShadow[sil.p1] ^ faceCastsShadow[sil.p2]))
+        {
+            continue;
+        }
+
+        // if the edge is completely off the negative side of
+        // a frustum plane, don't add it at all.  This can still
+        // happen even if the face is visible and casting a shadow
+        // if it is partially clipped
+        if (EDGE_CULLED(sil.v1, sil.v2))
+        {
+            continue;
+        }
+
+        std::size_t v1 = 0;
+        std::size_t v2 = 0;
+
+        // see if the edge needs to be clipped
+        if (EDGE_CLIPPED(sil.v1, sil.v2))
+        {
+            reserveShadowVerts(4);
+
+            v1 = _numShadowVerts;
+            v2 = v1 + 2;
+
+            if (!clipLineToLight(tri.vertices[sil.v1].vertex, tri.vertices[sil.v2].vertex, 
+                frustum, _shadowVerts[v1].getVector3(), _shadowVerts[v2].getVector3()))
+            {
+                continue;   // clipped away
+            }
+
+            _numShadowVerts += 4;
+        } 
+        else 
+        {
+            // use the entire edge
+            v1 = remap[sil.v1];
+            v2 = remap[sil.v2];
+            if ( v1 < 0 || v2 < 0 )
+            {
+                rError() << "addSilEdges: bad remap[]" << std::endl;
+                return;
+            }
+        }
+
+        reserveShadowIndices(6);
+
+        // we need to choose the correct way of triangulating the silhouette quad
+        // consistantly between any two points, no matter which order they are specified.
+        // If this wasn't done, slight rasterization cracks would show in the shadow
+        // volume when two sil edges were exactly coincident
+        if (faceCastsShadow[sil.p2])
+        {
+            if (pointsOrdered(_shadowVerts[v1].getVector3(), _shadowVerts[v2].getVector3()))
+            {
+                _shadowIndices[_numShadowIndices++] = v1;
+                _shadowIndices[_numShadowIndices++] = v1+1;
+                _shadowIndices[_numShadowIndices++] = v2;
+                _shadowIndices[_numShadowIndices++] = v2;
+                _shadowIndices[_numShadowIndices++] = v1+1;
+                _shadowIndices[_numShadowIndices++] = v2+1;
+            } 
+            else
+            {
+                _shadowIndices[_numShadowIndices++] = v1;
+                _shadowIndices[_numShadowIndices++] = v2+1;
+                _shadowIndices[_numShadowIndices++] = v2;
+                _shadowIndices[_numShadowIndices++] = v1;
+                _shadowIndices[_numShadowIndices++] = v1+1;
+                _shadowIndices[_numShadowIndices++] = v2+1;
+            }
+        }
+        else
+        { 
+            if (pointsOrdered(_shadowVerts[v1].getVector3(), _shadowVerts[v2].getVector3()))
+            {
+                _shadowIndices[_numShadowIndices++] = v1;
+                _shadowIndices[_numShadowIndices++] = v2;
+                _shadowIndices[_numShadowIndices++] = v1+1;
+                _shadowIndices[_numShadowIndices++] = v2;
+                _shadowIndices[_numShadowIndices++] = v2+1;
+                _shadowIndices[_numShadowIndices++] = v1+1;
+            } 
+            else
+            {
+                _shadowIndices[_numShadowIndices++] = v1;
+                _shadowIndices[_numShadowIndices++] = v2;
+                _shadowIndices[_numShadowIndices++] = v2+1;
+                _shadowIndices[_numShadowIndices++] = v1;
+                _shadowIndices[_numShadowIndices++] = v2+1;
+                _shadowIndices[_numShadowIndices++] = v1+1;
+            }
+        }
+    }
+}
+
+namespace
+{
+
+inline void getLightProjectionMatrix(const Vector3& origin, const Plane3& rearPlane, Vector4 mat[4])
+{
+    // calculate the homogeneous light vector
+    Vector4 lv(origin, 1);
+
+    float lg = Vector4(rearPlane.normal(), -rearPlane.dist()).dot(lv);
+
+    // outer product
+    mat[0][0] = lg - rearPlane.normal()[0] * lv[0];
+    mat[0][1] = -rearPlane.normal()[1] * lv[0];
+    mat[0][2] = -rearPlane.normal()[2] * lv[0];
+    mat[0][3] = rearPlane.dist() * lv[0];
+
+    mat[1][0] = -rearPlane.normal()[0] * lv[1];
+    mat[1][1] = lg - rearPlane.normal()[1] * lv[1];
+    mat[1][2] = -rearPlane.normal()[2] * lv[1];
+    mat[1][3] = rearPlane.dist() * lv[1];
+
+    mat[2][0] = -rearPlane.normal()[0] * lv[2];
+    mat[2][1] = -rearPlane.normal()[1] * lv[2];
+    mat[2][2] = lg - rearPlane.normal()[2] * lv[2];
+    mat[2][3] = rearPlane.dist() * lv[2];
+
+    mat[3][0] = -rearPlane.normal()[0] * lv[3];
+    mat[3][1] = -rearPlane.normal()[1] * lv[3];
+    mat[3][2] = -rearPlane.normal()[2] * lv[3];
+    mat[3][3] = lg - (-rearPlane.dist() * lv[3]);
+}
+
+}
+
+void ShadowVolumeBuilder::projectPointsToFarPlane(const Matrix4& transform, const ProcLight& light, 
+    const Plane3& lightPlaneLocal, std::size_t firstShadowVert, std::size_t numShadowVerts)
+{
+    Vector3 lv = transform.transformPoint(light.getGlobalLightOrigin());
+
+    Vector4 mat[4];
+    getLightProjectionMatrix(lv, lightPlaneLocal, mat);
+
+    // make a projected copy of the even verts into the odd spots
+    Vector4* in = &_shadowVerts[firstShadowVert];
+
+    for (std::size_t i = firstShadowVert; i < numShadowVerts; i+= 2, in += 2)
+    {
+        in[0].w() = 1;
+
+        float w = in->getVector3().dot(mat[3].getVector3()) + mat[3][3];
+        
+        if (w == 0)
+        {
+            in[1] = in[0];
+            continue;
+        }
+
+        float oow = 1.0f / w;
+
+        in[1].x() = (in->getVector3().dot(mat[0].getVector3()) + mat[0][3]) * oow;
+        in[1].y() = (in->getVector3().dot(mat[1].getVector3()) + mat[1][3]) * oow;
+        in[1].z() = (in->getVector3().dot(mat[2].getVector3()) + mat[2][3]) * oow;
+        in[1].w() = 1;
+    }
+}
+
+void ShadowVolumeBuilder::createShadowVolumeInFrustum(const Matrix4& transform, const Surface& tri,
+    const ProcLight& light, const Vector3& lightOrigin, const Plane3 frustum[6],
+    const Plane3 &farPlane, bool makeClippedPlanes, int* remap, unsigned char* faceCastsShadow,
+    std::vector<unsigned char>& globalFacing)
+{
+#if 0
+    int     cullBits;
+#endif
+
+    unsigned short* pointCull = (unsigned short*)alloca(tri.vertices.size() * sizeof(unsigned short));
+
+    // test the vertexes for inside the light frustum, which will allow
+    // us to completely cull away some triangles from consideration.
+    calcPointCull(tri, frustum, pointCull, remap);
+
+    // this may not be the first frustum added to the volume
+    std::size_t firstShadowIndex = _numShadowIndices;
+    std::size_t firstShadowVert = _numShadowVerts;
+
+    // decide which triangles front shadow volumes, clipping as needed
+    _clipSilEdges.clear();
+
+    std::size_t numTris = tri.indices.size() / 3;
+
+    for (std::size_t i = 0; i < numTris; ++i)
+    {
+        faceCastsShadow[i] = 0; // until shown otherwise
+
+        // if it isn't facing the right way, don't add it
+        // to the shadow volume
+        if (globalFacing[i])
+        {
+            continue;
+        }
+
+        int i1 = tri.silIndexes[i*3 + 0];
+        int i2 = tri.silIndexes[i*3 + 1];
+        int i3 = tri.silIndexes[i*3 + 2];
+
+        // if all the verts are off one side of the frustum,
+        // don't add any of them
+        if (pointCull[i1] & pointCull[i2] & pointCull[i3] & 0x3f)
+        {
+            continue;
+        }
+
+        // make sure the verts that are not on the negative sides
+        // of the frustum are copied over.
+        // we need to get the original verts even from clipped triangles
+        // so the edges reference correctly, because an edge may be unclipped
+        // even when a triangle is clipped.
+        reserveShadowVerts(6);
+
+        if (!POINT_CULLED(i1) && remap[i1] == -1)
+        {
+            remap[i1] = static_cast<int>(_numShadowVerts);
+            _shadowVerts[_numShadowVerts].getVector3() = tri.vertices[i1].vertex;
+            _numShadowVerts += 2;
+        }
+
+        if (!POINT_CULLED(i2) && remap[i2] == -1)
+        {
+            remap[i2] = static_cast<int>(_numShadowVerts);
+            _shadowVerts[_numShadowVerts].getVector3() = tri.vertices[i2].vertex;
+            _numShadowVerts += 2;
+        }
+
+        if (!POINT_CULLED(i3) && remap[i3] == -1)
+        {
+            remap[i3] = static_cast<int>(_numShadowVerts);
+            _shadowVerts[_numShadowVerts].getVector3() = tri.vertices[i3].vertex;
+            _numShadowVerts += 2;
+        }
+
+        // clip the triangle if any points are on the negative sides
+        if ( TRIANGLE_CLIPPED( i1, i2, i3 ) )
+        {
+            int cullBits = ( ( pointCull[ i1 ] ^ 0xfc0 ) | ( pointCull[ i2 ] ^ 0xfc0 ) | ( pointCull[ i3 ] ^ 0xfc0 ) ) >> 6;
+
+            // this will also define clip edges that will become silhouette planes
+            if (clipTriangleToLight(tri.vertices[i1].vertex, tri.vertices[i2].vertex, tri.vertices[i3].vertex, cullBits, frustum))
+            {
+                faceCastsShadow[i] = 1;
+            }
+        } 
+        else
+        {
+            reserveShadowIndices(3);
+
+            if (remap[i1] == -1 || remap[i2] == -1 || remap[i3] == -1)
+            {
+                rError() << "createShadowVolumeInFrustum: bad remap[]" << std::endl;
+                return;
+            }
+
+            _shadowIndices[_numShadowIndices++] = remap[i3];
+            _shadowIndices[_numShadowIndices++] = remap[i2];
+            _shadowIndices[_numShadowIndices++] = remap[i1];
+            faceCastsShadow[i] = 1;
+        }
+    }
+
+    // add indexes for the back caps, which will just be reversals of the
+    // front caps using the back vertexes
+    std::size_t numCapIndexes = _numShadowIndices - firstShadowIndex;
+
+    // if no faces have been defined for the shadow volume,
+    // there won't be anything at all
+    if (numCapIndexes == 0)
+    {
+        return;
+    }
+
+    //--------------- off-line processing ------------------
+
+    // if we are running from dmap, perform the (very) expensive shadow optimizations
+    // to remove internal sil edges and optimize the caps
+    if (false/*callOptimizer*/) // greebo: defaults to false for the moment being
+    {
+#if 0
+        optimizedShadow_t opt;
+        
+        // project all of the vertexes to the shadow plane, generating
+        // an equal number of back vertexes
+//      R_ProjectPointsToFarPlane( ent, light, farPlane, firstShadowVert, numShadowVerts );
+
+        opt = SuperOptimizeOccluders( shadowVerts, shadowIndexes + firstShadowIndex, numCapIndexes, farPlane, lightOrigin );
+
+        // pull off the non-optimized data
+        numShadowIndexes = firstShadowIndex;
+        numShadowVerts = firstShadowVert;
+
+        // add the optimized data
+        if ( numShadowIndexes + opt.totalIndexes > MAX_SHADOW_INDEXES 
+            || numShadowVerts + opt.numVerts > MAX_SHADOW_VERTS ) {
+            overflowed = true;
+            common->Printf( "WARNING: overflowed MAX_SHADOW tables, shadow discarded\n" );
+            Mem_Free( opt.verts );
+            Mem_Free( opt.indexes );
+            return;
+        }
+
+        for ( i = 0 ; i < opt.numVerts ; i++ ) {
+            shadowVerts[numShadowVerts+i][0] = opt.verts[i][0];
+            shadowVerts[numShadowVerts+i][1] = opt.verts[i][1];
+            shadowVerts[numShadowVerts+i][2] = opt.verts[i][2];
+            shadowVerts[numShadowVerts+i][3] = 1;
+        }
+        for ( i = 0 ; i < opt.totalIndexes ; i++ ) {
+            int index = opt.indexes[i];
+            if ( index < 0 || index > opt.numVerts ) {
+                common->Error( "optimized shadow index out of range" );
+            }
+            shadowIndexes[numShadowIndexes+i] = index + numShadowVerts;
+        }
+
+        numShadowVerts += opt.numVerts;
+        numShadowIndexes += opt.totalIndexes;
+
+        // note the index distribution so we can sort all the caps after all the sils
+        indexRef[indexFrustumNumber].frontCapStart = firstShadowIndex;
+        indexRef[indexFrustumNumber].rearCapStart = firstShadowIndex+opt.numFrontCapIndexes;
+        indexRef[indexFrustumNumber].silStart = firstShadowIndex+opt.numFrontCapIndexes+opt.numRearCapIndexes;
+        indexRef[indexFrustumNumber].end = numShadowIndexes;
+        indexFrustumNumber++;
+
+        Mem_Free( opt.verts );
+        Mem_Free( opt.indexes );
+#endif
+        return;
+    }
+
+    //--------------- real-time processing ------------------
+
+    // the dangling edge "face" is never considered to cast a shadow,
+    // so any face with dangling edges that casts a shadow will have
+    // it's dangling sil edge trigger a sil plane
+    faceCastsShadow[numTris] = 0;
+
+    reserveShadowIndices(numCapIndexes);
+
+    for (std::size_t i = 0; i < numCapIndexes; i += 3)
+    {
+        _shadowIndices[_numShadowIndices + i + 0] = _shadowIndices[firstShadowIndex + i + 2] + 1;
+        _shadowIndices[_numShadowIndices + i + 1] = _shadowIndices[firstShadowIndex + i + 1] + 1;
+        _shadowIndices[_numShadowIndices + i + 2] = _shadowIndices[firstShadowIndex + i + 0] + 1;
+    }
+
+    _numShadowIndices += numCapIndexes;
+
+    // c_caps += numCapIndexes * 2;
+
+    std::size_t preSilIndexes = _numShadowIndices;
+
+    // if any triangles were clipped, we will have a list of edges
+    // on the frustum which must now become sil edges
+    if (makeClippedPlanes)
+    {
+        addClipSilEdges();
+    }
+
+    // any edges that are a transition between a shadowing and
+    // non-shadowing triangle will cast a silhouette edge
+    addSilEdges(tri, pointCull, frustum, remap, faceCastsShadow);
+
+    // c_sils += numShadowIndexes - preSilIndexes;
+
+    // project all of the vertexes to the shadow plane, generating
+    // an equal number of back vertexes
+    projectPointsToFarPlane(transform, light, farPlane, firstShadowVert, _numShadowVerts);
+
+    // note the index distribution so we can sort all the caps after all the sils
+    _indexRef[_indexFrustumNumber].frontCapStart = firstShadowIndex;
+    _indexRef[_indexFrustumNumber].rearCapStart = firstShadowIndex+numCapIndexes;
+    _indexRef[_indexFrustumNumber].silStart = preSilIndexes;
+    _indexRef[_indexFrustumNumber].end = _numShadowIndices;
+    _indexFrustumNumber++;
+}
+
+Surface ShadowVolumeBuilder::createShadowVolume(const Matrix4& transform, const Surface& tri, const ProcLight& light,
+                             ShadowGenType optimize, Surface::CullInfo& cullInfo)
+{
+#if 0
+    if ( !r_shadows.GetBool() ) {
+        return NULL;
+    }
+#endif
+
+    if (tri.silEdges.empty() || tri.indices.empty() || tri.vertices.empty())
+    {
+        return Surface();
+    }
+
+    //tr.pc.c_createShadowVolumes++;
+
+    // use the fast infinite projection in dynamic situations, which
+    // trades somewhat more overdraw and no cap optimizations for
+    // a very simple generation process
+    if (optimize == SG_DYNAMIC && true /*r_useTurboShadow.GetBool()*/)
+    {
+        // greebo: With the current settings this code won't be reached
+
+        if (true /*tr.backEndRendererHasVertexPrograms*/ && true/*r_useShadowVertexProgram.GetBool()*/)
+        {
+             return createVertexProgramTurboShadowVolume(transform, tri, light, cullInfo);
+        } 
+        else
+        {
+            return createTurboShadowVolume(transform, tri, light, cullInfo);
+        }
+    }
+
+    Surface newTri;
+
+    calcInteractionFacing(transform, tri, light, cullInfo);
+
+    std::size_t numFaces = tri.indices.size() / 3;
+    
+    unsigned char allFront = 1;
+
+    for (std::size_t i = 0; i < numFaces && allFront; ++i)
+    {
+        allFront &= cullInfo.facing[i];
+    }
+
+    if (allFront)
+    {
+        // if no faces are the right direction, don't make a shadow at all
+        return Surface();
+    }
+
+    // clear the shadow volume
+    _numShadowIndices = 0;
+    _numShadowVerts = 0;
+    _indexFrustumNumber = 0;
+    int capPlaneBits = 0;
+    bool callOptimizer = (optimize == SG_OFFLINE);
+
+    // the facing information will be the same for all six projections
+    // from a point light, as well as for any directed lights
+    std::vector<unsigned char>& globalFacing = cullInfo.facing;
+
+    unsigned char* faceCastsShadow = (unsigned char*)alloca(tri.indices.size() / 3 + 1);    // + 1 for fake dangling edge face
+    int* remap = (int*)alloca(tri.vertices.size() * sizeof(int));
+
+    Vector3 lightOrigin = globalPointToLocal(transform, light.getGlobalLightOrigin());
+    
+    // run through all the shadow frustums, which is one for a projected light,
+    // and usually six for a point light, but point lights with centers outside
+    // the box may have less
+    for (std::size_t frustumNum = 0; frustumNum < light.numShadowFrustums; ++frustumNum)
+    {
+        const ShadowFrustum& frust = light.shadowFrustums[frustumNum];
+        Plane3 frustum[6];
+
+        // transform the planes into entity space
+        // we could share and reverse some of the planes between frustums for a minor
+        // speed increase
+
+        // the cull test is redundant for a single shadow frustum projected light, because
+        // the surface has already been checked against the main light frustums
+        std::size_t j = 0;
+
+        for (j = 0; j < frust.numPlanes; ++j)
+        {
+            frustum[j] = OptUtils::TransformPlane(frust.planes[j], transform);
+            //R_GlobalPlaneToLocal( ent->modelMatrix, frust->planes[j], frustum[j] );
+
+            // try to cull the entire surface against this frustum
+            float d = planeDistanceToBounds(tri.bounds, frustum[j]);
+
+            if (d < -LIGHT_CLIP_EPSILON)
+            {
+                break;
+            }
+        }
+
+        if (j != frust.numPlanes)
+        {
+            continue;
+        }
+
+        // we need to check all the triangles
+        std::size_t oldFrustumNumber = _indexFrustumNumber;
+
+        createShadowVolumeInFrustum(transform, tri, light, lightOrigin, frustum, frustum[5], frust.makeClippedPlanes, remap, faceCastsShadow, globalFacing);
+
+        if (_indexFrustumNumber != oldFrustumNumber)
+        {
+            // note that we have caps projected against this frustum,
+            // which may allow us to skip drawing the caps if all projected
+            // planes face away from the viewer and the viewer is outside the light volume
+            capPlaneBits |= 1<<frustumNum;
+        }
+    }
+
+    // if no faces have been defined for the shadow volume,
+    // there won't be anything at all
+    if (_numShadowIndices == 0) 
+    {
+        return Surface();
+    }
+
+    // allocate a new surface for the shadow volume
+    // newTri = R_AllocStaticTriSurf();
+
+    // we might consider setting this, but it would only help for
+    // large lights that are partially off screen
+    //newTri.bounds = AABB();
+
+    // copy off the verts and indexes
+    newTri.shadowVertices.assign(_shadowVerts.begin(), _shadowVerts.begin() + _numShadowVerts);
+
+    newTri.indices.resize(_numShadowIndices);
+
+    // the shadow verts will go into a main memory buffer as well as a vertex
+    // cache buffer, so they can be copied back if they are purged
+    //R_AllocStaticTriSurfShadowVerts( newTri, newTri->numVerts );
+    //SIMDProcessor->Memcpy( newTri->shadowVertexes, shadowVerts, newTri->numVerts * sizeof( newTri->shadowVertexes[0] ) );
+
+    //R_AllocStaticTriSurfIndexes( newTri, newTri->numIndexes );
+
+    if ( 1 /* sortCapIndexes */ )
+    {
+        newTri.shadowCapPlaneBits = capPlaneBits;
+
+        // copy the sil indexes first
+        newTri.numShadowIndicesNoCaps = 0;
+
+        for (std::size_t i = 0; i < _indexFrustumNumber; ++i)
+        {
+            std::size_t c = _indexRef[i].end - _indexRef[i].silStart;
+
+            memcpy(&newTri.indices[newTri.numShadowIndicesNoCaps], &_shadowIndices[_indexRef[i].silStart], c * sizeof(newTri.indices[0]));
+
+            newTri.numShadowIndicesNoCaps += c;
+        }
+
+        // copy rear cap indexes next
+        newTri.numShadowIndicesNoFrontCaps = newTri.numShadowIndicesNoCaps;
+
+        for (std::size_t i = 0; i < _indexFrustumNumber; ++i)
+        {
+            std::size_t c = _indexRef[i].silStart - _indexRef[i].rearCapStart;
+
+            memcpy(&newTri.indices[newTri.numShadowIndicesNoFrontCaps], &_shadowIndices[_indexRef[i].rearCapStart], c * sizeof(newTri.indices[0]));
+
+            newTri.numShadowIndicesNoFrontCaps += c;
+        }
+
+        // copy front cap indexes last
+        std::size_t numIndices = newTri.numShadowIndicesNoFrontCaps;
+
+        for (std::size_t i = 0; i < _indexFrustumNumber; ++i)
+        {
+            std::size_t c = _indexRef[i].rearCapStart - _indexRef[i].frontCapStart;
+
+            memcpy(&newTri.indices[numIndices], &_shadowIndices[_indexRef[i].frontCapStart], c * sizeof(newTri.indices[0]));
+
+            numIndices += c;
+        }
+    }
+//  else 
+//  {
+//      newTri->shadowCapPlaneBits = 63;    // we don't have optimized index lists
+//      SIMDProcessor->Memcpy( newTri->indexes, shadowIndexes, newTri->numIndexes * sizeof( newTri->indexes[0] ) );
+//  }
+
+    if (false /*optimize == SG_OFFLINE*/) // greebo: cannot be true at the moment
+    {
+        //CleanupOptimizedShadowTris( newTri );
+    }
+
+    return newTri;
+}
+
+} // namespace
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <vector>
+#include "math/Matrix4.h"
+#include "ProcLight.h"
+#include "Surface.h"
+
+namespace map
+{
+
+/**
+ * Generates the shadow volume of an occluder surface for a given light.
+ *
+ * The vertex and index buffers used while generating the volume are owned by
+ * this class and grow as needed, so there is no upper limit on the size of the
+ * volume. Each thread needs its own builder to create shadow volumes concurrently.
+ */
+class ShadowVolumeBuilder
+{
+public:
+	enum ShadowGenType
+	{
+		SG_DYNAMIC,		// use infinite projections
+		SG_STATIC,		// clip to bounds
+		SG_OFFLINE		// perform very time consuming optimizations
+	};
+
+private:
+	std::size_t _numShadowIndices;
+	std::size_t _numShadowVerts;
+	std::vector<Vector4> _shadowVerts;
+	std::vector<std::size_t> _shadowIndices;
+
+	// Edges created by clipping triangles to the frustum, pairs of shadow vertex indices
+	struct ClipSilEdge
+	{
+		int v1;
+		int v2;
+
+		ClipSilEdge(int v1_, int v2_) :
+			v1(v1_),
+			v2(v2_)
+		{}
+	};
+	std::vector<ClipSilEdge> _clipSilEdges;
+
+#define	MAX_CLIPPED_POINTS	20
+
+	struct ClipTri
+	{
+		int		numVerts;
+		Vector3	verts[MAX_CLIPPED_POINTS];
+		int		edgeFlags[MAX_CLIPPED_POINTS];
+	};
+
+	struct IndexRef 
+	{
+		std::size_t	frontCapStart;
+		std::size_t	rearCapStart;
+		std::size_t	silStart;
+		std::size_t	end;
+	};
+	
+	IndexRef _indexRef[6];
+	std::size_t _indexFrustumNumber;		// which shadow generating side of a light the indexRef is for
+
+public:
+	ShadowVolumeBuilder();
+
+	/*
+	 * The returned surface will have a valid bounds and radius for culling.
+	 * 
+	 * Triangles are clipped to the light frustum before projecting.
+	 * 
+	 * A single triangle can clip to as many as 7 vertexes, so
+	 * the worst case expansion is 2*(numindexes/3)*7 verts when counting both
+	 * the front and back caps, although it will usually only be a modest
+	 * increase in vertexes for closed modesl
+	 * 
+	 * The worst case index count is much larger, when the 7 vertex clipped triangle
+	 * needs 15 indexes for the front, 15 for the back, and 42 (a quad on seven sides)
+	 * for the sides, for a total of 72 indexes from the original 3.  Ouch.
+	 * 
+	 * NULL may be returned if the surface doesn't create a shadow volume at all,
+	 * as with a single face that the light is behind.
+	 * 
+	 * If an edge is within an epsilon of the border of the volume, it must be treated
+	 * as if it is clipped for triangles, generating a new sil edge, and act
+	 * as if it was culled for edges, because the sil edge will have been
+	 * generated by the triangle irregardless of if it actually was a sil edge.
+	*/
+	Surface createShadowVolume(const Matrix4& transform, const Surface& tri, const ProcLight& light,
+							 ShadowGenType optimize, Surface::CullInfo& cullInfo);
+
+private:
+	// Stubs, not implemented yet
+	Surface createVertexProgramTurboShadowVolume(const Matrix4& transform, const Surface& tri, 
+								const ProcLight& light, Surface::CullInfo& cullInfo);
+	Surface createTurboShadowVolume(const Matrix4& transform, const Surface& tri, 
+								const ProcLight& light, Surface::CullInfo& cullInfo);
+
+	// Determines which triangles of the surface are facing towards the light origin.
+	// The facing array should be allocated with one extra index than
+	// the number of surface triangles, which will be used to handle dangling
+	void calcInteractionFacing(const Matrix4& transform, const Surface& tri, const ProcLight& light,
+							 Surface::CullInfo& cullInfo);
+
+	// Adds new verts and indexes to the shadow volume.
+	// 
+	// If the frustum completely defines the projected light,
+	// makeClippedPlanes should be true, which will cause sil quads to
+	// be added along all clipped edges.
+	// 
+	// If the frustum is just part of a point light, clipped planes don't
+	// need to be added.
+	void createShadowVolumeInFrustum(const Matrix4& transform, const Surface& tri,
+									const ProcLight& light, const Vector3& lightOrigin, const Plane3 frustum[6],
+									const Plane3 &farPlane, bool makeClippedPlanes, int* remap, 
+									unsigned char* faceCastsShadow, std::vector<unsigned char>& globalFacing);
+
+	// Also inits the remap[] array to all -1
+	void calcPointCull(const Surface& tri, const Plane3 frustum[6], unsigned short* pointCull, int* remap);
+
+	bool clipTriangleToLight(const Vector3& a, const Vector3& b, const Vector3& c, int planeBits, const Plane3 frustum[6]);
+
+	// Clips a triangle from one buffer to another, setting edge flags
+	// The returned buffer may be the same as inNum if no clipping is done
+	// If entirely clipped away, clipTris[returned].numVerts == 0
+	// 
+	// I have some worries about edge flag cases when polygons are clipped
+	// multiple times near the epsilon.
+	int chopWinding(ClipTri clipTris[2], int inNum, const Plane3& plane);
+
+	// Add sil edges for each triangle clipped to the side of the frustum.
+	// Only done for simple projected lights, not point lights.
+	void addClipSilEdges();
+
+	// Add quads from the front points to the projected points
+	// for each silhouette edge in the light
+	void addSilEdges(const Surface& tri, unsigned short* pointCull, const Plane3 frustum[6], 
+					 int* remap, unsigned char* faceCastsShadow);
+
+	// If neither point is clearly behind the clipping
+	// plane, the edge will be passed unmodified.  A sil edge that
+	// is on a border plane must be drawn.
+	// 
+	// If one point is clearly clipped by the plane and the
+	// other point is on the plane, it will be completely removed.
+	bool clipLineToLight(const Vector3& a, const Vector3& b, const Plane3 frustum[4], Vector3& p1, Vector3& p2);
+
+	// make a projected copy of the even verts into the odd spots
+	// that is on the far light clip plane
+	void projectPointsToFarPlane(const Matrix4& transform, const ProcLight& light, 
+								const Plane3& lightPlaneLocal, std::size_t firstShadowVert, std::size_t numShadowVerts);
+
+	// Grow the buffers such that the given number of verts/indices can be appended
+	void reserveShadowVerts(std::size_t count);
+	void reserveShadowIndices(std::size_t count);
+};
+
+} // namespace
@@ -9,8 +9,8 @@ namespace map
 {
 
 std::size_t Surface::MAX_SIL_EDGES = 0x10000;
-std::size_t	Surface::_totalCoplanarSilEdges = 0;
-std::size_t Surface::_totalSilEdges = 0;
+std::atomic<std::size_t> Surface::_totalCoplanarSilEdges(0);
+std::atomic<std::size_t> Surface::_totalSilEdges(0);
 
 void Surface::calcBounds()
 {
@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <map>
+#include <atomic>
 #include "render/ArbitraryMeshVertex.h"
 #include "math/AABB.h"
 #include "math/Vector4.h"
@@ -34,8 +35,9 @@ private:
 	std::size_t	_numPlanes;
 	std::size_t _numSilEdges;
 
-	static std::size_t _totalCoplanarSilEdges;
-	static std::size_t _totalSilEdges;
+	// Shadow volumes are generated concurrently, so these are atomic
+	static std::atomic<std::size_t> _totalCoplanarSilEdges;
+	static std::atomic<std::size_t> _totalSilEdges;
 
 public:
 	AABB		bounds;
@@ -3,13 +3,14 @@
 #include "math/Vector3.h"
 #include "math/AABB.h"
 #include <memory>
+#include <vector>
+#include <deque>
+#include <algorithm>
 #include "ProcFile.h"
-#include <list>
 
 namespace map
 {
 
-#define	HASH_BINS		16
 #define	SNAP_FRACTIONS	32
 
 #define	VERTEX_EPSILON	( 1.0 / SNAP_FRACTIONS )
@@ -20,26 +21,59 @@ struct HashVert
 	struct HashVert* next;
 	Vector3	v;
 	int		iv[3];
+	std::size_t	index;	// creation order
 };
 
+/**
+ * Spatial hash of snapped vertices, used to fix t-junctions.
+ *
+ * The resolution of the bin grid is derived from the number of vertices
+ * passed to calculateBounds() and the shape of the bounds, such that the
+ * number of vertices per bin stays roughly constant for small and large
+ * vertex sets alike.
+ */
 class TriangleHash
 {
 public:
 	AABB		_hashBounds;
-	Vector3		_hashScale;
-	HashVert*	_hashVerts[HASH_BINS][HASH_BINS][HASH_BINS];
-	std::size_t	_numHashVerts;
-	std::size_t _numTotalVerts;
+
+	// Per-bin occupancy, see getOccupancyStats()
+	struct OccupancyStats
+	{
+		std::size_t numBins;
+		std::size_t numOccupiedBins;
+		std::size_t maxVertsPerBin;
+		double		averageVertsPerOccupiedBin;
+	};
+
+private:
+	// Average number of triangle corners a bin is sized for
+	static const std::size_t CORNERS_PER_BIN = 1;
+
+	// Upper limit of the grid size, to keep the memory footprint in check
+	static const std::size_t MAX_BINS = 1 << 20;
+
+	int			_numBins[3];
 	int			_hashIntMins[3];
 	int			_hashIntScale[3];
 
+	std::vector<HashVert*> _bins;
+	std::deque<HashVert> _hashVerts;
+
+	std::size_t _numBoundedCorners;
+	std::size_t _numTotalVerts;
+
 public:
 	TriangleHash() :
-		_numHashVerts(0),
+		_numBoundedCorners(0),
 		_numTotalVerts(0)
 	{
-		// clear the hash tables
-		memset(_hashVerts, 0, sizeof(_hashVerts));
+		for (std::size_t i = 0; i < 3; ++i)
+		{
+			_numBins[i] = 1;
+			_hashIntMins[i] = 0;
+			_hashIntScale[i] = 1;
+		}
 	}
 
 	void calculateBounds(const ProcArea::OptimizeGroups& groups)
@@ -55,9 +89,12 @@ public:
 				_hashBounds.includePoint(a->v[1].vertex);
 				_hashBounds.includePoint(a->v[2].vertex);
 			}
+
+			_numBoundedCorners += group->triList.size() * 3;
 		}
 	}
 
+	// Spreads the bounds and sets up the bin grid, call this after calculateBounds()
 	void spreadHashBounds()
 	{
 		Vector3 min = _hashBounds.origin - _hashBounds.extents;
@@ -72,18 +109,40 @@ public:
 
 		_hashBounds = AABB::createFromMinMax(min, max);
 
+		// Distribute the bins over the axes proportionally to the bounds size
+		std::size_t targetBins = std::max<std::size_t>(_numBoundedCorners / CORNERS_PER_BIN, 1);
+		targetBins = std::min<std::size_t>(targetBins, std::size_t(MAX_BINS));
+
+		Vector3 size = max - min;
+		double binsPerUnit = pow(targetBins / (size[0] * size[1] * size[2]), 1.0 / 3);
+
+		int rangeInt[3];
+
 		for (std::size_t i = 0; i < 3; ++i)
 		{
 			_hashIntMins[i] = static_cast<int>(min[i] * SNAP_FRACTIONS);
 
-			_hashScale[i] = _hashBounds.extents[i] / HASH_BINS;
-			_hashIntScale[i] = static_cast<int>(_hashScale[i] * SNAP_FRACTIONS);
+			rangeInt[i] = static_cast<int>(max[i] * SNAP_FRACTIONS) - _hashIntMins[i];
+			setNumBins(i, rangeInt[i], std::max(static_cast<int>(size[i] * binsPerUnit + 0.5), 1));
+		}
 
-			if (_hashIntScale[i] < 1) 
+		// Rounding each axis to at least one bin can push the total past the
+		// cap on flat bounds, shrink the largest axis until the grid fits
+		while (getTotalBins() > MAX_BINS)
+		{
+			std::size_t largest = 0;
+
+			for (std::size_t i = 1; i < 3; ++i)
 			{
-				_hashIntScale[i] = 1;
+				if (_numBins[i] > _numBins[largest]) largest = i;
 			}
+
+			unsigned long long bins = static_cast<unsigned long long>(_numBins[largest]) * MAX_BINS / getTotalBins();
+
+			setNumBins(largest, rangeInt[largest], std::max(static_cast<int>(bins), 1));
 		}
+
+		_bins.assign(static_cast<std::size_t>(getTotalBins()), NULL);
 	}
 
 	void hashTriangles(ProcArea::OptimizeGroups& groups)
@@ -112,55 +171,65 @@ public:
 	HashVert* getHashVert(Vector3& vertex)
 	{
 		int		iv[3];
-		int		block[3];
-		std::size_t i;
+		int		minBlock[3];
+		int		maxBlock[3];
 
 		_numTotalVerts++;
 
 		// snap the vert to integral values
-		for (i = 0 ; i < 3 ; i++ )
+		for (std::size_t i = 0; i < 3; ++i)
 		{
 			iv[i] = static_cast<int>(floor( (vertex[i] + 0.5/SNAP_FRACTIONS ) * SNAP_FRACTIONS ));
-			block[i] = ( iv[i] - _hashIntMins[i] ) / _hashIntScale[i];
 
-			if (block[i] < 0)
-			{
-				block[i] = 0;
-			}
-			else if (block[i] >= HASH_BINS)
-			{
-				block[i] = HASH_BINS - 1;
-			}
+			// a near vertex can be located in the neighbouring bins
+			minBlock[i] = getBlock(i, iv[i] - 1);
+			maxBlock[i] = getBlock(i, iv[i] + 1);
 		}
 
-		// see if a vertex near enough already exists
-		// this could still fail to find a near neighbor right at the hash block boundary
-		for (HashVert* hv = _hashVerts[block[0]][block[1]][block[2]]; hv; hv = hv->next)
-		{
-			std::size_t i = 0;
+		// see if a vertex near enough already exists, prefer the most recent one
+		HashVert* found = NULL;
 
-			for (i = 0; i < 3; ++i)
+		for (int x = minBlock[0]; x <= maxBlock[0]; ++x)
+		{
+			for (int y = minBlock[1]; y <= maxBlock[1]; ++y)
 			{
-				int	d = hv->iv[i] - iv[i];
-
-				if (d < -1 || d > 1)
+				for (int z = minBlock[2]; z <= maxBlock[2]; ++z)
 				{
-					break;
+					// chains are ordered newest first, so the first match per bin is sufficient
+					for (HashVert* hv = getBin(x, y, z); hv; hv = hv->next)
+					{
+						if (hv->iv[0] - iv[0] >= -1 && hv->iv[0] - iv[0] <= 1 &&
+							hv->iv[1] - iv[1] >= -1 && hv->iv[1] - iv[1] <= 1 &&
+							hv->iv[2] - iv[2] >= -1 && hv->iv[2] - iv[2] <= 1)
+						{
+							if (found == NULL || hv->index > found->index)
+							{
+								found = hv;
+							}
+
+							break;
+						}
+					}
 				}
 			}
+		}
 
-			if ( i == 3 )
-			{
-				vertex = hv->v;
-				return hv;
-			}
+		if (found != NULL)
+		{
+			vertex = found->v;
+			return found;
 		}
 
 		// create a new one 
-		HashVert* hv = new HashVert;
+		_hashVerts.push_back(HashVert());
+		HashVert* hv = &_hashVerts.back();
+
+		HashVert*& bin = getBin(getBlock(0, iv[0]), getBlock(1, iv[1]), getBlock(2, iv[2]));
 
-		hv->next = _hashVerts[block[0]][block[1]][block[2]];
-		_hashVerts[block[0]][block[1]][block[2]] = hv;
+		hv->next = bin;
+		bin = hv;
+
+		hv->index = _hashVerts.size() - 1;
 
 		hv->iv[0] = iv[0];
 		hv->iv[1] = iv[1];
@@ -172,14 +241,47 @@ public:
 
 		vertex = hv->v;
 
-		_numHashVerts++;
-
 		return hv;
 	}
 
-	// Adds two new ProcTris to the front of the fixed list if the hashVert is on an edge of 
+	std::size_t getNumHashVerts() const
+	{
+		return _hashVerts.size();
+	}
+
+	OccupancyStats getOccupancyStats() const
+	{
+		OccupancyStats stats;
+
+		stats.numBins = _bins.size();
+		stats.numOccupiedBins = 0;
+		stats.maxVertsPerBin = 0;
+
+		for (std::size_t i = 0; i < _bins.size(); ++i)
+		{
+			std::size_t count = 0;
+
+			for (const HashVert* hv = _bins[i]; hv; hv = hv->next)
+			{
+				++count;
+			}
+
+			if (count > 0)
+			{
+				stats.numOccupiedBins++;
+				stats.maxVertsPerBin = std::max(stats.maxVertsPerBin, count);
+			}
+		}
+
+		stats.averageVertsPerOccupiedBin = stats.numOccupiedBins > 0 ? 
+			static_cast<double>(_hashVerts.size()) / stats.numOccupiedBins : 0;
+
+		return stats;
+	}
+
+	// Appends two new ProcTris to the halves list if the hashVert is on an edge of 
 	// the given mapTri (returns true), otherwise does nothing (and returns false).
-	bool fixTriangleAgainstHashVert(const ProcTri& a, HashVert* hv, std::list<ProcTri>& fixed)
+	bool fixTriangleAgainstHashVert(const ProcTri& a, HashVert* hv, ProcTris& halves)
 	{
 		const Vector3& v = hv->v;
 
@@ -263,8 +365,8 @@ public:
 				continue;
 			}
 
-			fixed.push_front(new1);
-			fixed.push_front(new2);
+			halves.push_back(new1);
+			halves.push_back(new2);
 
 			return true;
 		}
@@ -289,32 +391,45 @@ public:
 		int blocks[2][3];
 		getHashBlocksForTri(tri, blocks);
 
-		std::list<ProcTri> fixed(1, tri);
+		ProcTris fixed(1, tri);
+		ProcTris halves;
 
-		for (std::size_t i = blocks[0][0]; i <= blocks[1][0]; ++i)
+		for (int i = blocks[0][0]; i <= blocks[1][0]; ++i)
 		{
-			for (std::size_t j = blocks[0][1]; j <= blocks[1][1]; ++j)
+			for (int j = blocks[0][1]; j <= blocks[1][1]; ++j)
 			{
-				for (std::size_t k = blocks[0][2]; k <= blocks[1][2]; ++k)
+				for (int k = blocks[0][2]; k <= blocks[1][2]; ++k)
 				{
-					for (HashVert* hv = _hashVerts[i][j][k]; hv; hv = hv->next)
+					for (HashVert* hv = getBin(i, j, k); hv; hv = hv->next)
 					{
 						// fix all triangles in the list against this point
-						std::list<ProcTri>::iterator test = fixed.begin();
+						std::size_t numKept = 0;
 
-						while (test != fixed.end())
+						for (std::size_t test = 0; test < fixed.size(); ++test)
 						{
-							if (fixTriangleAgainstHashVert(*test, hv, fixed))
+							if (fixTriangleAgainstHashVert(fixed[test], hv, halves))
 							{
-								// cut into two triangles, they were added to the front of the fixed list already
-								// remove the old triangle, and increase the iterator to ensure it stays valid
-								fixed.erase(test++);
+								continue; // cut into two triangles, drop the old one
 							}
-							else 
+
+							// leave the triangle in the list, closing any gaps
+							if (numKept != test)
 							{
-								++test; // leave the triangle where it is
+								fixed[numKept] = std::move(fixed[test]);
 							}
+
+							++numKept;
+						}
+
+						if (halves.empty())
+						{
+							continue;
 						}
+
+						// the new triangles go to the front, the most recent split first
+						fixed.erase(fixed.begin() + numKept, fixed.end());
+						fixed.insert(fixed.begin(), halves.rbegin(), halves.rend());
+						halves.clear();
 					}
 				}
 			}
@@ -327,7 +442,7 @@ public:
 	}
 
 	// Returns an inclusive bounding box of hash bins that should hold the triangle
-	void getHashBlocksForTri(const ProcTri& tri, int blocks[2][3])
+	void getHashBlocksForTri(const ProcTri& tri, int blocks[2][3]) const
 	{
 		AABB bounds;
 
@@ -338,34 +453,44 @@ public:
 		Vector3 min = bounds.origin - bounds.extents;
 		Vector3 max = bounds.origin + bounds.extents;
 
-		Vector3 hashBoundsMin = _hashBounds.origin - _hashBounds.extents;
-		Vector3 hashBoundsMax = _hashBounds.origin + _hashBounds.extents;
-
 		// add a 1.0 slop margin on each side
 		for (std::size_t i = 0; i < 3; ++i) 
 		{
-			blocks[0][i] = static_cast<int>((min[i] - 1.0 - hashBoundsMin[i]) / _hashScale[i]);
+			blocks[0][i] = getBlock(i, static_cast<int>(floor((min[i] - 1.0) * SNAP_FRACTIONS)));
+			blocks[1][i] = getBlock(i, static_cast<int>(ceil((max[i] + 1.0) * SNAP_FRACTIONS)));
+		}
+	}
 
-			if (blocks[0][i] < 0)
-			{
-				blocks[0][i] = 0;
-			} 
-			else if (blocks[0][i] >= HASH_BINS)
-			{
-				blocks[0][i] = HASH_BINS - 1;
-			}
+private:
+	// Divides the snapped range of the axis into at most the given number of bins
+	void setNumBins(std::size_t axis, int rangeInt, int bins)
+	{
+		// Round the bin size up, then make sure the whole range is covered
+		_hashIntScale[axis] = std::max((rangeInt + bins - 1) / bins, 1);
+		_numBins[axis] = std::max((rangeInt + _hashIntScale[axis] - 1) / _hashIntScale[axis], 1);
+	}
+
+	unsigned long long getTotalBins() const
+	{
+		return static_cast<unsigned long long>(_numBins[0]) * _numBins[1] * _numBins[2];
+	}
 
-			blocks[1][i] = static_cast<int>((max[i] + 1.0 - hashBoundsMin[i]) / _hashScale[i]);
+	// Returns the bin coordinate of the given snapped value, clamped to the grid
+	int getBlock(std::size_t axis, int snapped) const
+	{
+		int block = (snapped - _hashIntMins[axis]) / _hashIntScale[axis];
 
-			if (blocks[1][i] < 0)
-			{
-				blocks[1][i] = 0;
-			} 
-			else if (blocks[1][i] >= HASH_BINS)
-			{
-				blocks[1][i] = HASH_BINS - 1;
-			}
+		if (snapped < _hashIntMins[axis] || block < 0)
+		{
+			return 0;
 		}
+
+		return block >= _numBins[axis] ? _numBins[axis] - 1 : block;
+	}
+
+	HashVert*& getBin(int x, int y, int z)
+	{
+		return _bins[(static_cast<std::size_t>(x) * _numBins[1] + y) * _numBins[2] + z];
 	}
 };
 typedef std::shared_ptr<TriangleHash> TriangleHashPtr;
@@ -0,0 +1,672 @@
+#include "HeadlessMaterials.h"
+
+#include "itextstream.h"
+#include "parser/BufferDefTokeniser.h"
+#include "parser/BufferDefBlockTokeniser.h"
+#include "os/dir.h"
+#include "os/path.h"
+#include "materiallib.h"
+#include "../../archivezip/ZipArchive.h"
+#include "../../vfspk3/SortedFilenames.h"
+
+#include <fstream>
+#include <algorithm>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/replace.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+namespace dmap
+{
+
+namespace
+{
+	const int SORT_UNDEFINED = -99;
+
+	// The stages relevant to the coverage of the material
+	struct StageInfo
+	{
+		bool hasTexture;
+		bool isInteraction;
+		std::pair<std::string, std::string> blendFunc;
+
+		StageInfo() :
+			hasTexture(false),
+			isInteraction(false),
+			blendFunc("gl_one", "gl_zero")
+		{}
+	};
+
+	// Collects the names of the .mtr files in an archive
+	class MaterialFileCollector :
+		public Archive::Visitor
+	{
+	private:
+		std::vector<std::string>& _files;
+
+	public:
+		MaterialFileCollector(std::vector<std::string>& files) :
+			_files(files)
+		{}
+
+		void visit(const std::string& name)
+		{
+			if (boost::algorithm::iends_with(name, ".mtr"))
+			{
+				_files.push_back(name);
+			}
+		}
+	};
+}
+
+HeadlessMaterial::HeadlessMaterial(const std::string& name, const std::string& definition, const std::string& fileName) :
+	_name(name),
+	_fileName(fileName),
+	_materialFlags(0),
+	_surfaceFlags(0),
+	_sortRequest(SORT_UNDEFINED),
+	_cullType(CULL_BACK),
+	_deformType(DEFORM_NONE),
+	_coverage(MC_UNDETERMINED),
+	_ambientLight(false),
+	_blendLight(false),
+	_fogLight(false),
+	_drawn(false),
+	_visible(true)
+{
+	_decalInfo.stayMilliSeconds = 0;
+	_decalInfo.fadeMilliSeconds = 0;
+	_decalInfo.startColour = Vector4(1, 1, 1, 1);
+	_decalInfo.endColour = Vector4(0, 0, 0, 0);
+
+	parseDefinition(definition);
+}
+
+// The flags and the coverage are evaluated by the same functions as in the shaders module
+void HeadlessMaterial::parseDefinition(const std::string& definition)
+{
+	parser::BufferDefTokeniser tokeniser(definition, parser::WHITESPACE, "{}(),");
+
+	std::vector<StageInfo> stages;
+	StageInfo stage;
+
+	try
+	{
+		int level = 1;
+
+		while (tokeniser.hasMoreTokens())
+		{
+			std::string token = tokeniser.nextToken();
+
+			if (token == "}")
+			{
+				if (--level == 1)
+				{
+					// Like the editor, only stages with an image are counted
+					if (stage.hasTexture)
+					{
+						stages.push_back(stage);
+					}
+
+					stage = StageInfo();
+				}
+
+				continue;
+			}
+			else if (token == "{")
+			{
+				++level;
+				continue;
+			}
+
+			boost::algorithm::to_lower(token);
+
+			if (level == 1)
+			{
+				if (shaders::parseMaterialFlag(token, _materialFlags, _coverage))
+				{
+					continue;
+				}
+
+				if (token == "decal_macro")
+				{
+					_materialFlags |= FLAG_TRANSLUCENT;
+					_sortRequest = SORT_DECAL;
+					_surfaceFlags |= SURF_DISCRETE;
+				}
+				else if (token == "twosided")
+				{
+					_cullType = CULL_NONE;
+				}
+				else if (token == "backsided")
+				{
+					_cullType = CULL_FRONT;
+				}
+				else if (token == "description")
+				{
+					_description = tokeniser.nextToken();
+				}
+				else if (token == "sort")
+				{
+					_sortRequest = shaders::parseSortRequest(tokeniser.nextToken(), SORT_UNDEFINED);
+				}
+				else if (token == "deform")
+				{
+					shaders::parseDeform(tokeniser, _deformType);
+				}
+				else if (token == "guisurf")
+				{
+					_surfaceFlags |= SURF_ENTITYGUI;
+					tokeniser.skipTokens(1);
+				}
+				else if (token == "ambientlight")
+				{
+					_ambientLight = true;
+				}
+				else if (token == "blendlight")
+				{
+					_blendLight = true;
+				}
+				else if (token == "foglight")
+				{
+					_fogLight = true;
+				}
+				else if (token == "qer_editorimage" || token == "lightfalloffimage")
+				{
+					tokeniser.skipTokens(1);
+				}
+				else if (token == "diffusemap" || token == "specularmap" || token == "bumpmap")
+				{
+					StageInfo shortcut;
+					shortcut.hasTexture = true;
+					shortcut.isInteraction = true;
+
+					stages.push_back(shortcut);
+				}
+				else
+				{
+					// Anything else is either a surface parameter or doesn't matter to dmap
+					shaders::parseSurfaceFlag(token, _surfaceFlags);
+				}
+			}
+			else if (level == 2)
+			{
+				if (token == "blend")
+				{
+					std::string blend = boost::algorithm::to_lower_copy(tokeniser.nextToken());
+
+					if (blend == "diffusemap" || blend == "bumpmap" || blend == "specularmap")
+					{
+						stage.isInteraction = true;
+					}
+					else if (blend.substr(0, 3) == "gl_")
+					{
+						// An explicit combination of GL blend modes
+						tokeniser.assertNextToken(",");
+						stage.blendFunc = std::make_pair(blend, tokeniser.nextToken());
+					}
+					else
+					{
+						// Predefined blend type like "add" or "modulate"
+						stage.blendFunc = std::make_pair(blend, std::string());
+					}
+				}
+				else if (token == "map" || token == "cameracubemap" || token == "cubemap" ||
+					token == "videomap" || token == "soundmap" || token == "remoterendermap" ||
+					token == "mirrorrendermap")
+				{
+					stage.hasTexture = true;
+				}
+				else if (token == "alphatest")
+				{
+					_coverage = MC_PERFORATED;
+				}
+			}
+		}
+	}
+	catch (parser::ParseException& e)
+	{
+		rError() << "Error while parsing material " << _name << ": " << e.what() << std::endl;
+	}
+
+	_drawn = !stages.empty() || (_surfaceFlags & SURF_ENTITYGUI) != 0;
+
+	if (_sortRequest == SORT_UNDEFINED)
+	{
+		_sortRequest = shaders::getDefaultSortRequest(_materialFlags);
+	}
+
+	if (_coverage == MC_UNDETERMINED)
+	{
+		std::size_t numInteractionStages = 0;
+
+		for (std::size_t i = 0; i < stages.size(); ++i)
+		{
+			if (stages[i].isInteraction)
+			{
+				++numInteractionStages;
+			}
+		}
+
+		_coverage = shaders::determineCoverage(stages.size(), numInteractionStages,
+			stages.empty() ? std::pair<std::string, std::string>() : stages.front().blendFunc);
+	}
+
+	shaders::applyCoverageFlags(_coverage, _materialFlags, _surfaceFlags);
+}
+
+TexturePtr HeadlessMaterial::getEditorImage()
+{
+	return TexturePtr();
+}
+
+bool HeadlessMaterial::isEditorImageNoTex()
+{
+	return false;
+}
+
+std::string HeadlessMaterial::getName() const
+{
+	return _name;
+}
+
+bool HeadlessMaterial::IsInUse() const
+{
+	return true;
+}
+
+void HeadlessMaterial::SetInUse(bool bInUse)
+{}
+
+bool HeadlessMaterial::IsDefault() const
+{
+	return _fileName.empty();
+}
+
+const char* HeadlessMaterial::getShaderFileName() const
+{
+	return _fileName.c_str();
+}
+
+int HeadlessMaterial::getSortRequest() const
+{
+	return _sortRequest;
+}
+
+float HeadlessMaterial::getPolygonOffset() const
+{
+	return 0;
+}
+
+ClampType HeadlessMaterial::getClampType() const
+{
+	return CLAMP_REPEAT;
+}
+
+Material::CullType HeadlessMaterial::getCullType() const
+{
+	return _cullType;
+}
+
+int HeadlessMaterial::getMaterialFlags() const
+{
+	return _materialFlags;
+}
+
+int HeadlessMaterial::getSurfaceFlags() const
+{
+	return _surfaceFlags;
+}
+
+Material::SurfaceType HeadlessMaterial::getSurfaceType() const
+{
+	return SURFTYPE_DEFAULT;
+}
+
+Material::DeformType HeadlessMaterial::getDeformType() const
+{
+	return _deformType;
+}
+
+int HeadlessMaterial::getSpectrum() const
+{
+	return 0;
+}
+
+const Material::DecalInfo& HeadlessMaterial::getDecalInfo() const
+{
+	return _decalInfo;
+}
+
+Material::Coverage HeadlessMaterial::getCoverage() const
+{
+	return _coverage;
+}
+
+std::string HeadlessMaterial::getDefinition()
+{
+	return std::string();
+}
+
+bool HeadlessMaterial::isAmbientLight() const
+{
+	return _ambientLight;
+}
+
+bool HeadlessMaterial::isBlendLight() const
+{
+	return _blendLight;
+}
+
+bool HeadlessMaterial::isFogLight() const
+{
+	return _fogLight;
+}
+
+bool HeadlessMaterial::lightCastsShadows() const
+{
+	return (_materialFlags & FLAG_FORCESHADOWS) ||
+		(!_fogLight && !_ambientLight && !_blendLight && !(_materialFlags & FLAG_NOSHADOWS));
+}
+
+bool HeadlessMaterial::surfaceCastsShadow() const
+{
+	return (_materialFlags & FLAG_FORCESHADOWS) || !(_materialFlags & FLAG_NOSHADOWS);
+}
+
+bool HeadlessMaterial::isDrawn() const
+{
+	return _drawn;
+}
+
+bool HeadlessMaterial::isDiscrete() const
+{
+	return (_surfaceFlags & SURF_ENTITYGUI) || _deformType != DEFORM_NONE ||
+		_sortRequest == SORT_SUBVIEW || (_surfaceFlags & SURF_DISCRETE);
+}
+
+ShaderLayer* HeadlessMaterial::firstLayer() const
+{
+	return NULL;
+}
+
+const ShaderLayerVector& HeadlessMaterial::getAllLayers() const
+{
+	return _layers;
+}
+
+TexturePtr HeadlessMaterial::lightFalloffImage()
+{
+	return TexturePtr();
+}
+
+std::string HeadlessMaterial::getDescription() const
+{
+	return _description;
+}
+
+bool HeadlessMaterial::isVisible() const
+{
+	return _visible;
+}
+
+void HeadlessMaterial::setVisible(bool visible)
+{
+	_visible = visible;
+}
+
+// ------------------------------------------------------------------------
+
+HeadlessMaterialManager::HeadlessMaterialManager(const std::vector<std::string>& basePaths) :
+	_basePaths(basePaths)
+{}
+
+void HeadlessMaterialManager::parseMaterialFile(std::istream& stream, const std::string& fileName)
+{
+	parser::BufferDefBlockTokeniser tokeniser(stream);
+
+	while (tokeniser.hasMoreBlocks())
+	{
+		parser::BlockTokeniser::Block block = tokeniser.nextBlock();
+
+		// Skip the other declarations which might be found in material files
+		if (block.name.substr(0, 5) == "table" || block.name.substr(0, 5) == "skin " ||
+			block.name.substr(0, 9) == "particle ")
+		{
+			continue;
+		}
+
+		boost::algorithm::replace_all(block.name, "\\", "/");
+
+		std::string key = boost::algorithm::to_lower_copy(block.name);
+
+		// The first definition wins, like in the editor
+		if (!_definitions.insert(Definitions::value_type(key, Definition(block.contents, fileName))).second)
+		{
+			rWarning() << "[dmap] " << fileName << ": material " << block.name << " already defined." << std::endl;
+		}
+	}
+}
+
+void HeadlessMaterialManager::initialiseModule(const ApplicationContext& ctx)
+{
+	// Like the VFS, each base path provides its folder first and its pk4s in
+	// reverse alphabetical order afterwards. The first file of a name wins.
+	typedef std::pair<std::string, ZipArchivePtr> MaterialFile; // (path, archive or empty)
+	typedef std::map<std::string, MaterialFile> MaterialFiles;
+	MaterialFiles materialFiles;
+
+	for (std::size_t i = 0; i < _basePaths.size(); ++i)
+	{
+		std::string basePath = os::standardPathWithSlash(_basePaths[i]);
+
+		try
+		{
+			os::foreachItemInDirectory(basePath + "materials/", [&](const fs::path& file)
+			{
+				if (boost::algorithm::iends_with(file.string(), ".mtr"))
+				{
+					std::string name = "materials/" + file.filename().string();
+
+					materialFiles.insert(MaterialFiles::value_type(
+						boost::algorithm::to_lower_copy(name), MaterialFile(file.string(), ZipArchivePtr())));
+				}
+			});
+		}
+		catch (os::DirectoryNotFoundException&)
+		{}
+
+		SortedFilenames pakFiles;
+
+		try
+		{
+			os::foreachItemInDirectory(basePath, [&](const fs::path& file)
+			{
+				if (boost::algorithm::iends_with(file.string(), ".pk4"))
+				{
+					pakFiles.insert(file.filename().string());
+				}
+			});
+		}
+		catch (os::DirectoryNotFoundException&)
+		{
+			rWarning() << "[dmap] Base path not found: " << _basePaths[i] << std::endl;
+			continue;
+		}
+
+		for (SortedFilenames::const_iterator pak = pakFiles.begin(); pak != pakFiles.end(); ++pak)
+		{
+			ZipArchivePtr archive(new ZipArchive(basePath + *pak));
+
+			if (archive->failed())
+			{
+				rError() << "[dmap] Unable to read archive: " << basePath << *pak << std::endl;
+				continue;
+			}
+
+			std::vector<std::string> files;
+			MaterialFileCollector collector(files);
+
+			archive->forEachFile(Archive::VisitorFunc(collector, Archive::eFiles, 1), "materials/");
+
+			for (std::size_t f = 0; f < files.size(); ++f)
+			{
+				materialFiles.insert(MaterialFiles::value_type(
+					boost::algorithm::to_lower_copy(files[f]), MaterialFile(files[f], archive)));
+			}
+		}
+	}
+
+	// Parse the files sorted by name, such that the definition order is stable
+	for (MaterialFiles::const_iterator i = materialFiles.begin(); i != materialFiles.end(); ++i)
+	{
+		const std::string& path = i->second.first;
+		const ZipArchivePtr& archive = i->second.second;
+
+		if (archive)
+		{
+			ArchiveTextFilePtr file = archive->openTextFile(path);
+
+			if (!file)
+			{
+				rError() << "[dmap] Unable to read material file: " << path << std::endl;
+				continue;
+			}
+
+			std::istream is(&(file->getInputStream()));
+			parseMaterialFile(is, path);
+		}
+		else
+		{
+			std::ifstream stream(path.c_str());
+
+			if (!stream.good())
+			{
+				rError() << "[dmap] Unable to read material file: " << path << std::endl;
+				continue;
+			}
+
+			parseMaterialFile(stream, path);
+		}
+	}
+
+	rMessage() << "[dmap] " << _definitions.size() << " material definitions found." << std::endl;
+}
+
+void HeadlessMaterialManager::realise()
+{}
+
+void HeadlessMaterialManager::unrealise()
+{}
+
+void HeadlessMaterialManager::refresh()
+{}
+
+bool HeadlessMaterialManager::isRealised()
+{
+	return true;
+}
+
+MaterialPtr HeadlessMaterialManager::getMaterialForName(const std::string& name)
+{
+	std::string key = boost::algorithm::to_lower_copy(name);
+
+	std::lock_guard<std::mutex> lock(_lock);
+
+	Materials::const_iterator found = _materials.find(key);
+
+	if (found != _materials.end())
+	{
+		return found->second;
+	}
+
+	Definitions::const_iterator def = _definitions.find(key);
+
+	MaterialPtr material;
+
+	if (def != _definitions.end())
+	{
+		material.reset(new HeadlessMaterial(name, def->second.first, def->second.second));
+	}
+	else
+	{
+		rWarning() << "[dmap] Material not found: " << name << std::endl;
+		material.reset(new HeadlessMaterial(name, std::string(), std::string()));
+	}
+
+	_materials.insert(Materials::value_type(key, material));
+
+	return material;
+}
+
+bool HeadlessMaterialManager::materialExists(const std::string& name)
+{
+	return _definitions.find(boost::algorithm::to_lower_copy(name)) != _definitions.end();
+}
+
+void HeadlessMaterialManager::foreachShaderName(const ShaderNameCallback& callback)
+{
+	for (Definitions::const_iterator i = _definitions.begin(); i != _definitions.end(); ++i)
+	{
+		callback(i->first);
+	}
+}
+
+void HeadlessMaterialManager::foreachShader(shaders::ShaderVisitor& visitor)
+{
+	for (Definitions::const_iterator i = _definitions.begin(); i != _definitions.end(); ++i)
+	{
+		visitor.visit(getMaterialForName(i->first));
+	}
+}
+
+void HeadlessMaterialManager::addActiveShadersObserver(const ActiveShadersObserverPtr& observer)
+{}
+
+void HeadlessMaterialManager::removeActiveShadersObserver(const ActiveShadersObserverPtr& observer)
+{}
+
+void HeadlessMaterialManager::setActiveShaderUpdates(bool val)
+{}
+
+void HeadlessMaterialManager::attach(ModuleObserver& observer)
+{}
+
+void HeadlessMaterialManager::detach(ModuleObserver& observer)
+{}
+
+void HeadlessMaterialManager::setLightingEnabled(bool enabled)
+{}
+
+const char* HeadlessMaterialManager::getTexturePrefix() const
+{
+	return "textures/";
+}
+
+TexturePtr HeadlessMaterialManager::getDefaultInteractionTexture(ShaderLayer::Type type)
+{
+	return TexturePtr();
+}
+
+TexturePtr HeadlessMaterialManager::loadTextureFromFile(const std::string& filename)
+{
+	return TexturePtr();
+}
+
+shaders::IShaderExpressionPtr HeadlessMaterialManager::createShaderExpressionFromString(const std::string& exprStr)
+{
+	return shaders::IShaderExpressionPtr();
+}
+
+const std::string& HeadlessMaterialManager::getName() const
+{
+	static std::string _name(MODULE_SHADERSYSTEM);
+	return _name;
+}
+
+const StringSet& HeadlessMaterialManager::getDependencies() const
+{
+	static StringSet _dependencies;
+	return _dependencies;
+}
+
+} // namespace
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "ishaders.h"
+
+#include <map>
+#include <mutex>
+#include <vector>
+#include <istream>
+
+namespace dmap
+{
+
+/**
+ * A material holding the flags the compiler needs (surface and material
+ * flags, coverage, sort, deform and light type). Stages are only examined
+ * to determine the coverage, no images or expressions are loaded.
+ */
+class HeadlessMaterial :
+	public Material
+{
+private:
+	std::string _name;
+	std::string _fileName;
+	std::string _description;
+
+	int _materialFlags;
+	int _surfaceFlags;
+	int _sortRequest;
+	CullType _cullType;
+	DeformType _deformType;
+	Coverage _coverage;
+
+	bool _ambientLight;
+	bool _blendLight;
+	bool _fogLight;
+
+	bool _drawn;
+	bool _visible;
+
+	DecalInfo _decalInfo;
+	ShaderLayerVector _layers;
+
+public:
+	// Parses the given block contents (without the outer braces),
+	// an empty definition results in a translucent, non-drawn material
+	HeadlessMaterial(const std::string& name, const std::string& definition, const std::string& fileName);
+
+	TexturePtr getEditorImage();
+	bool isEditorImageNoTex();
+	std::string getName() const;
+	bool IsInUse() const;
+	void SetInUse(bool bInUse);
+	bool IsDefault() const;
+	const char* getShaderFileName() const;
+	int getSortRequest() const;
+	float getPolygonOffset() const;
+	ClampType getClampType() const;
+	CullType getCullType() const;
+	int getMaterialFlags() const;
+	int getSurfaceFlags() const;
+	SurfaceType getSurfaceType() const;
+	DeformType getDeformType() const;
+	int getSpectrum() const;
+	const DecalInfo& getDecalInfo() const;
+	Coverage getCoverage() const;
+	std::string getDefinition();
+	bool isAmbientLight() const;
+	bool isBlendLight() const;
+	bool isFogLight() const;
+	bool lightCastsShadows() const;
+	bool surfaceCastsShadow() const;
+	bool isDrawn() const;
+	bool isDiscrete() const;
+	ShaderLayer* firstLayer() const;
+	const ShaderLayerVector& getAllLayers() const;
+	TexturePtr lightFalloffImage();
+	std::string getDescription() const;
+	bool isVisible() const;
+	void setVisible(bool visible);
+
+private:
+	void parseDefinition(const std::string& definition);
+};
+
+/**
+ * Reads the material declarations from the .mtr files in materials/ below
+ * the given base paths and in the pk4 archives found in them. Unknown
+ * material names result in an empty (translucent) material, like the
+ * default shader of the editor.
+ */
+class HeadlessMaterialManager :
+	public MaterialManager
+{
+private:
+	std::vector<std::string> _basePaths;
+
+	// Material name (lowercase) => (block contents, file name)
+	typedef std::pair<std::string, std::string> Definition;
+	typedef std::map<std::string, Definition> Definitions;
+	Definitions _definitions;
+
+	// The materials are constructed on demand, by any compiler thread
+	typedef std::map<std::string, MaterialPtr> Materials;
+	Materials _materials;
+	std::mutex _lock;
+
+public:
+	HeadlessMaterialManager(const std::vector<std::string>& basePaths);
+
+	void realise();
+	void unrealise();
+	void refresh();
+	bool isRealised();
+	MaterialPtr getMaterialForName(const std::string& name);
+	bool materialExists(const std::string& name);
+	void foreachShaderName(const ShaderNameCallback& callback);
+	void foreachShader(shaders::ShaderVisitor& visitor);
+	void addActiveShadersObserver(const ActiveShadersObserverPtr& observer);
+	void removeActiveShadersObserver(const ActiveShadersObserverPtr& observer);
+	void setActiveShaderUpdates(bool val);
+	void attach(ModuleObserver& observer);
+	void detach(ModuleObserver& observer);
+	void setLightingEnabled(bool enabled);
+	const char* getTexturePrefix() const;
+	TexturePtr getDefaultInteractionTexture(ShaderLayer::Type type);
+	TexturePtr loadTextureFromFile(const std::string& filename);
+	shaders::IShaderExpressionPtr createShaderExpressionFromString(const std::string& exprStr);
+
+	const std::string& getName() const;
+	const StringSet& getDependencies() const;
+	void initialiseModule(const ApplicationContext& ctx);
+
+private:
+	void parseMaterialFile(std::istream& stream, const std::string& fileName);
+};
+
+} // namespace
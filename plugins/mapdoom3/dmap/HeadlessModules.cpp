@@ -0,0 +1,136 @@
+#include "HeadlessModules.h"
+
+#include <iostream>
+#include <stdexcept>
+
+namespace dmap
+{
+
+HeadlessContext::HeadlessContext(int argc, char* argv[])
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		_args.push_back(argv[i]);
+	}
+
+	_errorHandler = [](const std::string& title, const std::string& message)
+	{
+		std::cerr << title << ": " << message << std::endl;
+	};
+}
+
+std::string HeadlessContext::getApplicationPath() const
+{
+	return "./";
+}
+
+std::string HeadlessContext::getRuntimeDataPath() const
+{
+	return getApplicationPath();
+}
+
+std::string HeadlessContext::getSettingsPath() const
+{
+	return getApplicationPath();
+}
+
+std::string HeadlessContext::getBitmapsPath() const
+{
+	return getApplicationPath();
+}
+
+const ApplicationContext::ArgumentList& HeadlessContext::getCmdLineArgs() const
+{
+	return _args;
+}
+
+std::ostream& HeadlessContext::getOutputStream() const
+{
+	return std::cout;
+}
+
+std::ostream& HeadlessContext::getErrorStream() const
+{
+	return std::cerr;
+}
+
+std::ostream& HeadlessContext::getWarningStream() const
+{
+	return std::cerr;
+}
+
+void HeadlessContext::savePathsToRegistry() const
+{
+	// There is no registry in the standalone dmap
+}
+
+const ErrorHandlingFunction& HeadlessContext::getErrorHandlingFunction() const
+{
+	return _errorHandler;
+}
+
+HeadlessModuleRegistry::HeadlessModuleRegistry(const ApplicationContext& context) :
+	_context(context),
+	_modulesInitialised(false)
+{}
+
+void HeadlessModuleRegistry::registerModule(RegisterableModulePtr module)
+{
+	assert(module);
+
+	if (_modulesInitialised)
+	{
+		throw std::logic_error("HeadlessModuleRegistry: module " + module->getName() +
+			" registered after initialisation.");
+	}
+
+	if (!_modules.insert(ModulesMap::value_type(module->getName(), module)).second)
+	{
+		throw std::logic_error("HeadlessModuleRegistry: multiple modules named " + module->getName());
+	}
+}
+
+void HeadlessModuleRegistry::initialiseModules()
+{
+	if (_modulesInitialised)
+	{
+		throw std::logic_error("HeadlessModuleRegistry::initialiseModules called twice.");
+	}
+
+	// The stand-in modules don't depend on each other
+	for (ModulesMap::const_iterator i = _modules.begin(); i != _modules.end(); ++i)
+	{
+		i->second->initialiseModule(_context);
+	}
+
+	_modulesInitialised = true;
+}
+
+void HeadlessModuleRegistry::shutdownModules()
+{
+	for (ModulesMap::const_iterator i = _modules.begin(); i != _modules.end(); ++i)
+	{
+		i->second->shutdownModule();
+	}
+
+	_modules.clear();
+}
+
+RegisterableModulePtr HeadlessModuleRegistry::getModule(const std::string& name) const
+{
+	ModulesMap::const_iterator found = _modules.find(name);
+
+	return found != _modules.end() ? found->second : RegisterableModulePtr();
+}
+
+bool HeadlessModuleRegistry::moduleExists(const std::string& name) const
+{
+	return _modules.find(name) != _modules.end();
+}
+
+const ApplicationContext& HeadlessModuleRegistry::getApplicationContext() const
+{
+	return _context;
+}
+
+} // namespace
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "imodule.h"
+#include <map>
+
+namespace dmap
+{
+
+/**
+ * The application context of the standalone dmap executable. All
+ * paths point to the working directory, the log goes to the console.
+ */
+class HeadlessContext :
+	public ApplicationContext
+{
+private:
+	ArgumentList _args;
+	ErrorHandlingFunction _errorHandler;
+
+public:
+	HeadlessContext(int argc, char* argv[]);
+
+	std::string getApplicationPath() const;
+	std::string getRuntimeDataPath() const;
+	std::string getSettingsPath() const;
+	std::string getBitmapsPath() const;
+	const ArgumentList& getCmdLineArgs() const;
+	std::ostream& getOutputStream() const;
+	std::ostream& getErrorStream() const;
+	std::ostream& getWarningStream() const;
+	void savePathsToRegistry() const;
+	const ErrorHandlingFunction& getErrorHandlingFunction() const;
+};
+
+/**
+ * A minimal module registry for the standalone dmap, holding the few
+ * modules the map reader and the compiler are calling. There are no
+ * dynamic libraries involved, the modules are registered by main().
+ */
+class HeadlessModuleRegistry :
+	public IModuleRegistry
+{
+private:
+	const ApplicationContext& _context;
+
+	typedef std::map<std::string, RegisterableModulePtr> ModulesMap;
+	ModulesMap _modules;
+
+	bool _modulesInitialised;
+
+public:
+	HeadlessModuleRegistry(const ApplicationContext& context);
+
+	void registerModule(RegisterableModulePtr module);
+	void initialiseModules();
+	void shutdownModules();
+	RegisterableModulePtr getModule(const std::string& name) const;
+	bool moduleExists(const std::string& name) const;
+	const ApplicationContext& getApplicationContext() const;
+};
+
+} // namespace
@@ -0,0 +1,757 @@
+#include "HeadlessScene.h"
+
+#include <stdexcept>
+#include <boost/algorithm/string/predicate.hpp>
+
+namespace dmap
+{
+
+HeadlessNode::HeadlessNode(Type type) :
+	_type(type)
+{}
+
+scene::INode::Type HeadlessNode::getNodeType() const
+{
+	return _type;
+}
+
+void HeadlessNode::renderSolid(RenderableCollector& collector, const VolumeTest& volume) const
+{}
+
+void HeadlessNode::renderWireframe(RenderableCollector& collector, const VolumeTest& volume) const
+{}
+
+const AABB& HeadlessNode::localAABB() const
+{
+	return _emptyAABB;
+}
+
+bool HeadlessNode::isHighlighted() const
+{
+	return false;
+}
+
+// ------------------------------------------------------------------------
+
+HeadlessFace::HeadlessFace(const Plane3& plane, const Matrix4& texDef, const std::string& shader) :
+	_plane(plane),
+	_texDef(Matrix4::getIdentity()),
+	_shader(shader)
+{
+	// Only the six brush primitive components are used, like in the editor's faces
+	_texDef.xx() = texDef.xx();
+	_texDef.yx() = texDef.yx();
+	_texDef.tx() = texDef.tx();
+	_texDef.xy() = texDef.xy();
+	_texDef.yy() = texDef.yy();
+	_texDef.ty() = texDef.ty();
+}
+
+void HeadlessFace::undoSave()
+{}
+
+const std::string& HeadlessFace::getShader() const
+{
+	return _shader;
+}
+
+void HeadlessFace::setShader(const std::string& name)
+{
+	_shader = name;
+}
+
+void HeadlessFace::shiftTexdef(float s, float t)
+{}
+
+void HeadlessFace::scaleTexdef(float s, float t)
+{}
+
+void HeadlessFace::rotateTexdef(float angle)
+{}
+
+void HeadlessFace::fitTexture(float s_repeat, float t_repeat)
+{}
+
+void HeadlessFace::flipTexture(unsigned int flipAxis)
+{}
+
+void HeadlessFace::normaliseTexture()
+{}
+
+IWinding& HeadlessFace::getWinding()
+{
+	return _winding;
+}
+
+const IWinding& HeadlessFace::getWinding() const
+{
+	return _winding;
+}
+
+const Plane3& HeadlessFace::getPlane3() const
+{
+	return _plane;
+}
+
+Matrix4 HeadlessFace::getTexDefMatrix() const
+{
+	return _texDef;
+}
+
+// ------------------------------------------------------------------------
+
+HeadlessBrush::HeadlessBrush() :
+	_detailFlag(Structural)
+{}
+
+std::size_t HeadlessBrush::getNumFaces() const
+{
+	return _faces.size();
+}
+
+IFace& HeadlessBrush::getFace(std::size_t index)
+{
+	return *_faces[index];
+}
+
+const IFace& HeadlessBrush::getFace(std::size_t index) const
+{
+	return *_faces[index];
+}
+
+IFace& HeadlessBrush::addFace(const Plane3& plane)
+{
+	return addFace(plane, Matrix4::getIdentity(), "");
+}
+
+IFace& HeadlessBrush::addFace(const Plane3& plane, const Matrix4& texDef, const std::string& shader)
+{
+	_faces.push_back(HeadlessFacePtr(new HeadlessFace(plane, texDef, shader)));
+	return *_faces.back();
+}
+
+bool HeadlessBrush::empty() const
+{
+	return _faces.empty();
+}
+
+bool HeadlessBrush::hasContributingFaces() const
+{
+	// The windings are calculated by the compiler, not here
+	return !_faces.empty();
+}
+
+void HeadlessBrush::removeEmptyFaces()
+{}
+
+void HeadlessBrush::setShader(const std::string& newShader)
+{
+	for (std::size_t i = 0; i < _faces.size(); ++i)
+	{
+		_faces[i]->setShader(newShader);
+	}
+}
+
+bool HeadlessBrush::hasShader(const std::string& name)
+{
+	for (std::size_t i = 0; i < _faces.size(); ++i)
+	{
+		if (boost::algorithm::iequals(_faces[i]->getShader(), name))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool HeadlessBrush::hasVisibleMaterial() const
+{
+	return true;
+}
+
+void HeadlessBrush::updateFaceVisibility()
+{}
+
+void HeadlessBrush::undoSave()
+{}
+
+IBrush::DetailFlag HeadlessBrush::getDetailFlag() const
+{
+	return _detailFlag;
+}
+
+void HeadlessBrush::setDetailFlag(DetailFlag newValue)
+{
+	_detailFlag = newValue;
+}
+
+HeadlessBrushNode::HeadlessBrushNode() :
+	HeadlessNode(Type::Brush)
+{}
+
+Brush& HeadlessBrushNode::getBrush()
+{
+	throw std::logic_error("HeadlessBrushNode: Brush is not available in the standalone dmap.");
+}
+
+IBrush& HeadlessBrushNode::getIBrush()
+{
+	return _brush;
+}
+
+// ------------------------------------------------------------------------
+
+HeadlessPatch::HeadlessPatch() :
+	_width(0),
+	_height(0),
+	_subdivisionsFixed(false),
+	_subdivisions(0, 0)
+{}
+
+void HeadlessPatch::attachObserver(Observer* observer)
+{}
+
+void HeadlessPatch::detachObserver(Observer* observer)
+{}
+
+void HeadlessPatch::setDims(std::size_t width, std::size_t height)
+{
+	_width = width;
+	_height = height;
+	_controls.resize(width * height);
+}
+
+std::size_t HeadlessPatch::getWidth() const
+{
+	return _width;
+}
+
+std::size_t HeadlessPatch::getHeight() const
+{
+	return _height;
+}
+
+PatchControl& HeadlessPatch::ctrlAt(std::size_t row, std::size_t col)
+{
+	return _controls[row * _width + col];
+}
+
+const PatchControl& HeadlessPatch::ctrlAt(std::size_t row, std::size_t col) const
+{
+	return _controls[row * _width + col];
+}
+
+PatchMesh HeadlessPatch::getTesselatedPatchMesh() const
+{
+	// The compiler subdivides the control points itself (see ProcPatch)
+	PatchMesh mesh;
+
+	mesh.width = 0;
+	mesh.height = 0;
+
+	return mesh;
+}
+
+void HeadlessPatch::insertColumns(std::size_t colIndex)
+{
+	throw GenericPatchException("HeadlessPatch: editing is not supported.");
+}
+
+void HeadlessPatch::insertRows(std::size_t rowIndex)
+{
+	throw GenericPatchException("HeadlessPatch: editing is not supported.");
+}
+
+void HeadlessPatch::removePoints(bool columns, std::size_t index)
+{
+	throw GenericPatchException("HeadlessPatch: editing is not supported.");
+}
+
+void HeadlessPatch::appendPoints(bool columns, bool beginning)
+{
+	throw GenericPatchException("HeadlessPatch: editing is not supported.");
+}
+
+void HeadlessPatch::controlPointsChanged()
+{}
+
+bool HeadlessPatch::isValid() const
+{
+	return _width >= 3 && _height >= 3 && _width % 2 == 1 && _height % 2 == 1;
+}
+
+bool HeadlessPatch::isDegenerate() const
+{
+	return !isValid();
+}
+
+const std::string& HeadlessPatch::getShader() const
+{
+	return _shader;
+}
+
+void HeadlessPatch::setShader(const std::string& name)
+{
+	_shader = name;
+}
+
+bool HeadlessPatch::hasVisibleMaterial() const
+{
+	return true;
+}
+
+bool HeadlessPatch::subdivionsFixed() const
+{
+	return _subdivisionsFixed;
+}
+
+Subdivisions HeadlessPatch::getSubdivisions() const
+{
+	return _subdivisions;
+}
+
+void HeadlessPatch::setFixedSubdivisions(bool isFixed, const Subdivisions& divisions)
+{
+	_subdivisionsFixed = isFixed;
+	_subdivisions = divisions;
+}
+
+HeadlessPatchNode::HeadlessPatchNode() :
+	HeadlessNode(Type::Patch)
+{}
+
+Patch& HeadlessPatchNode::getPatchInternal()
+{
+	throw std::logic_error("HeadlessPatchNode: Patch is not available in the standalone dmap.");
+}
+
+IPatch& HeadlessPatchNode::getPatch()
+{
+	return _patch;
+}
+
+// ------------------------------------------------------------------------
+
+HeadlessEntityClass::HeadlessEntityClass(const std::string& name) :
+	_name(name),
+	_isLight(name == "light"),
+	_emptyAttribute("", "", "")
+{}
+
+sigc::signal<void> HeadlessEntityClass::changedSignal() const
+{
+	return sigc::signal<void>();
+}
+
+std::string HeadlessEntityClass::getName() const
+{
+	return _name;
+}
+
+const IEntityClass* HeadlessEntityClass::getParent() const
+{
+	return NULL;
+}
+
+bool HeadlessEntityClass::isLight() const
+{
+	return _isLight;
+}
+
+bool HeadlessEntityClass::isFixedSize() const
+{
+	return false;
+}
+
+AABB HeadlessEntityClass::getBounds() const
+{
+	return AABB();
+}
+
+const Vector3& HeadlessEntityClass::getColour() const
+{
+	static Vector3 _colour(0.3, 0.3, 1);
+	return _colour;
+}
+
+const std::string& HeadlessEntityClass::getWireShader() const
+{
+	return _emptyAttribute.getValue();
+}
+
+const std::string& HeadlessEntityClass::getFillShader() const
+{
+	return _emptyAttribute.getValue();
+}
+
+EntityClassAttribute& HeadlessEntityClass::getAttribute(const std::string& name)
+{
+	return _emptyAttribute;
+}
+
+const EntityClassAttribute& HeadlessEntityClass::getAttribute(const std::string& name) const
+{
+	return _emptyAttribute;
+}
+
+void HeadlessEntityClass::forEachClassAttribute(std::function<void(const EntityClassAttribute&)> visitor,
+	bool editorKeys) const
+{}
+
+const std::string& HeadlessEntityClass::getModelPath() const
+{
+	return _emptyAttribute.getValue();
+}
+
+const std::string& HeadlessEntityClass::getSkin() const
+{
+	return _emptyAttribute.getValue();
+}
+
+bool HeadlessEntityClass::isOfType(const std::string& className)
+{
+	return _name == className;
+}
+
+std::string HeadlessEntityClass::getModName() const
+{
+	return std::string();
+}
+
+// ------------------------------------------------------------------------
+
+HeadlessKeyValue::HeadlessKeyValue(const std::string& value) :
+	_value(value)
+{}
+
+const std::string& HeadlessKeyValue::get() const
+{
+	return _value;
+}
+
+void HeadlessKeyValue::assign(const std::string& other)
+{
+	_value = other;
+}
+
+void HeadlessKeyValue::attach(KeyObserver& observer)
+{}
+
+void HeadlessKeyValue::detach(KeyObserver& observer)
+{}
+
+void HeadlessKeyValue::onNameChange(const std::string& oldName, const std::string& newName)
+{}
+
+HeadlessEntity::HeadlessEntity(const IEntityClassPtr& eclass) :
+	_eclass(eclass)
+{}
+
+IEntityClassPtr HeadlessEntity::getEntityClass() const
+{
+	return _eclass;
+}
+
+void HeadlessEntity::forEachKeyValue(Visitor& visitor) const
+{
+	for (KeyValues::const_iterator i = _keyValues.begin(); i != _keyValues.end(); ++i)
+	{
+		visitor.visit(i->first, i->second->get());
+	}
+}
+
+void HeadlessEntity::forEachKeyValue(KeyValueVisitor& visitor)
+{
+	for (KeyValues::const_iterator i = _keyValues.begin(); i != _keyValues.end(); ++i)
+	{
+		visitor.visit(i->first, *i->second);
+	}
+}
+
+void HeadlessEntity::setKeyValue(const std::string& key, const std::string& value)
+{
+	KeyValues::const_iterator found = find(key);
+
+	if (value.empty())
+	{
+		// Empty values are erased, like in the editor's entities
+		if (found != _keyValues.end())
+		{
+			_keyValues.erase(found);
+		}
+	}
+	else if (found != _keyValues.end())
+	{
+		found->second->assign(value);
+	}
+	else
+	{
+		_keyValues.push_back(std::make_pair(key, HeadlessKeyValuePtr(new HeadlessKeyValue(value))));
+	}
+}
+
+std::string HeadlessEntity::getKeyValue(const std::string& key) const
+{
+	KeyValues::const_iterator found = find(key);
+
+	return found != _keyValues.end() ? found->second->get() : _eclass->getAttribute(key).getValue();
+}
+
+bool HeadlessEntity::isInherited(const std::string& key) const
+{
+	return false;
+}
+
+Entity::KeyValuePairs HeadlessEntity::getKeyValuePairs(const std::string& prefix) const
+{
+	KeyValuePairs list;
+
+	for (KeyValues::const_iterator i = _keyValues.begin(); i != _keyValues.end(); ++i)
+	{
+		if (boost::algorithm::istarts_with(i->first, prefix))
+		{
+			list.push_back(std::make_pair(i->first, i->second->get()));
+		}
+	}
+
+	return list;
+}
+
+bool HeadlessEntity::isModel() const
+{
+	std::string model = getKeyValue("model");
+	return !model.empty() && model != getKeyValue("name");
+}
+
+bool HeadlessEntity::isContainer() const
+{
+	return !_eclass->isFixedSize();
+}
+
+void HeadlessEntity::attachObserver(Observer* observer)
+{}
+
+void HeadlessEntity::detachObserver(Observer* observer)
+{}
+
+bool HeadlessEntity::isOfType(const std::string& className)
+{
+	return _eclass->isOfType(className);
+}
+
+HeadlessEntity::KeyValues::const_iterator HeadlessEntity::find(const std::string& key) const
+{
+	for (KeyValues::const_iterator i = _keyValues.begin(); i != _keyValues.end(); ++i)
+	{
+		if (boost::algorithm::iequals(i->first, key))
+		{
+			return i;
+		}
+	}
+
+	return _keyValues.end();
+}
+
+HeadlessEntityNode::HeadlessEntityNode(const IEntityClassPtr& eclass) :
+	HeadlessNode(Type::Entity),
+	_entity(eclass)
+{}
+
+Entity& HeadlessEntityNode::getEntity()
+{
+	return _entity;
+}
+
+void HeadlessEntityNode::refreshModel()
+{}
+
+float HeadlessEntityNode::getShaderParm(int parmNum) const
+{
+	return 0;
+}
+
+const Vector3& HeadlessEntityNode::getDirection() const
+{
+	static Vector3 _direction(0, 0, 1);
+	return _direction;
+}
+
+const ShaderPtr& HeadlessEntityNode::getWireShader() const
+{
+	static ShaderPtr _nullShader;
+	return _nullShader;
+}
+
+// ------------------------------------------------------------------------
+
+scene::INodePtr HeadlessBrushCreator::createBrush()
+{
+	return scene::INodePtr(new HeadlessBrushNode);
+}
+
+const std::string& HeadlessBrushCreator::getName() const
+{
+	static std::string _name(MODULE_BRUSHCREATOR);
+	return _name;
+}
+
+const StringSet& HeadlessBrushCreator::getDependencies() const
+{
+	static StringSet _dependencies;
+	return _dependencies;
+}
+
+void HeadlessBrushCreator::initialiseModule(const ApplicationContext& ctx)
+{}
+
+HeadlessPatchCreator::HeadlessPatchCreator(const std::string& defType) :
+	_name(MODULE_PATCH + defType)
+{}
+
+scene::INodePtr HeadlessPatchCreator::createPatch()
+{
+	return scene::INodePtr(new HeadlessPatchNode);
+}
+
+const std::string& HeadlessPatchCreator::getName() const
+{
+	return _name;
+}
+
+const StringSet& HeadlessPatchCreator::getDependencies() const
+{
+	static StringSet _dependencies;
+	return _dependencies;
+}
+
+void HeadlessPatchCreator::initialiseModule(const ApplicationContext& ctx)
+{}
+
+IEntityNodePtr HeadlessEntityCreator::createEntity(const IEntityClassPtr& eclass)
+{
+	return IEntityNodePtr(new HeadlessEntityNode(eclass));
+}
+
+void HeadlessEntityCreator::connectEntities(const scene::INodePtr& source, const scene::INodePtr& target)
+{}
+
+const std::string& HeadlessEntityCreator::getName() const
+{
+	static std::string _name(MODULE_ENTITYCREATOR);
+	return _name;
+}
+
+const StringSet& HeadlessEntityCreator::getDependencies() const
+{
+	static StringSet _dependencies;
+	return _dependencies;
+}
+
+void HeadlessEntityCreator::initialiseModule(const ApplicationContext& ctx)
+{}
+
+// ------------------------------------------------------------------------
+
+sigc::signal<void> HeadlessEntityClassManager::defsReloadedSignal() const
+{
+	return _defsReloadedSignal;
+}
+
+IEntityClassPtr HeadlessEntityClassManager::findOrInsert(const std::string& name, bool has_brushes)
+{
+	return findClass(name);
+}
+
+IEntityClassPtr HeadlessEntityClassManager::findClass(const std::string& name) const
+{
+	EntityClasses::const_iterator found = _classes.find(name);
+
+	if (found != _classes.end())
+	{
+		return found->second;
+	}
+
+	IEntityClassPtr eclass(new HeadlessEntityClass(name));
+	_classes.insert(EntityClasses::value_type(name, eclass));
+
+	return eclass;
+}
+
+void HeadlessEntityClassManager::forEachEntityClass(EntityClassVisitor& visitor)
+{
+	for (EntityClasses::const_iterator i = _classes.begin(); i != _classes.end(); ++i)
+	{
+		visitor.visit(i->second);
+	}
+}
+
+void HeadlessEntityClassManager::realise()
+{}
+
+void HeadlessEntityClassManager::unrealise()
+{}
+
+void HeadlessEntityClassManager::reloadDefs()
+{}
+
+IModelDefPtr HeadlessEntityClassManager::findModel(const std::string& name) const
+{
+	return IModelDefPtr();
+}
+
+void HeadlessEntityClassManager::forEachModelDef(ModelDefVisitor& visitor)
+{}
+
+const std::string& HeadlessEntityClassManager::getName() const
+{
+	static std::string _name(MODULE_ECLASSMANAGER);
+	return _name;
+}
+
+const StringSet& HeadlessEntityClassManager::getDependencies() const
+{
+	static StringSet _dependencies;
+	return _dependencies;
+}
+
+void HeadlessEntityClassManager::initialiseModule(const ApplicationContext& ctx)
+{}
+
+// ------------------------------------------------------------------------
+
+scene::INodePtr HeadlessModelCache::getModelNode(const std::string& modelPath)
+{
+	// Never NULL, like the editor's NullModel
+	return scene::INodePtr(new HeadlessNode(scene::INode::Type::Model));
+}
+
+model::IModelPtr HeadlessModelCache::getModel(const std::string& modelPath)
+{
+	return model::IModelPtr();
+}
+
+ModelLoaderPtr HeadlessModelCache::getModelLoaderForType(const std::string& type)
+{
+	return ModelLoaderPtr();
+}
+
+void HeadlessModelCache::clear()
+{}
+
+const std::string& HeadlessModelCache::getName() const
+{
+	static std::string _name(MODULE_MODELCACHE);
+	return _name;
+}
+
+const StringSet& HeadlessModelCache::getDependencies() const
+{
+	static StringSet _dependencies;
+	return _dependencies;
+}
+
+void HeadlessModelCache::initialiseModule(const ApplicationContext& ctx)
+{}
+
+} // namespace
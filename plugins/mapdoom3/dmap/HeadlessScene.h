@@ -0,0 +1,354 @@
+#pragma once
+
+#include "ibrush.h"
+#include "ipatch.h"
+#include "ientity.h"
+#include "ieclass.h"
+#include "imodelcache.h"
+#include "irender.h"
+
+#include <map>
+#include "math/Plane3.h"
+#include "math/Matrix4.h"
+#include "math/AABB.h"
+#include "scene/Node.h"
+
+/**
+ * Plain data implementations of the scene interfaces used by the map reader
+ * and the dmap compiler. They hold what has been parsed from the map file,
+ * without any of the editor's rendering, selection or undo functionality.
+ */
+namespace dmap
+{
+
+// Base of the scene nodes, which are never rendered
+class HeadlessNode :
+	public scene::Node
+{
+private:
+	Type _type;
+	AABB _emptyAABB;
+
+public:
+	HeadlessNode(Type type);
+
+	Type getNodeType() const;
+
+	void renderSolid(RenderableCollector& collector, const VolumeTest& volume) const;
+	void renderWireframe(RenderableCollector& collector, const VolumeTest& volume) const;
+
+	const AABB& localAABB() const;
+	bool isHighlighted() const;
+};
+
+class HeadlessFace :
+	public IFace
+{
+private:
+	Plane3 _plane;
+	Matrix4 _texDef;
+	std::string _shader;
+	IWinding _winding;
+
+public:
+	HeadlessFace(const Plane3& plane, const Matrix4& texDef, const std::string& shader);
+
+	void undoSave();
+	const std::string& getShader() const;
+	void setShader(const std::string& name);
+	void shiftTexdef(float s, float t);
+	void scaleTexdef(float s, float t);
+	void rotateTexdef(float angle);
+	void fitTexture(float s_repeat, float t_repeat);
+	void flipTexture(unsigned int flipAxis);
+	void normaliseTexture();
+	IWinding& getWinding();
+	const IWinding& getWinding() const;
+	const Plane3& getPlane3() const;
+	Matrix4 getTexDefMatrix() const;
+};
+
+class HeadlessBrush :
+	public IBrush
+{
+private:
+	typedef std::shared_ptr<HeadlessFace> HeadlessFacePtr;
+	std::vector<HeadlessFacePtr> _faces;
+
+	DetailFlag _detailFlag;
+
+public:
+	HeadlessBrush();
+
+	std::size_t getNumFaces() const;
+	IFace& getFace(std::size_t index);
+	const IFace& getFace(std::size_t index) const;
+	IFace& addFace(const Plane3& plane);
+	IFace& addFace(const Plane3& plane, const Matrix4& texDef, const std::string& shader);
+	bool empty() const;
+	bool hasContributingFaces() const;
+	void removeEmptyFaces();
+	void setShader(const std::string& newShader);
+	bool hasShader(const std::string& name);
+	bool hasVisibleMaterial() const;
+	void updateFaceVisibility();
+	void undoSave();
+	DetailFlag getDetailFlag() const;
+	void setDetailFlag(DetailFlag newValue);
+};
+
+class HeadlessBrushNode :
+	public HeadlessNode,
+	public IBrushNode
+{
+private:
+	HeadlessBrush _brush;
+
+public:
+	HeadlessBrushNode();
+
+	// The editor's Brush class is not available, this throws std::logic_error
+	Brush& getBrush();
+	IBrush& getIBrush();
+};
+
+class HeadlessPatch :
+	public IPatch
+{
+private:
+	std::size_t _width;
+	std::size_t _height;
+	std::vector<PatchControl> _controls;
+
+	std::string _shader;
+
+	bool _subdivisionsFixed;
+	Subdivisions _subdivisions;
+
+public:
+	HeadlessPatch();
+
+	void attachObserver(Observer* observer);
+	void detachObserver(Observer* observer);
+	void setDims(std::size_t width, std::size_t height);
+	std::size_t getWidth() const;
+	std::size_t getHeight() const;
+	PatchControl& ctrlAt(std::size_t row, std::size_t col);
+	const PatchControl& ctrlAt(std::size_t row, std::size_t col) const;
+	PatchMesh getTesselatedPatchMesh() const;
+	void insertColumns(std::size_t colIndex);
+	void insertRows(std::size_t rowIndex);
+	void removePoints(bool columns, std::size_t index);
+	void appendPoints(bool columns, bool beginning);
+	void controlPointsChanged();
+	bool isValid() const;
+	bool isDegenerate() const;
+	const std::string& getShader() const;
+	void setShader(const std::string& name);
+	bool hasVisibleMaterial() const;
+	bool subdivionsFixed() const;
+	Subdivisions getSubdivisions() const;
+	void setFixedSubdivisions(bool isFixed, const Subdivisions& divisions);
+};
+
+class HeadlessPatchNode :
+	public HeadlessNode,
+	public IPatchNode
+{
+private:
+	HeadlessPatch _patch;
+
+public:
+	HeadlessPatchNode();
+
+	// The editor's Patch class is not available, this throws std::logic_error
+	Patch& getPatchInternal();
+	IPatch& getPatch();
+};
+
+class HeadlessEntityClass :
+	public IEntityClass
+{
+private:
+	std::string _name;
+	bool _isLight;
+
+	// Returned for all attribute queries, there are no entityDefs
+	EntityClassAttribute _emptyAttribute;
+
+public:
+	HeadlessEntityClass(const std::string& name);
+
+	sigc::signal<void> changedSignal() const;
+	std::string getName() const;
+	const IEntityClass* getParent() const;
+	bool isLight() const;
+	bool isFixedSize() const;
+	AABB getBounds() const;
+	const Vector3& getColour() const;
+	const std::string& getWireShader() const;
+	const std::string& getFillShader() const;
+	EntityClassAttribute& getAttribute(const std::string& name);
+	const EntityClassAttribute& getAttribute(const std::string& name) const;
+	void forEachClassAttribute(std::function<void(const EntityClassAttribute&)> visitor, bool editorKeys) const;
+	const std::string& getModelPath() const;
+	const std::string& getSkin() const;
+	bool isOfType(const std::string& className);
+
+	// ModResource
+	std::string getModName() const;
+};
+
+class HeadlessKeyValue :
+	public EntityKeyValue
+{
+private:
+	std::string _value;
+
+public:
+	HeadlessKeyValue(const std::string& value);
+
+	const std::string& get() const;
+	void assign(const std::string& other);
+	void attach(KeyObserver& observer);
+	void detach(KeyObserver& observer);
+
+	// NameObserver
+	void onNameChange(const std::string& oldName, const std::string& newName);
+};
+
+class HeadlessEntity :
+	public Entity
+{
+private:
+	IEntityClassPtr _eclass;
+
+	// The spawnargs in insertion order, looked up case-insensitively
+	typedef std::shared_ptr<HeadlessKeyValue> HeadlessKeyValuePtr;
+	typedef std::vector<std::pair<std::string, HeadlessKeyValuePtr> > KeyValues;
+	KeyValues _keyValues;
+
+public:
+	HeadlessEntity(const IEntityClassPtr& eclass);
+
+	IEntityClassPtr getEntityClass() const;
+	void forEachKeyValue(Visitor& visitor) const;
+	void forEachKeyValue(KeyValueVisitor& visitor);
+	void setKeyValue(const std::string& key, const std::string& value);
+	std::string getKeyValue(const std::string& key) const;
+	bool isInherited(const std::string& key) const;
+	KeyValuePairs getKeyValuePairs(const std::string& prefix) const;
+	bool isModel() const;
+	bool isContainer() const;
+	void attachObserver(Observer* observer);
+	void detachObserver(Observer* observer);
+	bool isOfType(const std::string& className);
+
+private:
+	KeyValues::const_iterator find(const std::string& key) const;
+};
+
+class HeadlessEntityNode :
+	public HeadlessNode,
+	public IEntityNode
+{
+private:
+	HeadlessEntity _entity;
+
+public:
+	HeadlessEntityNode(const IEntityClassPtr& eclass);
+
+	Entity& getEntity();
+	void refreshModel();
+
+	// IRenderEntity
+	float getShaderParm(int parmNum) const;
+	const Vector3& getDirection() const;
+	const ShaderPtr& getWireShader() const;
+};
+
+class HeadlessBrushCreator :
+	public BrushCreator
+{
+public:
+	scene::INodePtr createBrush();
+
+	const std::string& getName() const;
+	const StringSet& getDependencies() const;
+	void initialiseModule(const ApplicationContext& ctx);
+};
+
+class HeadlessPatchCreator :
+	public PatchCreator
+{
+private:
+	std::string _name;
+
+public:
+	// The def type is either DEF2 or DEF3
+	HeadlessPatchCreator(const std::string& defType);
+
+	scene::INodePtr createPatch();
+
+	const std::string& getName() const;
+	const StringSet& getDependencies() const;
+	void initialiseModule(const ApplicationContext& ctx);
+};
+
+class HeadlessEntityCreator :
+	public EntityCreator
+{
+public:
+	IEntityNodePtr createEntity(const IEntityClassPtr& eclass);
+	void connectEntities(const scene::INodePtr& source, const scene::INodePtr& target);
+
+	const std::string& getName() const;
+	const StringSet& getDependencies() const;
+	void initialiseModule(const ApplicationContext& ctx);
+};
+
+/**
+ * Without entityDefs, every classname found in the map is accepted,
+ * all classes can hold brushes and patches.
+ */
+class HeadlessEntityClassManager :
+	public IEntityClassManager
+{
+private:
+	typedef std::map<std::string, IEntityClassPtr> EntityClasses;
+	mutable EntityClasses _classes;
+
+	sigc::signal<void> _defsReloadedSignal;
+
+public:
+	sigc::signal<void> defsReloadedSignal() const;
+	IEntityClassPtr findOrInsert(const std::string& name, bool has_brushes);
+	IEntityClassPtr findClass(const std::string& name) const;
+	void forEachEntityClass(EntityClassVisitor& visitor);
+	void realise();
+	void unrealise();
+	void reloadDefs();
+	IModelDefPtr findModel(const std::string& name) const;
+	void forEachModelDef(ModelDefVisitor& visitor);
+
+	const std::string& getName() const;
+	const StringSet& getDependencies() const;
+	void initialiseModule(const ApplicationContext& ctx);
+};
+
+// Models can't be loaded, so func_static models are not inlined
+class HeadlessModelCache :
+	public model::IModelCache
+{
+public:
+	scene::INodePtr getModelNode(const std::string& modelPath);
+	model::IModelPtr getModel(const std::string& modelPath);
+	ModelLoaderPtr getModelLoaderForType(const std::string& type);
+	void clear();
+
+	const std::string& getName() const;
+	const StringSet& getDependencies() const;
+	void initialiseModule(const ApplicationContext& ctx);
+};
+
+} // namespace
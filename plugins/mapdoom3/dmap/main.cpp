@@ -0,0 +1,102 @@
+/**
+ * Standalone dmap executable, compiling Doom 3 maps to .proc files without
+ * the editor. It doesn't need wxWidgets or an OpenGL context, such that maps
+ * can be compiled in batch on build machines:
+ *
+ * dmap [-basepath <path>]... [dmap options] <mapFile>
+ *
+ * The materials are read from the materials/ folder and the pk4 archives
+ * of each base path, the dmap options are the same as the ones of the
+ * editor's dmap command.
+ */
+#include "itextstream.h"
+#include "ibrush.h"
+#include "ipatch.h"
+
+#include <iostream>
+
+#include "HeadlessModules.h"
+#include "HeadlessScene.h"
+#include "HeadlessMaterials.h"
+#include "../compiler/DmapRunner.h"
+
+namespace
+{
+
+void printUsage()
+{
+	std::cerr << "Usage: dmap [-basepath <path>]... " << map::DmapOptions::ArgumentSyntax() << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	dmap::HeadlessContext context(argc, argv);
+
+	// Separate our own options from the ones of the compiler
+	std::vector<std::string> basePaths;
+	std::vector<std::string> dmapArgs;
+
+	const ApplicationContext::ArgumentList& args = context.getCmdLineArgs();
+
+	for (std::size_t i = 0; i < args.size(); ++i)
+	{
+		if (args[i] == "-basepath")
+		{
+			if (i + 1 >= args.size())
+			{
+				printUsage();
+				return 1;
+			}
+
+			basePaths.push_back(args[++i]);
+		}
+		else
+		{
+			dmapArgs.push_back(args[i]);
+		}
+	}
+
+	map::DmapOptions options;
+	std::string mapFile;
+
+	if (!options.parseArguments(dmapArgs, mapFile))
+	{
+		printUsage();
+		return 1;
+	}
+
+	if (basePaths.empty())
+	{
+		basePaths.push_back("./");
+	}
+
+	module::initialiseStreams(context);
+
+	dmap::HeadlessModuleRegistry registry(context);
+	module::RegistryReference::Instance().setRegistry(registry);
+
+	registry.registerModule(RegisterableModulePtr(new dmap::HeadlessMaterialManager(basePaths)));
+	registry.registerModule(RegisterableModulePtr(new dmap::HeadlessBrushCreator));
+	registry.registerModule(RegisterableModulePtr(new dmap::HeadlessPatchCreator(DEF2)));
+	registry.registerModule(RegisterableModulePtr(new dmap::HeadlessPatchCreator(DEF3)));
+	registry.registerModule(RegisterableModulePtr(new dmap::HeadlessEntityCreator));
+	registry.registerModule(RegisterableModulePtr(new dmap::HeadlessEntityClassManager));
+	registry.registerModule(RegisterableModulePtr(new dmap::HeadlessModelCache));
+
+	registry.initialiseModules();
+
+	bool success = false;
+
+	{
+		map::DmapRunner runner;
+		runner.setOptions(options);
+
+		success = runner.run(mapFile);
+	}
+
+	registry.shutdownModules();
+
+	return success ? 0 : 1;
+}
@@ -0,0 +1,213 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE procFileTest
+#include <boost/test/unit_test.hpp>
+
+#include <boost/filesystem.hpp>
+#include "plugins/mapdoom3/compiler/ProcFileLoader.h"
+#include "plugins/mapdoom3/compiler/ProcFile.h"
+
+using namespace map;
+
+namespace
+{
+    // All values are exactly representable as 32 bit floats and with six
+    // decimals, such that both formats have to reproduce them exactly
+    ProcFileContents createContents()
+    {
+        ProcFileContents contents;
+
+        ProcFileContents::Model model;
+        model.name = "_area0";
+
+        ProcFileContents::ModelSurface surface;
+        surface.material = "textures/common/caulk";
+
+        for (int i = 0; i < 4; ++i)
+        {
+            ArbitraryMeshVertex v;
+            v.vertex = Vector3(i * 64, -i * 32.5, 128.25);
+            v.texcoord = Vector2(i * 0.5, -i * 0.125);
+            v.normal = Vector3(0, 0, 1);
+            surface.surface.vertices.push_back(v);
+        }
+
+        int indices[] = { 0, 1, 2, 0, 2, 3 };
+        surface.surface.indices.assign(indices, indices + 6);
+
+        model.surfaces.push_back(surface);
+        contents.models.push_back(model);
+
+        contents.numAreas = 2;
+
+        ProcFileContents::Portal portal;
+        portal.area0 = 0;
+        portal.area1 = 1;
+        portal.winding = ProcWinding(Vector3(0, 0, 0), Vector3(0, 256, 0), Vector3(0, 256, 128));
+        contents.portals.push_back(portal);
+
+        ProcFileContents::Node node;
+        node.plane = Plane3(1, 0, 0, -16.5);
+        node.children[0] = -1;
+        node.children[1] = -2;
+        contents.nodes.push_back(node);
+
+        ProcFileContents::ShadowModel shadowModel;
+        shadowModel.name = "_prelight_light_1";
+
+        for (int i = 0; i < 6; ++i)
+        {
+            shadowModel.surface.shadowVertices.push_back(Vector4(i * 8, i * -4, 1.5, 1));
+        }
+
+        int shadowIndices[] = { 0, 1, 2, 3, 4, 5 };
+        shadowModel.surface.indices.assign(shadowIndices, shadowIndices + 6);
+        shadowModel.surface.numShadowIndicesNoCaps = 3;
+        shadowModel.surface.numShadowIndicesNoFrontCaps = 6;
+        shadowModel.surface.shadowCapPlaneBits = 5;
+
+        contents.shadowModels.push_back(shadowModel);
+
+        return contents;
+    }
+
+    ProcFileContentsPtr writeAndLoad(const ProcFileContents& contents, ProcFileWriter& writer,
+                                     const std::string& path)
+    {
+        BOOST_REQUIRE(writer.isOpen());
+
+        contents.writeTo(writer);
+        writer.finish();
+
+        return ProcFileLoader::loadFile(path);
+    }
+
+    void checkEqual(const ProcFileContents& a, const ProcFileContents& b)
+    {
+        BOOST_REQUIRE_EQUAL(a.models.size(), b.models.size());
+
+        for (std::size_t m = 0; m < a.models.size(); ++m)
+        {
+            BOOST_CHECK_EQUAL(a.models[m].name, b.models[m].name);
+            BOOST_REQUIRE_EQUAL(a.models[m].surfaces.size(), b.models[m].surfaces.size());
+
+            for (std::size_t s = 0; s < a.models[m].surfaces.size(); ++s)
+            {
+                const ProcFileContents::ModelSurface& sa = a.models[m].surfaces[s];
+                const ProcFileContents::ModelSurface& sb = b.models[m].surfaces[s];
+
+                BOOST_CHECK_EQUAL(sa.material, sb.material);
+                BOOST_REQUIRE_EQUAL(sa.surface.vertices.size(), sb.surface.vertices.size());
+
+                for (std::size_t v = 0; v < sa.surface.vertices.size(); ++v)
+                {
+                    BOOST_CHECK_EQUAL(sa.surface.vertices[v].vertex, sb.surface.vertices[v].vertex);
+                    BOOST_CHECK_EQUAL(sa.surface.vertices[v].texcoord, sb.surface.vertices[v].texcoord);
+                    BOOST_CHECK_EQUAL(sa.surface.vertices[v].normal, sb.surface.vertices[v].normal);
+                }
+
+                BOOST_CHECK(sa.surface.indices == sb.surface.indices);
+            }
+        }
+
+        BOOST_CHECK_EQUAL(a.numAreas, b.numAreas);
+        BOOST_REQUIRE_EQUAL(a.portals.size(), b.portals.size());
+
+        for (std::size_t p = 0; p < a.portals.size(); ++p)
+        {
+            BOOST_CHECK_EQUAL(a.portals[p].area0, b.portals[p].area0);
+            BOOST_CHECK_EQUAL(a.portals[p].area1, b.portals[p].area1);
+            BOOST_REQUIRE_EQUAL(a.portals[p].winding.size(), b.portals[p].winding.size());
+
+            for (std::size_t i = 0; i < a.portals[p].winding.size(); ++i)
+            {
+                BOOST_CHECK_EQUAL(a.portals[p].winding[i].vertex, b.portals[p].winding[i].vertex);
+            }
+        }
+
+        BOOST_REQUIRE_EQUAL(a.nodes.size(), b.nodes.size());
+
+        for (std::size_t n = 0; n < a.nodes.size(); ++n)
+        {
+            BOOST_CHECK_EQUAL(a.nodes[n].plane, b.nodes[n].plane);
+            BOOST_CHECK_EQUAL(a.nodes[n].children[0], b.nodes[n].children[0]);
+            BOOST_CHECK_EQUAL(a.nodes[n].children[1], b.nodes[n].children[1]);
+        }
+
+        BOOST_REQUIRE_EQUAL(a.shadowModels.size(), b.shadowModels.size());
+
+        for (std::size_t s = 0; s < a.shadowModels.size(); ++s)
+        {
+            const Surface& sa = a.shadowModels[s].surface;
+            const Surface& sb = b.shadowModels[s].surface;
+
+            BOOST_CHECK_EQUAL(a.shadowModels[s].name, b.shadowModels[s].name);
+            BOOST_CHECK_EQUAL(sa.numShadowIndicesNoCaps, sb.numShadowIndicesNoCaps);
+            BOOST_CHECK_EQUAL(sa.numShadowIndicesNoFrontCaps, sb.numShadowIndicesNoFrontCaps);
+            BOOST_CHECK_EQUAL(sa.shadowCapPlaneBits, sb.shadowCapPlaneBits);
+            BOOST_CHECK(sa.shadowVertices == sb.shadowVertices);
+            BOOST_CHECK(sa.indices == sb.indices);
+        }
+    }
+
+    // Removes the files written by a test case
+    struct TempFiles
+    {
+        std::string text;
+        std::string binary;
+
+        TempFiles()
+        {
+            boost::filesystem::path base = boost::filesystem::temp_directory_path() /
+                boost::filesystem::unique_path("procFileTest-%%%%-%%%%");
+
+            text = base.string() + ProcFile::Extension();
+            binary = base.string() + ProcFile::BinaryExtension();
+        }
+
+        ~TempFiles()
+        {
+            boost::system::error_code ec;
+            boost::filesystem::remove(text, ec);
+            boost::filesystem::remove(binary, ec);
+        }
+    };
+}
+
+BOOST_AUTO_TEST_CASE(textAndBinaryRoundTrip)
+{
+    TempFiles files;
+    ProcFileContents contents = createContents();
+
+    ProcTextWriter textWriter(files.text);
+    ProcFileContentsPtr fromText = writeAndLoad(contents, textWriter, files.text);
+
+    ProcBinaryWriter binaryWriter(files.binary);
+    ProcFileContentsPtr fromBinary = writeAndLoad(contents, binaryWriter, files.binary);
+
+    BOOST_REQUIRE(fromText);
+    BOOST_REQUIRE(fromBinary);
+
+    checkEqual(contents, *fromText);
+    checkEqual(contents, *fromBinary);
+    checkEqual(*fromText, *fromBinary);
+}
+
+BOOST_AUTO_TEST_CASE(singleAreaRoundTrip)
+{
+    TempFiles files;
+    ProcFileContents contents = createContents();
+
+    // Worlds without nodes don't write any portals either
+    contents.numAreas = 0;
+    contents.portals.clear();
+    contents.nodes.clear();
+
+    ProcTextWriter textWriter(files.text);
+    ProcFileContentsPtr fromText = writeAndLoad(contents, textWriter, files.text);
+
+    ProcBinaryWriter binaryWriter(files.binary);
+    ProcFileContentsPtr fromBinary = writeAndLoad(contents, binaryWriter, files.binary);
+
+    checkEqual(contents, *fromText);
+    checkEqual(contents, *fromBinary);
+}
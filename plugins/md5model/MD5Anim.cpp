@@ -2,6 +2,7 @@
 
 #include "itextstream.h"
 #include "string/convert.h"
+#include "parser/BufferDefTokeniser.h"
 
 namespace md5
 {
@@ -135,7 +136,7 @@ void MD5Anim::parseFrame(std::size_t frame, parser::DefTokeniser& tok)
 
 void MD5Anim::parseFromStream(std::istream& stream)
 {
-	parser::BasicDefTokeniser<std::istream> tokeniser(stream);
+	parser::BufferDefTokeniser tokeniser(stream);
 	parseFromTokens(tokeniser);
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 #include "math/Vector3.h"
 #include "math/Quaternion.h"
 
@@ -7,6 +7,7 @@
 #include "ifiletypes.h"
 #include "archivelib.h"
 #include "os/path.h"
+#include "parser/BufferDefTokeniser.h"
 
 #include "MD5ModelNode.h"
 
@@ -78,7 +79,7 @@ model::IModelPtr MD5ModelLoader::loadModelFromPath(const std::string& name)
 		try
 		{
 			std::istream is(&inputStream);
-			parser::BasicDefTokeniser<std::istream> tokeniser(is);
+			parser::BufferDefTokeniser tokeniser(is);
 
 			// Invoke the parser routine (might throw)
 			model->parseFromTokens(tokeniser);
@@ -55,6 +55,7 @@ public:
 
 	// LitObject implementation
 	bool intersectsLight(const RendererLight& light) const;
+	const AABB& getLitObjectBounds() const;
 	void insertLight(const RendererLight& light);
 	void clearLights();
 
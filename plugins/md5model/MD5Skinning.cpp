@@ -0,0 +1,234 @@
+#include "MD5Skinning.h"
+
+#include "MD5Skeleton.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MD5_SKINNING_USE_SSE2
+#endif
+
+namespace md5
+{
+
+namespace
+{
+	inline void setColumn(float* column, const Vector3& vector)
+	{
+		column[0] = static_cast<float>(vector.x());
+		column[1] = static_cast<float>(vector.y());
+		column[2] = static_cast<float>(vector.z());
+		column[3] = 0;
+	}
+
+	// Joints not defined by the pose (e.g. an animation with fewer joints) stay at the origin
+	inline void fillMissingJoints(MD5JointMatrices& matrices, std::size_t numDefinedJoints)
+	{
+		for (std::size_t i = numDefinedJoints; i < matrices.size(); ++i)
+		{
+			matrices[i].set(Quaternion::Identity(), Vector3(0, 0, 0));
+		}
+	}
+}
+
+void MD5JointMatrix::set(const Quaternion& orientation, const Vector3& origin)
+{
+	// The rotation is linear, its columns are the transformed unit axes
+	setColumn(columns[0], orientation.transformPoint(Vector3(1, 0, 0)));
+	setColumn(columns[1], orientation.transformPoint(Vector3(0, 1, 0)));
+	setColumn(columns[2], orientation.transformPoint(Vector3(0, 0, 1)));
+	setColumn(columns[3], origin);
+}
+
+MD5SkinningData::MD5SkinningData(const MD5Mesh& mesh) :
+	_numVertices(mesh.vertices.size()),
+	_numJoints(0)
+{
+	if (_numVertices == 0) return;
+
+	// Sort the vertices by their number of weights, to keep the padding small
+	std::vector<uint32_t> order(_numVertices);
+
+	for (std::size_t i = 0; i < _numVertices; ++i)
+	{
+		order[i] = static_cast<uint32_t>(i);
+	}
+
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+	{
+		return mesh.vertices[a].weight_count < mesh.vertices[b].weight_count;
+	});
+
+	std::size_t numBlocks = (_numVertices + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+	_vertexOrder.reserve(numBlocks * BLOCK_SIZE);
+	_firstSlot.reserve(numBlocks + 1);
+
+	for (std::size_t block = 0; block < numBlocks; ++block)
+	{
+		_firstSlot.push_back(static_cast<uint32_t>(_joints.size() / BLOCK_SIZE));
+
+		// Lanes past the last vertex repeat it, their results are discarded
+		const MD5Vert* lanes[BLOCK_SIZE];
+		std::size_t numSlots = 0;
+
+		for (std::size_t lane = 0; lane < BLOCK_SIZE; ++lane)
+		{
+			uint32_t index = order[std::min(block * BLOCK_SIZE + lane, _numVertices - 1)];
+
+			_vertexOrder.push_back(index);
+			lanes[lane] = &mesh.vertices[index];
+			numSlots = std::max(numSlots, lanes[lane]->weight_count);
+		}
+
+		for (std::size_t slot = 0; slot < numSlots; ++slot)
+		{
+			for (std::size_t lane = 0; lane < BLOCK_SIZE; ++lane)
+			{
+				if (slot >= lanes[lane]->weight_count)
+				{
+					// Padding, a zero weight of the first joint
+					_joints.push_back(0);
+					_x.push_back(0);
+					_y.push_back(0);
+					_z.push_back(0);
+					_t.push_back(0);
+					continue;
+				}
+
+				const MD5Weight& weight = mesh.weights[lanes[lane]->weight_index + slot];
+
+				_joints.push_back(static_cast<uint32_t>(weight.joint));
+				_x.push_back(static_cast<float>(weight.v.x() * weight.t));
+				_y.push_back(static_cast<float>(weight.v.y() * weight.t));
+				_z.push_back(static_cast<float>(weight.v.z() * weight.t));
+				_t.push_back(weight.t);
+
+				_numJoints = std::max(_numJoints, weight.joint + 1);
+			}
+		}
+	}
+
+	_firstSlot.push_back(static_cast<uint32_t>(_joints.size() / BLOCK_SIZE));
+
+	// The padding refers to the first joint
+	_numJoints = std::max<std::size_t>(_numJoints, 1);
+}
+
+void MD5SkinningData::getJointMatrices(const MD5Joints& joints, MD5JointMatrices& matrices) const
+{
+	matrices.resize(_numJoints);
+
+	std::size_t numDefined = std::min(joints.size(), _numJoints);
+
+	for (std::size_t i = 0; i < numDefined; ++i)
+	{
+		matrices[i].set(joints[i].rotation, joints[i].position);
+	}
+
+	fillMissingJoints(matrices, numDefined);
+}
+
+void MD5SkinningData::getJointMatrices(const MD5Skeleton& skeleton, MD5JointMatrices& matrices) const
+{
+	matrices.resize(_numJoints);
+
+	std::size_t numDefined = std::min(skeleton.size(), _numJoints);
+
+	for (std::size_t i = 0; i < numDefined; ++i)
+	{
+		const IMD5Anim::Key& key = skeleton.getKey(i);
+		matrices[i].set(key.orientation, key.origin);
+	}
+
+	fillMissingJoints(matrices, numDefined);
+}
+
+void MD5SkinningData::skin(const MD5JointMatrices& matrices, ArbitraryMeshVertex* vertices) const
+{
+	if (_numVertices == 0) return;
+
+	const MD5JointMatrix* joints = &matrices.front();
+	std::size_t numBlocks = _firstSlot.size() - 1;
+
+	for (std::size_t block = 0; block < numBlocks; ++block)
+	{
+		float resultX[BLOCK_SIZE];
+		float resultY[BLOCK_SIZE];
+		float resultZ[BLOCK_SIZE];
+
+#ifdef MD5_SKINNING_USE_SSE2
+		__m128 sumX = _mm_setzero_ps();
+		__m128 sumY = _mm_setzero_ps();
+		__m128 sumZ = _mm_setzero_ps();
+
+		for (std::size_t slot = _firstSlot[block]; slot < _firstSlot[block + 1]; ++slot)
+		{
+			std::size_t w = slot * BLOCK_SIZE;
+
+			const MD5JointMatrix& joint0 = joints[_joints[w]];
+			const MD5JointMatrix& joint1 = joints[_joints[w + 1]];
+			const MD5JointMatrix& joint2 = joints[_joints[w + 2]];
+			const MD5JointMatrix& joint3 = joints[_joints[w + 3]];
+
+			// The weighted position of each lane, times the matching matrix column
+			__m128 factors[4] =
+			{
+				_mm_loadu_ps(&_x[w]),
+				_mm_loadu_ps(&_y[w]),
+				_mm_loadu_ps(&_z[w]),
+				_mm_loadu_ps(&_t[w])
+			};
+
+			for (std::size_t c = 0; c < 4; ++c)
+			{
+				// Transpose the column of the four joints into per-component registers
+				__m128 x = _mm_loadu_ps(joint0.columns[c]);
+				__m128 y = _mm_loadu_ps(joint1.columns[c]);
+				__m128 z = _mm_loadu_ps(joint2.columns[c]);
+				__m128 unused = _mm_loadu_ps(joint3.columns[c]);
+
+				_MM_TRANSPOSE4_PS(x, y, z, unused);
+
+				sumX = _mm_add_ps(sumX, _mm_mul_ps(x, factors[c]));
+				sumY = _mm_add_ps(sumY, _mm_mul_ps(y, factors[c]));
+				sumZ = _mm_add_ps(sumZ, _mm_mul_ps(z, factors[c]));
+			}
+		}
+
+		_mm_storeu_ps(resultX, sumX);
+		_mm_storeu_ps(resultY, sumY);
+		_mm_storeu_ps(resultZ, sumZ);
+#else
+		for (std::size_t lane = 0; lane < BLOCK_SIZE; ++lane)
+		{
+			resultX[lane] = resultY[lane] = resultZ[lane] = 0;
+		}
+
+		for (std::size_t slot = _firstSlot[block]; slot < _firstSlot[block + 1]; ++slot)
+		{
+			for (std::size_t lane = 0; lane < BLOCK_SIZE; ++lane)
+			{
+				std::size_t w = slot * BLOCK_SIZE + lane;
+				const MD5JointMatrix& joint = joints[_joints[w]];
+
+				resultX[lane] += joint.columns[0][0] * _x[w] + joint.columns[1][0] * _y[w] +
+					joint.columns[2][0] * _z[w] + joint.columns[3][0] * _t[w];
+				resultY[lane] += joint.columns[0][1] * _x[w] + joint.columns[1][1] * _y[w] +
+					joint.columns[2][1] * _z[w] + joint.columns[3][1] * _t[w];
+				resultZ[lane] += joint.columns[0][2] * _x[w] + joint.columns[1][2] * _y[w] +
+					joint.columns[2][2] * _z[w] + joint.columns[3][2] * _t[w];
+			}
+		}
+#endif
+
+		// Lanes repeating the last vertex write the same result again
+		for (std::size_t lane = 0; lane < BLOCK_SIZE; ++lane)
+		{
+			vertices[_vertexOrder[block * BLOCK_SIZE + lane]].vertex =
+				Vertex3f(resultX[lane], resultY[lane], resultZ[lane]);
+		}
+	}
+}
+
+} // namespace
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+#include "MD5DataStructures.h"
+#include "render/ArbitraryMeshVertex.h"
+
+namespace md5
+{
+
+class MD5Skeleton;
+
+/**
+ * The transformation of a single joint, stored as four float columns
+ * (the rotation axes and the origin) padded to four components each,
+ * such that a column can be loaded into a single SSE register.
+ */
+struct MD5JointMatrix
+{
+	float columns[4][4];
+
+	// Construct the matrix from the given joint orientation and origin
+	void set(const Quaternion& orientation, const Vector3& origin);
+};
+
+typedef std::vector<MD5JointMatrix> MD5JointMatrices;
+
+/**
+ * The bind-pose weights of an MD5Mesh, re-arranged for skinning.
+ *
+ * Each weight position is pre-multiplied with its influence. This reduces
+ * a single weight to one matrix-vector product, the skinned position of a
+ * vertex is the sum of its weights:
+ *
+ *   vertex = sum(rotation * (v * t) + origin * t)
+ *
+ * The vertices are skinned in blocks of four, one vertex per SIMD lane.
+ * They are sorted by their number of weights, such that the vertices of a
+ * block have about the same number of weights. A block stores one slot per
+ * weight of its largest vertex, each slot holding one weight of all four
+ * vertices in structure of arrays layout. Lanes without a weight in a slot
+ * are padded with zero weights, the lanes of the last block beyond the end
+ * of the mesh repeat its last vertex.
+ *
+ * The data is built once per mesh and can be shared by all surfaces
+ * using that mesh.
+ */
+class MD5SkinningData
+{
+private:
+	static const std::size_t BLOCK_SIZE = 4;
+
+	// Per slot and lane: the joint index, the weighted position and the weight itself
+	std::vector<uint32_t> _joints;
+	std::vector<float> _x;
+	std::vector<float> _y;
+	std::vector<float> _z;
+	std::vector<float> _t;
+
+	// Per block: the index of its first slot, with an extra element
+	// marking the end of the last block's slots
+	std::vector<uint32_t> _firstSlot;
+
+	// Per lane: the index of the mesh vertex skinned in it
+	std::vector<uint32_t> _vertexOrder;
+
+	std::size_t _numVertices;
+
+	// The number of joints referenced by the weights
+	std::size_t _numJoints;
+
+public:
+	MD5SkinningData(const MD5Mesh& mesh);
+
+	std::size_t getNumVertices() const
+	{
+		return _numVertices;
+	}
+
+	// Fills the matrices with the joints of the default pose defined in the .md5mesh
+	void getJointMatrices(const MD5Joints& joints, MD5JointMatrices& matrices) const;
+
+	// Fills the matrices with the current joint positions of the given skeleton
+	void getJointMatrices(const MD5Skeleton& skeleton, MD5JointMatrices& matrices) const;
+
+	/**
+	 * Calculates the skinned vertex positions for the given joint matrices
+	 * and writes them to the vertex member of the given array, which needs
+	 * to have getNumVertices() elements.
+	 */
+	void skin(const MD5JointMatrices& matrices, ArbitraryMeshVertex* vertices) const;
+};
+
+} // namespace
@@ -5,6 +5,8 @@
 #include "string/convert.h"
 #include "MD5Model.h"
 #include "math/Ray.h"
+#include <cstddef>
+#include <stdint.h>
 
 namespace md5
 {
@@ -14,28 +16,58 @@ inline VertexPointer vertexpointer_arbitrarymeshvertex(const ArbitraryMeshVertex
   return VertexPointer(&array->vertex, sizeof(ArbitraryMeshVertex));
 }
 
+namespace
+{
+	inline void copyVector(float* dest, const Vector3& source)
+	{
+		dest[0] = static_cast<float>(source.x());
+		dest[1] = static_cast<float>(source.y());
+		dest[2] = static_cast<float>(source.z());
+	}
+
+	// Returns the given offset as pointer into the bound buffer (or client-side array)
+	inline const GLvoid* bufferOffset(const void* base, std::size_t memberOffset)
+	{
+		return reinterpret_cast<const GLvoid*>(reinterpret_cast<uintptr_t>(base) + memberOffset);
+	}
+}
+
 // Constructor
 MD5Surface::MD5Surface() : 
 	_originalShaderName(""),
 	_mesh(new MD5Mesh),
-	_normalList(0),
-	_lightingList(0)
+	_vertexBuffer(0),
+	_indexBuffer(0),
+	_vertexBufferSize(0),
+	_vertexBufferNeedsUpdate(true),
+	_indexBufferNeedsUpdate(true)
 {}
 
 MD5Surface::MD5Surface(const MD5Surface& other) :
 	_aabb_local(other._aabb_local),
 	_originalShaderName(other._originalShaderName),
 	_mesh(other._mesh),
-	_normalList(0),
-	_lightingList(0)
+	_skinningData(other._skinningData),
+	_vertexBuffer(0),
+	_indexBuffer(0),
+	_vertexBufferSize(0),
+	_vertexBufferNeedsUpdate(true),
+	_indexBufferNeedsUpdate(true)
 {}
 
 // Destructor
 MD5Surface::~MD5Surface()
 {
-	// Release GL display lists
-	glDeleteLists(_normalList, 1);
-	glDeleteLists(_lightingList, 1);
+	// Release the GL buffer objects
+	if (_vertexBuffer != 0)
+	{
+		glDeleteBuffers(1, &_vertexBuffer);
+	}
+
+	if (_indexBuffer != 0)
+	{
+		glDeleteBuffers(1, &_indexBuffer);
+	}
 }
 
 // Update geometry
@@ -67,74 +99,128 @@ void MD5Surface::updateGeometry()
 		i->bitangent.normalise();
 	}
 
-	// Build the display lists
-	createDisplayLists();
+	updateRenderVertices();
 }
 
-// Back-end render
-void MD5Surface::render(const RenderInfo& info) const
+void MD5Surface::updateRenderVertices()
 {
-	if (info.checkFlag(RENDER_BUMP))
-    {
-		glCallList(_lightingList);
-	}
-	else
-    {
-		glCallList(_normalList);
+	_renderVertices.resize(_vertices.size());
+
+	for (std::size_t i = 0; i < _vertices.size(); ++i)
+	{
+		const ArbitraryMeshVertex& source = _vertices[i];
+		RenderVertex& dest = _renderVertices[i];
+
+		copyVector(dest.vertex, source.vertex);
+		dest.texcoord[0] = static_cast<float>(source.texcoord.x());
+		dest.texcoord[1] = static_cast<float>(source.texcoord.y());
+		copyVector(dest.tangent, source.tangent);
+		copyVector(dest.bitangent, source.bitangent);
+		copyVector(dest.normal, source.normal);
 	}
+
+	_vertexBufferNeedsUpdate = true;
 }
 
-// Construct the display lists
-void MD5Surface::createDisplayLists()
+bool MD5Surface::bindBuffers() const
 {
-	// Create the list for lighting mode
-	_lightingList = glGenLists(1);
-	assert(_lightingList != 0);
-	glNewList(_lightingList, GL_COMPILE);
+	if (!GLEW_VERSION_1_5)
+	{
+		return false;
+	}
 
-	glBegin(GL_TRIANGLES);
-	for (Indices::const_iterator i = _indices.begin();
-		 i != _indices.end();
-		 ++i)
+	if (_vertexBuffer == 0)
 	{
-		// Get the vertex for this index
-		ArbitraryMeshVertex& v = _vertices[*i];
-
-		// Submit the vertex attributes and coordinate
-		if (GLEW_ARB_vertex_program) {
-			// Submit the vertex attributes and coordinate
-			glVertexAttrib2dvARB(ATTR_TEXCOORD, v.texcoord);
-			glVertexAttrib3dvARB(ATTR_TANGENT, v.tangent);
-			glVertexAttrib3dvARB(ATTR_BITANGENT, v.bitangent);
-			glVertexAttrib3dvARB(ATTR_NORMAL, v.normal);
+		glGenBuffers(1, &_vertexBuffer);
+		glGenBuffers(1, &_indexBuffer);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+
+	if (_vertexBufferNeedsUpdate)
+	{
+		_vertexBufferNeedsUpdate = false;
+
+		GLsizeiptr size = _renderVertices.size() * sizeof(RenderVertex);
+
+		if (_vertexBufferSize != _renderVertices.size())
+		{
+			// Allocate the storage once, pose changes are streamed into it
+			_vertexBufferSize = _renderVertices.size();
+			glBufferData(GL_ARRAY_BUFFER, size, &_renderVertices.front(), GL_DYNAMIC_DRAW);
+		}
+		else
+		{
+			glBufferSubData(GL_ARRAY_BUFFER, 0, size, &_renderVertices.front());
 		}
-		glVertex3dv(v.vertex);
 	}
-	glEnd();
 
-	glEndList();
+	if (_indexBufferNeedsUpdate)
+	{
+		_indexBufferNeedsUpdate = false;
 
-	// Generate the list for flat-shaded (unlit) mode
-	_normalList = glGenLists(1);
-	assert(_normalList != 0);
-	glNewList(_normalList, GL_COMPILE);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indices.size() * sizeof(RenderIndex),
+			&_indices.front(), GL_STATIC_DRAW);
+	}
 
-	glBegin(GL_TRIANGLES);
-	for (Indices::const_iterator i = _indices.begin();
-		 i != _indices.end();
-		 ++i)
+	return true;
+}
+
+// Back-end render
+void MD5Surface::render(const RenderInfo& info) const
+{
+	if (_indices.empty() || _renderVertices.empty())
 	{
-		// Get the vertex for this index
-		ArbitraryMeshVertex& v = _vertices[*i];
+		return;
+	}
+
+	// The attribute pointers are offsets into the buffers if they could be bound,
+	// otherwise they point to the client-side arrays
+	bool useBuffers = bindBuffers();
+
+	const void* vertexBase = useBuffers ? NULL : &_renderVertices.front();
+	const void* indexBase = useBuffers ? NULL : &_indices.front();
 
-		// Submit attributes
-		glNormal3dv(v.normal);
-		glTexCoord2dv(v.texcoord);
-		glVertex3dv(v.vertex);
+	// Our vertex colours are always white, if requested
+	glDisableClientState(GL_COLOR_ARRAY);
+	if (info.checkFlag(RENDER_VERTEX_COLOUR))
+	{
+		glColor3f(1, 1, 1);
 	}
-	glEnd();
 
-	glEndList();
+	const GLsizei stride = sizeof(RenderVertex);
+
+	glVertexPointer(3, GL_FLOAT, stride, bufferOffset(vertexBase, offsetof(RenderVertex, vertex)));
+
+	if (info.checkFlag(RENDER_BUMP))
+	{
+		glVertexAttribPointer(ATTR_NORMAL, 3, GL_FLOAT, 0, stride, bufferOffset(vertexBase, offsetof(RenderVertex, normal)));
+		glVertexAttribPointer(ATTR_TEXCOORD, 2, GL_FLOAT, 0, stride, bufferOffset(vertexBase, offsetof(RenderVertex, texcoord)));
+		glVertexAttribPointer(ATTR_TANGENT, 3, GL_FLOAT, 0, stride, bufferOffset(vertexBase, offsetof(RenderVertex, tangent)));
+		glVertexAttribPointer(ATTR_BITANGENT, 3, GL_FLOAT, 0, stride, bufferOffset(vertexBase, offsetof(RenderVertex, bitangent)));
+	}
+	else
+	{
+		if (info.checkFlag(RENDER_LIGHTING))
+		{
+			glNormalPointer(GL_FLOAT, stride, bufferOffset(vertexBase, offsetof(RenderVertex, normal)));
+		}
+
+		if (info.checkFlag(RENDER_TEXTURE_2D))
+		{
+			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+			glTexCoordPointer(2, GL_FLOAT, stride, bufferOffset(vertexBase, offsetof(RenderVertex, texcoord)));
+		}
+	}
+
+	glDrawElements(GL_TRIANGLES, GLsizei(_indices.size()), GL_UNSIGNED_INT, indexBase);
+
+	if (useBuffers)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
 }
 
 // Selection test
@@ -249,29 +335,23 @@ const std::string& MD5Surface::getDefaultMaterial() const
 	return _originalShaderName;
 }
 
-void MD5Surface::updateToDefaultPose(const MD5Joints& joints)
+void MD5Surface::skinVertices(const MD5JointMatrices& matrices)
 {
+	// Ensure we have all vertices allocated
 	if (_vertices.size() != _mesh->vertices.size())
 	{
 		_vertices.resize(_mesh->vertices.size());
 	}
 
-	for (std::size_t j = 0; j < _mesh->vertices.size(); ++j)
+	if (!_vertices.empty())
 	{
-		MD5Vert& vert = _mesh->vertices[j];
-
-		Vector3 skinned(0, 0, 0);
-
-		for (std::size_t k = 0; k != vert.weight_count; ++k)
-		{
-			MD5Weight& weight = _mesh->weights[vert.weight_index + k];
-			const MD5Joint& joint = joints[weight.joint];
+		_skinningData->skin(matrices, &_vertices.front());
+	}
 
-			Vector3 rotatedPoint = joint.rotation.transformPoint(weight.v);
-			skinned += (rotatedPoint + joint.position) * weight.t;
-		}
+	for (std::size_t j = 0; j < _mesh->vertices.size(); ++j)
+	{
+		const MD5Vert& vert = _mesh->vertices[j];
 
-		_vertices[j].vertex = skinned;
 		_vertices[j].texcoord = TexCoord2f(vert.u, vert.v);
 		_vertices[j].normal = Normal3f(0,0,0);
 	}
@@ -287,45 +367,29 @@ void MD5Surface::updateToDefaultPose(const MD5Joints& joints)
 	updateGeometry();
 }
 
-void MD5Surface::updateToSkeleton(const MD5Skeleton& skeleton)
+void MD5Surface::updateToDefaultPose(const MD5Joints& joints)
 {
-	// Ensure we have all vertices allocated
-	if (_vertices.size() != _mesh->vertices.size())
+	if (!_skinningData)
 	{
-		_vertices.resize(_mesh->vertices.size());
+		_skinningData.reset(new MD5SkinningData(*_mesh));
 	}
 
-	// Deform vertices to fit the skeleton
-	for (std::size_t j = 0; j < _mesh->vertices.size(); ++j)
-	{
-		MD5Vert& vert = _mesh->vertices[j];
+	_skinningData->getJointMatrices(joints, _jointMatrices);
 
-		Vector3 skinned(0, 0, 0);
-
-		for (std::size_t k = 0; k != vert.weight_count; ++k)
-		{
-			MD5Weight& weight = _mesh->weights[vert.weight_index + k];
-			const IMD5Anim::Key& key = skeleton.getKey(weight.joint);
-			//const Joint& joint = skeleton.getJoint(weight.joint);
-
-			Vector3 rotatedPoint = key.orientation.transformPoint(weight.v);
-			skinned += (rotatedPoint + key.origin) * weight.t;
-		}
-
-		_vertices[j].vertex = skinned;
-		_vertices[j].texcoord = TexCoord2f(vert.u, vert.v);
-		_vertices[j].normal = Normal3f(0,0,0);
-	}
+	skinVertices(_jointMatrices);
+}
 
-	// Ensure the index array is ok
-	if (_indices.empty())
+void MD5Surface::updateToSkeleton(const MD5Skeleton& skeleton)
+{
+	if (!_skinningData)
 	{
-		buildIndexArray();
+		_skinningData.reset(new MD5SkinningData(*_mesh));
 	}
 
-	buildVertexNormals();
+	// Deform vertices to fit the skeleton
+	_skinningData->getJointMatrices(skeleton, _jointMatrices);
 
-	updateGeometry();
+	skinVertices(_jointMatrices);
 }
 
 void MD5Surface::buildVertexNormals()
@@ -363,6 +427,8 @@ void MD5Surface::buildIndexArray()
 		_indices.push_back(static_cast<RenderIndex>(tri.b));
 		_indices.push_back(static_cast<RenderIndex>(tri.c));
 	}
+
+	_indexBufferNeedsUpdate = true;
 }
 
 void MD5Surface::parseFromTokens(parser::DefTokeniser& tok)
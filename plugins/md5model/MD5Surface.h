@@ -10,6 +10,7 @@
 #include "imodelsurface.h"
 
 #include "MD5DataStructures.h"
+#include "MD5Skinning.h"
 #include "parser/DefTokeniser.h"
 
 class Ray;
@@ -37,18 +38,45 @@ private:
 	// Several MD5Surfaces can share the same mesh
 	MD5MeshPtr _mesh;
 
+	// The weights of the mesh prepared for skinning, shared with copies of this surface
+	std::shared_ptr<MD5SkinningData> _skinningData;
+
+	// The joint transforms of the current pose
+	MD5JointMatrices _jointMatrices;
+
 	// Our render data
 	Vertices _vertices;
 	Indices _indices;
 
-	// The GL display lists for this surface's geometry
-	GLuint _normalList;
-	GLuint _lightingList;
+	// The vertex layout submitted to OpenGL
+	struct RenderVertex
+	{
+		float vertex[3];
+		float texcoord[2];
+		float tangent[3];
+		float bitangent[3];
+		float normal[3];
+	};
+	std::vector<RenderVertex> _renderVertices;
+
+	// The vertex buffer is kept over the lifetime of this surface, pose
+	// changes upload the new vertices into the existing storage
+	mutable GLuint _vertexBuffer;
+	mutable GLuint _indexBuffer;
+	mutable std::size_t _vertexBufferSize;
+	mutable bool _vertexBufferNeedsUpdate;
+	mutable bool _indexBufferNeedsUpdate;
 
 private:
 
-	// Create the display lists
-	void createDisplayLists();
+	// Calculate the vertex positions for the given joint matrices
+	void skinVertices(const MD5JointMatrices& matrices);
+
+	// Convert the vertices to the render layout, to be uploaded on the next render call
+	void updateRenderVertices();
+
+	// Upload pending changes and bind the buffers, returns false if VBOs are not supported
+	bool bindBuffers() const;
 
 	// Re-calculate the normal vectors
 	void buildVertexNormals();
@@ -74,7 +102,7 @@ public:
 	void setDefaultMaterial(const std::string& name);
 	
 	/**
-	 * Calculate the AABB and build the display lists for rendering.
+	 * Calculate the AABB and tangents and queue the vertices for upload.
 	 */
 	void updateGeometry();
 
@@ -13,7 +13,7 @@
 #include "igame.h"
 #include "i18n.h"
 
-#include "parser/DefTokeniser.h"
+#include "parser/BufferDefTokeniser.h"
 #include "math/Vector4.h"
 #include "os/fs.h"
 
@@ -132,7 +132,7 @@ void ParticlesManager::removeParticleDef(const std::string& name)
 void ParticlesManager::parseStream(std::istream& contents, const std::string& filename)
 {
 	// Usual ritual, get a parser::DefTokeniser and start tokenising the DEFs
-	parser::BasicDefTokeniser<std::istream> tok(contents);
+	parser::BufferDefTokeniser tok(contents);
 
 	while (tok.hasMoreTokens())
 	{
@@ -0,0 +1,91 @@
+#include "BatchedSpacePartition.h"
+
+#include "inode.h"
+
+namespace scene
+{
+
+BatchedSpacePartition::BatchedSpacePartition() :
+	_batchDepth(0)
+{}
+
+bool BatchedSpacePartition::unlink(const INodePtr& sceneNode)
+{
+	// Forget about any pending move
+	_dirtyNodes.erase(sceneNode);
+
+	return unlinkNode(sceneNode);
+}
+
+bool BatchedSpacePartition::relink(const INodePtr& sceneNode)
+{
+	if (!isLinked(sceneNode))
+	{
+		return false;
+	}
+
+	if (_batchDepth > 0)
+	{
+		_dirtyNodes.insert(sceneNode);
+	}
+	else
+	{
+		relinkNodes(std::vector<INodePtr>(1, sceneNode), std::vector<AABB>(1, sceneNode->worldAABB()));
+	}
+
+	return true;
+}
+
+void BatchedSpacePartition::beginBatch()
+{
+	++_batchDepth;
+}
+
+void BatchedSpacePartition::endBatch()
+{
+	assert(_batchDepth > 0);
+
+	if (--_batchDepth == 0)
+	{
+		flush();
+	}
+}
+
+void BatchedSpacePartition::flush()
+{
+	// Evaluating the bounds can trigger further relink() calls,
+	// these are collected and moved in the next round
+	++_batchDepth;
+
+	std::vector<INodePtr> nodes;
+	std::vector<AABB> bounds;
+
+	while (!_dirtyNodes.empty())
+	{
+		nodes.assign(_dirtyNodes.begin(), _dirtyNodes.end());
+		_dirtyNodes.clear();
+
+		bounds.resize(nodes.size());
+
+		for (std::size_t i = 0; i < nodes.size(); ++i)
+		{
+			bounds[i] = nodes[i]->worldAABB();
+		}
+
+		relinkNodes(nodes, bounds);
+	}
+
+	--_batchDepth;
+}
+
+util::ThreadPool& BatchedSpacePartition::getThreadPool()
+{
+	if (!_threadPool)
+	{
+		_threadPool.reset(new util::ThreadPool(0));
+	}
+
+	return *_threadPool;
+}
+
+} // namespace
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "ispacepartition.h"
+#include "math/AABB.h"
+#include "util/ThreadPool.h"
+
+#include <unordered_set>
+
+namespace scene
+{
+
+/**
+ * Common base of the space partition systems, implementing the batch mode.
+ *
+ * Nodes passed to relink() during batch mode are collected in a set, such
+ * that every node is moved only once, no matter how often its bounds
+ * changed in between. flush() evaluates the bounds of all collected nodes
+ * and passes them to relinkNodes(), which moves them in one go.
+ *
+ * Evaluating the bounds of a node may call relink() again, so this is only
+ * done on the calling thread. The worker threads get the evaluated bounds.
+ */
+class BatchedSpacePartition :
+	public ISpacePartitionSystem
+{
+private:
+	std::size_t _batchDepth;
+
+	typedef std::unordered_set<INodePtr> NodeSet;
+	NodeSet _dirtyNodes;
+
+	// Created on demand, when a large number of nodes needs to be moved
+	std::unique_ptr<util::ThreadPool> _threadPool;
+
+public:
+	BatchedSpacePartition();
+
+	bool unlink(const INodePtr& sceneNode);
+	bool relink(const INodePtr& sceneNode);
+
+	void beginBatch();
+	void endBatch();
+	void flush();
+
+protected:
+	virtual bool isLinked(const INodePtr& sceneNode) const = 0;
+
+	// Removes the node from the tree, returns false if it wasn't linked
+	virtual bool unlinkNode(const INodePtr& sceneNode) = 0;
+
+	// Moves the given nodes to the location matching their bounds, which have
+	// been evaluated beforehand. Nodes which aren't linked anymore are skipped.
+	virtual void relinkNodes(const std::vector<INodePtr>& nodes, const std::vector<AABB>& bounds) = 0;
+
+	// Invokes func(i) for each i in [0..count). Large counts are processed by a thread pool,
+	// the function must neither modify the tree nor evaluate node bounds in that case.
+	template<typename Func>
+	void parallelFor(std::size_t count, const Func& func)
+	{
+		if (count <= PARALLEL_CHUNK_SIZE)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				func(i);
+			}
+
+			return;
+		}
+
+		util::parallelFor(getThreadPool(), count, func, PARALLEL_CHUNK_SIZE);
+	}
+
+private:
+	static const std::size_t PARALLEL_CHUNK_SIZE = 1024;
+
+	util::ThreadPool& getThreadPool();
+};
+
+} // namespace
@@ -0,0 +1,192 @@
+#include "LooseOctree.h"
+
+#include "LooseOctreeNode.h"
+
+namespace scene
+{
+
+namespace
+{
+	// The root node encompasses the whole map area
+	const double ROOT_EXTENTS = 65536;
+
+	// The number of members, before a leaf is subdivided
+	const std::size_t SUBDIVISION_THRESHOLD = 32;
+
+	// Cells are not subdivided any further below this size
+	const double MIN_CELL_EXTENTS = 128;
+}
+
+LooseOctree::LooseOctree() :
+	_root(new LooseOctreeNode(Vector3(0, 0, 0), Vector3(ROOT_EXTENTS, ROOT_EXTENTS, ROOT_EXTENTS)))
+{}
+
+LooseOctree::~LooseOctree()
+{
+	_nodeMapping.clear();
+	_root.reset();
+}
+
+void LooseOctree::link(const scene::INodePtr& sceneNode)
+{
+	// Make sure we don't do double-links
+	assert(_nodeMapping.find(sceneNode) == _nodeMapping.end());
+
+	addMember(findNode(*_root, sceneNode->worldAABB()), sceneNode);
+}
+
+ISPNodePtr LooseOctree::getRoot() const
+{
+	return _root;
+}
+
+bool LooseOctree::isLinked(const scene::INodePtr& sceneNode) const
+{
+	return _nodeMapping.find(sceneNode) != _nodeMapping.end();
+}
+
+bool LooseOctree::unlinkNode(const scene::INodePtr& sceneNode)
+{
+	NodeMapping::iterator found = _nodeMapping.find(sceneNode);
+
+	if (found == _nodeMapping.end())
+	{
+		return false;
+	}
+
+	std::size_t index = found->second.index;
+	INodePtr moved = found->second.node->removeMember(index);
+
+	// The former last member now occupies the slot of the removed one
+	if (moved)
+	{
+		_nodeMapping[moved].index = index;
+	}
+
+	_nodeMapping.erase(found);
+
+	return true;
+}
+
+void LooseOctree::relinkNodes(const std::vector<scene::INodePtr>& nodes, const std::vector<AABB>& bounds)
+{
+	// The current locations, NULL for nodes which aren't linked anymore
+	std::vector<LooseOctreeNode*> targets(nodes.size());
+
+	for (std::size_t i = 0; i < nodes.size(); ++i)
+	{
+		NodeMapping::const_iterator found = _nodeMapping.find(nodes[i]);
+		targets[i] = found != _nodeMapping.end() ? found->second.node : NULL;
+	}
+
+	// Look up the target nodes first, this doesn't change the tree
+	parallelFor(nodes.size(), [&](std::size_t i)
+	{
+		if (targets[i] != NULL)
+		{
+			targets[i] = &findNode(*targets[i], bounds[i]);
+		}
+	});
+
+	for (std::size_t i = 0; i < nodes.size(); ++i)
+	{
+		const scene::INodePtr& sceneNode = nodes[i];
+
+		NodeMapping::const_iterator found = _nodeMapping.find(sceneNode);
+
+		if (found == _nodeMapping.end() || targets[i] == NULL) continue;
+
+		// The target might have been subdivided by one of the previous moves, continue from there
+		LooseOctreeNode& target = findNode(*targets[i], bounds[i]);
+
+		if (found->second.node != &target)
+		{
+			unlinkNode(sceneNode);
+			addMember(target, sceneNode);
+		}
+	}
+}
+
+LooseOctreeNode& LooseOctree::findNode(LooseOctreeNode& start, const AABB& bounds) const
+{
+	// Invalid bounds stay in the root
+	if (!bounds.isValid())
+	{
+		return *_root;
+	}
+
+	LooseOctreeNode* node = &start;
+
+	// Ascend until the bounds fit, objects outside the map area end up in the root
+	while (!node->fits(bounds))
+	{
+		ISPNodePtr parent = node->getParent();
+
+		if (!parent)
+		{
+			return *node;
+		}
+
+		node = static_cast<LooseOctreeNode*>(parent.get());
+	}
+
+	// Descend into the octant containing the center, as long as the object is small enough
+	while (!node->isLeaf())
+	{
+		LooseOctreeNode& child = node->getChild(node->getOctant(bounds.origin));
+
+		if (!child.fits(bounds))
+		{
+			break;
+		}
+
+		node = &child;
+	}
+
+	return *node;
+}
+
+void LooseOctree::addMember(LooseOctreeNode& node, const scene::INodePtr& sceneNode)
+{
+	MemberLocation location = { &node, node.addMember(sceneNode) };
+	_nodeMapping.insert(NodeMapping::value_type(sceneNode, location));
+
+	// Subdivide leaves with too many members, unless they're small enough already
+	if (node.isLeaf() &&
+		node.getMembers().size() >= SUBDIVISION_THRESHOLD &&
+		node.getCell().extents.x() > MIN_CELL_EXTENTS)
+	{
+		subdivide(node);
+	}
+}
+
+void LooseOctree::subdivide(LooseOctreeNode& node)
+{
+	node.subdivide();
+
+	// Evaluating the member bounds might trigger nodeBoundsChanged() calls, which re-link
+	// the affected nodes. Get this done before distributing the members to the children,
+	// working on a copy since the member array might change meanwhile.
+	ISPNode::MemberList members = node.getMembers();
+
+	for (ISPNode::MemberList::const_iterator i = members.begin(); i != members.end(); ++i)
+	{
+		(*i)->worldAABB();
+	}
+
+	// Move every member still linked here and fitting into one of the children
+	members = node.getMembers();
+
+	for (ISPNode::MemberList::const_iterator i = members.begin(); i != members.end(); ++i)
+	{
+		LooseOctreeNode& target = findNode(node, (*i)->worldAABB());
+
+		if (&target != &node)
+		{
+			unlinkNode(*i);
+			addMember(target, *i);
+		}
+	}
+}
+
+} // namespace
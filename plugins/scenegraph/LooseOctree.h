@@ -0,0 +1,72 @@
+#pragma once
+
+#include "BatchedSpacePartition.h"
+#include <unordered_map>
+
+namespace scene
+{
+
+class LooseOctreeNode;
+typedef std::shared_ptr<LooseOctreeNode> LooseOctreeNodePtr;
+
+/**
+ * A loose octree, as alternative to the regular Octree. The bounds of
+ * each node are twice the size of the cell it is responsible for, such
+ * that objects straddling a cell border can still be linked to the node
+ * whose cell contains their center. In the regular Octree these objects
+ * remain in the smallest node fully containing them, which tends to be
+ * the root node on large maps.
+ *
+ * The root node covers the whole map area and doesn't grow. Objects
+ * outside the map area (or without valid bounds) are linked to the root.
+ * Leaf nodes are subdivided when they exceed a certain amount of members.
+ *
+ * The members are stored in contiguous arrays. The NodeMapping table
+ * remembers the node and the array index of each member, unlinking
+ * moves the last member of that node into the vacated slot.
+ *
+ * Nodes with changed bounds are moved bottom-up, starting the search
+ * for the new location at their current node.
+ */
+class LooseOctree :
+	public BatchedSpacePartition
+{
+private:
+	LooseOctreeNodePtr _root;
+
+	// The node a scene::INode is linked to and its index in the member array
+	struct MemberLocation
+	{
+		LooseOctreeNode* node;
+		std::size_t index;
+	};
+
+	typedef std::unordered_map<INodePtr, MemberLocation> NodeMapping;
+	NodeMapping _nodeMapping;
+
+public:
+	LooseOctree();
+
+	~LooseOctree();
+
+	void link(const scene::INodePtr& sceneNode);
+
+	ISPNodePtr getRoot() const;
+
+protected:
+	bool isLinked(const scene::INodePtr& sceneNode) const;
+	bool unlinkNode(const scene::INodePtr& sceneNode);
+	void relinkNodes(const std::vector<scene::INodePtr>& nodes, const std::vector<AABB>& bounds);
+
+private:
+	// Returns the smallest node the given bounds can be linked to,
+	// starting the search at the given node
+	LooseOctreeNode& findNode(LooseOctreeNode& start, const AABB& bounds) const;
+
+	void addMember(LooseOctreeNode& node, const scene::INodePtr& sceneNode);
+
+	// Creates the children of the given leaf and re-links its members
+	void subdivide(LooseOctreeNode& node);
+};
+
+} // namespace
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "inode.h"
+#include "ispacepartition.h"
+#include "math/AABB.h"
+
+namespace scene
+{
+
+class LooseOctreeNode;
+typedef std::shared_ptr<LooseOctreeNode> LooseOctreeNodePtr;
+
+/**
+ * A node of the LooseOctree. Each node covers a cubic cell of space,
+ * its (loose) bounds are the cell enlarged by a factor of two. A member
+ * fits into a node if its center is within the cell and its extents
+ * are not larger than the cell's - it is then guaranteed to be
+ * contained in the loose bounds.
+ *
+ * The node doesn't know about the lookup table of the owning tree,
+ * the LooseOctree takes care of linking and unlinking members.
+ */
+class LooseOctreeNode :
+	public ISPNode,
+	public std::enable_shared_from_this<LooseOctreeNode>
+{
+private:
+	// The cell this node is responsible for
+	AABB _cell;
+
+	// The loose bounds, which encompass all members of this node
+	AABB _bounds;
+
+	ISPNodeWeakPtr _parent;
+
+	// The child nodes (8 or 0), indexed by octant (see getOctant())
+	NodeList _children;
+
+	MemberList _members;
+
+public:
+	LooseOctreeNode(const Vector3& origin, const Vector3& extents,
+					const LooseOctreeNodePtr& parent = LooseOctreeNodePtr()) :
+		_cell(origin, extents),
+		_bounds(origin, extents * 2),
+		_parent(parent)
+	{}
+
+	ISPNodePtr getParent() const
+	{
+		return _parent.lock();
+	}
+
+	// Returns the loose bounds, used for culling
+	const AABB& getBounds() const
+	{
+		return _bounds;
+	}
+
+	const AABB& getCell() const
+	{
+		return _cell;
+	}
+
+	const NodeList& getChildNodes() const
+	{
+		return _children;
+	}
+
+	const MemberList& getMembers() const
+	{
+		return _members;
+	}
+
+	bool isLeaf() const
+	{
+		return _children.empty();
+	}
+
+	// Returns the index of the child octant the given point is located in
+	std::size_t getOctant(const Vector3& point) const
+	{
+		return (point.x() >= _cell.origin.x() ? 1 : 0) |
+			   (point.y() >= _cell.origin.y() ? 2 : 0) |
+			   (point.z() >= _cell.origin.z() ? 4 : 0);
+	}
+
+	LooseOctreeNode& getChild(std::size_t octant)
+	{
+		assert(octant < _children.size());
+
+		return static_cast<LooseOctreeNode&>(*_children[octant]);
+	}
+
+	// Returns true if the given bounds can be linked to this node. Centers
+	// on the cell border are accepted, brushes are often snapped to the grid.
+	bool fits(const AABB& bounds) const
+	{
+		for (std::size_t i = 0; i < 3; ++i)
+		{
+			if (bounds.extents[i] > _cell.extents[i] ||
+				fabs(bounds.origin[i] - _cell.origin[i]) > _cell.extents[i])
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Adds 8 empty child nodes, the members are left untouched
+	void subdivide()
+	{
+		assert(isLeaf());
+
+		Vector3 childExtents = _cell.extents * 0.5;
+
+		_children.resize(8);
+
+		for (std::size_t octant = 0; octant < 8; ++octant)
+		{
+			Vector3 origin(
+				_cell.origin.x() + ((octant & 1) ? childExtents.x() : -childExtents.x()),
+				_cell.origin.y() + ((octant & 2) ? childExtents.y() : -childExtents.y()),
+				_cell.origin.z() + ((octant & 4) ? childExtents.z() : -childExtents.z())
+			);
+
+			_children[octant] = LooseOctreeNodePtr(new LooseOctreeNode(origin, childExtents, shared_from_this()));
+		}
+	}
+
+	// Appends the member, returns its index in the member array
+	std::size_t addMember(const INodePtr& sceneNode)
+	{
+		_members.push_back(sceneNode);
+		return _members.size() - 1;
+	}
+
+	// Removes the member at the given index by moving the last member into its place.
+	// Returns the moved member, which is empty if the removed one was the last.
+	INodePtr removeMember(std::size_t index)
+	{
+		assert(index < _members.size());
+
+		INodePtr moved;
+
+		if (index + 1 < _members.size())
+		{
+			moved = _members.back();
+			_members[index] = moved;
+		}
+
+		_members.pop_back();
+
+		return moved;
+	}
+};
+
+} // namespace
@@ -105,8 +105,13 @@ void Octree::ensureRootSize(const scene::INodePtr& sceneNode)
 	}
 }
 
+bool Octree::isLinked(const scene::INodePtr& sceneNode) const
+{
+	return _nodeMapping.find(sceneNode) != _nodeMapping.end();
+}
+
 // Unlink this node from the SP tree
-bool Octree::unlink(const scene::INodePtr& sceneNode)
+bool Octree::unlinkNode(const scene::INodePtr& sceneNode)
 {
 	NodeMapping::iterator found = _nodeMapping.find(sceneNode);
 
@@ -120,6 +125,95 @@ bool Octree::unlink(const scene::INodePtr& sceneNode)
 	return false;
 }
 
+void Octree::relinkNodes(const std::vector<scene::INodePtr>& nodes, const std::vector<AABB>& bounds)
+{
+	// The current locations, NULL for nodes which aren't linked anymore
+	std::vector<OctreeNode*> targets(nodes.size());
+
+	for (std::size_t i = 0; i < nodes.size(); ++i)
+	{
+		NodeMapping::const_iterator found = _nodeMapping.find(nodes[i]);
+		targets[i] = found != _nodeMapping.end() ? found->second : NULL;
+	}
+
+	// Look up the target nodes first, this doesn't change the tree
+	parallelFor(nodes.size(), [&](std::size_t i)
+	{
+		if (targets[i] != NULL)
+		{
+			targets[i] = findNode(*targets[i], bounds[i]);
+		}
+	});
+
+	OctreeNode* root = _root.get();
+
+	for (std::size_t i = 0; i < nodes.size(); ++i)
+	{
+		const scene::INodePtr& sceneNode = nodes[i];
+
+		// Moving a node can subdivide octree nodes, which relocates
+		// their members, so look up the current one again
+		NodeMapping::const_iterator found = _nodeMapping.find(sceneNode);
+
+		if (found == _nodeMapping.end() || targets[i] == NULL) continue;
+
+		// The targets remain valid as long as the tree doesn't grow
+		if (_root.get() == root && (!bounds[i].isValid() || root->getBounds().contains(bounds[i])))
+		{
+			if (found->second != targets[i])
+			{
+				found->second->unlink(sceneNode);
+				targets[i]->linkRecursively(sceneNode);
+			}
+
+			continue;
+		}
+
+		// Take the usual route, which lets the tree grow if the node exceeds the root
+		found->second->unlink(sceneNode);
+		link(sceneNode);
+	}
+}
+
+OctreeNode* Octree::findNode(OctreeNode& start, const AABB& bounds) const
+{
+	// Invalid bounds are linked to the root, like link() does
+	if (!bounds.isValid())
+	{
+		return _root.get();
+	}
+
+	OctreeNode* node = &start;
+
+	// Ascend until the bounds fit
+	while (!node->getBounds().contains(bounds))
+	{
+		ISPNodePtr parent = node->getParent();
+
+		if (!parent) break;
+
+		node = static_cast<OctreeNode*>(parent.get());
+	}
+
+	// Descend into the smallest child containing the bounds
+	for (std::size_t i = 0; i < node->getChildNodes().size(); /* in-loop */)
+	{
+		OctreeNode& child = (*node)[i];
+
+		if (child.getBounds().contains(bounds))
+		{
+			node = &child;
+			i = 0;
+		}
+		else
+		{
+			++i;
+		}
+	}
+
+	return node;
+}
+
 // Returns the root node of this SP tree
 ISPNodePtr Octree::getRoot() const
 {
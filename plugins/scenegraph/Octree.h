@@ -1,7 +1,7 @@
 #ifndef _OCTREE_H_
 #define _OCTREE_H_
 
-#include "ispacepartition.h"
+#include "BatchedSpacePartition.h"
 #include <map>
 
 namespace scene
@@ -37,9 +37,13 @@ typedef std::shared_ptr<OctreeNode> OctreeNodePtr;
  * algorithm. The scene::INodes don't know or care where they are linked to, so
  * it needs a fast lookup to avoid having to traverse the entire tree to find and
  * remove a single node.
+ *
+ * Nodes with changed bounds are moved bottom-up: starting at their current
+ * OctreeNode, the tree is ascended until the bounds fit, then descended
+ * to the smallest OctreeNode containing them.
  */
 class Octree :
-	public ISpacePartitionSystem
+	public BatchedSpacePartition
 {
 private:
 	// The root node of this SP
@@ -57,9 +61,6 @@ public:
 	// Links this node into the SP tree.
 	void link(const scene::INodePtr& sceneNode);
 
-	// Unlink this node from the SP tree, returns true if found
-	bool unlink(const scene::INodePtr& sceneNode);
-
 	// Returns the root node of this SP tree
 	ISPNodePtr getRoot() const;
 
@@ -73,7 +74,18 @@ public:
 	void notifyErase(OctreeNode* node);
 #endif
 
+protected:
+	bool isLinked(const scene::INodePtr& sceneNode) const;
+
+	// Unlink this node from the SP tree, returns true if found
+	bool unlinkNode(const scene::INodePtr& sceneNode);
+
+	void relinkNodes(const std::vector<scene::INodePtr>& nodes, const std::vector<AABB>& bounds);
+
 private:
+	// Returns the smallest octree node containing the bounds, starting the search at the given one
+	OctreeNode* findNode(OctreeNode& start, const AABB& bounds) const;
+
 	/**
 	 * This is called whenever a node is linked into the octree
 	 * and ensures that the topmost octree node (the root node) is
@@ -4,6 +4,7 @@
 #include "inode.h"
 #include "ispacepartition.h"
 #include "math/AABB.h"
+#include <algorithm>
 
 #include "Octree.h"
 
@@ -2,21 +2,36 @@
 
 #include "ivolumetest.h"
 #include "itextstream.h"
+#include "iregistry.h"
+#include <algorithm>
 
 #include "scene/InstanceWalkers.h"
 #include "debugging/debugging.h"
 
 #include "math/AABB.h"
+#include "registry/registry.h"
 #include "Octree.h"
+#include "LooseOctree.h"
 #include "SceneGraphFactory.h"
 
 namespace scene
 {
 
+namespace
+{
+	// Selects the space partition system, either "octree" (default) or "looseOctree"
+	const char* const RKEY_SPACE_PARTITION = "debug/scenegraph/spacePartition";
+
+	// The number of bounding boxes passed to VolumeTest::TestAABBs() at once
+	const std::size_t CULLING_BATCH_SIZE = 32;
+}
+
 SceneGraph::SceneGraph() :
 	_spacePartition(new Octree),
 	_visitedSPNodes(0),
-	_skippedSPNodes(0)
+	_skippedSPNodes(0),
+	_lastVisitedSPNodes(0),
+	_lastSkippedSPNodes(0)
 {}
 
 SceneGraph::~SceneGraph()
@@ -76,7 +91,7 @@ void SceneGraph::setRoot(const IMapRootNodePtr& newRoot)
 	_root = newRoot;
 
 	// Refresh the space partition class
-	_spacePartition = ISpacePartitionSystemPtr(new Octree);
+	_spacePartition = createSpacePartition();
 
 	if (_root != NULL)
 	{
@@ -136,11 +151,8 @@ void SceneGraph::nodeBoundsChanged(const INodePtr& node)
 {
 	//assert(_visitedSPNodes == 0); // Disallow this during traversal
 
-	if (_spacePartition->unlink(node))
-	{
-		// unlink returned true, so the given node was linked before => re-link it
-		_spacePartition->link(node);
-	}
+	// Moves the node if it was linked before, this is deferred in batch mode
+	_spacePartition->relink(node);
 }
 
 void SceneGraph::foreachNode(const INode::VisitorFunc& functor)
@@ -190,12 +202,18 @@ void SceneGraph::foreachNodeInVolume(const VolumeTest& volume, const INode::Visi
 	// changes during traversal so let's call this now. If nothing got changed, this call is very cheap.
 	if (_root != NULL) _root->worldAABB();
 
+	// Apply the changes collected in batch mode, once per traversal
+	_spacePartition->flush();
+
 	// Descend the SpacePartition tree and call the walker for each (partially) visible member
 	ISPNodePtr root = _spacePartition->getRoot();
 
 	_visitedSPNodes = _skippedSPNodes = 0;
 
-	foreachNodeInVolume_r(*root, volume, functor, visitHidden);
+	foreachNodeInVolume_r(*root, volume, functor, visitHidden, true);
+
+	_lastVisitedSPNodes = _visitedSPNodes;
+	_lastSkippedSPNodes = _skippedSPNodes;
 
 	_visitedSPNodes = _skippedSPNodes = 0;
 }
@@ -217,58 +235,137 @@ void SceneGraph::foreachVisibleNodeInVolume(const VolumeTest& volume, Walker& wa
 }
 
 bool SceneGraph::foreachNodeInVolume_r(const ISPNode& node, const VolumeTest& volume, 
-									   const INode::VisitorFunc& functor, bool visitHidden)
+									   const INode::VisitorFunc& functor, bool visitHidden,
+									   bool testMembers)
 {
 	_visitedSPNodes++;
 
-	// Visit all members
-	const ISPNode::MemberList& members = node.getMembers();
+	// Buffers for culling the members and child nodes in batches. The culling
+	// results are applied to the nodes they have been calculated for, which
+	// stay in the member list copy and the child batch below.
+	AABB bounds[CULLING_BATCH_SIZE];
+	VolumeIntersectionValue intersections[CULLING_BATCH_SIZE];
+	ISPNodePtr childBatch[CULLING_BATCH_SIZE];
+
+	// Visit all members. The walker is allowed to unlink the visited node,
+	// which removes it from the member list, so iterate over a copy.
+	const ISPNode::MemberList members = node.getMembers();
 
-	for (ISPNode::MemberList::const_iterator m = members.begin();
-		 m != members.end(); /* in-loop increment */)
+	for (std::size_t start = 0; start < members.size(); start += CULLING_BATCH_SIZE)
 	{
-		// Skip hidden nodes, if specified
-		if (!visitHidden && !(*m)->visible())
+		std::size_t count = std::min(CULLING_BATCH_SIZE, members.size() - start);
+
+		// Members of partially visible nodes are tested individually
+		if (testMembers)
 		{
-			++m;
-			continue;
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				bounds[i] = members[start + i]->worldAABB();
+			}
+
+			volume.TestAABBs(bounds, count, intersections);
 		}
 
-		// We're done, as soon as the walker returns FALSE
-		if (!functor(*m++))
+		for (std::size_t i = 0; i < count; ++i)
 		{
-			return false;
+			const INodePtr& member = members[start + i];
+
+			// Skip hidden nodes, if specified
+			if (!visitHidden && !member->visible())
+			{
+				continue;
+			}
+
+			// Members without valid bounds are always visited
+			if (testMembers && intersections[i] == VOLUME_OUTSIDE && bounds[i].isValid())
+			{
+				continue;
+			}
+
+			// We're done, as soon as the walker returns FALSE
+			if (!functor(member))
+			{
+				return false;
+			}
 		}
 	}
 
-	// Now consider the children
+	// Now consider the children, the walker may cause the partition to
+	// change them while traversing (e.g. by unlinking nodes)
 	const ISPNode::NodeList& children = node.getChildNodes();
 
-	for (ISPNode::NodeList::const_iterator i = children.begin(); i != children.end(); ++i)
+	for (std::size_t start = 0; start < children.size(); start += CULLING_BATCH_SIZE)
 	{
-		if (volume.TestAABB((*i)->getBounds()) == VOLUME_OUTSIDE)
+		std::size_t count = std::min(CULLING_BATCH_SIZE, children.size() - start);
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			childBatch[i] = children[start + i];
+		}
+
+		// Once a node is entirely inside the volume, so is everything below it
+		if (testMembers)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				bounds[i] = childBatch[i]->getBounds();
+			}
+
+			volume.TestAABBs(bounds, count, intersections);
+		}
+		else
 		{
-			// Skip this node, not visible
-			_skippedSPNodes++;
-			continue;
+			std::fill(intersections, intersections + count, VOLUME_INSIDE);
 		}
 
-		// Traverse all the children too, enter recursion
-		if (!foreachNodeInVolume_r(**i, volume, functor, visitHidden))
+		for (std::size_t i = 0; i < count; ++i)
 		{
-			// The walker returned false somewhere in the recursion depths, propagate this message
-			return false;
+			if (intersections[i] == VOLUME_OUTSIDE)
+			{
+				// Skip this node, not visible
+				_skippedSPNodes++;
+				continue;
+			}
+
+			// Traverse all the children too, enter recursion
+			if (!foreachNodeInVolume_r(*childBatch[i], volume, functor, visitHidden,
+									   intersections[i] != VOLUME_INSIDE))
+			{
+				// The walker returned false somewhere in the recursion depths, propagate this message
+				return false;
+			}
 		}
 	}
 
 	return true; // continue traversal
 }
 
+ISpacePartitionSystemPtr SceneGraph::createSpacePartition()
+{
+	// Without a root the scene is empty, and the registry might already be gone
+	if (_root && registry::getValue<std::string>(RKEY_SPACE_PARTITION) == "looseOctree")
+	{
+		return ISpacePartitionSystemPtr(new LooseOctree);
+	}
+
+	return ISpacePartitionSystemPtr(new Octree);
+}
+
 ISpacePartitionSystemPtr SceneGraph::getSpacePartition()
 {
 	return _spacePartition;
 }
 
+std::size_t SceneGraph::getLastVisitedSPNodeCount() const
+{
+	return _lastVisitedSPNodes;
+}
+
+std::size_t SceneGraph::getLastCulledSPNodeCount() const
+{
+	return _lastSkippedSPNodes;
+}
+
 // RegisterableModule implementation
 const std::string& SceneGraphModule::getName() const
 {
@@ -278,7 +375,13 @@ const std::string& SceneGraphModule::getName() const
 
 const StringSet& SceneGraphModule::getDependencies() const
 {
-	static StringSet _dependencies; // no deps
+	static StringSet _dependencies;
+
+	if (_dependencies.empty())
+	{
+		_dependencies.insert(MODULE_XMLREGISTRY);
+	}
+
 	return _dependencies;
 }
 
@@ -37,6 +37,10 @@ private:
 	std::size_t _visitedSPNodes;
 	std::size_t _skippedSPNodes;
 
+	// The counters of the most recent traversal
+	std::size_t _lastVisitedSPNodes;
+	std::size_t _lastSkippedSPNodes;
+
 public:
 	SceneGraph();
 
@@ -78,12 +82,20 @@ public:
 	void foreachVisibleNodeInVolume(const VolumeTest& volume, const INode::VisitorFunc& functor);
 
 	ISpacePartitionSystemPtr getSpacePartition();
+
+	std::size_t getLastVisitedSPNodeCount() const;
+	std::size_t getLastCulledSPNodeCount() const;
 private:
 	void foreachNodeInVolume(const VolumeTest& volume, const INode::VisitorFunc& functor, bool visitHidden);
 
-	// Recursive method used to descend the SpacePartition tree, returns FALSE if the walker signaled stop
+	// Recursive method used to descend the SpacePartition tree, returns FALSE if the walker signaled stop.
+	// The members are tested against the volume unless the SP node is known to be fully inside.
 	bool foreachNodeInVolume_r(const ISPNode& node, const VolumeTest& volume, 
-							   const INode::VisitorFunc& functor, bool visitHidden);
+							   const INode::VisitorFunc& functor, bool visitHidden,
+							   bool testMembers);
+
+	// Instantiates the space partition system chosen in the registry
+	ISpacePartitionSystemPtr createSpacePartition();
 };
 typedef std::shared_ptr<SceneGraph> SceneGraphPtr;
 
@@ -244,6 +244,15 @@ public:
         _texGenParams[index] = value;
     }
 
+    /**
+     * \brief
+     * Get the blend function strings, as given in the material definition.
+     */
+    const StringPair& getBlendFuncStrings() const
+    {
+        return _blendFuncStrings;
+    }
+
     /**
      * \brief
      * Set the blend function string.
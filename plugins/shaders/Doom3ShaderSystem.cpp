@@ -24,6 +24,7 @@
 
 namespace {
 	const char* TEXTURE_PREFIX = "textures/";
+	const char* MATERIAL_CACHE_FILE = "materials.cache";
 	const char* MISSING_BASEPATH_NODE =
 		"Failed to find \"/game/filesystem/shaders/basepath\" node \
 in game descriptor";
@@ -91,7 +92,11 @@ void Doom3ShaderSystem::loadMaterialFiles()
 	std::string extension = nlShaderExt[0].getContent();
 
 	// Load each file from the global filesystem
-	ShaderFileLoader loader(sPath, _currentOperation);
+	// Unchanged files are loaded from the parse cache in the settings folder
+	std::string cacheFile =
+		module::GlobalModuleRegistry().getApplicationContext().getSettingsPath() + MATERIAL_CACHE_FILE;
+
+	ShaderFileLoader loader(sPath, _currentOperation, cacheFile);
 	{
 		ScopedDebugTimer timer("ShaderFiles parsed: ");
         GlobalFileSystem().forEachFile(sPath, extension, [&](const std::string& filename)
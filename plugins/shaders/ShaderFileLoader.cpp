@@ -3,11 +3,11 @@
 #include "ifilesystem.h"
 #include "iarchive.h"
 #include "i18n.h"
-#include "parser/DefTokeniser.h"
-#include "parser/DefBlockTokeniser.h"
+#include "parser/BufferDefBlockTokeniser.h"
 #include "ShaderDefinition.h"
 #include "Doom3ShaderSystem.h"
 #include "TableDefinition.h"
+#include "util/ThreadPool.h"
 
 #include <iostream>
 #include <boost/algorithm/string/replace.hpp>
@@ -18,38 +18,44 @@
 namespace shaders
 {
 
+const char* const ShaderFileLoader::CACHE_FORMAT = "materials1";
+
+namespace
+{
+	// The kinds of blocks in the cached data
+	enum CachedBlockType
+	{
+		CACHED_TABLE,
+		CACHED_UNNAMED_TABLE,
+		CACHED_MATERIAL
+	};
+}
+
 /* Parses through the shader file and processes the tokens delivered by
  * DefTokeniser.
  */
-void ShaderFileLoader::parseShaderFile(std::istream& inStr,
-									   const std::string& filename)
+void ShaderFileLoader::parseShaderFile(const std::string& contents, ParsedFile& parsed)
 {
 	// Parse the file with a blocktokeniser, the actual block contents
 	// will be parsed separately.
-	parser::BasicDefBlockTokeniser<std::istream> tokeniser(inStr);
+	parser::BufferDefBlockTokeniser tokeniser(contents);
 
 	while (tokeniser.hasMoreBlocks())
 	{
 		// Get the next block
-		parser::BlockTokeniser::Block block = tokeniser.nextBlock();
+		const parser::BufferDefBlockTokeniser::BlockView& block = tokeniser.nextBlockView();
 
 		// Skip tables
 		if (block.name.substr(0, 5) == "table")
 		{
-			std::string tableName = block.name.substr(6);
+			parsed.blocks.push_back(ParsedBlock());
+			ParsedBlock& parsedBlock = parsed.blocks.back();
 
-			if (tableName.empty())
-			{
-				rError() << "[shaders] " << filename << ": Missing table name." << std::endl;
-				continue;
-			}
+			parsedBlock.name = block.name.substr(6);
 
-			TableDefinitionPtr table(new TableDefinition(tableName, block.contents));
-
-			if (!GetShaderSystem()->addTableDefinition(table))
+			if (!parsedBlock.name.empty())
 			{
-				rError() << "[shaders] " << filename
-					<< ": table " << tableName << " already defined." << std::endl;
+				parsedBlock.table.reset(new TableDefinition(parsedBlock.name, block.contents.str()));
 			}
 
 			continue;
@@ -63,18 +69,199 @@ void ShaderFileLoader::parseShaderFile(std::istream& inStr,
 			continue; // skip particle definition
 		}
 
-		boost::algorithm::replace_all(block.name, "\\", "/"); // use forward slashes
+		parsed.blocks.push_back(ParsedBlock());
+		ParsedBlock& parsedBlock = parsed.blocks.back();
+
+		parsedBlock.name = block.name;
+		boost::algorithm::replace_all(parsedBlock.name, "\\", "/"); // use forward slashes
+
+		parsedBlock.shaderTemplate.reset(new ShaderTemplate(parsedBlock.name, block.contents.str()));
+	}
+}
+
+std::string ShaderFileLoader::WriteCacheData(const ParsedFile& parsed)
+{
+	std::string data;
+	parser::CacheWriter writer(data);
+
+	writer.writeInt(static_cast<std::uint32_t>(parsed.blocks.size()));
+
+	for (std::vector<ParsedBlock>::const_iterator i = parsed.blocks.begin(); i != parsed.blocks.end(); ++i)
+	{
+		if (i->table)
+		{
+			writer.writeByte(CACHED_TABLE);
+			writer.writeString(i->name);
+			writer.writeString(i->table->getBlockContents());
+		}
+		else if (i->shaderTemplate)
+		{
+			writer.writeByte(CACHED_MATERIAL);
+			writer.writeString(i->name);
+			writer.writeString(i->shaderTemplate->getBlockContents());
+		}
+		else
+		{
+			writer.writeByte(CACHED_UNNAMED_TABLE);
+		}
+	}
+
+	return data;
+}
+
+void ShaderFileLoader::ReadCacheData(const std::string& data, ParsedFile& parsed)
+{
+	parser::CacheReader reader(data);
+
+	std::size_t numBlocks = reader.readInt();
+
+	for (std::size_t i = 0; i < numBlocks; ++i)
+	{
+		parsed.blocks.push_back(ParsedBlock());
+		ParsedBlock& block = parsed.blocks.back();
+
+		switch (reader.readByte())
+		{
+		case CACHED_TABLE:
+			block.name = reader.readString();
+			block.table.reset(new TableDefinition(block.name, reader.readString()));
+			break;
+
+		case CACHED_MATERIAL:
+			block.name = reader.readString();
+			block.shaderTemplate.reset(new ShaderTemplate(block.name, reader.readString()));
+			break;
+
+		case CACHED_UNNAMED_TABLE:
+			break;
+
+		default:
+			throw parser::ParseException("ShaderFileLoader: invalid cached block type");
+		}
+	}
+}
+
+void ShaderFileLoader::loadFile(const std::string& fullPath, ParsedFile& parsed)
+{
+	ScopedThreadStreamRedirect redirect(&parsed.log);
+
+	try
+	{
+		parser::ParseCache::FileStamp stamp;
+
+		if (_cache)
+		{
+			{
+				std::lock_guard<std::mutex> lock(_vfsLock);
+				stamp = _cache->getStamp(GlobalFileSystem().findPhysicalFile(fullPath));
+			}
+
+			const std::string* cached = _cache->findByStamp(fullPath, stamp);
+
+			if (cached != NULL && readCachedFile(*cached, parsed))
+			{
+				// Unchanged since the last run, no need to open the file
+				markFileDone(parsed);
+				return;
+			}
+		}
+
+		ArchiveTextFilePtr file;
+
+		{
+			std::lock_guard<std::mutex> lock(_vfsLock);
+			file = GlobalFileSystem().openTextFile(fullPath);
+		}
+
+		if (file == NULL)
+		{
+			throw std::runtime_error("Unable to read shaderfile: " + fullPath);
+		}
+
+		std::string contents;
+
+		{
+			std::istream is(&(file->getInputStream()));
+			parser::readStream(is, contents);
+		}
+
+		if (_cache)
+		{
+			std::uint64_t contentHash = parser::ParseCache::GetContentHash(contents);
+
+			// The archive might have changed, but not this file
+			const std::string* cached = _cache->findByContent(fullPath, stamp, contentHash);
+
+			if (cached == NULL || !readCachedFile(*cached, parsed))
+			{
+				parseShaderFile(contents, parsed);
+				_cache->store(fullPath, stamp, contentHash, WriteCacheData(parsed));
+			}
+		}
+		else
+		{
+			parseShaderFile(contents, parsed);
+		}
+	}
+	catch (...)
+	{
+		// Re-thrown when this file is due to be inserted
+		parsed.exception = std::current_exception();
+	}
+
+	markFileDone(parsed);
+}
 
-		ShaderTemplatePtr shaderTemplate(new ShaderTemplate(block.name, block.contents));
+bool ShaderFileLoader::readCachedFile(const std::string& data, ParsedFile& parsed)
+{
+	try
+	{
+		ReadCacheData(data, parsed);
+		return true;
+	}
+	catch (parser::ParseException&)
+	{
+		// Damaged data, parse the file instead
+		parsed.blocks.clear();
+		return false;
+	}
+}
 
-		// Construct the ShaderDefinition wrapper class
-		ShaderDefinition def(shaderTemplate, filename);
+void ShaderFileLoader::markFileDone(ParsedFile& parsed)
+{
+	std::lock_guard<std::mutex> lock(_doneLock);
 
-		// Insert into the definitions map, if not already present
-		if (!GetShaderLibrary().addDefinition(block.name, def))
+	parsed.done = true;
+	_fileDone.notify_all();
+}
+
+void ShaderFileLoader::insertDefinitions(const ParsedFile& parsed, const std::string& filename)
+{
+	for (std::vector<ParsedBlock>::const_iterator i = parsed.blocks.begin(); i != parsed.blocks.end(); ++i)
+	{
+		if (i->table)
 		{
-    		rError() << "[shaders] " << filename
-				<< ": shader " << block.name << " already defined." << std::endl;
+			if (!GetShaderSystem()->addTableDefinition(i->table))
+			{
+				rError() << "[shaders] " << filename
+					<< ": table " << i->name << " already defined." << std::endl;
+			}
+		}
+		else if (i->shaderTemplate)
+		{
+			// Construct the ShaderDefinition wrapper class
+			ShaderDefinition def(i->shaderTemplate, filename);
+
+			// Insert into the definitions map, if not already present
+			if (!GetShaderLibrary().addDefinition(i->name, def))
+			{
+				rError() << "[shaders] " << filename
+					<< ": shader " << i->name << " already defined." << std::endl;
+			}
+		}
+		else
+		{
+			rError() << "[shaders] " << filename << ": Missing table name." << std::endl;
 		}
 	}
 }
@@ -87,6 +274,47 @@ void ShaderFileLoader::addFile(const std::string& filename)
 
 void ShaderFileLoader::parseFiles()
 {
+	if (_cache)
+	{
+		_cache->load();
+	}
+
+	parseFilesInParallel();
+
+	if (_cache)
+	{
+		rMessage() << "[shaders] " << _cache->getNumHits() << " of " << _files.size()
+			<< " material files loaded from the parse cache." << std::endl;
+
+		if (!_cache->save())
+		{
+			rWarning() << "[shaders] Could not write the parse cache." << std::endl;
+		}
+	}
+}
+
+void ShaderFileLoader::parseFilesInParallel()
+{
+	util::ThreadPool pool(0);
+	util::TaskGroup group(pool);
+
+	std::vector<ParsedFilePtr> parsedFiles;
+	parsedFiles.reserve(_files.size());
+
+	for (std::size_t i = 0; i < _files.size(); ++i)
+	{
+		ParsedFilePtr parsed(new ParsedFile);
+		parsedFiles.push_back(parsed);
+
+		const std::string& fullPath = _files[i];
+
+		group.run([this, &fullPath, parsed]()
+		{
+			loadFile(fullPath, *parsed);
+		});
+	}
+
+	// Insert the results in file order, this thread helps out while waiting
 	for (std::size_t i = 0; i < _files.size(); ++i)
 	{
 		const std::string& fullPath = _files[i];
@@ -99,19 +327,33 @@ void ShaderFileLoader::parseFiles()
 			_currentOperation->setProgress(progress);
 		}
 
-		// Open the file
-		ArchiveTextFilePtr file = GlobalFileSystem().openTextFile(fullPath);
+		ParsedFile& parsed = *parsedFiles[i];
 
-		if (file != NULL)
+		while (pool.runPendingTask())
 		{
-			std::istream is(&(file->getInputStream()));
-			parseShaderFile(is, fullPath);
+			std::lock_guard<std::mutex> lock(_doneLock);
+			if (parsed.done) break;
 		}
-		else
+
 		{
-			throw std::runtime_error("Unable to read shaderfile: " + fullPath);
+			std::unique_lock<std::mutex> lock(_doneLock);
+			_fileDone.wait(lock, [&]() { return parsed.done; });
+		}
+
+		parsed.log.flush();
+
+		if (parsed.exception)
+		{
+			std::rethrow_exception(parsed.exception);
 		}
+
+		insertDefinitions(parsed, fullPath);
+
+		// Release the block contents of this file early
+		parsedFiles[i].reset();
 	}
+
+	group.wait();
 }
 
 } // namespace shaders
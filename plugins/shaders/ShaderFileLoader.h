@@ -2,11 +2,18 @@
 
 #include "ifilesystem.h"
 #include "iradiant.h"
+#include "itextstream.h"
 #include "ShaderTemplate.h"
 
-#include "parser/DefTokeniser.h"
+#include "TableDefinition.h"
+#include "parser/ParseCache.h"
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 namespace shaders
 {
@@ -17,6 +24,10 @@ namespace shaders
 class ShaderFileLoader
 {
 private:
+	// Identifies the layout of the cached data, change it along with
+	// WriteCacheData() and ReadCacheData()
+	static const char* const CACHE_FORMAT;
+
 	// The base path for the shaders (e.g. "materials/")
 	std::string _basePath;
 
@@ -24,22 +35,89 @@ private:
 
 	std::vector<std::string> _files;
 
+	// Parse results of unchanged files are taken from here
+	std::unique_ptr<parser::ParseCache> _cache;
+
+	// A table or material block, as found by the worker threads
+	struct ParsedBlock
+	{
+		std::string name;
+
+		// One of these is set, none of them for a table without name
+		TableDefinitionPtr table;
+		ShaderTemplatePtr shaderTemplate;
+	};
+
+	// The blocks of a single file, in the order they appear in the file
+	struct ParsedFile
+	{
+		std::vector<ParsedBlock> blocks;
+
+		// Set if opening or parsing the file failed
+		std::exception_ptr exception;
+
+		// Output of the worker thread, written to the log in file order
+		ThreadLogBuffer log;
+
+		bool done;
+
+		ParsedFile() :
+			done(false)
+		{}
+	};
+	typedef std::shared_ptr<ParsedFile> ParsedFilePtr;
+
+	// The VFS can't be used from several threads at once
+	std::mutex _vfsLock;
+
+	// Signalled whenever a worker finished a file
+	std::mutex _doneLock;
+	std::condition_variable _fileDone;
+
 private:
+	// Opens and parses the file, or takes the result from the cache.
+	// The result is stored in the given object.
+	void loadFile(const std::string& fullPath, ParsedFile& parsed);
+
+	// Splits the shader file contents into tables and material templates
+	void parseShaderFile(const std::string& contents, ParsedFile& parsed);
+
+	// Conversion of the parse results from and to the cached representation
+	static std::string WriteCacheData(const ParsedFile& parsed);
+	static void ReadCacheData(const std::string& data, ParsedFile& parsed);
 
-	// Parse a shader file with the given contents and filename
-	void parseShaderFile(std::istream& inStr, const std::string& filename);
+	// Reads the cached parse results, returns false if the data is damaged
+	bool readCachedFile(const std::string& data, ParsedFile& parsed);
+
+	void markFileDone(ParsedFile& parsed);
+
+	// Parses the files on a thread pool and inserts the definitions
+	void parseFilesInParallel();
+
+	// Inserts the parsed definitions into the library
+	void insertDefinitions(const ParsedFile& parsed, const std::string& filename);
 
 public:
 	// Constructor. Set the basepath to prepend onto shader filenames.
-	ShaderFileLoader(const std::string& path, ILongRunningOperation* currentOperation)
+	// The parse results are cached in the given file, pass an empty
+	// string to disable the cache.
+	ShaderFileLoader(const std::string& path, ILongRunningOperation* currentOperation,
+					 const std::string& cacheFile = std::string())
 	: _basePath(path),
 	_currentOperation(currentOperation)
 	{
 		_files.reserve(200);
+
+		if (!cacheFile.empty())
+		{
+			_cache.reset(new parser::ParseCache(cacheFile, CACHE_FORMAT));
+		}
 	}
 
 	void addFile(const std::string& filename);
 
+	// Parses all added files on a thread pool. The definitions are inserted in
+	// file order, so the first definition of a name wins like before.
 	void parseFiles();
 };
 
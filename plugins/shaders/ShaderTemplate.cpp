@@ -6,11 +6,11 @@
 
 #include "os/path.h"
 #include "string/convert.h"
-#include "parser/DefTokeniser.h"
+#include "parser/BufferDefTokeniser.h"
+#include "materiallib.h"
 
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string/case_conv.hpp>
-#include <boost/algorithm/string/trim.hpp>
 #include <iostream>
 
 #include "ShaderExpression.h"
@@ -26,39 +26,6 @@ NamedBindablePtr ShaderTemplate::getEditorTexture()
     return _editorTex;
 }
 
-IShaderExpressionPtr ShaderTemplate::parseSingleExpressionTerm(parser::DefTokeniser& tokeniser)
-{
-	std::string token = tokeniser.nextToken();
-
-	if (token == "(")
-	{
-		std::string expr = token;
-		std::size_t level = 1;
-
-		while (level > 0)
-		{
-			token = tokeniser.nextToken();
-			expr += token;
-
-			if (token == ")")
-			{
-				--level;
-			}
-			else if (token == "(")
-			{
-				++level;
-			}
-		}
-
-		return ShaderExpression::createFromString(expr);
-	}
-	else
-	{
-		// No parenthesis, parse this token alone
-		return ShaderExpression::createFromString(token);
-	}
-}
-
 /*  Searches a token for known shaderflags (e.g. "translucent") and sets the flags
  *  in the member variable _materialFlags
  *
@@ -67,12 +34,12 @@ IShaderExpressionPtr ShaderTemplate::parseSingleExpressionTerm(parser::DefTokeni
 bool ShaderTemplate::parseShaderFlags(parser::DefTokeniser& tokeniser,
                                       const std::string& token)
 {
-    if (token == "translucent")
+    if (parseMaterialFlag(token, _materialFlags, _coverage))
 	{
-        _materialFlags |= Material::FLAG_TRANSLUCENT | Material::FLAG_NOSHADOWS;
-		_coverage = Material::MC_TRANSLUCENT;
+        return true;
     }
-    else if (token == "decal_macro")
+
+    if (token == "decal_macro")
 	{
         _materialFlags |= Material::FLAG_TRANSLUCENT;
         _sortReq = Material::SORT_DECAL;
@@ -110,97 +77,8 @@ bool ShaderTemplate::parseShaderFlags(parser::DefTokeniser& tokeniser,
 	}
 	else if (token == "sort")
 	{
-		std::string sortVal = tokeniser.nextToken();
-
-		if (sortVal == "opaque")
-		{
-			_sortReq = Material::SORT_OPAQUE;
-		}
-		else if (sortVal == "decal")
-		{
-			_sortReq = Material::SORT_DECAL;
-		}
-		else if (sortVal == "portalSky")
-		{
-			_sortReq = Material::SORT_PORTAL_SKY;
-		}
-		else if (sortVal == "subview")
-		{
-			_sortReq = Material::SORT_SUBVIEW;
-		}
-		else if (sortVal == "far")
-		{
-			_sortReq = Material::SORT_FAR;
-		}
-		else if (sortVal == "medium")
-		{
-			_sortReq = Material::SORT_MEDIUM;
-		}
-		else if (sortVal == "close")
-		{
-			_sortReq = Material::SORT_CLOSE;
-		}
-		else if (sortVal == "almostNearest")
-		{
-			_sortReq = Material::SORT_ALMOST_NEAREST;
-		}
-		else if (sortVal == "nearest")
-		{
-			_sortReq = Material::SORT_NEAREST;
-		}
-		else if (sortVal == "postProcess")
-		{
-			_sortReq = Material::SORT_POST_PROCESS;
-		}
-		else // no special sort keyword, try to parse the numeric value
-		{
-			//  Strip any quotes
-			boost::algorithm::trim_if(sortVal, boost::algorithm::is_any_of("\""));
-
-			_sortReq = string::convert<int>(sortVal, SORT_UNDEFINED); // fall back to UNDEFINED in case of parsing failures
-		}
-	}
-	else if (token == "noshadows")
-	{
-		_materialFlags |= Material::FLAG_NOSHADOWS;
-	}
-	else if (token == "noselfshadow")
-	{
-		_materialFlags |= Material::FLAG_NOSELFSHADOW;
-	}
-	else if (token == "forceshadows")
-	{
-		_materialFlags |= Material::FLAG_FORCESHADOWS;
-	}
-	else if (token == "nooverlays")
-	{
-		_materialFlags |= Material::FLAG_NOOVERLAYS;
-	}
-	else if (token == "forceoverlays")
-	{
-		_materialFlags |= Material::FLAG_FORCEOVERLAYS;
-	}
-	else if (token == "forceopaque")
-	{
-		_materialFlags |= Material::FLAG_FORCEOPAQUE;
-		_coverage = Material::MC_OPAQUE;
-	}
-	else if (token == "nofog")
-	{
-		_materialFlags |= Material::FLAG_NOFOG;
-	}
-	else if (token == "noportalfog")
-	{
-		_materialFlags |= Material::FLAG_NOPORTALFOG;
-	}
-	else if (token == "unsmoothedtangents")
-	{
-		_materialFlags |= Material::FLAG_UNSMOOTHEDTANGENTS;
-	}
-	else if (token == "mirror")
-	{
-		_materialFlags |= Material::FLAG_MIRROR;
-		_coverage = Material::MC_OPAQUE;
+		// fall back to UNDEFINED in case of parsing failures
+		_sortReq = parseSortRequest(tokeniser.nextToken(), SORT_UNDEFINED);
 	}
 	else if (token == "decalinfo")
 	{
@@ -231,61 +109,7 @@ bool ShaderTemplate::parseShaderFlags(parser::DefTokeniser& tokeniser,
 	}
 	else if (token == "deform")
 	{
-		std::string type = tokeniser.nextToken();
-		boost::algorithm::to_lower(type);
-
-		if (type == "sprite")
-		{
-			_deformType = Material::DEFORM_SPRITE;
-		}
-		else if (type == "tube")
-		{
-			_deformType = Material::DEFORM_TUBE;
-		}
-		else if (type == "flare")
-		{
-			_deformType = Material::DEFORM_FLARE;
-
-			parseSingleExpressionTerm(tokeniser); // skip size info
-		}
-		else if (type == "expand")
-		{
-			_deformType = Material::DEFORM_EXPAND;
-
-			parseSingleExpressionTerm(tokeniser); // skip amount
-		}
-		else if (type == "move")
-		{
-			_deformType = Material::DEFORM_MOVE;
-
-			parseSingleExpressionTerm(tokeniser); // skip amount
-		}
-		else if (type == "turbulent")
-		{
-			_deformType = Material::DEFORM_TURBULENT;
-
-			tokeniser.skipTokens(1); // skip table name
-
-			parseSingleExpressionTerm(tokeniser); // range
-			parseSingleExpressionTerm(tokeniser); // timeoffset
-			parseSingleExpressionTerm(tokeniser); // domain
-		}
-		else if (type == "eyeball")
-		{
-			_deformType = Material::DEFORM_EYEBALL;
-		}
-		else if (type == "particle")
-		{
-			_deformType = Material::DEFORM_PARTICLE;
-
-			tokeniser.skipTokens(1); // skip particle name
-		}
-		else if (type == "particle2")
-		{
-			_deformType = Material::DEFORM_PARTICLE2;
-
-			tokeniser.skipTokens(1); // skip particle name
-		}
+		parseDeform(tokeniser, _deformType);
 	}
 	else if (token == "renderbump")
 	{
@@ -942,99 +766,12 @@ bool ShaderTemplate::parseStageModifiers(parser::DefTokeniser& tokeniser,
 bool ShaderTemplate::parseSurfaceFlags(parser::DefTokeniser& tokeniser,
                                        const std::string& token)
 {
-    if (token == "solid")
-    {
-        _surfaceFlags |= Material::SURF_SOLID;
-    }
-    else if (token == "water")
-    {
-        _surfaceFlags |= Material::SURF_WATER;
-    }
-    else if (token == "playerclip")
-    {
-        _surfaceFlags |= Material::SURF_PLAYERCLIP;
-    }
-    else if (token == "monsterclip")
-    {
-        _surfaceFlags |= Material::SURF_MONSTERCLIP;
-    }
-	else if (token == "moveableclip")
-    {
-        _surfaceFlags |= Material::SURF_MOVEABLECLIP;
-    }
-	else if (token == "ikclip")
-    {
-        _surfaceFlags |= Material::SURF_IKCLIP;
-    }
-	else if (token == "blood")
-    {
-        _surfaceFlags |= Material::SURF_BLOOD;
-    }
-	else if (token == "trigger")
-    {
-        _surfaceFlags |= Material::SURF_TRIGGER;
-    }
-	else if (token == "aassolid")
-    {
-		_surfaceFlags |= Material::SURF_AASSOLID;
-    }
-	else if (token == "aasobstacle")
-    {
-        _surfaceFlags |= Material::SURF_AASOBSTACLE;
-    }
-	else if (token == "flashlight_trigger")
-    {
-        _surfaceFlags |= Material::SURF_FLASHLIGHT_TRIGGER;
-    }
-	else if (token == "nonsolid")
-    {
-        _surfaceFlags |= Material::SURF_NONSOLID;
-    }
-	else if (token == "nullnormal")
-    {
-        _surfaceFlags |= Material::SURF_NULLNORMAL;
-    }
-	else if (token == "areaportal")
-    {
-		_surfaceFlags |= Material::SURF_AREAPORTAL;
-    }
-	else if (token == "qer_nocarve")
-    {
-		_surfaceFlags |= Material::SURF_NOCARVE;
-    }
-	else if (token == "discrete")
+    if (parseSurfaceFlag(token, _surfaceFlags))
     {
-        _surfaceFlags |= Material::SURF_DISCRETE;
+        return true;
     }
-	else if (token == "nofragment")
-    {
-        _surfaceFlags |= Material::SURF_NOFRAGMENT;
-    }
-	else if (token == "slick")
-    {
-        _surfaceFlags |= Material::SURF_SLICK;
-    }
-	else if (token == "collision")
-    {
-        _surfaceFlags |= Material::SURF_COLLISION;
-    }
-	else if (token == "noimpact")
-    {
-        _surfaceFlags |= Material::SURF_NOIMPACT;
-    }
-	else if (token == "nodamage")
-    {
-        _surfaceFlags |= Material::SURF_NODAMAGE;
-    }
-	else if (token == "ladder")
-    {
-        _surfaceFlags |= Material::SURF_LADDER;
-    }
-	else if (token == "nosteps")
-    {
-        _surfaceFlags |= Material::SURF_NOSTEPS;
-    }
-	else if (token == "metal")
+
+    if (token == "metal")
     {
 		_surfaceType = Material::SURFTYPE_METAL;
     }
@@ -1147,7 +884,7 @@ bool ShaderTemplate::saveLayer()
 void ShaderTemplate::parseDefinition()
 {
     // Construct a local deftokeniser to parse the unparsed block
-    parser::BasicDefTokeniser<std::string> tokeniser(
+    parser::BufferDefTokeniser tokeniser(
         _blockContents,
 		parser::WHITESPACE, // delimiters (whitespace)
         "{}(),"  // add the comma character to the kept delimiters
@@ -1208,79 +945,29 @@ void ShaderTemplate::parseDefinition()
             << p.what() << std::endl;
     }
 
-	// greebo: It appears that D3 is applying default sort values for material without
-	// an explicitly defined sort value, depending on a couple of things I didn't really investigate
-	// Some blend materials get SORT_MEDIUM applied by default, diffuses get OPAQUE assigned, but lights do not, etc.
 	if (_sortReq == SORT_UNDEFINED)
 	{
-		// Translucent materials need to be drawn after opaque ones, if not explicitly specified otherwise
-		if (_materialFlags & Material::FLAG_TRANSLUCENT)
-		{
-			_sortReq = Material::SORT_MEDIUM;
-		}
-		else
-		{
-			_sortReq = Material::SORT_OPAQUE;
-		}
+		_sortReq = getDefaultSortRequest(_materialFlags);
 	}
 
-	std::size_t numAmbientStages = 0;
-
-	for (Layers::const_iterator i = _layers.begin(); i != _layers.end(); ++i)
-	{
-		if ((*i)->getType() == ShaderLayer::BLEND)
-		{
-			numAmbientStages++;
-		}
-	}
-	
 	// Determine coverage if not yet done
 	if (_coverage == Material::MC_UNDETERMINED)
 	{
-		// automatically set MC_TRANSLUCENT if we don't have any interaction stages and 
-		// the first stage is blended and not an alpha test mask or a subview
-		if (_layers.empty())
-		{
-			// non-visible
-			_coverage = Material::MC_TRANSLUCENT;
-		} 
-		else if (_layers.size() != numAmbientStages)
-		{
-			// we have an interaction draw
-			_coverage = Material::MC_OPAQUE;
-		}
-		else
-		{
-			const Doom3ShaderLayer& firstLayer = **_layers.begin();
-
-			BlendFunc blend = firstLayer.getBlendFunc();
+		std::size_t numInteractionStages = 0;
 
-			// If the layers are blended with the destination, we consider it translucent
-			if (blend.dest != GL_ZERO || 
-				blend.src == GL_DST_COLOR ||
-				blend.src == GL_ONE_MINUS_DST_COLOR ||
-				blend.src == GL_DST_ALPHA ||
-				blend.src == GL_ONE_MINUS_DST_ALPHA)
-			{
-				_coverage = Material::MC_TRANSLUCENT;
-			}
-			else
+		for (Layers::const_iterator i = _layers.begin(); i != _layers.end(); ++i)
+		{
+			if ((*i)->getType() != ShaderLayer::BLEND)
 			{
-				_coverage = Material::MC_OPAQUE;
+				numInteractionStages++;
 			}
 		}
-	}
 
-	// translucent automatically implies noshadows
-	if (_coverage == Material::MC_TRANSLUCENT)
-	{
-		_materialFlags |= Material::FLAG_NOSHADOWS;
-	} 
-	else 
-	{
-		// mark the contents as opaque
-		_surfaceFlags |= Material::SURF_OPAQUE;
+		_coverage = determineCoverage(_layers.size(), numInteractionStages, 
+			_layers.empty() ? StringPair() : _layers.front()->getBlendFuncStrings());
 	}
+
+	applyCoverageFlags(_coverage, _materialFlags, _surfaceFlags);
 }
 
 void ShaderTemplate::addLayer(const Doom3ShaderLayerPtr& layer)
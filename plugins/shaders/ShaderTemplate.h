@@ -285,7 +285,6 @@ private:
     bool parseStageModifiers(parser::DefTokeniser&, const std::string&);
 	bool parseSurfaceFlags(parser::DefTokeniser&, const std::string&);
 	bool parseCondition(parser::DefTokeniser&, const std::string&);
-	IShaderExpressionPtr parseSingleExpressionTerm(parser::DefTokeniser& tokeniser);
 
 	bool saveLayer();
 
@@ -3,6 +3,7 @@
 #include "itextstream.h"
 #include "ifilesystem.h"
 #include "iarchive.h"
+#include "parser/BufferDefTokeniser.h"
 
 #include <iostream>
 
@@ -13,6 +14,13 @@ namespace {
 // CONSTANTS
 const char* SKINS_FOLDER = "skins/";
 
+// The parse results of unchanged skin files are stored here, in the settings folder
+const char* const PARSE_CACHE_FILE = "skins.cache";
+
+// Identifies the layout of the cached data, change it along with
+// WriteCacheData() and ReadCacheData()
+const char* const PARSE_CACHE_FORMAT = "skins1";
+
 } // blank namespace
 
 // Realise the skin cache
@@ -23,27 +31,22 @@ void Doom3SkinCache::realise()
 
 	rMessage() << "[skins] Loading skins." << std::endl;
 
+	parser::ParseCache cache(
+		module::GlobalModuleRegistry().getApplicationContext().getSettingsPath() + PARSE_CACHE_FILE,
+		PARSE_CACHE_FORMAT
+	);
+	cache.load();
+
 	// Use a functor to traverse the skins directory, catching any parse
 	// exceptions that may be thrown
 	try
 	{
         GlobalFileSystem().forEachFile(SKINS_FOLDER, "skin", [&] (const std::string& filename)
         {
-            // Open the .skin file and get its contents as a std::string
-            ArchiveTextFilePtr file = GlobalFileSystem().openTextFile(SKINS_FOLDER + filename);
-            assert(file);
-
-            std::istream is(&(file->getInputStream()));
-
-            try 
-            {
-                // Pass the contents back to the SkinCache module for parsing
-                parseFile(is, filename);
-            }
-            catch (parser::ParseException& e)
-            {
-                std::cout << "[skins]: in " << filename << ": " << e.what() << std::endl;
-            }
+            SkinDecls decls;
+            loadFile(filename, cache, decls);
+
+            addSkins(decls, filename);
         });
 	}
 	catch (parser::ParseException& e)
@@ -51,49 +54,92 @@ void Doom3SkinCache::realise()
 		std::cout << "[skins]: " << e.what() << std::endl;
 	}
 
+	if (!cache.save())
+	{
+		rWarning() << "[skins] Could not write the parse cache." << std::endl;
+	}
+
 	// Set the realised flag
 	_realised = true;
 }
 
+void Doom3SkinCache::loadFile(const std::string& filename, parser::ParseCache& cache, SkinDecls& decls)
+{
+	const std::string fullname = SKINS_FOLDER + filename;
+
+	parser::ParseCache::FileStamp stamp = cache.getStamp(GlobalFileSystem().findPhysicalFile(fullname));
+
+	const std::string* cached = cache.findByStamp(fullname, stamp);
+
+	if (cached != NULL && ReadCacheData(*cached, decls))
+	{
+		return; // unchanged since the last run
+	}
+
+	// Open the .skin file and get its contents as a std::string
+	ArchiveTextFilePtr file = GlobalFileSystem().openTextFile(fullname);
+	assert(file);
+
+	std::string contents;
+
+	{
+		std::istream is(&(file->getInputStream()));
+		parser::readStream(is, contents);
+	}
+
+	// The archive might have changed, but not this file
+	std::uint64_t contentHash = parser::ParseCache::GetContentHash(contents);
+
+	cached = cache.findByContent(fullname, stamp, contentHash);
+
+	if (cached != NULL && ReadCacheData(*cached, decls))
+	{
+		return;
+	}
+
+	// Files with errors are parsed again, to get the same messages on the next run
+	if (parseFile(contents, filename, decls))
+	{
+		cache.store(fullname, stamp, contentHash, WriteCacheData(decls));
+	}
+}
+
 // Parse the contents of a .skin file
-void Doom3SkinCache::parseFile(std::istream& contents, const std::string& filename)
+bool Doom3SkinCache::parseFile(const std::string& contents, const std::string& filename, SkinDecls& decls)
 {
-	// Construct a DefTokeniser to parse the file
-	parser::BasicDefTokeniser<std::istream> tok(contents);
-
-	// Call the parseSkin() function for each skin decl
-	while (tok.hasMoreTokens()) {
-		try {
-			// Try to parse the skin
-			Doom3ModelSkinPtr modelSkin = parseSkin(tok);
-			std::string skinName = modelSkin->getName();
-
-			modelSkin->setSkinFileName(filename);
-
-			NamedSkinMap::iterator found = _namedSkins.find(skinName);
-
-			// Is this already defined?
-			if (found != _namedSkins.end()) {
-				std::cout << "[skins] in " << filename << ": skin " + skinName +
-						     " previously defined in " +
-							 found->second->getSkinFileName() + "!\n";
-				// Don't insert the skin into the list
+	bool success = true;
+
+	try
+	{
+		// Construct a DefTokeniser to parse the file
+		parser::BufferDefTokeniser tok(contents);
+
+		// Call the parseSkin() function for each skin decl
+		while (tok.hasMoreTokens()) {
+			try {
+				// Try to parse the skin, it is dropped if that fails
+				SkinDecl decl;
+				parseSkin(tok, decl);
+
+				decls.push_back(decl);
 			}
-			else {
-				// Add the populated Doom3ModelSkin to the hashtable and the name to the
-				// list of all skins
-				_namedSkins.insert(NamedSkinMap::value_type(skinName, modelSkin));
-				_allSkins.push_back(skinName);
+			catch (parser::ParseException& e) {
+				std::cout << "[skins]: in " << filename << ": " << e.what() << "\n";
+				success = false;
 			}
 		}
-		catch (parser::ParseException& e) {
-			std::cout << "[skins]: in " << filename << ": " << e.what() << "\n";
-		}
 	}
+	catch (parser::ParseException& e)
+	{
+		std::cout << "[skins]: in " << filename << ": " << e.what() << std::endl;
+		success = false;
+	}
+
+	return success;
 }
 
 // Parse an individual skin declaration
-Doom3ModelSkinPtr Doom3SkinCache::parseSkin(parser::DefTokeniser& tok) {
+void Doom3SkinCache::parseSkin(parser::DefTokeniser& tok, SkinDecl& decl) {
 
 	// [ "skin" ] <name> "{"
 	//			[ "model" <modelname> ]
@@ -102,15 +148,12 @@ Doom3ModelSkinPtr Doom3SkinCache::parseSkin(parser::DefTokeniser& tok) {
 
 	// Parse the skin name, this is either the first token or the second token
 	// (preceded by "skin")
-	std::string skinName = tok.nextToken();
-	if (skinName == "skin")
-		skinName = tok.nextToken();
+	decl.name = tok.nextToken();
+	if (decl.name == "skin")
+		decl.name = tok.nextToken();
 
 	tok.assertNextToken("{");
 
-	// Create the skin object
-	Doom3ModelSkinPtr skin(new Doom3ModelSkin(skinName));
-
 	// Read key/value pairs until end of decl
 	std::string key = tok.nextToken();
 	while (key != "}") {
@@ -118,25 +161,113 @@ Doom3ModelSkinPtr Doom3SkinCache::parseSkin(parser::DefTokeniser& tok) {
 		// Read the value
 		std::string value = tok.nextToken();
 
-		if (value == "}") {
-			std::cout << "[skins] Warning: '}' found where shader name expected in skin: "
-					  << skinName << "\n";
+		decl.keyValues.push_back(std::make_pair(key, value));
+
+		// Get next key
+		key = tok.nextToken();
+	}
+}
+
+void Doom3SkinCache::addSkins(const SkinDecls& decls, const std::string& filename)
+{
+	for (SkinDecls::const_iterator decl = decls.begin(); decl != decls.end(); ++decl)
+	{
+		const std::string& skinName = decl->name;
+
+		// Create the skin object
+		Doom3ModelSkinPtr modelSkin(new Doom3ModelSkin(skinName));
+		modelSkin->setSkinFileName(filename);
+
+		for (std::vector<std::pair<std::string, std::string> >::const_iterator i = decl->keyValues.begin();
+			 i != decl->keyValues.end(); ++i)
+		{
+			if (i->second == "}") {
+				std::cout << "[skins] Warning: '}' found where shader name expected in skin: "
+						  << skinName << "\n";
+			}
+
+			// If this is a model key, add to the model->skin map, otherwise assume
+			// this is a remap declaration
+			if (i->first == "model") {
+				_modelSkins[i->second].push_back(skinName);
+			}
+			else {
+				modelSkin->addRemap(i->first, i->second);
+			}
 		}
 
-		// If this is a model key, add to the model->skin map, otherwise assume
-		// this is a remap declaration
-		if (key == "model") {
-			_modelSkins[value].push_back(skinName);
+		NamedSkinMap::iterator found = _namedSkins.find(skinName);
+
+		// Is this already defined?
+		if (found != _namedSkins.end()) {
+			std::cout << "[skins] in " << filename << ": skin " + skinName +
+					     " previously defined in " +
+						 found->second->getSkinFileName() + "!\n";
+			// Don't insert the skin into the list
 		}
 		else {
-			skin->addRemap(key, value);
+			// Add the populated Doom3ModelSkin to the hashtable and the name to the
+			// list of all skins
+			_namedSkins.insert(NamedSkinMap::value_type(skinName, modelSkin));
+			_allSkins.push_back(skinName);
 		}
+	}
+}
 
-		// Get next key
-		key = tok.nextToken();
+std::string Doom3SkinCache::WriteCacheData(const SkinDecls& decls)
+{
+	std::string data;
+	parser::CacheWriter writer(data);
+
+	writer.writeInt(static_cast<std::uint32_t>(decls.size()));
+
+	for (SkinDecls::const_iterator decl = decls.begin(); decl != decls.end(); ++decl)
+	{
+		writer.writeString(decl->name);
+		writer.writeInt(static_cast<std::uint32_t>(decl->keyValues.size()));
+
+		for (std::vector<std::pair<std::string, std::string> >::const_iterator i = decl->keyValues.begin();
+			 i != decl->keyValues.end(); ++i)
+		{
+			writer.writeString(i->first);
+			writer.writeString(i->second);
+		}
+	}
+
+	return data;
+}
+
+bool Doom3SkinCache::ReadCacheData(const std::string& data, SkinDecls& decls)
+{
+	try
+	{
+		parser::CacheReader reader(data);
+
+		std::size_t numDecls = reader.readInt();
+
+		for (std::size_t d = 0; d < numDecls; ++d)
+		{
+			decls.push_back(SkinDecl());
+			SkinDecl& decl = decls.back();
+
+			decl.name = reader.readString();
+
+			std::size_t numKeyValues = reader.readInt();
+
+			for (std::size_t i = 0; i < numKeyValues; ++i)
+			{
+				std::string key = reader.readString();
+				decl.keyValues.push_back(std::make_pair(key, reader.readString()));
+			}
+		}
+	}
+	catch (parser::ParseException&)
+	{
+		decls.clear();
+		return false;
 	}
 
-	return skin;
+	return true;
 }
 
 const std::string& Doom3SkinCache::getName() const {
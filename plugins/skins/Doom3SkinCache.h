@@ -6,6 +6,7 @@
 #include "imodule.h"
 #include "modelskin.h"
 #include "parser/DefTokeniser.h"
+#include "parser/ParseCache.h"
 
 #include <map>
 #include <string>
@@ -40,6 +41,16 @@ class Doom3SkinCache :
 	// Empty Doom3ModelSkin to return if a named skin is not found
 	Doom3ModelSkin _nullSkin;
 
+	// A parsed skin declaration, before it is added to the maps above
+	struct SkinDecl
+	{
+		std::string name;
+
+		// The "model" keys and remaps in declaration order
+		std::vector<std::pair<std::string, std::string> > keyValues;
+	};
+	typedef std::vector<SkinDecl> SkinDecls;
+
 private:
 
 	// Load and parse the skin files, populating internal data structures.
@@ -47,8 +58,22 @@ private:
 	// realised.
 	void realise();
 
-	// Parse an individual skin declaration and add return the skin object
-	Doom3ModelSkinPtr parseSkin(parser::DefTokeniser& tokeniser);
+	// Load the skin declarations of the given file from the parse cache, or
+	// parse them if the file has changed since the last run
+	void loadFile(const std::string& filename, parser::ParseCache& cache, SkinDecls& decls);
+
+	// Parse the given contents of a .skin file, returns false if any of the
+	// declarations could not be parsed
+	bool parseFile(const std::string& contents, const std::string& filename, SkinDecls& decls);
+
+	// Parse an individual skin declaration
+	void parseSkin(parser::DefTokeniser& tokeniser, SkinDecl& decl);
+
+	// Add the skin declarations of the given file to the internal data structures
+	void addSkins(const SkinDecls& decls, const std::string& filename);
+
+	static std::string WriteCacheData(const SkinDecls& decls);
+	static bool ReadCacheData(const std::string& data, SkinDecls& decls);
 
 public:
 	/* Constructor.
@@ -89,13 +114,6 @@ public:
 	 */
 	void refresh();
 
-	/* Parse the provided istream as a .skin file, and add all skins found within
-	 * to the internal data structures.
-	 *
-	 * @filename: This is for informational purposes only (error message display).
-	 */
-	void parseFile(std::istream& contents, const std::string& filename);
-
 	// RegisterableModule implementation
 	virtual const std::string& getName() const;
 	virtual const StringSet& getDependencies() const;
@@ -2,7 +2,7 @@
 
 #include "SoundManager.h"
 
-#include "parser/DefBlockTokeniser.h"
+#include "parser/BufferDefBlockTokeniser.h"
 #include "parser/DefTokeniser.h"
 #include "ifilesystem.h"
 #include "iarchive.h"
@@ -46,7 +46,7 @@ private:
     {
         // Construct a DefTokeniser to tokenise the string into sound shader
         // decls
-        parser::BasicDefBlockTokeniser<std::istream> tok(contents);
+        parser::BufferDefBlockTokeniser tok(contents);
 
         while (tok.hasMoreBlocks())
         {
@@ -1,6 +1,6 @@
 #include "SoundShader.h"
 
-#include "parser/DefTokeniser.h"
+#include "parser/BufferDefTokeniser.h"
 #include "string/convert.h"
 #include <algorithm>
 #include <boost/algorithm/string/predicate.hpp>
@@ -38,7 +38,7 @@ void SoundShader::parseDefinition() const
 	_contents.reset(new ParsedContents);
 
 	// Get a new tokeniser and parse the block
-	parser::BasicDefTokeniser<std::string> tok(_blockContents);
+	parser::BufferDefTokeniser tok(_blockContents);
 
 	while (tok.hasMoreTokens())
     {
@@ -292,6 +292,21 @@ std::string Doom3FileSystem::findFile(const std::string& name) {
     return "";
 }
 
+std::string Doom3FileSystem::findPhysicalFile(const std::string& name)
+{
+    // Same lookup order as openFile()
+    for (ArchiveList::iterator i = _archives.begin(); i != _archives.end(); ++i)
+    {
+        if (i->archive->containsFile(name))
+        {
+            // Directory archive names carry a trailing slash
+            return i->is_pakfile ? i->name : i->name + name;
+        }
+    }
+
+    return "";
+}
+
 std::string Doom3FileSystem::findRoot(const std::string& name) {
     for (ArchiveList::iterator i = _archives.begin(); i != _archives.end(); ++i) {
         if (!i->is_pakfile && path_equal_n(name.c_str(), i->name.c_str(), i->name.size())) {
@@ -55,6 +55,7 @@ public:
                                    std::size_t depth = 1);
 
 	std::string findFile(const std::string& name);
+	std::string findPhysicalFile(const std::string& name);
 	std::string findRoot(const std::string& name);
 
 	virtual void addObserver(Observer& observer);
@@ -25,6 +25,7 @@ public:
 			m_winding.resize(0);
 		}
 		m_winding.updateNormals(m_plane.normal());
+		m_winding.queueUpdate();
 	}
 
 	void render(const RenderInfo& info) const {
@@ -315,6 +315,10 @@ bool BrushNode::intersectsLight(const RendererLight& light) const {
 	return light.intersectsAABB(worldAABB());
 }
 
+const AABB& BrushNode::getLitObjectBounds() const {
+	return worldAABB();
+}
+
 void BrushNode::insertLight(const RendererLight& light) {
 	const Matrix4& l2w = localToWorld();
 	for (FaceInstances::iterator i = m_faceInstances.begin(); i != m_faceInstances.end(); ++i) {
@@ -393,6 +397,16 @@ bool BrushNode::isHighlighted() const
 	return isSelected();
 }
 
+bool BrushNode::prepareParallelCollection() const
+{
+	// Building the b-rep might change the bounds, and the light intersection tests
+	// are evaluating the lights' shared data
+	m_brush.evaluateBRep();
+	m_lightList->calculateIntersectingLights();
+
+	return true;
+}
+
 void BrushNode::evaluateViewDependent(const VolumeTest& volume, const Matrix4& localToWorld) const
 {
 	if (!m_viewChanged) return;
@@ -400,10 +414,11 @@ void BrushNode::evaluateViewDependent(const VolumeTest& volume, const Matrix4& l
 	m_viewChanged = false;
 
 	// Array of booleans to indicate which faces are visible
-	static bool faces_visible[c_brush_maxFaces];
+	// (not static, this might be called by several threads at once)
+	bool faces_visible[c_brush_maxFaces];
 
 	// Will hold the indices of all visible faces (from the current viewpoint)
-	static std::size_t visibleFaceIndices[c_brush_maxFaces];
+	std::size_t visibleFaceIndices[c_brush_maxFaces];
 
 	std::size_t numVisibleFaces(0);
 	bool* j = faces_visible;
@@ -134,6 +134,7 @@ public:
 
 	// LitObject implementation
 	bool intersectsLight(const RendererLight& light) const;
+	const AABB& getLitObjectBounds() const;
 	void insertLight(const RendererLight& light);
 	void clearLights();
 
@@ -145,6 +146,7 @@ public:
 
 	void viewChanged() const;
 	bool isHighlighted() const;
+	bool prepareParallelCollection() const;
 
 	void evaluateTransform();
 
@@ -303,6 +303,7 @@ void Face::freezeTransform() {
 
 void Face::updateWinding() {
     m_winding.updateNormals(m_plane.getPlane().normal());
+    m_winding.queueUpdate();
 }
 
 void Face::update_move_planepts_vertex(std::size_t index, PlanePoints planePoints) {
@@ -476,6 +477,7 @@ void Face::alignTexture(EAlignType align)
 
 void Face::EmitTextureCoordinates() {
     m_texdefTransformed.emitTextureCoordinates(m_winding, plane3().normal(), Matrix4::getIdentity());
+    m_winding.queueUpdate();
 }
 
 const Vector3& Face::centroid() const {
@@ -33,6 +33,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "debugging/render.h"
 
+#include <cstddef>
+
+Winding::VertexCacheBatch Winding::_renderBatch;
+
 namespace {
 	struct indexremap_t {
 		indexremap_t(std::size_t _x, std::size_t _y, std::size_t _z) :
@@ -42,6 +46,12 @@ namespace {
 		std::size_t x, y, z;
 	};
 
+	// Returns the offset of the given vertex member in the vertex cache's buffer
+	inline const GLvoid* vertexCacheOffset(std::size_t memberOffset)
+	{
+		return reinterpret_cast<const GLvoid*>(memberOffset);
+	}
+
 	inline indexremap_t indexremap_for_projectionaxis(const ProjectionAxis axis) {
 		switch (axis) {
 			case eProjectionAxisX:
@@ -56,11 +66,40 @@ namespace {
 
 void Winding::drawWireframe() const
 {
-	if (!empty())
+	if (empty()) return;
+
+	if (!bindVertexCache())
 	{
 		glVertexPointer(3, GL_DOUBLE, sizeof(WindingVertex), &front().vertex);
 		glDrawArrays(GL_LINE_LOOP, 0, GLsizei(size()));
+		return;
 	}
+
+	glVertexPointer(3, GL_FLOAT, sizeof(WindingVertexCache::Vertex),
+		vertexCacheOffset(offsetof(WindingVertexCache::Vertex, vertex)));
+	glDrawArrays(GL_LINE_LOOP, GLint(_cacheSlot.offset), GLsizei(size()));
+
+	WindingVertexCache::Instance().unbind();
+}
+
+bool Winding::bindVertexCache() const
+{
+	WindingVertexCache& cache = WindingVertexCache::Instance();
+
+	if (!cache.isAvailable())
+	{
+		return false;
+	}
+
+	if (needsCacheUpdate())
+	{
+		_cacheNeedsUpdate = false;
+		cache.update(_cacheSlot, &front(), size());
+	}
+
+	cache.bind();
+
+	return true;
 }
 
 void Winding::render(const RenderInfo& info) const
@@ -71,6 +110,106 @@ void Winding::render(const RenderInfo& info) const
 		return;
 	}
 
+	if (!bindVertexCache())
+	{
+		renderClientSide(info);
+		return;
+	}
+
+	setVertexCachePointers(info);
+
+	glDrawArrays(GL_POLYGON, GLint(_cacheSlot.offset), GLsizei(size()));
+
+	WindingVertexCache::Instance().unbind();
+}
+
+RenderBatch* Winding::getRenderBatch() const
+{
+	return WindingVertexCache::Instance().isAvailable() ? &_renderBatch : NULL;
+}
+
+void Winding::VertexCacheBatch::render(const RenderInfo& info,
+	const OpenGLRenderable* const* renderables, std::size_t count)
+{
+	_first.clear();
+	_count.clear();
+
+	WindingVertexCache& cache = WindingVertexCache::Instance();
+
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		// Only windings return this batch
+		const Winding& winding = *static_cast<const Winding*>(renderables[i]);
+
+		if (winding.empty()) continue;
+
+		if (winding.needsCacheUpdate())
+		{
+			winding._cacheNeedsUpdate = false;
+			cache.update(winding._cacheSlot, &winding.front(), winding.size());
+		}
+
+		_first.push_back(GLint(winding._cacheSlot.offset));
+		_count.push_back(GLsizei(winding.size()));
+	}
+
+	if (_first.empty()) return;
+
+	cache.bind();
+
+	setVertexCachePointers(info);
+
+	// Every winding is drawn as a separate polygon
+	glMultiDrawArrays(GL_POLYGON, &_first.front(), &_count.front(), GLsizei(_first.size()));
+
+	cache.unbind();
+}
+
+void Winding::setVertexCachePointers(const RenderInfo& info)
+{
+    // Our vertex colours are always white, if requested
+    glDisableClientState(GL_COLOR_ARRAY);
+    if (info.checkFlag(RENDER_VERTEX_COLOUR))
+    {
+        glColor3f(1, 1, 1);
+    }
+
+	typedef WindingVertexCache::Vertex Vertex;
+	const GLsizei stride = sizeof(Vertex);
+
+	// The pointers are offsets into the bound buffer, the slot is selected by glDrawArrays
+	glVertexPointer(3, GL_FLOAT, stride, vertexCacheOffset(offsetof(Vertex, vertex)));
+
+    // Check render flags. Multiple flags may be set, so the order matters.
+    if (info.checkFlag(RENDER_TEXTURE_CUBEMAP))
+    {
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(3, GL_FLOAT, stride, vertexCacheOffset(offsetof(Vertex, vertex)));
+    }
+	else if (info.checkFlag(RENDER_BUMP))
+    {
+		glVertexAttribPointer(ATTR_NORMAL, 3, GL_FLOAT, 0, stride, vertexCacheOffset(offsetof(Vertex, normal)));
+		glVertexAttribPointer(ATTR_TEXCOORD, 2, GL_FLOAT, 0, stride, vertexCacheOffset(offsetof(Vertex, texcoord)));
+		glVertexAttribPointer(ATTR_TANGENT, 3, GL_FLOAT, 0, stride, vertexCacheOffset(offsetof(Vertex, tangent)));
+		glVertexAttribPointer(ATTR_BITANGENT, 3, GL_FLOAT, 0, stride, vertexCacheOffset(offsetof(Vertex, bitangent)));
+	}
+	else
+    {
+		if (info.checkFlag(RENDER_LIGHTING))
+        {
+			glNormalPointer(GL_FLOAT, stride, vertexCacheOffset(offsetof(Vertex, normal)));
+		}
+
+		if (info.checkFlag(RENDER_TEXTURE_2D))
+        {
+            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+            glTexCoordPointer(2, GL_FLOAT, stride, vertexCacheOffset(offsetof(Vertex, texcoord)));
+		}
+	}
+}
+
+void Winding::renderClientSide(const RenderInfo& info) const
+{
     // Our vertex colours are always white, if requested
     glDisableClientState(GL_COLOR_ARRAY);
     if (info.checkFlag(RENDER_VERTEX_COLOUR))
@@ -149,6 +288,8 @@ void Winding::updateNormals(const Vector3& normal)
 	{
 		i->normal = normal;
 	}
+
+	_cacheNeedsUpdate = true;
 }
 
 AABB Winding::aabb() const
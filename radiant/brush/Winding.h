@@ -34,6 +34,8 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "math/Vector2.h"
 #include "math/Vector3.h"
 
+#include "WindingVertexCache.h"
+
 const double ON_EPSILON	= 1.0 / (1 << 8);
 
 class SelectionIntersection;
@@ -44,7 +46,58 @@ class Winding :
 	public IWinding,
     public OpenGLRenderable
 {
+private:
+	// The vertex range of this winding in the WindingVertexCache
+	mutable WindingVertexCache::Slot _cacheSlot;
+
+	// True if the cached vertices need to be updated before rendering
+	mutable bool _cacheNeedsUpdate;
+
+	// Draws windings from the WindingVertexCache with a single glMultiDrawArrays call
+	class VertexCacheBatch :
+		public RenderBatch
+	{
+	private:
+		// The slot ranges passed to glMultiDrawArrays, kept to avoid re-allocations
+		std::vector<GLint> _first;
+		std::vector<GLsizei> _count;
+
+	public:
+		void render(const RenderInfo& info, const OpenGLRenderable* const* renderables, std::size_t count) override;
+	};
+
+	// The batch shared by all windings
+	static VertexCacheBatch _renderBatch;
+
 public:
+	Winding() :
+		_cacheNeedsUpdate(true)
+	{}
+
+	// Copies the vertices only, the copy gets its own cache slot
+	Winding(const Winding& other) :
+		IWinding(other),
+		_cacheNeedsUpdate(true)
+	{}
+
+	Winding& operator=(const Winding& other)
+	{
+		IWinding::operator=(other);
+		_cacheNeedsUpdate = true;
+		return *this;
+	}
+
+	~Winding()
+	{
+		WindingVertexCache::Instance().release(_cacheSlot);
+	}
+
+	// Marks the vertex data as changed, to be uploaded before the next render() call
+	void queueUpdate()
+	{
+		_cacheNeedsUpdate = true;
+	}
+
 	/** greebo: Calculates the AABB of this winding
 	 */
 	AABB aabb() const;
@@ -52,15 +105,40 @@ public:
 	void testSelect(SelectionTest& test, SelectionIntersection& best);
 
 	// greebo: Updates the array containing the normal vectors of this winding
-	// The normal is the same for each vertex, so this just copies the values
+	// The normal is the same for each vertex, so this just copies the values.
+	// Queues an update of the cached vertices as well.
 	void updateNormals(const Vector3& normal);
 
 	// Submits this winding to OpenGL
 	void render(const RenderInfo& info) const;
 
+	// Returns the batch drawing windings from the vertex cache, NULL without VBO support
+	RenderBatch* getRenderBatch() const override;
+
 	// Submits the wireframe render commands to OpenGL
 	void drawWireframe() const;
 
+private:
+	// True if the cached vertices are outdated. Windings which grew without
+	// queueUpdate() being called are updated too, rather than drawing past
+	// the end of their slot.
+	bool needsCacheUpdate() const
+	{
+		return _cacheNeedsUpdate || _cacheSlot.capacity < size();
+	}
+
+	// Uploads changed vertices and binds the cache's buffer. Returns false if
+	// VBOs are not supported, the client-side arrays need to be used then.
+	bool bindVertexCache() const;
+
+	// Renders from the client-side arrays, used without VBO support
+	void renderClientSide(const RenderInfo& info) const;
+
+	// Sets the array pointers needed by the given render flags to the bound vertex cache
+	static void setVertexCachePointers(const RenderInfo& info);
+
+public:
+
 	// Wraps the given index around if it's larger than the size of this winding
 	inline std::size_t wrap(std::size_t i) const
 	{
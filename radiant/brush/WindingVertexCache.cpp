@@ -0,0 +1,159 @@
+#include "WindingVertexCache.h"
+
+#include "ibrush.h"
+#include <algorithm>
+
+namespace
+{
+	// The smallest slot capacity is 2^MIN_SLOT_SHIFT vertices
+	const std::size_t MIN_SLOT_SHIFT = 2;
+
+	// The initial size of the buffer, in vertices
+	const std::size_t INITIAL_CAPACITY = 1 << 16;
+
+	inline void copyVector(float* dest, const Vector3& source)
+	{
+		dest[0] = static_cast<float>(source.x());
+		dest[1] = static_cast<float>(source.y());
+		dest[2] = static_cast<float>(source.z());
+	}
+}
+
+WindingVertexCache::WindingVertexCache() :
+	_vbo(0),
+	_vboCapacity(0),
+	_dirtyBegin(0),
+	_dirtyEnd(0)
+{}
+
+WindingVertexCache& WindingVertexCache::Instance()
+{
+	static WindingVertexCache _instance;
+	return _instance;
+}
+
+bool WindingVertexCache::isAvailable() const
+{
+	return GLEW_VERSION_1_5 ? true : false;
+}
+
+void WindingVertexCache::update(Slot& slot, const WindingVertex* vertices, std::size_t count)
+{
+	if (slot.capacity < count)
+	{
+		release(slot);
+		allocate(slot, count);
+	}
+
+	Vertex* dest = &_vertices[slot.offset];
+
+	for (std::size_t i = 0; i < count; ++i, ++dest)
+	{
+		const WindingVertex& source = vertices[i];
+
+		copyVector(dest->vertex, source.vertex);
+		dest->texcoord[0] = static_cast<float>(source.texcoord.x());
+		dest->texcoord[1] = static_cast<float>(source.texcoord.y());
+		copyVector(dest->tangent, source.tangent);
+		copyVector(dest->bitangent, source.bitangent);
+		copyVector(dest->normal, source.normal);
+	}
+
+	if (_dirtyBegin == _dirtyEnd)
+	{
+		_dirtyBegin = slot.offset;
+		_dirtyEnd = slot.offset + count;
+	}
+	else
+	{
+		_dirtyBegin = std::min(_dirtyBegin, slot.offset);
+		_dirtyEnd = std::max(_dirtyEnd, slot.offset + count);
+	}
+}
+
+void WindingVertexCache::release(Slot& slot)
+{
+	if (slot.capacity == 0) return;
+
+	std::size_t sizeClass = 0;
+
+	while ((std::size_t(1) << sizeClass) < slot.capacity)
+	{
+		++sizeClass;
+	}
+
+	_freeSlots[sizeClass].push_back(slot.offset);
+
+	slot = Slot();
+}
+
+void WindingVertexCache::allocate(Slot& slot, std::size_t count)
+{
+	std::size_t sizeClass = MIN_SLOT_SHIFT;
+
+	while ((std::size_t(1) << sizeClass) < count)
+	{
+		++sizeClass;
+	}
+
+	if (_freeSlots.size() <= sizeClass)
+	{
+		_freeSlots.resize(sizeClass + 1);
+	}
+
+	slot.capacity = std::size_t(1) << sizeClass;
+
+	std::vector<std::size_t>& freeSlots = _freeSlots[sizeClass];
+
+	if (!freeSlots.empty())
+	{
+		slot.offset = freeSlots.back();
+		freeSlots.pop_back();
+		return;
+	}
+
+	// Append a new slot to the buffer
+	slot.offset = _vertices.size();
+
+	if (_vertices.capacity() < slot.offset + slot.capacity)
+	{
+		_vertices.reserve(std::max(INITIAL_CAPACITY, _vertices.capacity() * 2));
+	}
+
+	_vertices.resize(slot.offset + slot.capacity);
+}
+
+void WindingVertexCache::bind()
+{
+	if (_vbo == 0)
+	{
+		glGenBuffers(1, &_vbo);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+
+	if (_vertices.empty()) return;
+
+	if (_vboCapacity < _vertices.size())
+	{
+		// The buffer has grown, re-allocate the storage and upload everything
+		_vboCapacity = _vertices.capacity();
+
+		glBufferData(GL_ARRAY_BUFFER, _vboCapacity * sizeof(Vertex), NULL, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, _vertices.size() * sizeof(Vertex), &_vertices.front());
+	}
+	else if (_dirtyBegin != _dirtyEnd)
+	{
+		glBufferSubData(GL_ARRAY_BUFFER,
+			_dirtyBegin * sizeof(Vertex),
+			(_dirtyEnd - _dirtyBegin) * sizeof(Vertex),
+			&_vertices[_dirtyBegin]);
+	}
+
+	_dirtyBegin = _dirtyEnd = 0;
+}
+
+void WindingVertexCache::unbind()
+{
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
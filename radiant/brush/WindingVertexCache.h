@@ -0,0 +1,86 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <vector>
+#include <cstddef>
+
+struct WindingVertex;
+
+/**
+ * Stores the vertices of all brush windings in a single OpenGL
+ * vertex buffer object, converted to single precision floats.
+ *
+ * Every winding reserves a slot in the buffer, whose capacity is rounded
+ * up to a power of two, such that the slot can be reused when the winding
+ * is changed. Freed slots are kept in a free list per capacity.
+ *
+ * Changed windings are only copied to the client-side shadow of the buffer,
+ * the modified range is uploaded on the next bind() call. This way every
+ * changed brush is converted and uploaded once, unchanged brushes don't
+ * transfer any vertex data at all.
+ */
+class WindingVertexCache
+{
+public:
+	// The vertex layout in the buffer
+	struct Vertex
+	{
+		float vertex[3];
+		float texcoord[2];
+		float tangent[3];
+		float bitangent[3];
+		float normal[3];
+	};
+
+	// The vertex range reserved for a single winding
+	struct Slot
+	{
+		std::size_t offset;
+		std::size_t capacity; // 0 if unallocated
+
+		Slot() :
+			offset(0),
+			capacity(0)
+		{}
+	};
+
+private:
+	GLuint _vbo;
+
+	// The number of vertices the VBO storage has been allocated for
+	std::size_t _vboCapacity;
+
+	// Client-side copy of the buffer contents
+	std::vector<Vertex> _vertices;
+
+	// The range of vertices which changed since the last upload
+	std::size_t _dirtyBegin;
+	std::size_t _dirtyEnd;
+
+	// Free slot offsets, indexed by the log2 of their capacity
+	std::vector< std::vector<std::size_t> > _freeSlots;
+
+public:
+	WindingVertexCache();
+
+	// Returns the instance used by all brush windings
+	static WindingVertexCache& Instance();
+
+	// Returns true if the current GL context supports vertex buffer objects
+	bool isAvailable() const;
+
+	// Copies the given vertices into the slot, which is (re-)allocated if necessary
+	void update(Slot& slot, const WindingVertex* vertices, std::size_t count);
+
+	// Returns the slot to the free list
+	void release(Slot& slot);
+
+	// Binds the VBO to GL_ARRAY_BUFFER, uploading all pending changes
+	void bind();
+
+	// Binds the default buffer again
+	void unbind();
+
+private:
+	void allocate(Slot& slot, std::size_t count);
+};
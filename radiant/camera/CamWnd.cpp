@@ -43,6 +43,7 @@ namespace
     const std::string FAR_CLIP_OUT_TEXT = "Move far clip plane further away";
     const std::string FAR_CLIP_DISABLED_TEXT = " (currently disabled in preferences)";
     const char* const RKEY_SELECT_EPSILON = "user/ui/selectionEpsilon";
+    const char* const RKEY_PARALLEL_COLLECTION = "debug/render/parallelCollection";
 }
 
 class ObjectFinder :
@@ -149,7 +150,9 @@ CamWnd::CamWnd(wxWindow* parent) :
 	_wxGLWidget(new wxutil::GLWidget(_mainWxWidget, std::bind(&CamWnd::onRender, this), "CamWnd")),
     _timer(this),
     _timerLock(false),
-    _deferredDraw(std::bind(&CamWnd::performDeferredDraw, this))
+    _deferredDraw(std::bind(&CamWnd::performDeferredDraw, this)),
+    _collectionThreadPool(new util::ThreadPool(
+        registry::getValue<bool>(RKEY_PARALLEL_COLLECTION, true) ? 0 : 1))
 {
 	Connect(wxEVT_TIMER, wxTimerEventHandler(CamWnd::onFrame), NULL, this);
 
@@ -582,7 +585,7 @@ void CamWnd::Cam_Draw()
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	render::RenderStatistics::Instance().resetStats();
+	render::RenderStatistics::Instance().beginFrame();
 
 	render::View::resetCullStats();
 
@@ -682,11 +685,13 @@ void CamWnd::Cam_Draw()
         CamRenderer renderer(allowedRenderFlags, _primitiveHighlightShader,
                              _faceHighlightShader, _view.getViewer());
 
-		render::RenderableCollectionWalker::collectRenderablesInScene(renderer, _view);
+		render::RenderableCollectionWalker::collectRenderablesInScene(renderer, _view, *_collectionThreadPool);
 
         renderer.render(_camera.modelview, _camera.projection);
     }
 
+    render::RenderStatistics::Instance().endFrame();
+
     // greebo: Draw the clipper's points (skipping the depth-test)
     {
         glDisable(GL_DEPTH_TEST);
@@ -756,6 +761,10 @@ void CamWnd::Cam_Draw()
 
 	GlobalOpenGL().drawString(render::View::getCullStats());
 
+    glRasterPos3f(1.0f, static_cast<float>(_camera.height) - 21.0f, 0.0f);
+
+    GlobalOpenGL().drawString(render::RenderStatistics::Instance().getTimingString());
+
     drawTime();
 
     if (_activeMouseTool)
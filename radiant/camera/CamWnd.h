@@ -20,6 +20,7 @@
 #include "Camera.h"
 
 #include "selection/Rectangle.h"
+#include "util/ThreadPool.h"
 #include <memory>
 #include <boost/noncopyable.hpp>
 #include <sigc++/connection.h>
@@ -83,6 +84,9 @@ private:
 
     wxutil::KeyEventFilterPtr _escapeListener;
 
+    // Worker threads collecting the renderables of the visible nodes
+    std::unique_ptr<util::ThreadPool> _collectionThreadPool;
+
 public:
 	// Constructor and destructor
 	CamWnd(wxWindow* parent);
@@ -11,6 +11,8 @@
 
 #include "registry/registry.h"
 #include "modulesystem/StaticModule.h"
+#include "modulesystem/ModuleRegistry.h"
+#include "render/RenderStatistics.h"
 #include "wxutil/MouseButton.h"
 
 #include "tools/ShaderClipboardTools.h"
@@ -53,6 +55,10 @@ void GlobalCameraManager::registerCommands()
 
 	GlobalCommandSystem().addCommand("TogglePreview", std::bind(&GlobalCameraManager::toggleLightingMode, this, std::placeholders::_1));
 
+	GlobalCommandSystem().addCommand("ToggleRenderTrace",
+		std::bind(&GlobalCameraManager::toggleRenderTrace, this, std::placeholders::_1),
+		cmd::ARGTYPE_STRING|cmd::ARGTYPE_OPTIONAL);
+
 	// Insert movement commands
 	GlobalCommandSystem().addCommand("CameraForward", std::bind(&GlobalCameraManager::moveForwardDiscrete, this, std::placeholders::_1));
 	GlobalCommandSystem().addCommand("CameraBack", std::bind(&GlobalCameraManager::moveBackDiscrete, this, std::placeholders::_1));
@@ -90,6 +96,7 @@ void GlobalCameraManager::registerCommands()
 	GlobalEventManager().addCommand("CamDecreaseMoveSpeed", "CamDecreaseMoveSpeed");
 
 	GlobalEventManager().addCommand("TogglePreview", "TogglePreview");
+	GlobalEventManager().addCommand("ToggleRenderTrace", "ToggleRenderTrace");
 
 	// Insert movement commands
 	GlobalEventManager().addCommand("CameraForward", "CameraForward");
@@ -299,6 +306,30 @@ void GlobalCameraManager::toggleLightingMode(const cmd::ArgumentList& args) {
 	getCameraSettings()->toggleLightingMode();
 }
 
+void GlobalCameraManager::toggleRenderTrace(const cmd::ArgumentList& args)
+{
+	render::RenderStatistics& stats = render::RenderStatistics::Instance();
+
+	if (!stats.isTracing())
+	{
+		stats.startTrace();
+		rMessage() << "Render trace started, run ToggleRenderTrace again to write it." << std::endl;
+		return;
+	}
+
+	std::string filename = !args.empty() && !args[0].getString().empty() ? args[0].getString() :
+		module::ModuleRegistry::Instance().getApplicationContext().getSettingsPath() + "rendertrace.json";
+
+	if (stats.stopTrace(filename))
+	{
+		rMessage() << "Render trace written to " << filename << std::endl;
+	}
+	else
+	{
+		rError() << "Could not write the render trace to " << filename << std::endl;
+	}
+}
+
 void GlobalCameraManager::farClipPlaneIn(const cmd::ArgumentList& args) {
 	CamWndPtr camWnd = getActiveCamWnd();
 	if (camWnd == NULL) return;
@@ -74,6 +74,10 @@ public:
 	// Toggles between lighting and solid rendering mode (passes the call to the CameraSettings class)
 	void toggleLightingMode(const cmd::ArgumentList& args);
 
+	// Starts recording a render trace of the camera frames, or stops the running
+	// trace and writes it to the given file (default: rendertrace.json in the settings path)
+	void toggleRenderTrace(const cmd::ArgumentList& args);
+
     // Increases/decreases the far clip plane distance (passes the call to
     // CamWnd)
 	void farClipPlaneIn(const cmd::ArgumentList& args);
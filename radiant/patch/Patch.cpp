@@ -331,6 +331,17 @@ void Patch::evaluateTransform()
 	}
 }
 
+void Patch::evaluateBounds()
+{
+	evaluateTransform();
+
+	// updateTesselation() calculates the same bounds, it won't trigger the callbacks then
+	if (_tesselationChanged && isValid())
+	{
+		updateAABB();
+	}
+}
+
 // Revert the changes, fall back to the saved state in <m_ctrl>
 void Patch::revertTransform()
 {
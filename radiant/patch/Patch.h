@@ -152,6 +152,10 @@ public:
 	// Called to evaluate the transform
 	void evaluateTransform();
 
+	// Evaluates the transform and updates the bounds ahead of the tesselation,
+	// such that the (deferred) tesselation doesn't need to notify any observers
+	void evaluateBounds();
+
 	// Revert the changes, fall back to the saved state in <m_ctrl>
 	void revertTransform();
 	// Apply the transformed control array, save it into <m_ctrl> and overwrite the old values
@@ -285,6 +285,10 @@ bool PatchNode::intersectsLight(const RendererLight& light) const {
 	return light.intersectsAABB(worldAABB());
 }
 
+const AABB& PatchNode::getLitObjectBounds() const {
+	return worldAABB();
+}
+
 void PatchNode::renderSolid(RenderableCollector& collector, const VolumeTest& volume) const
 {
 	// Don't render invisible shaders
@@ -389,6 +393,14 @@ bool PatchNode::isHighlighted() const
 	return isSelected();
 }
 
+bool PatchNode::prepareParallelCollection() const
+{
+	// The tesselation is left to the worker threads
+	const_cast<Patch&>(m_patch).evaluateBounds();
+
+	return true;
+}
+
 void PatchNode::evaluateTransform()
 {
 	Matrix4 matrix = calculateTransform();
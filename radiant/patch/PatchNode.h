@@ -120,6 +120,7 @@ public:
 
 	// LitObject implementation
 	bool intersectsLight(const RendererLight& light) const;
+	const AABB& getLitObjectBounds() const;
 
 	// Renderable implementation
 
@@ -134,6 +135,7 @@ public:
 
 	void evaluateTransform();
 	bool isHighlighted() const;
+	bool prepareParallelCollection() const;
 
 protected:
 	// Gets called by the Transformable implementation whenever
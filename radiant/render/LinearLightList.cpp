@@ -1,5 +1,8 @@
 #include "LinearLightList.h"
 
+#include <vector>
+#include <algorithm>
+
 namespace render
 {
 
@@ -12,11 +15,30 @@ void LinearLightList::calculateIntersectingLights() const
     {
         m_dirty = false;
 
+        const AABB& bounds = _litObject.getLitObjectBounds();
+
+        // Keep the object's entry in the index up to date
+        if (!_litObjects.contains(_litObject) || _litObjects.getBounds(_litObject) != bounds)
+        {
+            _litObjects.remove(_litObject);
+            _litObjects.insert(_litObject, bounds);
+        }
+
         _activeLights.clear();
         _litObject.clearLights();
 
+        // Gather the lights near the object, sorted by address like the set of all lights
+        std::vector<RendererLight*> candidates;
+
+        _lights.forEachIntersecting(bounds, [&](RendererLight& light)
+        {
+            candidates.push_back(&light);
+        });
+
+        std::sort(candidates.begin(), candidates.end());
+
         // Determine which lights intersect object
-        for (RendererLight* light : _allLights)
+        for (RendererLight* light : candidates)
         {
             if (_litObject.intersectsLight(*light))
             {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "irender.h"
+#include "SpatialHashGrid.h"
 #include <list>
 #include <functional>
 
@@ -9,12 +10,21 @@ namespace render
 
 typedef std::set<RendererLight*> RendererLights;
 
+// Spatial indices of the lights and lit objects known to the renderer
+typedef SpatialHashGrid<RendererLight> LightGrid;
+typedef SpatialHashGrid<LitObject> LitObjectGrid;
+
 /**
  * \brief
  * Main renderer implementation of LightList interface.
  *
  * The LinearLightList is reponsible for associating a single lit object with
- * all of the lights which currently light it.
+ * all of the lights which currently light it. Only the lights whose volume
+ * bounds overlap the object's bounds are tested for intersection.
+ *
+ * On recalculation, the object is (re-)inserted into the lit object grid with
+ * its current bounds, which allows the renderer to find the lists affected by
+ * a changed light.
  */
 class LinearLightList :
 	public LightList
@@ -27,8 +37,11 @@ private:
     // Target object
 	LitObject& _litObject;
 
-    // Set of all available lights
-	RendererLights& _allLights;
+    // Index of all available lights
+	const LightGrid& _lights;
+
+    // Index of all lit objects, updated with the bounds of our object
+	LitObjectGrid& _litObjects;
 
     // Update callback
 	VoidCallback _testDirtyFunc;
@@ -50,16 +63,20 @@ public:
      * The illuminatable object whose lit status we are tracking.
      *
      * \param lights
-     * Entire set of available light sources provided by the renderer.
+     * Spatial index of all available light sources provided by the renderer.
+     *
+     * \param litObjects
+     * Spatial index of all lit objects, maintained by the light lists.
      *
      * \param testFunc
      * A callback function to request the renderer check if the light list
      * needs to recalculate its intersections, and call setDirty() if necessary.
      */
     LinearLightList(LitObject& object,
-                    RendererLights& lights,
+                    const LightGrid& lights,
+                    LitObjectGrid& litObjects,
                     VoidCallback testFunc)
-    : _litObject(object), _allLights(lights), _testDirtyFunc(testFunc)
+    : _litObject(object), _lights(lights), _litObjects(litObjects), _testDirtyFunc(testFunc)
 	{
 		m_dirty = true;
 	}
@@ -5,6 +5,7 @@
 #include "math/Matrix4.h"
 #include "modulesystem/StaticModule.h"
 #include "backend/GLProgramFactory.h"
+#include "RenderStatistics.h"
 
 #include <functional>
 
@@ -30,6 +31,9 @@ namespace {
  	      0xAA, 0xAA, 0xAA, 0xAA, 0x55, 0x55, 0x55, 0x55,
 	      0xAA, 0xAA, 0xAA, 0xAA, 0x55, 0x55, 0x55, 0x55
 	};
+
+	// The cell size of the light and lit object grids, in world units
+	const double LIGHT_GRID_CELL_SIZE = 512;
 }
 
 /**
@@ -39,8 +43,10 @@ OpenGLRenderSystem::OpenGLRenderSystem() :
 	_realised(false),
 	_currentShaderProgram(SHADER_PROGRAM_NONE),
 	_shadersAvailable(false),
+	_sortIndicesChanged(true),
 	_time(0),
-	m_lightsChanged(true),
+	_lightGrid(LIGHT_GRID_CELL_SIZE),
+	_litObjectGrid(LIGHT_GRID_CELL_SIZE),
 	m_traverseRenderablesMutex(false)
 {
 	// For the static default rendersystem, the MaterialManager is not existent yet,
@@ -184,20 +190,50 @@ void OpenGLRenderSystem::render(RenderStateFlags globalstate,
 	glHint(GL_FOG_HINT, GL_NICEST);
     glDisable(GL_FOG);
 
-    // Iterate over the sorted mapping between OpenGLStates and their
-    // OpenGLShaderPasses (containing the renderable geometry), and render the
-    // contents of each bucket. Each pass is passed a reference to the "current"
-    // state, which it can change.
-	for (OpenGLStates::iterator i = _state_sorted.begin();
-		i != _state_sorted.end();
-		++i)
-	{
-        // Render the OpenGLShaderPass
-        if (!i->second->empty())
+    RenderStatistics& stats = RenderStatistics::Instance();
+
+    {
+        RenderStatistics::ScopedPhase sorting(RenderStatistics::PHASE_SORTING);
+
+        if (_sortIndicesChanged)
         {
-            i->second->render(current, globalstate, viewer, _time);
+            updateSortIndices();
         }
-	}
+
+        // Sort the queued renderables in the order of the sorted OpenGLStates and
+        // let each OpenGLShaderPass render its range of entries. Each pass is
+        // passed a reference to the "current" state, which it can change.
+        _renderQueue.sort();
+    }
+
+    const RenderQueue::Entries& entries = _renderQueue.getEntries();
+
+    if (!entries.empty())
+    {
+        RenderStatistics::ScopedPhase submission(RenderStatistics::PHASE_SUBMISSION);
+
+        const RenderQueue::Entry* end = &entries.front() + entries.size();
+
+        for (const RenderQueue::Entry* i = &entries.front(); i != end;)
+        {
+            const RenderQueue::Entry* passEnd = i;
+
+            while (passEnd != end && passEnd->pass == i->pass)
+            {
+                ++passEnd;
+            }
+
+            stats.beginPass();
+
+            i->pass->render(current, globalstate, viewer, _time, i, passEnd);
+
+            stats.endPass(stats.isTracing() ? i->pass->getName() : std::string());
+
+            i = passEnd;
+        }
+    }
+
+    _renderQueue.clear();
 
 	glPopAttrib();
 }
@@ -376,9 +412,10 @@ LightList& OpenGLRenderSystem::attachLitObject(LitObject& object)
 			&object,
 			LinearLightList(
                 object,
-                m_lights,
+                _lightGrid,
+                _litObjectGrid,
                 std::bind(
-                    &OpenGLRenderSystem::propagateLightChangedFlagToAllLights,
+                    &OpenGLRenderSystem::updateChangedLights,
                     this
                 )
             )
@@ -388,6 +425,7 @@ LightList& OpenGLRenderSystem::attachLitObject(LitObject& object)
 
 void OpenGLRenderSystem::detachLitObject(LitObject& object) 
 {
+	_litObjectGrid.remove(object);
 	m_lightLists.erase(&object);
 }
 
@@ -410,34 +448,95 @@ void OpenGLRenderSystem::detachLight(RendererLight& light)
 {
     ASSERT_MESSAGE(m_lights.find(&light) != m_lights.end(), "light could not be detached");
     m_lights.erase(&light);
-    lightChanged(light);
+    _changedLights.erase(&light);
+
+    // The light might be destroyed after this call, remove it right away
+    if (_lightGrid.contains(light))
+    {
+        setLightListsDirty(_lightGrid.getBounds(light));
+        _lightGrid.remove(light);
+    }
 }
 
 void OpenGLRenderSystem::lightChanged(RendererLight& light)
 {
-    m_lightsChanged = true;
+    // The light volume is evaluated on the next light list update
+    if (m_lights.find(&light) != m_lights.end())
+    {
+        _changedLights.insert(&light);
+    }
 }
 
-void OpenGLRenderSystem::propagateLightChangedFlagToAllLights()
+void OpenGLRenderSystem::updateChangedLights()
 {
-    if (m_lightsChanged)
+    if (_changedLights.empty())
     {
-    	m_lightsChanged = false;
-    	for (LightLists::iterator i = m_lightLists.begin();
-             i != m_lightLists.end();
-             ++i) 
+        return;
+    }
+
+    for (RendererLight* light : _changedLights)
+    {
+        // Objects within the old bounds might not be lit anymore
+        if (_lightGrid.contains(*light))
         {
-    		i->second.setDirty();
-    	}
-	}
+            setLightListsDirty(_lightGrid.getBounds(*light));
+            _lightGrid.remove(*light);
+        }
+
+        AABB bounds = light->getLightVolumeBounds();
+
+        setLightListsDirty(bounds);
+        _lightGrid.insert(*light, bounds);
+    }
+
+    _changedLights.clear();
+}
+
+void OpenGLRenderSystem::setLightListsDirty(const AABB& bounds)
+{
+    _litObjectGrid.forEachIntersecting(bounds, [&](LitObject& object)
+    {
+        LightLists::iterator i = m_lightLists.find(&object);
+
+        if (i != m_lightLists.end())
+        {
+            i->second.setDirty();
+        }
+    });
 }
 
 void OpenGLRenderSystem::insertSortedState(const OpenGLStates::value_type& val) {
 	_state_sorted.insert(val);
+	_sortIndicesChanged = true;
 }
 
 void OpenGLRenderSystem::eraseSortedState(const OpenGLStates::key_type& key) {
-	_state_sorted.erase(key);
+	OpenGLStates::iterator found = _state_sorted.find(key);
+
+	if (found != _state_sorted.end())
+	{
+		// Any queued renderables of this pass will be dropped
+		found->second->setSortIndex(OpenGLShaderPass::INVALID_SORT_INDEX);
+		_state_sorted.erase(found);
+		_sortIndicesChanged = true;
+	}
+}
+
+RenderQueue& OpenGLRenderSystem::getRenderQueue()
+{
+	return _renderQueue;
+}
+
+void OpenGLRenderSystem::updateSortIndices()
+{
+	_sortIndicesChanged = false;
+
+	std::size_t sortIndex = 0;
+
+	for (OpenGLStates::const_iterator i = _state_sorted.begin(); i != _state_sorted.end(); ++i)
+	{
+		i->second->setSortIndex(sortIndex++);
+	}
 }
 
 // renderables
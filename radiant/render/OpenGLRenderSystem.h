@@ -5,6 +5,7 @@
 #include "imodule.h"
 #include "backend/OpenGLStateManager.h"
 #include "backend/OpenGLShader.h"
+#include "backend/RenderQueue.h"
 #include "LinearLightList.h"
 #include "render/backend/OpenGLStateLess.h"
 
@@ -37,19 +38,38 @@ private:
 	// Map of OpenGLState references, with access functions.
 	OpenGLStates _state_sorted;
 
+	// True if the sort indices of the shader passes need to be re-assigned
+	bool _sortIndicesChanged;
+
+	// The renderables submitted since the last render() call
+	RenderQueue _renderQueue;
+
 	// Render time
 	std::size_t _time;
 
 	// Lights
 	RendererLights m_lights;
-	bool m_lightsChanged;
 	typedef std::map<LitObject*, LinearLightList> LightLists;
 	LightLists m_lightLists;
 
+	// Spatial indices of the lights and the objects whose light lists are calculated
+	LightGrid _lightGrid;
+	LitObjectGrid _litObjectGrid;
+
+	// Lights which have been attached or changed since the last light list update
+	RendererLights _changedLights;
+
 	sigc::signal<void> _sigExtensionsInitialised;
 
 private:
-	void propagateLightChangedFlagToAllLights();
+	// Re-indexes the changed lights, setting the light lists within their old and new bounds dirty
+	void updateChangedLights();
+
+	// Sets the light lists of all objects intersecting the given bounds dirty
+	void setLightListsDirty(const AABB& bounds);
+
+	// Assigns the position in the sorted state map to each shader pass
+	void updateSortIndices();
 
 public:
 
@@ -96,6 +116,7 @@ public:
     /* OpenGLStateManager implementation */
 	void insertSortedState(const OpenGLStates::value_type& val);
 	void eraseSortedState(const OpenGLStates::key_type& key);
+	RenderQueue& getRenderQueue();
 
 	// renderables
 	void attachRenderable(const Renderable& renderable);
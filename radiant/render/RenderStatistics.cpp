@@ -0,0 +1,322 @@
+#include "RenderStatistics.h"
+
+#include <fstream>
+#include <boost/format.hpp>
+
+namespace render
+{
+
+namespace
+{
+	// Limits the memory used by a forgotten trace, roughly 40 MB
+	const std::size_t MAX_TRACE_EVENTS = 500000;
+
+	const char* const PHASE_NAMES[RenderStatistics::NUM_PHASES] =
+	{
+		"traversal",
+		"collection",
+		"sorting",
+		"submission",
+	};
+
+	const char* const CATEGORY_NAMES[] = { "frame", "phase", "pass" };
+
+	// The names of the event arguments, per category
+	const char* const FRAME_ARGS[] =
+	{
+		"visitedNodes", "culledNodes", "renderables", "passes", "stateChanges", "transforms"
+	};
+
+	const char* const PASS_ARGS[] =
+	{
+		"renderables", "stateChanges", "transforms"
+	};
+
+	inline double getMilliseconds(std::chrono::steady_clock::duration duration)
+	{
+		return std::chrono::duration<double, std::milli>(duration).count();
+	}
+
+	inline double getMicroseconds(std::chrono::steady_clock::duration duration)
+	{
+		return std::chrono::duration<double, std::micro>(duration).count();
+	}
+
+	std::string escapeJson(const std::string& str)
+	{
+		std::string result;
+		result.reserve(str.size());
+
+		for (std::string::const_iterator c = str.begin(); c != str.end(); ++c)
+		{
+			switch (*c)
+			{
+			case '"': result += "\\\""; break;
+			case '\\': result += "\\\\"; break;
+			case '\n': result += "\\n"; break;
+			case '\r': result += "\\r"; break;
+			case '\t': result += "\\t"; break;
+			default:
+				if (static_cast<unsigned char>(*c) < 0x20)
+				{
+					result += (boost::format("\\u%04x") % static_cast<int>(*c)).str();
+				}
+				else
+				{
+					result += *c;
+				}
+			}
+		}
+
+		return result;
+	}
+}
+
+RenderStatistics::ScopedPhase::ScopedPhase(Phase phase) :
+	_phase(phase),
+	_active(RenderStatistics::Instance().isFrameActive())
+{
+	if (_active)
+	{
+		_start = Clock::now();
+	}
+}
+
+RenderStatistics::ScopedPhase::~ScopedPhase()
+{
+	if (_active)
+	{
+		RenderStatistics::Instance().recordPhase(_phase, _start, Clock::now());
+	}
+}
+
+RenderStatistics::RenderStatistics() :
+	_frameActive(false),
+	_frameTime(0),
+	_countPrims(0),
+	_countStates(0),
+	_countTransforms(0),
+	_countBatches(0),
+	_countPasses(0),
+	_countVisitedNodes(0),
+	_countCulledNodes(0),
+	_passPrims(0),
+	_passStates(0),
+	_passTransforms(0),
+	_tracing(false),
+	_traceTruncated(false)
+{
+	for (std::size_t i = 0; i < NUM_PHASES; ++i)
+	{
+		_phaseTimes[i] = 0;
+	}
+}
+
+const std::string& RenderStatistics::getStatString()
+{
+	_statStr = (boost::format("prims: %d (%d batches) | states: %d | transforms: %d | passes: %d | nodes: %d (%d culled) | msec: %.2f")
+		% _countPrims % _countBatches % _countStates % _countTransforms % _countPasses
+		% _countVisitedNodes % _countCulledNodes % _frameTime).str();
+
+	return _statStr;
+}
+
+const std::string& RenderStatistics::getTimingString()
+{
+	_timingStr = (boost::format("traversal: %.2f | collection: %.2f | sorting: %.2f | submission: %.2f msec%s")
+		% _phaseTimes[PHASE_TRAVERSAL] % _phaseTimes[PHASE_COLLECTION]
+		% _phaseTimes[PHASE_SORTING] % _phaseTimes[PHASE_SUBMISSION]
+		% (_tracing ? " | tracing" : "")).str();
+
+	return _timingStr;
+}
+
+void RenderStatistics::beginFrame()
+{
+	_countPrims = 0;
+	_countStates = 0;
+	_countTransforms = 0;
+	_countBatches = 0;
+	_countPasses = 0;
+	_countVisitedNodes = 0;
+	_countCulledNodes = 0;
+
+	for (std::size_t i = 0; i < NUM_PHASES; ++i)
+	{
+		_phaseTimes[i] = 0;
+	}
+
+	_frameActive = true;
+	_frameStart = Clock::now();
+}
+
+void RenderStatistics::endFrame()
+{
+	if (!_frameActive) return;
+
+	Clock::time_point end = Clock::now();
+
+	_frameActive = false;
+	_frameTime = getMilliseconds(end - _frameStart);
+
+	if (_tracing)
+	{
+		std::size_t args[] =
+		{
+			_countVisitedNodes, _countCulledNodes, _countPrims,
+			_countPasses, _countStates, _countTransforms
+		};
+
+		addTraceEvent("frame", TRACE_FRAME, _frameStart, end, args, sizeof(args) / sizeof(args[0]));
+	}
+}
+
+void RenderStatistics::addNodes(std::size_t visited, std::size_t culled)
+{
+	_countVisitedNodes += visited;
+	_countCulledNodes += culled;
+}
+
+void RenderStatistics::beginPass()
+{
+	if (!_frameActive) return;
+
+	_passPrims = _countPrims;
+	_passStates = _countStates;
+	_passTransforms = _countTransforms;
+
+	if (_tracing)
+	{
+		_passStart = Clock::now();
+	}
+}
+
+void RenderStatistics::endPass(const std::string& name)
+{
+	if (!_frameActive) return;
+
+	++_countPasses;
+
+	if (_tracing)
+	{
+		std::size_t args[] =
+		{
+			_countPrims - _passPrims,
+			_countStates - _passStates,
+			_countTransforms - _passTransforms
+		};
+
+		addTraceEvent(name, TRACE_PASS, _passStart, Clock::now(), args, sizeof(args) / sizeof(args[0]));
+	}
+}
+
+void RenderStatistics::startTrace()
+{
+	_traceEvents.clear();
+	_traceNames.clear();
+	_traceNameIndices.clear();
+	_traceTruncated = false;
+
+	_tracing = true;
+	_traceStart = Clock::now();
+}
+
+bool RenderStatistics::stopTrace(const std::string& filename)
+{
+	_tracing = false;
+
+	std::ofstream str(filename.c_str());
+
+	if (!str.good())
+	{
+		return false;
+	}
+
+	str << "{" << std::endl;
+	str << "  \"displayTimeUnit\": \"ms\"," << std::endl;
+	str << "  \"otherData\": { \"truncated\": " << (_traceTruncated ? "true" : "false") << " }," << std::endl;
+	str << "  \"traceEvents\": [" << std::endl;
+
+	for (std::vector<TraceEvent>::const_iterator e = _traceEvents.begin(); e != _traceEvents.end(); ++e)
+	{
+		const char* const* argNames = e->category == TRACE_FRAME ? FRAME_ARGS : PASS_ARGS;
+		std::size_t numArgs = e->category == TRACE_FRAME ? sizeof(FRAME_ARGS) / sizeof(FRAME_ARGS[0]) :
+			e->category == TRACE_PASS ? sizeof(PASS_ARGS) / sizeof(PASS_ARGS[0]) : 0;
+
+		str << "    { \"name\": \"" << escapeJson(_traceNames[e->name]) << "\"";
+		str << ", \"cat\": \"" << CATEGORY_NAMES[e->category] << "\"";
+		str << ", \"ph\": \"X\"";
+		str << ", \"ts\": " << (boost::format("%.3f") % e->start);
+		str << ", \"dur\": " << (boost::format("%.3f") % e->duration);
+		str << ", \"pid\": 1, \"tid\": 1";
+		str << ", \"args\": {";
+
+		for (std::size_t a = 0; a < numArgs; ++a)
+		{
+			str << (a == 0 ? " " : ", ") << "\"" << argNames[a] << "\": " << e->args[a];
+		}
+
+		str << (numArgs == 0 ? "}" : " }") << " }";
+		str << (e + 1 != _traceEvents.end() ? "," : "") << std::endl;
+	}
+
+	str << "  ]" << std::endl;
+	str << "}" << std::endl;
+
+	_traceEvents.clear();
+	_traceNames.clear();
+	_traceNameIndices.clear();
+
+	return str.good();
+}
+
+RenderStatistics& RenderStatistics::Instance()
+{
+	static RenderStatistics _instance;
+	return _instance;
+}
+
+void RenderStatistics::recordPhase(Phase phase, Clock::time_point start, Clock::time_point end)
+{
+	// Phases can be entered several times per frame
+	_phaseTimes[phase] += getMilliseconds(end - start);
+
+	if (_tracing)
+	{
+		addTraceEvent(PHASE_NAMES[phase], TRACE_PHASE, start, end, NULL, 0);
+	}
+}
+
+void RenderStatistics::addTraceEvent(const std::string& name, TraceCategory category,
+	Clock::time_point start, Clock::time_point end, const std::size_t* args, std::size_t numArgs)
+{
+	if (_traceEvents.size() >= MAX_TRACE_EVENTS)
+	{
+		_traceTruncated = true;
+		return;
+	}
+
+	std::map<std::string, std::size_t>::const_iterator found = _traceNameIndices.find(name);
+
+	if (found == _traceNameIndices.end())
+	{
+		found = _traceNameIndices.insert(std::make_pair(name, _traceNames.size())).first;
+		_traceNames.push_back(name);
+	}
+
+	TraceEvent event;
+
+	event.name = found->second;
+	event.category = category;
+	event.start = getMicroseconds(start - _traceStart);
+	event.duration = getMicroseconds(end - start);
+
+	for (std::size_t a = 0; a < MAX_TRACE_ARGS; ++a)
+	{
+		event.args[a] = a < numArgs ? args[a] : 0;
+	}
+
+	_traceEvents.push_back(event);
+}
+
+} // namespace render
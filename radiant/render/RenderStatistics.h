@@ -1,45 +1,181 @@
 #pragma once
 
-#include <wx/stopwatch.h>
-#include "string/string.h"
+#include <map>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstddef>
 
 namespace render
 {
 
+/**
+ * Collects the counters and timings of the camera frames, which are shown
+ * in the camera overlay.
+ *
+ * A frame lasts from beginFrame() to endFrame(), the phases of the frame
+ * (scene traversal, renderable collection, state sorting and GL submission)
+ * are measured by ScopedPhase objects. Phases and passes outside a frame
+ * (e.g. of the orthoviews) are not recorded.
+ *
+ * While a trace is running, every frame, phase and shader pass is recorded
+ * as an event, written as Chrome trace JSON (chrome://tracing) when the trace
+ * is stopped.
+ *
+ * This class is not thread-safe, it must only be used by the main thread.
+ */
 class RenderStatistics
 {
+public:
+	enum Phase
+	{
+		PHASE_TRAVERSAL,
+		PHASE_COLLECTION,
+		PHASE_SORTING,
+		PHASE_SUBMISSION,
+		NUM_PHASES
+	};
+
+	// Measures the lifetime of this object as the given phase of the current frame
+	class ScopedPhase
+	{
+	private:
+		Phase _phase;
+		bool _active;
+		std::chrono::steady_clock::time_point _start;
+
+	public:
+		ScopedPhase(Phase phase);
+		~ScopedPhase();
+	};
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
 	std::string _statStr;
+	std::string _timingStr;
+
+	bool _frameActive;
+	Clock::time_point _frameStart;
+
+	// Milliseconds spent in the last frame and its phases
+	double _frameTime;
+	double _phaseTimes[NUM_PHASES];
 
 	std::size_t _countPrims;
 	std::size_t _countStates;
 	std::size_t _countTransforms;
+	std::size_t _countBatches;
+	std::size_t _countPasses;
+	std::size_t _countVisitedNodes;
+	std::size_t _countCulledNodes;
+
+	// The start of the pass currently being rendered
+	Clock::time_point _passStart;
+	std::size_t _passPrims;
+	std::size_t _passStates;
+	std::size_t _passTransforms;
+
+	enum TraceCategory
+	{
+		TRACE_FRAME,
+		TRACE_PHASE,
+		TRACE_PASS,
+	};
+
+	static const std::size_t MAX_TRACE_ARGS = 6;
+
+	struct TraceEvent
+	{
+		std::size_t name;		// index into _traceNames
+		TraceCategory category;
+		double start;			// microseconds since the start of the trace
+		double duration;		// microseconds
+		std::size_t args[MAX_TRACE_ARGS];
+	};
+
+	bool _tracing;
+	bool _traceTruncated;
+	Clock::time_point _traceStart;
+	std::vector<TraceEvent> _traceEvents;
+
+	// Event names are stored once, the events refer to them by index
+	std::vector<std::string> _traceNames;
+	std::map<std::string, std::size_t> _traceNameIndices;
 
-	wxStopWatch _timer;
 public:
-	const std::string& getStatString()
-    {
-        _statStr = "prims: " + string::to_string(_countPrims) +
-				  " | states: " + string::to_string(_countStates) +
-				  " | transforms: "	+ string::to_string(_countTransforms) +
-				  " | msec: " + string::to_string(_timer.Time());
-
-		return _statStr;
+	RenderStatistics();
+
+	// Returns the counters of the last frame
+	const std::string& getStatString();
+
+	// Returns the timings of the last frame
+	const std::string& getTimingString();
+
+	// Resets the counters and starts measuring a new frame
+	void beginFrame();
+
+	// Finishes the frame started by beginFrame()
+	void endFrame();
+
+	bool isFrameActive() const
+	{
+		return _frameActive;
+	}
+
+	// Adds the number of visited and culled space partition nodes
+	void addNodes(std::size_t visited, std::size_t culled);
+
+	// Called by the shader passes for each rendered renderable
+	void addPrimitive()
+	{
+		++_countPrims;
 	}
 
-	void resetStats() 
-    {
-		_countPrims = 0;
-		_countStates = 0;
-		_countTransforms = 0;
+	// Called by the shader passes for each batch of renderables drawn at once
+	void addBatch(std::size_t numRenderables)
+	{
+		++_countBatches;
+		_countPrims += numRenderables;
+	}
 
-		_timer.Start();
+	// Called by the shader passes if applying their state changed any GL state
+	void addStateChange()
+	{
+		++_countStates;
 	}
 
-	static RenderStatistics& Instance()
-    {
-		static RenderStatistics _instance;
-		return _instance;
+	// Called by the shader passes for each modelview matrix change
+	void addTransform()
+	{
+		++_countTransforms;
 	}
+
+	// Marks the start of a shader pass during GL submission
+	void beginPass();
+
+	// Marks the end of the pass started by beginPass(). The name is only
+	// needed while tracing (see isTracing()).
+	void endPass(const std::string& name);
+
+	bool isTracing() const
+	{
+		return _tracing;
+	}
+
+	// Starts recording a trace, discarding any events of a previous one
+	void startTrace();
+
+	// Stops recording and writes the trace to the given file, returns false on failure
+	bool stopTrace(const std::string& filename);
+
+	static RenderStatistics& Instance();
+
+private:
+	void recordPhase(Phase phase, Clock::time_point start, Clock::time_point end);
+
+	void addTraceEvent(const std::string& name, TraceCategory category,
+		Clock::time_point start, Clock::time_point end, const std::size_t* args, std::size_t numArgs);
 };
 
 } // namespace render
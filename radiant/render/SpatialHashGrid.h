@@ -0,0 +1,279 @@
+#pragma once
+
+#include "math/AABB.h"
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+
+namespace render
+{
+
+/**
+ * \brief
+ * Sparse uniform grid storing items by their world-space bounds.
+ *
+ * Every item is listed in all cells overlapped by its AABB. Items
+ * spanning too many cells, or without valid bounds, are kept in a
+ * separate list which is checked by every query.
+ *
+ * Queries report every item whose bounds intersect the query bounds
+ * exactly once, without any temporary allocations: an item overlapping
+ * several query cells is only reported in the first of the cells shared
+ * by both the item and the query.
+ */
+template<typename Item>
+class SpatialHashGrid
+{
+private:
+	struct CellIndex
+	{
+		int x, y, z;
+	};
+
+	struct Entry
+	{
+		Item* item;
+		AABB bounds;
+
+		// The cell range overlapped by the bounds
+		CellIndex min;
+		CellIndex max;
+	};
+	typedef std::vector<Entry> Entries;
+
+	double _cellSize;
+
+	typedef std::unordered_map<uint64_t, Entries> Cells;
+	Cells _cells;
+
+	// Items which are not sorted into cells
+	Entries _oversized;
+
+	// The entry of every contained item, needed for removal
+	typedef std::map<Item*, Entry> ItemMap;
+	ItemMap _items;
+
+	// Items covering more cells than this are kept in the oversized list
+	static const std::size_t MAX_CELLS_PER_ITEM = 64;
+
+	// Cell indices are clamped to this range to fit into the hash key
+	static const int MAX_CELL_INDEX = (1 << 20) - 1;
+
+public:
+	SpatialHashGrid(double cellSize) :
+		_cellSize(cellSize)
+	{}
+
+	bool contains(Item& item) const
+	{
+		return _items.find(&item) != _items.end();
+	}
+
+	// Returns the bounds the given item has been inserted with
+	const AABB& getBounds(Item& item) const
+	{
+		return _items.find(&item)->second.bounds;
+	}
+
+	void insert(Item& item, const AABB& bounds)
+	{
+		Entry entry;
+		entry.item = &item;
+		entry.bounds = bounds;
+
+		if (!getCellRange(bounds, entry.min, entry.max))
+		{
+			_oversized.push_back(entry);
+		}
+		else
+		{
+			for (int x = entry.min.x; x <= entry.max.x; ++x)
+			{
+				for (int y = entry.min.y; y <= entry.max.y; ++y)
+				{
+					for (int z = entry.min.z; z <= entry.max.z; ++z)
+					{
+						_cells[getKey(x, y, z)].push_back(entry);
+					}
+				}
+			}
+		}
+
+		_items[&item] = entry;
+	}
+
+	void remove(Item& item)
+	{
+		typename ItemMap::iterator found = _items.find(&item);
+
+		if (found == _items.end()) return;
+
+		const Entry& entry = found->second;
+
+		if (!isInCells(entry))
+		{
+			removeFromList(_oversized, &item);
+		}
+		else
+		{
+			for (int x = entry.min.x; x <= entry.max.x; ++x)
+			{
+				for (int y = entry.min.y; y <= entry.max.y; ++y)
+				{
+					for (int z = entry.min.z; z <= entry.max.z; ++z)
+					{
+						typename Cells::iterator cell = _cells.find(getKey(x, y, z));
+
+						removeFromList(cell->second, &item);
+
+						if (cell->second.empty())
+						{
+							_cells.erase(cell);
+						}
+					}
+				}
+			}
+		}
+
+		_items.erase(found);
+	}
+
+	/**
+	 * Invokes the functor with every item whose bounds intersect the given
+	 * AABB. Items without valid bounds are always reported, passing invalid
+	 * query bounds reports every item in the grid.
+	 */
+	template<typename Functor>
+	void forEachIntersecting(const AABB& bounds, Functor func) const
+	{
+		CellIndex min, max;
+
+		if (!bounds.isValid())
+		{
+			for (typename ItemMap::const_iterator i = _items.begin(); i != _items.end(); ++i)
+			{
+				func(*i->first);
+			}
+			return;
+		}
+
+		for (typename Entries::const_iterator i = _oversized.begin(); i != _oversized.end(); ++i)
+		{
+			if (!i->bounds.isValid() || i->bounds.intersects(bounds))
+			{
+				func(*i->item);
+			}
+		}
+
+		if (!getCellRange(bounds, min, max))
+		{
+			// The query covers too many cells, test the items directly
+			for (typename ItemMap::const_iterator i = _items.begin(); i != _items.end(); ++i)
+			{
+				const Entry& entry = i->second;
+
+				if (isInCells(entry) && entry.bounds.intersects(bounds))
+				{
+					func(*entry.item);
+				}
+			}
+			return;
+		}
+
+		for (int x = min.x; x <= max.x; ++x)
+		{
+			for (int y = min.y; y <= max.y; ++y)
+			{
+				for (int z = min.z; z <= max.z; ++z)
+				{
+					typename Cells::const_iterator cell = _cells.find(getKey(x, y, z));
+
+					if (cell == _cells.end()) continue;
+
+					for (typename Entries::const_iterator i = cell->second.begin(); i != cell->second.end(); ++i)
+					{
+						// Only report the item in the first cell shared with the query
+						if (x != std::max(i->min.x, min.x) ||
+							y != std::max(i->min.y, min.y) ||
+							z != std::max(i->min.z, min.z))
+						{
+							continue;
+						}
+
+						if (i->bounds.intersects(bounds))
+						{
+							func(*i->item);
+						}
+					}
+				}
+			}
+		}
+	}
+
+private:
+	bool isInCells(const Entry& entry) const
+	{
+		CellIndex min, max;
+		return getCellRange(entry.bounds, min, max);
+	}
+
+	// Returns false if the bounds are invalid or cover too many cells
+	bool getCellRange(const AABB& bounds, CellIndex& min, CellIndex& max) const
+	{
+		if (!bounds.isValid())
+		{
+			return false;
+		}
+
+		Vector3 lower = bounds.origin - bounds.extents;
+		Vector3 upper = bounds.origin + bounds.extents;
+
+		min.x = getCellCoordinate(lower.x());
+		min.y = getCellCoordinate(lower.y());
+		min.z = getCellCoordinate(lower.z());
+		max.x = getCellCoordinate(upper.x());
+		max.y = getCellCoordinate(upper.y());
+		max.z = getCellCoordinate(upper.z());
+
+		std::size_t numCells = std::size_t(max.x - min.x + 1) *
+			std::size_t(max.y - min.y + 1) * std::size_t(max.z - min.z + 1);
+
+		return numCells <= MAX_CELLS_PER_ITEM;
+	}
+
+	int getCellCoordinate(double value) const
+	{
+		double cell = std::floor(value / _cellSize);
+
+		if (cell < -MAX_CELL_INDEX) return -MAX_CELL_INDEX;
+		if (cell > MAX_CELL_INDEX) return MAX_CELL_INDEX;
+
+		return static_cast<int>(cell);
+	}
+
+	static uint64_t getKey(int x, int y, int z)
+	{
+		const uint64_t mask = (uint64_t(1) << 21) - 1;
+
+		return (uint64_t(x) & mask) | ((uint64_t(y) & mask) << 21) | ((uint64_t(z) & mask) << 42);
+	}
+
+	static void removeFromList(Entries& entries, Item* item)
+	{
+		for (typename Entries::iterator i = entries.begin(); i != entries.end(); ++i)
+		{
+			if (i->item == item)
+			{
+				// Order doesn't matter, move the last entry into the gap
+				*i = entries.back();
+				entries.pop_back();
+				return;
+			}
+		}
+	}
+};
+
+} // namespace
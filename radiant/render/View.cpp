@@ -126,6 +126,14 @@ VolumeIntersectionValue View::TestAABB(const AABB& aabb, const Matrix4& localToW
 	return _frustum.testIntersection(aabb, localToWorld);
 }
 
+void View::TestAABBs(const AABB* aabbs, std::size_t count, VolumeIntersectionValue* results) const
+{
+#if defined(DEBUG_CULLING)
+	g_count_bboxs += static_cast<int>(count);
+#endif
+	_frustum.testIntersection(aabbs, count, results);
+}
+
 const Matrix4& View::GetViewMatrix() const
 {
 	return _viewproj;
@@ -54,6 +54,7 @@ public:
 
     VolumeIntersectionValue TestAABB(const AABB& aabb) const;
 	VolumeIntersectionValue TestAABB(const AABB& aabb, const Matrix4& localToWorld) const;
+	void TestAABBs(const AABB* aabbs, std::size_t count, VolumeIntersectionValue* results) const;
 
 	const Matrix4& GetViewMatrix() const;
 	const Matrix4& GetViewport() const;
@@ -196,7 +196,7 @@ unsigned int OpenGLShader::getFlags() const
 // Append a default shader pass onto the back of the state list
 OpenGLState& OpenGLShader::appendDefaultPass()
 {
-    _shaderPasses.push_back(OpenGLShaderPassPtr(new OpenGLShaderPass(*this)));
+    _shaderPasses.push_back(OpenGLShaderPassPtr(new OpenGLShaderPass(*this, _glStateManager.getRenderQueue())));
     OpenGLState& state = _shaderPasses.back()->state();
     return state;
 }
@@ -1,5 +1,6 @@
 #include "OpenGLShaderPass.h"
 #include "OpenGLShader.h"
+#include "render/RenderStatistics.h"
 
 #include "math/Matrix4.h"
 #include "math/AABB.h"
@@ -341,6 +342,11 @@ void OpenGLShaderPass::applyState(OpenGLState& current,
                           ? _glState.glProgram
                           : 0;
 
+    if (changingBitsMask != 0 || program != current.glProgram)
+    {
+        RenderStatistics::Instance().addStateChange();
+    }
+
     if (program != current.glProgram)
     {
         if (current.glProgram != 0)
@@ -571,7 +577,7 @@ void OpenGLShaderPass::addRenderable(const OpenGLRenderable& renderable,
                                       const Matrix4& modelview,
                                       const RendererLight* light)
 {
-    _renderablesWithoutEntity.push_back(TransformedRenderable(renderable, modelview, light, NULL));
+    _renderQueue.push(*this, renderable, modelview, light, NULL);
 }
 
 void OpenGLShaderPass::addRenderable(const OpenGLRenderable& renderable,
@@ -579,21 +585,16 @@ void OpenGLShaderPass::addRenderable(const OpenGLRenderable& renderable,
                                       const IRenderEntity& entity,
                                       const RendererLight* light)
 {
-    RenderablesByEntity::iterator i = _renderables.find(&entity);
-
-    if (i == _renderables.end())
-    {
-        i = _renderables.insert(RenderablesByEntity::value_type(&entity, Renderables())).first;
-    }
-
-    i->second.push_back(TransformedRenderable(renderable, modelview, light, &entity));
+    _renderQueue.push(*this, renderable, modelview, light, &entity);
 }
 
 // Render the bucket contents
 void OpenGLShaderPass::render(OpenGLState& current,
                               unsigned int flagsMask,
                               const Vector3& viewer,
-                              std::size_t time)
+                              std::size_t time,
+                              const RenderQueue::Entry* begin,
+                              const RenderQueue::Entry* end)
 {
     // Reset the texture matrix
     glMatrixMode(GL_TEXTURE);
@@ -604,28 +605,39 @@ void OpenGLShaderPass::render(OpenGLState& current,
     // Apply our state to the current state object
     applyState(current, flagsMask, viewer, time, NULL);
 
-    if (!_renderablesWithoutEntity.empty())
+    // The entries are sorted by entity, the ones without entity come first
+    const RenderQueue::Entry* i = begin;
+
+    while (i != end && i->entity == NULL)
+    {
+        ++i;
+    }
+
+    if (i != begin)
     {
-        renderAllContained(_renderablesWithoutEntity, current, viewer, time);
+        renderAllContained(begin, i, current, viewer, time);
     }
 
-    for (RenderablesByEntity::const_iterator i = _renderables.begin();
-         i != _renderables.end();
-         ++i)
+    while (i != end)
     {
+        const IRenderEntity* entity = i->entity;
+        const RenderQueue::Entry* entityEnd = i;
+
+        while (entityEnd != end && entityEnd->entity == entity)
+        {
+            ++entityEnd;
+        }
+
         // Apply our state to the current state object
-        applyState(current, flagsMask, viewer, time, i->first);
+        applyState(current, flagsMask, viewer, time, entity);
 
-        if (!stateIsActive())
+        if (stateIsActive())
         {
-            continue;
+            renderAllContained(i, entityEnd, current, viewer, time);
         }
 
-        renderAllContained(i->second, current, viewer, time);
+        i = entityEnd;
     }
-
-    _renderablesWithoutEntity.clear();
-    _renderables.clear();
 }
 
 bool OpenGLShaderPass::stateIsActive()
@@ -691,7 +703,8 @@ void OpenGLShaderPass::setUpLightingCalculation(OpenGLState& current,
 }
 
 // Flush renderables
-void OpenGLShaderPass::renderAllContained(const Renderables& renderables,
+void OpenGLShaderPass::renderAllContained(const RenderQueue::Entry* begin,
+                                          const RenderQueue::Entry* end,
                                           OpenGLState& current,
                                           const Vector3& viewer,
                                           std::size_t time)
@@ -699,11 +712,15 @@ void OpenGLShaderPass::renderAllContained(const Renderables& renderables,
     // Keep a pointer to the last transform matrix and render entity used
     const Matrix4* transform = 0;
 
+    RenderStatistics& stats = RenderStatistics::Instance();
+
     glPushMatrix();
 
-    // Iterate over each transformed renderable in the vector
-    for (const TransformedRenderable& r : renderables)
+    // Iterate over each transformed renderable in the range
+    for (const RenderQueue::Entry* i = begin; i != end;)
     {
+        const RenderQueue::Entry& r = *i;
+
         // If the current iteration's transform matrix was different from the
         // last, apply it and store for the next iteration
         if (transform == NULL ||
@@ -714,6 +731,8 @@ void OpenGLShaderPass::renderAllContained(const Renderables& renderables,
             glPushMatrix();
             glMultMatrixd(*transform);
 
+            stats.addTransform();
+
             // Determine the face direction
             if (current.testRenderFlag(RENDER_CULLFACE)
                 && transform->getHandedness() == Matrix4::RIGHTHANDED)
@@ -734,15 +753,58 @@ void OpenGLShaderPass::renderAllContained(const Renderables& renderables,
             setUpLightingCalculation(current, light, viewer, *transform, time);
         }
 
-        // Render the renderable
         RenderInfo info(current.getRenderFlags(), viewer, current.cubeMapMode);
-        r.renderable->render(info);
+
+        // Subsequent renderables of the same batch sharing the transform
+        // and light are drawn together
+        RenderBatch* batch = r.renderable->getRenderBatch();
+        const RenderQueue::Entry* batchEnd = i + 1;
+
+        if (batch != NULL)
+        {
+            while (batchEnd != end && batchEnd->light == light &&
+                   (batchEnd->transform == transform || batchEnd->transform->isAffineEqual(*transform)) &&
+                   batchEnd->renderable->getRenderBatch() == batch)
+            {
+                ++batchEnd;
+            }
+        }
+
+        if (batchEnd - i > 1)
+        {
+            _batchRenderables.clear();
+
+            for (const RenderQueue::Entry* b = i; b != batchEnd; ++b)
+            {
+                _batchRenderables.push_back(b->renderable);
+            }
+
+            batch->render(info, &_batchRenderables.front(), _batchRenderables.size());
+
+            stats.addBatch(_batchRenderables.size());
+        }
+        else
+        {
+            // Render the renderable
+            r.renderable->render(info);
+
+            stats.addPrimitive();
+        }
+
+        i = batchEnd;
     }
 
     // Cleanup
     glPopMatrix();
 }
 
+std::string OpenGLShaderPass::getName() const
+{
+    const MaterialPtr& material = _owner.getMaterial();
+
+    return material ? material->getName() : "unnamed pass";
+}
+
 // Stream insertion operator
 std::ostream& operator<<(std::ostream& st, const OpenGLShaderPass& self)
 {
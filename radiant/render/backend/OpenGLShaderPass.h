@@ -2,9 +2,8 @@
 
 #include "math/Vector3.h"
 #include "iglrender.h"
-
+#include "RenderQueue.h"
 #include <vector>
-#include <map>
 
 /* FORWARD DECLS */
 class Matrix4;
@@ -20,54 +19,30 @@ class OpenGLShader;
  * @brief A single component pass of an OpenGL shader.
  *
  * Each OpenGLShader may contain multiple passes, which are rendered
- * independently. Each pass retains its own OpenGLState and a list of renderable
- * objects to be rendered in this pass.
+ * independently. Each pass retains its own OpenGLState, the renderable
+ * objects to be rendered in this pass are stored in the render system's
+ * RenderQueue.
  */
 class OpenGLShaderPass
 {
+public:
+	// The sort index of passes which are not in the sorted state map
+	static const std::size_t INVALID_SORT_INDEX = static_cast<std::size_t>(-1);
+
+private:
 	render::OpenGLShader& _owner;
 
+	// The queue receiving our renderables
+	RenderQueue& _renderQueue;
+
 	// The state applied to this bucket
 	OpenGLState _glState;
 
-	/*
-	 * Representation of a transformed-and-lit renderable object. Stores a
-	 * single object, with its transform matrix and illuminating light source.
-	 */
-	struct TransformedRenderable
-	{
-    	// The renderable object
-    	const OpenGLRenderable* renderable;
-
-    	// The modelview transform for this renderable
-    	const Matrix4* transform;
-
-		// The light falling on this obejct
-    	const RendererLight* light;
-
-		// The entity attached to this renderable
-		const IRenderEntity* entity;
-
-		// Constructor
-		TransformedRenderable(const OpenGLRenderable& r,
-							  const Matrix4& t,
-							  const RendererLight* l,
-							  const IRenderEntity* e)
-		: renderable(&r),
-		  transform(&t),
-		  light(l),
-		  entity(e)
-		{}
-	};
-
-	// Vector of transformed renderables using this state
-	typedef std::vector<TransformedRenderable> Renderables;
-	Renderables _renderablesWithoutEntity;
-	
-	// Renderables sorted by RenderEntity
-	typedef std::map<const IRenderEntity*, Renderables> RenderablesByEntity;
-
-	RenderablesByEntity _renderables;
+	// Position in the sorted state map, assigned by the render system
+	std::size_t _sortIndex;
+
+	// The renderables of the batch being drawn, kept to avoid re-allocations
+	std::vector<const OpenGLRenderable*> _batchRenderables;
 
 private:
 
@@ -85,8 +60,9 @@ private:
 
 	void setupTextureMatrix(GLenum textureUnit, const ShaderLayerPtr& stage);
 
-	// Render all of the given TransformedRenderables
-	void renderAllContained(const Renderables& renderables,
+	// Render all of the given queue entries
+	void renderAllContained(const RenderQueue::Entry* begin,
+							const RenderQueue::Entry* end,
 							OpenGLState& current,
 						    const Vector3& viewer,
 							std::size_t time);
@@ -121,8 +97,10 @@ private:
 
 public:
 
-	OpenGLShaderPass(render::OpenGLShader& owner) :
-		_owner(owner)
+	OpenGLShaderPass(render::OpenGLShader& owner, RenderQueue& renderQueue) :
+		_owner(owner),
+		_renderQueue(renderQueue),
+		_sortIndex(INVALID_SORT_INDEX)
 	{}
 
 	/**
@@ -155,9 +133,22 @@ public:
 		return &_glState;
 	}
 
+	std::size_t getSortIndex() const
+	{
+		return _sortIndex;
+	}
+
+	void setSortIndex(std::size_t sortIndex)
+	{
+		_sortIndex = sortIndex;
+	}
+
+	// Returns the name of the material this pass belongs to, used in render traces
+	std::string getName() const;
+
 	/**
 	 * \brief
-     * Render the renderables attached to this shader pass.
+     * Render the given renderables of this shader pass.
      *
      * \param current
      * The current OpenGL state variables.
@@ -168,19 +159,15 @@ public:
      * \param viewer
      * Viewer location in world space.
      *
+     * \param begin, end
+     * The range of sorted queue entries submitted to this pass.
      */
 	void render(OpenGLState& current,
 				unsigned int flagsMask,
 				const Vector3& viewer,
-				std::size_t time);
-
-	/**
-	 * Returns true if this shaderpass doesn't have anything to render.
-	 */
-	bool empty() const
-	{
-		return _renderables.empty() && _renderablesWithoutEntity.empty();
-	}
+				std::size_t time,
+				const RenderQueue::Entry* begin,
+				const RenderQueue::Entry* end);
 
 	friend std::ostream& operator<<(std::ostream& st, const OpenGLShaderPass& self);
 };
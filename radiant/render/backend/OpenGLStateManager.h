@@ -10,6 +10,7 @@ namespace render
 {
 
 class OpenGLShaderPass;
+class RenderQueue;
 typedef std::shared_ptr<OpenGLShaderPass> OpenGLShaderPassPtr;
 
 /**
@@ -43,6 +44,12 @@ public:
      */
     virtual void eraseSortedState(const OpenGLStates::key_type& key) = 0;
 
+    /**
+     * \brief
+     * Return the queue the shader passes submit their renderables to.
+     */
+    virtual RenderQueue& getRenderQueue() = 0;
+
 };
 
 
@@ -0,0 +1,143 @@
+#include "RenderQueue.h"
+
+#include "OpenGLShaderPass.h"
+#include <algorithm>
+
+namespace render
+{
+
+namespace
+{
+	// Bit widths of the sort key components, from most to least significant
+	const unsigned int PASS_BITS = 20;
+	const unsigned int ENTITY_BITS = 20;
+	const unsigned int SEQUENCE_BITS = 24;
+
+	const uint64_t MAX_PASS = (uint64_t(1) << PASS_BITS) - 1;
+	const uint64_t MAX_ENTITY = (uint64_t(1) << ENTITY_BITS) - 1;
+	const uint64_t MAX_SEQUENCE = (uint64_t(1) << SEQUENCE_BITS) - 1;
+
+	const std::size_t INITIAL_ENTITY_TABLE_SIZE = 256;
+
+	inline bool entryKeyLess(const RenderQueue::Entry& a, const RenderQueue::Entry& b)
+	{
+		return a.key < b.key;
+	}
+
+	inline std::size_t hashEntity(const IRenderEntity* entity)
+	{
+		// Fibonacci hashing, the lower bits of the address are always zero
+		return static_cast<std::size_t>((reinterpret_cast<uintptr_t>(entity) >> 4) * 0x9E3779B97F4A7C15ULL >> 24);
+	}
+}
+
+RenderQueue::RenderQueue() :
+	_numEntities(0)
+{
+	resizeEntityTable(INITIAL_ENTITY_TABLE_SIZE);
+}
+
+void RenderQueue::sort()
+{
+	std::size_t numEntries = 0;
+
+	for (std::size_t i = 0; i < _entries.size(); ++i)
+	{
+		Entry& entry = _entries[i];
+
+		std::size_t sortIndex = entry.pass->getSortIndex();
+
+		// Skip the renderables of passes that have been removed meanwhile
+		if (sortIndex == OpenGLShaderPass::INVALID_SORT_INDEX)
+		{
+			continue;
+		}
+
+		// Values exceeding the bit widths are clamped, which only affects the
+		// ordering within a group, the passes detect changes by comparing pointers
+		uint64_t pass = std::min<uint64_t>(sortIndex, MAX_PASS);
+		uint64_t entity = std::min<uint64_t>(getEntityIndex(entry.entity), MAX_ENTITY);
+		uint64_t sequence = std::min<uint64_t>(numEntries, MAX_SEQUENCE);
+
+		entry.key = (pass << (ENTITY_BITS + SEQUENCE_BITS)) | (entity << SEQUENCE_BITS) | sequence;
+
+		_entries[numEntries++] = entry;
+	}
+
+	_entries.resize(numEntries);
+
+	std::sort(_entries.begin(), _entries.end(), entryKeyLess);
+}
+
+void RenderQueue::clear()
+{
+	_entries.clear();
+
+	if (_numEntities > 0)
+	{
+		EntitySlot emptySlot = { NULL, 0 };
+		std::fill(_entitySlots.begin(), _entitySlots.end(), emptySlot);
+		_numEntities = 0;
+	}
+}
+
+std::size_t RenderQueue::getEntityIndex(const IRenderEntity* entity)
+{
+	if (entity == NULL)
+	{
+		return 0;
+	}
+
+	// Keep the load factor below 0.5
+	if ((_numEntities + 1) * 2 > _entitySlots.size())
+	{
+		resizeEntityTable(_entitySlots.size() * 2);
+	}
+
+	std::size_t mask = _entitySlots.size() - 1;
+
+	for (std::size_t slot = hashEntity(entity) & mask; ; slot = (slot + 1) & mask)
+	{
+		EntitySlot& candidate = _entitySlots[slot];
+
+		if (candidate.entity == entity)
+		{
+			return candidate.index;
+		}
+
+		if (candidate.entity == NULL)
+		{
+			candidate.entity = entity;
+			candidate.index = ++_numEntities;
+			return candidate.index;
+		}
+	}
+}
+
+void RenderQueue::resizeEntityTable(std::size_t size)
+{
+	std::vector<EntitySlot> oldSlots;
+	oldSlots.swap(_entitySlots);
+
+	EntitySlot emptySlot = { NULL, 0 };
+	_entitySlots.resize(size, emptySlot);
+
+	std::size_t mask = size - 1;
+
+	// Re-insert the existing entities, keeping their indices
+	for (std::vector<EntitySlot>::const_iterator i = oldSlots.begin(); i != oldSlots.end(); ++i)
+	{
+		if (i->entity == NULL) continue;
+
+		std::size_t slot = hashEntity(i->entity) & mask;
+
+		while (_entitySlots[slot].entity != NULL)
+		{
+			slot = (slot + 1) & mask;
+		}
+
+		_entitySlots[slot] = *i;
+	}
+}
+
+} // namespace
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+class Matrix4;
+class OpenGLRenderable;
+class RendererLight;
+class IRenderEntity;
+
+namespace render
+{
+
+class OpenGLShaderPass;
+
+/**
+ * The renderables submitted to all shader passes since the last call to
+ * OpenGLRenderSystem::render(), stored in a single linear array.
+ *
+ * Before rendering, the entries are sorted by a packed 64 bit key, made up
+ * of the pass' position in the sorted state map, the render entity and
+ * the submission order. The render system walks the sorted array, each
+ * shader pass renders its consecutive range of entries.
+ *
+ * The arrays are cleared but not deallocated after each frame, such that
+ * the queue doesn't need any heap allocations once it reached its working
+ * size.
+ */
+class RenderQueue
+{
+public:
+	struct Entry
+	{
+		// The sort key, calculated by sort()
+		uint64_t key;
+
+		OpenGLShaderPass* pass;
+		const OpenGLRenderable* renderable;
+		const Matrix4* transform;
+		const RendererLight* light;
+		const IRenderEntity* entity;
+	};
+
+	typedef std::vector<Entry> Entries;
+
+private:
+	Entries _entries;
+
+	// Open addressing hash table assigning frame-local indices to render entities
+	struct EntitySlot
+	{
+		const IRenderEntity* entity;
+		std::size_t index;
+	};
+	std::vector<EntitySlot> _entitySlots;
+	std::size_t _numEntities;
+
+public:
+	RenderQueue();
+
+	void push(OpenGLShaderPass& pass,
+			  const OpenGLRenderable& renderable,
+			  const Matrix4& transform,
+			  const RendererLight* light,
+			  const IRenderEntity* entity)
+	{
+		Entry entry = { 0, &pass, &renderable, &transform, light, entity };
+		_entries.push_back(entry);
+	}
+
+	bool empty() const
+	{
+		return _entries.empty();
+	}
+
+	/**
+	 * Calculates the sort keys and sorts the entries. Entries of passes which
+	 * are not part of the sorted state map anymore are removed. Renderables
+	 * without entity precede the ones with an entity, all renderables of the
+	 * same pass and entity are kept in submission order.
+	 */
+	void sort();
+
+	const Entries& getEntries() const
+	{
+		return _entries;
+	}
+
+	// Removes all entries, keeping the allocated memory
+	void clear();
+
+private:
+	// Returns the frame-local index of the given entity, starting at 1
+	std::size_t getEntityIndex(const IRenderEntity* entity);
+
+	void resizeEntityTable(std::size_t size);
+};
+
+} // namespace
@@ -4,7 +4,11 @@
 #include "ientity.h"
 #include "ieclass.h"
 #include "iscenegraph.h"
+#include "RenderableRecorder.h"
+#include "render/RenderStatistics.h"
+#include "util/ThreadPool.h"
 #include <functional>
+#include <vector>
 
 namespace render
 {
@@ -48,6 +52,39 @@ private:
         return std::bind(&RenderableCollectionWalker::render, this, std::placeholders::_1);
     }
 
+    static bool isHighlighted(const scene::INodePtr& node, const scene::INodePtr& parent)
+    {
+        return node->isHighlighted() || (parent != NULL && parent->isHighlighted());
+    }
+
+    // Walker storing the visible nodes in traversal order
+    class VisibleNodeGatherer :
+        public scene::Graph::Walker
+    {
+    public:
+        std::vector<scene::INodePtr> nodes;
+
+        bool visit(const scene::INodePtr& node)
+        {
+            nodes.push_back(node);
+            return true;
+        }
+    };
+
+    // A range of visible nodes collected in one go
+    struct NodeRange
+    {
+        std::size_t begin;
+        std::size_t end;
+        bool parallel;
+    };
+
+    // Below this number of visible nodes everything is collected on the main thread
+    static const std::size_t PARALLEL_COLLECTION_THRESHOLD = 256;
+
+    // The maximum number of nodes collected by a single task
+    static const std::size_t NODES_PER_TASK = 128;
+
 public:
 
     // scene::Graph::Walker implementation
@@ -77,7 +114,7 @@ public:
 
         node->viewChanged();
 
-        if (node->isHighlighted() || (parent != NULL && parent->isHighlighted()))
+        if (isHighlighted(node, parent))
         {
             if (GlobalSelectionSystem().Mode() != SelectionSystem::eComponent)
             {
@@ -117,6 +154,102 @@ public:
         RenderableCollectionWalker walker(collector, volume);
         GlobalRenderSystem().forEachRenderable(walker.getRenderableCallback());
     }
+
+    /**
+     * \brief
+     * Like collectRenderablesInScene() above, with the lazily evaluated node
+     * geometry being built on the threads of the given pool.
+     *
+     * Culling is done on the calling thread, the visible nodes are then split
+     * into ranges of subsequent nodes, which correspond to subtrees of the
+     * space partition. Nodes supporting parallel collection (see
+     * Renderable::prepareParallelCollection) are visited by the worker threads,
+     * each range submitting to its own RenderableRecorder. All other nodes and
+     * the highlighted ones are visited on the calling thread afterwards, while
+     * the recorded ranges are passed to the collector in scene order.
+     */
+    static void collectRenderablesInScene(RenderableCollector& collector,
+                                          const VolumeTest& volume,
+                                          util::ThreadPool& pool)
+    {
+        VisibleNodeGatherer gatherer;
+
+        {
+            RenderStatistics::ScopedPhase traversal(RenderStatistics::PHASE_TRAVERSAL);
+
+            GlobalSceneGraph().foreachVisibleNodeInVolume(volume, gatherer);
+
+            RenderStatistics::Instance().addNodes(GlobalSceneGraph().getLastVisitedSPNodeCount(),
+                                                  GlobalSceneGraph().getLastCulledSPNodeCount());
+        }
+
+        RenderStatistics::ScopedPhase collection(RenderStatistics::PHASE_COLLECTION);
+
+        const std::vector<scene::INodePtr>& nodes = gatherer.nodes;
+
+        RenderableCollectionWalker walker(collector, volume);
+
+        if (pool.isSerial() || nodes.size() < PARALLEL_COLLECTION_THRESHOLD)
+        {
+            for (std::vector<scene::INodePtr>::const_iterator i = nodes.begin(); i != nodes.end(); ++i)
+            {
+                walker.visit(*i);
+            }
+
+            GlobalRenderSystem().forEachRenderable(walker.getRenderableCallback());
+            return;
+        }
+
+        // Prepare the nodes on this thread and split them into ranges
+        std::vector<NodeRange> ranges;
+
+        for (std::size_t i = 0; i < nodes.size(); ++i)
+        {
+            bool parallel = !isHighlighted(nodes[i], nodes[i]->getParent()) &&
+                            nodes[i]->prepareParallelCollection();
+
+            if (ranges.empty() || ranges.back().parallel != parallel ||
+                (parallel && ranges.back().end - ranges.back().begin >= NODES_PER_TASK))
+            {
+                NodeRange range = { i, i, parallel };
+                ranges.push_back(range);
+            }
+
+            ranges.back().end = i + 1;
+        }
+
+        std::vector<RenderableRecorder> recorders(ranges.size(),
+            RenderableRecorder(collector.supportsFullMaterials()));
+
+        util::parallelFor(pool, ranges.size(), [&](std::size_t r)
+        {
+            if (!ranges[r].parallel) return;
+
+            RenderableCollectionWalker rangeWalker(recorders[r], volume);
+
+            for (std::size_t i = ranges[r].begin; i < ranges[r].end; ++i)
+            {
+                rangeWalker.visit(nodes[i]);
+            }
+        });
+
+        // Submit everything in scene order
+        for (std::size_t r = 0; r < ranges.size(); ++r)
+        {
+            if (ranges[r].parallel)
+            {
+                recorders[r].replay(collector);
+                continue;
+            }
+
+            for (std::size_t i = ranges[r].begin; i < ranges[r].end; ++i)
+            {
+                walker.visit(nodes[i]);
+            }
+        }
+
+        GlobalRenderSystem().forEachRenderable(walker.getRenderableCallback());
+    }
 };
 
 } // namespace
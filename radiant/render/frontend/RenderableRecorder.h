@@ -0,0 +1,172 @@
+#pragma once
+
+#include "irenderable.h"
+#include <vector>
+
+namespace render
+{
+
+/**
+ * \brief
+ * RenderableCollector recording all submitted states and renderables,
+ * such that they can be passed to another collector later on.
+ *
+ * This is used to collect renderables on worker threads, the recorded
+ * calls are replayed into the view's collector on the main thread.
+ * The submitted objects and transforms are stored by reference, they
+ * need to stay valid until the collector has rendered them, which is
+ * the case for renderables submitted by scene nodes.
+ */
+class RenderableRecorder :
+    public RenderableCollector
+{
+private:
+    enum CommandType
+    {
+        PUSH_STATE,
+        POP_STATE,
+        SET_STATE,
+        HIGHLIGHT_FACES,
+        HIGHLIGHT_PRIMITIVES,
+        SET_LIGHTS,
+        ADD_RENDERABLE
+    };
+
+    struct Command
+    {
+        CommandType type;
+
+        // The style of SET_STATE, or the flag of the HIGHLIGHT_* commands
+        int arg;
+
+        ShaderPtr shader;
+        const LightList* lights;
+        const OpenGLRenderable* renderable;
+        const Matrix4* world;
+        const IRenderEntity* entity;
+
+        Command(CommandType type_, int arg_ = 0) :
+            type(type_),
+            arg(arg_),
+            lights(NULL),
+            renderable(NULL),
+            world(NULL),
+            entity(NULL)
+        {}
+    };
+
+    std::vector<Command> _commands;
+
+    bool _supportsFullMaterials;
+
+public:
+    // Pass the supportsFullMaterials() value of the collector this recording is meant for
+    RenderableRecorder(bool supportsFullMaterials) :
+        _supportsFullMaterials(supportsFullMaterials)
+    {}
+
+    bool empty() const
+    {
+        return _commands.empty();
+    }
+
+    void clear()
+    {
+        _commands.clear();
+    }
+
+    // Passes all recorded calls to the given collector, in the order they were made
+    void replay(RenderableCollector& collector) const
+    {
+        for (std::vector<Command>::const_iterator i = _commands.begin(); i != _commands.end(); ++i)
+        {
+            switch (i->type)
+            {
+            case PUSH_STATE:
+                collector.PushState();
+                break;
+            case POP_STATE:
+                collector.PopState();
+                break;
+            case SET_STATE:
+                collector.SetState(i->shader, static_cast<EStyle>(i->arg));
+                break;
+            case HIGHLIGHT_FACES:
+                collector.highlightFaces(i->arg != 0);
+                break;
+            case HIGHLIGHT_PRIMITIVES:
+                collector.highlightPrimitives(i->arg != 0);
+                break;
+            case SET_LIGHTS:
+                collector.setLights(*i->lights);
+                break;
+            case ADD_RENDERABLE:
+                if (i->entity != NULL)
+                {
+                    collector.addRenderable(*i->renderable, *i->world, *i->entity);
+                }
+                else
+                {
+                    collector.addRenderable(*i->renderable, *i->world);
+                }
+                break;
+            }
+        }
+    }
+
+    // RenderableCollector implementation
+    void PushState()
+    {
+        _commands.push_back(Command(PUSH_STATE));
+    }
+
+    void PopState()
+    {
+        _commands.push_back(Command(POP_STATE));
+    }
+
+    void SetState(const ShaderPtr& state, EStyle mode)
+    {
+        _commands.push_back(Command(SET_STATE, mode));
+        _commands.back().shader = state;
+    }
+
+    void addRenderable(const OpenGLRenderable& renderable, const Matrix4& world)
+    {
+        _commands.push_back(Command(ADD_RENDERABLE));
+        _commands.back().renderable = &renderable;
+        _commands.back().world = &world;
+    }
+
+    void addRenderable(const OpenGLRenderable& renderable, const Matrix4& world,
+                       const IRenderEntity& entity)
+    {
+        _commands.push_back(Command(ADD_RENDERABLE));
+        _commands.back().renderable = &renderable;
+        _commands.back().world = &world;
+        _commands.back().entity = &entity;
+    }
+
+    bool supportsFullMaterials() const
+    {
+        return _supportsFullMaterials;
+    }
+
+    void highlightFaces(bool enable)
+    {
+        _commands.push_back(Command(HIGHLIGHT_FACES, enable ? 1 : 0));
+    }
+
+    void highlightPrimitives(bool enable)
+    {
+        _commands.push_back(Command(HIGHLIGHT_PRIMITIVES, enable ? 1 : 0));
+    }
+
+    void setLights(const LightList& lights)
+    {
+        _commands.push_back(Command(SET_LIGHTS));
+        _commands.back().lights = &lights;
+    }
+};
+
+} // namespace
@@ -781,6 +781,9 @@ void RadiantSelectionSystem::outputScale(std::ostream& ostream) {
 
 // Shortcut call for an instantly applied rotation of the current selection
 void RadiantSelectionSystem::rotateSelected(const Quaternion& rotation) {
+    // Move the changed nodes in the space partition once, after freezing
+    scene::SpacePartitionBatch batch(GlobalSceneGraph().getSpacePartition());
+
     // Apply the transformation and freeze the changes
     startMove();
     rotate(rotation);
@@ -789,6 +792,9 @@ void RadiantSelectionSystem::rotateSelected(const Quaternion& rotation) {
 
 // Shortcut call for an instantly applied translation of the current selection
 void RadiantSelectionSystem::translateSelected(const Vector3& translation) {
+    // Move the changed nodes in the space partition once, after freezing
+    scene::SpacePartitionBatch batch(GlobalSceneGraph().getSpacePartition());
+
     // Apply the transformation and freeze the changes
     startMove();
     translate(translation);
@@ -797,6 +803,9 @@ void RadiantSelectionSystem::translateSelected(const Vector3& translation) {
 
 // Shortcut call for an instantly applied scaling of the current selection
 void RadiantSelectionSystem::scaleSelected(const Vector3& scaling) {
+    // Move the changed nodes in the space partition once, after freezing
+    scene::SpacePartitionBatch batch(GlobalSceneGraph().getSpacePartition());
+
     // Apply the transformation and freeze the changes
     startMove();
     scale(scaling);
@@ -814,6 +823,9 @@ void RadiantSelectionSystem::MoveSelected(const render::View& view, const Vector
         if (!_undoBegun) {
             _undoBegun = true;
             GlobalUndoSystem().start();
+
+            // Move the changed nodes in the space partition once per frame
+            _spacePartitionBatch.reset(new scene::SpacePartitionBatch(GlobalSceneGraph().getSpacePartition()));
         }
 
         Matrix4 device2manip;
@@ -898,6 +910,9 @@ void RadiantSelectionSystem::cancelMove() {
 		}
 	});
 
+    // Leave batch mode, this moves the reverted nodes back
+    _spacePartitionBatch.reset();
+
     _pivotMoving = false;
     pivotChanged();
 
@@ -945,6 +960,9 @@ void RadiantSelectionSystem::endMove() {
     // Remove all degenerated brushes from the scene graph (should emit a warning)
     foreachSelected(RemoveDegenerateBrushWalker());
 
+    // Leave batch mode, the nodes are moved to their final location
+    _spacePartitionBatch.reset();
+
     _pivotMoving = false;
     pivotChanged();
 
@@ -4,6 +4,7 @@
 #include "irenderable.h"
 #include "iselection.h"
 #include "icommandsystem.h"
+#include "ispacepartition.h"
 
 #include "selectionlib.h"
 #include "math/Matrix4.h"
@@ -95,6 +96,9 @@ private:
 
 	// state
 	bool _undoBegun;
+
+	// Defers the space partition updates while the selection is being manipulated
+	scene::SpacePartitionBatchPtr _spacePartitionBatch;
 	EMode _mode;
 	EComponentMode _componentMode;
 
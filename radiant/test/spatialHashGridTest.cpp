@@ -0,0 +1,93 @@
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE spatialHashGridTest
+#include <boost/test/unit_test.hpp>
+
+#include "radiant/render/SpatialHashGrid.h"
+#include <set>
+
+namespace
+{
+    struct Item
+    {
+        int id;
+    };
+
+    typedef render::SpatialHashGrid<Item> Grid;
+
+    std::multiset<int> query(const Grid& grid, const AABB& bounds)
+    {
+        std::multiset<int> result;
+
+        grid.forEachIntersecting(bounds, [&](Item& item)
+        {
+            result.insert(item.id);
+        });
+
+        return result;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(reportItemsOnce)
+{
+    Grid grid(64);
+
+    // Spans several cells
+    Item large = { 1 };
+    grid.insert(large, AABB(Vector3(0, 0, 0), Vector3(100, 100, 100)));
+
+    Item small = { 2 };
+    grid.insert(small, AABB(Vector3(300, 0, 0), Vector3(8, 8, 8)));
+
+    std::multiset<int> found = query(grid, AABB(Vector3(50, 0, 0), Vector3(100, 100, 100)));
+
+    BOOST_CHECK_EQUAL(found.count(1), 1);
+    BOOST_CHECK_EQUAL(found.count(2), 0);
+
+    found = query(grid, AABB(Vector3(200, 0, 0), Vector3(120, 20, 20)));
+
+    BOOST_CHECK_EQUAL(found.count(1), 1);
+    BOOST_CHECK_EQUAL(found.count(2), 1);
+}
+
+BOOST_AUTO_TEST_CASE(oversizedAndInvalidItems)
+{
+    Grid grid(64);
+
+    // Covers far more cells than allowed per item
+    Item world = { 1 };
+    grid.insert(world, AABB(Vector3(0, 0, 0), Vector3(10000, 10000, 10000)));
+
+    Item unbounded = { 2 };
+    grid.insert(unbounded, AABB());
+
+    std::multiset<int> found = query(grid, AABB(Vector3(500, 500, 500), Vector3(1, 1, 1)));
+
+    BOOST_CHECK_EQUAL(found.count(1), 1);
+    BOOST_CHECK_EQUAL(found.count(2), 1);
+
+    found = query(grid, AABB(Vector3(20000, 0, 0), Vector3(1, 1, 1)));
+
+    BOOST_CHECK_EQUAL(found.count(1), 0);
+    BOOST_CHECK_EQUAL(found.count(2), 1);
+}
+
+BOOST_AUTO_TEST_CASE(removeAndReinsert)
+{
+    Grid grid(64);
+
+    Item item = { 1 };
+    grid.insert(item, AABB(Vector3(0, 0, 0), Vector3(100, 10, 10)));
+
+    BOOST_CHECK(grid.contains(item));
+
+    grid.remove(item);
+
+    BOOST_CHECK(!grid.contains(item));
+    BOOST_CHECK(query(grid, AABB(Vector3(0, 0, 0), Vector3(100, 10, 10))).empty());
+
+    // Move the item somewhere else
+    grid.insert(item, AABB(Vector3(1000, 0, 0), Vector3(10, 10, 10)));
+
+    BOOST_CHECK(query(grid, AABB(Vector3(0, 0, 0), Vector3(100, 10, 10))).empty());
+    BOOST_CHECK_EQUAL(query(grid, AABB(Vector3(1000, 0, 0), Vector3(1, 1, 1))).count(1), 1);
+}